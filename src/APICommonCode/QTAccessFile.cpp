@@ -80,58 +80,57 @@ Bool16      QTAccessFile::sAllocatedName = false;
 OSMutex*    QTAccessFile::sAccessFileMutex = NULL;//QTAccessFile isn't reentrant
 const int kBuffLen = 512;
 
-void QTAccessFile::Initialize() // called by server at initialize never call again
+//
+// The access file cache. Every path that has been checked for an access file
+// gets an entry, including paths that turned out not to have one, so walking up
+// the directory tree is just a series of lookups in here.
+struct QTAccessFileCacheEntry
 {
-    if (NULL == sAccessFileMutex)
-    {   sAccessFileMutex = NEW OSMutex();
-    }
-}
+    char*                   fPath;
+    UInt32                  fHashValue;
+    QTAccessFileRules*      fRules;             //NULL if there is no access file at fPath
+    QTSS_TimeVal            fModDate;
+    SInt64                  fLastCheckedMSecs;
+    QTAccessFileCacheEntry* fNextHashEntry;
+};
 
-void QTAccessFile::SetAccessFileName(const char *inQTAccessFileName)
+enum
 {
-    OSMutexLocker locker(sAccessFileMutex);
-    if (NULL == inQTAccessFileName)
-    {   Assert(NULL != inQTAccessFileName);
-        return;
-    }
-    
-    if (sAllocatedName)
-    {   delete [] sQTAccessFileName;
-    }
-    
-    sAllocatedName = true;
-    sQTAccessFileName = NEW char[strlen(inQTAccessFileName)+1];
-    ::strcpy(sQTAccessFileName, inQTAccessFileName);
-    
-}
+    kNumAccessFileCacheBuckets = 1024 //UInt32. must be a power of 2
+};
 
+static QTAccessFileCacheEntry*  sAccessFileCache[kNumAccessFileCacheBuckets];
+static UInt32                   sNumCachedAccessFiles = 0;
 
-Bool16 QTAccessFile::AccessAllowed  (   char *userName, char**groupArray, UInt32 numGroups, StrPtrLen *accessFileBufPtr,
-                                        QTSS_ActionFlags inFlags,StrPtrLen* ioRealmNameStr 
-                                    )
-{       
-    if (NULL == accessFileBufPtr || NULL == accessFileBufPtr->Ptr || 0 == accessFileBufPtr->Len)
-        return false; // nothing to check
-    if (ioRealmNameStr != NULL && ioRealmNameStr->Ptr != NULL && ioRealmNameStr->Len > 0)
-        ioRealmNameStr->Ptr[0] = 0;
+static UInt32 HashAccessFilePath(const char* inPath)
+{
+    UInt32 theHash = 0;
+    for (const UInt8* theChar = (const UInt8*)inPath; *theChar != '\0'; theChar++)
+        theHash = (theHash * 31) + *theChar;
+    return theHash;
+}
+
+QTAccessFileRules::QTAccessFileRules(StrPtrLen* inAccessFileBuf)
+:   fText(NULL),
+    fDirectives(NULL),
+    fNumDirectives(0),
+    fDirectivesSize(0),
+    fRefCount(0)
+{
+    if (NULL == inAccessFileBuf || NULL == inAccessFileBuf->Ptr || 0 == inAccessFileBuf->Len)
+        return;
         
-    StringParser            accessFileParser(accessFileBufPtr);
-    QTSS_ActionFlags        currentFlags = qtssActionFlagsRead; 
-    StrPtrLen               line;
-    StrPtrLen               word;
-    Bool16                  haveUserName = false;
-    Bool16                  haveRealmResultBuffer = false;
-    Bool16                  haveGroups = false;
+    StrPtrLen theText(inAccessFileBuf->GetAsCString(), inAccessFileBuf->Len);
+    fText = theText.Ptr;
     
-    if (NULL != userName && 0 != userName[0])
-        haveUserName = true;
+    //
+    // This keeps just the lines that AccessAllowed and FindUsersAndGroupsFilesAndAuthScheme
+    // used to act on, parsed the same way they parsed them.
+    StringParser    accessFileParser(&theText);
+    StrPtrLen       line;
+    StrPtrLen       word;
+    Directive*      theDirective = NULL;
     
-    if (numGroups > 0 && groupArray != NULL)
-        haveGroups = true;
-        
-    if (ioRealmNameStr != NULL && ioRealmNameStr->Ptr != NULL && ioRealmNameStr->Len > 0)
-        haveRealmResultBuffer = true;
-        
     while( accessFileParser.GetDataRemaining() != 0 ) 
     {
         accessFileParser.GetThruEOL(&line);  // Read each line  
@@ -147,111 +146,320 @@ Bool16 QTAccessFile::AccessAllowed  (   char *userName, char**groupArray, UInt32
         lineParser.ConsumeUntilWhitespace(&word);
         if ( word.Equal("<Limit") ) // a limit line
         {
-            currentFlags = qtssActionFlagsNoFlags; // clear to no access
+            this->AddDirective(kLimit, &theDirective);
             lineParser.ConsumeWhitespace();
-            lineParser.ConsumeUntil( &word, sWhitespaceAndGreaterThanMask); // the flag <limit Read> or <limit Read >
+            lineParser.ConsumeUntil( &word, QTAccessFile::sWhitespaceAndGreaterThanMask); // the flag <limit Read> or <limit Read >
             while (word.Len != 0) // compare each word in the line
             {   
                 if (word.Equal("WRITE")  ) 
-                {   currentFlags |= inFlags & qtssActionFlagsWrite; // accept following lines if inFlags has write
-                }
+                    theDirective->fLimitFlags |= qtssActionFlagsWrite;
                 
                 if (word.Equal("READ") ) 
-                {   currentFlags |= inFlags & qtssActionFlagsRead; // accept following lines if inFlags has read
-                }
+                    theDirective->fLimitFlags |= qtssActionFlagsRead;
+                    
                 lineParser.ConsumeWhitespace();
-                lineParser.ConsumeUntil(&word, sWhitespaceAndGreaterThanMask);
+                lineParser.ConsumeUntil(&word, QTAccessFile::sWhitespaceAndGreaterThanMask);
             }
             continue; //done with limit line
         }
+        
         if ( word.Equal("</Limit>") )
-            currentFlags = qtssActionFlagsRead; // set the current access state to the default of read access
+        {   this->AddDirective(kEndLimit, &theDirective);
+            continue;
+        }
         
-        if (0 == (currentFlags & inFlags))
-            continue; // ignore lines because inFlags doesn't match the current access state
-            
-        if (haveRealmResultBuffer && word.Equal("AuthName") ) //realm name
-        {   
+        if ( word.Equal("AuthName") || word.Equal("AuthUserFile") || word.Equal("AuthGroupFile") )
+        {
+            if (word.Equal("AuthName"))
+                this->AddDirective(kAuthName, &theDirective);
+            else if (word.Equal("AuthUserFile"))
+                this->AddDirective(kAuthUserFile, &theDirective);
+            else
+                this->AddDirective(kAuthGroupFile, &theDirective);
+                
+            lineParser.ConsumeWhitespace();
+            lineParser.GetThruEOL(&theDirective->fValue);
+            StringParser::UnQuote(&theDirective->fValue);// if the parsed string is surrounded by quotes then remove them.
+            continue;
+        }
+        
+        if (word.Equal("AuthScheme") )
+        {
+            this->AddDirective(kAuthScheme, &theDirective);
             lineParser.ConsumeWhitespace();
             lineParser.GetThruEOL(&word);
             StringParser::UnQuote(&word);// if the parsed string is surrounded by quotes then remove them.
-            
-            if (ioRealmNameStr->Len <= word.Len) 
-                word.Len = ioRealmNameStr->Len -1; // just copy what we can
-            ::memcpy(ioRealmNameStr->Ptr, word.Ptr,word.Len);
-            ioRealmNameStr->Ptr[word.Len] = 0; 
-            // we don't change the buffer len ioRealmNameStr->Len because we might have another AuthName tag to copy
-            continue; // done with AuthName (realm)
+
+            if (word.Equal("basic"))
+                theDirective->fAuthScheme = qtssAuthBasic;
+            else if (word.Equal("digest"))
+                theDirective->fAuthScheme = qtssAuthDigest;
+            continue;
         }
         
-        
         if (word.Equal("require") )
         {
             lineParser.ConsumeWhitespace();
             lineParser.ConsumeUntilWhitespace(&word);       
 
-            if (haveUserName && word.Equal("valid-user") ) 
-            {   return true; 
-            }
-            
-            if ( word.Equal("any-user")  ) 
-            {   return true; 
-            }
-    
-            if (!haveUserName)
-                continue;
+            if ( word.Equal("valid-user") ) 
+                this->AddDirective(kRequireValidUser, &theDirective);
+            else if ( word.Equal("any-user")  ) 
+                this->AddDirective(kRequireAnyUser, &theDirective);
+            else if ( word.Equal("user") || word.Equal("group") )
+            {
+                this->AddDirective(word.Equal("user") ? kRequireUser : kRequireGroup, &theDirective);
                 
-            if (word.Equal("user") )
-            {   
+                //count the names, then go back and collect them
+                StringParser countParser(lineParser);
+                UInt32 theNumNames = 0;
+                countParser.ConsumeWhitespace();
+                countParser.ConsumeUntilWhitespace(&word);
+                while (word.Len != 0)
+                {   theNumNames++;
+                    countParser.ConsumeWhitespace();
+                    countParser.ConsumeUntilWhitespace(&word);
+                }
+                
+                theDirective->fNames = NEW StrPtrLen[theNumNames + 1];
                 lineParser.ConsumeWhitespace();
-                lineParser.ConsumeUntilWhitespace(&word);   
-                    
+                lineParser.ConsumeUntilWhitespace(&word);
                 while (word.Len != 0) // compare each word in the line
-                {   
-                    if ( word.Equal(userName) ) 
-                    {   return true; 
-                    }
+                {   theDirective->fNames[theDirective->fNumNames++] = word;
                     lineParser.ConsumeWhitespace();
                     lineParser.ConsumeUntilWhitespace(&word);       
                 }
-                continue; // done with "require user" line
             }
+            continue; // done with "require" line
+        }
+    }
+}
+
+QTAccessFileRules::~QTAccessFileRules()
+{
+    Assert(fRefCount == 0);
+    for (UInt32 x = 0; x < fNumDirectives; x++)
+        delete [] fDirectives[x].fNames;
+    delete [] fDirectives;
+    delete [] fText;
+}
+
+void QTAccessFileRules::AddDirective(UInt32 inType, Directive** outDirective)
+{
+    if (fNumDirectives == fDirectivesSize)
+    {
+        UInt32 theNewSize = (fDirectivesSize == 0) ? 8 : fDirectivesSize * 2;
+        Directive* theNewDirectives = NEW Directive[theNewSize];
+        for (UInt32 x = 0; x < fNumDirectives; x++)
+            theNewDirectives[x] = fDirectives[x];
+        delete [] fDirectives;
+        fDirectives = theNewDirectives;
+        fDirectivesSize = theNewSize;
+    }
+    
+    Directive* theDirective = &fDirectives[fNumDirectives++];
+    theDirective->fType = inType;
+    theDirective->fLimitFlags = qtssActionFlagsNoFlags;
+    theDirective->fValue.Set(NULL, 0);
+    theDirective->fAuthScheme = qtssAuthNone;
+    theDirective->fNames = NULL;
+    theDirective->fNumNames = 0;
+    *outDirective = theDirective;
+}
+
+Bool16 QTAccessFileRules::AccessAllowed (   char *userName, char**groupArray, UInt32 numGroups, 
+                                            QTSS_ActionFlags inFlags, StrPtrLen* ioRealmNameStr
+                                        )
+{
+    if (NULL == fText)
+        return false; // nothing to check
+    if (ioRealmNameStr != NULL && ioRealmNameStr->Ptr != NULL && ioRealmNameStr->Len > 0)
+        ioRealmNameStr->Ptr[0] = 0;
+        
+    QTSS_ActionFlags        currentFlags = qtssActionFlagsRead; 
+    Bool16                  haveUserName = false;
+    Bool16                  haveRealmResultBuffer = false;
+    Bool16                  haveGroups = false;
+    
+    if (NULL != userName && 0 != userName[0])
+        haveUserName = true;
+    
+    if (numGroups > 0 && groupArray != NULL)
+        haveGroups = true;
+        
+    if (ioRealmNameStr != NULL && ioRealmNameStr->Ptr != NULL && ioRealmNameStr->Len > 0)
+        haveRealmResultBuffer = true;
+        
+    for (UInt32 x = 0; x < fNumDirectives; x++)
+    {
+        Directive* theDirective = &fDirectives[x];
+        
+        if (theDirective->fType == kLimit)
+        {   currentFlags = theDirective->fLimitFlags & inFlags; // accept following lines if inFlags has the limit's access
+            continue;
+        }
+        if (theDirective->fType == kEndLimit)
+        {   currentFlags = qtssActionFlagsRead; // set the current access state to the default of read access
+            continue;
+        }
+        
+        if (0 == (currentFlags & inFlags))
+            continue; // ignore lines because inFlags doesn't match the current access state
             
-            if (haveGroups && word.Equal("group")) // check if we have groups for the user
+        switch (theDirective->fType)
+        {
+            case kAuthName:
             {
-                lineParser.ConsumeWhitespace();
-                lineParser.ConsumeUntilWhitespace(&word);       
+                if (!haveRealmResultBuffer)
+                    break;
+                    
+                UInt32 theLen = theDirective->fValue.Len;
+                if (ioRealmNameStr->Len <= theLen) 
+                    theLen = ioRealmNameStr->Len -1; // just copy what we can
+                ::memcpy(ioRealmNameStr->Ptr, theDirective->fValue.Ptr, theLen);
+                ioRealmNameStr->Ptr[theLen] = 0; 
+                // we don't change the buffer len ioRealmNameStr->Len because we might have another AuthName tag to copy
+                break;
+            }
+            
+            case kRequireValidUser:
+                if (haveUserName)
+                    return true;
+                break;
                 
-                while (word.Len != 0) // compare each word in the line
-                {   
-                    for (UInt32 index = 0; index < numGroups; index ++)
-                    {   if(word.Equal(groupArray[index])) 
+            case kRequireAnyUser:
+                return true;
+                
+            case kRequireUser:
+                if (!haveUserName)
+                    break;
+                for (UInt32 y = 0; y < theDirective->fNumNames; y++)
+                {   if (theDirective->fNames[y].Equal(userName))
+                        return true;
+                }
+                break;
+                
+            case kRequireGroup:
+                if (!haveUserName || !haveGroups) // check if we have groups for the user
+                    break;
+                for (UInt32 y = 0; y < theDirective->fNumNames; y++)
+                {   for (UInt32 index = 0; index < numGroups; index ++)
+                    {   if (theDirective->fNames[y].Equal(groupArray[index])) 
                             return true;
                     }
-                
-                    lineParser.ConsumeWhitespace();
-                    lineParser.ConsumeUntilWhitespace(&word);
                 }
-                continue; // done with "require group" line
-            }
-                    
-            continue; // done with unparsed "require" line
+                break;
         }
-        
     }
     
     return false; // user or group not found
 }
 
+QTSS_AuthScheme QTAccessFileRules::FindUsersAndGroupsFilesAndAuthScheme(QTSS_ActionFlags inAction, char** outUsersFilePath, char** outGroupsFilePath)
+{
+    QTSS_AuthScheme authScheme = qtssAuthNone;
+    QTSS_ActionFlags currentFlags = qtssActionFlagsRead;
+    
+    *outUsersFilePath = NULL;
+    *outGroupsFilePath = NULL;
+    
+    for (UInt32 x = 0; x < fNumDirectives; x++)
+    {
+        Directive* theDirective = &fDirectives[x];
+        
+        if (theDirective->fType == kLimit)
+        {   currentFlags = theDirective->fLimitFlags & inAction;
+            continue;
+        }
+        if (theDirective->fType == kEndLimit)
+        {   currentFlags = qtssActionFlagsRead;
+            continue;
+        }
+        
+        if (0 == (currentFlags & inAction))
+            continue; // ignore lines because inAction doesn't match the current access state
+            
+        switch (theDirective->fType)
+        {
+            case kAuthUserFile:
+                // The last one found takes precedence...delete the previous path
+                delete [] *outUsersFilePath;
+                *outUsersFilePath = theDirective->fValue.GetAsCString();
+                break;
+                
+            case kAuthGroupFile:
+                delete [] *outGroupsFilePath;
+                *outGroupsFilePath = theDirective->fValue.GetAsCString();
+                break;
+                
+            case kAuthScheme:
+                if (theDirective->fAuthScheme != qtssAuthNone)
+                    authScheme = theDirective->fAuthScheme;
+                break;
+        }
+    }
+    
+    return authScheme;
+}
+
+void QTAccessFile::Initialize() // called by server at initialize never call again
+{
+    if (NULL == sAccessFileMutex)
+    {   sAccessFileMutex = NEW OSMutex();
+    }
+}
+
+void QTAccessFile::SetAccessFileName(const char *inQTAccessFileName)
+{
+    OSMutexLocker locker(sAccessFileMutex);
+    if (NULL == inQTAccessFileName)
+    {   Assert(NULL != inQTAccessFileName);
+        return;
+    }
+    
+    if (sAllocatedName)
+    {   delete [] sQTAccessFileName;
+    }
+    
+    sAllocatedName = true;
+    sQTAccessFileName = NEW char[strlen(inQTAccessFileName)+1];
+    ::strcpy(sQTAccessFileName, inQTAccessFileName);
+    
+    //the cache is keyed by full path, so entries for the old name would just sit there
+    FlushAccessFileCache();
+    
+}
+
+
+Bool16 QTAccessFile::AccessAllowed  (   char *userName, char**groupArray, UInt32 numGroups, StrPtrLen *accessFileBufPtr,
+                                        QTSS_ActionFlags inFlags,StrPtrLen* ioRealmNameStr 
+                                    )
+{       
+    QTAccessFileRules theRules(accessFileBufPtr);
+    return theRules.AccessAllowed(userName, groupArray, numGroups, inFlags, ioRealmNameStr);
+}
+
 char*  QTAccessFile::GetAccessFile_Copy( const char* movieRootDir, const char* dirPath)
+{   
+    char* theAccessFilePath = NULL;
+    QTAccessFileRules* theRules = QTAccessFile::GetAccessFileRules(movieRootDir, dirPath, &theAccessFilePath);
+    QTAccessFile::ReleaseAccessFileRules(theRules);
+    return theAccessFilePath;
+}
+
+QTAccessFileRules* QTAccessFile::GetAccessFileRules(const char* movieRootDir, const char* dirPath, char** outAccessFilePath)
 {   
     OSMutexLocker locker(sAccessFileMutex);
 
+    if (outAccessFilePath != NULL)
+        *outAccessFilePath = NULL;
+        
     char* currentDir= NULL;
     char* lastSlash = NULL;
     int movieRootDirLen = ::strlen(movieRootDir);
     int maxLen = strlen(dirPath)+strlen(sQTAccessFileName) + strlen(kPathDelimiterString) + 1;
     currentDir = NEW char[maxLen];
+    OSCharArrayDeleter currentDirDeleter(currentDir);
 
     ::strcpy(currentDir, dirPath);
 
@@ -272,11 +480,15 @@ char*  QTAccessFile::GetAccessFile_Copy( const char* movieRootDir, const char* d
         ::strcat(currentDir, kPathDelimiterString);
         ::strcat(currentDir, sQTAccessFileName);
     
-        QTSS_Object fileObject = NULL;
-        if( QTSS_OpenFileObject(currentDir, qtssOpenFileNoFlags, &fileObject) == QTSS_NoErr) 
+        QTAccessFileRules* theRules = QTAccessFile::LookupAccessFile(currentDir);
+        if (theRules != NULL) 
         {
-            (void)QTSS_CloseFileObject(fileObject);
-            return currentDir;
+            if (outAccessFilePath != NULL)
+            {
+                currentDirDeleter.ClearObject();
+                *outAccessFilePath = currentDir;
+            }
+            return theRules;
         }
                 
         //strip off the "/qtaccess"
@@ -294,116 +506,126 @@ char*  QTAccessFile::GetAccessFile_Copy( const char* movieRootDir, const char* d
             break;
     }
     
-    delete[] currentDir;
     return NULL;
 }
 
-// allocates memory for outUsersFilePath and outGroupsFilePath - remember to delete
-// returns the auth scheme
-QTSS_AuthScheme QTAccessFile::FindUsersAndGroupsFilesAndAuthScheme(char* inAccessFilePath, QTSS_ActionFlags inAction, char** outUsersFilePath, char** outGroupsFilePath)
+void QTAccessFile::ReleaseAccessFileRules(QTAccessFileRules* inRules)
 {
-    QTSS_AuthScheme authScheme = qtssAuthNone;
-    QTSS_ActionFlags currentFlags = qtssActionFlagsRead;
-    
-    if (inAccessFilePath == NULL)
-    return authScheme;
+    if (inRules == NULL)
+        return;
         
-    *outUsersFilePath = NULL;
-    *outGroupsFilePath = NULL;
-    //Assert(outUsersFilePath == NULL);
-    //Assert(outGroupsFilePath == NULL);
-    
-    StrPtrLen accessFileBuf;
-    (void)QTSSModuleUtils::ReadEntireFile(inAccessFilePath, &accessFileBuf);
-    OSCharArrayDeleter accessFileBufDeleter(accessFileBuf.Ptr);
+    OSMutexLocker locker(sAccessFileMutex);
+    Assert(inRules->fRefCount > 0);
+    inRules->fRefCount--;
+    if (inRules->fRefCount == 0)
+        delete inRules;
+}
+
+QTAccessFileRules* QTAccessFile::LookupAccessFile(char* inAccessFilePath)
+{
+    UInt32 theHashValue = HashAccessFilePath(inAccessFilePath);
+    QTAccessFileCacheEntry* theEntry = sAccessFileCache[theHashValue & (kNumAccessFileCacheBuckets - 1)];
+    for ( ; theEntry != NULL; theEntry = theEntry->fNextHashEntry)
+    {
+        if ((theEntry->fHashValue == theHashValue) && (::strcmp(theEntry->fPath, inAccessFilePath) == 0))
+            break;
+    }
     
-    StringParser accessFileParser(&accessFileBuf);
-    StrPtrLen line;
-    StrPtrLen word;
+    if (theEntry == NULL)
+    {
+        //Bogus URLs can make up any number of paths, so don't let the cache grow without limit
+        if (sNumCachedAccessFiles >= kMaxCachedAccessFiles)
+            QTAccessFile::FlushAccessFileCache();
+            
+        theEntry = NEW QTAccessFileCacheEntry;
+        theEntry->fPath = NEW char[::strlen(inAccessFilePath) + 1];
+        ::strcpy(theEntry->fPath, inAccessFilePath);
+        theEntry->fHashValue = theHashValue;
+        theEntry->fRules = NULL;
+        theEntry->fModDate = -1;
+        theEntry->fLastCheckedMSecs = 0;
+        theEntry->fNextHashEntry = sAccessFileCache[theHashValue & (kNumAccessFileCacheBuckets - 1)];
+        sAccessFileCache[theHashValue & (kNumAccessFileCacheBuckets - 1)] = theEntry;
+        sNumCachedAccessFiles++;
+    }
     
-    while( accessFileParser.GetDataRemaining() != 0 ) 
+    SInt64 theCurrentTime = QTSS_Milliseconds();
+    if ((theEntry->fLastCheckedMSecs == 0) || ((theCurrentTime - theEntry->fLastCheckedMSecs) >= kAccessFileCheckIntervalMSecs))
     {
-    accessFileParser.GetThruEOL(&line);     // Read each line   
-    StringParser lineParser(&line);
-    lineParser.ConsumeWhitespace();         //skip over leading whitespace
-    if (lineParser.GetDataRemaining() == 0)     // must be an empty line
-        continue;
-
-    char firstChar = lineParser.PeekFast();
-    if ( (firstChar == '#') || (firstChar == '\0') )
-        continue;               //skip over comments and blank lines...
+        //
+        // Only read the file if it has changed since we parsed it. ReadEntireFile
+        // leaves the buffer empty if the mod date is no newer than the one passed in.
+        StrPtrLen theFileData;
+        QTSS_TimeVal theModDate = -1;
+        QTSS_Error theErr = QTSSModuleUtils::ReadEntireFile(inAccessFilePath, &theFileData,
+                                    (theEntry->fRules != NULL) ? theEntry->fModDate : -1, &theModDate);
+        OSCharArrayDeleter theFileDataDeleter(theFileData.Ptr);
         
-        lineParser.ConsumeUntilWhitespace(&word);
-               
-        if ( word.Equal("<Limit") ) // a limit line
-    {
-        currentFlags = qtssActionFlagsNoFlags; // clear to no access
-        lineParser.ConsumeWhitespace();
-        lineParser.ConsumeUntil( &word, sWhitespaceAndGreaterThanMask); // the flag <limit Read> or <limit Read >
-        while (word.Len != 0) // compare each word in the line
-        {   
-            if (word.Equal("WRITE")  ) 
-            {   
-                            currentFlags |= inAction & qtssActionFlagsWrite; // accept following lines if inFlags has write
+        if ((theErr != QTSS_NoErr) || (theFileData.Ptr != NULL))
+        {
+            //the file is gone, or has changed
+            if (theEntry->fRules != NULL)
+            {   theEntry->fRules->fRefCount--;
+                if (theEntry->fRules->fRefCount == 0)
+                    delete theEntry->fRules;
+                theEntry->fRules = NULL;
             }
-                
-            if (word.Equal("READ") ) 
-            {   
-                            currentFlags |= inAction & qtssActionFlagsRead; // accept following lines if inFlags has read
+            if (theErr == QTSS_NoErr)
+            {   theEntry->fRules = NEW QTAccessFileRules(&theFileData);
+                theEntry->fRules->fRefCount++; //the cache's reference
+                theEntry->fModDate = theModDate;
             }
-                        
-            lineParser.ConsumeWhitespace();
-            lineParser.ConsumeUntil(&word, sWhitespaceAndGreaterThanMask);
-                }
-                continue; //done with limit line
         }
-        
-        if ( word.Equal("</Limit>") )
-                currentFlags = qtssActionFlagsRead; // set the current access state to the default of read access
-        
-        if (0 == (currentFlags & inAction))
-            continue; // ignore lines because inFlags doesn't match the current access state
-            
-        if (word.Equal("AuthUserFile") )
-    {
-                lineParser.ConsumeWhitespace();
-                lineParser.GetThruEOL(&word);
-                StringParser::UnQuote(&word);// if the parsed string is surrounded by quotes then remove them.
-        
-                if(*outUsersFilePath != NULL)       // we are encountering the AuthUserFile keyword twice!
-                    delete[] *outUsersFilePath; // The last one found takes precedence...delete the previous path
-                
-                *outUsersFilePath = word.GetAsCString();
-        continue;
-        }
-        
-        if (word.Equal("AuthGroupFile") )
-        {
-            lineParser.ConsumeWhitespace();
-            lineParser.GetThruEOL(&word);
-            StringParser::UnQuote(&word);// if the parsed string is surrounded by quotes then remove them.
+        theEntry->fLastCheckedMSecs = theCurrentTime;
+    }
+    
+    if (theEntry->fRules != NULL)
+        theEntry->fRules->fRefCount++; //the caller's reference
+    return theEntry->fRules;
+}
 
-            if(*outGroupsFilePath != NULL)      // we are encountering the AuthGroupFile keyword twice!
-                delete[] *outGroupsFilePath;    // The last one found takes precedence...delete the previous path       
-        *outGroupsFilePath = word.GetAsCString();
-        continue;
-        }
-        
-        if (word.Equal("AuthScheme") )
+void QTAccessFile::FlushAccessFileCache()
+{
+    for (UInt32 theBucket = 0; theBucket < kNumAccessFileCacheBuckets; theBucket++)
+    {
+        QTAccessFileCacheEntry* theEntry = sAccessFileCache[theBucket];
+        while (theEntry != NULL)
         {
-            lineParser.ConsumeWhitespace();
-            lineParser.GetThruEOL(&word);
-            StringParser::UnQuote(&word);// if the parsed string is surrounded by quotes then remove them.
-
-            if (word.Equal("basic"))
-                authScheme = qtssAuthBasic;
-            else if (word.Equal("digest"))
-                authScheme = qtssAuthDigest;
-                
-            continue;
+            QTAccessFileCacheEntry* theNextEntry = theEntry->fNextHashEntry;
+            if (theEntry->fRules != NULL)
+            {   theEntry->fRules->fRefCount--;
+                if (theEntry->fRules->fRefCount == 0)
+                    delete theEntry->fRules;
+            }
+            delete [] theEntry->fPath;
+            delete theEntry;
+            theEntry = theNextEntry;
         }
+        sAccessFileCache[theBucket] = NULL;
     }
+    sNumCachedAccessFiles = 0;
+}
+
+// allocates memory for outUsersFilePath and outGroupsFilePath - remember to delete
+// returns the auth scheme
+QTSS_AuthScheme QTAccessFile::FindUsersAndGroupsFilesAndAuthScheme(char* inAccessFilePath, QTSS_ActionFlags inAction, char** outUsersFilePath, char** outGroupsFilePath)
+{
+    if (inAccessFilePath == NULL)
+    return qtssAuthNone;
+        
+    *outUsersFilePath = NULL;
+    *outGroupsFilePath = NULL;
     
+    QTAccessFileRules* theRules = NULL;
+    {
+        OSMutexLocker locker(sAccessFileMutex);
+        theRules = QTAccessFile::LookupAccessFile(inAccessFilePath);
+    }
+    if (theRules == NULL)
+        return qtssAuthNone;
+        
+    QTSS_AuthScheme authScheme = theRules->FindUsersAndGroupsFilesAndAuthScheme(inAction, outUsersFilePath, outGroupsFilePath);
+    QTAccessFile::ReleaseAccessFileRules(theRules);
     return authScheme;
 }
 
@@ -439,10 +661,9 @@ QTSS_Error QTAccessFile::AuthorizeRequest(QTSS_StandardRTSP_Params* inParams, Bo
     if (NULL == theUserProfile)
         return QTSS_RequestFailed;
 
-    char* accessFilePath = QTAccessFile::GetAccessFile_Copy(movieRootDirStr, pathBuffStr);
-    OSCharArrayDeleter accessFilePathDeleter(accessFilePath);
+    QTAccessFileRules* accessFileRules = QTAccessFile::GetAccessFileRules(movieRootDirStr, pathBuffStr, NULL);
     
-    if (NULL == accessFilePath) // we are done nothing to do
+    if (NULL == accessFileRules) // we are done nothing to do
     {   if (QTSS_NoErr != QTSS_SetValue(theRTSPRequest,qtssRTSPReqUserAllowed, 0, &allowNoAccessFiles, sizeof(allowNoAccessFiles)))
             return QTSS_RequestFailed; // Bail on the request. The Server will handle the error
         return QTSS_NoErr;
@@ -455,15 +676,12 @@ QTSS_Error QTAccessFile::AuthorizeRequest(QTSS_StandardRTSP_Params* inParams, Bo
     char** groupCharPtrArray =  QTSSModuleUtils::GetGroupsArray_Copy(theUserProfile, &numGroups);
     OSCharPointerArrayDeleter groupCharPtrArrayDeleter(groupCharPtrArray);
     
-    StrPtrLen accessFileBuf;
-    (void)QTSSModuleUtils::ReadEntireFile(accessFilePath, &accessFileBuf);
-    OSCharArrayDeleter accessFileBufDeleter(accessFileBuf.Ptr);
-        
     char realmName[kBuffLen] = { 0 };
     StrPtrLen   realmNameStr(realmName,kBuffLen -1);
     
     //check if this user is allowed to see this movie
-    Bool16 allowRequest = QTAccessFile::AccessAllowed(username, groupCharPtrArray, numGroups,  &accessFileBuf, authorizeAction,&realmNameStr);
+    Bool16 allowRequest = accessFileRules->AccessAllowed(username, groupCharPtrArray, numGroups, authorizeAction,&realmNameStr);
+    QTAccessFile::ReleaseAccessFileRules(accessFileRules);
     
     // Get the auth scheme
     QTSS_AuthScheme theAuthScheme = qtssAuthNone;
@@ -27,6 +27,10 @@
 
     Contains:   This object contains an interface for finding and parsing qtaccess files.
                 
+                Parsed qtaccess files are cached by path. A cached file is checked
+                against its mod date at most once every kAccessFileCheckIntervalMSecs,
+                so authorizing a request normally touches no files at all.
+                
 
 */
 #ifndef _QT_ACCESS_FILE_H_
@@ -38,6 +42,65 @@
 #include "StrPtrLen.h"
 #include "OSHeaders.h"
 
+class OSMutex;
+
+//
+// A qtaccess file, parsed once into a list of directives so requests can be
+// checked against it without looking at the text again. Instances are shared
+// through the QTAccessFile cache and are never changed after they are built.
+class QTAccessFileRules
+{
+    public:
+        //Parses inAccessFileBuf, which isn't referenced afterwards.
+        QTAccessFileRules(StrPtrLen* inAccessFileBuf);
+        ~QTAccessFileRules();
+        
+        //Same as QTAccessFile::AccessAllowed, for this file
+        Bool16 AccessAllowed(char *userName, char**groupArray, UInt32 numGroups, 
+                                QTSS_ActionFlags inFlags, StrPtrLen* ioRealmNameStr);
+        
+        //Same as QTAccessFile::FindUsersAndGroupsFilesAndAuthScheme, for this file
+        QTSS_AuthScheme FindUsersAndGroupsFilesAndAuthScheme(QTSS_ActionFlags inAction, 
+                                char** outUsersFilePath, char** outGroupsFilePath);
+        
+    private:
+    
+        enum
+        {
+            kLimit              = 0,
+            kEndLimit           = 1,
+            kAuthName           = 2,
+            kAuthUserFile       = 3,
+            kAuthGroupFile      = 4,
+            kAuthScheme         = 5,
+            kRequireValidUser   = 6,
+            kRequireAnyUser     = 7,
+            kRequireUser        = 8,
+            kRequireGroup       = 9
+        };
+        
+        struct Directive
+        {
+            UInt32              fType;
+            QTSS_ActionFlags    fLimitFlags;    //kLimit: READ and / or WRITE
+            StrPtrLen           fValue;         //kAuthName, kAuthUserFile, kAuthGroupFile
+            QTSS_AuthScheme     fAuthScheme;    //kAuthScheme, qtssAuthNone if not basic or digest
+            StrPtrLen*          fNames;         //kRequireUser, kRequireGroup
+            UInt32              fNumNames;
+        };
+        
+        void AddDirective(UInt32 inType, Directive** outDirective);
+        
+        char*       fText;      //copy of the file, fValue and fNames point into it
+        Directive*  fDirectives;
+        UInt32      fNumDirectives;
+        UInt32      fDirectivesSize;
+        
+        UInt32      fRefCount;  //protected by the QTAccessFile cache mutex
+        
+        friend class QTAccessFile;
+};
+
 class QTAccessFile
 {
     public:
@@ -73,7 +136,25 @@ class QTAccessFile
                 
         static QTSS_Error AuthorizeRequest(QTSS_StandardRTSP_Params* inParams, Bool16 allowNoAccessFiles, QTSS_ActionFlags noAction, QTSS_ActionFlags authorizeAction);
 
+        //GetAccessFileRules
+        //
+        // Like GetAccessFile_Copy, but returns the parsed file from the cache, or NULL if
+        // there isn't one. outAccessFilePath may be NULL. Call ReleaseAccessFileRules when done.
+        static QTAccessFileRules* GetAccessFileRules(const char* movieRootDir, const char* dirPath, char** outAccessFilePath);
+        static void ReleaseAccessFileRules(QTAccessFileRules* inRules);
+        
+        enum
+        {
+            kAccessFileCheckIntervalMSecs   = 1000, //SInt64
+            kMaxCachedAccessFiles           = 8192  //UInt32. the cache is flushed when it grows past this
+        };
+        
     private:    
+        // Returns the cached rules for inAccessFilePath with a reference added, re-reading
+        // the file if it is due to be checked. Caller must hold sAccessFileMutex.
+        static QTAccessFileRules* LookupAccessFile(char* inAccessFilePath);
+        static void FlushAccessFileCache();
+        
         static char* sQTAccessFileName; // managed by the QTAccess module
         static Bool16 sAllocatedName;
         static OSMutex* sAccessFileMutex;
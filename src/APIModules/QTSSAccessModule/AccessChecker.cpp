@@ -76,7 +76,11 @@ AccessChecker::AccessChecker() :
     fGroupsFileModDate(-1),
     fProfiles(NULL),
     fNumUsers(0),
-    fCurrentSize(0)
+    fCurrentSize(0),
+    fProfileHash(NULL),
+    fProfileHashSize(0),
+    fLastCheckTimeMSecs(-1),
+    fLastUpdateErr(kNoErr)
 {
 }
 
@@ -109,6 +113,9 @@ void AccessChecker::UpdateFilePaths(const char* inUsersFilePath, const char* inG
     
     fGroupsFilePath = NEW char[strlen(inGroupsFilePath)+1];
     ::strcpy(fGroupsFilePath, inGroupsFilePath);
+    
+    // New files, so the next UpdateUserProfiles must read them
+    fLastCheckTimeMSecs = -1;
 }
 
 // Function to delete memory allocated for all the profiles, and the authRealm
@@ -171,6 +178,11 @@ void AccessChecker::DeleteProfilesAndRealm()
         fProfiles = NULL;
     }
     
+    // the hash only points at the profiles deleted above
+    delete [] fProfileHash;
+    fProfileHash = NULL;
+    fProfileHashSize = 0;
+    
     // delete the fAuthRealm field
     if(fAuthRealm.Len != 0) {
         delete fAuthRealm.Ptr;
@@ -181,14 +193,28 @@ void AccessChecker::DeleteProfilesAndRealm()
     fCurrentSize = 0;
 }
 
+// Every authenticated request calls this, so the users and groups files are only
+// stat'ed once every kFileCheckIntervalMSecs; in between, the result of the last
+// check is returned as is.
+UInt32 AccessChecker::UpdateUserProfiles()
+{
+    SInt64 theCurrentTime = QTSS_Milliseconds();
+    if ((fLastCheckTimeMSecs != -1) && (theCurrentTime - fLastCheckTimeMSecs < kFileCheckIntervalMSecs))
+        return fLastUpdateErr;
+        
+    fLastUpdateErr = ReadUserProfiles();
+    fLastCheckTimeMSecs = theCurrentTime;
+    return fLastUpdateErr;
+}
+
 // Memory is allocated for each username record found in the users file
 // Memory is also allocated for each group name found in the groups file per user
 // All this memory must be deleted if the profiles are deleted, before parsing
 // the file again
-UInt32 AccessChecker::UpdateUserProfiles() {
+UInt32 AccessChecker::ReadUserProfiles() {
     
     UInt32 index = 0;
-    UInt32 i = 0, j = 0;
+    UInt32 i = 0;
     UInt32 resultErr = kNoErr;
     Bool16 groupFileErrors = true;
         Bool16 userFileErrors = true;
@@ -359,6 +385,7 @@ UInt32 AccessChecker::UpdateUserProfiles() {
         index ++;
     }
     fNumUsers = index;
+    BuildProfileHash();
     
         if(!groupFileErrors)    
     {
@@ -387,27 +414,25 @@ UInt32 AccessChecker::UpdateUserProfiles() {
                             {
                                     groupLineParser.ConsumeWhitespace();
                                     groupLineParser.ConsumeUntilWhitespace(&groupUser);
-                                    for(i = 0; i < fNumUsers; i++) {
-                                            if(fProfiles[i]->username.Equal(groupUser))
-                                            {
-                                                    UInt32 grpSize = fProfiles[i]->groupsSize;
-                                                    if(fProfiles[i]->numGroups >= grpSize) {
-                                                            char** oldGroups = fProfiles[i]->groups;
-                                                            fProfiles[i]->groups = NEW char*[grpSize * 2];
-                                                            for(j = 0; j < grpSize; j++) {
-                                                                    fProfiles[i]->groups[j] = oldGroups[j];
-                                                            }
-                                                            fProfiles[i]->groupsSize *= 2;
-                                                            delete [] oldGroups;
-                                                    }
-                                                    
-                                                    fProfiles[i]->groups[fProfiles[i]->numGroups] = groupName.GetAsCString();
-                                                    if(nameLen > fProfiles[i]->maxGroupNameLen) 
-                                                            fProfiles[i]->maxGroupNameLen = nameLen;
-                                                    fProfiles[i]->numGroups++;
-                                                    break;
+                                    UserProfile* profile = RetrieveUserProfile(&groupUser);
+                                    if(profile == NULL)
+                                            continue;
+                                            
+                                    UInt32 grpSize = profile->groupsSize;
+                                    if(profile->numGroups >= grpSize) {
+                                            char** oldGroups = profile->groups;
+                                            profile->groups = NEW char*[grpSize * 2];
+                                            for(i = 0; i < grpSize; i++) {
+                                                    profile->groups[i] = oldGroups[i];
                                             }
+                                            profile->groupsSize *= 2;
+                                            delete [] oldGroups;
                                     }
+                                    
+                                    profile->groups[profile->numGroups] = groupName.GetAsCString();
+                                    if(nameLen > profile->maxGroupNameLen) 
+                                            profile->maxGroupNameLen = nameLen;
+                                    profile->numGroups++;
                             }
                     }
             }
@@ -427,13 +452,48 @@ Bool16  AccessChecker::HaveFilePathsChanged(const char* inUsersFilePath, const c
     return changed;
 }
 
+static UInt32 HashUserName(const StrPtrLen* inUserName)
+{
+    UInt32 theHash = 0;
+    for (UInt32 x = 0; x < inUserName->Len; x++)
+        theHash = (theHash * 31) + (UInt8)inUserName->Ptr[x];
+    return theHash;
+}
+
+// Allocates the bucket array, which is deleted along with the profiles
+void AccessChecker::BuildProfileHash()
+{
+    Assert(fProfileHash == NULL);
+    
+    fProfileHashSize = kMinProfileHashSize;
+    while (fProfileHashSize < fNumUsers)
+        fProfileHashSize <<= 1;
+        
+    fProfileHash = NEW UserProfile*[fProfileHashSize];
+    ::memset(fProfileHash, 0, sizeof(UserProfile*) * fProfileHashSize);
+    
+    // Insert from the end so that when a name appears twice in the users file,
+    // the first entry is found first, as it was with the linear search.
+    for (UInt32 index = fNumUsers; index > 0; index--)
+    {
+        UserProfile* profile = fProfiles[index - 1];
+        UserProfile** theBucket = &fProfileHash[HashUserName(&profile->username) & (fProfileHashSize - 1)];
+        profile->fNextHashEntry = *theBucket;
+        *theBucket = profile;
+    }
+}
+
 // No memory is allocated
 AccessChecker::UserProfile* AccessChecker::RetrieveUserProfile(const StrPtrLen* inUserName)
 {
-    UInt32 index = 0;
-    for(index = 0; index < fNumUsers; index++) {
-        if(fProfiles[index]->username.Equal(*inUserName)) 
-            return fProfiles[index];
+    if (fProfileHash == NULL)
+        return NULL;
+        
+    UserProfile* profile = fProfileHash[HashUserName(inUserName) & (fProfileHashSize - 1)];
+    for ( ; profile != NULL; profile = profile->fNextHashEntry)
+    {
+        if(profile->username.Equal(*inUserName)) 
+            return profile;
     }
     return NULL;
 }
@@ -55,9 +55,10 @@ class AccessChecker
             If not found, 
                 deny access
                 
-    ToDo:
-        would probably be a good idea to do some caching of ".qtaccess" data to avoid
-        multiple directory walks
+    Parsed ".qtaccess" files are cached by QTAccessFile, so the directory walk
+    only touches the disk when an access file changes. Profiles are hashed by
+    username, and the users and groups files are checked for changes at most
+    once every kFileCheckIntervalMSecs.
 */
 
 public:
@@ -70,6 +71,7 @@ public:
         UInt32      maxGroupNameLen;
         UInt32      numGroups;
         UInt32      groupsSize;
+        UserProfile* fNextHashEntry;    // next profile in the same username bucket
     };
     
     AccessChecker();
@@ -85,6 +87,7 @@ public:
     inline char* GetGroupsFilePathPtr() {return fGroupsFilePath;}
     
     enum { kDefaultNumProfiles = 10, kDefaultNumGroups = 2 };
+    enum { kMinProfileHashSize = 16, kFileCheckIntervalMSecs = 1000 };
     enum {  kNoErr                  = 0x00000000, 
             kUsersFileNotFoundErr   = 0x00000001, 
             kGroupsFileNotFoundErr  = 0x00000002, 
@@ -104,12 +107,20 @@ protected:
     UserProfile**       fProfiles;
     UInt32              fNumUsers;
     UInt32              fCurrentSize;
+    
+    UserProfile**       fProfileHash;       // power of two buckets, keyed by username
+    UInt32              fProfileHashSize;
+    
+    SInt64              fLastCheckTimeMSecs;    // -1 forces the next UpdateUserProfiles to read the files
+    UInt32              fLastUpdateErr;
         
     static const char*  kDefaultUsersFilePath;
     static const char*  kDefaultGroupsFilePath;
     
 private:
     void DeleteProfilesAndRealm();
+    UInt32 ReadUserProfiles();
+    void BuildProfileHash();
 };
 
 #endif //_QTSSACCESSCHECKER_H_
@@ -289,7 +289,7 @@ ElementNode::~ElementNode()
         {
             //qtss_printf("deleting hash entry of %s \n", GetName(index));
             SetOSRef(index,NULL);
-            (fElementMap->GetHashTable())->Remove(theRefPtr);
+            fElementMap->UnRegister(theRefPtr, theRefPtr->GetRefCount()); // don't wait on it, we're tearing down
             delete (OSRef*) theRefPtr;  ElementNode_RemovePtr(theRefPtr,"ElementNode::~ElementNode OSRef *");
         }
         
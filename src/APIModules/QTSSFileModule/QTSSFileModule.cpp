@@ -46,6 +46,7 @@
 #include "ResizeableStringFormatter.h"
 #include "StringParser.h"
 #include "SDPUtils.h"
+#include "SDPCache.h"
 
 #include <errno.h>
 
@@ -84,6 +85,9 @@ class FileSession
         Bool16              fAdjustPauseTime;
 };
 
+// DESCRIBEs of movies with no file session yet are answered from here when they can be
+static SDPCache*        sSDPCache = NULL;
+
 // ref to the prefs dictionary object
 static QTSS_ModulePrefsObject       sPrefs;
 static QTSS_PrefsObject             sServerPrefs;
@@ -140,6 +144,11 @@ static UInt32               sPrivateBufferUnitKSize = 0;
 static UInt32               sPrivateBufferUnitSize  = 0;
 static UInt32               sPrivateBufferMaxUnits  = 0;
 
+static Bool16               sEnableMappedFileCache  = false;
+static UInt32               sMappedFileCacheMaxMBytes = 0;
+static UInt32               sMovieHeaderCacheMaxMBytes = 0;
+static Bool16               sEnableRTPCacheFiles    = false;
+
 static Float32              sAddClientBufferDelaySecs = 0;
 
 static Bool16               sRecordMovieFileSDP = false;
@@ -173,6 +182,9 @@ static QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParamBlock);
 static QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams);
 static QTSS_Error DestroySession(QTSS_ClientSessionClosing_Params* inParams);
 static void       DeleteFileSession(FileSession* inFileSession);
+static void       UpdateMovieCacheStats();
+static Bool16     SendCachedDescribe(QTSS_StandardRTSP_Params* inParamBlock, char* inMoviePath, char* inCacheKey);
+static void       AddSDPCacheEntry(char* inCacheKey, QTFile* inMovie, iovec* inSDPVec, UInt32 inNumVectors, UInt32 inSDPLen);
 static UInt32   WriteSDPHeader(FILE* sdpFile, iovec *theSDPVec, SInt16 *ioVectorIndex, StrPtrLen *sdpHeader);
 static void     BuildPrefBasedHeaders();
 
@@ -360,6 +372,7 @@ QTSS_Error Register(QTSS_Register_Params* inParams)
 QTSS_Error Initialize(QTSS_Initialize_Params* inParams)
 {
     QTRTPFile::Initialize();
+    sSDPCache = NEW SDPCache();
     QTSSModuleUtils::Initialize(inParams->inMessages, inParams->inServer, inParams->inErrorLogStream);
 
     sPrefs = QTSSModuleUtils::GetModulePrefsObject(inParams->inModule);
@@ -482,6 +495,24 @@ QTSS_Error RereadPrefs()
     sPrivateBufferMaxUnits = 8;
     QTSSModuleUtils::GetIOAttribute(sPrefs, "max_private_buffer_units_per_buffer", qtssAttrDataTypeUInt32, &sPrivateBufferMaxUnits, sizeof(sPrivateBufferMaxUnits));
 
+    sEnableMappedFileCache = false;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "enable_mapped_file_cache", qtssAttrDataTypeBool16, &sEnableMappedFileCache, sizeof(sEnableMappedFileCache));
+
+    sMappedFileCacheMaxMBytes = 1024;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "mapped_file_cache_max_mbytes", qtssAttrDataTypeUInt32, &sMappedFileCacheMaxMBytes, sizeof(sMappedFileCacheMaxMBytes));
+
+    // Movies opened from now on are mapped (or not) accordingly
+    QTFile_MappedFile::SetCacheParams(sEnableMappedFileCache, (UInt64)sMappedFileCacheMaxMBytes * 1024 * 1024);
+
+    sMovieHeaderCacheMaxMBytes = 32;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "movie_header_cache_max_mbytes", qtssAttrDataTypeUInt32, &sMovieHeaderCacheMaxMBytes, sizeof(sMovieHeaderCacheMaxMBytes));
+    QTRTPFile::SetFileCacheParams((UInt64)sMovieHeaderCacheMaxMBytes * 1024 * 1024);
+
+    // Movies with a .rtpcache file built by QTRTPCacheGen send its packets
+    sEnableRTPCacheFiles = false;
+    QTSSModuleUtils::GetIOAttribute(sPrefs, "enable_rtp_cache_files", qtssAttrDataTypeBool16, &sEnableRTPCacheFiles, sizeof(sEnableRTPCacheFiles));
+    QTRTPFile::SetRTPCacheFileParams(sEnableRTPCacheFiles);
+
     sAddClientBufferDelaySecs = 0;
     QTSSModuleUtils::GetIOAttribute(sPrefs, "add_seconds_to_client_buffer_delay", qtssAttrDataTypeFloat32, &sAddClientBufferDelaySecs, sizeof(sAddClientBufferDelaySecs));
 
@@ -508,6 +539,9 @@ QTSS_Error RereadPrefs()
 
     BuildPrefBasedHeaders();
     
+    // Cached SDPs were built with the old prefs
+    sSDPCache->Flush();
+    
     return QTSS_NoErr;
 }
 
@@ -642,6 +676,37 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
         }
     }
 
+    //
+    // The SDP built for this movie may already be cached. Only SDPs generated
+    // from the movie are cached, so skip the cache if an .sdp file could be
+    // served or written instead. A later SETUP opens the movie.
+    OSCharArrayDeleter theCacheKey(NULL);
+    if ( (theFile == NULL) && !sEnableMovieFileSDP && !sRecordMovieFileSDP )
+    {
+        char* theFilePathStr = NULL;
+        (void)QTSS_GetValueAsString(inParamBlock->inRTSPRequest, qtssRTSPReqFilePath, 0, &theFilePathStr);
+        QTSSCharArrayDeleter theFilePathStrDeleter(theFilePathStr);
+        
+        StrPtrLen theLocalAddrStr;
+        (void)QTSS_GetValuePtr(inParamBlock->inRTSPSession, qtssRTSPSesLocalAddrStr, 0, (void**)&theLocalAddrStr.Ptr, &theLocalAddrStr.Len);
+        
+        Bool16 theAdjustBandwidth = false;
+        if (sPlayerCompatibility)
+            theAdjustBandwidth = QTSSModuleUtils::HavePlayerProfile(sServerPrefs, inParamBlock, QTSSModuleUtils::kAdjustBandwidth);
+        
+        if (theFilePathStr != NULL)
+        {
+            // movie path, file path (the s= line), local address (the o= line), bandwidth adjustment
+            UInt32 theKeyLen = ::strlen(thePath.GetObject()) + ::strlen(theFilePathStr) + theLocalAddrStr.Len + 8;
+            theCacheKey.SetObject(NEW char[theKeyLen]);
+            qtss_sprintf(theCacheKey.GetObject(), "%s\n%s\n%.*s\n%d", thePath.GetObject(), theFilePathStr,
+                                (int)theLocalAddrStr.Len, theLocalAddrStr.Ptr, theAdjustBandwidth ? 1 : 0);
+                                
+            if (SendCachedDescribe(inParamBlock, thePath.GetObject(), theCacheKey.GetObject()))
+                return QTSS_NoErr;
+        }
+    }
+
     if ( theFile == NULL )
     {   
         theErr = CreateQTRTPFile(inParamBlock, thePath.GetObject(), &theFile);
@@ -756,7 +821,7 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
         
         // the first number is the NTP time used for the session identifier (this changes for each request)
         // the second number is the NTP date time of when the file was modified (this changes when the file changes)
-        qtss_sprintf(ownerLine, "o=StreamingServer %I64d %I64d IN IP4 %s", (SInt64) OS::UnixTime_Secs() + 2208988800LU, (SInt64) theFile->fFile.GetQTFile()->GetModDate(),ipCstr);
+        qtss_snprintf(ownerLine, sLineSize - 1, "o=StreamingServer %" _64BITARG_ "d %" _64BITARG_ "d IN IP4 %s", (SInt64) OS::UnixTime_Secs() + 2208988800LU, (SInt64) theFile->fFile.GetQTFile()->GetModDate(),ipCstr);
         Assert(ownerLine[sLineSize - 1] == 0);
 
         StrPtrLen ownerStr(ownerLine);
@@ -882,6 +947,9 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParamBlock)
                                         kCacheControlHeader.Ptr, kCacheControlHeader.Len);
         QTSSModuleUtils::SendDescribeResponse(inParamBlock->inRTSPRequest, inParamBlock->inClientSession,
                                                                         &theSDPVec[0], vectorIndex, totalSDPLength);    
+                                                                        
+        if (theCacheKey.GetObject() != NULL)
+            AddSDPCacheEntry(theCacheKey.GetObject(), theFile->fFile.GetQTFile(), &theSDPVec[1], vectorIndex - 1, totalSDPLength);
     }
     
     Assert(theSDPData.Ptr != NULL);
@@ -899,6 +967,7 @@ QTSS_Error CreateQTRTPFile(QTSS_StandardRTSP_Params* inParamBlock, char* inPath,
 {   
     *outFile = NEW FileSession();
     QTRTPFile::ErrorCode theErr = (*outFile)->fFile.Initialize(inPath);
+    UpdateMovieCacheStats();
     if (theErr != QTRTPFile::errNoError)
     {
         delete *outFile;
@@ -929,6 +998,11 @@ QTSS_Error CreateQTRTPFile(QTSS_StandardRTSP_Params* inParamBlock, char* inPath,
         AssertV(0, theErr);
     }
     
+    //
+    // Have packet payloads sent straight out of mapped movie and RTP cache
+    // files rather than copied into each packet. See SendPackets.
+    (*outFile)->fFile.SetUsePacketVectors(true);
+    
     return QTSS_NoErr;
 }
 
@@ -1272,6 +1346,7 @@ QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParamBlock)
                                                         
     //make sure to clear the next packet the server would have sent!
     (*theFile)->fPacketStruct.packetData = NULL;
+    (*theFile)->fPacketStruct.packetVectorLen = 0;
     
     // Set the movie duration and size parameters
     Float64 movieDuration = (*theFile)->fFile.GetMovieDuration();
@@ -1448,6 +1523,7 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
         if ((*theFile)->fPacketStruct.packetData == NULL)
         {
             Float64 theTransmitTime = (*theFile)->fFile.GetNextPacket((char**)&(*theFile)->fPacketStruct.packetData, &(*theFile)->fNextPacketLen);
+            (*theFile)->fFile.GetLastPacketVector(&(*theFile)->fPacketStruct.packetVector, &(*theFile)->fPacketStruct.packetVectorLen);
             if ( QTRTPFile::errNoError != (*theFile)->fFile.Error() )
             {
                 QTSS_CliSesTeardownReason reason = qtssCliSesTearDownUnsupportedMedia;
@@ -1550,6 +1626,8 @@ QTSS_Error SendPackets(QTSS_RTPSendPackets_Params* inParams)
         QTSS_WriteFlags theFlags = qtssWriteFlagsIsRTP;
         if (isBeginningOfWriteBurst)
             theFlags |= qtssWriteFlagsWriteBurstBegin;
+        if ((*theFile)->fPacketStruct.packetVectorLen > 0)
+            theFlags |= qtssWriteFlagsPacketVector;
 
         theStream = (QTSS_Object)theLastPacketTrack->Cookie1;
 		Assert(theStream != NULL);
@@ -1621,4 +1699,94 @@ QTSS_Error DestroySession(QTSS_ClientSessionClosing_Params* inParams)
 void    DeleteFileSession(FileSession* inFileSession)
 {   
     delete inFileSession;
+    UpdateMovieCacheStats();
+}
+
+//
+// Returns the movie's mod date the way QTFile::GetModDate sees it, or -1 if
+// the movie can't be opened.
+static SInt64 GetMovieModDate(char* inMoviePath)
+{
+    QTSS_Object theMovie = NULL;
+    if (QTSS_OpenFileObject(inMoviePath, qtssOpenFileNoFlags, &theMovie) != QTSS_NoErr)
+        return -1;
+        
+    SInt64 theModDate = -1;
+    UInt32 theLen = sizeof(theModDate);
+    (void)QTSS_GetValue(theMovie, qtssFlObjModDate, 0, (void*)&theModDate, &theLen);
+    (void)QTSS_CloseFileObject(theMovie);
+    return theModDate;
+}
+
+static void UpdateDescribeCacheStats()
+{
+    UInt32 theHits = sSDPCache->GetNumHits();
+    UInt32 theMisses = sSDPCache->GetNumMisses();
+    (void)QTSS_SetValue(sServer, qtssSvrDescribeCacheHits, 0, &theHits, sizeof(theHits));
+    (void)QTSS_SetValue(sServer, qtssSvrDescribeCacheMisses, 0, &theMisses, sizeof(theMisses));
+}
+
+Bool16  SendCachedDescribe(QTSS_StandardRTSP_Params* inParamBlock, char* inMoviePath, char* inCacheKey)
+{
+    //
+    // A movie that can't be opened isn't served from the cache; the normal
+    // path sends the right error.
+    SInt64 theModDate = GetMovieModDate(inMoviePath);
+    if (theModDate == -1)
+        return false;
+        
+    UInt32 theSDPLen = 0, theSessionIDOffset = 0, theSessionIDLen = 0;
+    char theModDateStr[DateBuffer::kDateBufferLen];
+    OSCharArrayDeleter theSDP(sSDPCache->Get(inCacheKey, theModDate, &theSDPLen, &theSessionIDOffset, &theSessionIDLen, theModDateStr));
+    UpdateDescribeCacheStats();
+    if (theSDP.GetObject() == NULL)
+        return false;
+    
+    //
+    // Same If-Modified-Since handling as for a generated SDP
+    QTSS_TimeVal* theTime = NULL;
+    UInt32 theLen = 0;
+    (void) QTSS_GetValuePtr(inParamBlock->inRTSPRequest, qtssRTSPReqIfModSinceDate, 0, (void**)&theTime, &theLen);
+    if ((theLen == sizeof(QTSS_TimeVal)) && (*theTime > 0) && (*theTime == theModDate))
+    {
+        QTSS_Error theErr = QTSS_SetValue( inParamBlock->inRTSPRequest, qtssRTSPReqStatusCode, 0,
+                                &kNotModifiedStatus, sizeof(kNotModifiedStatus) );
+        Assert(theErr == QTSS_NoErr);
+        theErr = QTSS_SendStandardRTSPResponse(inParamBlock->inRTSPRequest, inParamBlock->inClientSession, 0);
+        Assert(theErr == QTSS_NoErr);
+        return true;
+    }
+    
+    //
+    // Send it with a new session ID in the o= line
+    char theSessionID[SDPCache::kSessionIDBufferLen];
+    iovec theSDPVec[4]; // 1 for the RTSP header, then before, in place of, and after the session ID
+    ::memset(&theSDPVec[0], 0, sizeof(theSDPVec));
+    UInt32 theSendLen = SDPCache::ReplaceSessionID(theSDP.GetObject(), theSDPLen, theSessionIDOffset, theSessionIDLen,
+                                    (SInt64) OS::UnixTime_Secs() + 2208988800LU, theSessionID, &theSDPVec[1]);
+    
+    (void)QTSS_AppendRTSPHeader(inParamBlock->inRTSPRequest, qtssLastModifiedHeader,
+                                    theModDateStr, DateBuffer::kDateBufferLen);
+    (void)QTSS_AppendRTSPHeader(inParamBlock->inRTSPRequest, qtssCacheControlHeader,
+                                    kCacheControlHeader.Ptr, kCacheControlHeader.Len);
+    QTSSModuleUtils::SendDescribeResponse(inParamBlock->inRTSPRequest, inParamBlock->inClientSession,
+                                    &theSDPVec[0], 4, theSendLen);
+    return true;
+}
+
+void    AddSDPCacheEntry(char* inCacheKey, QTFile* inMovie, iovec* inSDPVec, UInt32 inNumVectors, UInt32 inSDPLen)
+{
+    char* theSDP = QTSSModuleUtils::CoalesceVectors(inSDPVec, inNumVectors, inSDPLen);
+    if (theSDP != NULL)
+        sSDPCache->Add(inCacheKey, inMovie->GetModDate(), inMovie->GetModDateStr(), theSDP, inSDPLen);
+}
+
+void    UpdateMovieCacheStats()
+{
+    UInt32 theHits = 0, theMisses = 0, theEvictions = 0;
+    QTRTPFile::GetFileCacheStats(&theHits, &theMisses, &theEvictions);
+    
+    (void)QTSS_SetValue(sServer, qtssSvrMovieCacheHits, 0, &theHits, sizeof(theHits));
+    (void)QTSS_SetValue(sServer, qtssSvrMovieCacheMisses, 0, &theMisses, sizeof(theMisses));
+    (void)QTSS_SetValue(sServer, qtssSvrMovieCacheEvictions, 0, &theEvictions, sizeof(theEvictions));
 }
@@ -0,0 +1,178 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       SDPCache.cpp
+
+    Contains:   Implementation of the class
+    
+
+*/
+
+#include <string.h>
+
+#include "SDPCache.h"
+#include "SafeStdLib.h"
+#include "OSMemory.h"
+#include "StrPtrLen.h"
+#include "StringParser.h"
+
+SDPCache::SDPCache(UInt32 inMaxEntries)
+:   fMaxEntries(inMaxEntries),
+    fNumHits(0),
+    fNumMisses(0)
+{
+    ::memset(fBuckets, 0, sizeof(fBuckets));
+}
+
+UInt32 SDPCache::HashKey(const char* inKey)
+{
+    UInt32 theHash = 0;
+    for (const char* theChar = inKey; *theChar != '\0'; theChar++)
+        theHash = (theHash * 31) + (UInt8)*theChar;
+    return theHash;
+}
+
+SDPCacheEntry* SDPCache::Find(const char* inKey, UInt32 inHashValue)
+{
+    SDPCacheEntry* theEntry = fBuckets[inHashValue & (kNumBuckets - 1)];
+    for ( ; theEntry != NULL; theEntry = theEntry->fNextHashEntry)
+    {
+        if ((theEntry->fHashValue == inHashValue) && (::strcmp(theEntry->fKey, inKey) == 0))
+            break;
+    }
+    return theEntry;
+}
+
+char* SDPCache::Get(const char* inKey, SInt64 inModDate, UInt32* outSDPLen, UInt32* outSessionIDOffset,
+                        UInt32* outSessionIDLen, char* outModDateStr)
+{
+    OSMutexLocker locker(&fMutex);
+    SDPCacheEntry* theEntry = this->Find(inKey, HashKey(inKey));
+    if ((theEntry != NULL) && (theEntry->fModDate != inModDate))
+    {
+        this->Remove(theEntry); // the movie changed
+        theEntry = NULL;
+    }
+    
+    if (theEntry == NULL)
+    {
+        fNumMisses++;
+        return NULL;
+    }
+    fNumHits++;
+    
+    // Most recently used go to the back of the queue
+    fQueue.Remove(&theEntry->fQueueElem);
+    fQueue.EnQueue(&theEntry->fQueueElem);
+    
+    // Hand out a copy so the lock isn't held while sending
+    char* theSDP = NEW char[theEntry->fSDPLen];
+    ::memcpy(theSDP, theEntry->fSDP, theEntry->fSDPLen);
+    *outSDPLen = theEntry->fSDPLen;
+    *outSessionIDOffset = theEntry->fSessionIDOffset;
+    *outSessionIDLen = theEntry->fSessionIDLen;
+    ::memcpy(outModDateStr, theEntry->fModDateStr, DateBuffer::kDateBufferLen);
+    return theSDP;
+}
+
+void SDPCache::Add(const char* inKey, SInt64 inModDate, const char* inModDateStr, char* inSDP, UInt32 inSDPLen)
+{
+    static StrPtrLen sOwnerPrefix("o=StreamingServer ");
+    
+    SDPCacheEntry* theEntry = NEW SDPCacheEntry();
+    theEntry->fKey = NEW char[::strlen(inKey) + 1];
+    ::strcpy(theEntry->fKey, inKey);
+    theEntry->fHashValue = HashKey(inKey);
+    theEntry->fModDate = inModDate;
+    ::memcpy(theEntry->fModDateStr, inModDateStr, DateBuffer::kDateBufferLen);
+    theEntry->fSDP = inSDP;
+    theEntry->fSDPLen = inSDPLen;
+    
+    //
+    // Find the session ID, the first number in the o= line the module wrote
+    StrPtrLen theSDP(theEntry->fSDP, theEntry->fSDPLen);
+    StrPtrLen theOwnerLine;
+    theSDP.FindString(sOwnerPrefix, &theOwnerLine);
+    if (theOwnerLine.Len > 0)
+    {
+        StrPtrLen theRest(theOwnerLine.Ptr + sOwnerPrefix.Len, theSDP.Len - ((theOwnerLine.Ptr + sOwnerPrefix.Len) - theSDP.Ptr));
+        StringParser theOwnerParser(&theRest);
+        StrPtrLen theSessionID;
+        (void)theOwnerParser.ConsumeInteger(&theSessionID);
+        theEntry->fSessionIDOffset = theSessionID.Ptr - theSDP.Ptr;
+        theEntry->fSessionIDLen = theSessionID.Len;
+    }
+    
+    OSMutexLocker locker(&fMutex);
+    
+    //
+    // Someone else may have just cached the same SDP
+    SDPCacheEntry* theOther = this->Find(theEntry->fKey, theEntry->fHashValue);
+    if (theOther != NULL)
+        this->Remove(theOther);
+    
+    if ((fQueue.GetLength() >= fMaxEntries) && (fQueue.GetLength() > 0))
+        this->Remove((SDPCacheEntry*)fQueue.GetHead()->GetEnclosingObject());
+        
+    SDPCacheEntry** theBucket = &fBuckets[theEntry->fHashValue & (kNumBuckets - 1)];
+    theEntry->fNextHashEntry = *theBucket;
+    *theBucket = theEntry;
+    fQueue.EnQueue(&theEntry->fQueueElem);
+}
+
+void SDPCache::Remove(SDPCacheEntry* inEntry)
+{
+    SDPCacheEntry** theLink = &fBuckets[inEntry->fHashValue & (kNumBuckets - 1)];
+    while (*theLink != inEntry)
+        theLink = &(*theLink)->fNextHashEntry;
+    *theLink = inEntry->fNextHashEntry;
+    
+    fQueue.Remove(&inEntry->fQueueElem);
+    delete inEntry;
+}
+
+void SDPCache::Flush()
+{
+    OSMutexLocker locker(&fMutex);
+    while (fQueue.GetLength() > 0)
+        this->Remove((SDPCacheEntry*)fQueue.GetHead()->GetEnclosingObject());
+}
+
+UInt32 SDPCache::ReplaceSessionID(char* inSDP, UInt32 inSDPLen, UInt32 inSessionIDOffset, UInt32 inSessionIDLen,
+                                    SInt64 inSessionID, char* ioSessionIDBuffer, iovec* outVecs)
+{
+    ioSessionIDBuffer[0] = '\0';
+    if (inSessionIDLen > 0)
+        (void)qtss_snprintf(ioSessionIDBuffer, kSessionIDBufferLen, "%" _64BITARG_ "d", inSessionID);
+    ioSessionIDBuffer[kSessionIDBufferLen - 1] = '\0';
+    
+    outVecs[0].iov_base = inSDP;
+    outVecs[0].iov_len = inSessionIDOffset;
+    outVecs[1].iov_base = ioSessionIDBuffer;
+    outVecs[1].iov_len = ::strlen(ioSessionIDBuffer);
+    outVecs[2].iov_base = inSDP + inSessionIDOffset + inSessionIDLen;
+    outVecs[2].iov_len = inSDPLen - (inSessionIDOffset + inSessionIDLen);
+    return outVecs[0].iov_len + outVecs[1].iov_len + outVecs[2].iov_len;
+}
@@ -0,0 +1,133 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       SDPCache.h
+
+    Contains:   The SDPs QTSSFileModule generated for DESCRIBEs of movies, kept so
+                that DESCRIBEs of popular titles can be answered without opening
+                the movie.
+                
+                Entries are found by a key made of everything besides the prefs
+                that goes into the SDP, and are only used while the movie's mod
+                date is unchanged. The least recently used entry is evicted once
+                the cache is full. The cache has its own lock, so any task thread
+                may use it.
+
+*/
+
+#ifndef __SDP_CACHE_H__
+#define __SDP_CACHE_H__
+
+#include "OSHeaders.h"
+#include "OSMutex.h"
+#include "OSQueue.h"
+#include "DateTranslator.h"
+
+#ifndef __Win32__
+#include <sys/uio.h>
+#endif
+
+class SDPCacheEntry
+{
+    public:
+    
+        SDPCacheEntry() : fQueueElem(this), fKey(NULL), fHashValue(0), fNextHashEntry(NULL),
+                          fModDate(0), fSDP(NULL), fSDPLen(0), fSessionIDOffset(0), fSessionIDLen(0)
+        { fModDateStr[0] = '\0'; }
+        
+        ~SDPCacheEntry() { delete [] fKey; delete [] fSDP; }
+        
+        OSQueueElem         fQueueElem;         // in the cache's queue, least recently used at the head
+        char*               fKey;
+        UInt32              fHashValue;
+        SDPCacheEntry*      fNextHashEntry;
+        
+        SInt64              fModDate;
+        char                fModDateStr[DateBuffer::kDateBufferLen];
+        
+        char*               fSDP;
+        UInt32              fSDPLen;
+        UInt32              fSessionIDOffset;   // of the o= line's session ID, which is new for every DESCRIBE
+        UInt32              fSessionIDLen;
+};
+
+class SDPCache
+{
+    public:
+    
+        enum
+        {
+            kNumBuckets             = 1024,     // must be a power of 2
+            kDefaultMaxEntries      = 4096,
+            kSessionIDBufferLen     = 24        // an SInt64 in decimal, and its terminator
+        };
+        
+        SDPCache(UInt32 inMaxEntries = kDefaultMaxEntries);
+        ~SDPCache() { this->Flush(); }
+        
+        //
+        // If there is an SDP for inKey made from this version of the movie, returns
+        // a copy of it, which the caller must delete [], along with where its session
+        // ID is. outModDateStr must hold DateBuffer::kDateBufferLen chars. An SDP made
+        // from an older version of the movie is dropped, and NULL is returned.
+        char*   Get(const char* inKey, SInt64 inModDate, UInt32* outSDPLen, UInt32* outSessionIDOffset,
+                        UInt32* outSessionIDLen, char* outModDateStr);
+        
+        //
+        // Takes over inSDP, which must have been allocated with NEW char[]. Replaces
+        // any SDP already cached for inKey.
+        void    Add(const char* inKey, SInt64 inModDate, const char* inModDateStr, char* inSDP, UInt32 inSDPLen);
+        
+        // Empties the cache
+        void    Flush();
+        
+        //
+        // Points outVecs[0..2] at a cached SDP before, in place of, and after its session
+        // ID. The new session ID is inSessionID, written into ioSessionIDBuffer, which must
+        // hold kSessionIDBufferLen chars. Returns the length of the SDP as it will be sent.
+        static UInt32   ReplaceSessionID(char* inSDP, UInt32 inSDPLen, UInt32 inSessionIDOffset, UInt32 inSessionIDLen,
+                                            SInt64 inSessionID, char* ioSessionIDBuffer, iovec* outVecs);
+        
+        UInt32  GetNumEntries()     { return fQueue.GetLength(); }
+        UInt32  GetNumHits()        { return fNumHits; }
+        UInt32  GetNumMisses()      { return fNumMisses; }
+        
+    private:
+    
+        static UInt32   HashKey(const char* inKey);
+        
+        // These are called with fMutex held
+        SDPCacheEntry*  Find(const char* inKey, UInt32 inHashValue);
+        void            Remove(SDPCacheEntry* inEntry);
+        
+        OSMutex         fMutex;
+        SDPCacheEntry*  fBuckets[kNumBuckets];
+        OSQueue         fQueue;
+        UInt32          fMaxEntries;
+        UInt32          fNumHits;
+        UInt32          fNumMisses;
+};
+
+#endif // __SDP_CACHE_H__
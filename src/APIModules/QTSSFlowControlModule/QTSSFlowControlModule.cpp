@@ -61,6 +61,7 @@ static UInt32   sDefaultLossThickTolerance      = 5;
 static UInt32   sDefaultLossesToThick           = 6;
 static UInt32   sDefaultWorsesToThin            = 2;
 static Bool16   sDefaultModuleEnabled      = true;
+static Bool16   sDefaultUsePacerModel      = false;
 
 // Current values for preferences
 static UInt32   sLossThinTolerance      = 30;
@@ -69,6 +70,11 @@ static UInt32   sLossThickTolerance     = 5;
 static UInt32   sLossesToThick          = 6;
 static UInt32   sWorsesToThin           = 2;
 static Bool16   sModuleEnabled      = true;
+static Bool16   sUsePacerModel      = false;
+
+// How far the smoothed round trip time can drift above the minimum, on top of
+// half the minimum, before we take it as a queue building up
+static UInt32   sRTTToleranceMSecs  = 20;
 
 // Server preference we respect
 static Bool16   sDisableThinning       = false;
@@ -82,6 +88,7 @@ static QTSS_Error   Initialize(QTSS_Initialize_Params* inParams);
 static QTSS_Error   RereadPrefs();
 static QTSS_Error   ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams);
 static void             InitializeDictionaryItems(QTSS_RTPStreamObject inStream);
+static Bool16           GetPathCondition(QTSS_ClientSessionObject inSession, Bool16* outIsCongested, Bool16* outHasRoom);
 
 
 
@@ -161,6 +168,8 @@ QTSS_Error RereadPrefs()
                                 
     QTSSModuleUtils::GetAttribute(sPrefs, "flow_control_udp_thinning_module_enabled",  qtssAttrDataTypeBool16,
             &sModuleEnabled, &sDefaultModuleEnabled, sizeof(sDefaultModuleEnabled));
+    QTSSModuleUtils::GetAttribute(sPrefs, "flow_control_use_pacer_model",  qtssAttrDataTypeBool16,
+            &sUsePacerModel, &sDefaultUsePacerModel, sizeof(sDefaultUsePacerModel));
 
     UInt32 len = sizeof(sDisableThinning);
     (void) QTSS_GetValue(sServerPrefs, qtssPrefsDisableThinning, 0, (void*)&sDisableThinning, &len);
@@ -218,6 +227,10 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
     
     //More bandwidth will be served if the client reports "getting better"
     
+    //If the server has a model of the path to the client (see RTPPacer), a congested
+    //path counts the same as a loss above M, and a path without room doesn't count
+    //towards serving more bandwidth even if the loss is low.
+    
     //If the initial values of our dictionary items aren't yet in, put them in.
     InitializeDictionaryItems(inParams->inRTPStream);
     
@@ -253,6 +266,8 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
      
     
     //First take any action necessitated by the loss percent
+    Bool16 isLossAboveTol = false;
+    Bool16 isLossBelowTol = false;
     (void)QTSS_GetValuePtr(inParams->inRTPStream, qtssRTPStrPercentPacketsLost, 0, (void**)&uint16Ptr, &theLen);
     if ((uint16Ptr != NULL) && (theLen == sizeof(UInt16)))
     {
@@ -261,50 +276,64 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
 #if FLOW_CONTROL_DEBUGGING
         qtss_printf("Percent loss: %d\n", thePercentLoss);
 #endif
+        isLossAboveTol = (thePercentLoss > sLossThinTolerance);
+        isLossBelowTol = (thePercentLoss < sLossThickTolerance);
+    }
     
-        //check for a thinning condition
-        if (thePercentLoss > sLossThinTolerance)
-        {
-            theNumLossesAboveTol++;//we must count this loss
-
-            //We only adjust after a certain number of these in a row. Check to see if we've
-            //satisfied the thinning condition, and adjust the count
-            if (theNumLossesAboveTol >= sNumLossesToThin)
-            {
+    //...or by the path model
+    Bool16 isCongested = false;
+    Bool16 hasRoom = false;
+    if (sUsePacerModel && GetPathCondition(inParams->inClientSession, &isCongested, &hasRoom))
+    {
 #if FLOW_CONTROL_DEBUGGING
-                qtss_printf("Percent loss too high: ratcheting less\n");
+        qtss_printf("Path congested: %d, path has room: %d\n", isCongested, hasRoom);
 #endif
-                ratchetLess = true;
-            }
-            else
-            {
+        isLossAboveTol = isLossAboveTol || isCongested;
+        isLossBelowTol = isLossBelowTol && hasRoom;
+    }
+    
+    //check for a thinning condition
+    if (isLossAboveTol)
+    {
+        theNumLossesAboveTol++;//we must count this loss
+
+        //We only adjust after a certain number of these in a row. Check to see if we've
+        //satisfied the thinning condition, and adjust the count
+        if (theNumLossesAboveTol >= sNumLossesToThin)
+        {
 #if FLOW_CONTROL_DEBUGGING
-                qtss_printf("Percent loss too high: Incrementing percent loss count to %lu\n", theNumLossesAboveTol);
+            qtss_printf("Percent loss or congestion too high: ratcheting less\n");
 #endif
-                (void)QTSS_SetValue(theStream, sNumLossesAboveTolAttr, 0, &theNumLossesAboveTol, sizeof(theNumLossesAboveTol));
-                clearPercentLossThinCount = false;
-            }
+            ratchetLess = true;
         }
-        //check for a thickening condition
-        else if (thePercentLoss < sLossThickTolerance)
+        else
         {
-            theNumLossesBelowTol++;//we must count this loss
-            if (theNumLossesBelowTol >= sLossesToThick)
-            {
 #if FLOW_CONTROL_DEBUGGING
-                qtss_printf("Percent is low: ratcheting more\n");
+            qtss_printf("Percent loss or congestion too high: Incrementing percent loss count to %lu\n", theNumLossesAboveTol);
 #endif
-                ratchetMore = true;
-            }
-            else
-            {
+            (void)QTSS_SetValue(theStream, sNumLossesAboveTolAttr, 0, &theNumLossesAboveTol, sizeof(theNumLossesAboveTol));
+            clearPercentLossThinCount = false;
+        }
+    }
+    //check for a thickening condition
+    else if (isLossBelowTol)
+    {
+        theNumLossesBelowTol++;//we must count this loss
+        if (theNumLossesBelowTol >= sLossesToThick)
+        {
 #if FLOW_CONTROL_DEBUGGING
-                qtss_printf("Percent is low: Incrementing percent loss count to %lu\n", theNumLossesBelowTol);
+            qtss_printf("Percent is low: ratcheting more\n");
 #endif
-                (void)QTSS_SetValue(theStream, sNumLossesBelowTolAttr, 0, &theNumLossesBelowTol, sizeof(theNumLossesBelowTol));
-                clearPercentLossThickCount = false;
-            }           
+            ratchetMore = true;
         }
+        else
+        {
+#if FLOW_CONTROL_DEBUGGING
+            qtss_printf("Percent is low: Incrementing percent loss count to %lu\n", theNumLossesBelowTol);
+#endif
+            (void)QTSS_SetValue(theStream, sNumLossesBelowTolAttr, 0, &theNumLossesBelowTol, sizeof(theNumLossesBelowTol));
+            clearPercentLossThickCount = false;
+        }           
     }
     
     //Now take a look at the getting worse heuristic
@@ -424,6 +453,34 @@ QTSS_Error ProcessRTCPPacket(QTSS_RTCPProcess_Params* inParams)
     return QTSS_NoErr;
 }
 
+Bool16  GetPathCondition(QTSS_ClientSessionObject inSession, Bool16* outIsCongested, Bool16* outHasRoom)
+{
+    UInt32 theBottleneckBandwidth = 0;
+    UInt32 theMinRTT = 0;
+    UInt32 theSmoothedRTT = 0;
+    UInt32 theCurrentBitRate = 0;
+    
+    UInt32 theLen = sizeof(theBottleneckBandwidth);
+    (void)QTSS_GetValue(inSession, qtssCliSesBottleneckBandwidth, 0, (void*)&theBottleneckBandwidth, &theLen);
+    if (theBottleneckBandwidth == 0)
+        return false; // no receiver reports to go by yet
+        
+    theLen = sizeof(theMinRTT);
+    (void)QTSS_GetValue(inSession, qtssCliSesMinRTTInMsec, 0, (void*)&theMinRTT, &theLen);
+    theLen = sizeof(theSmoothedRTT);
+    (void)QTSS_GetValue(inSession, qtssCliSesSmoothedRTTInMsec, 0, (void*)&theSmoothedRTT, &theLen);
+    theLen = sizeof(theCurrentBitRate);
+    (void)QTSS_GetValue(inSession, qtssCliSesCurrentBitRate, 0, (void*)&theCurrentBitRate, &theLen);
+    
+    //A round trip time well above the least one seen means packets are sitting in a
+    //queue somewhere. Sending a fifth more than the client has been getting means
+    //the queue is about to start.
+    Bool16 isQueueBuilding = (theSmoothedRTT > theMinRTT + (theMinRTT / 2) + sRTTToleranceMSecs);
+    *outIsCongested = isQueueBuilding || ((UInt64)theBottleneckBandwidth * 5 < (UInt64)theCurrentBitRate * 4);
+    *outHasRoom = !isQueueBuilding && (theBottleneckBandwidth >= theCurrentBitRate);
+    return true;
+}
+
 void    InitializeDictionaryItems(QTSS_RTPStreamObject inStream)
 {
     UInt32* theValue = NULL;
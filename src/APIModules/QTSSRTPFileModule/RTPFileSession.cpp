@@ -55,15 +55,15 @@ RTPFileSession::RTPFileSession()
 
 RTPFileSession::~RTPFileSession()
 {
-    // Check to see if we should destroy this file
-    OSMutexLocker locker (sOpenFileMap.GetMutex());
-
 #if RTPFILESESSIONDEBUG
     qtss_printf("Dropping refcount on file\n");
 #endif
     if (fFile == NULL)
         return;
         
+    // Check to see if we should destroy this file
+    OSMutexLocker locker (sOpenFileMap.GetMutex(fFile->GetRef()->GetString()));
+
     sOpenFileMap.Release(fFile->GetRef());
     if (fFile->GetRef()->GetRefCount() == 0)
     {
@@ -84,7 +84,7 @@ RTPFileSession::ErrorCode   RTPFileSession::Initialize(StrPtrLen& inFilePath, Fl
     Assert(fFile == NULL);
     
     // Check to see if this file is already open
-    OSMutexLocker locker(sOpenFileMap.GetMutex());
+    OSMutexLocker locker(sOpenFileMap.GetMutex((StrPtrLen*)&inFilePath));
     OSRef* theFileRef = sOpenFileMap.Resolve((StrPtrLen*)&inFilePath);
 
     if (theFileRef == NULL)
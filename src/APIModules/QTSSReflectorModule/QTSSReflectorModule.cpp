@@ -1286,7 +1286,7 @@ ReflectorSession* FindOrCreateSession(StrPtrLen* inPath, QTSS_StandardRTSP_Param
 {   
     // This function assumes that inPath is NULL terminated
     // Ok, look for a reflector session matching this full path as the ID
-    OSMutexLocker locker(sSessionMap->GetMutex());
+    OSMutexLocker locker(sSessionMap->GetMutex(inPath));
     OSRef* theSessionRef = sSessionMap->Resolve(inPath);
     ReflectorSession* theSession = NULL;
      
@@ -1566,27 +1566,14 @@ void DeleteReflectorPushSession(QTSS_StandardRTSP_Params* inParams, ReflectorSes
 
 QTSS_Error AddRTPStream(ReflectorSession* theSession,QTSS_StandardRTSP_Params* inParams, QTSS_RTPStreamObject *newStreamPtr)
 {       
-    // Ok, this is completely crazy but I can't think of a better way to do this that's
-    // safe so we'll do it this way for now. Because the ReflectorStreams use this session's
-    // stream queue, we need to make sure that each ReflectorStream is not reflecting to this
-    // session while we call QTSS_AddRTPStream. One brutal way to do this is to grab each
-    // ReflectorStream's mutex, which will stop every reflector stream from running.
+    // This is the broadcaster's session. Nothing reflects to it, so adding a
+    // stream can't disturb a ReflectorSender.
     Assert(newStreamPtr != NULL);
     
-    if (theSession != NULL)
-        for (UInt32 x = 0; x < theSession->GetNumStreams(); x++)
-            theSession->GetStreamByIndex(x)->GetMutex()->Lock();
-    
     //
     // Turn off reliable UDP transport, because we are not yet equipped to
     // do overbuffering.
-    QTSS_Error theErr = QTSS_AddRTPStream(inParams->inClientSession, inParams->inRTSPRequest, newStreamPtr, qtssASFlagsForceUDPTransport);
-
-    if (theSession != NULL)
-        for (UInt32 y = 0; y < theSession->GetNumStreams(); y++)
-            theSession->GetStreamByIndex(y)->GetMutex()->Unlock();
-
-    return theErr;
+    return QTSS_AddRTPStream(inParams->inClientSession, inParams->inRTSPRequest, newStreamPtr, qtssASFlagsForceUDPTransport);
 }
 
 QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams)
@@ -1733,20 +1720,10 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams)
     
     QTSS_RTPStreamObject newStream = NULL;
     {
-        // Ok, this is completely crazy but I can't think of a better way to do this that's
-        // safe so we'll do it this way for now. Because the ReflectorStreams use this session's
-        // stream queue, we need to make sure that each ReflectorStream is not reflecting to this
-        // session while we call QTSS_AddRTPStream. One brutal way to do this is to grab each
-        // ReflectorStream's mutex, which will stop every reflector stream from running.
-        
-        for (UInt32 x = 0; x < theSession->GetNumStreams(); x++)
-            theSession->GetStreamByIndex(x)->GetMutex()->Lock();
-            
+        // The ReflectorStreams may be reflecting to this session while we add the
+        // stream. That's safe: they only see the streams the RTPSessionOutput has
+        // been handed, and this one isn't handed over until it is set up below.
         theErr = QTSS_AddRTPStream(inParams->inClientSession, inParams->inRTSPRequest, &newStream, 0);
-
-        for (UInt32 y = 0; y < theSession->GetNumStreams(); y++)
-            theSession->GetStreamByIndex(y)->GetMutex()->Unlock();
-            
         if (theErr != QTSS_NoErr)
             return theErr;
     }
@@ -1773,6 +1750,11 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams)
     Assert(theStreamCookie != NULL);
     theErr = QTSS_SetValue(newStream, sStreamCookieAttr, 0, &theStreamCookie, sizeof(theStreamCookie));
     Assert(theErr == QTSS_NoErr);
+    
+    // Now that the stream can be matched to its ReflectorStream, let the output reflect to it
+    theErr = QTSS_GetValuePtr(inParams->inClientSession, sOutputAttr, 0, (void**)&theOutput, &theLen);
+    if ((theErr == QTSS_NoErr) && (theLen == sizeof(RTPSessionOutput*)))
+        (*theOutput)->AddStream(newStream);
 
     // Set the number of quality levels.
     static UInt32 sNumQualityLevels = ReflectorSession::kNumQualityLevels;
@@ -1806,6 +1788,12 @@ Bool16 HaveStreamBuffers(QTSS_StandardRTSP_Params* inParams, ReflectorSession* i
     
     
     SInt64 packetArrivalTime = 0;
+    
+    // RTP-Info has to describe the packets this output will actually start with
+    SInt64 theStartArrivalTime = 0;
+    RTPSessionOutput** theOutput = NULL;
+    if (QTSS_GetValuePtr(inParams->inClientSession, sOutputAttr, 0, (void**)&theOutput, &theLen) == QTSS_NoErr)
+        theStartArrivalTime = (*theOutput)->fStartArrivalTime;
 
     //lock all streams
     for (y = 0; y < inSession->GetNumStreams(); y++)
@@ -1832,7 +1820,7 @@ Bool16 HaveStreamBuffers(QTSS_StandardRTSP_Params* inParams, ReflectorSession* i
         }                
         
         theSender = theReflectorStream->GetRTPSender();                
-        haveBufferedStreams =  theSender->GetFirstPacketInfo(&firstSeqNum, &firstTimeStamp, &packetArrivalTime);
+        haveBufferedStreams =  theSender->GetFirstPacketInfo(&firstSeqNum, &firstTimeStamp, &packetArrivalTime, theStartArrivalTime);
         //printf("theStreamIndex= %lu haveBufferedStreams=%d, seqnum=%d, timestamp=%lu\n", theStreamIndex, haveBufferedStreams, firstSeqNum, firstTimeStamp);
        
        if (!haveBufferedStreams)
@@ -1937,6 +1925,13 @@ QTSS_Error DoPlay(QTSS_StandardRTSP_Params* inParams, ReflectorSession* inSessio
         // server can use it from within QTSS_Play
         UInt32 bitsPerSecond =  inSession->GetBitRate();
         (void)QTSS_SetValue(inParams->inClientSession, qtssCliSesMovieAverageBitRate, 0, &bitsPerSecond, sizeof(bitsPerSecond));
+        
+        // A viewer that hasn't been sent anything yet starts at the most recent
+        // keyframe, if the broadcast has one, so the first picture comes right away.
+        RTPSessionOutput** theOutput = NULL;
+        theErr = QTSS_GetValuePtr(inParams->inClientSession, sOutputAttr, 0, (void**)&theOutput, &theLen);
+        if ((theErr == QTSS_NoErr) && (*theOutput)->fNewOutput)
+            (*theOutput)->SetStartArrivalTime(inSession->GetKeyFrameStartTime());
    
         if (sPlayResponseRangeHeader)
         {
@@ -2028,9 +2023,9 @@ void KillCommandPathInList()
 {
     char filePath[128] = "";
     ResizeableStringFormatter commandPath( (char*) filePath, sizeof(filePath)); // ResizeableStringFormatter is safer and more efficient than StringFormatter for most paths.
-    OSMutexLocker locker (sSessionMap->GetMutex());
+    OSRefTableLocker locker(sSessionMap);
 
-    for (OSRefHashTableIter theIter(sSessionMap->GetHashTable()); !theIter.IsDone(); theIter.Next())
+    for (OSRefTableIter theIter(sSessionMap); !theIter.IsDone(); theIter.Next())
     {
         OSRef* theRef = theIter.GetCurrent();
         if (theRef == NULL)
@@ -2141,10 +2136,10 @@ void RemoveOutput(ReflectorOutput* inOutput, ReflectorSession* inSession, Bool16
 
         //check if the ReflectorSession should be deleted
         //(it should if its ref count has dropped to 0)
-        OSMutexLocker locker (sSessionMap->GetMutex());
+        OSRef* theSessionRef = inSession->GetRef();
+        OSMutexLocker locker ((theSessionRef != NULL) ? sSessionMap->GetMutex(theSessionRef->GetString()) : NULL);
         //decrement the ref count
         
-        OSRef* theSessionRef = inSession->GetRef();
         if (theSessionRef != NULL) 
         {               
             if (theSessionRef->GetRefCount() == 0)
@@ -493,6 +493,11 @@ QTSS_Error Filter(QTSS_StandardRTSP_Params* inParams)
         RelaySession* theSession = (RelaySession*)iter.GetCurrent()->GetEnclosingObject();
         (void)QTSS_Write(inParams->inRTSPRequest, theSession->GetSourceInfoHTML()->Ptr, theSession->GetSourceInfoHTML()->Len, NULL, 0);
 
+        // Write ingest stats for this source
+        char theIngestBuf[256];
+        qtss_sprintf(theIngestBuf, "Ingest stats for this source: %lu packets dropped by the kernel. %lu packets too big to reflect.<P>", theSession->GetNumPacketsDropped(), theSession->GetNumPacketOverruns());
+        (void)QTSS_Write(inParams->inRTSPRequest, &theIngestBuf[0], ::strlen(theIngestBuf), NULL, 0);
+
         for (OSQueueIter iter2(RelayOutput::GetOutputQueue()); !iter2.IsDone(); iter2.Next())
         {
             RelayOutput* theOutput = (RelayOutput*)iter2.GetCurrent()->GetEnclosingObject();
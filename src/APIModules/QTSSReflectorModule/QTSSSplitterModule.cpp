@@ -374,7 +374,7 @@ ReflectorSession* FindOrCreateSession(StrPtrLen* inPath, QTSS_StandardRTSP_Param
     // Ok, look for a reflector session matching the URL specified in the RCF file.
     // A unique broadcast is defined by the URL, the URL is the argument to resolve.
      
-    OSMutexLocker locker(sSessionMap->GetMutex());
+    OSMutexLocker locker(sSessionMap->GetMutex(theInfo->GetRTSPClient()->GetURL()));
     OSRef* theSessionRef = sSessionMap->Resolve(theInfo->GetRTSPClient()->GetURL());
     ReflectorSession* theSession = NULL;
     
@@ -473,7 +473,7 @@ void    DeleteSessionOnError(ReflectorSession* inSession, QTSS_ClientSessionObje
     Assert(inSession->GetSocketStream() != NULL);
     (void)QTSS_DestroySocketStream(inSession->GetSocketStream());
 
-    OSMutexLocker locker (sSessionMap->GetMutex());
+    OSMutexLocker locker (sSessionMap->GetMutex(inSession->GetRef()->GetString()));
     //decrement the ref count
     sSessionMap->Release(inSession->GetRef());
     
@@ -522,20 +522,10 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams, ReflectorSession* inSessi
 
     QTSS_RTPStreamObject newStream = NULL;
     {
-        // Ok, this is completely crazy but I can't think of a better way to do this that's
-        // safe so we'll do it this way for now. Because the ReflectorStreams use this session's
-        // stream queue, we need to make sure that each ReflectorStream is not reflecting to this
-        // session while we call QTSS_AddRTPStream. One brutal way to do this is to grab each
-        // ReflectorStream's mutex, which will stop every reflector stream from running.
-        
-        for (UInt32 x = 0; x < inSession->GetNumStreams(); x++)
-            inSession->GetStreamByIndex(x)->GetMutex()->Lock();
-            
+        // The ReflectorStreams may be reflecting to this session while we add the
+        // stream. That's safe: they only see the streams the RTPSessionOutput has
+        // been handed, and this one isn't handed over until it is set up below.
         theErr = QTSS_AddRTPStream(inParams->inClientSession, inParams->inRTSPRequest, &newStream, 0);
-
-        for (UInt32 y = 0; y < inSession->GetNumStreams(); y++)
-            inSession->GetStreamByIndex(y)->GetMutex()->Unlock();
-            
         if (theErr != QTSS_NoErr)
             return theErr;
     }
@@ -554,6 +544,13 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams, ReflectorSession* inSessi
     theErr = QTSS_SetValue(newStream, sStreamCookieAttr, 0, &theStreamCookie, sizeof(theStreamCookie));
     Assert(theErr == QTSS_NoErr);
 
+    // Now that the stream can be matched to its ReflectorStream, let the output reflect to it
+    RTPSessionOutput** theOutput = NULL;
+    UInt32 theLen = 0;
+    theErr = QTSS_GetValuePtr(inParams->inClientSession, sOutputAttr, 0, (void**)&theOutput, &theLen);
+    if ((theErr == QTSS_NoErr) && (theLen == sizeof(RTPSessionOutput*)))
+        (*theOutput)->AddStream(newStream);
+
     // Set the number of quality levels.
     static UInt32 sNumQualityLevels = ReflectorSession::kNumQualityLevels;
     theErr = QTSS_SetValue(newStream, qtssRTPStrNumQualityLevels, 0, &sNumQualityLevels, sizeof(sNumQualityLevels));
@@ -610,7 +607,7 @@ QTSS_Error DestroySession(QTSS_ClientSessionClosing_Params* inParams)
 
         //check if the ReflectorSession should be deleted
         //(it should if its ref count has dropped to 0)
-        OSMutexLocker locker (sSessionMap->GetMutex());
+        OSMutexLocker locker (sSessionMap->GetMutex(theSession->GetRef()->GetString()));
         //decrement the ref count
         sSessionMap->Release(theSession->GetRef());
         if (theSession->GetRef()->GetRefCount() == 0)
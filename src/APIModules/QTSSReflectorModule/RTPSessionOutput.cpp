@@ -33,6 +33,8 @@
 
 #include "RTPSessionOutput.h"
 #include "ReflectorStream.h"
+#include "OSMemory.h"
+#include "atomic.h"
 
 #include <errno.h>
 
@@ -81,13 +83,48 @@ RTPSessionOutput::RTPSessionOutput(QTSS_ClientSessionObject inClientSession, Ref
     fIsUDP(false),
     fTransportInitialized(false),
     fMustSynch(true),
-    fPreFilter(true)
+    fPreFilter(true),
+    fStreamArray(NULL),
+    fMaxStreams(inReflectorSession->GetNumStreams()),
+    fNumStreams(0)
 {
+    fStreamArray = NEW QTSS_RTPStreamObject[fMaxStreams];
+    
     // create a bookmark for each stream we'll reflect
     this->InititializeBookmarks( inReflectorSession->GetNumStreams() );
    
 }
 
+void RTPSessionOutput::AddStream(QTSS_RTPStreamObject inStream)
+{
+    // Only the RTSP thread adds streams, so the slot needs no lock. The
+    // barrier keeps a sender from seeing the count before the slot.
+    Assert(fNumStreams < fMaxStreams);
+    if (fNumStreams >= fMaxStreams)
+        return;
+        
+    fStreamArray[fNumStreams] = inStream;
+    memory_barrier();
+    fNumStreams++;
+}
+
+void RTPSessionOutput::SetStartArrivalTime(SInt64 inArrivalTime)
+{
+    fStartArrivalTime = inArrivalTime;
+    fBufferDelayMSecs = ReflectorStream::sOverBufferInMsec;
+    if (inArrivalTime == 0)
+        return;
+        
+    //Packets are scheduled a buffer delay after they arrived. Shortening it to the
+    //age of the first packet has that go out now and the rest at their original
+    //spacing, which the stream's overbuffer window lets the client take early.
+    SInt64 theAge = OS::Milliseconds() - inArrivalTime;
+    if (theAge < 0)
+        theAge = 0;
+    if (theAge < (SInt64)fBufferDelayMSecs)
+        fBufferDelayMSecs = (UInt32)theAge;
+}
+
 void RTPSessionOutput::Register()
 {
     // Add some attributes to QTSS_RTPStream dictionary 
@@ -208,8 +245,9 @@ Bool16 RTPSessionOutput::IsUDP()
         
     QTSS_RTPStreamObject *theStreamPtr = NULL;
     QTSS_RTPTransportType *theTransportTypePtr = NULL;
-    for (SInt16 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+    for (UInt32 z = 0; z < fNumStreams; z++)
     {
+        theStreamPtr = &fStreamArray[z];
         (void) QTSS_GetValuePtr(*theStreamPtr, qtssRTPStrTransportType, 0, (void**) &theTransportTypePtr, &theLen);
         if (theTransportTypePtr && *theTransportTypePtr == qtssRTPTransportTypeUDP)
         {   
@@ -319,8 +357,9 @@ QTSS_Error  RTPSessionOutput::TrackRTCPBaseTime(QTSS_RTPStreamObject *theStreamP
         if (fMustSynch || QTSS_NoErr != QTSS_GetValuePtr(*theStreamPtr, sBaseArrivalTimeStampAttr, 0, (void**)&fBaseArrivalTime, &theLen)  )
         {   // we don't have a base arrival time for the session see if we can set one now.
         
-            for (SInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&findStream, &theLen) == QTSS_NoErr; z++)
+            for (UInt32 z = 0; z < fNumStreams; z++)
             {
+                findStream = &fStreamArray[z];
                 SInt64* firstArrivalTimePtr = NULL;
                 if (QTSS_NoErr != QTSS_GetValuePtr(*findStream, sFirstRTPArrivalTimeAttr, 0, (void**)&firstArrivalTimePtr, &theLen))
                 {// no packet on this stream yet 
@@ -559,18 +598,22 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
     //make sure all RTP streams with this ID see this packet
     QTSS_RTPStreamObject *theStreamPtr = NULL;
                                   
-    for (UInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+    for (UInt32 z = 0; z < fNumStreams; z++)
     {
+        theStreamPtr = &fStreamArray[z];
         if (this->PacketMatchesStream(inStreamCookie, theStreamPtr))
         { 
             if ( this->FilterPacket(theStreamPtr, inPacket) )
-                return  QTSS_NoErr; // keep looking at packets
+                break; // keep looking at packets
                 
             if (this->PacketAlreadySent(theStreamPtr,inFlags, packetIDPtr)) 
-                return QTSS_NoErr; // keep looking at packets
+                break; // keep looking at packets
                 
             if (!this->PacketReadyToSend(theStreamPtr,&currentTime, inFlags, packetIDPtr, timeToSendThisPacketAgain)) 
-                return QTSS_WouldBlock; // stop not ready to send packets now
+            {
+                writeErr = QTSS_WouldBlock; // stop not ready to send packets now
+                break;
+            }
                                           
     
        // TrackPackets below is for re-writing the rtcps we don't use it right now-- shouldn't need to    
@@ -579,7 +622,7 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
             QTSS_PacketStruct thePacket;
             thePacket.packetData = inPacket->Ptr;
             thePacket.packetTransmitTime = (currentTime - packetLatenessInMSec) + (fBufferDelayMSecs - (currentTime - *arrivalTimeMSecPtr)); // add buffer time where oldest buffered packet as now == 0 and newest is entire buffer time in the future.
-            writeErr = QTSS_Write(*theStreamPtr, &thePacket, inPacket->Len, NULL, inFlags | qtssWriteFlagsWriteBurstBegin); 
+            writeErr = QTSS_Write(*theStreamPtr, &thePacket, inPacket->Len, NULL, inFlags | qtssWriteFlagsWriteBurstBegin | qtssWriteFlagsSharedPacketData); 
             if (writeErr == QTSS_WouldBlock)
             {  
                 //
@@ -49,10 +49,16 @@ class RTPSessionOutput : public ReflectorOutput
         
         RTPSessionOutput(QTSS_ClientSessionObject inRTPSession, ReflectorSession* inReflectorSession,
                             QTSS_Object serverPrefs, QTSS_AttributeID inCookieAddrID);
-        virtual ~RTPSessionOutput() {}
+        virtual ~RTPSessionOutput() { delete [] fStreamArray; }
         
         ReflectorSession* GetReflectorSession() { return fReflectorSession; }
         
+        // Reflects to inStream from now on. Call once a SETUP has added the stream
+        // to the client session and set its stream cookie. The senders only look at
+        // streams added this way, never at the client session's own stream array,
+        // which the RTSP thread may grow while they are walking it.
+        void                    AddStream(QTSS_RTPStreamObject inStream);
+        
         // This writes the packet out to the proper QTSS_RTPStreamObject.
         // If this function returns QTSS_WouldBlock, timeToSendThisPacketAgain will
         // be set to # of msec in which the packet can be sent, or -1 if unknown
@@ -61,6 +67,11 @@ class RTPSessionOutput : public ReflectorOutput
         
         SInt64                  GetReflectorSessionInitTime()                    { return fReflectorSession->GetInitTimeMS(); }
         
+        // Starts this output with the packets that arrived at or after inArrivalTime
+        // (normally a keyframe, see ReflectorSession::GetKeyFrameStartTime), sent
+        // right away rather than a whole buffer delay behind. 0 restores the default.
+        void                    SetStartArrivalTime(SInt64 inArrivalTime);
+        
         virtual Bool16  IsUDP();
         
         virtual Bool16  IsPlaying();
@@ -77,6 +88,10 @@ class RTPSessionOutput : public ReflectorOutput
         Bool16                  fMustSynch;
         Bool16                  fPreFilter;
         
+        QTSS_RTPStreamObject*   fStreamArray;   // one slot per ReflectorSession stream
+        UInt32                  fMaxStreams;
+        volatile UInt32         fNumStreams;    // bumped after the slot is filled
+        
         UInt16 GetPacketSeqNumber(StrPtrLen* inPacket);
         void SetPacketSeqNumber(StrPtrLen* inPacket, UInt16 inSeqNumber);
         Bool16 PacketShouldBeThinned(QTSS_RTPStreamObject inStream, StrPtrLen* inPacket);
@@ -49,7 +49,7 @@ class ReflectorOutput
 {
     public:
     
-        ReflectorOutput() : fBookmarkedPacketsElemsArray(NULL), fNumBookmarks(0), fAvailPosition(0), fLastIntervalMilliSec(5), fLastPacketTransmitTime(0) {}   
+        ReflectorOutput() : fBookmarkedPacketsElemsArray(NULL), fNumBookmarks(0), fAvailPosition(0), fLastIntervalMilliSec(5), fLastPacketTransmitTime(0), fNewOutput(true), fStartArrivalTime(0) {}   
 
         virtual ~ReflectorOutput() 
         {
@@ -68,6 +68,10 @@ class ReflectorOutput
         QTSS_TimeVal        fLastPacketTransmitTime;
        
         Bool16              fNewOutput;
+        
+        // If not 0, each sender starts this output at its first packet that
+        // arrived at or after this time, rather than at the usual place in the buffer.
+        SInt64              fStartArrivalTime;
 inline  OSQueueElem*    GetBookMarkedPacket(OSQueue *thePacketQueue);
 inline  Bool16          SetBookMarkPacket(OSQueueElem* thePacketElemPtr);
         
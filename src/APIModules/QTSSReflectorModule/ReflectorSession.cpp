@@ -119,12 +119,12 @@ ReflectorSession::~ReflectorSession()
 #endif
 
     // For each stream, check to see if the ReflectorStream should be deleted
-    OSMutexLocker locker (sStreamMap->GetMutex());
     for (UInt32 x = 0; x < fSourceInfo->GetNumStreams(); x++)
     {
         if (fStreamArray[x] == NULL)
             continue;
         
+        OSMutexLocker locker (sStreamMap->GetMutex(fStreamArray[x]->GetRef()->GetString()));
         UInt32 refCount = fStreamArray[x]->GetRef()->GetRefCount();
         Bool16 unregisterNow = (refCount == 1) ? true : false;
         
@@ -183,7 +183,9 @@ QTSS_Error ReflectorSession::SetupReflectorSession(SourceInfo* inInfo, QTSS_Stan
         StrPtrLen theStreamIDPtr(theStreamID, ReflectorStream::kStreamIDSize);
         ReflectorStream::GenerateSourceID(fSourceInfo->GetStreamInfo(x), &theStreamID[0]);
         
-        OSMutexLocker locker(sStreamMap->GetMutex());
+        // The stream's ID can change once its sockets are bound, so lock
+        // the whole map rather than just this ID
+        OSRefTableLocker locker(sStreamMap);
         OSRef* theStreamRef = NULL;
         
         if (false && (inFlags & kIsPushSession)) // always setup our own ports when pushed.
@@ -351,6 +353,24 @@ void    ReflectorSession::AddOutput(ReflectorOutput* inOutput, Bool16 isClient)
     (void)atomic_add(&fNumOutputs, 1);
 }
 
+SInt64  ReflectorSession::GetKeyFrameStartTime()
+{
+    SInt64 theStartTime = 0;
+    for (UInt32 x = 0; x < fSourceInfo->GetNumStreams(); x++)
+    {
+        ReflectorSender* theSender = fStreamArray[x]->GetRTPSender();
+        if (!theSender->TracksKeyFrames())
+            continue;
+            
+        SInt64 theKeyFrameTime = theSender->GetKeyFrameArrivalTime();
+        if (theKeyFrameTime == 0)
+            return 0;
+        if ((theStartTime == 0) || (theKeyFrameTime < theStartTime))
+            theStartTime = theKeyFrameTime;
+    }
+    return theStartTime;
+}
+
 void    ReflectorSession::RemoveOutput(ReflectorOutput* inOutput, Bool16 isClient)
 {
     (void)atomic_sub(&fNumOutputs, 1);
@@ -386,6 +406,22 @@ UInt32  ReflectorSession::GetBitRate()
     return retval;
 }
 
+UInt32  ReflectorSession::GetNumPacketsDropped()
+{
+    UInt32 retval = 0;
+    for (UInt32 x = 0; x < fSourceInfo->GetNumStreams(); x++)
+        retval += fStreamArray[x]->GetNumPacketsDropped();
+    return retval;
+}
+
+UInt32  ReflectorSession::GetNumPacketOverruns()
+{
+    UInt32 retval = 0;
+    for (UInt32 x = 0; x < fSourceInfo->GetNumStreams(); x++)
+        retval += fStreamArray[x]->GetNumPacketOverruns();
+    return retval;
+}
+
 Bool16 ReflectorSession::Equal(SourceInfo* inInfo)
 {
     return fSourceInfo->Equal(inInfo);
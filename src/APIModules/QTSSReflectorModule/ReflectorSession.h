@@ -142,6 +142,17 @@ class ReflectorSession
         // until enough time passes to compute an accurate average.
         UInt32          GetBitRate();
         
+        // Ingest health, summed over the streams' sockets: packets the kernel
+        // dropped for want of receive buffer, and packets too big to reflect.
+        UInt32          GetNumPacketsDropped();
+        UInt32          GetNumPacketOverruns();
+        
+        // Where new outputs should start so that every video stream begins
+        // with a keyframe: the arrival time of the oldest of the video streams'
+        // most recent keyframes. 0 if any video stream we can find keyframes
+        // in doesn't have one buffered, or if there are no such streams.
+        SInt64          GetKeyFrameStartTime();
+        
         // Returns true if this SourceInfo structure is equivalent to this
         // ReflectorSession.
         Bool16 Equal(SourceInfo* inInfo);
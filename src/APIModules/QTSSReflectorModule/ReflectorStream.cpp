@@ -38,6 +38,7 @@
 #include "atomic.h"
 #include "RTCPPacket.h"
 #include "ReflectorSession.h"
+#include "UDPSocket.h"
 
 
 #if DEBUG
@@ -61,6 +62,9 @@ static UInt32                   sDefaultBucketDelayInMsec           = 73;
 static Bool16                   sDefaultUsePacketReceiveTime        = false; 
 static UInt32                   sDefaultMaxFuturePacketTimeSec      = 60;
 static UInt32                   sDefaultFirstPacketOffsetMsec       = 500;
+static UInt32                   sDefaultFanOutThreads               = 0;
+static UInt32                   sDefaultFanOutMinOutputs            = 2000;
+static Bool16                   sDefaultKeyFrameStartEnabled        = true;
 
 UInt32                          ReflectorStream::sBucketSize  = 16;
 UInt32                          ReflectorStream::sOverBufferInMsec = 10000; // more or less what the client over buffer will be
@@ -72,6 +76,7 @@ UInt32                          ReflectorStream::sOverBufferInSec = 10;
 UInt32                          ReflectorStream::sBucketDelayInMsec = 73;
 Bool16                          ReflectorStream::sUsePacketReceiveTime = false;
 UInt32                          ReflectorStream::sFirstPacketOffsetMsec = 500;
+Bool16                          ReflectorStream::sKeyFrameStartEnabled = true;
 
 void ReflectorStream::Register()
 {
@@ -104,9 +109,23 @@ void ReflectorStream::Initialize(QTSS_ModulePrefsObject inPrefs)
     QTSSModuleUtils::GetAttribute(inPrefs, "reflector_rtp_info_offset_msec", qtssAttrDataTypeUInt32,
                               &ReflectorStream::sFirstPacketOffsetMsec, &sDefaultFirstPacketOffsetMsec, sizeof(sDefaultFirstPacketOffsetMsec));
 
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_keyframe_start", qtssAttrDataTypeBool16,
+                              &ReflectorStream::sKeyFrameStartEnabled, &sDefaultKeyFrameStartEnabled, sizeof(sDefaultKeyFrameStartEnabled));
+
     ReflectorStream::sOverBufferInMsec = sOverBufferInSec * 1000;
     ReflectorStream::sMaxFuturePacketMSec = sMaxFuturePacketSec * 1000;
     ReflectorStream::sMaxPacketAgeMSec = sOverBufferInMsec;
+    
+    // The fan-out threads are started once; changing their number takes a restart.
+    UInt32 theNumFanOutThreads = 0;
+    UInt32 theFanOutMinOutputs = 0;
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_fanout_threads", qtssAttrDataTypeUInt32,
+                              &theNumFanOutThreads, &sDefaultFanOutThreads, sizeof(theNumFanOutThreads));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_fanout_min_outputs", qtssAttrDataTypeUInt32,
+                              &theFanOutMinOutputs, &sDefaultFanOutMinOutputs, sizeof(theFanOutMinOutputs));
+
+    ReflectorFanOutThread::Initialize(theNumFanOutThreads, theFanOutMinOutputs);
 }
 
 void ReflectorStream::GenerateSourceID(SourceInfo::StreamInfo* inInfo, char* ioBuffer)
@@ -123,9 +142,9 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
     fRTPSender(NULL, qtssWriteFlagsIsRTP),
     fRTCPSender(NULL, qtssWriteFlagsIsRTCP),
     fOutputArray(NULL),
-    fNumBuckets(kMinNumBuckets),
     fNumElements(0),
     fBucketMutex(),
+    fOutputsEpoch(1),
     
     fDestRTCPAddr(0),
     fDestRTCPPort(0),
@@ -149,8 +168,17 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
 
     fStreamInfo.Copy(*inInfo);
     
+    //New viewers of video we can find keyframes in are started on one
+    if (sKeyFrameStartEnabled && (fStreamInfo.fPayloadType == qtssVideoPayloadType))
+    {
+        if (fStreamInfo.fPayloadName.NumEqualIgnoreCase("H264/", 5))
+            fRTPSender.fKeyFrameFormat = ReflectorSender::kH264KeyFrames;
+        else if (fStreamInfo.fPayloadName.NumEqualIgnoreCase("MP4V-ES/", 8))
+            fRTPSender.fKeyFrameFormat = ReflectorSender::kMPEG4KeyFrames;
+    }
+    
     // ALLOCATE BUCKET ARRAY
-    this->AllocateBucketArray(fNumBuckets);
+    (void)this->AllocateBucketArray(kMinNumBuckets);
 
     // WRITE RTCP PACKET
     
@@ -227,84 +255,172 @@ ReflectorStream::~ReflectorStream()
         //qtss_printf("Deleting stream %x\n", this);
 
     //delete every client Bucket
-    for (UInt32 y = 0; y < fNumBuckets; y++)
-        delete [] fOutputArray[y];
-    delete [] fOutputArray;
+    for (UInt32 y = 0; y < fOutputArray->fNumBuckets; y++)
+        delete [] fOutputArray->fBuckets[y];
+    delete [] fOutputArray->fBuckets;
+    delete fOutputArray;
 }
 
-void ReflectorStream::AllocateBucketArray(UInt32 inNumBuckets)
+ReflectorStream::BucketArray* ReflectorStream::AllocateBucketArray(UInt32 inNumBuckets)
 {
-    Bucket* oldArray = fOutputArray;
-    //allocate the 2-dimensional array
-    fOutputArray = NEW Bucket[inNumBuckets];
-    for (UInt32 x = 0; x < inNumBuckets; x++)
+    //The new array takes over the buckets of the old one, so the only thing
+    //that needs copying is the array of bucket pointers. Returns the old
+    //array, which the caller must free (but not its buckets) once no sender
+    //can still be walking it.
+    BucketArray* oldArray = fOutputArray;
+    BucketArray* newArray = NEW BucketArray;
+    newArray->fNumBuckets = inNumBuckets;
+    newArray->fBuckets = NEW Bucket[inNumBuckets];
+    
+    UInt32 x = 0;
+    if (oldArray != NULL)
+    {
+        Assert(inNumBuckets > oldArray->fNumBuckets);
+        for ( ; x < oldArray->fNumBuckets; x++)
+            newArray->fBuckets[x] = oldArray->fBuckets[x];
+    }
+    for ( ; x < inNumBuckets; x++)
     {
-        fOutputArray[x] = NEW ReflectorOutput*[sBucketSize];
-        ::memset(fOutputArray[x], 0, sizeof(ReflectorOutput*) * sBucketSize);
+        newArray->fBuckets[x] = NEW ReflectorOutput*[sBucketSize];
+        ::memset(newArray->fBuckets[x], 0, sizeof(ReflectorOutput*) * sBucketSize);
     }
     
-    //copy over the old information if there was an old array
-    if (oldArray != NULL)
+    memory_barrier(); //the new array must be complete before a sender can find it
+    fOutputArray = newArray;
+    return oldArray;
+}
+
+UInt32 ReflectorStream::GetNumPacketsDropped()
+{
+    if (fSockets == NULL)
+        return 0;
+    return ((ReflectorSocket*)fSockets->GetSocketA())->GetNumPacketsDropped() +
+            ((ReflectorSocket*)fSockets->GetSocketB())->GetNumPacketsDropped();
+}
+
+UInt32 ReflectorStream::GetNumPacketOverruns()
+{
+    if (fSockets == NULL)
+        return 0;
+    return ((ReflectorSocket*)fSockets->GetSocketA())->GetNumPacketOverruns() +
+            ((ReflectorSocket*)fSockets->GetSocketB())->GetNumPacketOverruns();
+}
+
+UInt32 ReflectorStream::AdvanceOutputsEpoch()
+{
+    memory_barrier(); //a walk that sees the new epoch must also see the change
+    fOutputsEpoch++;
+    if (fOutputsEpoch == 0)
+        fOutputsEpoch = 1;
+    return fOutputsEpoch;
+}
+
+void ReflectorStream::WaitForOutputWalks(UInt32 inEpoch)
+{
+    //
+    // A walk that started under inEpoch or later can't see what was changed
+    // before inEpoch was reached. Wait out any walk that started earlier.
+    // Walks take a single pass over the outputs, so this is short.
+    memory_barrier();
+    for (UInt32 theNumWaits = 0; ; theNumWaits++)
     {
-        Assert(inNumBuckets > fNumBuckets);
-        for (UInt32 y = 0; y < fNumBuckets; y++)
-        {
-            ::memcpy(fOutputArray[y],oldArray[y], sBucketSize * sizeof(ReflectorOutput*));
-            delete [] oldArray[y];
-        }
-        delete [] oldArray;
+        UInt32 theRTPWalk = fRTPSender.fOutputWalkEpoch;
+        UInt32 theRTCPWalk = fRTCPSender.fOutputWalkEpoch;
+        if (((theRTPWalk == 0) || ((SInt32)(theRTPWalk - inEpoch) >= 0)) &&
+            ((theRTCPWalk == 0) || ((SInt32)(theRTCPWalk - inEpoch) >= 0)))
+            break;
+            
+        if (theNumWaits < 100)
+            OSThread::ThreadYield();
+        else
+            OSThread::Sleep(1);
     }
-    fNumBuckets = inNumBuckets;
 }
 
+ReflectorStream::BucketArray* ReflectorStream::BeginOutputWalk(volatile UInt32* outWalkEpoch)
+{
+    *outWalkEpoch = fOutputsEpoch;
+    memory_barrier(); //announce the walk before looking at the outputs
+    return fOutputArray;
+}
+
+void ReflectorStream::EndOutputWalk(volatile UInt32* ioWalkEpoch)
+{
+    memory_barrier(); //done with the outputs before saying so
+    *ioWalkEpoch = 0;
+}
 
 SInt32 ReflectorStream::AddOutput(ReflectorOutput* inOutput, SInt32 putInThisBucket)
 {
-    OSMutexLocker locker(&fBucketMutex);
-    
+    BucketArray* theOldArray = NULL;
+    SInt32 theResult = -1;
+    UInt32 theEpoch = 0;
+    {
+        OSMutexLocker locker(&fBucketMutex);
+        
 #if DEBUG
-    // We should never be adding an output twice to a stream
-    for (UInt32 dOne = 0; dOne < fNumBuckets; dOne++)
-        for (UInt32 dTwo = 0; dTwo < sBucketSize; dTwo++)
-            Assert(fOutputArray[dOne][dTwo] != inOutput);
+        // We should never be adding an output twice to a stream
+        for (UInt32 dOne = 0; dOne < fOutputArray->fNumBuckets; dOne++)
+            for (UInt32 dTwo = 0; dTwo < sBucketSize; dTwo++)
+                Assert(fOutputArray->fBuckets[dOne][dTwo] != inOutput);
 #endif
 
-    // If caller didn't specify a bucket, find a bucket
-    if (putInThisBucket < 0)
-        putInThisBucket = this->FindBucket();
+        // If caller didn't specify a bucket, find a bucket
+        if (putInThisBucket < 0)
+        {
+            // If we need more buckets, allocate them.
+            if (fNumElements == (sBucketSize * fOutputArray->fNumBuckets))
+                theOldArray = this->AllocateBucketArray(fOutputArray->fNumBuckets * 2);
+            putInThisBucket = this->FindBucket();
+        }
+            
+        Assert(putInThisBucket >= 0);
         
-    Assert(putInThisBucket >= 0);
-    
-    if (fNumBuckets <= (UInt32)putInThisBucket)
-        this->AllocateBucketArray(putInThisBucket * 2);
+        if (fOutputArray->fNumBuckets <= (UInt32)putInThisBucket)
+        {
+            Assert(theOldArray == NULL);
+            theOldArray = this->AllocateBucketArray(putInThisBucket * 2);
+        }
 
-    for(UInt32 y = 0; y < sBucketSize; y++)
-    {
-        if (fOutputArray[putInThisBucket][y] == NULL)
+        Bucket theBucket = fOutputArray->fBuckets[putInThisBucket];
+        for(UInt32 y = 0; y < sBucketSize; y++)
         {
-            fOutputArray[putInThisBucket][y] = inOutput;
+            if (theBucket[y] == NULL)
+            {
+                memory_barrier(); //a sender that finds the output must see it fully set up
+                theBucket[y] = inOutput;
 #if REFLECTOR_STREAM_DEBUGGING 
-            qtss_printf("Adding new output (0x%lx) to bucket %ld, index %ld,\nnum buckets %li bucketSize: %li \n",(long)inOutput, putInThisBucket, y, (long)fNumBuckets, (long)sBucketSize);
+                qtss_printf("Adding new output (0x%lx) to bucket %ld, index %ld,\nnum buckets %li bucketSize: %li \n",(long)inOutput, putInThisBucket, y, (long)fOutputArray->fNumBuckets, (long)sBucketSize);
 #endif
-            fNumElements++;
-            return putInThisBucket;
+                fNumElements++;
+                theResult = putInThisBucket;
+                break;
+            }
         }
+        // If there was no empty spot in the specified bucket, theResult is still an error
+        
+        if (theOldArray != NULL)
+            theEpoch = this->AdvanceOutputsEpoch();
+    }
+    
+    //Filling a slot is safe under a walk, but the array we replaced may still be
+    //in use. Wait without the lock: a sender takes it when it trims its queue.
+    if (theOldArray != NULL)
+    {
+        this->WaitForOutputWalks(theEpoch);
+        delete [] theOldArray->fBuckets;
+        delete theOldArray;
     }
-    // There was no empty spot in the specified bucket. Return an error
-    return -1;      
+    return theResult;
 }
 
 SInt32 ReflectorStream::FindBucket()
 {
-    // If we need more buckets, allocate them.
-    if (fNumElements == (sBucketSize * fNumBuckets))
-        this->AllocateBucketArray(fNumBuckets * 2);
-    
     //find the first open spot in the array
-    for (SInt32 putInThisBucket = 0; (UInt32)putInThisBucket < fNumBuckets; putInThisBucket++)
+    for (SInt32 putInThisBucket = 0; (UInt32)putInThisBucket < fOutputArray->fNumBuckets; putInThisBucket++)
     {
         for(UInt32 y = 0; y < sBucketSize; y++)
-            if (fOutputArray[putInThisBucket][y] == NULL)
+            if (fOutputArray->fBuckets[putInThisBucket][y] == NULL)
                 return putInThisBucket;
     }
     Assert(0);
@@ -313,28 +429,37 @@ SInt32 ReflectorStream::FindBucket()
 
 void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 {
-    OSMutexLocker locker(&fBucketMutex);
-    Assert(fNumElements > 0);
-    
-    //look at all the indexes in the array
-    for (UInt32 x = 0; x < fNumBuckets; x++)
+    UInt32 theEpoch = 0;
     {
-        for (UInt32 y = 0; y < sBucketSize; y++)
+        OSMutexLocker locker(&fBucketMutex);
+        Assert(fNumElements > 0);
+        
+        //look at all the indexes in the array
+        for (UInt32 x = 0; (theEpoch == 0) && (x < fOutputArray->fNumBuckets); x++)
         {
-            //The array may have blank spaces!
-            if (fOutputArray[x][y] == inOutput)
+            for (UInt32 y = 0; y < sBucketSize; y++)
             {
-                fOutputArray[x][y] = NULL;//just clear out the pointer
-                
+                //The array may have blank spaces!
+                if (fOutputArray->fBuckets[x][y] == inOutput)
+                {
+                    fOutputArray->fBuckets[x][y] = NULL;//just clear out the pointer
+                    
 #if REFLECTOR_STREAM_DEBUGGING  
-                qtss_printf("Removing output %x from bucket %ld, index %ld\n",inOutput,x,y);
+                    qtss_printf("Removing output %x from bucket %ld, index %ld\n",inOutput,x,y);
 #endif
-                fNumElements--;
-                return;             
+                    fNumElements--;
+                    theEpoch = this->AdvanceOutputsEpoch();
+                    break;
+                }
             }
         }
+        Assert(theEpoch != 0);
     }
-    Assert(0);
+    
+    //The caller is free to delete inOutput as soon as we return, so make sure
+    //no sender is still using it.
+    if (theEpoch != 0)
+        this->WaitForOutputWalks(theEpoch);
 }
 
 void  ReflectorStream::TearDownAllOutputs()
@@ -343,10 +468,10 @@ void  ReflectorStream::TearDownAllOutputs()
     OSMutexLocker locker(&fBucketMutex);
     
     //look at all the indexes in the array
-    for (UInt32 x = 0; x < fNumBuckets; x++)
+    for (UInt32 x = 0; x < fOutputArray->fNumBuckets; x++)
     {
         for (UInt32 y = 0; y < sBucketSize; y++)
-        {   ReflectorOutput* theOutputPtr= fOutputArray[x][y];
+        {   ReflectorOutput* theOutputPtr= fOutputArray->fBuckets[x][y];
             //The array may have blank spaces!
             if (theOutputPtr != NULL)
             {   theOutputPtr->TearDown();
@@ -431,6 +556,13 @@ QTSS_Error ReflectorStream::BindSockets(QTSS_StandardRTSP_Params* inParams, UInt
 	fSockets->GetSocketA()->SetSocketRcvBufSize(512 * 1024);
 	fSockets->GetSocketB()->SetSocketRcvBufSize(512 * 1024);
 #endif
+
+    // Packets are stamped with the time the kernel received them, and the
+    // sockets keep count of what the kernel had to drop. Both are best effort.
+    (void)fSockets->GetSocketA()->EnableReceiveTimestamps();
+    (void)fSockets->GetSocketB()->EnableReceiveTimestamps();
+    (void)fSockets->GetSocketA()->EnableDropCounting();
+    (void)fSockets->GetSocketB()->EnableDropCounting();
     
     //If the broadcaster is sending RTP directly to us, we don't
     //need to join a multicast group because we're not using multicast
@@ -529,7 +661,13 @@ ReflectorSender::ReflectorSender(ReflectorStream* inStream, UInt32 inWriteFlag)
     fHasNewPackets(false),
     fNextTimeToRun(0),
     fLastRRTime(0),
-    fSocketQueueElem()
+    fSocketQueueElem(),
+    fKeyFrameFormat(kNoKeyFrames),
+    fAccessUnitRTPTime(0),
+    fAccessUnitStart(NULL),
+    fKeyFramePacket(NULL),
+    fKeyFrameArrivalTime(0),
+    fOutputWalkEpoch(0)
 {   
     fSocketQueueElem.SetEnclosingObject(this); 
 }
@@ -669,10 +807,14 @@ Bool16 ReflectorSender::GetFirstRTPTimePacket(UInt16* outSeqNumPtr, UInt32* outR
    return true;
 }
 
-Bool16 ReflectorSender::GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr) 
+Bool16 ReflectorSender::GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr, SInt64 inStartArrivalTime) 
 {
     OSMutexLocker locker(&fStream->fBucketMutex);
-    OSQueueElem* packetElem = this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec);
+    OSQueueElem* packetElem = NULL;
+    if (inStartArrivalTime != 0)
+        packetElem = this->GetPacketArrivedAtOrAfter(inStartArrivalTime);
+    if (packetElem == NULL)
+        packetElem = this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec);
 //    OSQueueElem* packetElem = this->GetClientBufferStartPacket();
             
     if (packetElem == NULL)
@@ -740,30 +882,15 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 		#endif	
 	}
 	
-	//the rest of this function must be atomic wrt the ReflectorSession, because
-	//it involves iterating through the RTPSession array, which isn't thread safe
-	OSMutexLocker locker(&fStream->fBucketMutex);
+	//Walk the outputs without the bucket lock. See ReflectPackets.
+	ReflectorStream::BucketArray* theOutputs = fStream->BeginOutputWalk(&fOutputWalkEpoch);
+	UDPSocket::BeginSendBatch(); //flushed before the walk ends. See ReflectPackets about shared payloads.
 	
-	// Check to see if we should update the session's bitrate average
-	if ((fStream->fLastBitRateSample + ReflectorStream::kBitRateAvgIntervalInMilSecs) < currentTime)
-	{
-		unsigned int intervalBytes = fStream->fBytesSentInThisInterval;
-		(void)atomic_sub(&fStream->fBytesSentInThisInterval, intervalBytes);
-		
-		// Multiply by 1000 to convert from milliseconds to seconds, and by 8 to convert from bytes to bits
-		Float32 bps = (Float32)(intervalBytes * 8) / (Float32)(currentTime - fStream->fLastBitRateSample);
-		bps *= 1000;
-		fStream->fCurrentBitRate = (UInt32)bps;
-		
-		// Don't check again for awhile!
-		fStream->fLastBitRateSample = currentTime;
-	}
-
-	for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
+	for (UInt32 bucketIndex = 0; bucketIndex < theOutputs->fNumBuckets; bucketIndex++)
 	{	
 		for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
 		{	 
-			ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
+			ReflectorOutput* theOutput = theOutputs->fBuckets[bucketIndex][bucketMemberIndex];
 		
 			
 			if (theOutput != NULL)
@@ -895,6 +1022,28 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 		}
 	}
 	
+	UDPSocket::EndSendBatch();
+	fStream->EndOutputWalk(&fOutputWalkEpoch);
+	
+	//RTSP threads look at the packet queue under the bucket lock, so the
+	//queue is only trimmed with it held
+	OSMutexLocker locker(&fStream->fBucketMutex);
+	
+	// Check to see if we should update the session's bitrate average
+	if ((fStream->fLastBitRateSample + ReflectorStream::kBitRateAvgIntervalInMilSecs) < currentTime)
+	{
+		unsigned int intervalBytes = fStream->fBytesSentInThisInterval;
+		(void)atomic_sub(&fStream->fBytesSentInThisInterval, intervalBytes);
+		
+		// Multiply by 1000 to convert from milliseconds to seconds, and by 8 to convert from bytes to bits
+		Float32 bps = (Float32)(intervalBytes * 8) / (Float32)(currentTime - fStream->fLastBitRateSample);
+		bps *= 1000;
+		fStream->fCurrentBitRate = (UInt32)bps;
+		
+		// Don't check again for awhile!
+		fStream->fLastBitRateSample = currentTime;
+	}
+
 	// reset our first new packet bookmark
 	fFirstNewPacketInQueue = NULL;
 
@@ -986,13 +1135,24 @@ void ReflectorSender::ReflectPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue)
         fStream->SendReceiverReport();
     }
     
-    //the rest of this function must be atomic wrt the ReflectorSession, because
-    //it involves iterating through the RTPSession array, which isn't thread safe
-    OSMutexLocker locker(&fStream->fBucketMutex);
+    //
+    //The outputs are walked without the bucket lock, so SETUPs and TEARDOWNs on
+    //RTSP threads don't wait for a pass to finish and a pass doesn't wait for
+    //them. The stream keeps anything this walk can see alive until
+    //EndOutputWalk, so an output found here stays valid for the whole pass.
+    ReflectorStream::BucketArray* theOutputs = fStream->BeginOutputWalk(&fOutputWalkEpoch);
+    
+    //Send this pass's packets to all the outputs with as few system calls as
+    //possible. The batch is flushed before the walk ends, so outputs (and
+    //their sockets) can't go away underneath it.
+    //
+    //RTPSessionOutputs write with qtssWriteFlagsSharedPacketData, so the batch
+    //points at the payloads in fPacketQueue rather than copying each one per
+    //output. The queue isn't trimmed until after the flush, and only the
+    //ReflectorSocket refills freed packets, holding its demuxer mutex for the
+    //whole of this call.
+    UDPSocket::BeginSendBatch();
     
-    // Check to see if we should update the session's bitrate average
-    fStream->UpdateBitRate(currentTime);
-
     // where to start new clients in the q
     fFirstPacketInQueueForNewOutput = this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec); 
   
@@ -1007,36 +1167,29 @@ if (thePacket == NULL)
     fFirstPacketInQueueForNewOutput = GetClientBufferNextPacketTime(thePacket->GetPacketRTPTime());
 */
 
-    for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
-    {   
-        for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
-        {    
-            ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
-            if (theOutput != NULL)
-            {                 
-                if ( false == theOutput->IsPlaying() ) 
-                    continue;
-                    
-                OSQueueElem*    packetElem = theOutput->GetBookMarkedPacket(&fPacketQueue); 
-                if ( packetElem  == NULL ) // should only be a new output
-                {                  
-                    packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
-                    theOutput->fNewOutput = false;     
-                 }
-
-                SInt64  bucketDelay = ReflectorStream::sBucketDelayInMsec * (SInt64)bucketIndex;
-                packetElem = this->SendPacketsToOutput(theOutput, packetElem,currentTime, bucketDelay);
-                if (packetElem)
-                {
-                    ReflectorPacket*    thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
-                    thePacket->fNeededByOutput = true; // flag to prevent removal in RemoveOldPackets
-                    (void) theOutput->SetBookMarkPacket(packetElem); // store a reference to the packet
-                }
-            } 
-        }
+    //Streams with very large audiences are spread over the fan-out threads.
+    UInt32 theNumSlices = ReflectorFanOutThread::GetNumSlices(fStream->fNumElements, theOutputs->fNumBuckets);
+    if (theNumSlices > 1)
+        ReflectorFanOutThread::ReflectToBuckets(this, theOutputs->fBuckets, theOutputs->fNumBuckets, theNumSlices, currentTime, &fNextTimeToRun);
+    else
+    {
+        for (UInt32 bucketIndex = 0; bucketIndex < theOutputs->fNumBuckets; bucketIndex++)
+            this->ReflectToBucket(theOutputs->fBuckets[bucketIndex], bucketIndex, currentTime, &fNextTimeToRun);
     }
 
-    this->RemoveOldPackets(inFreeQueue);
+    UDPSocket::EndSendBatch();
+    fStream->EndOutputWalk(&fOutputWalkEpoch);
+    
+    //RTSP threads look at the packet queue under the bucket lock, so the
+    //queue is only trimmed with it held
+    {
+        OSMutexLocker locker(&fStream->fBucketMutex);
+        
+        // Check to see if we should update the session's bitrate average
+        fStream->UpdateBitRate(currentTime);
+        
+        this->RemoveOldPackets(inFreeQueue);
+    }
     fFirstNewPacketInQueue = NULL;
 
     //Don't forget that the caller also wants to know when we next want to run
@@ -1049,7 +1202,42 @@ if (thePacket == NULL)
     
 }
 
-OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay)
+void ReflectorSender::ReflectToBucket(ReflectorOutput** inBucket, UInt32 inBucketIndex, SInt64 inCurrentTime, SInt64* ioNextTimeToRun)
+{
+    for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
+    {    
+        ReflectorOutput* theOutput = inBucket[bucketMemberIndex];
+        if (theOutput != NULL)
+        {                 
+            if ( false == theOutput->IsPlaying() ) 
+                continue;
+                
+            OSQueueElem*    packetElem = theOutput->GetBookMarkedPacket(&fPacketQueue); 
+            if ( packetElem  == NULL ) // should only be a new output
+            {                  
+                if (theOutput->fStartArrivalTime != 0) // told where to start, such as at a keyframe
+                    packetElem = this->GetPacketArrivedAtOrAfter(theOutput->fStartArrivalTime);
+                if (packetElem == NULL)
+                    packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
+                theOutput->fNewOutput = false;     
+             }
+
+            SInt64  bucketDelay = ReflectorStream::sBucketDelayInMsec * (SInt64)inBucketIndex;
+            packetElem = this->SendPacketsToOutput(theOutput, packetElem, inCurrentTime, bucketDelay, ioNextTimeToRun);
+            if (packetElem)
+            {
+                ReflectorPacket*    thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+                // flag to prevent removal in RemoveOldPackets. Fan-out slices may store
+                // this concurrently, but they only ever store true and nothing reads it
+                // until every slice has reported done under the group mutex.
+                thePacket->fNeededByOutput = true;
+                (void) theOutput->SetBookMarkPacket(packetElem); // store a reference to the packet
+            }
+        } 
+    }
+}
+
+OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, SInt64* ioNextTimeToRun)
 {
     OSQueueElem* lastPacket = currentPacket;
     OSQueueIter qIter(&fPacketQueue, currentPacket);  // starts from beginning if currentPacket == NULL, else from currentPacket                
@@ -1072,27 +1260,27 @@ OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput,
         if (err == QTSS_WouldBlock)
         { // call us again in # ms to retry on an EAGAIN
             
-            if ((timeToSendPacket > 0) && ( (fNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
-                fNextTimeToRun = timeToSendPacket - currentTime;
+            if ((timeToSendPacket > 0) && ( (*ioNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
+                *ioNextTimeToRun = timeToSendPacket - currentTime;
             
             if (theOutput->fLastIntervalMilliSec < 5 )
                 theOutput->fLastIntervalMilliSec = 5;
 
             if ( timeToSendPacket < 0 ) // blocked and we are behind
-                fNextTimeToRun = theOutput->fLastIntervalMilliSec; // Use the last packet interval 
+                *ioNextTimeToRun = theOutput->fLastIntervalMilliSec; // Use the last packet interval 
                
-            if (fNextTimeToRun > 1000) //don't wait that long
-                fNextTimeToRun = 1000;
+            if (*ioNextTimeToRun > 1000) //don't wait that long
+                *ioNextTimeToRun = 1000;
 
-            if (fNextTimeToRun < 5) //wait longer
-                fNextTimeToRun = 5;
+            if (*ioNextTimeToRun < 5) //wait longer
+                *ioNextTimeToRun = 5;
 
             if (theOutput->fLastIntervalMilliSec >= 1000) // allow up to 1 second max -- allow some time for the socket to clear and don't go into a tight loop if the client is gone.
                 theOutput->fLastIntervalMilliSec = 1000;
             else
                 theOutput->fLastIntervalMilliSec *= 2; // scale upwards over time
 
-            //qtss_printf ( "Blocked ReflectorSender::SendPacketsToOutput timeToSendPacket=%qd fLastIntervalMilliSec=%qd fNextTimeToRun=%qd \n", timeToSendPacket, theOutput->fLastIntervalMilliSec, fNextTimeToRun);
+            //qtss_printf ( "Blocked ReflectorSender::SendPacketsToOutput timeToSendPacket=%qd fLastIntervalMilliSec=%qd fNextTimeToRun=%qd \n", timeToSendPacket, theOutput->fLastIntervalMilliSec, *ioNextTimeToRun);
            
            break;
         }
@@ -1169,6 +1357,13 @@ void    ReflectorSender::RemoveOldPackets(OSQueue* inFreeQueue)
         // walk q and remove packets that are too old
         if ( !thePacket->fNeededByOutput && packetDelay > currentMaxPacketDelay) // delete based on late tolerance and whether a client is blocked on the packet
         {   // not needed and older than our required buffer
+            if (elem == fKeyFramePacket) // there's no newer keyframe left either
+            {
+                fKeyFramePacket = NULL;
+                fKeyFrameArrivalTime = 0;
+            }
+            if (thePacket == fAccessUnitStart)
+                fAccessUnitStart = NULL;
             thePacket->Reset();
             fPacketQueue.Remove( elem );
             inFreeQueue->EnQueue( elem );
@@ -1186,6 +1381,276 @@ void    ReflectorSender::RemoveOldPackets(OSQueue* inFreeQueue)
 
 }
 
+OSQueueElem* ReflectorSender::GetPacketArrivedAtOrAfter(SInt64 inArrivalTime)
+{
+    //Callers want a recent packet, so walk from the newest end of the queue
+    OSQueueElem* theOldestElem = fPacketQueue.GetHead();
+    OSQueueElem* theFoundElem = NULL;
+    for (OSQueueElem* theElem = fPacketQueue.GetTail(); theElem != NULL; theElem = theElem->Next())
+    {
+        ReflectorPacket* thePacket = (ReflectorPacket*)theElem->GetEnclosingObject();
+        if (thePacket->fTimeArrived < inArrivalTime)
+            break;
+            
+        theFoundElem = theElem;
+        if (theElem == theOldestElem)
+            break;
+    }
+    return theFoundElem;
+}
+
+SInt64 ReflectorSender::GetKeyFrameArrivalTime()
+{
+    OSMutexLocker locker(&fStream->fBucketMutex);
+    return fKeyFrameArrivalTime;
+}
+
+void ReflectorSender::TrackKeyFrames(ReflectorPacket* inPacket)
+{
+    //A video frame is sent as one or more packets with the same RTP timestamp,
+    //and the parameter sets that go with a keyframe may be in packets of their
+    //own ahead of it. So a keyframe is marked on the first packet with its
+    //timestamp, whichever packet it is actually found in.
+    UInt32 theRTPTime = inPacket->GetPacketRTPTime();
+    Bool16 startsAccessUnit = (fAccessUnitStart == NULL) || (theRTPTime != fAccessUnitRTPTime);
+    if (startsAccessUnit)
+    {
+        fAccessUnitStart = inPacket;
+        fAccessUnitRTPTime = theRTPTime;
+    }
+    
+    if (fAccessUnitStart->fIsKeyFrame)
+        return; // already found in an earlier packet of this frame
+        
+    if (this->IsKeyFrameData(&inPacket->fPacketPtr, startsAccessUnit))
+    {
+        fAccessUnitStart->fIsKeyFrame = true;
+        fKeyFramePacket = &fAccessUnitStart->fQueueElem;
+        
+        //The demuxer mutex is held, and it is always taken before fBucketMutex
+        OSMutexLocker locker(&fStream->fBucketMutex);
+        fKeyFrameArrivalTime = fAccessUnitStart->fTimeArrived;
+    }
+}
+
+Bool16 ReflectorSender::IsKeyFrameData(StrPtrLen* inPacket, Bool16 inStartsAccessUnit)
+{
+    //Find the payload: skip the fixed header, the CSRCs and any header extension
+    UInt8* thePacket = (UInt8*)inPacket->Ptr;
+    UInt32 theLen = inPacket->Len;
+    if (theLen < 12)
+        return false;
+        
+    UInt32 theHeaderLen = 12 + ((thePacket[0] & 0x0F) * 4);
+    if (thePacket[0] & 0x10)
+    {
+        if (theLen < theHeaderLen + 4)
+            return false;
+        theHeaderLen += 4 + (((thePacket[theHeaderLen + 2] << 8) | thePacket[theHeaderLen + 3]) * 4);
+    }
+    if (theLen <= theHeaderLen)
+        return false;
+    if (thePacket[0] & 0x20) // padding, as long as its last byte says
+    {
+        UInt8 thePadLen = thePacket[theLen - 1];
+        if ((thePadLen == 0) || (thePadLen >= theLen - theHeaderLen))
+            return false;
+        theLen -= thePadLen;
+    }
+        
+    UInt8* thePayload = thePacket + theHeaderLen;
+    UInt32 thePayloadLen = theLen - theHeaderLen;
+    
+    if (fKeyFrameFormat == kH264KeyFrames)
+    {
+        enum { kIDRSlice = 5, kSPS = 7, kSTAPA = 24, kFUA = 28 };
+        UInt8 theNALType = thePayload[0] & 0x1F;
+        
+        if (theNALType == kSTAPA) // several NAL units, each preceded by a 16 bit size
+        {
+            for (UInt32 theOffset = 1; theOffset + 2 < thePayloadLen; )
+            {
+                UInt32 theNALSize = (thePayload[theOffset] << 8) | thePayload[theOffset + 1];
+                UInt8 theAggregatedType = thePayload[theOffset + 2] & 0x1F;
+                if ((theAggregatedType == kIDRSlice) || (theAggregatedType == kSPS))
+                    return true;
+                theOffset += 2 + theNALSize;
+            }
+            return false;
+        }
+        
+        if (theNALType == kFUA) // a fragment of a NAL unit; only the first one counts
+        {
+            if ((thePayloadLen < 2) || !(thePayload[1] & 0x80))
+                return false;
+            theNALType = thePayload[1] & 0x1F;
+        }
+        return (theNALType == kIDRSlice) || (theNALType == kSPS);
+    }
+    
+    if (fKeyFrameFormat == kMPEG4KeyFrames)
+    {
+        //The headers of a frame are at the start of its first packet. A VOS
+        //or GOV header only comes before an I-VOP, otherwise it is up to the
+        //VOP's coding type.
+        if (!inStartsAccessUnit)
+            return false;
+            
+        enum { kVOSStartCode = 0xB0, kGOVStartCode = 0xB3, kVOPStartCode = 0xB6 };
+        for (UInt32 x = 0; x + 4 < thePayloadLen; x++)
+        {
+            if ((thePayload[x] != 0) || (thePayload[x + 1] != 0) || (thePayload[x + 2] != 1))
+                continue;
+                
+            UInt8 theStartCode = thePayload[x + 3];
+            if ((theStartCode == kVOSStartCode) || (theStartCode == kGOVStartCode))
+                return true;
+            if (theStartCode == kVOPStartCode)
+                return (thePayload[x + 4] >> 6) == 0; // vop_coding_type 0 is an I-VOP
+        }
+    }
+    return false;
+}
+
+ReflectorFanOutThread**  ReflectorFanOutThread::sThreads = NULL;
+UInt32                   ReflectorFanOutThread::sNumThreads = 0;
+UInt32                   ReflectorFanOutThread::sMinOutputs = 0;
+
+void ReflectorFanOutThread::Initialize(UInt32 inNumThreads, UInt32 inMinOutputs)
+{
+    //The reflector, relay and splitter modules all initialize the ReflectorStreams
+    sMinOutputs = inMinOutputs;
+    if ((sThreads != NULL) || (inNumThreads == 0))
+        return;
+        
+    if (inNumThreads > kMaxNumThreads)
+        inNumThreads = kMaxNumThreads;
+    
+    //Spread the threads over the processors. The calling threads are TaskThreads,
+    //which aren't bound to any one of them.
+    UInt32 theNumProcessors = OS::GetNumProcessors();
+    if (theNumProcessors == 0)
+        theNumProcessors = 1;
+        
+    sThreads = NEW ReflectorFanOutThread*[inNumThreads];
+    for (UInt32 x = 0; x < inNumThreads; x++)
+    {
+        sThreads[x] = NEW ReflectorFanOutThread(x % theNumProcessors);
+        sThreads[x]->Start();
+    }
+    sNumThreads = inNumThreads;
+}
+
+UInt32 ReflectorFanOutThread::GetNumSlices(UInt32 inNumOutputs, UInt32 inNumBuckets)
+{
+    if ((sNumThreads == 0) || (inNumOutputs < sMinOutputs) || (inNumBuckets < 2))
+        return 1;
+    
+    //The calling thread takes a slice too
+    UInt32 theNumSlices = sNumThreads + 1;
+    if (theNumSlices > inNumBuckets)
+        theNumSlices = inNumBuckets;
+    return theNumSlices;
+}
+
+void ReflectorFanOutThread::ReflectToBuckets(   ReflectorSender* inSender, ReflectorOutput*** inBuckets, UInt32 inNumBuckets,
+                                                UInt32 inNumSlices, SInt64 inCurrentTime, SInt64* ioNextTimeToRun)
+{
+    Assert((inNumSlices > 1) && (inNumSlices <= sNumThreads + 1) && (inNumSlices <= inNumBuckets));
+    
+    Slice theSlices[kMaxNumThreads + 1];
+    SliceGroup theGroup;
+    theGroup.fNumPending = inNumSlices - 1;
+    
+    UInt32 theBucketsPerSlice = (inNumBuckets + inNumSlices - 1) / inNumSlices;
+    UInt32 theFirstBucket = 0;
+    for (UInt32 x = 0; x < inNumSlices; x++)
+    {
+        theSlices[x].fQueueElem.SetEnclosingObject(&theSlices[x]);
+        theSlices[x].fGroup = &theGroup;
+        theSlices[x].fSender = inSender;
+        theSlices[x].fBuckets = inBuckets;
+        theSlices[x].fFirstBucket = theFirstBucket;
+        theFirstBucket += theBucketsPerSlice;
+        if ((theFirstBucket > inNumBuckets) || (x == inNumSlices - 1))
+            theFirstBucket = inNumBuckets;
+        theSlices[x].fLastBucket = theFirstBucket;
+        theSlices[x].fCurrentTime = inCurrentTime;
+        theSlices[x].fNextTimeToRun = *ioNextTimeToRun;
+    }
+    
+    //The same slice of a stream always goes to the same thread, so its outputs
+    //stay warm in one processor's cache
+    for (UInt32 y = 1; y < inNumSlices; y++)
+        sThreads[y - 1]->EnQueue(&theSlices[y]);
+
+    ReflectorFanOutThread::ReflectSlice(&theSlices[0]);
+    
+    {
+        OSMutexLocker locker(&theGroup.fMutex);
+        while (theGroup.fNumPending > 0)
+            theGroup.fDoneCond.Wait(&theGroup.fMutex);
+    }
+    
+    //The sender runs again as soon as any slice needs it to
+    for (UInt32 z = 0; z < inNumSlices; z++)
+    {
+        if (theSlices[z].fNextTimeToRun < *ioNextTimeToRun)
+            *ioNextTimeToRun = theSlices[z].fNextTimeToRun;
+    }
+}
+
+void ReflectorFanOutThread::ReflectSlice(Slice* inSlice)
+{
+    ReflectorSender* theSender = inSlice->fSender;
+    for (UInt32 bucketIndex = inSlice->fFirstBucket; bucketIndex < inSlice->fLastBucket; bucketIndex++)
+        theSender->ReflectToBucket(inSlice->fBuckets[bucketIndex], bucketIndex, inSlice->fCurrentTime, &inSlice->fNextTimeToRun);
+}
+
+void ReflectorFanOutThread::EnQueue(Slice* inSlice)
+{
+    OSMutexLocker locker(&fMutex);
+    fSliceQueue.EnQueue(&inSlice->fQueueElem);
+    fCond.Signal();
+}
+
+void ReflectorFanOutThread::Entry()
+{
+#if __linux__
+    cpu_set_t theCPUs;
+    CPU_ZERO(&theCPUs);
+    CPU_SET(fProcessor, &theCPUs);
+    (void)::pthread_setaffinity_np(::pthread_self(), sizeof(theCPUs), &theCPUs);
+#endif
+
+    while (!this->IsStopRequested())
+    {
+        Slice* theSlice = NULL;
+        {
+            OSMutexLocker locker(&fMutex);
+            OSQueueElem* theElem = fSliceQueue.DeQueue();
+            if (theElem == NULL)
+            {
+                fCond.Wait(&fMutex, 1000);
+                continue;
+            }
+            theSlice = (Slice*)theElem->GetEnclosingObject();
+        }
+        
+        //Each thread batches its own sends, and flushes them before the
+        //slice is reported done: the sender's output walk ends right after.
+        UDPSocket::BeginSendBatch();
+        ReflectorFanOutThread::ReflectSlice(theSlice);
+        UDPSocket::EndSendBatch();
+        
+        SliceGroup* theGroup = theSlice->fGroup;
+        OSMutexLocker locker(&theGroup->fMutex);
+        theGroup->fNumPending--;
+        if (theGroup->fNumPending == 0)
+            theGroup->fDoneCond.Signal();
+    }
+}
+
 UDPSocketPair* ReflectorSocketPool::ConstructUDPSocketPair()
 {
     return NEW UDPSocketPair
@@ -1218,7 +1683,8 @@ ReflectorSocket::ReflectorSocket()
     fHasReceiveTime(false),
     fFirstReceiveTime(0),
     fFirstArrivalTime(0),
-    fCurrentSSRC(0)
+    fCurrentSSRC(0),
+    fNumPacketOverruns(0)
 
 {
     //construct all the preallocated packets
@@ -1515,6 +1981,10 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
             
 		}
              
+		// The payload is only looked at once any receive time tag is off the end of it
+		if (!thePacket->IsRTCP() && theSender->TracksKeyFrames() && theSender->fStream->BufferEnabled())
+			theSender->TrackKeyFrames(thePacket);
+             
 		//printf("ReflectorSocket::GetIncomingData has packet from time=%qd src addr=%lu src port=%u packetlen=%lu\n",inMilliseconds, theRemoteAddr,theRemotePort,thePacket->fPacketPtr.Len);
 		if (0) //turn on / off buffer size checking --  pref can go here if we find we need to adjust this
 		if (theSender->fPacketQueue.GetLength() > maxQSize) //don't grow memory too big
@@ -1533,20 +2003,56 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
 void ReflectorSocket::GetIncomingData(const SInt64& inMilliseconds)
 {
     OSMutexLocker locker(this->GetDemuxer()->GetMutex());
-    UInt32 theRemoteAddr = 0;
-    UInt16 theRemotePort = 0;
-    //get all the outstanding packets for this socket
+    ReflectorPacket*    thePackets[kNumPacketsPerRead];
+    void*               theBuffers[kNumPacketsPerRead];
+    UDPRecvInfo         theInfo[kNumPacketsPerRead];
+    
+    //get all the outstanding packets for this socket, a batch at a time
     while (true)
     {
-        //get a packet off the free queue.
-        ReflectorPacket* thePacket = this->GetPacket();
-
-        thePacket->fPacketPtr.Len = 0;
-        (void)this->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket->fPacketPtr.Ptr,
-                            ReflectorPacket::kMaxReflectorPacketSize, &thePacket->fPacketPtr.Len);
-                      
-        if (this->ProcessPacket(inMilliseconds,thePacket,theRemoteAddr, theRemotePort))
+        //get a batch of packets off the free queue.
+        for (UInt32 x = 0; x < kNumPacketsPerRead; x++)
+        {
+            thePackets[x] = this->GetPacket();
+            thePackets[x]->fPacketPtr.Len = 0;
+            theBuffers[x] = thePackets[x]->fPacketPtr.Ptr;
+        }
+        
+        UInt32 theNumReceived = 0;
+        (void)this->RecvFromMany(theBuffers, ReflectorPacket::kMaxReflectorPacketSize, kNumPacketsPerRead, theInfo, &theNumReceived);
+        
+        for (UInt32 y = 0; y < theNumReceived; y++)
+        {
+            ReflectorPacket* thePacket = thePackets[y];
+            if (theInfo[y].fTruncated)
+            {
+                //Too big for a ReflectorPacket. Reflecting what fit would only
+                //hand the clients a corrupt packet, so drop it.
+                fNumPacketOverruns++;
+                fFreeQueue.EnQueue(&thePacket->fQueueElem);
+                continue;
+            }
+            
+            thePacket->fPacketPtr.Len = theInfo[y].fRecvLen;
+            
+            //Use the kernel receive time when we have it. It is what the stream's
+            //timing is really based on, no matter how long the socket waited to run.
+            SInt64 theArrivalTime = inMilliseconds;
+            if ((theInfo[y].fArrivalTimeInMilSecs != 0) && (theInfo[y].fArrivalTimeInMilSecs < inMilliseconds))
+                theArrivalTime = theInfo[y].fArrivalTimeInMilSecs;
+            
+            (void)this->ProcessPacket(theArrivalTime, thePacket, theInfo[y].fRemoteAddr, theInfo[y].fRemotePort);
+        }
+        
+        for (UInt32 z = theNumReceived; z < kNumPacketsPerRead; z++)
+            fFreeQueue.EnQueue(&thePackets[z]->fQueueElem);
+        
+        if (theNumReceived < kNumPacketsPerRead)
+        {
+            //no more packets on this socket!
+            this->RequestEvent(EV_RE);
             break;
+        }
             
         //printf("ReflectorSocket::GetIncomingData \n");
     }
@@ -49,8 +49,10 @@
 #include "SequenceNumberMap.h"
 
 #include "OSMutex.h"
+#include "OSCond.h"
 #include "OSQueue.h"
 #include "OSRef.h"
+#include "OSThread.h"
 
 #include "RTCPSRPacket.h"
 #include "ReflectorOutput.h"
@@ -80,6 +82,7 @@ class ReflectorPacket
                             fIsRTCP = false;
                             fStreamCountID = 0;
                             fNeededByOutput = false; 
+                            fIsKeyFrame = false;
                         }
 
         ~ReflectorPacket() {}
@@ -105,6 +108,7 @@ inline  SInt64  GetPacketNTPTime();
         StrPtrLen   fPacketPtr;
         Bool16      fIsRTCP;
         Bool16      fNeededByOutput; // is this packet still needed for output?
+        Bool16      fIsKeyFrame; // first packet of a video keyframe (including the parameter sets sent with it)
         UInt64      fStreamCountID;
                 
         friend class ReflectorSender;
@@ -194,6 +198,11 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         ReflectorPacket*    GetPacket();
         virtual SInt64      Run();
         void    SetSSRCFilter(Bool16 state, UInt32 timeoutSecs) { fFilterSSRCs = state; fTimeoutSecs = timeoutSecs;}
+        
+        //Ingest health. Packets the kernel threw away because the receive buffer
+        //was full, and packets too big for a ReflectorPacket that were thrown away here.
+        UInt32  GetNumPacketsDropped()  { return this->GetNumKernelDrops(); }
+        UInt32  GetNumPacketOverruns()  { return fNumPacketOverruns; }
     private:
         
         //virtual SInt64        Run();
@@ -204,6 +213,7 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         enum
         {
             kNumPreallocatedPackets = 20,   //UInt32
+            kNumPacketsPerRead = 16,        //UInt32. ReflectorPackets filled by each RecvFromMany
             kRefreshBroadcastSessionIntervalMilliSecs = 10000,
             kSSRCTimeOut = 30000 // milliseconds before clearing the SSRC if no new ssrcs have come in
         };
@@ -224,6 +234,8 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         UInt64  fFirstReceiveTime;
         SInt64  fFirstArrivalTime;
         UInt32  fCurrentSSRC;
+        
+        UInt32  fNumPacketOverruns;
 
 };
 
@@ -264,11 +276,19 @@ class ReflectorSender : public UDPDemuxerTask
     //this is the old way of doing reflect packets. It is only here until the relay code can be cleaned up.
     void        ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue);
     
-    OSQueueElem*    SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay);
+    OSQueueElem*    SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, SInt64* ioNextTimeToRun);
+    
+    //Sends each output in the bucket what it hasn't had yet. Outputs that are
+    //flow controlled adjust ioNextTimeToRun (relative to inCurrentTime) instead
+    //of fNextTimeToRun, so different buckets can be reflected on different
+    //threads at once.
+    void        ReflectToBucket(ReflectorOutput** inBucket, UInt32 inBucketIndex, SInt64 inCurrentTime, SInt64* ioNextTimeToRun);
 
     UInt32      GetOldestPacketRTPTime(Bool16 *foundPtr);          
     UInt16      GetFirstPacketRTPSeqNum(Bool16 *foundPtr);             
-    Bool16      GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr);
+    //Describes the packet a new output will start with. inStartArrivalTime is
+    //the output's fStartArrivalTime.
+    Bool16      GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr, SInt64 inStartArrivalTime = 0);
 
     OSQueueElem*GetClientBufferNextPacketTime(UInt32 inRTPTime);
     Bool16      GetFirstRTPTimePacket(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr);
@@ -276,6 +296,33 @@ class ReflectorSender : public UDPDemuxerTask
     void        RemoveOldPackets(OSQueue* inFreeQueue);
     OSQueueElem* GetClientBufferStartPacketOffset(SInt64 offsetMsec); 
     OSQueueElem* GetClientBufferStartPacket() { return this->GetClientBufferStartPacketOffset(0); };
+    
+    //The oldest packet that arrived no earlier than inArrivalTime, found
+    //by walking back from the newest. NULL if there is none.
+    OSQueueElem* GetPacketArrivedAtOrAfter(SInt64 inArrivalTime);
+    
+    //
+    // KEYFRAMES
+    //
+    // Video senders of a format we know how to parse remember where the most
+    // recent keyframe starts, so new viewers can start with a picture they
+    // can decode instead of somewhere in the middle of a GOP.
+    enum
+    {
+        kNoKeyFrames        = 0,    //UInt32
+        kH264KeyFrames      = 1,    //UInt32. RFC 6184 payloads
+        kMPEG4KeyFrames     = 2     //UInt32. RFC 3016 (MP4V-ES) payloads
+    };
+    
+    Bool16      TracksKeyFrames()   { return fKeyFrameFormat != kNoKeyFrames; }
+    
+    //Arrival time of the first packet of the most recent keyframe still
+    //buffered, 0 if there isn't one
+    SInt64      GetKeyFrameArrivalTime();
+    
+    //Called for each RTP packet as it is queued
+    void        TrackKeyFrames(ReflectorPacket* inPacket);
+    Bool16      IsKeyFrameData(StrPtrLen* inPacket, Bool16 inStartsAccessUnit);
 
     ReflectorStream*    fStream;
     UInt32              fWriteFlag;
@@ -298,10 +345,97 @@ class ReflectorSender : public UDPDemuxerTask
     SInt64      fLastRRTime;
     OSQueueElem fSocketQueueElem;
     
+    //Keyframe tracking. Packets are only queued and trimmed with the socket's
+    //demuxer mutex held, so that is what protects these. RTSP threads can't
+    //take that mutex, so they get fKeyFrameArrivalTime, which only changes
+    //with fBucketMutex held as well, and never look at the packet itself.
+    UInt32                  fKeyFrameFormat;
+    UInt32                  fAccessUnitRTPTime;
+    ReflectorPacket*        fAccessUnitStart;   //first packet of the newest access unit
+    OSQueueElem*            fKeyFramePacket;    //first packet of the newest keyframe in fPacketQueue
+    SInt64                  fKeyFrameArrivalTime;   //its fTimeArrived, 0 if there isn't one
+    
+    //While this sender walks the stream's outputs, the stream's fOutputsEpoch
+    //as of the start of the walk. 0 otherwise.
+    volatile UInt32 fOutputWalkEpoch;
+    
     friend class ReflectorSocket;
     friend class ReflectorStream;
 };
 
+//
+// ReflectorFanOutThread
+//
+// A single ReflectorSender walks all of its stream's outputs on one thread, which
+// limits one very popular stream to what a single core can send. When the
+// stream has enough outputs, the sender instead splits its buckets into slices,
+// hands every slice but the first to one of these threads, reflects the first
+// itself and waits for the others.
+//
+// The slices share the sender's packet queue, which nothing changes while they
+// run (the ReflectorSocket holds its demuxer mutex for the whole ReflectPackets
+// call). An output is only ever in one slice, so each thread reads and moves
+// only its own outputs' bookmarks.
+class ReflectorFanOutThread : public OSThread
+{
+    public:
+    
+        //Starts the threads the first time it is called with a non-zero number.
+        //inMinOutputs is the fewest outputs a stream has to have to be split.
+        static void     Initialize(UInt32 inNumThreads, UInt32 inMinOutputs);
+        
+        //How many slices a stream with this many outputs and buckets should be split into. 1 means don't split.
+        static UInt32   GetNumSlices(UInt32 inNumOutputs, UInt32 inNumBuckets);
+        
+        //Reflects inNumBuckets buckets of inSender's outputs in inNumSlices slices,
+        //and returns once all of them have been reflected.
+        static void     ReflectToBuckets(   ReflectorSender* inSender, ReflectorOutput*** inBuckets, UInt32 inNumBuckets,
+                                            UInt32 inNumSlices, SInt64 inCurrentTime, SInt64* ioNextTimeToRun);
+        
+    private:
+    
+        enum
+        {
+            kMaxNumThreads = 64 //UInt32
+        };
+        
+        //All the slices handed out by one ReflectToBuckets call
+        struct SliceGroup
+        {
+            OSMutex         fMutex;
+            OSCond          fDoneCond;
+            UInt32          fNumPending;
+        };
+        
+        struct Slice
+        {
+            OSQueueElem         fQueueElem;
+            SliceGroup*         fGroup;
+            ReflectorSender*    fSender;
+            ReflectorOutput***  fBuckets;
+            UInt32              fFirstBucket;
+            UInt32              fLastBucket; //one past the last bucket in the slice
+            SInt64              fCurrentTime;
+            SInt64              fNextTimeToRun;
+        };
+        
+        ReflectorFanOutThread(UInt32 inProcessor) : OSThread(), fProcessor(inProcessor) {}
+        virtual ~ReflectorFanOutThread() {}
+        
+        virtual void    Entry();
+        void            EnQueue(Slice* inSlice);
+        static void     ReflectSlice(Slice* inSlice);
+        
+        UInt32          fProcessor;
+        OSMutex         fMutex;
+        OSCond          fCond;
+        OSQueue         fSliceQueue;
+        
+        static ReflectorFanOutThread**  sThreads;
+        static UInt32                   sNumThreads;
+        static UInt32                   sMinOutputs;
+};
+
 class ReflectorStream
 {
     public:
@@ -364,6 +498,8 @@ class ReflectorStream
         
         OSRef*                  GetRef()            { return &fRef; }
         UInt32                  GetBitRate()        { return fCurrentBitRate; }
+        UInt32                  GetNumPacketsDropped();     // RTP and RTCP sockets together
+        UInt32                  GetNumPacketOverruns();     // RTP and RTCP sockets together
         SourceInfo::StreamInfo* GetStreamInfo()     { return &fStreamInfo; }
         OSMutex*                GetMutex()          { return &fBucketMutex; }
         void*                   GetStreamCookie()   { return this; }
@@ -403,7 +539,6 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
     
          //Sends an RTCP receiver report to the broadcast source
         void    SendReceiverReport();
-        void    AllocateBucketArray(UInt32 inNumBuckets);
         SInt32  FindBucket();
         // Unique ID & OSRef. ReflectorStreams can be mapped & shared
         OSRef               fRef;
@@ -429,16 +564,41 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
     
         // BUCKET ARRAY
         
-        //ReflectorOutputs are kept in a 2-dimensional array, "Buckets"
+        //ReflectorOutputs are kept in a 2-dimensional array, "Buckets".
+        //
+        //The senders walk the array without taking fBucketMutex, so it changes
+        //only in ways a walk in progress can tolerate: a slot is filled or cleared
+        //with a single pointer store, and when more buckets are needed a bigger
+        //BucketArray sharing the old buckets is published in place of the old one.
+        //Anything a walk might still be looking at (an old BucketArray, or an
+        //output that was just removed and is about to be deleted) is only freed
+        //once WaitForOutputWalks says neither sender can be using it.
         typedef ReflectorOutput** Bucket;
-        Bucket*     fOutputArray;
-
-        UInt32      fNumBuckets;        //Number of buckets currently
+        struct BucketArray
+        {
+            UInt32  fNumBuckets;
+            Bucket* fBuckets;
+        };
+        BucketArray* volatile fOutputArray;
+        
         UInt32      fNumElements;       //Number of reflector outputs in the array
         
-        //Bucket array can't be modified while we are sending packets.
+        //Serializes changes to the bucket array. The senders also hold it while
+        //they trim their packet queues, which RTSP threads read under it.
         OSMutex     fBucketMutex;
         
+        //Advanced, with fBucketMutex held, every time a change to the bucket array
+        //is made that a walk has to be waited out for. Never 0.
+        volatile UInt32 fOutputsEpoch;
+        
+        BucketArray*    AllocateBucketArray(UInt32 inNumBuckets);
+        UInt32          AdvanceOutputsEpoch();
+        void            WaitForOutputWalks(UInt32 inEpoch);
+        
+        //Used by the senders to bracket a walk of the bucket array
+        BucketArray*    BeginOutputWalk(volatile UInt32* outWalkEpoch);
+        void            EndOutputWalk(volatile UInt32* ioWalkEpoch);
+        
         // RTCP RR information
         
         char        fReceiverReportBuffer[kReceiverReportSize + kAppSize +
@@ -478,6 +638,7 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         static UInt32       sBucketDelayInMsec;
         static Bool16       sUsePacketReceiveTime;
         static UInt32       sFirstPacketOffsetMsec;
+        static Bool16       sKeyFrameStartEnabled;
         
         friend class ReflectorSocket;
         friend class ReflectorSender;
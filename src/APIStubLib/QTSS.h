@@ -101,7 +101,9 @@ enum
     qtssWriteFlagsIsRTP             = 0x00000001,
     qtssWriteFlagsIsRTCP            = 0x00000002,   
     qtssWriteFlagsWriteBurstBegin   = 0x00000004,
-    qtssWriteFlagsBufferData        = 0x00000008
+    qtssWriteFlagsBufferData        = 0x00000008,
+    qtssWriteFlagsSharedPacketData  = 0x00000010,   // packetData stays valid and unchanged until the calling task's Run returns, so the server need not copy it
+    qtssWriteFlagsPacketVector      = 0x00000020    // RTP only. the packet is in pieces, described by packetVector in the QTSS_PacketStruct
 };
 typedef UInt32 QTSS_WriteFlags;
 
@@ -482,7 +484,10 @@ enum
     qtssCliSesRTCPPacketsRecv       = 34,   //read      //UInt32    //Number of RTCP packets received so far on this session.
     qtssCliSesRTCPBytesRecv         = 35,   //read      //UInt32    //Number of RTCP bytes received so far on this session.
     qtssCliSesStartedThinning       = 36,   //read      //Bool16    // At least one of the streams in the session is thinned
-    qtssCliSesNumParams             = 37
+    qtssCliSesBottleneckBandwidth   = 37,   //read      //UInt32    //Most bits per second the client has recently reported getting. 0 until the first receiver report.
+    qtssCliSesMinRTTInMsec          = 38,   //read      //UInt32    //Least round trip time measured recently from RTCP receiver reports or acks.
+    qtssCliSesSmoothedRTTInMsec     = 39,   //read      //UInt32    //Running average of the round trip times.
+    qtssCliSesNumParams             = 40
     
 };
 typedef UInt32 QTSS_ClientSessionAttributes;
@@ -509,7 +514,10 @@ enum
     qtssRTSPSesLocalPort    = 12,       //read      //UInt16        // This is the local port for the connection
     qtssRTSPSesRemotePort   = 13,       //read      //UInt16        // This is the client port for the connection
     
-    qtssRTSPSesNumParams    = 14
+    qtssRTSPSesNumInterleavedPackets = 14, //read   //UInt32        // RTP and RTCP packets sent interleaved on this connection
+    qtssRTSPSesNumInterleavedWrites  = 15, //read   //UInt32        // Socket writes it took to send them
+    
+    qtssRTSPSesNumParams    = 16
 };
 typedef UInt32 QTSS_RTSPSessionAttributes;
 
@@ -634,7 +642,18 @@ enum
     qtssSvrServerPlatform           = 39,   //read      //char array //Platform (OS) of the server
     qtssSvrRTSPServerComment        = 40,   //read      //char array //RTSP comment for the server header    
     qtssSvrNumThinned               = 41,    //r/w      //SInt32    //Number of thinned sessions
-    qtssSvrNumParams                = 42
+    qtssSvrEventThreadEventsPerSec  = 42,   //read      //UInt32    //Indexed by event thread: socket events dispatched per second
+    qtssSvrEventThreadWakeupLatency = 43,   //read      //UInt32    //Indexed by event thread: average microseconds from kernel wakeup to Task signal
+    qtssSvrTaskDispatchLatencyP99   = 44,   //read      //UInt32    //99th percentile microseconds from Task::Signal to Task::Run, over the last stats interval
+    qtssSvrMovieCacheHits           = 45,   //r/w       //UInt32    //Movie opens that found the movie already parsed
+    qtssSvrMovieCacheMisses         = 46,   //r/w       //UInt32    //Movie opens that had to parse the movie
+    qtssSvrMovieCacheEvictions      = 47,   //r/w       //UInt32    //Parsed movies released from the cache while unused
+    qtssSvrDescribeCacheHits        = 48,   //r/w       //UInt32    //DESCRIBEs answered with an SDP cached by the file module
+    qtssSvrDescribeCacheMisses      = 49,   //r/w       //UInt32    //DESCRIBEs the file module had to build an SDP for
+    qtssSvrSlabAllocatorNames       = 50,   //read      //char array //Indexed by slab allocator: what it allocates
+    qtssSvrSlabObjectsInUse         = 51,   //read      //UInt32    //Indexed by slab allocator: objects currently allocated
+    qtssSvrSlabObjectsAllocated     = 52,   //read      //UInt32    //Indexed by slab allocator: objects carved out of slabs so far
+    qtssSvrNumParams                = 53
 };
 typedef UInt32 QTSS_ServerAttributes;
 
@@ -734,7 +753,13 @@ enum
     qtssPrefsPlayersReqRTPHeader            = 70,   // "player_requires_rtp_header_info" //Char array //name of player to match against the player's user agent header
     qtssPrefsPlayersReqBandAdjust           = 71,   // "player_requires_bandwidth_adjustment //Char array //name of player to match against the player's user agent header
     qtssPrefsPlayersReqNoPauseTimeAdjust    = 72,   // "player_requires_no_pause_time_adjustment //Char array //name of player to match against the player's user agent header
-    qtssPrefsNumParams                      = 73
+    qtssPrefsRunNumEventThreads             = 73,   // "run_num_event_threads" //UInt32 // number of socket event threads; zero means one per processor. Platforms without epoll always use one.
+    qtssPrefsUDPSendBatchSize               = 74,   // "udp_send_batch_size" //UInt32 // max UDP packets handed to the kernel in one call when fanning out; 0 or 1 sends each packet on its own
+    qtssPrefsEnableUDPGSO                   = 75,   // "enable_udp_gso" //Bool16 // let batched sends of equal sized packets to one client use UDP segmentation offload
+    qtssPrefsEnableTCPZeroCopy              = 76,   // "enable_tcp_zerocopy" //Bool16 // send large interleaved RTP writes with MSG_ZEROCOPY where the platform has it
+    qtssPrefsSessionsShedPerUpdate          = 77,   // "sessions_shed_per_update" //UInt32 // most clients disconnected per bandwidth update while over maximum_bandwidth
+    qtssPrefsEnableRTPPacing                = 78,   // "enable_rtp_pacing" //Bool16 // pace RTP over UDP at a rate estimated from the client's RTCP feedback
+    qtssPrefsNumParams                      = 79
 };
 
 typedef UInt32 QTSS_PrefsAttributes;
@@ -1126,6 +1151,13 @@ typedef struct
     void*                           packetData;
     QTSS_TimeVal                    packetTransmitTime;
     QTSS_TimeVal                    suggestedWakeupTime;
+    
+    // Only looked at if qtssWriteFlagsPacketVector is set. The packet is then
+    // these packetVectorLen pieces, which add up to the length passed to QTSS_Write.
+    // The first piece must be packetData and hold the whole RTP header. The
+    // rest must stay valid and unchanged until the calling task's Run returns.
+    struct iovec*                   packetVector;
+    UInt32                          packetVectorLen;
 } QTSS_PacketStruct;
 
 
@@ -33,10 +33,12 @@
 
 #include "EventContext.h"
 #include "OSThread.h"
+#include "OS.h"
 #include "atomic.h"
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdint.h>
 
 #ifndef __Win32__
 #include <unistd.h>
@@ -48,16 +50,15 @@
 
 #define EVENT_CONTEXT_DEBUG 0
 
-#if EVENT_CONTEXT_DEBUG
-#include "OS.h"
-#endif
-
 #ifdef __Win32__
 unsigned int EventContext::sUniqueID = WM_USER; // See commentary in RequestEvent
 #else
 unsigned int EventContext::sUniqueID = 1;
 #endif
 
+EventThread*    EventThread::sThreadArray[kMaxEventThreads];
+UInt32          EventThread::sNumThreads = 0;
+
 EventContext::EventContext(int inFileDesc, EventThread* inThread)
 :   fFileDesc(inFileDesc),
     fUniqueID(0),
@@ -94,7 +95,7 @@ void EventContext::Cleanup()
             fEventThread->fRefTable.UnRegister(&fRef);
 
 #if !MACOSXEVENTQUEUE
-            select_removeevent(fFileDesc);//The eventqueue / select shim requires this
+            fEventThread->RemoveEvent(fFileDesc);//The eventqueue / select shim requires this
 #ifdef __Win32__
             err = ::closesocket(fFileDesc);
 #endif
@@ -141,6 +142,8 @@ void EventContext::SnarfEventContext( EventContext &fromContext )
     
     fromContext.fFileDesc = kInvalidFileDesc;
     
+    // the fd stays registered with the event thread it was hashed to
+    fEventThread = fromContext.fEventThread;
     fWatchEventCalled = fromContext.fWatchEventCalled; 
     fUniqueID = fromContext.fUniqueID;
     fUniqueIDStr.Set((char*)&fUniqueID, sizeof(fUniqueID)),
@@ -166,11 +169,7 @@ void EventContext::RequestEvent(int theMask)
     if (fWatchEventCalled)
     {
         fEventReq.er_eventbits = theMask;
-#if MACOSXEVENTQUEUE
-        if (modwatch(&fEventReq, theMask) != 0)
-#else
-        if (select_modwatch(&fEventReq, theMask) != 0)
-#endif  
+        if (fEventThread->ModWatch(&fEventReq, theMask) != 0)
             AssertV(false, OSThread::GetErrno());
     }
     else
@@ -194,6 +193,12 @@ void EventContext::RequestEvent(int theMask)
             fUniqueID = 1;
 #endif
 
+        //
+        // Pick this context's event thread. The ref table and the event queue both
+        // belong to the thread, so this has to happen before registering.
+        if (EventThread::GetNumThreads() > 1)
+            fEventThread = EventThread::GetThread((UInt32)fUniqueID % EventThread::GetNumThreads());
+
         fRef.Set(fUniqueIDStr, this);
         fEventThread->fRefTable.Register(&fRef);
             
@@ -205,32 +210,130 @@ void EventContext::RequestEvent(int theMask)
         fEventReq.er_data = (void*)fUniqueID;
 
         fWatchEventCalled = true;
-#if MACOSXEVENTQUEUE
-        if (watchevent(&fEventReq, theMask) != 0)
-#else
-        if (select_watchevent(&fEventReq, theMask) != 0)
-#endif  
+        if (fEventThread->WatchEvent(&fEventReq, theMask) != 0)
             //this should never fail, but if it does, cleanup.
             AssertV(false, OSThread::GetErrno());
             
     }
 }
 
+EventThread::EventThread()
+:   OSThread(),
+    fQueue(0),
+    fNumEvents(0),
+    fTotalWakeupLatencyInUSecs(0),
+    fLastNumEvents(0),
+    fLastTotalWakeupLatencyInUSecs(0),
+    fLastStatsTime(0),
+    fEventsPerSec(0),
+    fAvgWakeupLatencyInUSecs(0)
+{
+    Assert(CanAddThread());
+    
+#if EPOLLEVENTQUEUE
+    // The first thread uses queue 0, which select_startevents creates
+    if (sNumThreads > 0)
+        fQueue = ::select_createqueue();
+    Assert(fQueue >= 0);
+#endif
+
+    //Threads are only added while the server starts up, from the main thread.
+    //Store the thread before publishing the new count.
+    sThreadArray[sNumThreads] = this;
+    sNumThreads++;
+}
+
+Bool16 EventThread::CanAddThread()
+{
+#if EPOLLEVENTQUEUE
+    return sNumThreads < kMaxEventThreads;
+#else
+    // The select, WSA and MacOS X shims have a single global event queue
+    return sNumThreads == 0;
+#endif
+}
+
+int EventThread::WatchEvent(struct eventreq* req, int which)
+{
+#if MACOSXEVENTQUEUE
+    return watchevent(req, which);
+#elif EPOLLEVENTQUEUE
+    return select_queue_watchevent(fQueue, req, which);
+#else
+    return select_watchevent(req, which);
+#endif
+}
+
+int EventThread::ModWatch(struct eventreq* req, int which)
+{
+#if MACOSXEVENTQUEUE
+    return modwatch(req, which);
+#elif EPOLLEVENTQUEUE
+    return select_queue_modwatch(fQueue, req, which);
+#else
+    return select_modwatch(req, which);
+#endif
+}
+
+int EventThread::RemoveEvent(int which)
+{
+#if MACOSXEVENTQUEUE
+    return 0; // EventContext::Cleanup closes the fd itself
+#elif EPOLLEVENTQUEUE
+    return select_queue_removeevent(fQueue, which);
+#else
+    return select_removeevent(which);
+#endif
+}
+
+int EventThread::WaitEvent(struct eventreq* req, SInt64* outWakeupTimeInUSecs)
+{
+#if EPOLLEVENTQUEUE
+    return select_queue_waitevent(fQueue, req, outWakeupTimeInUSecs);
+#else
+  #if MACOSXEVENTQUEUE
+    int theReturnValue = waitevent(req, NULL);
+  #else
+    int theReturnValue = select_waitevent(req, NULL);
+  #endif
+    *outWakeupTimeInUSecs = OS::Microseconds();
+    return theReturnValue;
+#endif
+}
+
+void EventThread::UpdateStats(SInt64 inCurTimeInMilli)
+{
+    UInt32 theNumEvents = fNumEvents;
+    UInt32 theTotalLatency = fTotalWakeupLatencyInUSecs;
+    
+    if ((fLastStatsTime != 0) && (inCurTimeInMilli > fLastStatsTime))
+    {
+        UInt32 theEvents = theNumEvents - fLastNumEvents;
+        fEventsPerSec = (UInt32)(((SInt64)theEvents * 1000) / (inCurTimeInMilli - fLastStatsTime));
+        
+        if (theEvents > 0)
+            fAvgWakeupLatencyInUSecs = (theTotalLatency - fLastTotalWakeupLatencyInUSecs) / theEvents;
+        else
+            fAvgWakeupLatencyInUSecs = 0;
+    }
+    
+    fLastNumEvents = theNumEvents;
+    fLastTotalWakeupLatencyInUSecs = theTotalLatency;
+    fLastStatsTime = inCurTimeInMilli;
+}
+
 void EventThread::Entry()
 {
     struct eventreq theCurrentEvent;
     ::memset( &theCurrentEvent, '\0', sizeof(theCurrentEvent) );
+    SInt64 theWakeupTime = 0;
     
     while (true)
     {
         int theErrno = EINTR;
         while (theErrno == EINTR)
         {
-#if MACOSXEVENTQUEUE
-            int theReturnValue = waitevent(&theCurrentEvent, NULL);
-#else
-            int theReturnValue = select_waitevent(&theCurrentEvent, NULL);
-#endif  
+            int theReturnValue = this->WaitEvent(&theCurrentEvent, &theWakeupTime);
             //Sort of a hack. In the POSIX version of the server, waitevent can return
             //an actual POSIX errorcode.
             if (theReturnValue >= 0)
@@ -245,8 +348,10 @@ void EventThread::Entry()
         if (theCurrentEvent.er_data != NULL)
         {
             //The cookie in this event is an ObjectID. Resolve that objectID into
-            //a pointer.
-            StrPtrLen idStr((char*)&theCurrentEvent.er_data, sizeof(theCurrentEvent.er_data));
+            //a pointer. The ref table key is the context's fUniqueID, which can be
+            //narrower than the pointer it travels in.
+            PointerSizedInt theUniqueID = (PointerSizedInt)(uintptr_t)theCurrentEvent.er_data;
+            StrPtrLen idStr((char*)&theUniqueID, sizeof(theUniqueID));
             OSRef* ref = fRefTable.Resolve(&idStr);
             if (ref != NULL)
             {
@@ -257,6 +362,9 @@ void EventThread::Entry()
                 theContext->ProcessEvent(theCurrentEvent.er_eventbits);
                 fRefTable.Release(ref);
                 
+                fNumEvents++;
+                fTotalWakeupLatencyInUSecs += (UInt32)(OS::Microseconds() - theWakeupTime);
+                
                 
             }
         }
@@ -156,13 +156,59 @@ class EventThread : public OSThread
 {
     public:
     
-        EventThread() : OSThread() {}
+        //
+        // Every EventThread joins a process-wide pool. With a single thread the
+        // pool behaves exactly like the old global event thread. Where the event
+        // queue supports it (EPOLLEVENTQUEUE), each thread gets its own descriptor
+        // set and cookie table, and EventContexts are spread across the pool by
+        // hashing their unique ID when they first register.
+        EventThread();
         virtual ~EventThread() {}
-    
+        
+        static UInt32       GetNumThreads()             { return sNumThreads; }
+        static EventThread* GetThread(UInt32 inIndex)   { Assert(inIndex < sNumThreads); return sThreadArray[inIndex]; }
+        
+        // Can another EventThread be created on this platform?
+        static Bool16       CanAddThread();
+        
+        //
+        // STATISTICS
+        // UpdateStats is called periodically by whoever reports on the event
+        // threads; it recomputes the rates over the time since the last call.
+        void                UpdateStats(SInt64 inCurTimeInMilli);
+        UInt32              GetEventsPerSec()           { return fEventsPerSec; }
+        UInt32              GetAvgWakeupLatencyInUSecs(){ return fAvgWakeupLatencyInUSecs; }
+        
+        enum
+        {
+            kMaxEventThreads = 64   //UInt32
+        };
+        
     private:
     
         virtual void Entry();
+        
+        int             WatchEvent(struct eventreq* req, int which);
+        int             ModWatch(struct eventreq* req, int which);
+        int             RemoveEvent(int which);
+        int             WaitEvent(struct eventreq* req, SInt64* outWakeupTimeInUSecs);
+        
         OSRefTable      fRefTable;
+        int             fQueue;
+        
+        // Only the event thread itself writes these, so no locking. They
+        // are free running and wrap, UpdateStats only looks at the deltas
+        UInt32          fNumEvents;
+        UInt32          fTotalWakeupLatencyInUSecs;
+        
+        UInt32          fLastNumEvents;
+        UInt32          fLastTotalWakeupLatencyInUSecs;
+        SInt64          fLastStatsTime;
+        UInt32          fEventsPerSec;
+        UInt32          fAvgWakeupLatencyInUSecs;
+        
+        static EventThread* sThreadArray[kMaxEventThreads];
+        static UInt32       sNumThreads;
         
         friend class EventContext;
 };
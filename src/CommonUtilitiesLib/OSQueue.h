@@ -135,6 +135,10 @@ class OSQueue_Blocking
         OSCond*         GetCond()   { return &fCond; }
         OSQueue*        GetQueue()  { return &fQueue; }
         
+        // For callers that need to examine or remove elements other than the head
+        // (such as a task thread stealing work). Hold this while touching GetQueue().
+        OSMutex*        GetMutex()  { return &fMutex; }
+        
     private:
 
         OSCond              fCond;
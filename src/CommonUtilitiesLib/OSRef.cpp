@@ -31,6 +31,7 @@
 */
 
 #include "OSRef.h"
+#include "OSMemory.h"
 
 #include <errno.h>
 
@@ -44,12 +45,114 @@ UInt32  OSRefTableUtils::HashString(StrPtrLen* inString)
     //data in this string
     UInt8* theData = (UInt8*)inString->Ptr;
     
-    //divide by 4 and take the characters at quarter points in the string,
-    //use those as the basis for the hash value
-    UInt32 quarterLen = inString->Len >> 2;
-    return (inString->Len * (theData[0] + theData[quarterLen] +
-            theData[quarterLen * 2] + theData[quarterLen * 3] +
-            theData[inString->Len - 1]));
+    //FNV-1a over the whole string. Session IDs are all digits and all the
+    //same length, so hashing just a few characters of them leaves only a
+    //few dozen distinct hash values.
+    UInt32 theHash = 2166136261U;
+    for (UInt32 x = 0; x < inString->Len; x++)
+    {
+        theHash ^= theData[x];
+        theHash *= 16777619U;
+    }
+    return theHash;
+}
+
+OSRefTable::OSRefTable(UInt32 tableSize)
+:   fNumTableLocks(0)
+{
+    UInt32 theStripeSize = (tableSize / kNumStripes) | 1;
+    if (theStripeSize < kMinStripeSize)
+        theStripeSize = kMinStripeSize;
+        
+    for (UInt32 x = 0; x < kNumStripes; x++)
+    {
+        fStripes[x].fTable = NEW OSRefHashTable(theStripeSize);
+        fStripes[x].fOldTable = NULL;
+        fStripes[x].fMigrateIndex = 0;
+    }
+}
+
+OSRefTable::~OSRefTable()
+{
+    for (UInt32 x = 0; x < kNumStripes; x++)
+    {
+        delete fStripes[x].fTable;
+        delete fStripes[x].fOldTable;
+    }
+}
+
+void OSRefTable::Lock()
+{
+    // Always in the same order, so two threads locking the whole table
+    // can't deadlock
+    for (UInt32 x = 0; x < kNumStripes; x++)
+        fStripes[x].fMutex.Lock();
+    fNumTableLocks++;
+}
+
+void OSRefTable::Unlock()
+{
+    fNumTableLocks--;
+    for (UInt32 x = kNumStripes; x > 0; x--)
+        fStripes[x - 1].fMutex.Unlock();
+}
+
+OSRef* OSRefTable::Map(Stripe* inStripe, OSRefKey* inKey)
+{
+    this->Migrate(inStripe);
+    
+    OSRef* theRef = inStripe->fTable->Map(inKey);
+    if ((theRef == NULL) && (inStripe->fOldTable != NULL))
+        theRef = inStripe->fOldTable->Map(inKey);
+    return theRef;
+}
+
+void OSRefTable::Add(Stripe* inStripe, OSRef* inRef)
+{
+    inStripe->fTable->Add(inRef);
+    
+    // Whoever has the table locked may be iterating over it, so leave
+    // the tables alone until it's done.
+    if ((inStripe->fOldTable == NULL) && (fNumTableLocks == 0) &&
+        (inStripe->fTable->GetNumEntries() > (UInt64)inStripe->fTable->GetTableSize() * kMaxLoadFactor))
+    {
+        inStripe->fOldTable = inStripe->fTable;
+        inStripe->fTable = NEW OSRefHashTable((inStripe->fOldTable->GetTableSize() * 2) + 1);
+        inStripe->fMigrateIndex = 0;
+    }
+}
+
+void OSRefTable::Remove(Stripe* inStripe, OSRef* inRef)
+{
+    // OSHashTable::Remove ignores refs it doesn't have
+    inStripe->fTable->Remove(inRef);
+    if (inStripe->fOldTable != NULL)
+        inStripe->fOldTable->Remove(inRef);
+}
+
+void OSRefTable::Migrate(Stripe* inStripe)
+{
+    OSRefHashTable* theOldTable = inStripe->fOldTable;
+    if ((theOldTable == NULL) || (fNumTableLocks > 0))
+        return;
+        
+    for (UInt32 x = 0; (x < kBucketsPerMigrate) && (inStripe->fMigrateIndex < theOldTable->GetTableSize()); x++)
+    {
+        OSRef* theRef = NULL;
+        while ((theRef = theOldTable->GetTableEntry(inStripe->fMigrateIndex)) != NULL)
+        {
+            theOldTable->Remove(theRef);
+            inStripe->fTable->Add(theRef);
+        }
+        inStripe->fMigrateIndex++;
+    }
+    
+    if (inStripe->fMigrateIndex == theOldTable->GetTableSize())
+    {
+        Assert(theOldTable->GetNumEntries() == 0);
+        delete theOldTable;
+        inStripe->fOldTable = NULL;
+    }
 }
 
 OS_Error OSRefTable::Register(OSRef* inRef)
@@ -60,12 +163,13 @@ OS_Error OSRefTable::Register(OSRef* inRef)
 #endif
     Assert(inRef->fRefCount == 0);
     
-    OSMutexLocker locker(&fMutex);
+    Stripe* theStripe = this->GetStripe(inRef->fHashValue);
+    OSMutexLocker locker(&theStripe->fMutex);
 
     // Check for a duplicate. In this function, if there is a duplicate,
     // return an error, don't resolve the duplicate
     OSRefKey key(&inRef->fString);
-    OSRef* duplicateRef = fTable.Map(&key);
+    OSRef* duplicateRef = this->Map(theStripe, &key);
     if (duplicateRef != NULL)
         return EPERM;
         
@@ -73,7 +177,7 @@ OS_Error OSRefTable::Register(OSRef* inRef)
 #if DEBUG
     inRef->fInATable = true;
 #endif
-    fTable.Add(inRef);
+    this->Add(theStripe, inRef);
     return OS_NoErr;
 }
 
@@ -86,7 +190,8 @@ OSRef* OSRefTable::RegisterOrResolve(OSRef* inRef)
 #endif
     Assert(inRef->fRefCount == 0);
     
-    OSMutexLocker locker(&fMutex);
+    Stripe* theStripe = this->GetStripe(inRef->fHashValue);
+    OSMutexLocker locker(&theStripe->fMutex);
 
     // Check for a duplicate. If there is one, resolve it and return it to the caller
     OSRef* duplicateRef = this->Resolve(&inRef->fString);
@@ -97,34 +202,57 @@ OSRef* OSRefTable::RegisterOrResolve(OSRef* inRef)
 #if DEBUG
     inRef->fInATable = true;
 #endif
-    fTable.Add(inRef);
+    this->Add(theStripe, inRef);
     return NULL;
 }
 
 void OSRefTable::UnRegister(OSRef* ref, UInt32 refCount)
 {
     Assert(ref != NULL);
-    OSMutexLocker locker(&fMutex);
+    Stripe* theStripe = this->GetStripe(ref->fHashValue);
+    OSMutexLocker locker(&theStripe->fMutex);
+
+    // Holding one stripe, the table can only be locked down by this thread.
+    // Waiting with the other stripes held would deadlock with a thread that
+    // needs one of them before it releases the Ref, so let the whole table
+    // go while waiting. It must be locked again in stripe order, and the Ref
+    // may have been resolved again meanwhile, so check again once it is.
+    while ((fNumTableLocks > 0) && (ref->fRefCount > refCount))
+    {
+        UInt32 theNumTableLocks = fNumTableLocks;
+        locker.Unlock();
+        for (UInt32 x = 0; x < theNumTableLocks; x++)
+            this->Unlock();
+        
+        theStripe->fMutex.Lock();
+        while (ref->fRefCount > refCount)
+            ref->fCond.Wait(&theStripe->fMutex);
+        theStripe->fMutex.Unlock();
+        
+        for (UInt32 y = 0; y < theNumTableLocks; y++)
+            this->Lock();
+        locker.Lock();
+    }
 
     //make sure that no one else is using the object
     while (ref->fRefCount > refCount)
-        ref->fCond.Wait(&fMutex);
+        ref->fCond.Wait(&theStripe->fMutex);
     
 #if DEBUG
     OSRefKey key(&ref->fString);
     if (ref->fInATable)
-        Assert(fTable.Map(&key) != NULL);
+        Assert(this->Map(theStripe, &key) != NULL);
     ref->fInATable = false;
 #endif
     
     //ok, we now definitely have no one else using this object, so
     //remove it from the table
-    fTable.Remove(ref);
+    this->Remove(theStripe, ref);
 }
 
 Bool16 OSRefTable::TryUnRegister(OSRef* ref, UInt32 refCount)
 {
-    OSMutexLocker locker(&fMutex);
+    OSMutexLocker locker(&this->GetStripe(ref->fHashValue)->fMutex);
     if (ref->fRefCount > refCount)
         return false;
     
@@ -141,8 +269,9 @@ OSRef*  OSRefTable::Resolve(StrPtrLen* inUniqueID)
     OSRefKey key(inUniqueID);
 
     //this must be done atomically wrt the table
-    OSMutexLocker locker(&fMutex);
-    OSRef* ref = fTable.Map(&key);
+    Stripe* theStripe = this->GetStripe((UInt32)key.GetHashKey());
+    OSMutexLocker locker(&theStripe->fMutex);
+    OSRef* ref = this->Map(theStripe, &key);
     if (ref != NULL)
     {
         ref->fRefCount++;
@@ -154,7 +283,7 @@ OSRef*  OSRefTable::Resolve(StrPtrLen* inUniqueID)
 void    OSRefTable::Release(OSRef* ref)
 {
     Assert(ref != NULL);
-    OSMutexLocker locker(&fMutex);
+    OSMutexLocker locker(&this->GetStripe(ref->fHashValue)->fMutex);
     ref->fRefCount--;
     // fRefCount is an unsigned long and QTSS should never run into
     // a ref greater than 16 * 64K, so this assert just checks to
@@ -167,14 +296,15 @@ void    OSRefTable::Release(OSRef* ref)
 void    OSRefTable::Swap(OSRef* newRef)
 {
     Assert(newRef != NULL);
-    OSMutexLocker locker(&fMutex);
+    Stripe* theStripe = this->GetStripe(newRef->fHashValue);
+    OSMutexLocker locker(&theStripe->fMutex);
     
     OSRefKey key(&newRef->fString);
-    OSRef* oldRef = fTable.Map(&key);
+    OSRef* oldRef = this->Map(theStripe, &key);
     if (oldRef != NULL)
     {
-        fTable.Remove(oldRef);
-        fTable.Add(newRef);
+        this->Remove(theStripe, oldRef);
+        this->Add(theStripe, newRef);
 #if DEBUG
         newRef->fInATable = true;
         oldRef->fInATable = false;
@@ -185,3 +315,67 @@ void    OSRefTable::Swap(OSRef* newRef)
         Assert(0);
 }
 
+UInt32 OSRefTable::GetNumRefsInTable()
+{
+    UInt64 result = 0;
+    for (UInt32 x = 0; x < kNumStripes; x++)
+    {
+        OSRefHashTable* theOldTable = fStripes[x].fOldTable;
+        result += fStripes[x].fTable->GetNumEntries();
+        if (theOldTable != NULL)
+            result += theOldTable->GetNumEntries();
+    }
+    Assert(result < kUInt32_Max);
+    return (UInt32) result;
+}
+
+UInt32 OSRefTable::GetTableSize()
+{
+    UInt32 result = 0;
+    for (UInt32 x = 0; x < kNumStripes; x++)
+        result += fStripes[x].fTable->GetTableSize();
+    return result;
+}
+
+void OSRefTableIter::First()
+{
+    fStripeIndex = 0;
+    fHashTable = fTable->fStripes[0].fTable;
+    fBucketIndex = 0;
+    this->FindNonEmptyBucket();
+}
+
+void OSRefTableIter::Next()
+{
+    fCurrent = fCurrent->fNextHashEntry;
+    if (fCurrent == NULL)
+    {
+        fBucketIndex++;
+        this->FindNonEmptyBucket();
+    }
+}
+
+void OSRefTableIter::FindNonEmptyBucket()
+{
+    fCurrent = NULL;
+    while (fHashTable != NULL)
+    {
+        for ( ; fBucketIndex < fHashTable->GetTableSize(); fBucketIndex++)
+        {
+            fCurrent = fHashTable->GetTableEntry(fBucketIndex);
+            if (fCurrent != NULL)
+                return;
+        }
+        
+        // Done with this table. A stripe's old table, if it's still got one,
+        // comes after its new one.
+        OSRefTable::Stripe* theStripe = &fTable->fStripes[fStripeIndex];
+        if ((fHashTable == theStripe->fTable) && (theStripe->fOldTable != NULL))
+            fHashTable = theStripe->fOldTable;
+        else if (++fStripeIndex < OSRefTable::kNumStripes)
+            fHashTable = fTable->fStripes[fStripeIndex].fTable;
+        else
+            fHashTable = NULL;
+        fBucketIndex = 0;
+    }
+}
@@ -56,6 +56,7 @@ class OSRefTableUtils
 
         friend class OSRef;
         friend class OSRefKey;
+        friend class OSRefTable;
 };
 
 class OSRef
@@ -113,6 +114,7 @@ class OSRef
         friend class OSHashTable<OSRef, OSRefKey>;
         friend class OSHashTableIter<OSRef, OSRefKey>;
         friend class OSRefTable;
+        friend class OSRefTableIter;
 
 };
 
@@ -155,6 +157,7 @@ private:
     UInt32  fHashValue;
 
     friend class OSHashTable<OSRef, OSRefKey>;
+    friend class OSRefTable;
 };
 
 typedef OSHashTable<OSRef, OSRefKey> OSRefHashTable;
@@ -171,13 +174,24 @@ class OSRefTable
     
         //tableSize doesn't indicate the max number of Refs that can be added
         //(it's unlimited), but is rather just how big to make the hash table
-        OSRefTable(UInt32 tableSize = kDefaultTableSize) : fTable(tableSize), fMutex() {}
-        ~OSRefTable() {}
+        //to start with. The table grows as Refs are added.
+        OSRefTable(UInt32 tableSize = kDefaultTableSize);
+        ~OSRefTable();
+        
+        //The table is split into stripes, each with its own lock, so operations
+        //on different IDs don't contend with each other. Callers that need
+        //several operations on one ID to be atomic (resolve it, and register
+        //a new Ref if that fails, say) can hold the lock for that ID.
+        OSMutex*    GetMutex(StrPtrLen* inUniqueID)
+            { return &this->GetStripe(OSRefTableUtils::HashString(inUniqueID))->fMutex; }
         
-        //Allows access to the mutex in case you need to lock the table down
-        //between operations
-        OSMutex*    GetMutex()      { return &fMutex; }
-        OSRefHashTable* GetHashTable() { return &fTable; }
+        //Locks down the whole table, to iterate over it with an OSRefTableIter.
+        //Use an OSRefTableLocker. If UnRegister has to wait while the table is
+        //locked, it lets the whole table go until the Ref is released, so the
+        //table may change underneath an iterator. Use TryUnRegister, or only
+        //UnRegister Refs whose count has already dropped, to keep it still.
+        void        Lock();
+        void        Unlock();
         
         //Registers a Ref in the table. Once the Ref is in, clients may resolve
         //the ref by using its string ID. You must setup the Ref before passing it
@@ -198,6 +212,7 @@ class OSRefTable
         //when the refCount drops to the level specified. If several threads have
         //the ref currently, the calling thread will wait until the other threads
         //stop using the ref (by calling Release, below)
+        //If the caller has the whole table locked, it is unlocked while waiting.
         //This function is atomic wrt this ref table.
         void        UnRegister(OSRef* ref, UInt32 refCount = 0);
         
@@ -227,14 +242,81 @@ class OSRefTable
         // the new OSRef object.
         void        Swap(OSRef* newRef);
         
-        UInt32      GetNumRefsInTable() { UInt64 result =  fTable.GetNumEntries(); Assert(result < kUInt32_Max); return (UInt32) result; }
+        //Unless the table is locked, these are only approximate
+        UInt32      GetNumRefsInTable();
+        UInt32      GetTableSize();
         
     private:
     
+        enum
+        {
+            kNumStripes         = 16,   //UInt32. picked from the top bits of the hash
+            kMinStripeSize      = 31,   //UInt32
+            kMaxLoadFactor      = 2,    //UInt32. refs per bucket before a stripe grows
+            kBucketsPerMigrate  = 8     //UInt32
+        };
+        
+        //Each stripe is an independent hash table. When it gets too full, a
+        //table twice the size is made, and every operation on the stripe moves
+        //a few buckets from the old table over, so no one operation pays for
+        //rehashing the whole stripe.
+        struct Stripe
+        {
+            OSMutex             fMutex;
+            OSRefHashTable*     fTable;
+            OSRefHashTable*     fOldTable;      //NULL unless being moved into fTable
+            UInt32              fMigrateIndex;  //next bucket of fOldTable to move
+        };
         
-        //all this object needs to do its job is an atomic hashtable
-        OSRefHashTable  fTable;
-        OSMutex         fMutex;
+        Stripe*     GetStripe(UInt32 inHashValue) { return &fStripes[(inHashValue >> 28) % kNumStripes]; }
+        
+        //These must be called with the stripe locked
+        OSRef*      Map(Stripe* inStripe, OSRefKey* inKey);
+        void        Add(Stripe* inStripe, OSRef* inRef);
+        void        Remove(Stripe* inStripe, OSRef* inRef);
+        void        Migrate(Stripe* inStripe);
+        
+        Stripe      fStripes[kNumStripes];
+        UInt32      fNumTableLocks; //stripes don't grow or migrate while this is non-zero
+        
+        friend class OSRefTableIter;
+};
+
+//Iterates over every Ref in a table. The table must be locked down for the
+//life of the iterator.
+class OSRefTableIter
+{
+    public:
+    
+        OSRefTableIter(OSRefTable* inTable) : fTable(inTable) { this->First(); }
+        
+        void    First();
+        void    Next();
+        Bool16  IsDone()        { return (fCurrent == NULL); }
+        OSRef*  GetCurrent()    { return fCurrent; }
+        
+    private:
+    
+        //moves on to the first Ref at or after the current bucket
+        void    FindNonEmptyBucket();
+        
+        OSRefTable*     fTable;
+        OSRef*          fCurrent;
+        UInt32          fStripeIndex;
+        OSRefHashTable* fHashTable;
+        UInt32          fBucketIndex;
+};
+
+class OSRefTableLocker
+{
+    public:
+
+        OSRefTableLocker(OSRefTable* inTable) : fTable(inTable) { if (fTable != NULL) fTable->Lock(); }
+        ~OSRefTableLocker() { if (fTable != NULL) fTable->Unlock(); }
+        
+    private:
+
+        OSRefTable*     fTable;
 };
 
 
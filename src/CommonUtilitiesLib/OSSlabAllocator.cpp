@@ -0,0 +1,239 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSSlabAllocator.cpp
+
+    Contains:   Fast allocation of fixed size objects
+                
+                A thread is given an index, through a thread-specific key, the
+                first time it uses any allocator, and that index picks its cache
+                in every allocator.
+    
+    
+*/
+
+#include "OSSlabAllocator.h"
+#include "OSMemory.h"
+#include "MyAssert.h"
+#include "atomic.h"
+#include <stdint.h>
+
+#ifdef __Win32__
+static DWORD            sThreadIndexKey = 0;
+#elif __PTHREADS__
+#include <pthread.h>
+static pthread_key_t    sThreadIndexKey;
+#endif
+
+unsigned int        OSSlabAllocator::sNumThreads = 0;
+OSSlabAllocator*    OSSlabAllocator::sAllocators[kMaxAllocators];
+UInt32              OSSlabAllocator::sNumAllocators = 0;
+
+OSSlabAllocator::OSSlabAllocator(const char* inName, UInt32 inObjectSize)
+:   fName(inName),
+    fObjectSize((inObjectSize + 15) & ~15),
+    fFreeList(NULL),
+    fNumFree(0),
+    fNumSlabs(0),
+    fThreadCacheMemory(NULL),
+    fThreadCaches(NULL)
+{
+    Assert(fObjectSize >= sizeof(FreeObject));
+    
+    //
+    // Allocators are constructed at startup, before there is more than one
+    // thread to race on this.
+    if (sNumAllocators == 0)
+    {
+#ifdef __Win32__
+        sThreadIndexKey = ::TlsAlloc();
+#elif __PTHREADS__
+        (void)::pthread_key_create(&sThreadIndexKey, NULL);
+#endif
+    }
+    Assert(sNumAllocators < kMaxAllocators);
+    if (sNumAllocators < kMaxAllocators)
+        sAllocators[sNumAllocators++] = this;
+    
+    fThreadCacheMemory = NEW char[(kMaxThreadCaches * sizeof(ThreadCache)) + kCacheLineSize];
+    ::memset(fThreadCacheMemory, 0, (kMaxThreadCaches * sizeof(ThreadCache)) + kCacheLineSize);
+    UInt32 theAlignOffset = (UInt32)((kCacheLineSize - ((uintptr_t)fThreadCacheMemory & (kCacheLineSize - 1))) & (kCacheLineSize - 1));
+    fThreadCaches = (ThreadCache*)(fThreadCacheMemory + theAlignOffset);
+}
+
+OSSlabAllocator::ThreadCache* OSSlabAllocator::GetThreadCache()
+{
+#if defined(__Win32__) || __PTHREADS__
+#ifdef __Win32__
+    UInt32 theThreadIndex = (UInt32)(uintptr_t)::TlsGetValue(sThreadIndexKey);
+#else
+    UInt32 theThreadIndex = (UInt32)(uintptr_t)::pthread_getspecific(sThreadIndexKey);
+#endif
+    if (theThreadIndex == 0)
+    {
+        theThreadIndex = atomic_add(&sNumThreads, 1);
+        if (theThreadIndex > kMaxThreadCaches)
+            theThreadIndex = kMaxThreadCaches + 1;
+#ifdef __Win32__
+        (void)::TlsSetValue(sThreadIndexKey, (void*)(uintptr_t)theThreadIndex);
+#else
+        (void)::pthread_setspecific(sThreadIndexKey, (void*)(uintptr_t)theThreadIndex);
+#endif
+    }
+    if (theThreadIndex > kMaxThreadCaches)
+        return NULL;
+    return &fThreadCaches[theThreadIndex - 1];
+#else
+    return NULL;
+#endif
+}
+
+void* OSSlabAllocator::Get()
+{
+    ThreadCache* theCache = this->GetThreadCache();
+    if (theCache == NULL)
+    {
+        OSMutexLocker locker(&fMutex);
+        if (fFreeList == NULL)
+            this->Refill(NULL);
+        
+        FreeObject* theObject = fFreeList;
+        fFreeList = theObject->fNext;
+        fNumFree--;
+        return theObject;
+    }
+    
+    if (theCache->fFreeList == NULL)
+        this->Refill(theCache);
+        
+    FreeObject* theObject = theCache->fFreeList;
+    theCache->fFreeList = theObject->fNext;
+    theCache->fNumFree--;
+    return theObject;
+}
+
+void OSSlabAllocator::Put(void* inObject)
+{
+    Assert(inObject != NULL);
+    FreeObject* theObject = (FreeObject*)inObject;
+    
+    ThreadCache* theCache = this->GetThreadCache();
+    if (theCache == NULL)
+    {
+        OSMutexLocker locker(&fMutex);
+        theObject->fNext = fFreeList;
+        fFreeList = theObject;
+        fNumFree++;
+        return;
+    }
+    
+    theObject->fNext = theCache->fFreeList;
+    theCache->fFreeList = theObject;
+    theCache->fNumFree++;
+    
+    //
+    // A thread that only frees (say, the one tearing down sessions another
+    // thread set up) would otherwise hoard everything it frees.
+    if (theCache->fNumFree >= 2 * kBatchSize)
+        this->Drain(theCache, kBatchSize);
+}
+
+void OSSlabAllocator::Refill(ThreadCache* inCache)
+{
+    // Moves a batch from the shared list into inCache, making a new slab
+    // first if the shared list runs low. With no cache, just makes sure
+    // the shared list isn't empty; the caller then holds fMutex.
+    OSMutexLocker locker((inCache != NULL) ? &fMutex : NULL);
+
+    if (fNumFree < ((inCache != NULL) ? (UInt32)kBatchSize : 1))
+    {
+        char* theSlab = NEW char[kObjectsPerSlab * fObjectSize];
+        for (UInt32 x = 0; x < kObjectsPerSlab; x++)
+        {
+            FreeObject* theObject = (FreeObject*)(theSlab + (x * fObjectSize));
+            theObject->fNext = fFreeList;
+            fFreeList = theObject;
+        }
+        fNumFree += kObjectsPerSlab;
+        fNumSlabs++;
+    }
+    
+    if (inCache == NULL)
+        return;
+        
+    for (UInt32 y = 0; (y < kBatchSize) && (fFreeList != NULL); y++)
+    {
+        FreeObject* theObject = fFreeList;
+        fFreeList = theObject->fNext;
+        fNumFree--;
+        
+        theObject->fNext = inCache->fFreeList;
+        inCache->fFreeList = theObject;
+        inCache->fNumFree++;
+    }
+}
+
+void OSSlabAllocator::Drain(ThreadCache* inCache, UInt32 inNumToKeep)
+{
+    OSMutexLocker locker(&fMutex);
+    while (inCache->fNumFree > inNumToKeep)
+    {
+        FreeObject* theObject = inCache->fFreeList;
+        inCache->fFreeList = theObject->fNext;
+        inCache->fNumFree--;
+        
+        theObject->fNext = fFreeList;
+        fFreeList = theObject;
+        fNumFree++;
+    }
+}
+
+void* OSSlabAllocator::New(OSSlabAllocator* inAllocator, size_t inSize)
+{
+    if ((inAllocator == NULL) || (((inSize + 15) & ~15) != inAllocator->fObjectSize))
+        return ::operator new(inSize);
+    return inAllocator->Get();
+}
+
+void OSSlabAllocator::Delete(OSSlabAllocator* inAllocator, void* inObject, size_t inSize)
+{
+    if (inObject == NULL)
+        return;
+    if ((inAllocator == NULL) || (((inSize + 15) & ~15) != inAllocator->fObjectSize))
+        ::operator delete(inObject);
+    else
+        inAllocator->Put(inObject);
+}
+
+UInt32 OSSlabAllocator::GetNumObjectsInUse()
+{
+    UInt32 theNumFree = fNumFree;
+    UInt32 theNumThreads = (sNumThreads < kMaxThreadCaches) ? sNumThreads : (UInt32)kMaxThreadCaches;
+    for (UInt32 x = 0; x < theNumThreads; x++)
+        theNumFree += fThreadCaches[x].fNumFree;
+        
+    UInt32 theTotal = this->GetTotalNumObjects();
+    return (theNumFree < theTotal) ? theTotal - theNumFree : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSSlabAllocator.h
+
+    Contains:   Fast allocation of fixed size objects, such as the per-client
+                session objects that come and go with every connection.
+                
+                Objects are carved out of slabs of kObjectsPerSlab at a time, so
+                connection churn doesn't fragment the heap. Each thread keeps a
+                small cache of free objects that it gets from and puts to without
+                locking; only when that cache runs dry or overflows does it take
+                a batch from, or give one back to, the allocator's shared list.
+                
+                Like OSBufferPool, slabs are never given back to the heap.
+                    
+
+*/
+
+#ifndef __OS_SLAB_ALLOCATOR_H__
+#define __OS_SLAB_ALLOCATOR_H__
+
+#include "OSHeaders.h"
+#include "OSMutex.h"
+
+class OSSlabAllocator
+{
+    public:
+    
+        //inName is kept, not copied. inObjectSize is rounded up to keep every
+        //object suitably aligned.
+        OSSlabAllocator(const char* inName, UInt32 inObjectSize);
+        
+        //
+        // This object currently *does not* clean up for itself when
+        // you destruct it!
+        ~OSSlabAllocator() {}
+        
+        //
+        // ACCESSORS
+        const char* GetName()           { return fName; }
+        UInt32  GetObjectSize()         { return fObjectSize; }
+        UInt32  GetTotalNumObjects()    { return fNumSlabs * kObjectsPerSlab; }
+        
+        //Objects handed out and not yet put back. Free objects sitting in
+        //other threads' caches are counted without locking, so this is
+        //approximate while the allocator is busy.
+        UInt32  GetNumObjectsInUse();
+        
+        //
+        // All these functions are thread-safe
+        
+        //Never returns NULL; like NEW, the process exits if memory runs out
+        void*   Get();
+        
+        //Returns an object retrieved by Get back to the allocator. Any thread
+        //may put back an object that another one got.
+        void    Put(void* inObject);
+        
+        //
+        // For class-specific operator new and delete. Objects of any other size
+        // (a subclass, say), or made before the class has an allocator, come
+        // from the heap instead.
+        static void*    New(OSSlabAllocator* inAllocator, size_t inSize);
+        static void     Delete(OSSlabAllocator* inAllocator, void* inObject, size_t inSize);
+        
+        //
+        // Every allocator ever constructed, for reporting
+        static UInt32           GetNumAllocators()  { return sNumAllocators; }
+        static OSSlabAllocator* GetAllocator(UInt32 inIndex)
+            { return (inIndex < sNumAllocators) ? sAllocators[inIndex] : NULL; }
+    
+    private:
+    
+        enum
+        {
+            kObjectsPerSlab     = 32,   //UInt32
+            kBatchSize          = 16,   //UInt32. objects moved between a thread cache and the shared list at once
+            kMaxThreadCaches    = 64,   //UInt32. threads beyond this use the shared list directly
+            kMaxAllocators      = 32,   //UInt32
+            kCacheLineSize      = 64    //UInt32
+        };
+        
+        //A free object holds the link to the next one in its first bytes
+        struct FreeObject
+        {
+            FreeObject* fNext;
+        };
+        
+        struct ThreadCache
+        {
+            FreeObject* fFreeList;
+            UInt32      fNumFree;
+            char        fPad[kCacheLineSize - sizeof(FreeObject*) - sizeof(UInt32)];
+        };
+        
+        ThreadCache*    GetThreadCache();
+        void            Refill(ThreadCache* inCache);
+        void            Drain(ThreadCache* inCache, UInt32 inNumToKeep);
+        
+        const char*     fName;
+        UInt32          fObjectSize;
+        
+        OSMutex         fMutex;
+        FreeObject*     fFreeList;      //shared, protected by fMutex
+        UInt32          fNumFree;
+        UInt32          fNumSlabs;
+        
+        char*           fThreadCacheMemory;
+        ThreadCache*    fThreadCaches;
+        
+        static unsigned int     sNumThreads;
+        static OSSlabAllocator* sAllocators[kMaxAllocators];
+        static UInt32           sNumAllocators;
+};
+
+#endif //__OS_SLAB_ALLOCATOR_H__
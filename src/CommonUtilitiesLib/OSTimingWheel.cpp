@@ -0,0 +1,210 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSTimingWheel.cpp
+
+    Contains:   Implements a hierarchical timing wheel
+                
+                Level 0 has one slot per millisecond for the next kLevel0Size
+                milliseconds. Each higher level has kLevelNSize slots, each
+                covering a whole turn of the level below it. When level 0 wraps,
+                the next slot of level 1 is re-inserted, and so on up.
+    
+    
+*/
+
+#include "OSTimingWheel.h"
+#include "MyAssert.h"
+
+OSTimingWheel::OSTimingWheel(SInt64 inCurrentTimeInMilSecs)
+:   fCurrentTime(inCurrentTimeInMilSecs),
+    fNumElements(0)
+{
+    for (UInt32 x = 0; x <= kNumLevels; x++)
+        fNumInLevel[x] = 0;
+}
+
+void OSTimingWheel::Insert(OSTimingWheelElem* inElem)
+{
+    Assert(inElem != NULL);
+    Assert(inElem->fCurrentWheel == NULL);
+    
+    inElem->fCurrentWheel = this;
+    fNumElements++;
+    this->AddToSlot(inElem);
+}
+
+void OSTimingWheel::AddToSlot(OSTimingWheelElem* inElem)
+{
+    SInt64 theExpiration = inElem->fValue;
+    SInt64 theDelta = theExpiration - fCurrentTime;
+    
+    if (theDelta < 0)
+    {
+        //Its slot has already been expired, so it is due now. The next
+        //ExtractExpired returns it even if the clock hasn't moved.
+        inElem->fLevel = kExpiredLevel;
+        fExpired.EnQueue(&inElem->fSlotElem);
+    }
+    else if (theDelta < kLevel0Size)
+    {
+        //due within this turn of level 0
+        inElem->fLevel = 0;
+        fLevel0[theExpiration & kLevel0Mask].EnQueue(&inElem->fSlotElem);
+    }
+    else
+    {
+        UInt32 theLevel = 1;
+        UInt32 theShift = kLevel0Bits;
+        while ((theLevel < kNumLevels - 1) && (theDelta >= ((SInt64)1 << (theShift + kLevelNBits))))
+        {
+            theLevel++;
+            theShift += kLevelNBits;
+        }
+        
+        //Further out than the wheel reaches. Park it in the last slot of the top
+        //level; when that slot cascades it gets put back in based on its real value.
+        if (theDelta >= ((SInt64)1 << (theShift + kLevelNBits)))
+            theExpiration = fCurrentTime + ((SInt64)1 << (theShift + kLevelNBits)) - 1;
+            
+        inElem->fLevel = theLevel;
+        fLevelN[theLevel - 1][(theExpiration >> theShift) & kLevelNMask].EnQueue(&inElem->fSlotElem);
+    }
+    fNumInLevel[inElem->fLevel]++;
+}
+
+OSTimingWheelElem* OSTimingWheel::Remove(OSTimingWheelElem* inElem)
+{
+    Assert(inElem != NULL);
+    if (inElem->fCurrentWheel != this)
+        return NULL;
+    
+    Assert(inElem->fSlotElem.IsMemberOfAnyQueue());
+    inElem->fSlotElem.Remove();
+    inElem->fCurrentWheel = NULL;
+    fNumInLevel[inElem->fLevel]--;
+    fNumElements--;
+    return inElem;
+}
+
+OSTimingWheelElem* OSTimingWheel::ExtractExpired(SInt64 inCurrentTimeInMilSecs)
+{
+    if (fExpired.GetLength() == 0)
+        this->Advance(inCurrentTimeInMilSecs);
+    
+    OSQueueElem* theSlotElem = fExpired.DeQueue();
+    if (theSlotElem == NULL)
+        return NULL;
+        
+    OSTimingWheelElem* theElem = (OSTimingWheelElem*)theSlotElem->GetEnclosingObject();
+    theElem->fCurrentWheel = NULL;
+    fNumInLevel[kExpiredLevel]--;
+    fNumElements--;
+    return theElem;
+}
+
+SInt64 OSTimingWheel::GetNextExpiration()
+{
+    if (fNumElements == 0)
+        return -1;
+    
+    if (fNumInLevel[kExpiredLevel] > 0)
+        return fCurrentTime - 1;
+        
+    //
+    // If the higher levels have anything, only look as far as the next wrap of
+    // level 0 (which may be right now, if fCurrentTime sits on one that hasn't been
+    // processed yet): that is when the next coarse slot cascades, and it may bring
+    // in something due before anything level 0 holds for the following turn.
+    SInt64 theLimit = fCurrentTime + kLevel0Size;
+    if (fNumElements != fNumInLevel[0])
+        theLimit = (fCurrentTime + kLevel0Mask) & ~(SInt64)kLevel0Mask;
+        
+    if (fNumInLevel[0] > 0)
+    {
+        for (SInt64 theTime = fCurrentTime; theTime < theLimit; theTime++)
+        {
+            if (fLevel0[theTime & kLevel0Mask].GetLength() > 0)
+                return theTime;
+        }
+    }
+    
+    return theLimit;
+}
+
+void OSTimingWheel::Advance(SInt64 inCurrentTimeInMilSecs)
+{
+    while (fCurrentTime <= inCurrentTimeInMilSecs)
+    {
+        if (fNumElements == fNumInLevel[kExpiredLevel])
+        {
+            //Nothing left in any slot, so there is nothing to cascade either
+            fCurrentTime = inCurrentTimeInMilSecs + 1;
+            return;
+        }
+        
+        UInt32 theIndex = (UInt32)(fCurrentTime & kLevel0Mask);
+        if (theIndex == 0)
+        {
+            UInt32 theShift = kLevel0Bits;
+            for (UInt32 theLevel = 1; theLevel < kNumLevels; theLevel++, theShift += kLevelNBits)
+            {
+                UInt32 theLevelIndex = (UInt32)((fCurrentTime >> theShift) & kLevelNMask);
+                this->Cascade(theLevel, theLevelIndex);
+                if (theLevelIndex != 0)
+                    break;
+            }
+        }
+        
+        if (fNumInLevel[0] == 0)
+        {
+            //Skip straight to the next wrap of level 0 (or to now)
+            SInt64 theNextWrap = (fCurrentTime | kLevel0Mask) + 1;
+            fCurrentTime = (theNextWrap <= inCurrentTimeInMilSecs) ? theNextWrap : inCurrentTimeInMilSecs + 1;
+            continue;
+        }
+        
+        OSQueue* theSlot = &fLevel0[theIndex];
+        for (OSQueueElem* theSlotElem = theSlot->DeQueue(); theSlotElem != NULL; theSlotElem = theSlot->DeQueue())
+        {
+            ((OSTimingWheelElem*)theSlotElem->GetEnclosingObject())->fLevel = kExpiredLevel;
+            fExpired.EnQueue(theSlotElem);
+            fNumInLevel[0]--;
+            fNumInLevel[kExpiredLevel]++;
+        }
+        fCurrentTime++;
+    }
+}
+
+void OSTimingWheel::Cascade(UInt32 inLevel, UInt32 inIndex)
+{
+    OSQueue* theSlot = &fLevelN[inLevel - 1][inIndex];
+    for (OSQueueElem* theSlotElem = theSlot->DeQueue(); theSlotElem != NULL; theSlotElem = theSlot->DeQueue())
+    {
+        OSTimingWheelElem* theElem = (OSTimingWheelElem*)theSlotElem->GetEnclosingObject();
+        fNumInLevel[inLevel]--;
+        this->AddToSlot(theElem);
+    }
+}
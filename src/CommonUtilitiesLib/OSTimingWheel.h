@@ -0,0 +1,129 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       OSTimingWheel.h
+
+    Contains:   Implements a hierarchical timing wheel. Elements are scheduled for
+                a time in milliseconds and come back out once that time has passed.
+                Insert and Remove are O(1); expiring costs O(1) per element plus an
+                occasional cascade of one coarse slot into the finer levels.
+
+                The wheel has no lock of its own: it is meant to be owned by one
+                thread, or protected by its owner's mutex.
+                    
+
+*/
+
+#ifndef _OSTIMINGWHEEL_H_
+#define _OSTIMINGWHEEL_H_
+
+#include "OSHeaders.h"
+#include "OSQueue.h"
+
+class OSTimingWheelElem;
+
+class OSTimingWheel
+{
+    public:
+    
+        //Pass in the current time. The wheel never looks at the clock itself.
+        OSTimingWheel(SInt64 inCurrentTimeInMilSecs);
+        ~OSTimingWheel() {}
+        
+        //ACCESSORS
+        UInt32      GetNumElements() { return fNumElements; }
+        
+        //Returns the time by which something in the wheel may expire, or -1 if
+        //the wheel is empty. Exact when the next expiration comes before the
+        //next turn of level 0, otherwise an early (safe) estimate.
+        SInt64      GetNextExpiration();
+        
+        //MODIFIERS
+        
+        //Schedules the element for the time in its value. A time in the
+        //past means it expires on the next call to ExtractExpired.
+        void                Insert(OSTimingWheelElem* inElem);
+        
+        //Returns one element whose time is <= inCurrentTime, or NULL.
+        OSTimingWheelElem*  ExtractExpired(SInt64 inCurrentTimeInMilSecs);
+        
+        //Removes the specified element from the wheel. Returns NULL if it
+        //wasn't in this wheel.
+        OSTimingWheelElem*  Remove(OSTimingWheelElem* inElem);
+    
+    private:
+    
+        enum
+        {
+            kLevel0Bits = 8,                        //UInt32
+            kLevelNBits = 6,                        //UInt32
+            kNumLevels = 4,                         //UInt32. covers 2^26 ms, about 18 hours
+            kLevel0Size = 1 << kLevel0Bits,         //UInt32
+            kLevelNSize = 1 << kLevelNBits,         //UInt32
+            kLevel0Mask = kLevel0Size - 1,          //UInt32
+            kLevelNMask = kLevelNSize - 1,          //UInt32
+            kExpiredLevel = kNumLevels              //UInt32. fLevel of elements on fExpired
+        };
+        
+        void        Advance(SInt64 inCurrentTimeInMilSecs);
+        void        Cascade(UInt32 inLevel, UInt32 inIndex);
+        void        AddToSlot(OSTimingWheelElem* inElem);
+        
+        //Every slot before fCurrentTime has been expired
+        SInt64      fCurrentTime;
+        UInt32      fNumElements;
+        UInt32      fNumInLevel[kNumLevels + 1];
+        
+        OSQueue     fLevel0[kLevel0Size];
+        OSQueue     fLevelN[kNumLevels - 1][kLevelNSize];
+        OSQueue     fExpired;
+};
+
+class OSTimingWheelElem
+{
+    public:
+        OSTimingWheelElem(void* enclosingObject = NULL)
+            : fValue(0), fEnclosingObject(enclosingObject), fSlotElem(this), fLevel(0), fCurrentWheel(NULL) {}
+        ~OSTimingWheelElem() {}
+        
+        //Same interface as OSHeapElem: the value is the time, in milliseconds,
+        //that this element should expire.
+        void    SetValue(SInt64 newValue) { fValue = newValue; }
+        SInt64  GetValue()              { return fValue; }
+        void*   GetEnclosingObject()    { return fEnclosingObject; }
+        void    SetEnclosingObject(void* obj) { fEnclosingObject = obj; }
+        Bool16  IsMemberOfAnyWheel()    { return fCurrentWheel != NULL; }
+        
+    private:
+    
+        SInt64          fValue;
+        void*           fEnclosingObject;
+        OSQueueElem     fSlotElem;
+        UInt32          fLevel;
+        OSTimingWheel*  fCurrentWheel;
+        
+        friend class OSTimingWheel;
+};
+#endif //_OSTIMINGWHEEL_H_
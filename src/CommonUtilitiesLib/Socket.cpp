@@ -43,6 +43,16 @@
 
 #endif
 
+#if TCPZEROCOPY
+#include <linux/errqueue.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60 //from asm-generic/socket.h, for C libraries that predate it
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
+
 #include <errno.h>
 
 #include "Socket.h"
@@ -60,12 +70,29 @@
 
 EventThread* Socket::sEventThread = NULL;
 
+UInt32 Socket::AddEventThreads(UInt32 inNumToAdd)
+{
+    // Returns the number of event threads actually added
+    UInt32 theNumAdded = 0;
+    for ( ; (theNumAdded < inNumToAdd) && EventThread::CanAddThread(); theNumAdded++)
+        (void)new EventThread();
+    return theNumAdded;
+}
+
+void Socket::StartThread()
+{
+    for (UInt32 x = 0; x < EventThread::GetNumThreads(); x++)
+        EventThread::GetThread(x)->Start();
+}
+
 Socket::Socket(Task *notifytask, UInt32 inSocketType)
 :   EventContext(EventContext::kInvalidFileDesc, sEventThread),
     fState(inSocketType),
     fLocalAddrStrPtr(NULL),
     fLocalDNSStrPtr(NULL),
-    fPortStr(fPortBuffer, kPortBufSizeInBytes)
+    fPortStr(fPortBuffer, kPortBufSizeInBytes),
+    fZeroCopySendsIssued(0),
+    fZeroCopySendsCompleted(0)
 {
     fLocalAddr.sin_addr.s_addr = 0;
     fLocalAddr.sin_port = 0;
@@ -326,6 +353,8 @@ OS_Error Socket::WriteV(const struct iovec* iov, const UInt32 numIOvecs, UInt32*
         // Are there any errors that can happen if the client is connected?
         // Yes... EAGAIN. Means the socket is now flow-controleld
         int theErr = OSThread::GetErrno();
+        if ((theErr == EAGAIN) && (fZeroCopySendsCompleted != fZeroCopySendsIssued))
+            (void)this->GetZeroCopySendsCompleted(); // or they keep waking us up
         if ((theErr != EAGAIN) && (this->IsConnected()))
             fState ^= kConnected;//turn off connected state flag
         return (OS_Error)theErr;
@@ -336,6 +365,92 @@ OS_Error Socket::WriteV(const struct iovec* iov, const UInt32 numIOvecs, UInt32*
     return OS_NoErr;
 }
 
+OS_Error Socket::WriteVZeroCopy(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLenSent)
+{
+#if TCPZEROCOPY
+    Assert(iov != NULL);
+
+    if (!(fState & kConnected))
+        return (OS_Error)ENOTCONN;
+    
+    if (!(fState & (kZeroCopy | kNoZeroCopy)))
+    {
+        int one = 1;
+        if (::setsockopt(fFileDesc, SOL_SOCKET, SO_ZEROCOPY, (char*)&one, sizeof(one)) == 0)
+            fState |= kZeroCopy;
+        else
+            fState |= kNoZeroCopy;
+    }
+    if (fState & kNoZeroCopy)
+        return this->WriteV(iov, numIOvecs, outLenSent);
+    
+    struct msghdr theMsg;
+    ::memset(&theMsg, 0, sizeof(theMsg));
+    theMsg.msg_iov = (struct iovec*)iov;
+    theMsg.msg_iovlen = numIOvecs;
+    
+    int err;
+    do {
+        err = ::sendmsg(fFileDesc, &theMsg, MSG_ZEROCOPY);
+    } while((err == -1) && (OSThread::GetErrno() == EINTR));
+    if (err == -1)
+    {
+        int theErr = OSThread::GetErrno();
+        if (theErr == ENOBUFS)
+        {
+            // Out of locked memory for pinning pages. Copy this one instead.
+            return this->WriteV(iov, numIOvecs, outLenSent);
+        }
+        if ((theErr == EAGAIN) && (fZeroCopySendsCompleted != fZeroCopySendsIssued))
+            (void)this->GetZeroCopySendsCompleted();
+        if ((theErr != EAGAIN) && (this->IsConnected()))
+            fState ^= kConnected;//turn off connected state flag
+        return (OS_Error)theErr;
+    }
+    
+    // The kernel numbers each zero copy send that takes data, starting at 0
+    fZeroCopySendsIssued++;
+    
+    if (outLenSent != NULL)
+        *outLenSent = (UInt32)err;
+        
+    return OS_NoErr;
+#else
+    return this->WriteV(iov, numIOvecs, outLenSent);
+#endif
+}
+
+UInt32 Socket::GetZeroCopySendsCompleted()
+{
+#if TCPZEROCOPY
+    // Completions come back on the socket's error queue as ranges of send
+    // numbers. TCP completes them in order, so the end of the last range
+    // tells us how many are done.
+    while (fZeroCopySendsCompleted != fZeroCopySendsIssued)
+    {
+        char theControlBuf[128];
+        struct msghdr theMsg;
+        ::memset(&theMsg, 0, sizeof(theMsg));
+        theMsg.msg_control = theControlBuf;
+        theMsg.msg_controllen = sizeof(theControlBuf);
+        
+        if (::recvmsg(fFileDesc, &theMsg, MSG_ERRQUEUE) == -1)
+            break;
+            
+        for (struct cmsghdr* theCmsg = CMSG_FIRSTHDR(&theMsg); theCmsg != NULL; theCmsg = CMSG_NXTHDR(&theMsg, theCmsg))
+        {
+            if ((theCmsg->cmsg_level != SOL_IP) || (theCmsg->cmsg_type != IP_RECVERR))
+                continue;
+            
+            struct sock_extended_err* theErr = (struct sock_extended_err*)CMSG_DATA(theCmsg);
+            if ((theErr->ee_errno == 0) && (theErr->ee_origin == SO_EE_ORIGIN_ZEROCOPY))
+                fZeroCopySendsCompleted = (UInt32)theErr->ee_data + 1;
+        }
+    }
+#endif
+    return fZeroCopySendsCompleted;
+}
+
 OS_Error Socket::Read(void *buffer, const UInt32 length, UInt32 *outRecvLenP)
 {
     Assert(outRecvLenP != NULL);
@@ -355,6 +470,8 @@ OS_Error Socket::Read(void *buffer, const UInt32 length, UInt32 *outRecvLenP)
         // Are there any errors that can happen if the client is connected?
         // Yes... EAGAIN. Means the socket is now flow-controleld
         int theErr = OSThread::GetErrno();
+        if ((theErr == EAGAIN) && (fZeroCopySendsCompleted != fZeroCopySendsIssued))
+            (void)this->GetZeroCopySendsCompleted(); // or they keep waking us up
         if ((theErr != EAGAIN) && (this->IsConnected()))
             fState ^= kConnected;//turn off connected state flag
         return (OS_Error)theErr;
@@ -56,9 +56,13 @@ class Socket : public EventContext
             kNonBlockingSocketType = 1
         };
 
-        // This class provides a global event thread.
+        // This class provides the global event threads. Initialize creates the
+        // first one. AddEventThreads may add more (if the platform's event queue
+        // supports it) before StartThread starts them all; sockets are spread across
+        // them when they first request events.
         static void Initialize() { sEventThread = new EventThread(); }
-        static void StartThread() { sEventThread->Start(); }
+        static UInt32 AddEventThreads(UInt32 inNumToAdd);
+        static void StartThread();
         static EventThread* GetEventThread() { return sEventThread; }
         
         //Binds the socket to the following address.
@@ -89,6 +93,15 @@ class Socket : public EventContext
         //Returns: QTSS_FileNotOpen, QTSS_NoErr, or POSIX errorcode.
         OS_Error        WriteV(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLengthSent);
         
+        //WriteVZeroCopy: same as WriteV, but the kernel sends straight out of the
+        //caller's pages (MSG_ZEROCOPY) instead of copying them. The caller must not
+        //change or reuse that memory until GetZeroCopySendsCompleted() reaches the
+        //value GetZeroCopySendsIssued() had right after the call. On platforms or
+        //sockets that can't do this, it is WriteV and the count doesn't change.
+        OS_Error        WriteVZeroCopy(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLengthSent);
+        UInt32          GetZeroCopySendsIssued()    { return fZeroCopySendsIssued; }
+        UInt32          GetZeroCopySendsCompleted();
+        
         //You can query for the socket's state
         Bool16  IsConnected()   { return (Bool16) (fState & kConnected); }
         Bool16  IsBound()       { return (Bool16) (fState & kBound); }
@@ -148,9 +161,14 @@ class Socket : public EventContext
         enum
         {
             kBound      = 0x0004,
-            kConnected  = 0x0008
+            kConnected  = 0x0008,
+            kZeroCopy   = 0x0010,   // SO_ZEROCOPY is on
+            kNoZeroCopy = 0x0020    // SO_ZEROCOPY was refused
         };
         
+        UInt32          fZeroCopySendsIssued;
+        UInt32          fZeroCopySendsCompleted;
+        
         static EventThread* sEventThread;
         
 };
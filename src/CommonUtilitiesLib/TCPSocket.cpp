@@ -60,6 +60,11 @@ void TCPSocket::SnarfSocket( TCPSocket & fromSocket )
     ::memset( &remoteaddr, 0, sizeof( remoteaddr ) );
 
     fromSocket.Set( EventContext::kInvalidFileDesc, &remoteaddr );
+    
+    // zero copy sends in flight belong to the connection
+    fState |= fromSocket.fState & (kZeroCopy | kNoZeroCopy);
+    fZeroCopySendsIssued = fromSocket.fZeroCopySendsIssued;
+    fZeroCopySendsCompleted = fromSocket.fZeroCopySendsCompleted;
 
     // get the event context too
     this->SnarfEventContext( fromSocket );
@@ -42,7 +42,7 @@ OSMutexRW       TaskThreadPool::sMutexRW;
 static char* sTaskStateStr="live_"; //Alive
 
 Task::Task()
-:   fEvents(0), fUseThisThread(NULL), fWriteLock(false), fTimerHeapElem(), fTaskQueueElem()
+:   fEvents(0), fUseThisThread(NULL), fWriteLock(false), fTimerElem(), fTaskQueueElem(), fSignalTimeInUSecs(0)
 {
 #if DEBUG
     fInRunCount = 0;
@@ -50,7 +50,7 @@ Task::Task()
     this->SetTaskName("unknown");
 
 	fTaskQueueElem.SetEnclosingObject(this);
-	fTimerHeapElem.SetEnclosingObject(this);
+	fTimerElem.SetEnclosingObject(this);
 
 }
 
@@ -100,6 +100,8 @@ void Task::Signal(EventFlags events)
     EventFlags oldEvents = atomic_or(&fEvents, events);
     if ((!(oldEvents & kAlive)) && (TaskThreadPool::sNumTaskThreads > 0))
     {
+        fSignalTimeInUSecs = OS::Microseconds();
+        
         if (fUseThisThread != NULL)
             // Task needs to be placed on a particular thread.
          {
@@ -134,6 +136,13 @@ void    Task::GlobalUnlock()
 
 
 
+TaskThread::TaskThread()
+:   OSThread(), fTaskThreadPoolElem(), fStealIndex(0), fTimerWheel(OS::Milliseconds())
+{
+    fTaskThreadPoolElem.SetEnclosingObject(this);
+    ::memset(fDispatchLatencyHistogram, 0, sizeof(fDispatchLatencyHistogram));
+}
+
 void TaskThread::Entry()
 {
     Task* theTask = NULL;
@@ -191,8 +200,8 @@ void TaskThread::Entry()
                      
                     theTask->fUseThisThread = NULL;
                     
-                    if (NULL != fHeap.Remove(&theTask->fTimerHeapElem)) 
-                        qtss_printf("TaskThread::Entry task still in heap before delete\n");
+                    if (NULL != fTimerWheel.Remove(&theTask->fTimerElem)) 
+                        qtss_printf("TaskThread::Entry task still in timer wheel before delete\n");
                     
                     if (NULL != theTask->fTaskQueueElem.InQueue())
                         qtss_printf("TaskThread::Entry task still in queue before delete\n");
@@ -226,9 +235,9 @@ void TaskThread::Entry()
             {
                 //note that if we get here, we don't reset theTask, so it will get passed into
                 //WaitForTask
-                if (TASK_DEBUG) qtss_printf("TaskThread::Entry insert TaskName=%s in timer heap thread=%lu elem=%lu task=%ld timeout=%.2f\n", theTask->fTaskName,  (UInt32) this, (UInt32) &theTask->fTimerHeapElem,(SInt32) theTask, (float)theTimeout / (float) 1000);
-                theTask->fTimerHeapElem.SetValue(OS::Milliseconds() + theTimeout);
-                fHeap.Insert(&theTask->fTimerHeapElem);
+                if (TASK_DEBUG) qtss_printf("TaskThread::Entry insert TaskName=%s in timer wheel thread=%lu elem=%lu task=%ld timeout=%.2f\n", theTask->fTaskName,  (UInt32) this, (UInt32) &theTask->fTimerElem,(SInt32) theTask, (float)theTimeout / (float) 1000);
+                theTask->fTimerElem.SetValue(OS::Milliseconds() + theTimeout);
+                fTimerWheel.Insert(&theTask->fTimerElem);
                 (void)atomic_or(&theTask->fEvents, Task::kIdleEvent);
                 doneProcessingEvent = true;
             }
@@ -262,17 +271,32 @@ Task* TaskThread::WaitForTask()
     {
         SInt64 theCurrentTime = OS::Milliseconds();
         
-        if ((fHeap.PeekMin() != NULL) && (fHeap.PeekMin()->GetValue() <= theCurrentTime))
+        OSTimingWheelElem* theTimerElem = fTimerWheel.ExtractExpired(theCurrentTime);
+        if (theTimerElem != NULL)
         {    
-            if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask found timer-task=%s thread %lu fHeap.CurrentHeapSize(%lu) taskElem = %lu enclose=%lu\n",((Task*)fHeap.PeekMin()->GetEnclosingObject())->fTaskName, (UInt32) this, fHeap.CurrentHeapSize(), (UInt32) fHeap.PeekMin(), (UInt32) fHeap.PeekMin()->GetEnclosingObject());
-            return (Task*)fHeap.ExtractMin()->GetEnclosingObject();
+            if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask found timer-task=%s thread %lu fTimerWheel.GetNumElements(%lu) taskElem = %lu enclose=%lu\n",((Task*)theTimerElem->GetEnclosingObject())->fTaskName, (UInt32) this, fTimerWheel.GetNumElements(), (UInt32) theTimerElem, (UInt32) theTimerElem->GetEnclosingObject());
+            return (Task*)theTimerElem->GetEnclosingObject();
+        }
+        
+        //
+        // Nothing of our own is ready. Rather than go to sleep while another thread
+        // has tasks backed up behind a long Run(), take one of those.
+        if (fTaskQueue.GetQueue()->GetLength() == 0)
+        {
+            Task* theStolenTask = this->StealTask();
+            if (theStolenTask != NULL)
+            {
+                if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask stole task=%s thread %lu enclose=%lu\n", theStolenTask->fTaskName, (UInt32) this, (UInt32) theStolenTask);
+                this->RecordDispatchLatency(theStolenTask);
+                return theStolenTask;
+            }
         }
     
         //if there is an element waiting for a timeout, figure out how long we should wait.
         SInt64 theTimeout = 0;
-        if (fHeap.PeekMin() != NULL)
-            theTimeout = fHeap.PeekMin()->GetValue() - theCurrentTime;
-        Assert(theTimeout >= 0);
+        SInt64 theNextExpiration = fTimerWheel.GetNextExpiration();
+        if (theNextExpiration >= 0)
+            theTimeout = theNextExpiration - theCurrentTime;
         
         //
         // Make sure we can't go to sleep for some ridiculously short
@@ -287,7 +311,9 @@ Task* TaskThread::WaitForTask()
         if (theElem != NULL)
         {
             if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask found signal-task=%s thread %lu fTaskQueue.GetLength(%lu) taskElem = %lu enclose=%lu\n", ((Task*)theElem->GetEnclosingObject())->fTaskName,  (UInt32) this, fTaskQueue.GetQueue()->GetLength(), (UInt32)  theElem,  (UInt32)theElem->GetEnclosingObject() );
-            return (Task*)theElem->GetEnclosingObject();
+            Task* theTask = (Task*)theElem->GetEnclosingObject();
+            this->RecordDispatchLatency(theTask);
+            return theTask;
         }
 
         //
@@ -297,8 +323,70 @@ Task* TaskThread::WaitForTask()
     }   
 }
 
+Task* TaskThread::StealTask()
+{
+    UInt32 theNumThreads = TaskThreadPool::sNumTaskThreads;
+    if ((theNumThreads < 2) || this->IsStopRequested())
+        return NULL;
+    
+    for (UInt32 x = 0; x < theNumThreads; x++)
+    {
+        TaskThread* theVictim = TaskThreadPool::sTaskThreadArray[fStealIndex++ % theNumThreads];
+        if (theVictim == this)
+            continue;
+        
+        OSQueue* theQueue = theVictim->fTaskQueue.GetQueue();
+        if (theQueue->GetLength() == 0)
+            continue;
+            
+        //
+        // Never wait on another thread's queue: if its owner or a signaller has it,
+        // just move on to the next one.
+        if (!theVictim->fTaskQueue.GetMutex()->TryLock())
+            continue;
+        
+        //
+        // Take the most recently queued task. The owner is about to run the oldest
+        // one, and the newest is the one that would otherwise wait the longest.
+        // Skip tasks that have asked to run on that particular thread.
+        UInt32 theNumToExamine = theQueue->GetLength();
+        if (theNumToExamine > kMaxTasksToExamineForSteal)
+            theNumToExamine = kMaxTasksToExamineForSteal;
+            
+        OSQueueElem* theElem = theQueue->GetTail();
+        for (UInt32 y = 0; y < theNumToExamine; y++, theElem = theElem->Next())
+        {
+            Task* theTask = (Task*)theElem->GetEnclosingObject();
+            if (theTask->fUseThisThread == NULL)
+            {
+                theQueue->Remove(theElem);
+                theVictim->fTaskQueue.GetMutex()->Unlock();
+                return theTask;
+            }
+        }
+        
+        theVictim->fTaskQueue.GetMutex()->Unlock();
+    }
+    return NULL;
+}
+
+void TaskThread::RecordDispatchLatency(Task* inTask)
+{
+    SInt64 theLatency = OS::Microseconds() - inTask->fSignalTimeInUSecs;
+    
+    // Bucket n holds latencies in [2^n, 2^(n+1)) microseconds.
+    UInt32 theBucket = 0;
+    while ((theLatency > 1) && (theBucket < kNumLatencyBuckets - 1))
+    {
+        theLatency >>= 1;
+        theBucket++;
+    }
+    fDispatchLatencyHistogram[theBucket]++;
+}
+
 TaskThread** TaskThreadPool::sTaskThreadArray = NULL;
 UInt32       TaskThreadPool::sNumTaskThreads = 0;
+UInt32       TaskThreadPool::sLastDispatchLatencyHistogram[TaskThread::kNumLatencyBuckets];
 
 Bool16 TaskThreadPool::AddThreads(UInt32 numToAdd)
 {
@@ -333,3 +421,33 @@ void TaskThreadPool::RemoveThreads()
     
     sNumTaskThreads = 0;
 }
+
+UInt32 TaskThreadPool::GetDispatchLatencyP99InUSecs()
+{
+    UInt32 theDeltas[TaskThread::kNumLatencyBuckets];
+    UInt32 theTotal = 0;
+    
+    for (UInt32 theBucket = 0; theBucket < TaskThread::kNumLatencyBuckets; theBucket++)
+    {
+        UInt32 theCount = 0;
+        for (UInt32 x = 0; x < sNumTaskThreads; x++)
+            theCount += sTaskThreadArray[x]->fDispatchLatencyHistogram[theBucket];
+        
+        theDeltas[theBucket] = theCount - sLastDispatchLatencyHistogram[theBucket];
+        sLastDispatchLatencyHistogram[theBucket] = theCount;
+        theTotal += theDeltas[theBucket];
+    }
+    
+    if (theTotal == 0)
+        return 0;
+    
+    UInt32 theThreshold = theTotal - (theTotal / 100);
+    UInt32 theSum = 0;
+    for (UInt32 theBucket = 0; theBucket < TaskThread::kNumLatencyBuckets; theBucket++)
+    {
+        theSum += theDeltas[theBucket];
+        if ((theSum >= theThreshold) && (theBucket < TaskThread::kNumLatencyBuckets - 1))
+            return (UInt32)1 << (theBucket + 1);
+    }
+    return (UInt32)1 << (TaskThread::kNumLatencyBuckets - 1);
+}
@@ -46,7 +46,7 @@
 #define __TASK_H__
 
 #include "OSQueue.h"
-#include "OSHeap.h"
+#include "OSTimingWheel.h"
 #include "OSThread.h"
 #include "OSMutexRW.h"
 
@@ -143,11 +143,13 @@ class Task
         volatile UInt32 fInRunCount;
 #endif
 
-        //This could later be optimized by using a timing wheel instead of a heap,
-        //and that way we wouldn't need both a heap elem and a queue elem here (just queue elem)
-        OSHeapElem      fTimerHeapElem;
+        //For waiting in a TaskThread's timer wheel after Run returns > 0
+        OSTimingWheelElem   fTimerElem;
         OSQueueElem     fTaskQueueElem;
         
+        //When this task was last put on a task queue, for dispatch latency stats
+        SInt64          fSignalTimeInUSecs;
+        
         //Variable used for assigning tasks to threads in a round-robin fashion
         static unsigned int sThreadPicker;
         
@@ -160,23 +162,35 @@ class TaskThread : public OSThread
     
         //Implementation detail: all tasks get run on TaskThreads.
         
-                        TaskThread() :  OSThread(), fTaskThreadPoolElem()
-                                        {fTaskThreadPoolElem.SetEnclosingObject(this);}
+                        TaskThread();
 						virtual         ~TaskThread() { this->StopAndWaitForThread(); }
            
     private:
     
         enum
         {
-            kMinWaitTimeInMilSecs = 10  //UInt32
+            kMinWaitTimeInMilSecs = 10,     //UInt32
+            kMaxTasksToExamineForSteal = 8, //UInt32
+            kNumLatencyBuckets = 32         //UInt32, log2 microsecond buckets
         };
 
         virtual void    Entry();
         Task*           WaitForTask();
         
+        // Takes a task that is waiting on another thread's queue, or returns NULL.
+        // Tasks that asked for a specific thread (ForceSameThread / CallLocked)
+        // are never taken.
+        Task*           StealTask();
+        void            RecordDispatchLatency(Task* inTask);
+        
         OSQueueElem     fTaskThreadPoolElem;
+        UInt32          fStealIndex;
         
-        OSHeap              fHeap;
+        // Histogram of Signal-to-Run delays for tasks this thread dequeued. Only
+        // this thread writes it; TaskThreadPool reads it for the p99 stat.
+        UInt32          fDispatchLatencyHistogram[kNumLatencyBuckets];
+        
+        OSTimingWheel       fTimerWheel;
         OSQueue_Blocking    fTaskQueue;
         
         
@@ -187,6 +201,10 @@ class TaskThread : public OSThread
 //Because task threads share a global queue of tasks to execute,
 //there can only be one pool of task threads. That is why this object
 //is static.
+//
+//Signalled tasks are handed to the threads round-robin, and a thread that runs
+//out of work steals queued tasks from the others, so one slow Run() doesn't hold
+//up everything queued behind it.
 class TaskThreadPool {
 public:
 
@@ -195,11 +213,18 @@ public:
     static void     SwitchPersonality( char *user = NULL, char *group = NULL);
     static void     RemoveThreads();
     
+    //99th percentile of the time between a Task being signalled and its Run
+    //function being called, over all threads since the last call. This is the
+    //upper bound of a power-of-two bucket, so it is coarse. Not reentrant:
+    //meant to be called from a single periodic stats task.
+    static UInt32   GetDispatchLatencyP99InUSecs();
+    
 private:
 
     static TaskThread**     sTaskThreadArray;
     static UInt32           sNumTaskThreads;
     static OSMutexRW        sMutexRW;
+    static UInt32           sLastDispatchLatencyHistogram[TaskThread::kNumLatencyBuckets];
     
     friend class Task;
     friend class TaskThread;
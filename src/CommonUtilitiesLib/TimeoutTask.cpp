@@ -47,22 +47,20 @@ void TimeoutTask::Initialize()
 
 
 TimeoutTask::TimeoutTask(Task* inTask, SInt64 inTimeoutInMilSecs)
-: fTask(inTask), fQueueElem()
+: fTask(inTask), fWheelElem()
 {
-	fQueueElem.SetEnclosingObject(this);
-    this->SetTimeout(inTimeoutInMilSecs);
+	fWheelElem.SetEnclosingObject(this);
     if (NULL == inTask)
 		fTask = (Task *) this;
     Assert(sThread != NULL); // this can happen if RunServer intializes tasks in the wrong order
 
-    OSMutexLocker locker(&sThread->fMutex); 
-    sThread->fQueue.EnQueue(&fQueueElem);
+    this->SetTimeout(inTimeoutInMilSecs);
 }
 
 TimeoutTask::~TimeoutTask()
 {
     OSMutexLocker locker(&sThread->fMutex);
-    sThread->fQueue.Remove(&fQueueElem);
+    (void)sThread->fWheel.Remove(&fWheelElem);
 }
 
 void TimeoutTask::SetTimeout(SInt64 inTimeoutInMilSecs)
@@ -72,38 +70,61 @@ void TimeoutTask::SetTimeout(SInt64 inTimeoutInMilSecs)
         fTimeoutAtThisTime = 0;
     else
         fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs;
+    
+    //
+    // The new timeout may be sooner than the old one, so reschedule. A timeout
+    // of 0 (never) stays out of the wheel until it is given a real one.
+    OSMutexLocker locker(&sThread->fMutex);
+    (void)sThread->fWheel.Remove(&fWheelElem);
+    if (fTimeoutAtThisTime > 0)
+    {
+        fWheelElem.SetValue(fTimeoutAtThisTime);
+        sThread->fWheel.Insert(&fWheelElem);
+    }
 }
 
 SInt64 TimeoutTaskThread::Run()
 {
-    //ok, check for timeouts now. Go through the whole queue
+    //ok, check for timeouts now. Only the ones the wheel says are due need looking at
     OSMutexLocker locker(&fMutex);
     SInt64 curTime = OS::Milliseconds();
-	SInt64 intervalMilli = kIntervalSeconds * 1000;//always default to 60 seconds but adjust to smallest interval > 0
-	SInt64 taskInterval = intervalMilli;
+	SInt64 intervalMilli = kIntervalSeconds * 1000;//always default to 60 seconds but adjust to the next timeout in the wheel
 	
-    for (OSQueueIter iter(&fQueue); !iter.IsDone(); iter.Next())
+    for (OSTimingWheelElem* theElem = fWheel.ExtractExpired(curTime); theElem != NULL; theElem = fWheel.ExtractExpired(curTime))
     {
-        TimeoutTask* theTimeoutTask = (TimeoutTask*)iter.GetCurrent()->GetEnclosingObject();
+        TimeoutTask* theTimeoutTask = (TimeoutTask*)theElem->GetEnclosingObject();
         
         //if it's time to time this task out, signal it
-        if ((theTimeoutTask->fTimeoutAtThisTime > 0) && (curTime >= theTimeoutTask->fTimeoutAtThisTime))
+        if (curTime >= theTimeoutTask->fTimeoutAtThisTime)
         {
 #if TIMEOUT_DEBUGGING
             qtss_printf("TimeoutTask %ld timed out. Curtime = %I64d, timeout time = %I64d\n",(SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
 #endif
 			theTimeoutTask->fTask->Signal(Task::kTimeoutEvent);
+			
+			//Keep reminding it, as the old full scan did, until it is refreshed or goes away
+			SInt64 theReminderInterval = theTimeoutTask->fTimeoutInMilSecs;
+			if (theReminderInterval > kIntervalSeconds * 1000)
+			    theReminderInterval = kIntervalSeconds * 1000;
+			theElem->SetValue(curTime + theReminderInterval);
 		}
 		else
 		{
-			taskInterval = theTimeoutTask->fTimeoutAtThisTime - curTime;
-			if ( (taskInterval > 0) && (theTimeoutTask->fTimeoutInMilSecs > 0) && (intervalMilli > taskInterval) )
-				intervalMilli = taskInterval + 1000; // set timeout to 1 second past this task's timeout
+		    //refreshed since it went in. Put it back for its new time.
+			theElem->SetValue(theTimeoutTask->fTimeoutAtThisTime);
 #if TIMEOUT_DEBUGGING
 			qtss_printf("TimeoutTask %ld not being timed out. Curtime = %I64d. timeout time = %I64d\n", (SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
 #endif
 		}
+		
+		//Both times are after curTime, so ExtractExpired won't hand it straight back
+		fWheel.Insert(theElem);
 	}
+	
+	SInt64 theNextExpiration = fWheel.GetNextExpiration();
+	if ((theNextExpiration >= 0) && (theNextExpiration - curTime < intervalMilli))
+	    intervalMilli = theNextExpiration - curTime + 1000; // set timeout to 1 second past the next timeout
+	    
 	(void)this->GetEvents();//we must clear the event mask!
 	
 	OSThread::ThreadYield();
@@ -30,6 +30,11 @@
                 overhead for maintaining the timing information, this is a low overhead,
                 low priority timing mechanism. Timeouts may not happen exactly when
                 they are supposed to, but who cares?
+                
+                Timeouts sit in a timing wheel at the time they were last known to
+                expire. RefreshTimeout only bumps that time, so it stays cheap; when
+                the wheel hands back a timeout that has been refreshed in the meantime,
+                it is simply put back in for its new time.
                     
     
     
@@ -44,7 +49,7 @@
 #include "IdleTask.h"
 
 #include "OSThread.h"
-#include "OSQueue.h"
+#include "OSTimingWheel.h"
 #include "OSMutex.h"
 #include "OS.h"
 
@@ -55,7 +60,7 @@ class TimeoutTaskThread : public IdleTask
     public:
     
         //All timeout tasks get timed out from this thread
-                    TimeoutTaskThread() : IdleTask(), fMutex() {this->SetTaskName("TimeoutTask");}
+                    TimeoutTaskThread() : IdleTask(), fMutex(), fWheel(OS::Milliseconds()) {this->SetTaskName("TimeoutTask");}
         virtual     ~TimeoutTaskThread(){}
 
     private:
@@ -68,7 +73,7 @@ class TimeoutTaskThread : public IdleTask
 
         virtual SInt64          Run();
         OSMutex                 fMutex;
-        OSQueue                 fQueue;
+        OSTimingWheel           fWheel;
         
         friend class TimeoutTask;
 };
@@ -102,8 +107,8 @@ class TimeoutTask
         Task*       fTask;
         SInt64      fTimeoutAtThisTime;
         SInt64      fTimeoutInMilSecs;
-        //for putting on our global queue of timeout tasks
-        OSQueueElem fQueueElem;
+        //for putting in the global timing wheel of timeout tasks
+        OSTimingWheelElem fWheelElem;
         
         static TimeoutTaskThread*   sThread;
         
@@ -56,8 +56,248 @@
 #include <netlog.h>
 #endif
 
+#if UDPSENDBATCHING
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 //from linux/udp.h, for C libraries that predate it
+#endif
+
+enum
+{
+    kMaxBatchPackets = 64,          //UInt32
+    kMaxBatchPieces = kMaxBatchPackets * 4, //UInt32
+    kBatchBufferSize = 64 * 1024,   //UInt32
+    kMaxGSOSegments = 64,           //UInt32. UDP_MAX_SEGMENTS in the kernel
+    kMaxGSOBytes = 65000            //UInt32. must fit in one IP datagram
+};
+
+//
+// One of these per thread. Each packet is any number of pieces, some copied
+// into fBuffer and some left in the caller's memory.
+// Pieces are kept in packet order, so a run of packets that can go out as one
+// GSO send is a contiguous run of fPieces.
+struct UDPSendBatch
+{
+    UInt32              fDepth;
+    int                 fFileDesc;
+    UInt32              fNumPackets;
+    UInt32              fNumPieces;
+    UInt32              fBytesUsed;
+    UInt32              fLengths[kMaxBatchPackets];
+    UInt32              fFirstPiece[kMaxBatchPackets + 1];  //fFirstPiece[fNumPackets] == fNumPieces
+    struct sockaddr_in  fAddrs[kMaxBatchPackets];
+    struct iovec        fPieces[kMaxBatchPieces];
+    UInt32              fFirstPacket[kMaxBatchPackets];     //per message
+    UInt32              fNumSegments[kMaxBatchPackets];     //per message
+    struct mmsghdr      fMsgs[kMaxBatchPackets];
+    char                fControl[kMaxBatchPackets][CMSG_SPACE(sizeof(UInt16))];
+    char                fBuffer[kBatchBufferSize];
+};
+
+static UInt32           sMaxPacketsPerBatch = kMaxBatchPackets;
+static Bool16           sUseGSO = false;
+static pthread_key_t    sSendBatchKey;
+static pthread_once_t   sSendBatchKeyOnce = PTHREAD_ONCE_INIT;
+
+static void DeleteSendBatch(void* inBatch)
+{
+    delete (UDPSendBatch*)inBatch;
+}
+
+static void MakeSendBatchKey()
+{
+    (void)::pthread_key_create(&sSendBatchKey, DeleteSendBatch);
+}
+
+static UDPSendBatch* GetSendBatch()
+{
+    (void)::pthread_once(&sSendBatchKeyOnce, MakeSendBatchKey);
+    return (UDPSendBatch*)::pthread_getspecific(sSendBatchKey);
+}
+
+static Bool16 SameDestination(struct sockaddr_in* inAddr1, struct sockaddr_in* inAddr2)
+{
+    return (inAddr1->sin_addr.s_addr == inAddr2->sin_addr.s_addr) && (inAddr1->sin_port == inAddr2->sin_port);
+}
+
+static void FlushSendBatch(UDPSendBatch* inBatch)
+{
+    //
+    // Build one message per packet, or per run of packets that can go out as a
+    // single GSO send: same destination, all the same size except possibly the last.
+    UInt32 theNumMsgs = 0;
+    inBatch->fFirstPiece[inBatch->fNumPackets] = inBatch->fNumPieces;
+    for (UInt32 x = 0; x < inBatch->fNumPackets; theNumMsgs++)
+    {
+        UInt32 theSegmentSize = inBatch->fLengths[x];
+        UInt32 theNumSegments = 1;
+        UInt32 theRunBytes = theSegmentSize;
+        
+        if (sUseGSO)
+        {
+            while ((x + theNumSegments < inBatch->fNumPackets) && (theNumSegments < kMaxGSOSegments))
+            {
+                UInt32 theNextLength = inBatch->fLengths[x + theNumSegments];
+                if ((theNextLength > theSegmentSize) || (theRunBytes + theNextLength > kMaxGSOBytes) ||
+                    !SameDestination(&inBatch->fAddrs[x], &inBatch->fAddrs[x + theNumSegments]))
+                    break;
+                    
+                theRunBytes += theNextLength;
+                theNumSegments++;
+                if (theNextLength < theSegmentSize)
+                    break; //a short segment has to be the last one
+            }
+        }
+        
+        struct msghdr* theMsg = &inBatch->fMsgs[theNumMsgs].msg_hdr;
+        ::memset(theMsg, 0, sizeof(struct msghdr));
+        theMsg->msg_name = &inBatch->fAddrs[x];
+        theMsg->msg_namelen = sizeof(struct sockaddr_in);
+        theMsg->msg_iov = &inBatch->fPieces[inBatch->fFirstPiece[x]];
+        theMsg->msg_iovlen = inBatch->fFirstPiece[x + theNumSegments] - inBatch->fFirstPiece[x];
+        
+        if (theNumSegments > 1)
+        {
+            theMsg->msg_control = inBatch->fControl[theNumMsgs];
+            theMsg->msg_controllen = CMSG_SPACE(sizeof(UInt16));
+            struct cmsghdr* theCmsg = CMSG_FIRSTHDR(theMsg);
+            theCmsg->cmsg_level = SOL_UDP;
+            theCmsg->cmsg_type = UDP_SEGMENT;
+            theCmsg->cmsg_len = CMSG_LEN(sizeof(UInt16));
+            *(UInt16*)CMSG_DATA(theCmsg) = (UInt16)theSegmentSize;
+        }
+        inBatch->fFirstPacket[theNumMsgs] = x;
+        inBatch->fNumSegments[theNumMsgs] = theNumSegments;
+        
+        x += theNumSegments;
+    }
+    
+    UInt32 theNumSent = 0;
+    while (theNumSent < theNumMsgs)
+    {
+        int theResult = ::sendmmsg(inBatch->fFileDesc, &inBatch->fMsgs[theNumSent], theNumMsgs - theNumSent, 0);
+        if (theResult > 0)
+        {
+            theNumSent += theResult;
+            continue;
+        }
+        
+        //
+        // The message at theNumSent failed. If it was a GSO send that the kernel or
+        // device can't do, stop using GSO and send its packets one at a time.
+        // Otherwise drop it, just as callers of SendTo drop failed sends.
+        int theErr = OSThread::GetErrno();
+        struct msghdr* theMsg = &inBatch->fMsgs[theNumSent].msg_hdr;
+        if ((inBatch->fNumSegments[theNumSent] > 1) &&
+            ((theErr == EIO) || (theErr == EINVAL) || (theErr == ENOPROTOOPT) || (theErr == EOPNOTSUPP)))
+        {
+            sUseGSO = false;
+            
+            UInt32 theFirstPacket = inBatch->fFirstPacket[theNumSent];
+            for (UInt32 y = theFirstPacket; y < theFirstPacket + inBatch->fNumSegments[theNumSent]; y++)
+            {
+                theMsg->msg_iov = &inBatch->fPieces[inBatch->fFirstPiece[y]];
+                theMsg->msg_iovlen = inBatch->fFirstPiece[y + 1] - inBatch->fFirstPiece[y];
+                theMsg->msg_control = NULL;
+                theMsg->msg_controllen = 0;
+                (void)::sendmsg(inBatch->fFileDesc, theMsg, 0);
+            }
+        }
+        theNumSent++;
+    }
+    
+    inBatch->fNumPackets = 0;
+    inBatch->fNumPieces = 0;
+    inBatch->fBytesUsed = 0;
+}
+
+//
+// Adds a packet made of the inNumPieces pieces at inPieces. Pieces that lie
+// within the inCopyLength bytes at inCopy are copied into the batch; the rest
+// are left where they are. Returns false if batching is off, in which case the
+// caller sends the packet itself.
+static Bool16 AddToSendBatch(int inFileDesc, UInt32 inRemoteAddr, UInt16 inRemotePort,
+                            const struct iovec* inPieces, UInt32 inNumPieces, const char* inCopy, UInt32 inCopyLength)
+{
+    UDPSendBatch* theBatch = GetSendBatch();
+    if ((theBatch == NULL) || (theBatch->fDepth == 0) || (sMaxPacketsPerBatch <= 1) ||
+        (inCopyLength > kBatchBufferSize) || (inNumPieces > kMaxBatchPieces))
+        return false;
+        
+    if ((theBatch->fNumPackets > 0) &&
+        ((theBatch->fFileDesc != inFileDesc) || (theBatch->fNumPackets >= sMaxPacketsPerBatch) ||
+        (theBatch->fBytesUsed + inCopyLength > kBatchBufferSize) || (theBatch->fNumPieces + inNumPieces > kMaxBatchPieces)))
+        FlushSendBatch(theBatch);
+    
+    UInt32 theIndex = theBatch->fNumPackets++;
+    theBatch->fFileDesc = inFileDesc;
+    theBatch->fLengths[theIndex] = 0;
+    theBatch->fFirstPiece[theIndex] = theBatch->fNumPieces;
+    theBatch->fAddrs[theIndex].sin_family = AF_INET;
+    theBatch->fAddrs[theIndex].sin_port = htons(inRemotePort);
+    theBatch->fAddrs[theIndex].sin_addr.s_addr = htonl(inRemoteAddr);
+    
+    Bool16 theLastPieceWasCopied = false;
+    for (UInt32 x = 0; x < inNumPieces; x++)
+    {
+        char* thePiece = (char*)inPieces[x].iov_base;
+        UInt32 thePieceLength = inPieces[x].iov_len;
+        if (thePieceLength == 0)
+            continue;
+        theBatch->fLengths[theIndex] += thePieceLength;
+        
+        if ((thePiece < inCopy) || (thePiece + thePieceLength > inCopy + inCopyLength))
+        {
+            theBatch->fPieces[theBatch->fNumPieces].iov_base = thePiece;
+            theBatch->fPieces[theBatch->fNumPieces].iov_len = thePieceLength;
+            theBatch->fNumPieces++;
+            theLastPieceWasCopied = false;
+            continue;
+        }
+        
+        //
+        // The caller may reuse its buffer before the flush, so take a copy. Copies
+        // in a row are contiguous in fBuffer, so they make one piece.
+        Assert(theBatch->fBytesUsed + thePieceLength <= kBatchBufferSize);
+        ::memcpy(&theBatch->fBuffer[theBatch->fBytesUsed], thePiece, thePieceLength);
+        if (theLastPieceWasCopied)
+            theBatch->fPieces[theBatch->fNumPieces - 1].iov_len += thePieceLength;
+        else
+        {
+            theBatch->fPieces[theBatch->fNumPieces].iov_base = &theBatch->fBuffer[theBatch->fBytesUsed];
+            theBatch->fPieces[theBatch->fNumPieces].iov_len = thePieceLength;
+            theBatch->fNumPieces++;
+        }
+        theBatch->fBytesUsed += thePieceLength;
+        theLastPieceWasCopied = true;
+    }
+    return true;
+}
+#endif //UDPSENDBATCHING
+
+#if UDPRECVBATCHING
+#include <time.h>
+#include <sys/time.h>
+#include "OS.h"
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40 //from asm-generic/socket.h, for C libraries that predate it
+#endif
+
+enum
+{
+    kMaxRecvBatch = 32  //UInt32. datagrams per recvmmsg
+};
+#endif //UDPRECVBATCHING
+
 UDPSocket::UDPSocket(Task* inTask, UInt32 inSocketType)
-: Socket(inTask, inSocketType), fDemuxer(NULL)
+: Socket(inTask, inSocketType), fDemuxer(NULL), fNumKernelDrops(0)
 {
     if (inSocketType & kWantsDemuxer)
         fDemuxer = NEW UDPDemuxer();
@@ -89,6 +329,109 @@ UDPSocket::SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt
     return OS_NoErr;
 }
 
+OS_Error UDPSocket::SendToV(UInt32 inRemoteAddr, UInt16 inRemotePort, const struct iovec* inVec, UInt32 inNumVectors)
+{
+    Assert(inVec != NULL);
+    
+    struct sockaddr_in  theRemoteAddr;
+    theRemoteAddr.sin_family = AF_INET;
+    theRemoteAddr.sin_port = htons(inRemotePort);
+    theRemoteAddr.sin_addr.s_addr = htonl(inRemoteAddr);
+
+#ifdef __Win32__
+    DWORD theBytesSent = 0;
+    int theErr = ::WSASendTo(fFileDesc, (LPWSABUF)inVec, inNumVectors, &theBytesSent, 0, (sockaddr*)&theRemoteAddr, sizeof(theRemoteAddr), NULL, NULL);
+#else
+    struct msghdr theMsg;
+    ::memset(&theMsg, 0, sizeof(theMsg));
+    theMsg.msg_name = (void*)&theRemoteAddr;
+    theMsg.msg_namelen = sizeof(theRemoteAddr);
+    theMsg.msg_iov = (struct iovec*)inVec;
+    theMsg.msg_iovlen = inNumVectors;
+    int theErr = ::sendmsg(fFileDesc, &theMsg, 0);
+#endif
+
+    if (theErr == -1)
+        return (OS_Error)OSThread::GetErrno();
+    return OS_NoErr;
+}
+
+void UDPSocket::SendToBatched(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt32 inLength)
+{
+#if UDPSENDBATCHING
+    struct iovec theVec;
+    theVec.iov_base = (char*)inBuffer;
+    theVec.iov_len = inLength;
+    if (AddToSendBatch(fFileDesc, inRemoteAddr, inRemotePort, &theVec, 1, (char*)inBuffer, inLength))
+        return;
+#endif
+    (void)this->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+}
+
+void UDPSocket::SendToBatched(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                void* inHeader, UInt32 inHeaderLength, void* inPayload, UInt32 inPayloadLength)
+{
+    struct iovec theVec[2];
+    theVec[0].iov_base = (char*)inHeader;
+    theVec[0].iov_len = inHeaderLength;
+    theVec[1].iov_base = (char*)inPayload;
+    theVec[1].iov_len = inPayloadLength;
+#if UDPSENDBATCHING
+    if (AddToSendBatch(fFileDesc, inRemoteAddr, inRemotePort, theVec, 2, (char*)inHeader, inHeaderLength))
+        return;
+#endif
+    (void)this->SendToV(inRemoteAddr, inRemotePort, theVec, 2);
+}
+
+void UDPSocket::SendToBatchedV(UInt32 inRemoteAddr, UInt16 inRemotePort, const struct iovec* inVec, UInt32 inNumVectors,
+                                void* inBuffer, UInt32 inBufferLength)
+{
+    Assert(inNumVectors > 0);
+#if UDPSENDBATCHING
+    if (AddToSendBatch(fFileDesc, inRemoteAddr, inRemotePort, inVec, inNumVectors, (char*)inBuffer, inBufferLength))
+        return;
+#endif
+    (void)this->SendToV(inRemoteAddr, inRemotePort, inVec, inNumVectors);
+}
+
+void UDPSocket::BeginSendBatch()
+{
+#if UDPSENDBATCHING
+    UDPSendBatch* theBatch = GetSendBatch();
+    if (theBatch == NULL)
+    {
+        theBatch = NEW UDPSendBatch;
+        ::memset(theBatch, 0, sizeof(UDPSendBatch));
+        (void)::pthread_setspecific(sSendBatchKey, theBatch);
+    }
+    theBatch->fDepth++;
+#endif
+}
+
+void UDPSocket::EndSendBatch()
+{
+#if UDPSENDBATCHING
+    UDPSendBatch* theBatch = GetSendBatch();
+    Assert((theBatch != NULL) && (theBatch->fDepth > 0));
+    if ((theBatch == NULL) || (theBatch->fDepth == 0))
+        return;
+        
+    theBatch->fDepth--;
+    if ((theBatch->fDepth == 0) && (theBatch->fNumPackets > 0))
+        FlushSendBatch(theBatch);
+#endif
+}
+
+void UDPSocket::SetSendBatchParams(UInt32 inMaxPacketsPerBatch, Bool16 inUseGSO)
+{
+#if UDPSENDBATCHING
+    if (inMaxPacketsPerBatch > kMaxBatchPackets)
+        inMaxPacketsPerBatch = kMaxBatchPackets;
+    sMaxPacketsPerBatch = inMaxPacketsPerBatch;
+    sUseGSO = inUseGSO;
+#endif
+}
+
 OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
                             void* ioBuffer, UInt32 inBufLen, UInt32* outRecvLen)
 {
@@ -119,6 +462,119 @@ OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
     return OS_NoErr;        
 }
 
+OS_Error UDPSocket::RecvFromMany(void** ioBuffers, UInt32 inBufLen, UInt32 inNumBuffers,
+                                UDPRecvInfo* outInfo, UInt32* outNumReceived)
+{
+    Assert(ioBuffers != NULL);
+    Assert(outInfo != NULL);
+    Assert(outNumReceived != NULL);
+    *outNumReceived = 0;
+    
+#if UDPRECVBATCHING
+    if (inNumBuffers > kMaxRecvBatch)
+        inNumBuffers = kMaxRecvBatch;
+        
+    struct mmsghdr      theMsgs[kMaxRecvBatch];
+    struct iovec        theIOVecs[kMaxRecvBatch];
+    struct sockaddr_in  theAddrs[kMaxRecvBatch];
+    char                theControl[kMaxRecvBatch][CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(UInt32))];
+    
+    ::memset(theMsgs, 0, sizeof(struct mmsghdr) * inNumBuffers);
+    for (UInt32 x = 0; x < inNumBuffers; x++)
+    {
+        theIOVecs[x].iov_base = ioBuffers[x];
+        theIOVecs[x].iov_len = inBufLen;
+        theMsgs[x].msg_hdr.msg_name = &theAddrs[x];
+        theMsgs[x].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        theMsgs[x].msg_hdr.msg_iov = &theIOVecs[x];
+        theMsgs[x].msg_hdr.msg_iovlen = 1;
+        theMsgs[x].msg_hdr.msg_control = theControl[x];
+        theMsgs[x].msg_hdr.msg_controllen = sizeof(theControl[x]);
+    }
+    
+    int theResult = ::recvmmsg(fFileDesc, theMsgs, inNumBuffers, MSG_DONTWAIT, NULL);
+    if (theResult <= 0)
+        return (theResult == 0) ? (OS_Error)EAGAIN : (OS_Error)OSThread::GetErrno();
+    
+    //
+    // Kernel timestamps are wall clock time. OS::Milliseconds() is offset from that
+    // by however far ::time() was from ::gettimeofday() when the server started, so
+    // turn each timestamp into an age and subtract that from OS::Milliseconds().
+    SInt64 theNowInMilSecs = OS::Milliseconds();
+    struct timeval theWallClock;
+    (void)::gettimeofday(&theWallClock, NULL);
+    SInt64 theWallClockInMilSecs = ((SInt64)theWallClock.tv_sec * 1000) + (theWallClock.tv_usec / 1000);
+    
+    for (int y = 0; y < theResult; y++)
+    {
+        struct msghdr* theMsg = &theMsgs[y].msg_hdr;
+        outInfo[y].fRecvLen = theMsgs[y].msg_len;
+        outInfo[y].fRemoteAddr = ntohl(theAddrs[y].sin_addr.s_addr);
+        outInfo[y].fRemotePort = ntohs(theAddrs[y].sin_port);
+        outInfo[y].fTruncated = (theMsg->msg_flags & MSG_TRUNC) != 0;
+        outInfo[y].fArrivalTimeInMilSecs = 0;
+        
+        for (struct cmsghdr* theCmsg = CMSG_FIRSTHDR(theMsg); theCmsg != NULL; theCmsg = CMSG_NXTHDR(theMsg, theCmsg))
+        {
+            if (theCmsg->cmsg_level != SOL_SOCKET)
+                continue;
+            if (theCmsg->cmsg_type == SO_TIMESTAMPNS)
+            {
+                struct timespec* theTime = (struct timespec*)CMSG_DATA(theCmsg);
+                SInt64 theAge = theWallClockInMilSecs - (((SInt64)theTime->tv_sec * 1000) + (theTime->tv_nsec / 1000000));
+                if (theAge < 0)
+                    theAge = 0; //the wall clock was stepped back
+                outInfo[y].fArrivalTimeInMilSecs = theNowInMilSecs - theAge;
+            }
+            else if (theCmsg->cmsg_type == SO_RXQ_OVFL)
+                fNumKernelDrops = *(UInt32*)CMSG_DATA(theCmsg);
+        }
+    }
+    *outNumReceived = (UInt32)theResult;
+    return OS_NoErr;
+#else
+    OS_Error theErr = OS_NoErr;
+    for ( ; *outNumReceived < inNumBuffers; (*outNumReceived)++)
+    {
+        UDPRecvInfo* theInfo = &outInfo[*outNumReceived];
+        theErr = this->RecvFrom(&theInfo->fRemoteAddr, &theInfo->fRemotePort, ioBuffers[*outNumReceived], inBufLen, &theInfo->fRecvLen);
+        if (theErr != OS_NoErr)
+            break;
+        theInfo->fTruncated = false;
+        theInfo->fArrivalTimeInMilSecs = 0;
+    }
+    if (*outNumReceived > 0)
+        return OS_NoErr;
+    return theErr;
+#endif
+}
+
+OS_Error UDPSocket::EnableReceiveTimestamps()
+{
+#if UDPRECVBATCHING
+    int theOn = 1;
+    int err = ::setsockopt(fFileDesc, SOL_SOCKET, SO_TIMESTAMPNS, (char*)&theOn, sizeof(theOn));
+    if (err == -1)
+        return (OS_Error)OSThread::GetErrno();
+    return OS_NoErr;
+#else
+    return (OS_Error)ENOPROTOOPT;
+#endif
+}
+
+OS_Error UDPSocket::EnableDropCounting()
+{
+#if UDPRECVBATCHING
+    int theOn = 1;
+    int err = ::setsockopt(fFileDesc, SOL_SOCKET, SO_RXQ_OVFL, (char*)&theOn, sizeof(theOn));
+    if (err == -1)
+        return (OS_Error)OSThread::GetErrno();
+    return OS_NoErr;
+#else
+    return (OS_Error)ENOPROTOOPT;
+#endif
+}
+
 OS_Error UDPSocket::JoinMulticast(UInt32 inRemoteAddr)
 {
     struct ip_mreq  theMulti;
@@ -26,6 +26,15 @@
     File:       UDPSocket.h
 
     Contains:   Adds additional Socket functionality specific to UDP.
+    
+                On platforms that define UDPSENDBATCHING, packets sent with
+                SendToBatched while a send batch is open on the calling thread are
+                collected and sent with sendmmsg when the batch is closed. This is
+                what keeps a fan-out of one packet to thousands of clients from
+                costing one system call per client.
+                
+                Likewise, RecvFromMany reads a burst of datagrams with one recvmmsg
+                on platforms that define UDPRECVBATCHING.
 
     
     
@@ -44,6 +53,15 @@
 #include "Socket.h"
 #include "UDPDemuxer.h"
 
+//What RecvFromMany found out about each datagram it read
+struct UDPRecvInfo
+{
+    UInt32  fRecvLen;
+    UInt32  fRemoteAddr;
+    UInt16  fRemotePort;
+    Bool16  fTruncated;             //the datagram was bigger than the buffer
+    SInt64  fArrivalTimeInMilSecs;  //kernel receive time in OS::Milliseconds() terms, or 0 if unknown
+};
 
 class   UDPSocket : public Socket
 {
@@ -70,10 +88,65 @@ class   UDPSocket : public Socket
         //returns an ERRNO
         OS_Error        SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                     void* inBuffer, UInt32 inLength);
+        
+        //Gathers the vectors into one datagram. returns an ERRNO
+        OS_Error        SendToV(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                    const struct iovec* inVec, UInt32 inNumVectors);
+                                    
+        //Like SendTo, but if a send batch is open on this thread the packet is
+        //copied into the batch and goes out when the batch is flushed. Any error
+        //from the eventual send is dropped, so only use this where the result of
+        //SendTo would be ignored anyway.
+        void            SendToBatched(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                    void* inBuffer, UInt32 inLength);
+        
+        //Sends inHeader followed by inPayload as one datagram. Only the header is
+        //copied into the batch; the payload is gathered straight from the caller's
+        //memory when the batch is flushed, so it must stay valid and unchanged
+        //until then. This lets a payload shared by many destinations be batched
+        //without a copy per destination.
+        void            SendToBatched(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                    void* inHeader, UInt32 inHeaderLength,
+                                    void* inPayload, UInt32 inPayloadLength);
+        
+        //The same for a packet in any number of pieces. Pieces that lie within
+        //inBuffer are copied into the batch, since the caller is free to reuse it.
+        //The rest are gathered from the caller's memory when the batch is flushed.
+        void            SendToBatchedV(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                    const struct iovec* inVec, UInt32 inNumVectors,
+                                    void* inBuffer, UInt32 inBufferLength);
+        
+        //Batches nest; the outermost EndSendBatch flushes. A batch is also flushed
+        //when it fills up, or when a packet for a different socket is added to it.
+        //The caller must keep every socket it sends on open until the flush.
+        static void     BeginSendBatch();
+        static void     EndSendBatch();
+        
+        //An inMaxPacketsPerBatch of 0 or 1 turns batching off. If inUseGSO is true,
+        //a run of equal sized packets to the same destination goes out as a single
+        //UDP GSO (UDP_SEGMENT) send. GSO turns itself off if the kernel rejects it.
+        static void     SetSendBatchParams(UInt32 inMaxPacketsPerBatch, Bool16 inUseGSO);
                         
         OS_Error        RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
                                         void* ioBuffer, UInt32 inBufLen, UInt32* outRecvLen);
         
+        //Reads up to inNumBuffers datagrams, one into each of ioBuffers, and
+        //describes datagram x in outInfo[x]. Returns an ERRNO (EAGAIN when nothing
+        //was waiting) only if no datagram was read. Fewer than inNumBuffers
+        //datagrams read means the socket has been drained.
+        OS_Error        RecvFromMany(void** ioBuffers, UInt32 inBufLen, UInt32 inNumBuffers,
+                                        UDPRecvInfo* outInfo, UInt32* outNumReceived);
+        
+        //Ask the kernel to stamp each datagram with its arrival time (SO_TIMESTAMPNS)
+        //and to count datagrams it drops because the receive buffer is full
+        //(SO_RXQ_OVFL). Both show up through RecvFromMany. Return an ERRNO.
+        OS_Error        EnableReceiveTimestamps();
+        OS_Error        EnableDropCounting();
+        
+        //Datagrams the kernel has dropped on this socket, as of the last RecvFromMany.
+        //Always 0 unless EnableDropCounting succeeded.
+        UInt32          GetNumKernelDrops() { return fNumKernelDrops; }
+        
         //A UDP socket may or may not have a demuxer associated with it. The demuxer
         //is a data structure so the socket can associate incoming data with the proper
         //task to process that data (based on source IP addr & port)
@@ -83,6 +156,17 @@ class   UDPSocket : public Socket
     
         UDPDemuxer* fDemuxer;
         struct sockaddr_in  fMsgAddr;
+        UInt32      fNumKernelDrops;
+};
+
+//Opens a send batch for the life of the object, the way OSMutexLocker holds a
+//mutex. Declare it after any locker that keeps the target sockets alive, so
+//the batch is flushed before that lock is released.
+class UDPSendBatcher
+{
+    public:
+        UDPSendBatcher()    { UDPSocket::BeginSendBatch(); }
+        ~UDPSendBatcher()   { UDPSocket::EndSendBatch(); }
 };
 #endif // __UDPSOCKET_H__
 
@@ -51,6 +51,17 @@ unsigned int atomic_or(unsigned int *area, unsigned int val)
     return oldval;
 }
 
+void memory_barrier()
+{
+#if defined(__GNUC__)
+    __sync_synchronize();
+#elif __Win32__
+    MemoryBarrier();
+#else
+    OSMutexLocker locker(&sAtomicMutex); //taking a lock is a full fence
+#endif
+}
+
 unsigned int compare_and_store(unsigned int oval, unsigned int nval, unsigned int *area)
 {
    int rv;
@@ -81,6 +81,9 @@ extern unsigned int atomic_or(unsigned int *area, unsigned int mask);
 
 extern unsigned int atomic_sub(unsigned int *area, int val);
 
+/* Full memory fence: no load or store moves across it */
+extern void memory_barrier(void);
+
 extern void queue_atomic(unsigned int *anchor,
                     unsigned int *elem, unsigned int disp);
 
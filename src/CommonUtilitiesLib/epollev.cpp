@@ -0,0 +1,273 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       epollev.cpp
+
+    Contains:   Linux epoll implementation of MacOS X event queue functions.
+                Drop-in replacement for the select() shim in ev.cpp: same API,
+                same one-shot semantics (an fd delivers one event and is then
+                disarmed until select_modwatch is called again), but with no
+                FD_SETSIZE ceiling and no O(maxfd) scan per wakeup.
+                
+                Several independent queues can be created so that more than one
+                EventThread can wait for events; queue 0 backs the classic API.
+
+
+*/
+
+#include "ev.h"
+
+#if EPOLLEVENTQUEUE
+
+#define EV_DEBUGGING 0 //Enables a lot of printfs
+
+//
+// When set, descriptors are registered edge-triggered (EPOLLET). Because every
+// registration is also EPOLLONESHOT and re-armed through EPOLL_CTL_MOD, the kernel
+// re-checks readiness on each modwatch, so a reader that stops before EAGAIN
+// does not lose its wakeup.
+#define EV_EDGE_TRIGGERED 1
+
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "OS.h"
+#include "OSHeaders.h"
+#include "MyAssert.h"
+#include "OSThread.h"
+
+enum
+{
+    kMaxEventsPerWait = 256,    // epoll_event slots harvested per epoll_wait
+    kMaxEventQueues = 64,       // one per EventThread
+    kEpollSizeHint = 1024       // ignored by modern kernels, must be > 0
+};
+
+//
+// Each queue has its own epoll descriptor and its own batch of harvested events.
+// A queue is only ever waited on by the EventThread that owns it, so the batch
+// state needs no locking; epoll_ctl is safe to call from any thread.
+struct EventQueue
+{
+    int                 fEpollFD;
+    struct epoll_event  fReturnedEvents[kMaxEventsPerWait];
+    int                 fNumEventsBackFromWait;
+    int                 fCurrentEventPos;
+    SInt64              fWakeupTime;    // when the current batch came back from epoll_wait
+};
+
+static EventQueue   sQueues[kMaxEventQueues];
+static int          sNumQueues = 0;
+
+//
+// The cookie and the fd both travel in the epoll_data, so no fd-indexed
+// cookie array is needed. Cookies handed to us by EventContext are unique IDs
+// that always fit in 32 bits.
+static inline UInt64 packeventdata(int fd, void* cookie)
+{
+    Assert((uintptr_t)cookie <= 0xFFFFFFFF);
+    return ((UInt64)(uintptr_t)cookie << 32) | (UInt32)fd;
+}
+
+static inline UInt32 epollmask(int which)
+{
+    UInt32 theMask = EPOLLONESHOT;
+#if EV_EDGE_TRIGGERED
+    theMask |= EPOLLET;
+#endif
+    if (which & EV_RE)
+        theMask |= EPOLLIN | EPOLLRDHUP;
+    if (which & EV_WR)
+        theMask |= EPOLLOUT;
+    return theMask;
+}
+
+static inline EventQueue* getqueue(int inQueue)
+{
+    Assert((inQueue >= 0) && (inQueue < sNumQueues));
+    return &sQueues[inQueue];
+}
+
+static int makequeue()
+{
+    Assert(sNumQueues < kMaxEventQueues);
+    if (sNumQueues >= kMaxEventQueues)
+        return -1;
+
+    EventQueue* theQueue = &sQueues[sNumQueues];
+    ::memset(theQueue, 0, sizeof(EventQueue));
+    theQueue->fEpollFD = ::epoll_create(kEpollSizeHint);
+    AssertV(theQueue->fEpollFD >= 0, OSThread::GetErrno());
+
+    return sNumQueues++;
+}
+
+void select_startevents()
+{
+    //Queue 0 backs the non-queue functions below
+    if (sNumQueues == 0)
+        (void)makequeue();
+}
+
+int select_createqueue()
+{
+    //Only called while the server is starting up, from the main thread.
+    //Queue 0 always belongs to the classic API, so make sure it exists first.
+    select_startevents();
+    return makequeue();
+}
+
+int select_removeevent(int which)
+{
+    return select_queue_removeevent(0, which);
+}
+
+int select_watchevent(struct eventreq *req, int which)
+{
+    return select_queue_modwatch(0, req, which);
+}
+
+int select_modwatch(struct eventreq *req, int which)
+{
+    return select_queue_modwatch(0, req, which);
+}
+
+int select_waitevent(struct eventreq *req, void* /*onlyForMacOSX*/)
+{
+    return select_queue_waitevent(0, req, NULL);
+}
+
+int select_queue_removeevent(int inQueue, int which)
+{
+    //
+    // The select shim defers the close to the select thread. epoll_ctl takes
+    // effect immediately, so once the fd is out of the interest list we can close it
+    // here. A stale event already harvested by select_waitevent carries the old
+    // cookie, which no longer resolves in the EventThread's ref table.
+    struct epoll_event theEvent;    // non-NULL for kernels before 2.6.9
+    ::memset(&theEvent, 0, sizeof(theEvent));
+    (void)::epoll_ctl(getqueue(inQueue)->fEpollFD, EPOLL_CTL_DEL, which, &theEvent);
+#if EV_DEBUGGING
+    qtss_printf("removeevent: queue %d Disabled %d \n", inQueue, which);
+#endif
+    (void)::close(which);
+    return 0;
+}
+
+int select_queue_watchevent(int inQueue, struct eventreq *req, int which)
+{
+    return select_queue_modwatch(inQueue, req, which);
+}
+
+int select_queue_modwatch(int inQueue, struct eventreq *req, int which)
+{
+    Assert(req->er_data != NULL);
+
+    struct epoll_event theEvent;
+    theEvent.events = epollmask(which);
+    theEvent.data.u64 = packeventdata(req->er_handle, req->er_data);
+
+#if EV_DEBUGGING
+    qtss_printf("modwatch: queue %d fd %d mask 0x%lx\n", inQueue, req->er_handle, theEvent.events);
+#endif
+
+    //
+    // The first RequestEvent on an fd adds it, every later one re-arms it. An fd that
+    // was snarfed from another EventContext may not have been added yet, so fall back
+    // to ADD whenever MOD says the fd is unknown.
+    int theEpollFD = getqueue(inQueue)->fEpollFD;
+    int theErr = ::epoll_ctl(theEpollFD, EPOLL_CTL_MOD, req->er_handle, &theEvent);
+    if ((theErr != 0) && (OSThread::GetErrno() == ENOENT))
+        theErr = ::epoll_ctl(theEpollFD, EPOLL_CTL_ADD, req->er_handle, &theEvent);
+
+    return theErr;
+}
+
+int select_queue_waitevent(int inQueue, struct eventreq *req, SInt64* outWakeupTimeInUSecs)
+{
+    EventQueue* theQueue = getqueue(inQueue);
+
+    if (theQueue->fCurrentEventPos >= theQueue->fNumEventsBackFromWait)
+    {
+        //We've handed out everything from the last epoll_wait. Get some more.
+        theQueue->fCurrentEventPos = 0;
+        theQueue->fNumEventsBackFromWait = 0;
+
+    #if THREADING_IS_COOPERATIVE
+        int theTimeout = 5;
+    #else
+        int theTimeout = 15 * 1000; //Periodically time out just in case we are deaf for some reason
+    #endif
+
+        OSThread::ThreadYield();
+
+        int theResult = ::epoll_wait(theQueue->fEpollFD, theQueue->fReturnedEvents, kMaxEventsPerWait, theTimeout);
+#if EV_DEBUGGING
+        qtss_printf("waitevent: queue %d back from epoll_wait. Result = %d\n", inQueue, theResult);
+#endif
+        if (theResult < 0)
+        {
+            if (OSThread::GetErrno() == EINTR)
+                return EINTR;
+            return theResult;
+        }
+
+        theQueue->fNumEventsBackFromWait = theResult;
+        if (theQueue->fNumEventsBackFromWait == 0)
+            return EINTR;   //timed out, force caller to call waitevent again.
+
+        theQueue->fWakeupTime = OS::Microseconds();
+    }
+
+    struct epoll_event* theEvent = &theQueue->fReturnedEvents[theQueue->fCurrentEventPos++];
+
+    req->er_handle = (int)(UInt32)(theEvent->data.u64 & 0xFFFFFFFF);
+    req->er_data = (void*)(uintptr_t)(theEvent->data.u64 >> 32);
+    req->er_eventbits = 0;
+
+    //
+    // Hangups and errors are reported as readable so the owner wakes up
+    // and discovers the condition on its next read.
+    if (theEvent->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        req->er_eventbits |= EV_RE;
+    if (theEvent->events & EPOLLOUT)
+        req->er_eventbits |= EV_WR;
+
+    if (outWakeupTimeInUSecs != NULL)
+        *outWakeupTimeInUSecs = theQueue->fWakeupTime;
+
+#if EV_DEBUGGING
+    qtss_printf("waitevent: queue %d Found an fd: %d bits=%d\n", inQueue, req->er_handle, req->er_eventbits);
+#endif
+
+    //EPOLLONESHOT has already disarmed this fd until the next modwatch.
+    return 0;
+}
+
+#endif //EPOLLEVENTQUEUE
@@ -26,12 +26,17 @@
     File:       ev.cpp
 
     Contains:   POSIX select implementation of MacOS X event queue functions.
+                Platforms that define EPOLLEVENTQUEUE use epollev.cpp instead.
 
 
     
 
 */
 
+#include "ev.h"
+
+#if !EPOLLEVENTQUEUE
+
 #define EV_DEBUGGING 0 //Enables a lot of printfs
 
     #include <sys/time.h>
@@ -48,7 +53,6 @@
 #include <unistd.h>
 #include <sys/errno.h>
 
-#include "ev.h"
 #include "OS.h"
 #include "OSHeaders.h"
 #include "MyAssert.h"
@@ -455,3 +459,4 @@ bool selecthasdata()
         return true;//we've gotten a real event, return that to the caller
 }
 
+#endif //!EPOLLEVENTQUEUE
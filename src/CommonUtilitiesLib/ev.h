@@ -30,6 +30,8 @@
     #include <sys/queue.h>
 #endif
 
+#include "OSHeaders.h"
+
 struct eventreq {
   int      er_type;
 #define EV_FD 1    // file descriptor
@@ -81,6 +83,22 @@ int select_waitevent(struct eventreq *req, void* onlyForMOSX);
 void select_startevents();
 int select_removeevent(int which);
 
+#if EPOLLEVENTQUEUE
+
+//
+// The epoll backend can run several independent event queues, one per EventThread.
+// select_createqueue returns the new queue's index, or -1 if no more can be made.
+// Queue 0 is created by select_startevents and is the one the calls above use.
+// select_queue_waitevent also reports when the batch holding the returned event
+// came back from the kernel, for wakeup latency accounting (may be NULL).
+int select_createqueue();
+int select_queue_watchevent(int inQueue, struct eventreq *req, int which);
+int select_queue_modwatch(int inQueue, struct eventreq *req, int which);
+int select_queue_waitevent(int inQueue, struct eventreq *req, SInt64* outWakeupTimeInUSecs);
+int select_queue_removeevent(int inQueue, int which);
+
+#endif
+
 #endif
 
 #endif /* _SYS_EV_H_ */
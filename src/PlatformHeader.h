@@ -92,6 +92,10 @@
 
 #define USE_ATOMICLIB 0
 #define MACOSXEVENTQUEUE 0
+#define EPOLLEVENTQUEUE 1 //epollev.cpp replaces the select() shim in ev.cpp
+#define UDPSENDBATCHING 1 //UDPSocket::SendToBatched can use sendmmsg
+#define UDPRECVBATCHING 1 //UDPSocket::RecvFromMany can use recvmmsg
+#define TCPZEROCOPY 1 //Socket::WriteVZeroCopy can use MSG_ZEROCOPY
 #define __PTHREADS__    1
 #define __PTHREADS_MUTEXES__    1
 #define ALLOW_NON_WORD_ALIGN_ACCESS 1
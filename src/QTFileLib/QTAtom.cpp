@@ -267,3 +267,39 @@ Bool16 QTAtom::ReadSubAtomInt64(const char * AtomPath, UInt64 * Datum)
     return true;
 }
 
+
+
+// -------------------------------------
+// Index table searches
+//
+UInt32 QTAtom::LowerBound(const UInt32 * Table, UInt32 NumEntries, UInt32 Value)
+{
+    UInt32      First = 0;
+    
+    while( NumEntries > 0 ) {
+        UInt32  Half = NumEntries / 2;
+        if( Table[First + Half] < Value ) {
+            First += Half + 1;
+            NumEntries -= Half + 1;
+        } else
+            NumEntries = Half;
+    }
+    
+    return First;
+}
+
+UInt32 QTAtom::UpperBound(const UInt32 * Table, UInt32 NumEntries, UInt32 Value)
+{
+    UInt32      First = 0;
+    
+    while( NumEntries > 0 ) {
+        UInt32  Half = NumEntries / 2;
+        if( Table[First + Half] <= Value ) {
+            First += Half + 1;
+            NumEntries -= Half + 1;
+        } else
+            NumEntries = Half;
+    }
+    
+    return First;
+}
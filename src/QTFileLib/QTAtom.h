@@ -83,6 +83,14 @@ public:
             
             char*       MemMap(UInt64 Offset, UInt32 Length);
             Bool16      UnMap(char *memPtr, UInt32 Length);
+
+    //
+    // Binary searches over the ascending, host-ordered index tables that the
+    // sample table atoms build when they are initialized. Both return an
+    // index between 0 and NumEntries.
+    static  UInt32      LowerBound(const UInt32 * Table, UInt32 NumEntries, UInt32 Value);  // first entry >= Value
+    static  UInt32      UpperBound(const UInt32 * Table, UInt32 NumEntries, UInt32 Value);  // first entry > Value
+
     //
     // Debugging functions.
     virtual void        DumpAtom(void) {}
@@ -307,6 +307,25 @@ Bool16 QTAtom_dref::Read(UInt32 RefID, UInt64 Offset, char * const Buffer, UInt3
     return fFile->Read(Offset, Buffer, Length, Entry->FCB);
 }
 
+Bool16 QTAtom_dref::Reference(UInt32 RefID, UInt64 Offset, UInt32 Length, const char ** Data, QTFile_FileControlBlock * FCB)
+{
+    //
+    // Validate that this ref exists.
+    if( (RefID == 0) || (RefID > fNumRefs) )
+        return false;
+
+    if( IsRefInThisFile(RefID) )
+        return fFile->Reference(Offset, Length, Data, FCB);
+    
+    //
+    // Files in other refs are opened by Read, so leave it to Read until then.
+    DataRefEntry *Entry = &fRefs[RefID - 1];
+    if( !Entry->IsEntryInitialized || !Entry->IsFileOpen )
+        return false;
+    
+    return fFile->Reference(Offset, Length, Data, Entry->FCB);
+}
+
 
 
 // -------------------------------------
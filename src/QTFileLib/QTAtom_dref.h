@@ -88,6 +88,8 @@ public:
     // Read functions.
             Bool16      Read(UInt32 RefID, UInt64 Offset, char * const Buffer, UInt32 Length,
                              QTFile_FileControlBlock * FCB = NULL);
+            Bool16      Reference(UInt32 RefID, UInt64 Offset, UInt32 Length, const char ** Data,
+                                  QTFile_FileControlBlock * FCB = NULL);
 
 
     //
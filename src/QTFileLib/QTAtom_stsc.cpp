@@ -127,7 +127,9 @@ void QTAtom_stsc_SampleTableControlBlock::Reset(void)
 //
 QTAtom_stsc::QTAtom_stsc(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fSampleToChunkTable(NULL), fTableSize(0)
+      fNumEntries(0), fSampleToChunkTable(NULL), fTableSize(0),
+      fIndexTable(NULL), fFirstChunkTable(NULL), fSamplesPerChunkTable(NULL),
+      fSampleDescriptionTable(NULL), fFirstSampleTable(NULL)
 {
 }
 
@@ -143,6 +145,8 @@ QTAtom_stsc::~QTAtom_stsc(void)
         delete[] fSampleToChunkTable;
 #endif
 
+    if( fIndexTable != NULL )
+        delete[] fIndexTable;
 }
 
 
@@ -182,6 +186,38 @@ Bool16 QTAtom_stsc::Initialize(void)
     ReadBytes(stscPos_SampleTable, fSampleToChunkTable, fNumEntries * 12);
 #endif
     
+    //
+    // Build the host ordered index. Samples are numbered from 1 and, as in
+    // SampleToChunkInfo, the run before the first entry is taken to be one
+    // sample per chunk starting at chunk 1.
+    UInt32      FirstChunk = 0, SamplesPerChunk = 0, SampleDescription = 0;
+    UInt32      LastFirstChunk = 1, LastSamplesPerChunk = 1, CurSample = 1;
+    
+    fIndexTable = NEW UInt32[(fNumEntries * 4) + 1];
+    fFirstChunkTable = fIndexTable;
+    fSamplesPerChunkTable = fFirstChunkTable + fNumEntries;
+    fSampleDescriptionTable = fSamplesPerChunkTable + fNumEntries;
+    fFirstSampleTable = fSampleDescriptionTable + fNumEntries;
+    
+    for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
+        memcpy(&FirstChunk, fSampleToChunkTable + (CurEntry * 12) + 0, 4);
+        FirstChunk = ntohl(FirstChunk);
+        memcpy(&SamplesPerChunk, fSampleToChunkTable + (CurEntry * 12) + 4, 4);
+        SamplesPerChunk = ntohl(SamplesPerChunk);
+        memcpy(&SampleDescription, fSampleToChunkTable + (CurEntry * 12) + 8, 4);
+        SampleDescription = ntohl(SampleDescription);
+        
+        CurSample += (FirstChunk - LastFirstChunk) * LastSamplesPerChunk;
+        
+        fFirstChunkTable[CurEntry] = FirstChunk;
+        fSamplesPerChunkTable[CurEntry] = SamplesPerChunk;
+        fSampleDescriptionTable[CurEntry] = SampleDescription;
+        fFirstSampleTable[CurEntry] = CurSample;
+        
+        LastFirstChunk = FirstChunk;
+        LastSamplesPerChunk = SamplesPerChunk;
+    }
+    
     //
     // This atom has been successfully read in.
     return true;
@@ -392,8 +428,9 @@ Bool16 QTAtom_stsc::SampleToChunkInfo(UInt32 SampleNumber,  UInt32 *samplesPerCh
     QTAtom_stsc_SampleTableControlBlock *tempSTCB = NULL;
     
     // General vars
-    UInt32      NewCurSample;
-    UInt32      FirstChunk = 0, SamplesPerChunk = 0, SampleDescription = 0;
+    enum { kNoEntry = 0xFFFFFFFF };
+    UInt32      CurEntry;
+    UInt32      FirstChunk = 0, SamplesPerChunk = 0;
     
     Bool16      missedCache = false;
 
@@ -452,104 +489,48 @@ Bool16 QTAtom_stsc::SampleToChunkInfo(UInt32 SampleNumber,  UInt32 *samplesPerCh
 //  qtss_printf("QTAtom_stsc::SampleToChunkInfo missed cache SampleNumber = %ld\n",SampleNumber);
 
     //
-    // Assume that this sample came out of the last chunk.
-    aChunkNumber = STCB->fLastFirstChunk_SampleToChunkInfo + ((SampleNumber - STCB->fCurSample_SampleToChunkInfo) / STCB->fLastSamplesPerChunk_SampleToChunkInfo) ;
-    aSampleDescriptionIndex = STCB->fLastSampleDescription_SampleToChunkInfo;
-    aSampleOffsetInChunk = SampleNumber - (STCB->fCurSample_SampleToChunkInfo + ((aChunkNumber - STCB->fLastFirstChunk_SampleToChunkInfo) * STCB->fLastSamplesPerChunk_SampleToChunkInfo));
-    aSamplesPerChunk = STCB->fLastSamplesPerChunk_SampleToChunkInfo;
+    // Find the last entry whose first chunk starts at or before the sample,
+    // trying the entry we found last time before searching the table.
+    CurEntry = STCB->fCurEntry_SampleToChunkInfo;
+    if( (CurEntry >= fNumEntries) || (fFirstSampleTable[CurEntry] > SampleNumber)
+        || ((CurEntry + 1 < fNumEntries) && (fFirstSampleTable[CurEntry + 1] <= SampleNumber)) )
+    {
+        CurEntry = UpperBound(fFirstSampleTable, fNumEntries, SampleNumber);
+        if( CurEntry > 0 )
+            CurEntry--;
+        else
+            CurEntry = kNoEntry;    // before the first entry
+    }
     
-    if( ChunkNumber != NULL )
-        *ChunkNumber = aChunkNumber;
-    if( SampleDescriptionIndex != NULL )
-        *SampleDescriptionIndex = aSampleDescriptionIndex;
-    if( SampleOffsetInChunk != NULL )
-        *SampleOffsetInChunk = aSampleOffsetInChunk;
-    if (NULL != samplesPerChunk) 
-         *samplesPerChunk = aSamplesPerChunk;
-         
-    //
-    // Linear search through the sample table until we find the chunk
-    // which contains the given sample.
-
-    if (STCB->fCurSample_SampleToChunkInfo > SampleNumber) // we missed the cache start over
-    {   
+    if( STCB->fCurSample_SampleToChunkInfo > SampleNumber ) // we missed the cache
         missedCache = true;
-//      qtss_printf("missed loop Cache!! STCB = %ld STCB->fCurSample_SampleToChunkInfo = %ld  > SampleNumber = %ld \n",STCB, STCB->fCurSample_SampleToChunkInfo, SampleNumber);
+    
+    if( CurEntry == kNoEntry )
+    {
         STCB->fCurEntry_SampleToChunkInfo = 0;
         STCB->fCurSample_SampleToChunkInfo = 1;
         STCB->fLastFirstChunk_SampleToChunkInfo = 1;
         STCB->fLastSamplesPerChunk_SampleToChunkInfo = 1;
         STCB->fLastSampleDescription_SampleToChunkInfo = 0;
     }
-
-
-
-    for(; STCB->fCurEntry_SampleToChunkInfo < fNumEntries; STCB->fCurEntry_SampleToChunkInfo++ ) {
-        //
-        // Copy this entry's fields.
-        memcpy(&FirstChunk, fSampleToChunkTable + (STCB->fCurEntry_SampleToChunkInfo * 12) + 0, 4);
-        FirstChunk = ntohl(FirstChunk);
-        memcpy(&SamplesPerChunk, fSampleToChunkTable + (STCB->fCurEntry_SampleToChunkInfo * 12) + 4, 4);
-        SamplesPerChunk = ntohl(SamplesPerChunk);
-        memcpy(&SampleDescription, fSampleToChunkTable + (STCB->fCurEntry_SampleToChunkInfo * 12) + 8, 4);
-        SampleDescription = ntohl(SampleDescription);
-        
-        //
-        // Check to see if the sample was actually in the last chunk and
-        // return if it was.
-        NewCurSample = STCB->fCurSample_SampleToChunkInfo +  (FirstChunk - STCB->fLastFirstChunk_SampleToChunkInfo) * STCB->fLastSamplesPerChunk_SampleToChunkInfo ;
-        if( SampleNumber < NewCurSample )
-        {
-    
-            if( ChunkNumber != NULL )
-                *ChunkNumber = aChunkNumber;
-            if( SampleDescriptionIndex != NULL )
-                *SampleDescriptionIndex = aSampleDescriptionIndex;
-            if( SampleOffsetInChunk != NULL )
-                *SampleOffsetInChunk = aSampleOffsetInChunk;
-            if (NULL != samplesPerChunk) 
-                 *samplesPerChunk = aSamplesPerChunk;
-        
-            if (SampleNumber == 1 || missedCache)
-            {
-//                  qtss_printf("QTAtom_stsc::SampleToChunkInfo (SampleNumber == %ld) \n",SampleNumber);
-                    STCB->fFirstChunkNumber_SampleToChunkInfo = aChunkNumber;
-                    STCB->fFirstSampleDescriptionIndex_SampleToChunkInfo = aSampleDescriptionIndex;
-                    STCB->fFirstSamplesPerChunk_SampleToChunkInfo = aSamplesPerChunk;
-                    STCB->fFirstSampleOffsetInChunk_SampleToChunkInfo = aSampleOffsetInChunk;
-                    STCB->fFirstSampleNumber_SampleToChunkInfo = SampleNumber;
-            }
-//          qtss_printf("GetSample Info in for loop returning offset %ld \n",aSampleOffsetInChunk);
-            goto done;
-        }   
-
-        STCB->fCurSample_SampleToChunkInfo = NewCurSample;
-        
-        //
-        // Assume that the sample will be in this chunk.
-        
-
-        aChunkNumber = FirstChunk + ((SampleNumber - STCB->fCurSample_SampleToChunkInfo) / SamplesPerChunk) ;
-        aSampleDescriptionIndex = SampleDescription;
-        aSampleOffsetInChunk = SampleNumber - (STCB->fCurSample_SampleToChunkInfo + ((aChunkNumber - FirstChunk) * SamplesPerChunk));
-        aSamplesPerChunk = SamplesPerChunk;  
-        
-        //
-        // We have yet to find the sample; update our CurSample counter
-        // and move on.
-        
-
-        STCB->fLastFirstChunk_SampleToChunkInfo = FirstChunk;
-        STCB->fLastSampleDescription_SampleToChunkInfo = SampleDescription;
-        STCB->fLastSamplesPerChunk_SampleToChunkInfo = SamplesPerChunk;
-
-
+    else
+    {
+        STCB->fCurEntry_SampleToChunkInfo = CurEntry;
+        STCB->fCurSample_SampleToChunkInfo = fFirstSampleTable[CurEntry];
+        STCB->fLastFirstChunk_SampleToChunkInfo = fFirstChunkTable[CurEntry];
+        STCB->fLastSamplesPerChunk_SampleToChunkInfo = fSamplesPerChunkTable[CurEntry];
+        STCB->fLastSampleDescription_SampleToChunkInfo = fSampleDescriptionTable[CurEntry];
     }
-
-//  qtss_printf("GetSample Info fall out of loop returning offset%ld \n",aSampleOffsetInChunk);
+    
     //
-    // Falling out of the loop means that the sample is in the last chunk of
-    // the table.
+    // The sample is in one of this entry's chunks.
+    FirstChunk = STCB->fLastFirstChunk_SampleToChunkInfo;
+    SamplesPerChunk = STCB->fLastSamplesPerChunk_SampleToChunkInfo;
+    
+    aChunkNumber = FirstChunk + ((SampleNumber - STCB->fCurSample_SampleToChunkInfo) / SamplesPerChunk);
+    aSampleDescriptionIndex = STCB->fLastSampleDescription_SampleToChunkInfo;
+    aSampleOffsetInChunk = SampleNumber - (STCB->fCurSample_SampleToChunkInfo + ((aChunkNumber - FirstChunk) * SamplesPerChunk));
+    aSamplesPerChunk = SamplesPerChunk;
     
     if( ChunkNumber != NULL )
         *ChunkNumber = aChunkNumber;
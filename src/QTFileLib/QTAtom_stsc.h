@@ -145,6 +145,15 @@ protected:
     UInt32      fNumEntries;
     char        *fSampleToChunkTable;
     UInt32      fTableSize;
+    
+    //
+    // Host ordered copy of the table, plus the number of the first sample in
+    // each entry's first chunk so that SampleToChunkInfo can binary search.
+    UInt32      *fIndexTable;
+    UInt32      *fFirstChunkTable;
+    UInt32      *fSamplesPerChunkTable;
+    UInt32      *fSampleDescriptionTable;
+    UInt32      *fFirstSampleTable;
 };
 
 #endif // QTAtom_stsc_H
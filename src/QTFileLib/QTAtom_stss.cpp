@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "SafeStdLib.h"
+#include <string.h>
 #ifndef __Win32__
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -68,7 +69,7 @@ const int       stssPos_SampleTable         =  8;
 //
 QTAtom_stss::QTAtom_stss(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fSyncSampleTable(NULL), fTable(NULL), fTableSize(0)
+      fNumEntries(0), fTable(NULL)
 {
 }
 
@@ -76,13 +77,18 @@ QTAtom_stss::~QTAtom_stss(void)
 {
     //
     // Free our variables.
-#if __MacOSX__
-    if( fSyncSampleTable != NULL )
-        this->UnMap(fSyncSampleTable, fTableSize);
-#else
-    if( fSyncSampleTable != NULL )
-        delete[] fSyncSampleTable;
-#endif
+    if( fTable != NULL )
+        delete[] fTable;
+}
+
+static int CompareSampleNumbers(const void * First, const void * Second)
+{
+    UInt32  FirstSample = *(const UInt32 *)First;
+    UInt32  SecondSample = *(const UInt32 *)Second;
+    
+    if( FirstSample < SecondSample )
+        return -1;
+    return (FirstSample > SecondSample) ? 1 : 0;
 }
 
 
@@ -111,50 +117,39 @@ Bool16 QTAtom_stss::Initialize(void)
         if( (unsigned long)(fNumEntries * 4) != (fTOCEntry.AtomDataLength - 8) )
             return false;
 
-        
-#if 0 //__MacOSX__ MMAP_TABLES needs fixing. It should be page aligned and maybe on a 64bit system the whole file should be mapped.
-    fTableSize = (fNumEntries * 4);
-    fSyncSampleTable = this->MemMap(stssPos_SampleTable, fTableSize);
-    fTable = (UInt32 *) fSyncSampleTable;
-    if (fSyncSampleTable == NULL)
-        return false;
- 
-#else
         //
         // Read in the sync sample table.
-        fSyncSampleTable = NEW char[(fNumEntries * 4) + 1];
-        if( fSyncSampleTable == NULL )
+        char *syncSampleTable = NEW char[(fNumEntries * 4) + 1];
+        if( syncSampleTable == NULL )
             return false;
         
-        if( ((PointerSizedInt)fSyncSampleTable & (PointerSizedInt)0x3) == 0)
-            fTable = (UInt32 *)fSyncSampleTable;
-        else
-            fTable = (UInt32 *)(((PointerSizedInt)fSyncSampleTable + 4) & ~((PointerSizedInt)0x3));
-        
-        initSucceeds = ReadBytes(stssPos_SampleTable, (char *)fTable, fNumEntries * 4);
-
-#endif        
+        initSucceeds = ReadBytes(stssPos_SampleTable, syncSampleTable, fNumEntries * 4);
         if ( initSucceeds )
         {
             // This atom has been successfully read in.
-            // sample offsets are in network byte order on disk, convert them to host order
-            UInt32      sampleIndex = 0;
-            
-            // convert each sample to host order
+            // sample numbers are in network byte order on disk, convert them to host order
             // NOTE - most other Atoms handle byte order conversions in
             // the accessor function.  For efficiency reasons it's converted
             // to host order here for sync samples.
+            fTable = NEW UInt32[fNumEntries + 1];
             
-            for ( sampleIndex = 0; sampleIndex < fNumEntries; sampleIndex++ )
+            Bool16  isSorted = true;
+            for ( UInt32 sampleIndex = 0; sampleIndex < fNumEntries; sampleIndex++ )
             {
-                fTable[sampleIndex] = ntohl( fTable[sampleIndex] );
-            
+                memcpy(&tempInt32, syncSampleTable + (sampleIndex * 4), 4);
+                fTable[sampleIndex] = ntohl(tempInt32);
+                if ( (sampleIndex > 0) && (fTable[sampleIndex] < fTable[sampleIndex - 1]) )
+                    isSorted = false;
             }
-        
+            
+            //
+            // The accessors binary search the table, so put the (rare) movie
+            // that doesn't list its sync samples in order right.
+            if ( !isSorted )
+                ::qsort(fTable, fNumEntries, sizeof(UInt32), CompareSampleNumbers);
         }
-
-
-
+        
+        delete [] syncSampleTable;
     }
     
     return initSucceeds;
@@ -168,37 +163,25 @@ Bool16 QTAtom_stss::Initialize(void)
 void QTAtom_stss::PreviousSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumber)
 {
     //
-    // We assume that we won't find an answer
-    *SyncSampleNumber = SampleNumber;
-    
-    //
-    // Scan the table until we find a sample number greater than our current
-    // sample number; then return that.
-    for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
-        //
-        // Take this entry if it is before (or equal to) our current entry.
-        if( fTable[CurEntry] <= SampleNumber )
-            *SyncSampleNumber = fTable[CurEntry];
-    }
+    // Find the last sync sample at or before our current sample number;
+    // if there is none we return the sample we were given.
+    UInt32 CurEntry = UpperBound(fTable, fNumEntries, SampleNumber);
+    if( CurEntry > 0 )
+        *SyncSampleNumber = fTable[CurEntry - 1];
+    else
+        *SyncSampleNumber = SampleNumber;
 }
 
 void QTAtom_stss::NextSyncSample(UInt32 SampleNumber, UInt32 *SyncSampleNumber)
 {
     //
-    // We assume that we won't find an answer
-    *SyncSampleNumber = SampleNumber + 1;
-    
-    //
-    // Scan the table until we find a sample number greater than our current
-    // sample number; then return that.
-    for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
-        //
-        // Take this entry if it is greater than our current entry.
-        if( fTable[CurEntry] > SampleNumber ) {
-            *SyncSampleNumber = fTable[CurEntry];
-            break;
-        }
-    }
+    // Find the first sync sample after our current sample number; if there
+    // is none we return the next sample.
+    UInt32 CurEntry = UpperBound(fTable, fNumEntries, SampleNumber);
+    if( CurEntry < fNumEntries )
+        *SyncSampleNumber = fTable[CurEntry];
+    else
+        *SyncSampleNumber = SampleNumber + 1;
 }
 
 
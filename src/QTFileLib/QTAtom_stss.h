@@ -61,14 +61,8 @@ public:
             inline Bool16       IsSyncSample(UInt32 SampleNumber, UInt32 inCursor)
             {
                 Assert(inCursor <= fNumEntries);
-                for (UInt32 curEntry = inCursor; curEntry < fNumEntries; curEntry++)
-                {
-                    if (fTable[curEntry] == SampleNumber)
-                        return true;
-                    else if (fTable[curEntry] > SampleNumber)
-                        return false;
-                }
-                return false;
+                UInt32 curEntry = inCursor + LowerBound(fTable + inCursor, fNumEntries - inCursor, SampleNumber);
+                return (curEntry < fNumEntries) && (fTable[curEntry] == SampleNumber);
             }
 
 
@@ -85,9 +79,7 @@ protected:
     UInt32      fFlags; // 24 bits in the low 3 bytes
 
     UInt32      fNumEntries;
-    char        *fSyncSampleTable;
-    UInt32      *fTable; // longword-aligned version of the above
-    UInt32      fTableSize;
+    UInt32      *fTable; // host ordered and ascending
 };
 
 #endif // QTAtom_stss_H
@@ -98,7 +98,8 @@ void QTAtom_stts_SampleTableControlBlock::Reset(void)
 //
 QTAtom_stts::QTAtom_stts(QTFile * File, QTFile::AtomTOCEntry * TOCEntry, Bool16 Debug, Bool16 DeepDebug)
     : QTAtom(File, TOCEntry, Debug, DeepDebug),
-      fNumEntries(0), fTimeToSampleTable(NULL), fTableSize(0)
+      fNumEntries(0), fIndexTable(NULL),
+      fFirstSampleTable(NULL), fFirstMediaTimeTable(NULL), fSampleDurationTable(NULL)
 {
 }
 
@@ -106,15 +107,8 @@ QTAtom_stts::~QTAtom_stts(void)
 {
     //
     // Free our variables.
-#if __MacOSX__
-    if( fTimeToSampleTable != NULL )
-        this->UnMap(fTimeToSampleTable, fTableSize);
-#else
-    if( fTimeToSampleTable != NULL )
-        delete[] fTimeToSampleTable;
-#endif
-
-
+    if( fIndexTable != NULL )
+        delete[] fIndexTable;
 }
 
 
@@ -126,6 +120,7 @@ Bool16 QTAtom_stts::Initialize(void)
 {
     // Temporary vars
     UInt32      tempInt32;
+    UInt32      SampleCount, SampleDuration;
 
 
     //
@@ -143,19 +138,36 @@ Bool16 QTAtom_stts::Initialize(void)
 
     //
     // Read in the time-to-sample table.
-
-#if __MacOSX__
-    fTableSize = (fNumEntries * 8);
-    fTimeToSampleTable = this->MemMap(sttsPos_SampleTable, fTableSize);
-    if( fTimeToSampleTable == NULL )
-        return false;
-#else
-    fTimeToSampleTable = NEW char[fNumEntries * 8];
-    if( fTimeToSampleTable == NULL )
+    char *timeToSampleTable = NEW char[(fNumEntries * 8) + 1];
+    if( timeToSampleTable == NULL )
         return false;
     
-    ReadBytes(sttsPos_SampleTable, fTimeToSampleTable, fNumEntries * 8);
-#endif
+    ReadBytes(sttsPos_SampleTable, timeToSampleTable, fNumEntries * 8);
+
+    //
+    // Turn the runs of samples into ascending first-sample and media time
+    // tables so that lookups can binary search them.
+    fIndexTable = NEW UInt32[(fNumEntries * 3) + 2];
+    fFirstSampleTable = fIndexTable;
+    fFirstMediaTimeTable = fFirstSampleTable + fNumEntries + 1;
+    fSampleDurationTable = fFirstMediaTimeTable + fNumEntries + 1;
+    
+    fFirstSampleTable[0] = 1;
+    fFirstMediaTimeTable[0] = 0;
+    for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) {
+        //
+        // Copy this sample count and duration.
+        memcpy(&SampleCount, timeToSampleTable + (CurEntry * 8), 4);
+        SampleCount = ntohl(SampleCount);
+        memcpy(&SampleDuration, timeToSampleTable + (CurEntry * 8) + 4, 4);
+        SampleDuration = ntohl(SampleDuration);
+        
+        fSampleDurationTable[CurEntry] = SampleDuration;
+        fFirstSampleTable[CurEntry + 1] = fFirstSampleTable[CurEntry] + SampleCount;
+        fFirstMediaTimeTable[CurEntry + 1] = fFirstMediaTimeTable[CurEntry] + (SampleCount * SampleDuration);
+    }
+    
+    delete [] timeToSampleTable;
 
     //
     // This atom has been successfully read in.
@@ -170,67 +182,50 @@ Bool16 QTAtom_stts::Initialize(void)
 Bool16 QTAtom_stts::MediaTimeToSampleNumber(UInt32 MediaTime, UInt32 * SampleNumber, QTAtom_stts_SampleTableControlBlock * STCB)
 {
     // General vars
-    UInt32      SampleCount, SampleDuration;
-    QTAtom_stts_SampleTableControlBlock *tempSTCB = NULL;
-    Bool16      result = false;
+    UInt32      CurEntry = 0;
+    
     //
-    // Use the default STCB if one was not passed in to us.
-    if( STCB == NULL )
-    {   
-//      qtss_printf("QTAtom_stts::MediaTimeToSampleNumber  ( STCB == NULL ) \n");
-        tempSTCB = NEW QTAtom_stts_SampleTableControlBlock;
-        STCB = tempSTCB;
-    }
+    // Start with the entry we found last time; playing straight through, the
+    // media time is usually still inside of it.
+    if( STCB != NULL )
+        CurEntry = STCB->fMTtSN_CurEntry;
+    
     //
-    // Reconfigure the STCB if necessary.
-    if( MediaTime < STCB->fMTtSN_CurMediaTime )
+    // Otherwise find the first entry which ends at or after the given media time.
+    if( (CurEntry >= fNumEntries)
+        || ((CurEntry > 0) && (fFirstMediaTimeTable[CurEntry] >= MediaTime))
+        || (fFirstMediaTimeTable[CurEntry + 1] < MediaTime) )
     {
-//      qtss_printf(" QTAtom_stts::MediaTimeToSampleNumber RESET \n");
-        STCB->Reset();
+        CurEntry = LowerBound(fFirstMediaTimeTable + 1, fNumEntries, MediaTime);
+        if( CurEntry == fNumEntries )
+            return false;
     }
-    //
-    // Linearly search through the sample table until we find the sample
-    // which fits inside the given media time.
-    for( ; STCB->fMTtSN_CurEntry < fNumEntries; STCB->fMTtSN_CurEntry++ ) {
-        //
-        // Copy this sample count and duration.
-        memcpy(&SampleCount, fTimeToSampleTable + (STCB->fMTtSN_CurEntry * 8), 4);
-        SampleCount = ntohl(SampleCount);
-        memcpy(&SampleDuration, fTimeToSampleTable + (STCB->fMTtSN_CurEntry * 8) + 4, 4);
-        SampleDuration = ntohl(SampleDuration);
-
-        //
-        // Can we skip over this entry?
-        if( STCB->fMTtSN_CurMediaTime + (SampleCount * SampleDuration) < MediaTime ) {
-            STCB->fMTtSN_CurMediaTime += SampleCount * SampleDuration;
-            STCB->fMTtSN_CurSample += SampleCount;
-            continue;
-        }
-
-        //
-        // Locate and return the sample which is/begins right before the
-        // given media time.
-        if( SampleNumber != NULL )
-        {   
-            *SampleNumber = STCB->fMTtSN_CurSample;
-            if (SampleDuration > 0)
-                *SampleNumber += (MediaTime - STCB->fMTtSN_CurMediaTime) / SampleDuration;
-            result = true;
-            break;
-        }   
+    
+    if( STCB != NULL )
+    {
+        STCB->fMTtSN_CurEntry = CurEntry;
+        STCB->fMTtSN_CurMediaTime = fFirstMediaTimeTable[CurEntry];
+        STCB->fMTtSN_CurSample = fFirstSampleTable[CurEntry];
     }
 
-    delete tempSTCB;
+    //
+    // Locate and return the sample which is/begins right before the
+    // given media time.
+    if( SampleNumber == NULL )
+        return false;
     
-    return result;
+    *SampleNumber = fFirstSampleTable[CurEntry];
+    if (fSampleDurationTable[CurEntry] > 0)
+        *SampleNumber += (MediaTime - fFirstMediaTimeTable[CurEntry]) / fSampleDurationTable[CurEntry];
+    
+    return true;
 }
 
 Bool16 QTAtom_stts::SampleNumberToMediaTime(UInt32 SampleNumber, UInt32 * MediaTime, QTAtom_stts_SampleTableControlBlock * STCB)
 {
     // General vars
-    UInt32      SampleCount, SampleDuration;
-    //
-    // Use the default STCB if one was not passed in to us.
+    UInt32      CurEntry;
+    
     Assert(STCB != NULL);
 
     if ( STCB->fGetSampleMediaTime_SampleNumber == SampleNumber)
@@ -240,47 +235,33 @@ Bool16 QTAtom_stts::SampleNumberToMediaTime(UInt32 SampleNumber, UInt32 * MediaT
         return true;
     }
 
-
     //
-    // Reconfigure the STCB if necessary.
-    if( SampleNumber < STCB->fSNtMT_CurSample )
+    // Start with the entry we found last time, otherwise find the first entry
+    // which ends at or after the given sample.
+    CurEntry = STCB->fSNtMT_CurEntry;
+    if( (CurEntry >= fNumEntries)
+        || ((CurEntry > 0) && (fFirstSampleTable[CurEntry] >= SampleNumber))
+        || (fFirstSampleTable[CurEntry + 1] < SampleNumber) )
     {
-//      qtss_printf(" QTAtom_stts::SampleNumberToMediaTime reset \n");
-        STCB->Reset();
+        CurEntry = LowerBound(fFirstSampleTable + 1, fNumEntries, SampleNumber);
+        if( CurEntry == fNumEntries )
+            return false;
     }
-    //
-    // Linearly search through the sample table until we find the sample
-    // which fits inside the given media time.
-    for( ; STCB->fSNtMT_CurEntry < fNumEntries; STCB->fSNtMT_CurEntry++ ) {
-        //
-        // Copy this sample count and duration.
-        memcpy(&SampleCount, fTimeToSampleTable + (STCB->fSNtMT_CurEntry * 8), 4);
-        SampleCount = ntohl(SampleCount);
-        memcpy(&SampleDuration, fTimeToSampleTable + (STCB->fSNtMT_CurEntry * 8) + 4, 4);
-        SampleDuration = ntohl(SampleDuration);
-
-        //
-        // Can we skip over this entry?
-        if( STCB->fSNtMT_CurSample + SampleCount < SampleNumber ) {
-            STCB->fSNtMT_CurMediaTime += SampleCount * SampleDuration;
-            STCB->fSNtMT_CurSample += SampleCount;
-            continue;
-        }
-
-        //
-        // Return the sample time at the beginning of this sample.
-        if( MediaTime != NULL )
-            *MediaTime = STCB->fSNtMT_CurMediaTime + ((SampleNumber - STCB->fSNtMT_CurSample) * SampleDuration);
+    
+    STCB->fSNtMT_CurEntry = CurEntry;
+    STCB->fSNtMT_CurMediaTime = fFirstMediaTimeTable[CurEntry];
+    STCB->fSNtMT_CurSample = fFirstSampleTable[CurEntry];
 
-        STCB->fGetSampleMediaTime_SampleNumber = SampleNumber;
-        STCB->fGetSampleMediaTime_MediaTime = *MediaTime;
+    //
+    // Return the sample time at the beginning of this sample.
+    UInt32 theMediaTime = fFirstMediaTimeTable[CurEntry] + ((SampleNumber - fFirstSampleTable[CurEntry]) * fSampleDurationTable[CurEntry]);
+    if( MediaTime != NULL )
+        *MediaTime = theMediaTime;
 
-        return true;
-    }
+    STCB->fGetSampleMediaTime_SampleNumber = SampleNumber;
+    STCB->fGetSampleMediaTime_MediaTime = theMediaTime;
 
-    //
-    // No match; return false.
-    return false;
+    return true;
 }
 
 
@@ -305,19 +286,11 @@ void QTAtom_stts::DumpTable(void)
     
     //
     // Print the table.
-    UInt32      SampleCount = 0;
-    UInt32      SampleDuration = 0;
     for( UInt32 CurEntry = 0; CurEntry < fNumEntries; CurEntry++ ) 
     {
-        //
-        // Copy this sample count and duration.
-        memcpy(&SampleCount, fTimeToSampleTable + (CurEntry * 8), 4);
-        SampleCount = ntohl(SampleCount);
-        memcpy(&SampleDuration, fTimeToSampleTable + (CurEntry* 8) + 4, 4);
-        SampleDuration = ntohl(SampleDuration);
-
         // Print out a listing.
-        qtss_printf("  %10lu : %10lu  %10lu\n", CurEntry, SampleCount, SampleDuration);
+        qtss_printf("  %10lu : %10lu  %10lu\n", CurEntry,
+                    fFirstSampleTable[CurEntry + 1] - fFirstSampleTable[CurEntry], fSampleDurationTable[CurEntry]);
     }
 }
 
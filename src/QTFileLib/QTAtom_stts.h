@@ -103,8 +103,15 @@ protected:
     UInt32      fFlags; // 24 bits in the low 3 bytes
 
     UInt32      fNumEntries;
-    char        *fTimeToSampleTable;
-    UInt32      fTableSize;
+    
+    //
+    // Host ordered index built from the time-to-sample table. Entry i starts
+    // at fFirstSampleTable[i] and fFirstMediaTimeTable[i]; both tables have a
+    // final entry marking the end of the track.
+    UInt32      *fIndexTable;
+    UInt32      *fFirstSampleTable;
+    UInt32      *fFirstMediaTimeTable;
+    UInt32      *fSampleDurationTable;
     
 };
 
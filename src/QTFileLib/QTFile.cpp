@@ -86,7 +86,8 @@ QTFile::QTFile(Bool16 Debug, Bool16 DeepDebug)
     fNumTracks(0),
     fFirstTrack(NULL), fLastTrack(NULL),
     fMovieHeaderAtom(NULL), 
-    fFile(-1)
+    fFile(-1),
+    fMappedFile(NULL)
 {
 }
 
@@ -138,6 +139,8 @@ QTFile::~QTFile(void)
         //free(fMoviePath);
         delete [] fMoviePath;
 
+    QTFile_MappedFile::Release(fMappedFile);
+
 #if DSS_USE_API_CALLBACKS
     (void)QTSS_CloseFileObject(fMovieFD);
 #endif
@@ -205,6 +208,10 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
     if( !fMovieFD.IsValid() )
         return errFileNotFound;
 #endif
+
+    //
+    // Serve reads from the shared mapped file cache if it is on
+    fMappedFile = QTFile_MappedFile::Acquire(fMoviePath);
     
     //
     // We have a file, generate the mod date str
@@ -304,6 +311,8 @@ QTFile::ErrorCode QTFile::Open(const char * MoviePath)
 
 void QTFile::AllocateBuffers(UInt32 inUnitSizeInK, UInt32 inBufferInc, UInt32 inBufferSizeUnits, UInt32 inMaxBitRateBuffSizeInBlocks, UInt32 inBitrate)
 {
+    if (fMappedFile != NULL) // reads don't go through the file's buffers
+        return;
 
 #if DSS_USE_API_CALLBACKS
     if (fOSFileSourceFD != NULL)
@@ -597,8 +606,19 @@ SInt64 QTFile::GetModDate()
 Bool16 QTFile::Read(UInt64 Offset, char * const Buffer, UInt32 Length, QTFile_FileControlBlock * FCB)
 {
     // General vars
-    OSMutexLocker   ReadMutex(fReadMutex);
     Bool16 rv = false;
+    
+    //
+    // Mapped reads never touch fMovieFD, so clients of the same movie don't
+    // have to wait for each other.
+    if (fMappedFile != NULL)
+    {
+        if( FCB )
+            return FCB->Read(&fMovieFD,Offset,Buffer,Length,fMappedFile);
+        return fMappedFile->Read(Offset, Buffer, Length);
+    }
+    
+    OSMutexLocker   ReadMutex(fReadMutex);
 
     if( FCB )
         rv = FCB->Read(&fMovieFD,Offset,Buffer,Length);
@@ -620,6 +640,18 @@ Bool16 QTFile::Read(UInt64 Offset, char * const Buffer, UInt32 Length, QTFile_Fi
     return rv;
 }
 
+Bool16 QTFile::Reference(UInt64 Offset, UInt32 Length, const char ** Data, QTFile_FileControlBlock * FCB)
+{
+    if( FCB )
+        return FCB->Reference(Offset, Length, Data, fMappedFile);
+    
+    if (fMappedFile == NULL)
+        return false;
+    
+    *Data = fMappedFile->GetData(Offset, Length);
+    return *Data != NULL;
+}
+
 
 
 
@@ -133,6 +133,13 @@ public:
     //
     // Read functions.
             Bool16      Read(UInt64 Offset, char * const Buffer, UInt32 Length, QTFile_FileControlBlock * FCB = NULL);
+            
+            // Points at the data instead of copying it; only works for mapped files.
+            // The pointer is good for as long as this QTFile is open.
+            Bool16      Reference(UInt64 Offset, UInt32 Length, const char ** Data, QTFile_FileControlBlock * FCB = NULL);
+            
+            // True if reads are served from the shared mapped file cache
+            Bool16      IsMapped() { return fMappedFile != NULL; }
     
 
             void        AllocateBuffers(UInt32 inUnitSizeInK, UInt32 inBufferInc, UInt32 inBufferSize, UInt32 inMaxBitRateBuffSizeInBlocks, UInt32 inBitrate);
@@ -185,6 +192,8 @@ protected:
     
     OSMutex             *fReadMutex;
     int                  fFile;
+    
+    QTFile_MappedFile   *fMappedFile;
                         
 };
 
@@ -193,6 +202,10 @@ Bool16 QTFile::ValidTOC()
     UInt64 theLength = 0;
     UInt64 thePos = 0;
 
+    // Mapped reads leave the file's position alone, and only fail past the end
+    if (fMappedFile != NULL)
+        return true;
+
 #if DSS_USE_API_CALLBACKS
     UInt32 theDataLen = sizeof(UInt64);
     (void)QTSS_GetValue(fMovieFD, qtssFlObjLength, 0, (void*)&theLength, &theDataLen);
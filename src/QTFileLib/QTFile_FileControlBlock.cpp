@@ -50,6 +50,13 @@
 
 #include <fcntl.h>
 
+#ifndef __Win32__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 
 // -------------------------------------
@@ -59,12 +66,203 @@
 //#define DEEP_DEBUG_PRINT(s) if(fDeepDebug) qtss_printf s
 
 
+// -------------------------------------
+// Mapped file cache
+//
+
+OSMutex     QTFile_MappedFile::sMutex;
+OSQueue     QTFile_MappedFile::sFileQueue;
+Bool16      QTFile_MappedFile::sEnabled = false;
+UInt64      QTFile_MappedFile::sMaxMappedBytes = 0;
+UInt64      QTFile_MappedFile::sNumMappedBytes = 0;
+UInt32      QTFile_MappedFile::sPageSize = 4096;
+
+void QTFile_MappedFile::SetCacheParams(Bool16 inEnabled, UInt64 inMaxMappedBytes)
+{
+    OSMutexLocker locker(&sMutex);
+#ifdef __Win32__
+    sEnabled = false;
+#else
+    sEnabled = inEnabled;
+    long thePageSize = ::sysconf(_SC_PAGESIZE);
+    if (thePageSize > 0)
+        sPageSize = (UInt32)thePageSize;
+#endif
+    sMaxMappedBytes = inMaxMappedBytes;
+    
+    //The limit may have gone down
+    EvictUnused(0);
+}
+
+QTFile_MappedFile* QTFile_MappedFile::Acquire(const char* inPath)
+{
+#ifdef __Win32__
+    return NULL;
+#else
+    if (!sEnabled)
+        return NULL;
+        
+    //
+    // Identify the file by what is open, not by what the path pointed to a
+    // moment ago.
+    int theFD = ::open(inPath, O_RDONLY);
+    if (theFD == -1)
+        return NULL;
+        
+    struct stat theStat;
+    if ((::fstat(theFD, &theStat) != 0) || !S_ISREG(theStat.st_mode) || (theStat.st_size <= 0)
+        || ((UInt64)theStat.st_size != (UInt64)(size_t)theStat.st_size)) // too big for this address space
+    {
+        (void)::close(theFD);
+        return NULL;
+    }
+    
+    OSMutexLocker locker(&sMutex);
+    for (OSQueueIter theIter(&sFileQueue); !theIter.IsDone(); )
+    {
+        QTFile_MappedFile* theFile = (QTFile_MappedFile*)theIter.GetCurrent()->GetEnclosingObject();
+        theIter.Next();
+        
+        if (::strcmp(theFile->fPath, inPath) != 0)
+            continue;
+            
+        if ((theFile->fDevice == (UInt64)theStat.st_dev) && (theFile->fInode == (UInt64)theStat.st_ino)
+            && (theFile->fLength == (UInt64)theStat.st_size) && (theFile->fModDate == (SInt64)theStat.st_mtime))
+        {
+            (void)::close(theFD);
+            theFile->fRefCount++;
+            
+            //Most recently used go to the back of the queue
+            sFileQueue.Remove(&theFile->fQueueElem);
+            sFileQueue.EnQueue(&theFile->fQueueElem);
+            return theFile;
+        }
+        
+        //This file has been replaced. Clients still reading the old one keep
+        //its mapping until they are done with it.
+        if (theFile->fRefCount == 0)
+            delete theFile;
+    }
+    
+    UInt64 theLength = (UInt64)theStat.st_size;
+    EvictUnused(theLength);
+    if ((sNumMappedBytes + theLength) > sMaxMappedBytes)
+    {
+        (void)::close(theFD);
+        return NULL;
+    }
+    
+    void* theData = ::mmap(NULL, (size_t)theLength, PROT_READ, MAP_SHARED, theFD, 0);
+    (void)::close(theFD);
+    if (theData == MAP_FAILED)
+        return NULL;
+        
+    QTFile_MappedFile* theFile = NEW QTFile_MappedFile();
+    theFile->fPath = NEW char[::strlen(inPath) + 1];
+    ::strcpy(theFile->fPath, inPath);
+    theFile->fDevice = (UInt64)theStat.st_dev;
+    theFile->fInode = (UInt64)theStat.st_ino;
+    theFile->fLength = theLength;
+    theFile->fModDate = (SInt64)theStat.st_mtime;
+    theFile->fData = (char*)theData;
+    theFile->fRefCount = 1;
+    
+    sNumMappedBytes += theLength;
+    sFileQueue.EnQueue(&theFile->fQueueElem);
+    return theFile;
+#endif
+}
+
+void QTFile_MappedFile::Release(QTFile_MappedFile* inFile)
+{
+    if (inFile == NULL)
+        return;
+        
+    OSMutexLocker locker(&sMutex);
+    Assert(inFile->fRefCount > 0);
+    inFile->fRefCount--;
+    if (inFile->fRefCount == 0)
+        EvictUnused(0);
+}
+
+void QTFile_MappedFile::GetCacheStats(UInt32* outNumFiles, UInt64* outNumMappedBytes)
+{
+    OSMutexLocker locker(&sMutex);
+    *outNumFiles = sFileQueue.GetLength();
+    *outNumMappedBytes = sNumMappedBytes;
+}
+
+void QTFile_MappedFile::EvictUnused(UInt64 inNumBytesNeeded)
+{
+    //
+    // Unmap files no one is reading, least recently used first, until there is
+    // room. Called with sMutex held.
+    UInt64 theMaxMappedBytes = sEnabled ? sMaxMappedBytes : 0;
+    for (OSQueueIter theIter(&sFileQueue); !theIter.IsDone(); )
+    {
+        if ((sNumMappedBytes + inNumBytesNeeded) <= theMaxMappedBytes)
+            break;
+            
+        QTFile_MappedFile* theFile = (QTFile_MappedFile*)theIter.GetCurrent()->GetEnclosingObject();
+        theIter.Next();
+        if (theFile->fRefCount == 0)
+            delete theFile;
+    }
+}
+
+QTFile_MappedFile::~QTFile_MappedFile()
+{
+    Assert(fRefCount == 0);
+#ifndef __Win32__
+    if (fData != NULL)
+        (void)::munmap(fData, (size_t)fLength);
+#endif
+    sNumMappedBytes -= fLength;
+    sFileQueue.Remove(&fQueueElem);
+    delete [] fPath;
+}
+
+Bool16 QTFile_MappedFile::Read(UInt64 inPosition, void* inBuffer, UInt32 inLength)
+{
+    if ((inPosition > fLength) || (inLength > (fLength - inPosition)))
+        return false;
+        
+    ::memcpy(inBuffer, fData + inPosition, inLength);
+    return true;
+}
+
+const char* QTFile_MappedFile::GetData(UInt64 inPosition, UInt32 inLength)
+{
+    if ((inPosition > fLength) || (inLength > (fLength - inPosition)))
+        return NULL;
+        
+    return fData + inPosition;
+}
+
+void QTFile_MappedFile::WillNeed(UInt64 inPosition, UInt64 inLength)
+{
+#ifndef __Win32__
+    if (inPosition >= fLength)
+        return;
+    if (inLength > (fLength - inPosition))
+        inLength = fLength - inPosition;
+        
+    //madvise wants a page aligned address
+    UInt64 theStart = inPosition - (inPosition % sPageSize);
+    (void)::madvise(fData + theStart, (size_t)(inPosition + inLength - theStart), MADV_WILLNEED);
+#endif
+}
+
+
 // -------------------------------------
 // Class state cookie
 //
 
 QTFile_FileControlBlock::QTFile_FileControlBlock(void)
-    : fDataFD(NULL), fDataBufferPool(NULL),
+    : fDataFD(NULL),
+      fMappedFile(NULL),
+      fReadAheadStart(0), fReadAheadEnd(0),
+      fDataBufferPool(NULL),
       fDataBufferSize(0), fDataBufferPosStart(0), fDataBufferPosEnd(0),
       fCurrentDataBuffer(NULL), fPreviousDataBuffer(NULL),
       fCurrentDataBufferLength(0), fPreviousDataBufferLength(0),
@@ -78,6 +276,7 @@ QTFile_FileControlBlock::~QTFile_FileControlBlock(void)
 {
     if( fDataBufferPool != NULL )
         delete[] fDataBufferPool;
+    QTFile_MappedFile::Release(fMappedFile);
 #if DSS_USE_API_CALLBACKS
     (void)QTSS_CloseFileObject(fDataFD);
 #endif
@@ -93,6 +292,10 @@ void QTFile_FileControlBlock::Set( char * DataPath)
     fDataFD.Set(DataPath);
 #endif
 
+    QTFile_MappedFile::Release(fMappedFile);
+    fMappedFile = NULL;
+    if (this->IsValid())
+        fMappedFile = QTFile_MappedFile::Acquire(DataPath);
 }
 
 Bool16 QTFile_FileControlBlock::ReadInternal(FILE_SOURCE *dataFD, UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32 *inReadLenPtr)
@@ -121,7 +324,43 @@ Bool16 QTFile_FileControlBlock::ReadInternal(FILE_SOURCE *dataFD, UInt64 inPosit
 }
 
 
-Bool16 QTFile_FileControlBlock::Read(FILE_SOURCE *dflt, UInt64 inPosition, void* inBuffer, UInt32 inLength)
+void QTFile_FileControlBlock::AdviseMapped(QTFile_MappedFile* inMapping, UInt64 inPosition, UInt32 inLength)
+{
+    //
+    // Keep the OS reading ahead of this client's playhead. The window moves
+    // when a read gets into its second half or lands outside it (a seek).
+    UInt64 theEnd = inPosition + inLength;
+    if ((inPosition < fReadAheadStart) || ((theEnd + (kMappedReadAheadBytes / 2)) > fReadAheadEnd))
+    {
+        //Don't advise again what the old window already covered
+        UInt64 theAdviseStart = inPosition;
+        if ((inPosition >= fReadAheadStart) && (inPosition < fReadAheadEnd))
+            theAdviseStart = fReadAheadEnd;
+            
+        fReadAheadStart = inPosition;
+        fReadAheadEnd = theEnd + kMappedReadAheadBytes;
+        inMapping->WillNeed(theAdviseStart, fReadAheadEnd - theAdviseStart);
+    }
+}
+
+Bool16 QTFile_FileControlBlock::ReadMapped(QTFile_MappedFile* inMapping, UInt64 inPosition, void* inBuffer, UInt32 inLength)
+{
+    this->AdviseMapped(inMapping, inPosition, inLength);
+    return inMapping->Read(inPosition, inBuffer, inLength);
+}
+
+Bool16 QTFile_FileControlBlock::Reference(UInt64 inPosition, UInt32 inLength, const char** outData, QTFile_MappedFile* inMovieMapping)
+{
+    QTFile_MappedFile* theMapping = this->IsValid() ? fMappedFile : inMovieMapping;
+    if (theMapping == NULL)
+        return false;
+        
+    this->AdviseMapped(theMapping, inPosition, inLength);
+    *outData = theMapping->GetData(inPosition, inLength);
+    return *outData != NULL;
+}
+
+Bool16 QTFile_FileControlBlock::Read(FILE_SOURCE *dflt, UInt64 inPosition, void* inBuffer, UInt32 inLength, QTFile_MappedFile* inMovieMapping)
 {
     // Temporary vars
     UInt32 rcSize;
@@ -138,6 +377,12 @@ Bool16 QTFile_FileControlBlock::Read(FILE_SOURCE *dflt, UInt64 inPosition, void*
         dataFD = &fDataFD;
     else
         dataFD = dflt;
+        
+    //
+    // A mapped file is shared by every client, so there's nothing to buffer
+    QTFile_MappedFile* theMapping = this->IsValid() ? fMappedFile : inMovieMapping;
+    if (theMapping != NULL)
+        return this->ReadMapped(theMapping, inPosition, inBuffer, inLength);
 
     if  (
             ( !fCacheEnabled) ||    // file control block caching disabled
@@ -25,6 +25,9 @@
 //
 // QTFile_FileControlBlock:
 //   All the per-client stuff for QTFile.
+//
+// QTFile_MappedFile:
+//   A movie file mapped into memory once and read by every client.
 
 
 #ifndef _QTFILE_FILECONTROLBLOCK_H_
@@ -34,6 +37,8 @@
 // Includes
 #include "OSHeaders.h"
 #include "OSFileSource.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
 
 #if DSS_USE_API_CALLBACKS
 #include "QTSS.h"
@@ -45,6 +50,69 @@
     #define FILE_SOURCE OSFileSource
 #endif
 
+//
+// Process-wide cache of read-only movie file mappings. Every QTFile and
+// QTFile_FileControlBlock reading the same file shares one mapping, so popular
+// titles are read from the page cache with no per-client buffers. Mappings are
+// found by path plus the file's device, inode, length and mod date, so a file
+// that is replaced gets a fresh mapping. Mappings no longer in use stay around
+// until the total mapped bytes go over the limit, least recently used first.
+class QTFile_MappedFile {
+
+ public:
+    //
+    // Mapping is off until this turns it on. Turning it off only stops new
+    // files from being mapped.
+    static void SetCacheParams(Bool16 inEnabled, UInt64 inMaxMappedBytes);
+    
+    //
+    // Returns the mapping of the file at this path, or NULL if mapping is off,
+    // the file can't be mapped, or mapping it would go over the limit.
+    // Balance with Release.
+    static QTFile_MappedFile* Acquire(const char* inPath);
+    static void Release(QTFile_MappedFile* inFile);
+    
+    //
+    // How many files are mapped and how many bytes that is, in use or not.
+    static void GetCacheStats(UInt32* outNumFiles, UInt64* outNumMappedBytes);
+    
+    UInt64 GetLength() { return fLength; }
+    
+    //
+    // Copies out of the mapping. Fails if any of it is past the end of the file.
+    Bool16 Read(UInt64 inPosition, void* inBuffer, UInt32 inLength);
+    
+    //
+    // Points into the mapping instead, or returns NULL if any of it is past
+    // the end of the file. Good for as long as the caller holds the mapping.
+    const char* GetData(UInt64 inPosition, UInt32 inLength);
+    
+    //
+    // Asks the OS to start bringing this part of the file in.
+    void WillNeed(UInt64 inPosition, UInt64 inLength);
+    
+private:
+    QTFile_MappedFile() : fQueueElem(this), fPath(NULL), fDevice(0), fInode(0), fLength(0), fModDate(0), fData(NULL), fRefCount(0) {}
+    ~QTFile_MappedFile();
+    
+    static void EvictUnused(UInt64 inNumBytesNeeded);
+    
+    OSQueueElem fQueueElem;     // in sFileQueue, least recently used at the head
+    char        *fPath;
+    UInt64      fDevice, fInode;
+    UInt64      fLength;
+    SInt64      fModDate;
+    char        *fData;
+    UInt32      fRefCount;
+    
+    static OSMutex  sMutex;
+    static OSQueue  sFileQueue;
+    static Bool16   sEnabled;
+    static UInt64   sMaxMappedBytes;
+    static UInt64   sNumMappedBytes;
+    static UInt32   sPageSize;
+};
+
 //
 // Class state cookie
 class QTFile_FileControlBlock {
@@ -62,7 +130,13 @@ class QTFile_FileControlBlock {
     //following position in the file
     // void Advise(OSFileSource *dflt, UInt64 advisePos, UInt32 adviseAmt);
     
-    Bool16 Read(FILE_SOURCE *dflt, UInt64 inPosition, void* inBuffer, UInt32 inLength);
+    //inMovieMapping is used, if there is one, whenever dflt would be. A mapped
+    //file is copied straight out of the mapping; use Reference to avoid the copy.
+    Bool16 Read(FILE_SOURCE *dflt, UInt64 inPosition, void* inBuffer, UInt32 inLength, QTFile_MappedFile* inMovieMapping = NULL);
+    
+    //Like Read, but points at the data in whichever mapping Read would copy it
+    //from. Returns false if that file isn't mapped.
+    Bool16 Reference(UInt64 inPosition, UInt32 inLength, const char** outData, QTFile_MappedFile* inMovieMapping = NULL);
 
     Bool16 ReadInternal(FILE_SOURCE *dataFD, UInt64 inPosition, void* inBuffer, UInt32 inLength, UInt32 *inReadLenPtr = NULL);
 
@@ -93,8 +167,20 @@ private:
     {   
         kMaxDefaultBlocks           = 8,
         kDataBufferUnitSizeExp      = 15,   // 32Kbytes
-        kBlockByteSize = ( 1 << kDataBufferUnitSizeExp)
+        kBlockByteSize = ( 1 << kDataBufferUnitSizeExp),
+        kMappedReadAheadBytes = 8 * kBlockByteSize
     };
+    
+    //
+    // Mapping of the file this control block was Set to, if it has its own
+    QTFile_MappedFile   *fMappedFile;
+    
+    //
+    // This client's read-ahead window in whichever mapping it reads from
+    UInt64              fReadAheadStart, fReadAheadEnd;
+    
+    Bool16 ReadMapped(QTFile_MappedFile* inMapping, UInt64 inPosition, void* inBuffer, UInt32 inLength);
+    void AdviseMapped(QTFile_MappedFile* inMapping, UInt64 inPosition, UInt32 inLength);
     //
     // Data buffer cache
     char                *fDataBufferPool;
@@ -139,7 +139,12 @@ QTHintTrack_HintTrackControlBlock::QTHintTrack_HintTrackControlBlock(QTFile_File
       fSyncSampleCursor(0),
       
       fCurrentPacketNumber(0),
-      fCurrentPacketPosition(0)
+      fCurrentPacketPosition(0),
+      
+      fPacketVector(NULL),
+      fPacketVectorMax(0), fPacketVectorLen(0),
+      fPacketVectorBufferStart(NULL),
+      fPacketVectorRefLength(0)
 {
     fMediaTrackSTSC_STCB = NULL;
     fMediaTrackRefIndex = -2;
@@ -960,7 +965,7 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
                 {   return errInvalidQuickTimeFile;
                 }
 
-                if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+                if( !this->ReadMediaData(htcb, track, sampleDescriptionIndex, dataOffset, readLength, ppPacketBufOut) )
                     return (errInvalidQuickTimeFile);
                 totalMediaReadTime += GetMicroseconds() - readStart;
             #else
@@ -970,14 +975,11 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
                 {   return errInvalidQuickTimeFile;
                 }
                     
-                if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+                if( !this->ReadMediaData(htcb, track, sampleDescriptionIndex, dataOffset, readLength, ppPacketBufOut) )
                     return (errInvalidQuickTimeFile);
                     
             #endif
     
-                    
-            *ppPacketBufOut += readLength;  // point to remainder of buffer;    
-    
     
     
             while (remainingLength > 0)  // loop if packet is split across more than just two chunks
@@ -1025,7 +1027,7 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
                     {   return errInvalidQuickTimeFile;
                     }
 
-                    if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+                    if( !this->ReadMediaData(htcb, track, sampleDescriptionIndex, dataOffset, readLength, ppPacketBufOut) )
                            return errInvalidQuickTimeFile;
                     totalMediaReadTime += GetMicroseconds() - readStart;
                 #else
@@ -1033,12 +1035,10 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
                     {   return errInvalidQuickTimeFile;
                     }
 
-                    if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+                    if( !this->ReadMediaData(htcb, track, sampleDescriptionIndex, dataOffset, readLength, ppPacketBufOut) )
                     {   return errInvalidQuickTimeFile; 
                     }
                 #endif       
-                
-                    *ppPacketBufOut += readLength;  // point to remainder of buffer;    
             }
     
             
@@ -1052,10 +1052,8 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
             }
 
 
-            if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+            if( !this->ReadMediaData(htcb, track, sampleDescriptionIndex, dataOffset, readLength, ppPacketBufOut) )
                 return (errInvalidQuickTimeFile);
-
-            *ppPacketBufOut += readLength;  // point to remainder of buffer;    
         }
 
 
@@ -1135,6 +1133,40 @@ QTTrack::ErrorCode QTHintTrack::GetSampleData( QTHintTrack_HintTrackControlBlock
 }
 
 
+Bool16 QTHintTrack::ReadMediaData( QTHintTrack_HintTrackControlBlock * htcb, QTTrack * track, UInt32 sampleDescriptionIndex, UInt64 dataOffset, UInt32 readLength, char **ppPacketBufOut )
+{
+    //
+    // A reference takes up to three vectors: what has been written to the
+    // buffer so far, the reference, and what gets written after it.
+    const char* theData = NULL;
+    if (   (htcb->fPacketVectorLen + 3 <= htcb->fPacketVectorMax)
+        && (readLength >= kMinPacketReferenceLength)
+        && track->Reference(sampleDescriptionIndex, dataOffset, readLength, &theData, htcb->fFCB)
+       )
+    {
+        if (*ppPacketBufOut > htcb->fPacketVectorBufferStart)
+        {
+            htcb->fPacketVector[htcb->fPacketVectorLen].iov_base = htcb->fPacketVectorBufferStart;
+            htcb->fPacketVector[htcb->fPacketVectorLen].iov_len = *ppPacketBufOut - htcb->fPacketVectorBufferStart;
+            htcb->fPacketVectorLen++;
+            htcb->fPacketVectorBufferStart = *ppPacketBufOut;
+        }
+        
+        htcb->fPacketVector[htcb->fPacketVectorLen].iov_base = (char*)theData;
+        htcb->fPacketVector[htcb->fPacketVectorLen].iov_len = readLength;
+        htcb->fPacketVectorLen++;
+        htcb->fPacketVectorRefLength += readLength;
+        return true;
+    }
+    
+    if( !track->Read(sampleDescriptionIndex, dataOffset, *ppPacketBufOut, readLength, htcb->fFCB) )
+        return false;
+        
+    *ppPacketBufOut += readLength;  // point to remainder of buffer;
+    return true;
+}
+
+
 QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumber, char * buffer, UInt32 * length
                         , Float64 * transmitTime, Bool16 dropBFrames, Bool16 dropRepeatPackets, UInt32 ssrc, QTHintTrack_HintTrackControlBlock * htcb)
 {
@@ -1237,6 +1269,11 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
     // packet.
     
     pPacketOutBuf = buffer;
+    
+    Assert((htcb->fPacketVector == NULL) || (htcb->fRTPMetaInfoFieldArray == NULL));
+    htcb->fPacketVectorLen = 0;
+    htcb->fPacketVectorBufferStart = buffer;
+    htcb->fPacketVectorRefLength = 0;
 
     //
     // Add in the RTP header.
@@ -1416,9 +1453,19 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
 
     *length = packetSize;
     
+    //
+    // The last piece of the vector is whatever is left in the buffer. There is
+    // always at least the RTP header.
+    if ( (htcb->fPacketVector != NULL) && (pPacketOutBuf > htcb->fPacketVectorBufferStart) )
+    {
+        htcb->fPacketVector[htcb->fPacketVectorLen].iov_base = htcb->fPacketVectorBufferStart;
+        htcb->fPacketVector[htcb->fPacketVectorLen].iov_len = pPacketOutBuf - htcb->fPacketVectorBufferStart;
+        htcb->fPacketVectorLen++;
+    }
+    
     //
     // Always track packet number and packet position.
-    UInt16 thePacketDataLen = pPacketOutBuf - endOfMetaInfo;
+    UInt16 thePacketDataLen = (pPacketOutBuf - endOfMetaInfo) + htcb->fPacketVectorRefLength;
     htcb->fCurrentPacketNumber++;
     htcb->fCurrentPacketPosition += thePacketDataLen;
         
@@ -1444,6 +1491,35 @@ QTTrack::ErrorCode QTHintTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumb
     return err;
 }
 
+QTTrack::ErrorCode QTHintTrack::GetPacketFlags(UInt32 sampleNumber, UInt16 packetNumber, Bool16 * isRepeatPacket, Bool16 * isBFramePacket, QTHintTrack_HintTrackControlBlock * htcb)
+{
+    char*       buf;
+    UInt32      bufLen;
+    char*       pSampleBuffer;
+    UInt16      entryCount;
+    QTHintTrackRTPHeaderData    hdrData;
+
+    Assert(htcb != NULL);
+
+    //
+    // Find this packet's header the same way GetPacket does.
+    if( !this->GetSamplePtr(sampleNumber, &buf, &bufLen, htcb) )
+        return errInvalidQuickTimeFile;
+
+    MOVE_WORD( entryCount, (char *)buf + 0);
+    entryCount = ntohs(entryCount);
+    if( (packetNumber-1) > entryCount )
+        return errInvalidQuickTimeFile;
+
+    QTTrack::ErrorCode err = this->GetSamplePacketPtr( &pSampleBuffer, sampleNumber, packetNumber, hdrData, *htcb);
+    if ( err != errNoError )
+        return err;
+
+    *isRepeatPacket = (hdrData.hintFlags & kRepeatPacketMask) != 0;
+    *isBFramePacket = (hdrData.hintFlags & kBFrameBitMask) != 0;
+    return errNoError;
+}
+
 void QTHintTrack::WriteMetaInfoField(   RTPMetaInfoPacket::FieldIndex inFieldIndex,
                                         RTPMetaInfoPacket::FieldID inFieldID,
                                         void* inFieldData, UInt32 inFieldLen, char** ioBuffer)
@@ -38,6 +38,10 @@
 #include "RTPMetaInfoPacket.h"
 #include "MyAssert.h"
 
+#ifndef __Win32__
+#include <sys/uio.h>
+#endif
+
 
 //
 // External classes
@@ -82,6 +86,18 @@ public:
             fIsVideo = isVideo;
         }
         
+    //
+    // If you want GetPacket to leave media data in mapped movie files where it
+    // is rather than copying it into the packet buffer, give this HTCB an array
+    // of inMaxVectors iovecs. GetPacket then describes each packet it builds in
+    // fPacketVector: pieces of the packet buffer (always starting with the RTP
+    // header) and of the movie, in order. Pass NULL to turn this off. Not for
+    // RTP-Meta-Info packets.
+    void SetupPacketVector(struct iovec* inVector, UInt32 inMaxVectors)
+        {   fPacketVector = inVector; fPacketVectorMax = (inVector != NULL) ? inMaxVectors : 0;
+            fPacketVectorLen = 0;
+        }
+        
     //
     // File control block
     QTFile_FileControlBlock *fFCB;
@@ -117,6 +133,13 @@ public:
     
     SInt32              fMediaTrackRefIndex;
     QTAtom_stsc_SampleTableControlBlock * fMediaTrackSTSC_STCB;
+    
+    //
+    // Packet vector (see SetupPacketVector)
+    struct iovec*       fPacketVector;
+    UInt32              fPacketVectorMax, fPacketVectorLen;
+    char*               fPacketVectorBufferStart;   // start of the packet buffer not in fPacketVector yet
+    UInt32              fPacketVectorRefLength;     // bytes of this packet left in the movie
  
 };
 
@@ -184,6 +207,13 @@ public:
                                   UInt32 SSRC = 0,
                                   QTHintTrack_HintTrackControlBlock * HTCB = NULL);
 
+    //
+    // Whether the hint track marks this packet as a repeat packet or as
+    // B-frame data, which GetPacket drops when asked to.
+    ErrorCode   GetPacketFlags(UInt32 SampleNumber, UInt16 PacketNumber,
+                                  Bool16 * IsRepeatPacket, Bool16 * IsBFramePacket,
+                                  QTHintTrack_HintTrackControlBlock * HTCB);
+
     inline ErrorCode    GetSampleData( QTHintTrack_HintTrackControlBlock * htcb, char **buffPtr, char **ppPacketBufOut, UInt32 sampleNumber, UInt16 packetNumber, UInt32 buffOutLen ); 
 
     //
@@ -214,6 +244,15 @@ protected:
         kMaxHintTrackRefs = 1024
     };
     
+    enum
+    {
+        kMinPacketReferenceLength = 64  // smaller pieces of media are cheaper to copy than to send as their own iovec
+    };
+    
+    //
+    // Puts media data in the packet, by reference if the HTCB has a packet vector.
+    inline Bool16       ReadMediaData( QTHintTrack_HintTrackControlBlock * htcb, QTTrack * track, UInt32 sampleDescriptionIndex, UInt64 dataOffset, UInt32 readLength, char **ppPacketBufOut );
+    
     //
     // Protected member variables.
     QTAtom_hinf         *fHintInfoAtom;
@@ -0,0 +1,276 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPCacheFile:
+//   The pre-built RTP packets of a hinted movie.
+
+
+// -------------------------------------
+// Includes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+
+#include "OS.h"
+#include "OSMemory.h"
+
+#include "QTRTPCacheFile.h"
+
+#include <fcntl.h>
+
+#ifndef __Win32__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#endif
+
+
+
+// -------------------------------------
+// Field readers; nothing in the file is aligned.
+//
+static inline UInt16 ReadUInt16(const char* inField)
+{
+    UInt16 theValue;
+    ::memcpy(&theValue, inField, sizeof(theValue));
+    return ntohs(theValue);
+}
+
+static inline UInt32 ReadUInt32(const char* inField)
+{
+    UInt32 theValue = 0;
+    ::memcpy(&theValue, inField, 4);
+    return ntohl(theValue);
+}
+
+static inline UInt64 ReadUInt64(const char* inField)
+{
+    SInt64 theValue;
+    ::memcpy(&theValue, inField, sizeof(theValue));
+    return (UInt64)OS::NetworkToHostSInt64(theValue);
+}
+
+static inline Float64 ReadFloat64(const char* inField)
+{
+    UInt64 theBits = ReadUInt64(inField);
+    Float64 theValue;
+    ::memcpy(&theValue, &theBits, sizeof(theValue));
+    return theValue;
+}
+
+//
+// True if inNumEntries entries of inEntrySize starting at inOffset fit in
+// a file of inFileLength.
+static inline Bool16 TableFits(UInt64 inOffset, UInt64 inNumEntries, UInt64 inEntrySize, UInt64 inFileLength)
+{
+    if (inOffset > inFileLength)
+        return false;
+    return inNumEntries <= ((inFileLength - inOffset) / inEntrySize);
+}
+
+
+
+// -------------------------------------
+// QTRTPCacheTrack
+//
+Bool16 QTRTPCacheTrack::GetNumPackets(UInt32 sampleNumber, UInt16 * numPackets)
+{
+    if ( (sampleNumber < 1) || (sampleNumber > fNumSamples) )
+        return false;
+
+    const char* theEntry = fSampleTable + ((sampleNumber - 1) * QTRTPCacheFile::kSampleEntrySize);
+    UInt32 theNumPackets = ReadUInt32(theEntry + 4);
+    if ( theNumPackets > 0xFFFF )
+        return false;
+
+    *numPackets = (UInt16)theNumPackets;
+    return true;
+}
+
+Bool16 QTRTPCacheTrack::GetPacket(UInt32 sampleNumber, UInt16 packetNumber,
+                                  const char ** packet, UInt32 * length,
+                                  Float64 * transmitTime, UInt16 * flags)
+{
+    if ( (sampleNumber < 1) || (sampleNumber > fNumSamples) )
+        return false;
+
+    //
+    // Find the packet's entry.
+    const char* theSampleEntry = fSampleTable + ((sampleNumber - 1) * QTRTPCacheFile::kSampleEntrySize);
+    UInt32 theFirstPacket = ReadUInt32(theSampleEntry);
+    UInt32 theNumPackets = ReadUInt32(theSampleEntry + 4);
+    if ( (packetNumber < 1) || (packetNumber > theNumPackets) )
+        return false;
+
+    UInt32 thePacketIndex = theFirstPacket + (packetNumber - 1);
+    if ( (thePacketIndex < theFirstPacket) || (thePacketIndex >= fNumPackets) )
+        return false;
+
+    const char* thePacketEntry = fPacketTable + ((UInt64)thePacketIndex * QTRTPCacheFile::kPacketEntrySize);
+    UInt16 theFlags = ReadUInt16(thePacketEntry + 18);
+    if ( theFlags & kUncachedPacket )
+        return false;
+
+    //
+    // Make sure the packet itself is in the file and has an RTP header.
+    UInt64 theDataOffset = ReadUInt64(thePacketEntry + 8);
+    UInt16 theLength = ReadUInt16(thePacketEntry + 16);
+    if ( (theLength < 12) || !TableFits(theDataOffset, theLength, 1, fFileLength) )
+        return false;
+
+    *packet = fFileData + theDataOffset;
+    *length = theLength;
+    *transmitTime = ReadFloat64(thePacketEntry);
+    *flags = theFlags;
+    return true;
+}
+
+
+
+// -------------------------------------
+// QTRTPCacheFile
+//
+QTRTPCacheFile::QTRTPCacheFile(void)
+    : fData(NULL)
+    , fLength(0)
+    , fNumTracks(0)
+    , fTracks(NULL)
+{
+}
+
+QTRTPCacheFile::~QTRTPCacheFile(void)
+{
+    if( fTracks != NULL )
+        delete [] fTracks;
+
+#ifndef __Win32__
+    if( fData != NULL )
+        (void)::munmap(fData, (size_t)fLength);
+#endif
+}
+
+char* QTRTPCacheFile::GetCacheFilePath(const char * moviePath)
+{
+    static const char kCacheFileSuffix[] = ".rtpcache";
+
+    char* theCachePath = NEW char[::strlen(moviePath) + sizeof(kCacheFileSuffix)];
+    ::strcpy(theCachePath, moviePath);
+    ::strcat(theCachePath, kCacheFileSuffix);
+    return theCachePath;
+}
+
+QTRTPCacheFile* QTRTPCacheFile::Open(const char * cacheFilePath, SInt64 movieModDate)
+{
+#ifdef __Win32__
+    return NULL;
+#else
+    //
+    // Map the whole file.
+    int theFD = ::open(cacheFilePath, O_RDONLY);
+    if (theFD == -1)
+        return NULL;
+
+    struct stat theStat;
+    if ((::fstat(theFD, &theStat) != 0) || !S_ISREG(theStat.st_mode) || (theStat.st_size < kFileHeaderSize)
+        || ((UInt64)theStat.st_size != (UInt64)(size_t)theStat.st_size)) // too big for this address space
+    {
+        (void)::close(theFD);
+        return NULL;
+    }
+
+    UInt64 theLength = (UInt64)theStat.st_size;
+    void* theData = ::mmap(NULL, (size_t)theLength, PROT_READ, MAP_SHARED, theFD, 0);
+    (void)::close(theFD);
+    if (theData == MAP_FAILED)
+        return NULL;
+
+    QTRTPCacheFile* theFile = NEW QTRTPCacheFile();
+    theFile->fData = (char*)theData;
+    theFile->fLength = theLength;
+
+    //
+    // Check the header. A cache built from an older copy of the movie is
+    // no good to us.
+    const char* theHeader = theFile->fData;
+    if ( (ReadUInt32(theHeader) != (UInt32)kFileType) || (ReadUInt32(theHeader + 4) != kFileVersion)
+        || ((SInt64)ReadUInt64(theHeader + 8) != movieModDate) )
+    {
+        delete theFile;
+        return NULL;
+    }
+
+    theFile->fNumTracks = ReadUInt32(theHeader + 16);
+    if ( !TableFits(kFileHeaderSize, theFile->fNumTracks, kTrackHeaderSize, theLength) )
+    {
+        delete theFile;
+        return NULL;
+    }
+
+    //
+    // Read the track headers. Packet data is checked as it is used, but the
+    // tables have to be all there.
+    theFile->fTracks = NEW QTRTPCacheTrack[theFile->fNumTracks];
+    for (UInt32 trackIndex = 0; trackIndex < theFile->fNumTracks; trackIndex++)
+    {
+        const char* theTrackHeader = theFile->fData + kFileHeaderSize + (trackIndex * kTrackHeaderSize);
+        QTRTPCacheTrack* theTrack = &theFile->fTracks[trackIndex];
+
+        theTrack->fFileData = theFile->fData;
+        theTrack->fFileLength = theLength;
+        theTrack->fTrackID = ReadUInt32(theTrackHeader);
+        theTrack->fNumSamples = ReadUInt32(theTrackHeader + 4);
+        theTrack->fNumPackets = ReadUInt32(theTrackHeader + 8);
+
+        UInt64 theSampleTableOffset = ReadUInt64(theTrackHeader + 16);
+        UInt64 thePacketTableOffset = ReadUInt64(theTrackHeader + 24);
+        if ( !TableFits(theSampleTableOffset, theTrack->fNumSamples, kSampleEntrySize, theLength)
+            || !TableFits(thePacketTableOffset, theTrack->fNumPackets, kPacketEntrySize, theLength) )
+        {
+            delete theFile;
+            return NULL;
+        }
+
+        theTrack->fSampleTable = theFile->fData + theSampleTableOffset;
+        theTrack->fPacketTable = theFile->fData + thePacketTableOffset;
+    }
+
+    return theFile;
+#endif
+}
+
+QTRTPCacheTrack* QTRTPCacheFile::FindTrack(UInt32 trackID)
+{
+    for (UInt32 trackIndex = 0; trackIndex < fNumTracks; trackIndex++)
+    {
+        if (fTracks[trackIndex].fTrackID == trackID)
+            return &fTracks[trackIndex];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,157 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPCacheFile:
+//   The RTP packets of a hinted movie's hint tracks, built ahead of time by
+//   QTRTPCacheGen and stored next to the movie as "<movie>.rtpcache". The
+//   file is mapped read-only and shared by every client of the movie, so
+//   serving a packet is a table lookup and one copy instead of a walk through
+//   the hint sample and a read from each media track it points at.
+//
+//   Packets are stored exactly as QTHintTrack::GetPacket builds them with an
+//   SSRC of 0, before QTRTPFile adds its sequence number and timestamp
+//   offsets. Everything in the file is in network byte order:
+//
+//     File header (kFileHeaderSize)
+//       UInt32  type                'rtpc'
+//       UInt32  version             kFileVersion
+//       SInt64  movie mod date      QTFile::GetModDate of the movie it was built from
+//       UInt32  number of tracks
+//       UInt32  reserved
+//
+//     Track headers, one per hint track (kTrackHeaderSize each)
+//       UInt32  track ID
+//       UInt32  number of samples
+//       UInt32  number of packets
+//       UInt32  reserved
+//       UInt64  sample table offset
+//       UInt64  packet table offset
+//
+//     Sample table, one per hint sample (kSampleEntrySize each)
+//       UInt32  index of the sample's first packet in the packet table
+//       UInt32  number of packets
+//
+//     Packet table, one per packet (kPacketEntrySize each)
+//       Float64 transmit time       as the bits of an IEEE double
+//       UInt64  packet data offset
+//       UInt16  packet length
+//       UInt16  flags               kRepeatPacket, kBFramePacket, kUncachedPacket
+//       UInt32  reserved
+//
+//   Each track's packet data is contiguous and in packet table order. All
+//   offsets are from the start of the file.
+
+#ifndef QTRTPCacheFile_H
+#define QTRTPCacheFile_H
+
+
+//
+// Includes
+#include "OSHeaders.h"
+
+
+//
+// QTRTPCacheTrack class
+class QTRTPCacheTrack {
+
+public:
+    //
+    // Packet flags
+    enum
+    {
+        kRepeatPacket       = 0x0001,   // the hint track marked it a repeat packet
+        kBFramePacket       = 0x0002,   // the hint track marked it B-frame data
+        kUncachedPacket     = 0x0004    // couldn't be built, so it is left to the hint track
+    };
+
+    //
+    // Return false for anything the file doesn't have, in which case the
+    // caller should ask the hint track.
+    Bool16      GetNumPackets(UInt32 SampleNumber, UInt16 * NumPackets);
+    Bool16      GetPacket(UInt32 SampleNumber, UInt16 PacketNumber,
+                          const char ** Packet, UInt32 * Length,
+                          Float64 * TransmitTime, UInt16 * Flags);
+
+protected:
+    friend class QTRTPCacheFile;
+
+    //
+    // Protected member variables.
+    const char      *fFileData;
+    UInt64          fFileLength;
+
+    UInt32          fTrackID;
+    UInt32          fNumSamples, fNumPackets;
+    const char      *fSampleTable, *fPacketTable;
+};
+
+
+//
+// QTRTPCacheFile class
+class QTRTPCacheFile {
+
+public:
+    //
+    // File format constants
+    enum
+    {
+        kFileType           = FOUR_CHARS_TO_INT('r', 't', 'p', 'c'),
+        kFileVersion        = 1,
+
+        kFileHeaderSize     = 24,
+        kTrackHeaderSize    = 32,
+        kSampleEntrySize    = 8,
+        kPacketEntrySize    = 24
+    };
+
+    //
+    // Maps the cache file at this path. Returns NULL if there isn't one, or
+    // if it is damaged or was built from a different version of the movie.
+    static QTRTPCacheFile*  Open(const char * CacheFilePath, SInt64 MovieModDate);
+                            ~QTRTPCacheFile(void);
+
+    //
+    // Returns NULL if the file has no packets for this track.
+    QTRTPCacheTrack*        FindTrack(UInt32 TrackID);
+
+    //
+    // The cache file of the movie at this path.
+    static char*            GetCacheFilePath(const char * MoviePath); // caller deletes
+
+protected:
+    //
+    // Constructor; use Open.
+                            QTRTPCacheFile(void);
+
+    //
+    // Protected member variables.
+    char                *fData;
+    UInt64              fLength;
+
+    UInt32              fNumTracks;
+    QTRTPCacheTrack     *fTracks;
+};
+
+#endif // QTRTPCacheFile_H
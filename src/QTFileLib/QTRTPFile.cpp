@@ -37,11 +37,14 @@
 #include <string.h>
 
 #include "OSMutex.h"
+#include "OSFileSource.h"
+#include "OSArrayObjectDeleter.h"
 
 #include "QTFile.h"
 
 #include "QTTrack.h"
 #include "QTHintTrack.h"
+#include "QTRTPCacheFile.h"
 
 #include "QTRTPFile.h"
 #include "OSMemory.h"
@@ -75,269 +78,360 @@ const RTPMetaInfoPacket::FieldID QTRTPFile::kMetaInfoFields[] =
 // -------------------------------------
 // Protected cache functions and variables.
 //
-OSMutex                         *QTRTPFile::gFileCacheMutex,
-                                *QTRTPFile::gFileCacheAddMutex;
-QTRTPFile::RTPFileCacheEntry    *QTRTPFile::gFirstFileCacheEntry = NULL;
+// Movies are hashed by path into shards, each with its own mutex, so opening
+// one title doesn't wait on lookups or parsing of titles in other shards.
+// A movie is parsed by the first QTRTPFile that asks for it, with the entry's
+// InitMutex held so later askers wait for it rather than parse it again.
+struct RTPFileCacheShard
+{
+    OSMutex                         fMutex;
+    QTRTPFile::RTPFileCacheEntry*   fBuckets[QTRTPFile::kFileCacheBucketsPerShard];
+    OSQueue                         fUnusedQueue;   // least recently used at the head
+    UInt64                          fParsedBytes;   // of every opened movie in this shard
+    UInt32                          fNumHits, fNumMisses, fNumEvictions;
+};
+
+//
+// Static, so the tools that never call QTRTPFile::Initialize still work.
+static RTPFileCacheShard        gFileCacheShards[QTRTPFile::kNumFileCacheShards];
+UInt64                          QTRTPFile::gMaxParsedBytesPerShard = 0;
+Bool16                          QTRTPFile::gUseRTPCacheFiles = false;
+
+static UInt32 HashMoviePath(const char* inPath)
+{
+    UInt32 theHash = 0;
+    for (const char* theChar = inPath; *theChar != '\0'; theChar++)
+        theHash = (theHash * 31) + (UInt8)*theChar;
+    return theHash;
+}
+
+//
+// Returns the mod date of the file at this path as of now (QTFile only looks
+// at it when it opens the movie), or -1 if it can't be opened.
+static SInt64 GetCurrentModDate(const char* inPath)
+{
+#if DSS_USE_API_CALLBACKS
+    QTSS_Object theFile = NULL;
+    if (QTSS_OpenFileObject((char*)inPath, qtssOpenFileNoFlags, &theFile) != QTSS_NoErr)
+        return -1;
+    SInt64 theModDate = -1;
+    UInt32 theLen = sizeof(theModDate);
+    (void)QTSS_GetValue(theFile, qtssFlObjModDate, 0, (void*)&theModDate, &theLen);
+    (void)QTSS_CloseFileObject(theFile);
+    return theModDate;
+#else
+    OSFileSource theFile(inPath);
+    if (!theFile.IsValid())
+        return -1;
+    return (SInt64)theFile.GetModDate() * 1000;
+#endif
+}
+
+//
+// What a cached movie counts against the limit. The sample tables QTFile
+// parses all live in the moov atom, so its size is a good measure.
+static UInt64 GetParsedBytes(QTFile* inFile)
+{
+    QTFile::AtomTOCEntry* theMovieAtom = NULL;
+    UInt64 theParsedBytes = sizeof(QTFile);
+    if (inFile->FindTOCEntry("moov", &theMovieAtom))
+        theParsedBytes += theMovieAtom->AtomDataLength;
+    return theParsedBytes;
+}
 
 void QTRTPFile::Initialize(void)
 {
-    QTRTPFile::gFileCacheMutex = NEW OSMutex();
-    QTRTPFile::gFileCacheAddMutex = NEW OSMutex();
+    //The file cache is statically allocated and starts out empty
 }
 
+void QTRTPFile::SetFileCacheParams(UInt64 inMaxParsedBytes)
+{
+    gMaxParsedBytesPerShard = inMaxParsedBytes / kNumFileCacheShards;
+    
+    //The limit may have gone down
+    for (UInt32 theShard = 0; theShard < kNumFileCacheShards; theShard++)
+    {
+        OSMutexLocker locker(&gFileCacheShards[theShard].fMutex);
+        EvictUnusedFiles(&gFileCacheShards[theShard]);
+    }
+}
 
-QTRTPFile::ErrorCode QTRTPFile::new_QTFile(const char * filePath, QTFile ** theQTFile, Bool16 debugFlag, Bool16 deepDebugFlag)
+void QTRTPFile::SetRTPCacheFileParams(Bool16 inEnabled)
+{
+    //Movies already in the file cache keep what they have
+    gUseRTPCacheFiles = inEnabled;
+}
+
+void QTRTPFile::GetFileCacheStats(UInt32* outHits, UInt32* outMisses, UInt32* outEvictions)
+{
+    *outHits = *outMisses = *outEvictions = 0;
+    for (UInt32 theShard = 0; theShard < kNumFileCacheShards; theShard++)
+    {
+        OSMutexLocker locker(&gFileCacheShards[theShard].fMutex);
+        *outHits += gFileCacheShards[theShard].fNumHits;
+        *outMisses += gFileCacheShards[theShard].fNumMisses;
+        *outEvictions += gFileCacheShards[theShard].fNumEvictions;
+    }
+}
+
+
+QTRTPFile::ErrorCode QTRTPFile::new_QTFile(const char * filePath, QTFile ** theQTFile, RTPFileCacheEntry ** cacheEntry, Bool16 debugFlag, Bool16 deepDebugFlag)
 {
     // Temporary vars
     QTFile::ErrorCode   rcFile;
 
     // General vars
-    OSMutexLocker       fileCacheAddMutex(QTRTPFile::gFileCacheAddMutex);
-
     QTRTPFile::RTPFileCacheEntry    *fileCacheEntry;
     
         
     //
     // Find and return the QTFile object out of our cache, if it exists.
-    if( QTRTPFile::FindAndRefcountFileCacheEntry(filePath, &fileCacheEntry) ) 
+    if( QTRTPFile::FindOrAddFileCacheEntry(filePath, &fileCacheEntry) ) 
     {
-        fileCacheAddMutex.Unlock();
-    
-        fileCacheEntry->InitMutex->Lock();  // Guaranteed to block as the mutex
-                                            // is acquired before it is added to
-                                            // the list.
+        fileCacheEntry->InitMutex->Lock();  // Blocks until whoever added the
+                                            // entry is done opening the movie.
         fileCacheEntry->InitMutex->Unlock();// Because we don't actually need it.
     
+        //
+        // It couldn't be opened; give up our reference and fail the same way.
+        if( fileCacheEntry->File == NULL )
+        {
+            ErrorCode theErr = fileCacheEntry->InitErr;
+            QTRTPFile::ReleaseFileCacheEntry(fileCacheEntry);
+            return theErr;
+        }
+        
         *theQTFile = fileCacheEntry->File;
-        Assert(*theQTFile);
+        *cacheEntry = fileCacheEntry;
         
         return errNoError;
     }
 
 
     //
-    // Construct our file object.
+    // We added the entry, and hold its InitMutex. Construct our file object.
     *theQTFile = NEW QTFile(debugFlag, deepDebugFlag);
-    if( *theQTFile == NULL )
-        return errInternalError;
         
     //
     // Open the specified movie.
     if( (rcFile = (*theQTFile)->Open(filePath)) != QTFile::errNoError ) 
     {
         delete *theQTFile;
+        *theQTFile = NULL;
         
         switch( rcFile ) 
         {
             case errFileNotFound:
-                return errFileNotFound;
+                fileCacheEntry->InitErr = errFileNotFound;
+                break;
                 
             case errInvalidQuickTimeFile: 
-                return errInvalidQuickTimeFile;
+                fileCacheEntry->InitErr = errInvalidQuickTimeFile;
+                break;
                 
             default: 
-                return errInternalError;
+                fileCacheEntry->InitErr = errInternalError;
+                break;
         }
+        
+        ErrorCode theErr = fileCacheEntry->InitErr;
+        fileCacheEntry->InitMutex->Unlock();
+        QTRTPFile::ReleaseFileCacheEntry(fileCacheEntry);
+        return theErr;
     }
     
 
     //
-    // Add this file to our cache and release the global add mutex.
-    QTRTPFile::AddFileToCache(filePath, &fileCacheEntry); // Grabs InitMutex.
-    fileCacheAddMutex.Unlock();
-
+    // Map its packets too, if someone has built them.
+    if( gUseRTPCacheFiles )
+    {
+        OSCharArrayDeleter theCacheFilePath(QTRTPCacheFile::GetCacheFilePath(filePath));
+        fileCacheEntry->fRTPCacheFile = QTRTPCacheFile::Open(theCacheFilePath.GetObject(), (*theQTFile)->GetModDate());
+    }
 
     //
     // Finish setting up the fileCacheEntry.
-    if( fileCacheEntry != NULL )
-    {   // it may not have been cached..
-        fileCacheEntry->File = *theQTFile;      
-        fileCacheEntry->InitMutex->Unlock();
+    UInt32 theShardIndex = fileCacheEntry->fHashValue & (kNumFileCacheShards - 1);
+    {
+        OSMutexLocker locker(&gFileCacheShards[theShardIndex].fMutex);
+        fileCacheEntry->File = *theQTFile;
+        fileCacheEntry->fModDate = (*theQTFile)->GetModDate();
+        fileCacheEntry->fParsedBytes = GetParsedBytes(*theQTFile);
+        gFileCacheShards[theShardIndex].fParsedBytes += fileCacheEntry->fParsedBytes;
     }
+    fileCacheEntry->InitMutex->Unlock();
 
     //
     // Return the file object.
+    *cacheEntry = fileCacheEntry;
     return errNoError;
 }
 
 
-void QTRTPFile::delete_QTFile(QTFile * theQTFile)
+void QTRTPFile::delete_QTFile(QTFile * theQTFile, RTPFileCacheEntry * cacheEntry)
 {
+    if( theQTFile == NULL )
+        return;
+        
+    Assert(cacheEntry != NULL);
+    Assert(cacheEntry->File == theQTFile);
+    
+    theQTFile->DecBufferUserCount();
+    QTRTPFile::ReleaseFileCacheEntry(cacheEntry);
+}
+
 
+Bool16 QTRTPFile::FindOrAddFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **cacheEntry)
+{
     // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
+    UInt32                          theHashValue = HashMoviePath(inFilename);
+    RTPFileCacheShard               *theShard = &gFileCacheShards[theHashValue & (kNumFileCacheShards - 1)];
+    QTRTPFile::RTPFileCacheEntry    **theBucket = &theShard->fBuckets[(theHashValue / kNumFileCacheShards) & (kFileCacheBucketsPerShard - 1)];
     QTRTPFile::RTPFileCacheEntry    *listEntry;
+    OSMutexLocker                   shardMutex(&theShard->fMutex);
 
 
     //
     // Find the specified cache entry.
-    for ( listEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry ) 
+    for( listEntry = *theBucket; listEntry != NULL; listEntry = listEntry->NextEntry )
     {
         //
         // Check for matches.
-        if( listEntry->File != theQTFile )
+        if( (listEntry->fHashValue != theHashValue) || (::strcmp(listEntry->fFilename, inFilename) != 0) )
             continue;
             
-        theQTFile->DecBufferUserCount();
         //
-        // Delete the object if the reference count has dropped to zero.
-        if ( --listEntry->ReferenceCount == 0 ) 
+        // Anything still open is shared as is. A movie no one is using may
+        // have changed on disk since it was parsed, so check it before reuse.
+        if( listEntry->ReferenceCount == 0 )
         {
-            //
-            // Delete the file.
-            if( theQTFile != NULL )
-            {   delete theQTFile;
+            if( GetCurrentModDate(inFilename) != listEntry->fModDate )
+            {
+                QTRTPFile::RemoveFileCacheEntry(theShard, listEntry);
+                theShard->fNumEvictions++;
+                break;
             }
+            theShard->fUnusedQueue.Remove(&listEntry->fUnusedElem);
+        }
 
-            //
-            // Free our other vars.
-            if( listEntry->InitMutex != NULL )
-                delete listEntry->InitMutex;
-
-            if( listEntry->fFilename != NULL )
-                delete [] listEntry->fFilename;
-            
-            //
-            // Remove this entry from the list.
-            if( listEntry->PrevEntry != NULL )
-                listEntry->PrevEntry->NextEntry = listEntry->NextEntry;
+        //
+        // Update the reference count and set the return value.
+        listEntry->ReferenceCount++;
+        theShard->fNumHits++;
         
-            if( listEntry->NextEntry != NULL )
-                listEntry->NextEntry->PrevEntry = listEntry->PrevEntry;
+        *cacheEntry = listEntry;
         
-            if( QTRTPFile::gFirstFileCacheEntry == listEntry )
-                QTRTPFile::gFirstFileCacheEntry = listEntry->NextEntry;
-                
-            delete listEntry;
-        }
-
         //
         // Return.
-        return;
+        return true;
     }
 
     //
-    // The object was not in the cache.  Delete it
-    if( theQTFile != NULL )
-    {   delete theQTFile;
-    }
+    // The search failed. Add an entry, locked until the caller has opened the file.
+    theShard->fNumMisses++;
+    
+    listEntry = NEW QTRTPFile::RTPFileCacheEntry();
+    listEntry->InitMutex = NEW OSMutex();
+    listEntry->InitMutex->Lock();
+    
+    listEntry->fFilename = NEW char[(::strlen(inFilename) + 2)];
+    ::strcpy(listEntry->fFilename, inFilename);
+    listEntry->File = NULL;
+    listEntry->InitErr = errNoError;
+    listEntry->fModDate = 0;
+    listEntry->fParsedBytes = 0;
+    listEntry->fRTPCacheFile = NULL;
+    
+    listEntry->ReferenceCount = 1;
+    listEntry->fUnusedElem.SetEnclosingObject(listEntry);
+
+    listEntry->fHashValue = theHashValue;
+    listEntry->PrevEntry = NULL;
+    listEntry->NextEntry = *theBucket;
+    if( *theBucket != NULL )
+        (*theBucket)->PrevEntry = listEntry;
+    *theBucket = listEntry;
+    
+    *cacheEntry = listEntry;
+    return false;
 }
 
 
-void QTRTPFile::AddFileToCache(const char *inFilename, QTRTPFile::RTPFileCacheEntry ** newListEntry)
+void QTRTPFile::ReleaseFileCacheEntry(QTRTPFile::RTPFileCacheEntry *cacheEntry)
 {
     // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
-    QTRTPFile::RTPFileCacheEntry*   listEntry;
-    QTRTPFile::RTPFileCacheEntry*   lastListEntry;
-    
-    
-    //
-    // Add this track object to our track list.
-    (*newListEntry) = NEW QTRTPFile::RTPFileCacheEntry();
-    if( (*newListEntry) == NULL )
-        return;
+    RTPFileCacheShard   *theShard = &gFileCacheShards[cacheEntry->fHashValue & (kNumFileCacheShards - 1)];
+    OSMutexLocker       shardMutex(&theShard->fMutex);
 
-    (*newListEntry)->InitMutex = NEW OSMutex();
-    if( (*newListEntry)->InitMutex == NULL ) {
-        delete (*newListEntry);
-        *newListEntry = NULL;
+    Assert(cacheEntry->ReferenceCount > 0);
+    if ( --cacheEntry->ReferenceCount > 0 ) 
+        return;
+        
+    //
+    // Movies that failed to open aren't kept; the next asker tries again.
+    if( cacheEntry->File == NULL )
+    {
+        QTRTPFile::RemoveFileCacheEntry(theShard, cacheEntry);
         return;
     }
-    (*newListEntry)->InitMutex->Lock();
-    
-    (*newListEntry)->fFilename = NEW char[(::strlen(inFilename) + 2)];
-    ::strcpy((*newListEntry)->fFilename, inFilename);
-    (*newListEntry)->File = NULL;
     
-    (*newListEntry)->ReferenceCount = 1;
+    //
+    // Keep it around for the next client, most recently used at the back.
+    theShard->fUnusedQueue.EnQueue(&cacheEntry->fUnusedElem);
+    QTRTPFile::EvictUnusedFiles(theShard);
+}
 
-    (*newListEntry)->PrevEntry = NULL;
-    (*newListEntry)->NextEntry = NULL;
 
+void QTRTPFile::RemoveFileCacheEntry(RTPFileCacheShard *theShard, QTRTPFile::RTPFileCacheEntry *cacheEntry)
+{
     //
-    // Make this the first entry if there are no entries, otherwise we need to
-    // find out where this file fits in the list and insert it there.
-    if( QTRTPFile::gFirstFileCacheEntry == NULL ) 
-    {
-        QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-    }
-    else
-    {
-        //
-        // Go through the cache list until we find an inode number greater than
-        // the one that we have now.  Insert it in the list when we find this.
-        for( listEntry = lastListEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry ) {
-            //
-            // This is the last list entry that we saw (useful for later).
-            lastListEntry = listEntry;
-            
-            //
-            // Skip this entry if this inode number is smaller than the one
-            // for our new entry.
-            if( strcmp(listEntry->fFilename,inFilename) < 0 )
-                continue;
-            
-            //
-            // We've found a larger inode; insert this one in the list.
-            if( listEntry->PrevEntry == NULL )
-                QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-            else
-                listEntry->PrevEntry->NextEntry = (*newListEntry);
-                
-            (*newListEntry)->PrevEntry = listEntry->PrevEntry;
-            
-            listEntry->PrevEntry = (*newListEntry);
-            
-            (*newListEntry)->NextEntry = listEntry;
-            
-            return;
-        }
+    // Called with the shard mutex held, once no one is using the entry.
+    Assert(cacheEntry->ReferenceCount == 0);
+    
+    if( cacheEntry->fUnusedElem.IsMemberOfAnyQueue() )
+        theShard->fUnusedQueue.Remove(&cacheEntry->fUnusedElem);
         
-        //
-        // We fell out of our loop; this means that we are the largest inode
-        // in the list; add ourselves to the end of the list.
-        if( lastListEntry == NULL ) { // this can't happen, but..
-            QTRTPFile::gFirstFileCacheEntry = (*newListEntry);
-        }
-        else
-        {
-            lastListEntry->NextEntry = (*newListEntry);
-            (*newListEntry)->PrevEntry = lastListEntry;
-        }
-    }
-}
+    //
+    // Remove this entry from its hash chain.
+    if( cacheEntry->PrevEntry != NULL )
+        cacheEntry->PrevEntry->NextEntry = cacheEntry->NextEntry;
+    else
+        theShard->fBuckets[(cacheEntry->fHashValue / kNumFileCacheShards) & (kFileCacheBucketsPerShard - 1)] = cacheEntry->NextEntry;
 
-Bool16 QTRTPFile::FindAndRefcountFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **cacheEntry)
-{
-    // General vars
-    OSMutexLocker                   fileCacheMutex(QTRTPFile::gFileCacheMutex);
-    QTRTPFile::RTPFileCacheEntry    *listEntry;
+    if( cacheEntry->NextEntry != NULL )
+        cacheEntry->NextEntry->PrevEntry = cacheEntry->PrevEntry;
+    
+    //
+    // Delete the file and free our other vars.
+    theShard->fParsedBytes -= cacheEntry->fParsedBytes;
+    if( cacheEntry->File != NULL )
+        delete cacheEntry->File;
 
+    if( cacheEntry->fRTPCacheFile != NULL )
+        delete cacheEntry->fRTPCacheFile;
 
-    //
-    // Find the specified cache entry.
-    for( listEntry = QTRTPFile::gFirstFileCacheEntry; listEntry != NULL; listEntry = listEntry->NextEntry )
-    {
-        //
-        // Check for matches.
-        if( ::strcmp(listEntry->fFilename, inFilename) != 0 )
-            continue;
+    if( cacheEntry->InitMutex != NULL )
+        delete cacheEntry->InitMutex;
 
-        //
-        // Update the reference count and set the return value.
-        listEntry->ReferenceCount++;
-        
-        *cacheEntry = listEntry;
+    if( cacheEntry->fFilename != NULL )
+        delete [] cacheEntry->fFilename;
         
-        //
-        // Return.
-        return true;
-    }
+    delete cacheEntry;
+}
 
+
+void QTRTPFile::EvictUnusedFiles(RTPFileCacheShard *theShard)
+{
     //
-    // The search failed.
-    return false;
+    // Release movies no one is using, least recently used first, until the
+    // shard is back under its share of the limit. Called with the shard mutex held.
+    while( (theShard->fUnusedQueue.GetLength() > 0)
+        && ((theShard->fParsedBytes > gMaxParsedBytesPerShard) || (theShard->fUnusedQueue.GetLength() > kMaxUnusedFilesPerShard)) )
+    {
+        QTRTPFile::RTPFileCacheEntry* theEntry = (QTRTPFile::RTPFileCacheEntry*)theShard->fUnusedQueue.GetHead()->GetEnclosingObject();
+        QTRTPFile::RemoveFileCacheEntry(theShard, theEntry);
+        theShard->fNumEvictions++;
+    }
 }
 
 
@@ -349,6 +443,7 @@ QTRTPFile::QTRTPFile(Bool16 debugFlag, Bool16 deepDebugFlag)
     : fDebug(debugFlag)
     , fDeepDebug(deepDebugFlag)
     , fFile(NULL)
+    , fFileCacheEntry(NULL)
     , fFCB(NULL)
     , fNumHintTracks(0)
     , fFirstTrack(NULL)
@@ -364,6 +459,7 @@ QTRTPFile::QTRTPFile(Bool16 debugFlag, Bool16 deepDebugFlag)
     , fHasRTPMetaInfoFieldArray(false)
     , fWasLastSeekASeekToPacketNumber(false)
     , fDropRepeatPackets(false)
+    , fUsePacketVectors(false)
     , fErr(errNoError)
 {
     fFCB = NEW QTFile_FileControlBlock();
@@ -398,7 +494,7 @@ QTRTPFile::~QTRTPFile(void)
     if( fSDPFile != NULL )
         delete[] fSDPFile;
     
-    this->delete_QTFile(fFile);
+    this->delete_QTFile(fFile, fFileCacheEntry);
 
     if( fFCB != NULL )
         delete fFCB;
@@ -420,7 +516,7 @@ QTRTPFile::ErrorCode QTRTPFile::Initialize(const char * filePath)
     
     //
     // Create our file object.
-    rc = this->new_QTFile(filePath, &fFile, fDebug, fDeepDebug);
+    rc = this->new_QTFile(filePath, &fFile, &fFileCacheEntry, fDebug, fDeepDebug);
     if ( rc != errNoError ) 
     {
         fFile = NULL;
@@ -453,6 +549,7 @@ QTRTPFile::ErrorCode QTRTPFile::Initialize(const char * filePath)
         listEntry->HintTrack = hintTrack;
         
         listEntry->HTCB = NEW QTHintTrack_HintTrackControlBlock(fFCB);
+        listEntry->CacheTrack = NULL;
         listEntry->IsTrackActive = false;
         listEntry->IsPacketAvailable = false;
         listEntry->QualityLevel = kAllPackets;
@@ -480,6 +577,7 @@ QTRTPFile::ErrorCode QTRTPFile::Initialize(const char * filePath)
         
         listEntry->CurPacketTime = 0.0;
         listEntry->CurPacketLength = 0;
+        listEntry->CurPacketNumVectors = 0;
 
         listEntry->NextTrack = NULL;
 
@@ -709,6 +807,11 @@ QTRTPFile::ErrorCode QTRTPFile::AddTrack(UInt32 trackID, Bool16 useRandomOffset)
     trackEntry->LastSequenceNumber = 0;
     trackEntry->SequenceNumberAdditive = 0;
 
+    //
+    // Use the movie's pre-built packets for this track if it has them.
+    if( fFileCacheEntry->fRTPCacheFile != NULL )
+        trackEntry->CacheTrack = fFileCacheEntry->fRTPCacheFile->FindTrack(trackID);
+
     //
     // Setup RTP-Meta-Info stuff for this track.
     
@@ -864,6 +967,8 @@ UInt32 QTRTPFile::GetBytesPerSecond(void)
 // -------------------------------------
 void QTRTPFile::AllocatePrivateBuffers(UInt32 inUnitSizeInK, UInt32 inNumBuffSizeUnits, UInt32 inMaxBitRateBuffSizeInBlocks)
 {
+    if (fFile->IsMapped()) // every client reads the same mapping
+        return;
     
     fFCB->EnableCacheBuffers(true);
     UInt32 bytesPerSecond = this->GetBytesPerSecond();
@@ -1286,6 +1391,18 @@ Float64 QTRTPFile::GetNextPacket(char ** outPacket, int * outPacketLength)
     return firstPacket->CurPacketTime;
 }
 
+void QTRTPFile::GetLastPacketVector(struct iovec ** outVector, UInt32 * outNumVectors)
+{
+    *outVector = NULL;
+    *outNumVectors = 0;
+    
+    if( (fLastPacketTrack != NULL) && (fLastPacketTrack->CurPacketNumVectors > 0) )
+    {
+        *outVector = fLastPacketTrack->CurPacketVector;
+        *outNumVectors = fLastPacketTrack->CurPacketNumVectors;
+    }
+}
+
 
 
 // -------------------------------------
@@ -1445,7 +1562,9 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
         // Do we know how many packets are in this sample?  If not, figure it out.
         while ( trackEntry->NumPacketsInThisSample == 0 ) 
         {
-            if ( trackEntry->HintTrack->GetNumPackets(trackEntry->CurSampleNumber, &trackEntry->NumPacketsInThisSample, trackEntry->HTCB) != QTTrack::errNoError )
+            Bool16 haveNumPackets = (trackEntry->CacheTrack != NULL)
+                && trackEntry->CacheTrack->GetNumPackets(trackEntry->CurSampleNumber, &trackEntry->NumPacketsInThisSample);
+            if ( !haveNumPackets && (trackEntry->HintTrack->GetNumPackets(trackEntry->CurSampleNumber, &trackEntry->NumPacketsInThisSample, trackEntry->HTCB) != QTTrack::errNoError) )
                 return false;
                 
             if ( trackEntry->NumPacketsInThisSample == 0 )
@@ -1457,19 +1576,29 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
         //
         // Fetch this packet.
         trackEntry->CurPacketLength = QTRTPFILE_MAX_PACKET_LENGTH;
+        trackEntry->CurPacketNumVectors = 0;
+        
+        Bool16 usePacketVector = fUsePacketVectors && !fHasRTPMetaInfoFieldArray;
+        trackEntry->HTCB->SetupPacketVector(usePacketVector ? trackEntry->CurPacketVector : NULL, QTRTPFILE_MAX_PACKET_VECTORS);
 
         
     #if QT_PROFILE
         MicroSecondStopWatch    packetTimer;
         packetTimer.Start();
     #endif
-        getPacketErr = trackEntry->HintTrack->GetPacket(trackEntry->CurSampleNumber, trackEntry->CurPacketNumber,
-                                                   trackEntry->CurPacket, &trackEntry->CurPacketLength,
-                                                   &trackEntry->CurPacketTime,
-                                                   (trackEntry->QualityLevel >= kNoBFrames),
-                                                   fDropRepeatPackets,
-                                                   trackEntry->SSRC,
-                                                   trackEntry->HTCB);
+        if ( (trackEntry->CacheTrack == NULL) || fHasRTPMetaInfoFieldArray
+            || !this->GetCachedPacket(trackEntry, &getPacketErr) )
+        {
+            getPacketErr = trackEntry->HintTrack->GetPacket(trackEntry->CurSampleNumber, trackEntry->CurPacketNumber,
+                                                       trackEntry->CurPacket, &trackEntry->CurPacketLength,
+                                                       &trackEntry->CurPacketTime,
+                                                       (trackEntry->QualityLevel >= kNoBFrames),
+                                                       fDropRepeatPackets,
+                                                       trackEntry->SSRC,
+                                                       trackEntry->HTCB);
+            if( usePacketVector )
+                trackEntry->CurPacketNumVectors = trackEntry->HTCB->fPacketVectorLen;
+        }
 
     #if QT_PROFILE
         packetTimer.Stop();
@@ -1507,3 +1636,54 @@ Bool16 QTRTPFile::PrefetchNextPacket(RTPTrackListEntry * trackEntry, Bool16 doSe
     // Return the packet.
     return true;
 }
+
+Bool16 QTRTPFile::GetCachedPacket(RTPTrackListEntry * trackEntry, QTTrack::ErrorCode * outErr)
+{
+    // General vars
+    const char      *thePacket;
+    UInt32          thePacketLength;
+    UInt16          theFlags;
+    
+    
+    //
+    // Anything the cache file doesn't have comes from the hint track.
+    if ( !trackEntry->CacheTrack->GetPacket(trackEntry->CurSampleNumber, trackEntry->CurPacketNumber,
+                                            &thePacket, &thePacketLength, &trackEntry->CurPacketTime, &theFlags)
+        || (thePacketLength > trackEntry->CurPacketLength) )
+        return false;
+    
+    //
+    // Skip the same packets QTHintTrack::GetPacket would.
+    if ( ((theFlags & QTRTPCacheTrack::kRepeatPacket) && fDropRepeatPackets)
+        || ((theFlags & QTRTPCacheTrack::kBFramePacket) && (trackEntry->QualityLevel >= kNoBFrames)) )
+    {
+        *outErr = QTTrack::errIsSkippedPacket;
+        return true;
+    }
+    
+    //
+    // The stored packet was built with an SSRC of 0; everything else is
+    // rewritten by our caller. With packet vectors on, only the RTP header
+    // needs a copy of its own; the payload is sent from the cache file.
+    if ( (trackEntry->HTCB->fPacketVector != NULL) && (thePacketLength > 12) )
+    {
+        ::memcpy(trackEntry->CurPacket, thePacket, 12);
+        trackEntry->CurPacketVector[0].iov_base = trackEntry->CurPacket;
+        trackEntry->CurPacketVector[0].iov_len = 12;
+        trackEntry->CurPacketVector[1].iov_base = (char *)thePacket + 12;
+        trackEntry->CurPacketVector[1].iov_len = thePacketLength - 12;
+        trackEntry->CurPacketNumVectors = 2;
+    }
+    else
+        ::memcpy(trackEntry->CurPacket, thePacket, thePacketLength);
+    trackEntry->CurPacketLength = thePacketLength;
+    
+    UInt32 theSSRC = htonl(trackEntry->SSRC);
+    ::memcpy(trackEntry->CurPacket + 8, &theSSRC, 4);
+    
+    trackEntry->HTCB->fCurrentPacketNumber++;
+    trackEntry->HTCB->fCurrentPacketPosition += thePacketLength - 12;
+    
+    *outErr = QTTrack::errNoError;
+    return true;
+}
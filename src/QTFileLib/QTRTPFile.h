@@ -37,6 +37,7 @@
 #include "MyAssert.h"
 #include "RTPMetaInfoPacket.h"
 #include "QTHintTrack.h"
+#include "OSQueue.h"
 
 #ifndef __Win32__
 #include <sys/stat.h>
@@ -45,6 +46,7 @@
 //
 // Constants
 #define QTRTPFILE_MAX_PACKET_LENGTH     2048
+#define QTRTPFILE_MAX_PACKET_VECTORS    8
 
 
 //
@@ -55,6 +57,9 @@ class QTFile;
 class QTFile_FileControlBlock;
 class QTHintTrack;
 class QTHintTrack_HintTrackControlBlock;
+class QTRTPCacheFile;
+class QTRTPCacheTrack;
+struct RTPFileCacheShard;
 
 class QTRTPFile {
 
@@ -81,17 +86,40 @@ public:
         OSMutex     *InitMutex;
         
         //
-        // File information
+        // File information. If the file couldn't be opened, File is NULL
+        // and InitErr says why.
         char*       fFilename;
         QTFile      *File;
+        ErrorCode   InitErr;
+        SInt64      fModDate;
+        UInt64      fParsedBytes;   // roughly what the parsed sample tables take up
+        
+        //
+        // The movie's pre-built packets, if it has a cache file and they're in use.
+        QTRTPCacheFile  *fRTPCacheFile;
         
         //
         // Reference count for this cache entry
         int         ReferenceCount; 
         
         //
-        // List pointers
+        // Hash chain pointers, within the entry's shard
+        UInt32              fHashValue;
         RTPFileCacheEntry   *PrevEntry, *NextEntry;
+        
+        //
+        // In its shard's unused queue, least recently used first, while
+        // ReferenceCount is 0.
+        OSQueueElem         fUnusedElem;
+    };
+    
+    //
+    // File cache geometry
+    enum
+    {
+        kNumFileCacheShards = 16,           // must be a power of 2
+        kFileCacheBucketsPerShard = 256,    // must be a power of 2
+        kMaxUnusedFilesPerShard = 32        // each one keeps its movie open
     };
     
     struct RTPTrackListEntry {
@@ -101,6 +129,7 @@ public:
         UInt32          TrackID;
         QTHintTrack     *HintTrack;
         QTHintTrack_HintTrackControlBlock   *HTCB;
+        QTRTPCacheTrack *CacheTrack;    // this track's pre-built packets, or NULL
         Bool16          IsTrackActive, IsPacketAvailable;
         UInt32          QualityLevel;
         
@@ -127,6 +156,8 @@ public:
         Float64         CurPacketTime;
         char            CurPacket[QTRTPFILE_MAX_PACKET_LENGTH];
         UInt32          CurPacketLength;
+        struct iovec    CurPacketVector[QTRTPFILE_MAX_PACKET_VECTORS];
+        UInt32          CurPacketNumVectors;    // 0 if CurPacket is the whole packet
 
         //
         // List pointers
@@ -139,6 +170,23 @@ public:
     // Global initialize function; CALL THIS FIRST!
     static void         Initialize(void);
     
+    //
+    // Parsed movies stay cached after their last QTRTPFile goes away, until
+    // the parsed bytes of all cached movies go over this. 0 (the default)
+    // releases each movie as soon as no one is using it.
+    static void         SetFileCacheParams(UInt64 inMaxParsedBytes);
+    
+    //
+    // Counts since the server started. An eviction is an unused movie released
+    // to stay under the limit or because its file changed.
+    static void         GetFileCacheStats(UInt32* outHits, UInt32* outMisses, UInt32* outEvictions);
+    
+    //
+    // When on, movies opened from now on send the packets in their
+    // QTRTPCacheFile, if they have one, rather than building each one from
+    // the hint track. Off by default.
+    static void         SetRTPCacheFileParams(Bool16 inEnabled);
+    
     //
     // Returns a static array of the RTP-Meta-Info fields supported by QTFileLib.
     // It also returns field IDs for the fields it recommends being compressed.
@@ -224,6 +272,18 @@ public:
             UInt16      GetNextTrackSequenceNumber(UInt32 TrackID);
             Float64     GetNextPacket(char ** Packet, int * PacketLength);
             
+            //
+            // With packet vectors on, media data in mapped movie files and in
+            // QTRTPCacheFiles isn't copied into packets. The packet GetNextPacket
+            // returns then only holds the RTP header and whatever else had to be
+            // copied, though PacketLength is still the length of the whole packet;
+            // GetLastPacketVector gives all of its pieces, in order. A packet with
+            // nothing referenced comes back as one piece, and tracks sending
+            // RTP-Meta-Info packets always get whole packets (no pieces). The pieces
+            // are good until the next GetNextPacket. Off by default.
+            void        SetUsePacketVectors(Bool16 inEnabled) { fUsePacketVectors = inEnabled; }
+            void        GetLastPacketVector(struct iovec ** outVector, UInt32 * outNumVectors);
+            
             SInt32      GetMovieHintType();
             Bool16      DropRepeatPackets() { return fDropRepeatPackets; }
             Bool16      SetDropRepeatPackets(Bool16 allowRepeatPackets) { (!fHasRTPMetaInfoFieldArray) ? fDropRepeatPackets = allowRepeatPackets : fDropRepeatPackets = false; return fDropRepeatPackets;}
@@ -234,18 +294,21 @@ public:
 protected:
     //
     // Protected cache functions and variables.
-    static  OSMutex             *gFileCacheMutex, *gFileCacheAddMutex;
-    static  RTPFileCacheEntry   *gFirstFileCacheEntry;
+    static  UInt64              gMaxParsedBytesPerShard;
+    static  Bool16              gUseRTPCacheFiles;
     
-    static  ErrorCode   new_QTFile(const char * FilePath, QTFile ** File, Bool16 Debug = false, Bool16 DeepDebug = false);
-    static  void        delete_QTFile(QTFile * File);
+    static  ErrorCode   new_QTFile(const char * FilePath, QTFile ** File, RTPFileCacheEntry ** CacheEntry, Bool16 Debug = false, Bool16 DeepDebug = false);
+    static  void        delete_QTFile(QTFile * File, RTPFileCacheEntry * CacheEntry);
 
-    static  void        AddFileToCache(const char *inFilename, QTRTPFile::RTPFileCacheEntry ** NewListEntry);
-    static  Bool16      FindAndRefcountFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **CacheEntry);
+    static  Bool16      FindOrAddFileCacheEntry(const char *inFilename, QTRTPFile::RTPFileCacheEntry **CacheEntry);
+    static  void        ReleaseFileCacheEntry(QTRTPFile::RTPFileCacheEntry *CacheEntry);
+    static  void        RemoveFileCacheEntry(RTPFileCacheShard *Shard, QTRTPFile::RTPFileCacheEntry *CacheEntry);
+    static  void        EvictUnusedFiles(RTPFileCacheShard *Shard);
 
     //
     // Protected member functions.
             Bool16      PrefetchNextPacket(RTPTrackListEntry * TrackEntry, Bool16 doSeek = false);
+            Bool16      GetCachedPacket(RTPTrackListEntry * TrackEntry, QTTrack::ErrorCode * outErr);
             ErrorCode   ScanToCorrectSample();
             ErrorCode   ScanToCorrectPacketNumber(UInt32 inTrackID, UInt64 inPacketNumber);
 
@@ -254,6 +317,7 @@ protected:
     Bool16              fDebug, fDeepDebug;
 
     QTFile              *fFile;
+    RTPFileCacheEntry   *fFileCacheEntry;
     QTFile_FileControlBlock *fFCB;
     
     UInt32              fNumHintTracks;
@@ -272,6 +336,7 @@ protected:
     Bool16              fHasRTPMetaInfoFieldArray;
     Bool16              fWasLastSeekASeekToPacketNumber;
     Bool16              fDropRepeatPackets;
+    Bool16              fUsePacketVectors;
     ErrorCode           fErr;
     
     static const RTPMetaInfoPacket::FieldID kMetaInfoFields[];
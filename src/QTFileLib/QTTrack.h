@@ -172,6 +172,10 @@ public:
                                                 QTFile_FileControlBlock * FCB = NULL)
                         {   return fDataReferenceAtom->Read(fSampleDescriptionAtom->SampleDescriptionToDataReference(SampleDescriptionID), Offset, Buffer, Length, FCB); 
                         }
+    inline  Bool16      Reference(UInt32 SampleDescriptionID, UInt64 Offset, UInt32 Length, const char ** Data,
+                                                QTFile_FileControlBlock * FCB = NULL)
+                        {   return fDataReferenceAtom->Reference(fSampleDescriptionAtom->SampleDescriptionToDataReference(SampleDescriptionID), Offset, Length, Data, FCB); 
+                        }
 
     inline Bool16       GetSampleMediaTimeOffset(UInt32 SampleNumber, UInt32 *mediaTimeOffset, QTAtom_ctts_SampleTableControlBlock * STCB)
                         {   
@@ -0,0 +1,440 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPCacheGen:
+//   Builds the QTRTPCacheFile of a hinted movie, and optionally times
+//   sending the movie with and without it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SafeStdLib.h"
+#include <string.h>
+#include <fcntl.h>
+
+#ifndef __MacOSX__
+#include "getopt.h"
+#include <unistd.h>
+#endif
+
+#include "OS.h"
+#include "OSArrayObjectDeleter.h"
+#include "ResizeableStringFormatter.h"
+
+#include "QTFile.h"
+#include "QTTrack.h"
+#include "QTHintTrack.h"
+#include "QTRTPFile.h"
+#include "QTRTPCacheFile.h"
+
+#define MAX_PACKET_LEN 2048
+
+
+//
+// Writers for the file's fields, all in network byte order.
+static void PutUInt16(ResizeableStringFormatter* ioTable, UInt16 inValue)
+{
+    inValue = htons(inValue);
+    ioTable->Put((char *)&inValue, 2);
+}
+
+static void PutUInt32(ResizeableStringFormatter* ioTable, UInt32 inValue)
+{
+    UInt32 theValue = htonl(inValue);
+    ioTable->Put((char *)&theValue, 4);
+}
+
+static void PutUInt64(ResizeableStringFormatter* ioTable, UInt64 inValue)
+{
+    SInt64 theValue = OS::HostToNetworkSInt64((SInt64)inValue);
+    ioTable->Put((char *)&theValue, 8);
+}
+
+static void PutFloat64(ResizeableStringFormatter* ioTable, Float64 inValue)
+{
+    UInt64 theBits;
+    ::memcpy(&theBits, &inValue, sizeof(theBits));
+    PutUInt64(ioTable, theBits);
+}
+
+static bool WriteAll(int fd, char* inData, UInt32 inLength)
+{
+    while (inLength > 0)
+    {
+        ssize_t theLen = write(fd, inData, inLength);
+        if (theLen <= 0)
+            return false;
+        inData += theLen;
+        inLength -= theLen;
+    }
+    return true;
+}
+
+
+//
+// Writes the packets of one hint track: the packet data at the current end
+// of the file, then its sample and packet tables. Adds the track's header
+// to ioTrackHeaders.
+static bool WriteTrack(int fd, UInt64* ioFileOffset, QTHintTrack* inHintTrack, ResizeableStringFormatter* ioTrackHeaders, bool inVerbose)
+{
+    ResizeableStringFormatter   theSampleTable, thePacketTable;
+    QTHintTrack_HintTrackControlBlock   theHTCB;
+    UInt32      theNumSamples = 0, theNumPackets = 0, theNumUncached = 0;
+    UInt16      theNumPacketsInSample;
+
+    //
+    // The sample numbers run from 1 until the hint track has no more.
+    for (UInt32 curSample = 1; inHintTrack->GetNumPackets(curSample, &theNumPacketsInSample, &theHTCB) == QTTrack::errNoError; curSample++)
+    {
+        PutUInt32(&theSampleTable, theNumPackets);
+        PutUInt32(&theSampleTable, theNumPacketsInSample);
+
+        for (UInt16 curPacket = 1; curPacket <= theNumPacketsInSample; curPacket++)
+        {
+            char        thePacket[MAX_PACKET_LEN];
+            UInt32      thePacketLength = MAX_PACKET_LEN;
+            Float64     theTransmitTime = 0.0;
+            Bool16      isRepeatPacket = false, isBFramePacket = false;
+            UInt16      theFlags = 0;
+
+            //
+            // Build every packet, including the ones a client may ask to have
+            // dropped. Anything the hint track won't build is left to it.
+            if ( (inHintTrack->GetPacket(curSample, curPacket, thePacket, &thePacketLength, &theTransmitTime,
+                                        false, false, 0, &theHTCB) != QTTrack::errNoError)
+                || (inHintTrack->GetPacketFlags(curSample, curPacket, &isRepeatPacket, &isBFramePacket, &theHTCB) != QTTrack::errNoError) )
+            {
+                theFlags = QTRTPCacheTrack::kUncachedPacket;
+                thePacketLength = 0;
+                theNumUncached++;
+            }
+
+            if (isRepeatPacket)
+                theFlags |= QTRTPCacheTrack::kRepeatPacket;
+            if (isBFramePacket)
+                theFlags |= QTRTPCacheTrack::kBFramePacket;
+
+            PutFloat64(&thePacketTable, theTransmitTime);
+            PutUInt64(&thePacketTable, *ioFileOffset);
+            PutUInt16(&thePacketTable, (UInt16)thePacketLength);
+            PutUInt16(&thePacketTable, theFlags);
+            PutUInt32(&thePacketTable, 0);
+
+            if (!WriteAll(fd, thePacket, thePacketLength))
+                return false;
+            *ioFileOffset += thePacketLength;
+            theNumPackets++;
+        }
+        theNumSamples++;
+    }
+
+    //
+    // Then the tables.
+    UInt64 theSampleTableOffset = *ioFileOffset;
+    if (!WriteAll(fd, theSampleTable.GetBufPtr(), theSampleTable.GetCurrentOffset()))
+        return false;
+    *ioFileOffset += theSampleTable.GetCurrentOffset();
+
+    UInt64 thePacketTableOffset = *ioFileOffset;
+    if (!WriteAll(fd, thePacketTable.GetBufPtr(), thePacketTable.GetCurrentOffset()))
+        return false;
+    *ioFileOffset += thePacketTable.GetCurrentOffset();
+
+    PutUInt32(ioTrackHeaders, inHintTrack->GetTrackID());
+    PutUInt32(ioTrackHeaders, theNumSamples);
+    PutUInt32(ioTrackHeaders, theNumPackets);
+    PutUInt32(ioTrackHeaders, 0);
+    PutUInt64(ioTrackHeaders, theSampleTableOffset);
+    PutUInt64(ioTrackHeaders, thePacketTableOffset);
+
+    if (inVerbose)
+        qtss_printf("Track %lu: %lu samples, %lu packets (%lu left to the hint track)\n",
+                    inHintTrack->GetTrackID(), theNumSamples, theNumPackets, theNumUncached);
+    return true;
+}
+
+//
+// Builds the cache file. It is written under a temporary name and renamed
+// into place, so a server that has the old one mapped keeps reading it.
+static bool WriteCacheFile(const char* inMoviePath, bool inDebug, bool inDeepDebug, bool inVerbose)
+{
+    QTFile file(inDebug, inDeepDebug);
+    if (file.Open(inMoviePath) != QTFile::errNoError)
+    {
+        qtss_printf("Error!  Could not open movie file \"%s\"!\n", inMoviePath);
+        return false;
+    }
+
+    UInt32 theNumTracks = 0;
+    QTTrack* theTrack = NULL;
+    while (file.NextTrack(&theTrack, theTrack))
+    {
+        if (file.IsHintTrack(theTrack))
+            theNumTracks++;
+    }
+    if (theNumTracks == 0)
+    {
+        qtss_printf("Error!  \"%s\" has no hint tracks!\n", inMoviePath);
+        return false;
+    }
+
+    OSCharArrayDeleter theCachePath(QTRTPCacheFile::GetCacheFilePath(inMoviePath));
+    OSCharArrayDeleter theTempPath(new char[::strlen(theCachePath.GetObject()) + 5]);
+    qtss_sprintf(theTempPath.GetObject(), "%s.tmp", theCachePath.GetObject());
+
+    int fd = open(theTempPath.GetObject(), O_CREAT | O_TRUNC | O_WRONLY, 0664);
+    if (fd == -1)
+    {
+        qtss_printf("Error!  Could not create \"%s\"!\n", theTempPath.GetObject());
+        return false;
+    }
+
+    //
+    // The headers go in front of the tracks' packets, once they are known.
+    UInt64 theFileOffset = QTRTPCacheFile::kFileHeaderSize + (theNumTracks * QTRTPCacheFile::kTrackHeaderSize);
+    bool isWritten = (lseek(fd, (off_t)theFileOffset, SEEK_SET) == (off_t)theFileOffset);
+
+    ResizeableStringFormatter theHeaders;
+    PutUInt32(&theHeaders, QTRTPCacheFile::kFileType);
+    PutUInt32(&theHeaders, QTRTPCacheFile::kFileVersion);
+    PutUInt64(&theHeaders, (UInt64)file.GetModDate());
+    PutUInt32(&theHeaders, theNumTracks);
+    PutUInt32(&theHeaders, 0);
+
+    for (theTrack = NULL; isWritten && file.NextTrack(&theTrack, theTrack); )
+    {
+        if (!file.IsHintTrack(theTrack))
+            continue;
+
+        QTHintTrack* theHintTrack = (QTHintTrack *)theTrack;
+        if (theHintTrack->Initialize() != QTTrack::errNoError)
+        {
+            qtss_printf("Error!  Could not initialize track %lu!\n", theHintTrack->GetTrackID());
+            isWritten = false;
+            break;
+        }
+        isWritten = WriteTrack(fd, &theFileOffset, theHintTrack, &theHeaders, inVerbose);
+    }
+
+    if (isWritten)
+        isWritten = (lseek(fd, 0, SEEK_SET) == 0) && WriteAll(fd, theHeaders.GetBufPtr(), theHeaders.GetCurrentOffset());
+    if (close(fd) != 0)
+        isWritten = false;
+
+    if (!isWritten || (rename(theTempPath.GetObject(), theCachePath.GetObject()) != 0))
+    {
+        qtss_printf("Error!  Could not write \"%s\"!\n", theCachePath.GetObject());
+        (void)unlink(theTempPath.GetObject());
+        return false;
+    }
+
+    if (inVerbose)
+        qtss_printf("Wrote %s (%qu bytes)\n", theCachePath.GetObject(), theFileOffset);
+    return true;
+}
+
+
+//
+// Sends every hint track of the movie through QTRTPFile as fast as it can,
+// and sums up what it sent so the two ways can be checked against each other.
+static bool SendMovie(const char* inMoviePath, bool inUseCacheFile, SInt64* outMicroseconds,
+                        UInt32* outNumPackets, UInt64* outNumBytes, UInt32* outChecksum)
+{
+    QTRTPFile::SetRTPCacheFileParams(inUseCacheFile);
+
+    QTRTPFile theRTPFile;
+    if (theRTPFile.Initialize(inMoviePath) != QTRTPFile::errNoError)
+    {
+        qtss_printf("Error!  Could not open movie file \"%s\"!\n", inMoviePath);
+        return false;
+    }
+
+    //
+    // No random offsets, so both ways give the same packets.
+    QTFile* theFile = theRTPFile.GetQTFile();
+    for (QTTrack* theTrack = NULL; theFile->NextTrack(&theTrack, theTrack); )
+    {
+        if (!theFile->IsHintTrack(theTrack))
+            continue;
+        if (theRTPFile.AddTrack(theTrack->GetTrackID(), false) != QTRTPFile::errNoError)
+        {
+            qtss_printf("Error!  Could not add track %lu!\n", theTrack->GetTrackID());
+            return false;
+        }
+    }
+
+    if (theRTPFile.Seek(0.0) != QTRTPFile::errNoError)
+    {
+        qtss_printf("Error!  Couldn't seek to time 0.0!\n");
+        return false;
+    }
+
+    *outNumPackets = 0;
+    *outNumBytes = 0;
+    if (outChecksum != NULL)
+        *outChecksum = 0;
+
+    SInt64 theStartTime = OS::Microseconds();
+    while (true)
+    {
+        char    *thePacket;
+        int     thePacketLength;
+
+        Float64 theTransmitTime = theRTPFile.GetNextPacket(&thePacket, &thePacketLength);
+        if (thePacket == NULL)
+            break;
+
+        (*outNumPackets)++;
+        *outNumBytes += thePacketLength;
+
+        if (outChecksum == NULL)
+            continue;
+
+        *outChecksum = (*outChecksum * 31) + (UInt32)(theTransmitTime * 1000);
+        for (int theIndex = 0; theIndex < thePacketLength; theIndex++)
+            *outChecksum = (*outChecksum * 31) + (UInt8)thePacket[theIndex];
+    }
+    *outMicroseconds = OS::Microseconds() - theStartTime;
+    return true;
+}
+
+//
+// Sends the movie with and without its cache file, and reports both rates.
+// The first pass of each also checks that the packets are the same.
+static bool CompareThroughput(const char* inMoviePath, UInt32 inNumPasses)
+{
+    SInt64      theMicroseconds[2] = { 0, 0 };
+    UInt32      theNumPackets[2] = { 0, 0 };
+    UInt64      theNumBytes[2] = { 0, 0 };
+    UInt32      theChecksum[2] = { 0, 0 };
+
+    for (UInt32 thePass = 0; thePass < inNumPasses; thePass++)
+    {
+        for (UInt32 theMode = 0; theMode < 2; theMode++)
+        {
+            SInt64  thePassMicroseconds;
+            if (!SendMovie(inMoviePath, theMode == 1, &thePassMicroseconds, &theNumPackets[theMode], &theNumBytes[theMode],
+                            (thePass == 0) ? &theChecksum[theMode] : NULL))
+                return false;
+
+            theMicroseconds[theMode] += thePassMicroseconds;
+        }
+    }
+
+    static const char* kModeNames[] = { "hint tracks", "cache file " };
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        Float64 theSeconds = (Float64)theMicroseconds[theMode] / 1000000.0;
+        if (theSeconds <= 0.0)
+            theSeconds = 0.000001;
+        qtss_printf("%s: %lu packets, %qu bytes per pass; %.0f packets/sec, %.2f Mbytes/sec\n", kModeNames[theMode],
+                    theNumPackets[theMode], theNumBytes[theMode],
+                    (Float64)theNumPackets[theMode] * inNumPasses / theSeconds,
+                    (Float64)theNumBytes[theMode] * inNumPasses / theSeconds / (1024 * 1024));
+    }
+
+    bool isSame = (theChecksum[0] == theChecksum[1]) && (theNumPackets[0] == theNumPackets[1]) && (theNumBytes[0] == theNumBytes[1]);
+    qtss_printf("Packets are %s\n", isSame ? "the same" : "DIFFERENT");
+    return isSame;
+}
+
+
+int main(int argc, char *argv[]) {
+    // Temporary vars
+    int             ch;
+
+    // General vars
+    bool            Debug = false, DeepDebug = false;
+    bool            Verbose = true;
+    bool            Compare = false, CompareOnly = false;
+    UInt32          NumPasses = 10;
+    extern int optind;
+    extern char* optarg;
+
+    //
+    // Read our command line options
+    while( (ch = getopt(argc, argv, "dDstTn:")) != -1 ) {
+        switch( ch ) {
+            case 'd':
+                Debug = true;
+            break;
+
+            case 'D':
+                Debug = true;
+                DeepDebug = true;
+            break;
+
+            case 's':
+                Verbose = false;
+            break;
+
+            case 't':
+                Compare = true;
+            break;
+
+            case 'T':
+                Compare = true;
+                CompareOnly = true;
+            break;
+
+            case 'n':
+                NumPasses = ::atoi(optarg);
+                if (NumPasses == 0)
+                    NumPasses = 1;
+            break;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    //
+    // Validate our arguments.
+    if( argc < 1 ) {
+        qtss_printf("usage: QTRTPCacheGen [-d] [-D] [-s] [-t | -T] [-n passes] <filename> ..\n");
+        qtss_printf("usage: writes the RTP packets of each movie to <filename>.rtpcache\n");
+        qtss_printf("usage: -s only print errors\n");
+        qtss_printf("usage: -t then time sending the movie from its hint tracks and from the cache file\n");
+        qtss_printf("usage: -T only time it, using the cache file that is already there\n");
+        qtss_printf("usage: -n number of timed passes (default 10)\n");
+        exit(1);
+    }
+
+    QTRTPFile::Initialize();
+
+    int theResult = 0;
+    for ( ; argc > 0; argc--, argv++)
+    {
+        if (!CompareOnly && !WriteCacheFile(*argv, Debug, DeepDebug, Verbose))
+        {
+            theResult = 1;
+            continue;
+        }
+
+        if (Compare && !CompareThroughput(*argv, NumPasses))
+            theResult = 1;
+    }
+
+    return theResult;
+}
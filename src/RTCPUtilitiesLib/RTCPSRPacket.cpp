@@ -95,7 +95,7 @@ UInt32 RTCPSRPacket::GetACName(char* ioCNameBuffer)
     ioCNameBuffer[0] = 1;
     
     //Unique cname is constructed from the base name and the current time
-    qtss_sprintf(&ioCNameBuffer[1], " %s%I64d", sCNameBase, OS::Milliseconds() / 1000);
+    qtss_sprintf(&ioCNameBuffer[1], " %s%" _64BITARG_ "d", sCNameBase, OS::Milliseconds() / 1000);
     UInt32 cNameLen = ::strlen(ioCNameBuffer);
     //2nd byte of CName should be length
     ioCNameBuffer[1] = (UInt8) (cNameLen - 2);//don't count indicator or length byte
@@ -45,10 +45,17 @@
 
 
 QTSSDictionary::QTSSDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex) 
-:   fAttributes(NULL), fInstanceAttrs(NULL), fInstanceArraySize(0),
+:   fAttributes(NULL), fAttributesAllocator(NULL), fInstanceAttrs(NULL), fInstanceArraySize(0),
     fMap(inMap), fInstanceMap(NULL), fMutexP(inMutex), fMyMutex(false), fLocked(false)
 {
-    if (fMap != NULL)
+    if ((fMap != NULL) && (fMap->fValueArrayAllocator != NULL) && (fMap->fNumSlabAllocatedAttrs == fMap->GetNumAttrs()))
+    {
+        fAttributesAllocator = fMap->fValueArrayAllocator;
+        fAttributes = (DictValueElement*)fAttributesAllocator->Get();
+        for (UInt32 x = 0; x < fMap->GetNumAttrs(); x++)
+            new (&fAttributes[x]) DictValueElement();
+    }
+    else if (fMap != NULL)
         fAttributes = NEW DictValueElement[inMap->GetNumAttrs()];
 	if (fMutexP == NULL)
 	{
@@ -61,7 +68,9 @@ QTSSDictionary::~QTSSDictionary()
 {
     if (fMap != NULL)
         this->DeleteAttributeData(fAttributes, fMap->GetNumAttrs());
-    if (fAttributes != NULL)
+    if (fAttributesAllocator != NULL)
+        fAttributesAllocator->Put(fAttributes); // DictValueElement has nothing to destruct
+    else if (fAttributes != NULL)
         delete [] fAttributes;
     delete fInstanceMap;
     this->DeleteAttributeData(fInstanceAttrs, fInstanceArraySize);
@@ -859,7 +868,8 @@ void QTSSDictionaryMap::Initialize()
 }
 
 QTSSDictionaryMap::QTSSDictionaryMap(UInt32 inNumReservedAttrs, UInt32 inFlags)
-:   fNextAvailableID(inNumReservedAttrs), fNumValidAttrs(inNumReservedAttrs),fAttrArraySize(inNumReservedAttrs), fFlags(inFlags)
+:   fNextAvailableID(inNumReservedAttrs), fNumValidAttrs(inNumReservedAttrs),fAttrArraySize(inNumReservedAttrs), fFlags(inFlags),
+    fValueArrayAllocator(NULL), fNumSlabAllocatedAttrs(0)
 {
     if (fAttrArraySize < kMinArraySize)
         fAttrArraySize = kMinArraySize;
@@ -867,6 +877,16 @@ QTSSDictionaryMap::QTSSDictionaryMap(UInt32 inNumReservedAttrs, UInt32 inFlags)
     ::memset(fAttrArray, 0, sizeof(QTSSAttrInfoDict*) * fAttrArraySize);
 }
 
+void QTSSDictionaryMap::SlabAllocateValueArrays(char* inName)
+{
+    // If attributes get added after this, new dictionaries just go back to
+    // the heap. fNumSlabAllocatedAttrs is what the constructor checks.
+    if ((fValueArrayAllocator != NULL) || (this->GetNumAttrs() == 0))
+        return;
+    fNumSlabAllocatedAttrs = this->GetNumAttrs();
+    fValueArrayAllocator = NEW OSSlabAllocator(inName, fNumSlabAllocatedAttrs * sizeof(QTSSDictionary::DictValueElement));
+}
+
 QTSS_Error QTSSDictionaryMap::AddAttribute( const char* inAttrName,
                                             QTSS_AttrFunctionPtr inFuncPtr,
                                             QTSS_AttrDataType inDataType,
@@ -46,6 +46,7 @@
 #include "StrPtrLen.h"
 #include "MyAssert.h"
 #include "QTSSStream.h"
+#include "OSSlabAllocator.h"
 
 class QTSSDictionary;
 class QTSSDictionaryMap;
@@ -207,6 +208,7 @@ class QTSSDictionary : public QTSSStream
         };
         
         DictValueElement*   fAttributes;
+        OSSlabAllocator*    fAttributesAllocator; // NULL if fAttributes came from the heap
         DictValueElement*   fInstanceAttrs;
         UInt32              fInstanceArraySize;
         QTSSDictionaryMap*  fMap;
@@ -216,6 +218,8 @@ class QTSSDictionary : public QTSSStream
 		Bool16				fLocked;
         
         void DeleteAttributeData(DictValueElement* inDictValues, UInt32 inNumValues);
+        
+        friend class QTSSDictionaryMap;
 };
 
 
@@ -395,6 +399,12 @@ class QTSSDictionaryMap
             { Assert(inIndex < kNumDynamicDictionaryTypes + kNumDictionaries); return sDictionaryMaps[inIndex]; }
 
         static QTSS_ObjectType          CreateNewMap();
+        
+        //
+        // Once no more attributes will be added to this map, dictionaries using
+        // it can get their attribute value arrays from a slab allocator instead
+        // of the heap. Worth doing for the per-client dictionaries.
+        void                            SlabAllocateValueArrays(char* inName);
 
     private:
 
@@ -414,6 +424,8 @@ class QTSSDictionaryMap
         UInt32                          fAttrArraySize;
         QTSSAttrInfoDict**              fAttrArray;
         UInt32                          fFlags;
+        OSSlabAllocator*                fValueArrayAllocator;
+        UInt32                          fNumSlabAllocatedAttrs;
         
         friend class QTSSDictionary;
 };
@@ -165,6 +165,7 @@ Bool16 QTSServer::Initialize(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
     RTSPRequestInterface::Initialize();
     RTSPSessionInterface::Initialize();
     RTPSessionInterface::Initialize();
+    RTPSession::Initialize();
     RTPStream::Initialize();
     RTSPSession::Initialize();
     QTSSFile::Initialize();
@@ -282,9 +283,17 @@ void QTSServer::InitModules(QTSS_ServerState inEndState)
 
 void QTSServer::StartTasks()
 {
-    fRTCPTask = new RTCPTask();
     fStatsTask = new RTPStatsUpdaterTask();
 
+    //
+    // The modules have all added their attributes by now, so the dictionaries
+    // created for every client can take their value arrays from slabs.
+    QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPSessionDictIndex)->SlabAllocateValueArrays("RTSPSession attributes");
+    QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPRequestDictIndex)->SlabAllocateValueArrays("RTSPRequest attributes");
+    QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPHeaderDictIndex)->SlabAllocateValueArrays("RTSPHeader attributes");
+    QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kClientSessionDictIndex)->SlabAllocateValueArrays("RTPSession attributes");
+    QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)->SlabAllocateValueArrays("RTPStream attributes");
+
     //
     // Start listening
     for (UInt32 x = 0; x < fNumListeners; x++)
@@ -560,11 +569,7 @@ Bool16  QTSServer::SetupUDPSockets()
     {
         UDPSocketPair* thePair = fSocketPool->CreateUDPSocketPair(SocketUtils::GetIPAddr(theNumPairs), 0);
                 if (thePair != NULL)
-                {
             theNumAllocatedPairs++;
-                        thePair->GetSocketA()->RequestEvent(EV_RE);
-                        thePair->GetSocketB()->RequestEvent(EV_RE);
-                }
         }
     //only return an error if we couldn't allocate ANY pairs of sockets
     if (theNumAllocatedPairs == 0)
@@ -1087,15 +1092,13 @@ Bool16 RTSPListenerSocket::OverMaxConnections(UInt32 buffer)
 
 UDPSocketPair*  RTPSocketPool::ConstructUDPSocketPair()
 {
-    Task* theTask = ((QTSServer*)QTSServerInterface::GetServer())->fRTCPTask;
-    
     //construct a pair of UDP sockets, the lower one for RTP data (outgoing only, no demuxer
     //necessary), and one for RTCP data (incoming, so definitely need a demuxer).
-    //These are nonblocking sockets that DON'T receive events (we are going to poll for data)
-	// They do receive events - we don't poll from them anymore
+    //The RTP socket never asks for events. The RTCP socket reads its own packets
+    //whenever it gets a read event.
     return NEW
-        UDPSocketPair(  NEW UDPSocket(theTask, Socket::kNonBlockingSocketType),
-                        NEW UDPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType));
+        UDPSocketPair(  NEW UDPSocket(NULL, Socket::kNonBlockingSocketType),
+                        NEW RTCPSocket());
 }
 
 void RTPSocketPool::DestructUDPSocketPair(UDPSocketPair* inPair)
@@ -1138,6 +1141,10 @@ void RTPSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
         // For now, do not log an error, though we should enable this in the future.
         //QTSSModuleUtils::LogError(qtssWarningVerbosity, qtssMsgSockBufSizesTooLarge, theRcvBufSizeStr);
     }
+    
+    //
+    // Start listening for RTCP. Nothing arrives until the socket is bound.
+    inPair->GetSocketB()->RequestEvent(EV_RE);
 }
 
 
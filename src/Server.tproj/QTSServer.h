@@ -38,7 +38,6 @@
 #include "QTSServerInterface.h"
 #include "Task.h"
 
-class RTCPTask;
 class RTSPListenerSocket;
 class RTPSocketPool;
 class SessionTimeoutTask;
@@ -113,7 +112,6 @@ class QTSServer : public QTSServerInterface
     
         //
         // GLOBAL TASKS
-        RTCPTask*           fRTCPTask;
         RTPStatsUpdaterTask*fStatsTask;
         SessionTimeoutTask  *fSessionTimeoutTask;
         static char*        sPortPrefString;
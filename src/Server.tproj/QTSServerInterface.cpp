@@ -141,7 +141,18 @@ QTSSAttrInfoDict::AttrInfo  QTSServerInterface::sAttributes[] =
     /* 38  */ { "qtssSvrServerBuild",           NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 39  */ { "qtssSvrServerPlatform",        NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 40  */ { "qtssSvrRTSPServerComment",     NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
-    /* 41  */ { "qtssSvrNumThinned",            NULL,   qtssAttrDataTypeSInt32,     qtssAttrModeRead | qtssAttrModeWrite  }
+    /* 41  */ { "qtssSvrNumThinned",            NULL,   qtssAttrDataTypeSInt32,     qtssAttrModeRead | qtssAttrModeWrite  },
+    /* 42  */ { "qtssSvrEventThreadEventsPerSec",   NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead },
+    /* 43  */ { "qtssSvrEventThreadWakeupLatency",  NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead },
+    /* 44  */ { "qtssSvrTaskDispatchLatencyP99",    NULL,   qtssAttrDataTypeUInt32, qtssAttrModeRead },
+    /* 45  */ { "qtssSvrMovieCacheHits",        NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
+    /* 46  */ { "qtssSvrMovieCacheMisses",      NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
+    /* 47  */ { "qtssSvrMovieCacheEvictions",   NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
+    /* 48  */ { "qtssSvrDescribeCacheHits",     NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
+    /* 49  */ { "qtssSvrDescribeCacheMisses",   NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
+    /* 50  */ { "qtssSvrSlabAllocatorNames",    NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead },
+    /* 51  */ { "qtssSvrSlabObjectsInUse",      NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead },
+    /* 52  */ { "qtssSvrSlabObjectsAllocated",  NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead }
 };
 
 void    QTSServerInterface::Initialize()
@@ -205,14 +216,17 @@ QTSServerInterface::QTSServerInterface()
     fTotalRTPBytes(0),
     fTotalRTPPackets(0),
     fTotalRTPPacketsLost(0),
-    fPeriodicRTPBytes(0),
-    fPeriodicRTPPacketsLost(0),
-    fPeriodicRTPPackets(0),
     fCurrentRTPBandwidthInBits(0),
     fAvgRTPBandwidthInBits(0),
     fRTPPacketsPerSecond(0),
     fCPUPercent(0),
     fCPUTimeUsedInSec(0),
+    fTaskDispatchLatencyP99InUSecs(0),
+    fMovieCacheHits(0),
+    fMovieCacheMisses(0),
+    fMovieCacheEvictions(0),
+    fDescribeCacheHits(0),
+    fDescribeCacheMisses(0),
     fUDPWastageInBytes(0),
     fNumUDPBuffers(0),
     fNumMP3Sessions(0),
@@ -255,6 +269,12 @@ QTSServerInterface::QTSServerInterface()
     this->SetVal(qtssSvrStartupTime,        &fStartupTime_UnixMilli,    sizeof(fStartupTime_UnixMilli));
     this->SetVal(qtssSvrGMTOffsetInHrs,     &fGMTOffset,                sizeof(fGMTOffset));
     this->SetVal(qtssSvrCPULoadPercent,     &fCPUPercent,               sizeof(fCPUPercent));
+    this->SetVal(qtssSvrTaskDispatchLatencyP99, &fTaskDispatchLatencyP99InUSecs, sizeof(fTaskDispatchLatencyP99InUSecs));
+    this->SetVal(qtssSvrMovieCacheHits,     &fMovieCacheHits,           sizeof(fMovieCacheHits));
+    this->SetVal(qtssSvrMovieCacheMisses,   &fMovieCacheMisses,         sizeof(fMovieCacheMisses));
+    this->SetVal(qtssSvrMovieCacheEvictions, &fMovieCacheEvictions,     sizeof(fMovieCacheEvictions));
+    this->SetVal(qtssSvrDescribeCacheHits,  &fDescribeCacheHits,        sizeof(fDescribeCacheHits));
+    this->SetVal(qtssSvrDescribeCacheMisses, &fDescribeCacheMisses,     sizeof(fDescribeCacheMisses));
     this->SetVal(qtssMP3SvrCurConn,         &fNumMP3Sessions,           sizeof(fNumMP3Sessions));
     this->SetVal(qtssMP3SvrTotalConn,       &fTotalMP3Sessions,         sizeof(fTotalMP3Sessions));
     this->SetVal(qtssMP3SvrCurBandwidth,    &fCurrentMP3BandwidthInBits,sizeof(fCurrentMP3BandwidthInBits));
@@ -291,8 +311,8 @@ void QTSServerInterface::LogError(QTSS_ErrorVerbosity inVerbosity, char* inBuffe
 
 void QTSServerInterface::KillAllRTPSessions()
 {
-    OSMutexLocker locker(fRTPMap->GetMutex());
-    for (OSRefHashTableIter theIter(fRTPMap->GetHashTable()); !theIter.IsDone(); theIter.Next())
+    OSRefTableLocker locker(fRTPMap);
+    for (OSRefTableIter theIter(fRTPMap); !theIter.IsDone(); theIter.Next())
     {
         OSRef* theRef = theIter.GetCurrent();
         RTPSessionInterface* theSession = (RTPSessionInterface*)theRef->GetObject();
@@ -384,24 +404,13 @@ SInt64 RTPStatsUpdaterTask::Run()
     
     //First update total bytes. This must be done because total bytes is a 64 bit number,
     //so no atomic functions can apply.
-    //
-    // NOTE: The line below is not thread safe on non-PowerPC platforms. This is
-    // because the fPeriodicRTPBytes variable is being manipulated from within an
-    // atomic_add. On PowerPC, assignments are atomic, so the assignment below is ok.
-    // On a non-PowerPC platform, the following would be thread safe:
-    //unsigned int periodicBytes = atomic_add(&theServer->fPeriodicRTPBytes, 0);
-    unsigned int periodicBytes = theServer->fPeriodicRTPBytes;
-    (void)atomic_sub(&theServer->fPeriodicRTPBytes, periodicBytes);
-    theServer->fTotalRTPBytes += periodicBytes;
+    UInt32 periodicBytes = 0;
+    UInt32 periodicPackets = 0;
+    UInt32 periodicPacketsLost = 0;
+    theServer->fRTPStatsShards.CollectRTPCounts(&periodicBytes, &periodicPackets, &periodicPacketsLost);
     
-    // Same deal for packet totals
-    unsigned int periodicPackets = theServer->fPeriodicRTPPackets;
-    (void)atomic_sub(&theServer->fPeriodicRTPPackets, periodicPackets);
+    theServer->fTotalRTPBytes += periodicBytes;
     theServer->fTotalRTPPackets += periodicPackets;
-    
-    // ..and for lost packet totals
-    unsigned int periodicPacketsLost = theServer->fPeriodicRTPPacketsLost;
-    (void)atomic_sub(&theServer->fPeriodicRTPPacketsLost, periodicPacketsLost);
     theServer->fTotalRTPPacketsLost += periodicPacketsLost;
     
     SInt64 curTime = OS::Milliseconds();
@@ -450,6 +459,32 @@ SInt64 RTPStatsUpdaterTask::Run()
 		if (numProcessors > 1)
 			theServer->fCPUPercent /= numProcessors;
     }
+
+    //per event thread socket event rates
+    for (UInt32 theIndex = 0; theIndex < EventThread::GetNumThreads(); theIndex++)
+    {
+        EventThread* theThread = EventThread::GetThread(theIndex);
+        theThread->UpdateStats(curTime);
+        
+        UInt32 theEventsPerSec = theThread->GetEventsPerSec();
+        UInt32 theWakeupLatency = theThread->GetAvgWakeupLatencyInUSecs();
+        (void)theServer->SetValue(qtssSvrEventThreadEventsPerSec, theIndex, &theEventsPerSec, sizeof(theEventsPerSec), QTSSDictionary::kDontObeyReadOnly);
+        (void)theServer->SetValue(qtssSvrEventThreadWakeupLatency, theIndex, &theWakeupLatency, sizeof(theWakeupLatency), QTSSDictionary::kDontObeyReadOnly);
+    }
+    
+    theServer->fTaskDispatchLatencyP99InUSecs = TaskThreadPool::GetDispatchLatencyP99InUSecs();
+    
+    //slab allocator usage
+    for (UInt32 theIndex = 0; theIndex < OSSlabAllocator::GetNumAllocators(); theIndex++)
+    {
+        OSSlabAllocator* theAllocator = OSSlabAllocator::GetAllocator(theIndex);
+        
+        UInt32 theInUse = theAllocator->GetNumObjectsInUse();
+        UInt32 theAllocated = theAllocator->GetTotalNumObjects();
+        (void)theServer->SetValue(qtssSvrSlabAllocatorNames, theIndex, theAllocator->GetName(), ::strlen(theAllocator->GetName()), QTSSDictionary::kDontObeyReadOnly);
+        (void)theServer->SetValue(qtssSvrSlabObjectsInUse, theIndex, &theInUse, sizeof(theInUse), QTSSDictionary::kDontObeyReadOnly);
+        (void)theServer->SetValue(qtssSvrSlabObjectsAllocated, theIndex, &theAllocated, sizeof(theAllocated), QTSSDictionary::kDontObeyReadOnly);
+    }
     
     fLastTotalMP3Bytes = (SInt64)theServer->fTotalMP3Bytes;
     fLastBandwidthTime = curTime;
@@ -487,13 +522,7 @@ SInt64 RTPStatsUpdaterTask::Run()
         SInt32 maxKBits = theServer->GetPrefs()->GetMaxKBitsBandwidth();
         if ((maxKBits > -1) && (theServer->fAvgRTPBandwidthInBits > ((UInt32)maxKBits * 1024)))
         {
-            //we need to make sure that all of this happens atomically wrt the session map
-            OSMutexLocker locker(theServer->GetRTPSessionMap()->GetMutex());
-            RTPSessionInterface* theSession = this->GetNewestSession(theServer->fRTPMap);
-            if (theSession != NULL)
-                if ((curTime - theSession->GetSessionCreateTime()) <
-                        theServer->GetPrefs()->GetSafePlayDurationInSecs() * 1000)
-                    theSession->Signal(Task::kKillEvent);
+            this->ShedNewestSessions(theServer, curTime);
         }
     }
     else if (fLastBandwidthAvg == 0)
@@ -506,26 +535,22 @@ SInt64 RTPStatsUpdaterTask::Run()
     return theServer->GetPrefs()->GetTotalBytesUpdateTimeInSecs() * 1000;
 }
 
-RTPSessionInterface* RTPStatsUpdaterTask::GetNewestSession(OSRefTable* inRTPSessionMap)
+void RTPStatsUpdaterTask::ShedNewestSessions(QTSServerInterface* inServer, SInt64 inCurTime)
 {
-    //Caller must lock down the RTP session map
-    SInt64 theNewestPlayTime = 0;
-    RTPSessionInterface* theNewestSession = NULL;
-    
-    //use the session map to iterate through all the sessions, finding the most
-    //recently connected client
-    for (OSRefHashTableIter theIter(inRTPSessionMap->GetHashTable()); !theIter.IsDone(); theIter.Next())
-    {
-        OSRef* theRef = theIter.GetCurrent();
-        RTPSessionInterface* theSession = (RTPSessionInterface*)theRef->GetObject();
-        Assert(theSession->GetSessionCreateTime() > 0);
-        if (theSession->GetSessionCreateTime() > theNewestPlayTime)
-        {
-            theNewestPlayTime = theSession->GetSessionCreateTime();
-            theNewestSession = theSession;
-        }
-    }
-    return theNewestSession;
+    //Sessions that have played longer than the safe play duration are left
+    //alone, and so is everything older
+    SInt64 theSafePlayDuration = (SInt64)inServer->GetPrefs()->GetSafePlayDurationInSecs() * 1000;
+    (void)inServer->fAdmissionQueue.ShedNewest(inCurTime, theSafePlayDuration, inServer->GetPrefs()->GetSessionsShedPerUpdate());
+}
+
+void QTSServerInterface::AddToAdmissionQueue(RTPSessionInterface* inSession)
+{
+    fAdmissionQueue.Add(inSession->GetAdmissionQueueElem(), inSession->GetSessionCreateTime());
+}
+
+void QTSServerInterface::RemoveFromAdmissionQueue(RTPSessionInterface* inSession)
+{
+    fAdmissionQueue.Remove(inSession->GetAdmissionQueueElem());
 }
 
 
@@ -588,7 +613,8 @@ void* QTSServerInterface::GetNumWastedBytes(QTSSDictionary* inServer, UInt32* ou
     // because whether we are out of descriptors or not is continually changing
     QTSServerInterface* theServer = (QTSServerInterface*)inServer;
     
-    theServer->fUDPWastageInBytes = RTPPacketResender::GetWastedBufferBytes();
+    UInt32 theWastedBytes = theServer->fRTPStatsShards.GetRetransmitWastedBytes();
+    theServer->fUDPWastageInBytes = theWastedBytes;
 
     // Return the result
     *outLen = sizeof(theServer->fUDPWastageInBytes);
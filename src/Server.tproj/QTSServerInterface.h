@@ -44,6 +44,8 @@
 #include "QTSSMessages.h"
 #include "QTSSModule.h"
 #include "atomic.h"
+#include "RTPStatsShards.h"
+#include "RTPAdmissionQueue.h"
 
 #include "OSMutex.h"
 #include "Task.h"
@@ -96,15 +98,21 @@ class QTSServerInterface : public QTSSDictionary
         void                SwapFromRTSPToHTTP()
             { OSMutexLocker locker(&fMutex); fNumRTSPSessions--; fNumRTSPHTTPSessions++; }
             
+        //These are called for every packet, so each thread counts into its own
+        //shard of fRTPStatsShards. RTPStatsUpdaterTask adds the shards up when it runs.
+        
         //total rtp bytes sent by the server
         void            IncrementTotalRTPBytes(UInt32 bytes)
-                                        { (void)atomic_add(&fPeriodicRTPBytes, bytes); }
+            { fRTPStatsShards.AddRTPBytes(bytes); }
         //total rtp packets sent by the server
         void            IncrementTotalPackets()
-                                        { (void)atomic_add(&fPeriodicRTPPackets, 1); }
+            { fRTPStatsShards.AddRTPPackets(1); }
         //total rtp bytes reported as lost by the clients
         void            IncrementTotalRTPPacketsLost(UInt32 packets)
-                                        { (void)atomic_add(&fPeriodicRTPPacketsLost, packets); }
+            { fRTPStatsShards.AddRTPPacketsLost(packets); }
+        //bytes of retransmit buffers held but not filled, a current level rather than a total
+        void            AlterRetransmitWastedBytes(SInt32 inDifference)
+            { fRTPStatsShards.AlterRetransmitWastedBytes(inDifference); }
                                         
         // Also increments current RTP session count
         void            IncrementTotalRTPSessions()
@@ -184,6 +192,13 @@ class QTSServerInterface : public QTSSDictionary
         
         //Allows you to map RTP session IDs (strings) to actual RTP session objects
         OSRefTable*         GetRTPSessionMap()          { return fRTPMap; }
+        
+        //Active RTP sessions are also kept in the order they were admitted, so
+        //the newest can be found without going through the session map. A
+        //session must be removed before it is deleted. Removing one that isn't
+        //in the queue does nothing.
+        void                AddToAdmissionQueue(RTPSessionInterface* inSession);
+        void                RemoveFromAdmissionQueue(RTPSessionInterface* inSession);
     
         //Server provides a statically created & bound UDPSocket / Demuxer pair
         //for each IP address setup to serve RTP. You access those pairs through
@@ -268,6 +283,9 @@ class QTSServerInterface : public QTSSDictionary
         // All RTP sessions are put into this map
         OSRefTable*                 fRTPMap;
         
+        // And into this queue, in the order they were activated
+        RTPAdmissionQueue           fAdmissionQueue;
+        
         QTSServerPrefs*             fSrvrPrefs;
         QTSSMessages*               fSrvrMessages;
 
@@ -333,12 +351,10 @@ class QTSServerInterface : public QTSSDictionary
         //stores the total number of bytes lost (as reported by clients) since startup
         UInt64              fTotalRTPPacketsLost;
 
-        //because there is no 64 bit atomic add (for obvious reasons), we efficiently
-        //implement total byte counting by atomic adding to this variable, then every
-        //once in awhile updating the sTotalBytes.
-        unsigned int        fPeriodicRTPBytes;
-        unsigned int        fPeriodicRTPPacketsLost;
-        unsigned int        fPeriodicRTPPackets;
+        //because there is no 64 bit atomic add (for obvious reasons), each thread
+        //counts into 32 bit shards, and RTPStatsUpdaterTask adds what they have
+        //counted to the totals above every once in awhile.
+        RTPStatsShards      fRTPStatsShards;
         
         //stores the current served bandwidth in BITS per second
         UInt32              fCurrentRTPBandwidthInBits;
@@ -348,6 +364,18 @@ class QTSServerInterface : public QTSSDictionary
         Float32             fCPUPercent;
         Float32             fCPUTimeUsedInSec;              
         
+        // how long signalled tasks wait for a task thread
+        UInt32              fTaskDispatchLatencyP99InUSecs;
+        
+        // QTRTPFile's parsed movie cache, as last set by the file module
+        UInt32              fMovieCacheHits;
+        UInt32              fMovieCacheMisses;
+        UInt32              fMovieCacheEvictions;
+        
+        // the file module's SDP cache
+        UInt32              fDescribeCacheHits;
+        UInt32              fDescribeCacheMisses;
+        
         // stores # of UDP sockets in the server currently (gets updated lazily via.
         // param retrieval function)
         UInt32              fTotalUDPSockets;
@@ -409,7 +437,7 @@ class RTPStatsUpdaterTask : public Task
     private:
     
         virtual SInt64 Run();
-        RTPSessionInterface* GetNewestSession(OSRefTable* inRTPSessionMap);
+        void ShedNewestSessions(QTSServerInterface* inServer, SInt64 inCurTime);
                 Float32 GetCPUTimeInSeconds();
         
         SInt64 fLastBandwidthTime;
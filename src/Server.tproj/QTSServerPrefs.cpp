@@ -37,6 +37,7 @@
 #include "QTSSDataConverter.h"
 #include "defaultPaths.h"
 #include "QTSSRollingLog.h"
+#include "UDPSocket.h"
  
 #ifndef __Win32__
 #include <sys/types.h>
@@ -155,7 +156,13 @@ QTSServerPrefs::PrefInfo QTSServerPrefs::sPrefInfo[] =
     { kDontAllowMultipleValues, "false",    NULL                    },   //disable_thinning
     { kAllowMultipleValues,     "Nokia",    sRTP_Header_Players     },  //player_requires_rtp_header_info
     { kAllowMultipleValues,     "Nokia",    sAdjust_Bandwidth_Players     },  //player_requires_bandwidth_adjustment
-    { kAllowMultipleValues,     "Nokia",    sNo_Pause_Time_Adjustment_Players     }  //player_requires_no_pause_time_adjustment
+    { kAllowMultipleValues,     "Nokia",    sNo_Pause_Time_Adjustment_Players     },  //player_requires_no_pause_time_adjustment
+    { kDontAllowMultipleValues, "1",        NULL                    },  //run_num_event_threads
+    { kDontAllowMultipleValues, "32",       NULL                    },  //udp_send_batch_size
+    { kDontAllowMultipleValues, "false",    NULL                    },  //enable_udp_gso
+    { kDontAllowMultipleValues, "false",    NULL                    },  //enable_tcp_zerocopy
+    { kDontAllowMultipleValues, "1",        NULL                    },  //sessions_shed_per_update
+    { kDontAllowMultipleValues, "false",    NULL                    }   //enable_rtp_pacing
    
 
 };
@@ -236,7 +243,13 @@ QTSSAttrInfoDict::AttrInfo  QTSServerPrefs::sAttributes[] =
     /* 69 */ { "disable_thinning",                      NULL,                   qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
 	/* 70 */ { "player_requires_rtp_header_info",		NULL,					qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
 	/* 71 */ { "player_requires_bandwidth_adjustment",	NULL,					qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
-	/* 72 */ { "player_requires_no_pause_time_adjustment",	NULL,				qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite }
+	/* 72 */ { "player_requires_no_pause_time_adjustment",	NULL,				qtssAttrDataTypeCharArray,	qtssAttrModeRead | qtssAttrModeWrite },
+    /* 73 */ { "run_num_event_threads",                 NULL,                   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 74 */ { "udp_send_batch_size",                   NULL,                   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 75 */ { "enable_udp_gso",                        NULL,                   qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 76 */ { "enable_tcp_zerocopy",                   NULL,                   qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 77 */ { "sessions_shed_per_update",              NULL,                   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 78 */ { "enable_rtp_pacing",                     NULL,                   qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite }
 
 };
 
@@ -294,6 +307,12 @@ QTSServerPrefs::QTSServerPrefs(XMLPrefsParser* inPrefsSource, Bool16 inWriteMiss
     fEnableRTSPDebugPrintfs(false),
     fEnableRTSPServerInfo(true),
     fNumThreads(0),
+    fNumEventThreads(1),
+    fUDPSendBatchSize(32),
+    fEnableUDPGSO(false),
+    fEnableTCPZeroCopy(false),
+    fSessionsShedPerUpdate(1),
+    fEnableRTPPacing(false),
 #if __MacOSX__
     fEnableMonitorStatsFile(false),
 #else
@@ -376,6 +395,12 @@ void QTSServerPrefs::SetupAttributes()
     this->SetVal(qtssPrefsEnableRTSPDebugPrintfs,       &fEnableRTSPDebugPrintfs,       sizeof(fEnableRTSPDebugPrintfs));
     this->SetVal(qtssPrefsEnableRTSPServerInfo,         &fEnableRTSPServerInfo,         sizeof(fEnableRTSPServerInfo));
     this->SetVal(qtssPrefsRunNumThreads,                &fNumThreads,                   sizeof(fNumThreads));
+    this->SetVal(qtssPrefsRunNumEventThreads,           &fNumEventThreads,              sizeof(fNumEventThreads));
+    this->SetVal(qtssPrefsUDPSendBatchSize,             &fUDPSendBatchSize,             sizeof(fUDPSendBatchSize));
+    this->SetVal(qtssPrefsEnableUDPGSO,                 &fEnableUDPGSO,                 sizeof(fEnableUDPGSO));
+    this->SetVal(qtssPrefsEnableTCPZeroCopy,            &fEnableTCPZeroCopy,            sizeof(fEnableTCPZeroCopy));
+    this->SetVal(qtssPrefsSessionsShedPerUpdate,        &fSessionsShedPerUpdate,        sizeof(fSessionsShedPerUpdate));
+    this->SetVal(qtssPrefsEnableRTPPacing,              &fEnableRTPPacing,              sizeof(fEnableRTPPacing));
     this->SetVal(qtssPrefsEnableMonitorStatsFile,       &fEnableMonitorStatsFile,       sizeof(fEnableMonitorStatsFile));
     this->SetVal(qtssPrefsMonitorStatsFileIntervalSec,  &fStatsFileIntervalSeconds,     sizeof(fStatsFileIntervalSeconds));
 
@@ -508,6 +533,7 @@ void QTSServerPrefs::RereadServerPreferences(Bool16 inWriteMissingPrefs)
     QTSSModuleUtils::SetEnableRTSPErrorMsg(fEnableRTSPErrMsg);
     
     QTSSRollingLog::SetCloseOnWrite(fCloseLogsOnWrite);
+    UDPSocket::SetSendBatchParams(fUDPSendBatchSize, fEnableUDPGSO);
     //
     // In case we made any changes, write out the prefs file
     (void)fPrefsSource->WritePrefsFile();
@@ -97,6 +97,7 @@ class QTSServerPrefs : public QTSSPrefs
         UInt32      GetTotalBytesUpdateTimeInSecs()     { return fTBUpdateTimeInSecs; }
         UInt32      GetAvgBandwidthUpdateTimeInSecs()   { return fABUpdateTimeInSecs; }
         UInt32      GetSafePlayDurationInSecs()         { return fSafePlayDurationInSecs; }
+        UInt32      GetSessionsShedPerUpdate()          { return fSessionsShedPerUpdate; }
         
         // For the compiled-in error logging module
         
@@ -124,6 +125,7 @@ class QTSServerPrefs : public QTSSPrefs
         Bool16  GetRTSPServerInfoEnabled()      { return fEnableRTSPServerInfo; }
         
 		Float32	GetOverbufferRate()				{ return fOverbufferRate; }
+        Bool16  IsRTPPacingEnabled()            { return fEnableRTPPacing; }
 		
         // RUDP window size
         UInt32  GetSmallWindowSizeInK()         { return fSmallWindowSizeInK; }
@@ -190,6 +192,8 @@ class QTSServerPrefs : public QTSSPrefs
         UInt32 DeleteSDPFilesInterval()     { return fsdp_file_delete_interval_seconds; }
                 
         UInt32  GetNumThreads()             { return fNumThreads; }
+        UInt32  GetNumEventThreads()        { return fNumEventThreads; }
+        Bool16  GetTCPZeroCopyEnabled()     { return fEnableTCPZeroCopy; }
         
         Bool16  DisableThinning()           { return fDisableThinning; }
     private:
@@ -254,6 +258,12 @@ class QTSServerPrefs : public QTSSPrefs
         Bool16  fEnableRTSPDebugPrintfs;
         Bool16  fEnableRTSPServerInfo;
         UInt32  fNumThreads;
+        UInt32  fNumEventThreads;
+        UInt32  fUDPSendBatchSize;
+        Bool16  fEnableUDPGSO;
+        Bool16  fEnableTCPZeroCopy;
+        UInt32  fSessionsShedPerUpdate;
+        Bool16  fEnableRTPPacing;
         Bool16  fEnableMonitorStatsFile;
         UInt32  fStatsFileIntervalSeconds;
 	
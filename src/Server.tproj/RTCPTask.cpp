@@ -25,7 +25,7 @@
 /*
     File:       RTCPTask.cpp
 
-    Contains:   Implementation of class defined in RTCPTask.h
+    Contains:   Implementation of classes defined in RTCPTask.h
                     
     
     
@@ -34,81 +34,136 @@
 */
 
 #include "RTCPTask.h"
-#include "QTSServerInterface.h"
-#include "UDPSocketPool.h"
-#include "RTPStream.h"
+#include "OSMemory.h"
 
-SInt64 RTCPTask::Run()
+OSMutex     RTCPPacketBuffer::sFreeMutex;
+OSQueue     RTCPPacketBuffer::sFreeQueue;
+
+void RTCPPacketBuffer::Get(RTCPPacketBuffer** outBuffers, UInt32 inNumBuffers)
+{
+    UInt32 theNumBuffers = 0;
+    {
+        OSMutexLocker locker(&sFreeMutex);
+        for ( ; theNumBuffers < inNumBuffers; theNumBuffers++)
+        {
+            OSQueueElem* theElem = sFreeQueue.DeQueue();
+            if (theElem == NULL)
+                break;
+            outBuffers[theNumBuffers] = (RTCPPacketBuffer*)theElem->GetEnclosingObject();
+        }
+    }
+    for ( ; theNumBuffers < inNumBuffers; theNumBuffers++)
+        outBuffers[theNumBuffers] = NEW RTCPPacketBuffer();
+}
+
+void RTCPPacketBuffer::Release(RTCPPacketBuffer* inBuffer)
+{
+    inBuffer->fStream = NULL;
+    inBuffer->fLen = 0;
+    
+    OSMutexLocker locker(&sFreeMutex);
+    sFreeQueue.EnQueue(&inBuffer->fQueueElem);
+}
+
+Bool16 RTCPPacketQueue::EnQueue(RTCPPacketBuffer* inPacket, Task* inTask)
+{
+    OSMutexLocker locker(&fMutex);
+    if (fClosed || (fQueue.GetLength() >= kMaxQueuedPackets))
+        return false;
+        
+    fQueue.EnQueue(inPacket->GetQueueElem());
+    if (fQueue.GetLength() == 1)
+        inTask->Signal(Task::kReadEvent);
+    return true;
+}
+
+void RTCPPacketQueue::ProcessAll()
 {
-    const UInt32 kMaxRTCPPacketSize = 2048;
-    char thePacketBuffer[kMaxRTCPPacketSize];
-    StrPtrLen thePacket(thePacketBuffer, 0);
-    QTSServerInterface* theServer = QTSServerInterface::GetServer();
+    while (true)
+    {
+        OSQueueElem* theElem = NULL;
+        {
+            OSMutexLocker locker(&fMutex);
+            theElem = fQueue.DeQueue();
+        }
+        if (theElem == NULL)
+            break;
+        
+        RTCPPacketBuffer* thePacket = (RTCPPacketBuffer*)theElem->GetEnclosingObject();
+        StrPtrLen thePacketData(thePacket->fData, thePacket->fLen);
+        thePacket->fStream->ProcessIncomingRTCPPacket(&thePacketData);
+        RTCPPacketBuffer::Release(thePacket);
+    }
+}
+
+void RTCPPacketQueue::Close()
+{
+    OSMutexLocker locker(&fMutex);
+    fClosed = true;
     
-    //This task goes through all the UDPSockets in the RTPSocketPool, checking to see
-    //if they have data. If they do, it demuxes the packets and sends the packet onto
-    //the proper RTP session.
-    EventFlags events = this->GetEvents(); // get and clear events
+    for (OSQueueElem* theElem = fQueue.DeQueue(); theElem != NULL; theElem = fQueue.DeQueue())
+        RTCPPacketBuffer::Release((RTCPPacketBuffer*)theElem->GetEnclosingObject());
+}
+
+void RTCPSocket::ProcessEvent(int /*eventBits*/)
+{
+    //
+    // Only this socket's demuxer is locked while looking up streams, so RTCP for
+    // other sockets and new SETUPs on the socket pool are never held up by this.
+    // The demuxer lock also keeps each stream alive until its packet is queued,
+    // because ~RTPStream has to take it to unregister.
+    UDPDemuxer* theDemuxer = this->GetDemuxer();
+    Assert(theDemuxer != NULL);
     
-    if ( (events & Task::kReadEvent) || (events & Task::kIdleEvent) )
+    RTCPPacketBuffer*   theBuffers[kRecvBatchSize];
+    void*               theBufferPtrs[kRecvBatchSize];
+    UDPRecvInfo         theInfo[kRecvBatchSize];
+    UInt32              theNumBuffers = 0;
+    
+    for (UInt32 theBatch = 0; theBatch < kMaxBatchesPerEvent; theBatch++)
+    {
+        //replace the buffers the last batch handed off
+        if (theNumBuffers < kRecvBatchSize)
+            RTCPPacketBuffer::Get(&theBuffers[theNumBuffers], kRecvBatchSize - theNumBuffers);
+        theNumBuffers = kRecvBatchSize;
+        for (UInt32 x = 0; x < kRecvBatchSize; x++)
+            theBufferPtrs[x] = theBuffers[x]->fData;
+            
+        UInt32 theNumReceived = 0;
+        (void)this->RecvFromMany(theBufferPtrs, RTCPPacketBuffer::kMaxRTCPPacketSize, kRecvBatchSize,
+                                    theInfo, &theNumReceived);
+        
+        //Buffers that don't get queued on a session are packed at the front of
+        //theBuffers for the next batch.
+        UInt32 theNumKept = 0;
+        if (theNumReceived > 0)
         {
-                //Must be done atomically wrt the socket pool.
-                
-                OSMutexLocker locker(theServer->GetSocketPool()->GetMutex());
-                for (OSQueueIter iter(theServer->GetSocketPool()->GetSocketQueue());
-                                !iter.IsDone(); iter.Next())
+            OSMutexLocker locker(theDemuxer->GetMutex());
+            for (UInt32 y = 0; y < theNumReceived; y++)
+            {
+                RTCPPacketBuffer* thePacket = theBuffers[y];
+                RTCPPacketReceiver* theStream = (RTCPPacketReceiver*)theDemuxer->GetTask(theInfo[y].fRemoteAddr, theInfo[y].fRemotePort);
+                if ((theStream != NULL) && (!theInfo[y].fTruncated))
                 {
-                        UInt32 theRemoteAddr = 0;
-                        UInt16 theRemotePort = 0;
-        
-                        UDPSocketPair* thePair = (UDPSocketPair*)iter.GetCurrent()->GetEnclosingObject();
-                        Assert(thePair != NULL);
-                        
-                        for (UInt32 x = 0; x < 2; x++)
-                        {
-                                UDPSocket* theSocket = NULL;
-                                if (x == 0)
-                                        theSocket = thePair->GetSocketA();
-                                else
-                                        theSocket = thePair->GetSocketB();
-                                        
-                                UDPDemuxer* theDemuxer = theSocket->GetDemuxer();
-                        if (theDemuxer == NULL) 
-                            continue;
-                        else
-                        {
-                                        theDemuxer->GetMutex()->Lock();
-                            while (true) //get all the outstanding packets for this socket
-                                {
-                                        thePacket.Len = 0;
-                                        theSocket->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket.Ptr,  
-                                                                        kMaxRTCPPacketSize, &thePacket.Len);
-                                        if (thePacket.Len == 0)
-                                        {
-                                                theSocket->RequestEvent(EV_RE);   
-                                                break;//no more packets on this socket!
-                                        }
-                                        
-                                        //if this socket has a demuxer, find the target RTPStream
-                                        if (theDemuxer != NULL)
-                                        {
-                                                RTPStream* theStream = (RTPStream*)theDemuxer->GetTask(theRemoteAddr, theRemotePort);
-                                                if (theStream != NULL)
-                                                        theStream->ProcessIncomingRTCPPacket(&thePacket);
-                                        }
-                                }
-                                        theDemuxer->GetMutex()->Unlock();
-                        }
+                    thePacket->fStream = theStream;
+                    thePacket->fLen = theInfo[y].fRecvLen;
+                    if (theStream->QueueIncomingRTCPPacket(thePacket))
+                        continue;
                 }
+                theBuffers[theNumKept++] = thePacket;
+            }
         }
+        for (UInt32 z = theNumReceived; z < theNumBuffers; z++)
+            theBuffers[theNumKept++] = theBuffers[z];
+        theNumBuffers = theNumKept;
+        
+        if (theNumReceived < kRecvBatchSize)
+            break; //no more packets on this socket!
     }
-     
-    return 0; /* Fix for 4004432 */   
-    /*
-    SInt64 result = 0;
-    if (theServer->GetNumRTPSessions() > 0)
-        result =  theServer->GetPrefs()->GetRTCPPollIntervalInMsec();
     
-   return result;
-   */
+    for (UInt32 theIndex = 0; theIndex < theNumBuffers; theIndex++)
+        RTCPPacketBuffer::Release(theBuffers[theIndex]);
+    
+    //If we stopped before draining the socket, the re-armed event fires right away
+    this->RequestEvent(EV_RE);
 }
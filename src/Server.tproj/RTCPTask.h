@@ -25,27 +25,129 @@
 /*
     File:       RTCPTask.h
 
-    Contains:   A task object that processes all incoming RTCP packets
-                for the server, and passes each one onto the task for
-                which it belongs. 
+    Contains:   The receive side of the server's RTCP sockets. Each RTCP socket
+                reads its own datagrams when the EventThread says it is readable,
+                finds the RTPStream each one is for through the socket's demuxer,
+                and queues the packet on that stream's RTPSession. The session
+                processes the packet the next time it runs, on its own thread.
 
 */
 
 #ifndef __RTCP_TASK_H__
 #define __RTCP_TASK_H__
 
+#include "UDPSocket.h"
+#include "UDPDemuxer.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
 #include "Task.h"
 
-class RTCPTask : public Task
+class RTCPPacketReceiver;
+
+//
+// A received RTCP packet, on its way from an RTCPSocket to the stream it is for.
+// These are recycled through a free list, so a packet is read straight into the
+// buffer that gets queued on the session.
+class RTCPPacketBuffer
+{
+    public:
+    
+        enum
+        {
+            kMaxRTCPPacketSize = 2048   //UInt32
+        };
+        
+        //Gets up to inNumBuffers buffers, allocating any the free list can't supply.
+        static void         Get(RTCPPacketBuffer** outBuffers, UInt32 inNumBuffers);
+        static void         Release(RTCPPacketBuffer* inBuffer);
+        
+        OSQueueElem*        GetQueueElem()  { return &fQueueElem; }
+        
+        RTCPPacketReceiver* fStream;
+        UInt32              fLen;
+        char                fData[kMaxRTCPPacketSize];
+        
+    private:
+    
+        RTCPPacketBuffer() : fStream(NULL), fLen(0), fQueueElem(this) {}
+        
+        OSQueueElem         fQueueElem;
+        
+        static OSMutex      sFreeMutex;
+        static OSQueue      sFreeQueue;
+};
+
+//
+// What an RTCPSocket's demuxer finds for each packet it reads. The server
+// registers its RTPStreams.
+class RTCPPacketReceiver : public UDPDemuxerTask
+{
+    public:
+    
+        virtual ~RTCPPacketReceiver() {}
+        
+        //Called on the EventThread. Takes the packet, or returns false and leaves
+        //it with the caller.
+        virtual Bool16  QueueIncomingRTCPPacket(RTCPPacketBuffer* inPacket) = 0;
+        
+        //Called for each queued packet, on the thread that empties the queue
+        virtual void    ProcessIncomingRTCPPacket(StrPtrLen* inPacket) = 0;
+};
+
+//
+// The RTCP packets waiting for one session's Run. The mutex is only ever held
+// for a queue operation, so the EventThread never waits on a session.
+class RTCPPacketQueue
 {
     public:
-        //This task handles all incoming RTCP data. It just polls, so make sure
-        //to start the polling process by signalling a start event.
-        RTCPTask() : Task() {this->SetTaskName("RTCPTask"); this->Signal(Task::kStartEvent); }
-        virtual ~RTCPTask() {}
     
+        RTCPPacketQueue() : fClosed(false) {}
+        ~RTCPPacketQueue() { this->Close(); }
+        
+        //Queues the packet and, if it is the only one, signals inTask. One signal
+        //covers everything queued before the task gets to run. Returns false, and
+        //leaves the packet with the caller, if the queue is closed or full.
+        Bool16  EnQueue(RTCPPacketBuffer* inPacket, Task* inTask);
+        
+        //Hands each queued packet to its receiver, then frees it
+        void    ProcessAll();
+        
+        //Frees any queued packets and stops more from being queued. Signals are
+        //sent with the mutex held, so once this returns inTask is never signalled.
+        void    Close();
+        
     private:
-        virtual SInt64 Run();
+    
+        enum
+        {
+            kMaxQueuedPackets = 64  //UInt32
+        };
+        
+        OSMutex     fMutex;
+        OSQueue     fQueue;
+        Bool16      fClosed;
+};
+
+class RTCPSocket : public UDPSocket
+{
+    public:
+    
+        RTCPSocket() : UDPSocket(NULL, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType) {}
+        virtual ~RTCPSocket() {}
+        
+    protected:
+    
+        //Runs on the EventThread. Drains the socket in recvmmsg sized batches, then
+        //asks for the next read event.
+        virtual void ProcessEvent(int eventBits);
+        
+    private:
+    
+        enum
+        {
+            kRecvBatchSize      = 32,   //UInt32. datagrams per RecvFromMany
+            kMaxBatchesPerEvent = 8     //UInt32. then give the other sockets a turn
+        };
 };
 
 #endif //__RTCP_TASK_H__
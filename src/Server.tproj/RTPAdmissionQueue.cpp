@@ -0,0 +1,73 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPAdmissionQueue.cpp
+
+    Contains:   Implementation of the class
+    
+
+*/
+
+#include "RTPAdmissionQueue.h"
+
+void RTPAdmissionQueue::Add(RTPAdmissionQueueElem* inElem, SInt64 inCreateTime)
+{
+    OSMutexLocker locker(&fMutex);
+    Assert(!inElem->IsInQueue());
+    inElem->fCreateTime = inCreateTime;
+    fQueue.EnQueue(&inElem->fQueueElem);
+}
+
+void RTPAdmissionQueue::Remove(RTPAdmissionQueueElem* inElem)
+{
+    OSMutexLocker locker(&fMutex);
+    if (inElem->IsInQueue())
+        fQueue.Remove(&inElem->fQueueElem);
+}
+
+UInt32 RTPAdmissionQueue::ShedNewest(SInt64 inCurTime, SInt64 inSafePlayDuration, UInt32 inMaxToShed)
+{
+    //The newest sessions are at the tail, so this only looks at the ones it
+    //kills, plus one. Sessions can't be deleted while the mutex is held, so
+    //they can be signalled without locking the session map.
+    OSMutexLocker locker(&fMutex);
+    UInt32 theNumShed = 0;
+    for ( ; theNumShed < inMaxToShed; theNumShed++)
+    {
+        OSQueueElem* theQueueElem = fQueue.GetTail();
+        if (theQueueElem == NULL)
+            break;
+            
+        RTPAdmissionQueueElem* theElem = (RTPAdmissionQueueElem*)theQueueElem->GetEnclosingObject();
+        Assert(theElem->fCreateTime > 0);
+        if ((inCurTime - theElem->fCreateTime) >= inSafePlayDuration)
+            break;
+        
+        //Take it out now so the next one can be found; the session is on its way out
+        fQueue.Remove(theQueueElem);
+        theElem->fSession->Signal(Task::kKillEvent);
+    }
+    return theNumShed;
+}
@@ -0,0 +1,92 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPAdmissionQueue.h
+
+    Contains:   The server's RTP sessions in the order they were activated, so
+                that when it goes over max_bandwidth the newest ones can be shed
+                without walking, or even locking, the RTP session map.
+                
+                A session is taken out as it is killed, and again as it is
+                deleted in case it never got that far. Holding the queue's
+                mutex therefore keeps every session in it alive.
+
+*/
+
+#ifndef __RTP_ADMISSION_QUEUE_H__
+#define __RTP_ADMISSION_QUEUE_H__
+
+#include "OSHeaders.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+#include "Task.h"
+
+class RTPAdmissionQueueElem
+{
+    public:
+    
+        RTPAdmissionQueueElem() : fQueueElem(this), fSession(NULL), fCreateTime(0) {}
+        
+        void    SetSession(Task* inSession) { fSession = inSession; }
+        Bool16  IsInQueue()                 { return fQueueElem.IsMemberOfAnyQueue(); }
+        
+    private:
+    
+        OSQueueElem fQueueElem;
+        Task*       fSession;       //sent a kKillEvent when shed
+        SInt64      fCreateTime;    //msec, of the session
+        
+        friend class RTPAdmissionQueue;
+};
+
+class RTPAdmissionQueue
+{
+    public:
+    
+        RTPAdmissionQueue() {}
+        ~RTPAdmissionQueue() {}
+        
+        //Adds a session that was created at inCreateTime as the newest. It must
+        //not be in the queue already.
+        void    Add(RTPAdmissionQueueElem* inElem, SInt64 inCreateTime);
+        
+        //Takes a session out, if it is still in
+        void    Remove(RTPAdmissionQueueElem* inElem);
+        
+        //Kills up to inMaxToShed sessions, newest first, and takes them out.
+        //Stops at the first session that has played for inSafePlayDuration
+        //msecs or more, so it and everything older are left alone. Returns how
+        //many were killed.
+        UInt32  ShedNewest(SInt64 inCurTime, SInt64 inSafePlayDuration, UInt32 inMaxToShed);
+        
+        UInt32  GetLength() { return fQueue.GetLength(); }
+        
+    private:
+    
+        OSMutex fMutex;
+        OSQueue fQueue;     //newest at the tail
+};
+
+#endif //__RTP_ADMISSION_QUEUE_H__
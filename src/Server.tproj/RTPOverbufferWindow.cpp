@@ -91,7 +91,7 @@ SInt64 RTPOverbufferWindow::CheckTransmitTime(const SInt64& inTransmitTime, cons
 	if (fOverbufferWindowBegin == -1)
 		fOverbufferWindowBegin = inCurrentTime;
 	
-	if ((inTransmitTime <= inCurrentTime + fSendInterval) || 
+	if (this->IsPacketDue(inTransmitTime, inCurrentTime) || 
 		(fOverbufferingEnabled && (inTransmitTime <= inCurrentTime + fSendInterval + fSendAheadDurationInMsec)))
     {
         //
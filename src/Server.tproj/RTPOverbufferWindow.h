@@ -76,6 +76,12 @@ class RTPOverbufferWindow
         // bitrate is above the max play rate.
         SInt64 CheckTransmitTime(const SInt64& inTransmitTime, const SInt64& inCurrentTime, SInt32 inPacketSize);
         
+        //
+        // A packet is due once its transmit time falls within the current send
+        // interval. Due packets go out whatever the window says.
+        Bool16  IsPacketDue(const SInt64& inTransmitTime, const SInt64& inCurrentTime)
+            { return inTransmitTime <= inCurrentTime + fSendInterval; }
+        
         //
         // Remembers that this packet has been sent
         void AddPacketToWindow(SInt32 inPacketSize);
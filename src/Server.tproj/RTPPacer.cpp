@@ -0,0 +1,191 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPPacer.cpp
+
+    Contains:   Implementation of the class
+    
+
+*/
+
+#include "RTPPacer.h"
+#include "OSMemory.h"
+#include "MyAssert.h"
+
+// Probe at 5/4 for one round trip, drain at 3/4 for the next, then cruise for six
+const UInt32 RTPPacer::sGainCycle[] = { 1250, 750, 1000, 1000, 1000, 1000, 1000, 1000 };
+
+RTPPacer::RTPPacer(UInt32 inSendInterval)
+:   fSendInterval(inSendInterval),
+    fState(kStartupState),
+    fMinRTT(0),
+    fMinRTTStamp(0),
+    fSmoothedRTT(0),
+    fDeliveryRate(0),
+    fBandwidthSampleIndex(0),
+    fBottleneckBandwidth(0),
+    fFullBandwidth(0),
+    fFullBandwidthCount(0),
+    fCycleIndex(0),
+    fCycleStart(0),
+    fPacingRate(0),
+    fTokens(0),
+    fLastTokenTime(0)
+{
+    if (fSendInterval == 0)
+        fSendInterval = 200;
+        
+    for (UInt32 x = 0; x < kNumBandwidthSamples; x++)
+    {
+        fBandwidthSamples[x] = 0;
+        fBandwidthSampleTimes[x] = 0;
+    }
+}
+
+void RTPPacer::AddRTTSample(SInt32 inRTTMSecs, const SInt64& inCurrentTime)
+{
+    if (inRTTMSecs < 0)
+        return;
+    UInt32 theRTT = (UInt32)inRTTMSecs;
+    
+    //
+    // The minimum is only good for so long; if the path changed, the old
+    // minimum can't be gotten back, so let a newer sample replace it.
+    if ((fMinRTTStamp == 0) || (theRTT <= fMinRTT) || (inCurrentTime - fMinRTTStamp > kMinRTTWindowMSecs))
+    {
+        fMinRTT = theRTT;
+        fMinRTTStamp = inCurrentTime;
+    }
+    
+    if (fSmoothedRTT == 0)
+        fSmoothedRTT = theRTT;
+    else
+        fSmoothedRTT = ((fSmoothedRTT * 7) + theRTT) / 8;
+}
+
+void RTPPacer::UpdateDeliveryRate(UInt32 inOldStreamBitRate, UInt32 inNewStreamBitRate, const SInt64& inCurrentTime)
+{
+    fDeliveryRate += (SInt64)inNewStreamBitRate - (SInt64)inOldStreamBitRate;
+    if (fDeliveryRate < 0)
+        fDeliveryRate = 0;
+    if (fDeliveryRate > (SInt64)0xFFFFFFFF)
+        fDeliveryRate = 0xFFFFFFFF;
+        
+    fBandwidthSamples[fBandwidthSampleIndex] = (UInt32)fDeliveryRate;
+    fBandwidthSampleTimes[fBandwidthSampleIndex] = inCurrentTime;
+    fBandwidthSampleIndex = (fBandwidthSampleIndex + 1) % kNumBandwidthSamples;
+    
+    //
+    // The delivery rate can only fall short of the bottleneck bandwidth (the
+    // sender didn't have enough to send, or the client's reports were spaced
+    // out), so the best estimate is the most it has been lately.
+    UInt32 theMaxBandwidth = 0;
+    for (UInt32 x = 0; x < kNumBandwidthSamples; x++)
+    {
+        if ((fBandwidthSampleTimes[x] != 0) && (inCurrentTime - fBandwidthSampleTimes[x] <= kBandwidthWindowMSecs) &&
+            (fBandwidthSamples[x] > theMaxBandwidth))
+            theMaxBandwidth = fBandwidthSamples[x];
+    }
+    fBottleneckBandwidth = theMaxBandwidth;
+    
+    if (fState != kStartupState)
+        return;
+        
+    //
+    // Startup ends once the bottleneck bandwidth stops growing, which means
+    // sending faster only built a queue somewhere.
+    if ((SInt64)fBottleneckBandwidth >= (SInt64)fFullBandwidth + (SInt64)(fFullBandwidth / 4))
+    {
+        fFullBandwidth = fBottleneckBandwidth;
+        fFullBandwidthCount = 0;
+    }
+    else if (++fFullBandwidthCount >= kStartupRoundsToExit)
+    {
+        fState = kProbeBandwidthState;
+        fCycleIndex = 2; // start out cruising, not probing on top of the startup queue
+        fCycleStart = inCurrentTime;
+    }
+}
+
+void RTPPacer::UpdatePacingRate(const SInt64& inCurrentTime, UInt32 inMediaBitRate)
+{
+    UInt32 theGain = kStartupGain;
+    if (fState == kProbeBandwidthState)
+    {
+        //
+        // Each gain lasts one round trip, so a probe has time to show up in the
+        // RTT before the drain that follows it. Without a round trip time yet,
+        // use the send interval.
+        SInt64 theCycleLength = (fMinRTT > fSendInterval) ? fMinRTT : fSendInterval;
+        if (inCurrentTime - fCycleStart > theCycleLength)
+        {
+            fCycleIndex = (fCycleIndex + 1) % kNumGainCycleStates;
+            fCycleStart = inCurrentTime;
+        }
+        theGain = sGainCycle[fCycleIndex];
+    }
+    
+    SInt64 theRate = ((SInt64)fBottleneckBandwidth * theGain) / kGainUnit;
+    SInt64 theFloor = ((SInt64)inMediaBitRate * kMediaRateFloorGain) / kGainUnit;
+    if (theRate < theFloor)
+        theRate = theFloor;
+    if (theRate > (SInt64)0xFFFFFFFF)
+        theRate = 0xFFFFFFFF;
+    if (theRate < 1)    // a tiny estimate and no media bitrate can round to 0
+        theRate = 1;
+    fPacingRate = (UInt32)theRate;
+}
+
+SInt64 RTPPacer::CheckTransmitTime(const SInt64& inCurrentTime, SInt32 inPacketSize, UInt32 inMediaBitRate)
+{
+    if (!this->HasEstimate())
+        return -1;
+        
+    this->UpdatePacingRate(inCurrentTime, inMediaBitRate);
+    Assert(fPacingRate > 0);
+    
+    //
+    // The bucket holds a short burst's worth at the pacing rate, plus a couple of
+    // packets so a big packet at a low rate isn't stuck forever.
+    UInt32 theBurstMSecs = (fSendInterval < kMaxBurstMSecs) ? fSendInterval : kMaxBurstMSecs;
+    SInt64 theBucketDepth = ((SInt64)fPacingRate * theBurstMSecs) + (2 * kMaxPacketSize * kTokensPerByte);
+    
+    if (fLastTokenTime == 0)
+        fTokens = theBucketDepth;
+    else if (inCurrentTime > fLastTokenTime)
+        fTokens += (SInt64)fPacingRate * (inCurrentTime - fLastTokenTime);
+    fLastTokenTime = inCurrentTime;
+    
+    if (fTokens > theBucketDepth)
+        fTokens = theBucketDepth;
+    
+    SInt64 theTokensNeeded = (SInt64)inPacketSize * kTokensPerByte;
+    if (theTokensNeeded > theBucketDepth)
+        theTokensNeeded = theBucketDepth;
+    if (fTokens >= theTokensNeeded)
+        return -1;  // send this packet
+        
+    return inCurrentTime + ((theTokensNeeded - fTokens) / fPacingRate) + 1;
+}
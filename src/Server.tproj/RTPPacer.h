@@ -0,0 +1,159 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPPacer.h
+
+    Contains:   Per-session model of the path to the client, and the token bucket
+                that paces RTP packets out at a rate derived from it.
+                
+                The model keeps a windowed maximum of the delivery rate the client
+                reports (the bottleneck bandwidth) and a windowed minimum of the round
+                trip time, in the manner of BBR. Packets are released at a multiple of
+                the bottleneck bandwidth, cycling through gains that probe for more
+                bandwidth and then drain whatever queue the probe built, instead of
+                going out in one burst per send interval.
+
+*/
+
+#ifndef __RTP_PACER_H__
+#define __RTP_PACER_H__
+
+#include "OSHeaders.h"
+
+class RTPPacer
+{
+    public:
+
+        RTPPacer(UInt32 inSendInterval);
+        ~RTPPacer() { }
+        
+        //
+        // FEEDBACK
+        
+        //
+        // Each round trip time measured from an RTCP receiver report or ack
+        void AddRTTSample(SInt32 inRTTMSecs, const SInt64& inCurrentTime);
+        
+        //
+        // Each stream measures its own delivery rate (bits / sec) from the receiver
+        // reports for it, and passes in the previous and the new measurement. The
+        // session's delivery rate is the sum over its streams.
+        void UpdateDeliveryRate(UInt32 inOldStreamBitRate, UInt32 inNewStreamBitRate, const SInt64& inCurrentTime);
+        
+        //
+        // PACING
+        
+        //
+        // Call on each PLAY, so a session that was paused doesn't start out with
+        // tokens it saved up while it was paused (or without any at all)
+        void ResetPacingBucket() { fLastTokenTime = 0; }
+        
+        //
+        // If this packet can't go out yet, returns the time when enough tokens will
+        // have accumulated for it. Otherwise, returns -1. inMediaBitRate is the rate
+        // the media needs, or 0 if it isn't known; packets are never paced below it.
+        // Only packets sent ahead of their transmit time should be checked, so a
+        // low estimate can't hold back packets that are due.
+        SInt64 CheckTransmitTime(const SInt64& inCurrentTime, SInt32 inPacketSize, UInt32 inMediaBitRate);
+        
+        //
+        // Remembers that this packet has been sent
+        void AddPacketSent(SInt32 inPacketSize) { fTokens -= (SInt64)inPacketSize * kTokensPerByte; }
+        
+        //
+        // ACCESSORS
+        
+        // Until the first delivery rate comes in, there's nothing to pace by
+        Bool16  HasEstimate()               { return fBottleneckBandwidth > 0; }
+        Bool16  IsStartingUp()              { return fState == kStartupState; }
+        
+        UInt32  GetBottleneckBandwidth()    { return fBottleneckBandwidth; }
+        UInt32  GetMinRTT()                 { return fMinRTT; }
+        UInt32  GetSmoothedRTT()            { return fSmoothedRTT; }
+        UInt32  GetPacingRate()             { return fPacingRate; }
+        
+        UInt32* BottleneckBandwidthPtr()    { return &fBottleneckBandwidth; }
+        UInt32* MinRTTPtr()                 { return &fMinRTT; }
+        UInt32* SmoothedRTTPtr()            { return &fSmoothedRTT; }
+
+    private:
+    
+        void    UpdatePacingRate(const SInt64& inCurrentTime, UInt32 inMediaBitRate);
+        
+        enum
+        {
+            kStartupState           = 0,
+            kProbeBandwidthState    = 1
+        };
+        
+        enum
+        {
+            kTokensPerByte          = 8000,     // tokens are bit-milliseconds, so a bits / sec rate
+                                                // times a msec interval comes out in tokens
+            kMaxPacketSize          = 1500,
+            kMaxBurstMSecs          = 10,       // never release more than this much at once
+            
+            kMinRTTWindowMSecs      = 30000,    // receiver reports only come every few seconds, so
+            kBandwidthWindowMSecs   = 30000,    // these windows are long compared to TCP's
+            kNumBandwidthSamples    = 8,
+            
+            kStartupRoundsToExit    = 3,        // leave startup once the bandwidth stops growing 
+            kNumGainCycleStates     = 8,        // by a quarter for this many reports
+            
+            kGainUnit               = 1000,
+            kStartupGain            = 2885,     // 2 / ln(2)
+            kMediaRateFloorGain     = 1250
+        };
+        
+        static const UInt32 sGainCycle[kNumGainCycleStates];
+        
+        UInt32  fSendInterval;
+        UInt32  fState;
+        
+        // Path model
+        UInt32  fMinRTT;
+        SInt64  fMinRTTStamp;
+        UInt32  fSmoothedRTT;
+        
+        SInt64  fDeliveryRate;
+        UInt32  fBandwidthSamples[kNumBandwidthSamples];
+        SInt64  fBandwidthSampleTimes[kNumBandwidthSamples];
+        UInt32  fBandwidthSampleIndex;
+        UInt32  fBottleneckBandwidth;
+        
+        UInt32  fFullBandwidth;
+        UInt32  fFullBandwidthCount;
+        
+        UInt32  fCycleIndex;
+        SInt64  fCycleStart;
+        
+        // Token bucket
+        UInt32  fPacingRate;
+        SInt64  fTokens;
+        SInt64  fLastTokenTime;
+};
+
+
+#endif // __RTP_PACER_H__
@@ -35,7 +35,7 @@
 #include "RTPPacketResender.h"
 #include "RTPStream.h"
 #include "atomic.h"
-#include "OSMutex.h"
+#include "QTSServerInterface.h"
 
 #if RTP_PACKET_RESENDER_DEBUGGING
 #include "QTSSRollingLog.h"
@@ -72,13 +72,24 @@ class MyAckListLog : public QTSSRollingLog
 };
 #endif
 
-static const UInt32 kPacketArrayIncreaseInterval = 32;// must be multiple of 2
-static const UInt32 kInitialPacketArraySize = 64;// must be multiple of kPacketArrayIncreaseInterval (Turns out this is as big as we typically need)
-//static const UInt32 kMaxPacketArraySize = 512;// must be multiple of kPacketArrayIncreaseInterval it would have to be a 3 mbit or more
+static const UInt32 kInitialPacketArraySize = 64;// must be a power of 2 (Turns out this is as big as we typically need)
+static const UInt32 kMaxPacketArraySize = 8192;// must be a power of 2, and well short of the 64K sequence numbers
 
 static const UInt32 kMaxDataBufferSize = 1600;
-OSBufferPool RTPPacketResender::sBufferPool(kMaxDataBufferSize);
-unsigned int    RTPPacketResender::sNumWastedBytes = 0;
+OSSlabAllocator* RTPPacketResender::sAllocator = NULL;
+
+static void AlterRetransmitWastedBytes(SInt32 inDifference)
+{
+    // There is no server when the resender is tested on its own
+    QTSServerInterface* theServer = QTSServerInterface::GetServer();
+    if (theServer != NULL)
+        theServer->AlterRetransmitWastedBytes(inDifference);
+}
+
+void RTPPacketResender::Initialize()
+{
+    sAllocator = NEW OSSlabAllocator("RTPPacketResender", kMaxDataBufferSize);
+}
 
 RTPPacketResender::RTPPacketResender()
 :   fBandwidthTracker(NULL),
@@ -93,10 +104,9 @@ RTPPacketResender::RTPPacketResender()
     fNumSent(0),
     fPacketArray(NULL),
     fPacketArraySize(kInitialPacketArraySize),
-    fPacketArrayMask(0),
-    fHighestSeqNum(0),
-    fLastUsed(0),
-    fPacketQMutex()
+    fPacketArrayMask(kInitialPacketArraySize - 1),
+    fOldestEntry(NULL),
+    fNewestEntry(NULL)
 {
     fPacketArray = (RTPResenderEntry*) NEW char[sizeof(RTPResenderEntry) * fPacketArraySize];
     ::memset(fPacketArray,0,sizeof(RTPResenderEntry) * fPacketArraySize);
@@ -105,18 +115,8 @@ RTPPacketResender::RTPPacketResender()
 
 RTPPacketResender::~RTPPacketResender()
 {
-    for (UInt32 x = 0; x < fPacketArraySize; x++)
-    {
-        if (fPacketArray[x].fPacketSize > 0)
-            atomic_sub(&sNumWastedBytes, kMaxDataBufferSize - fPacketArray[x].fPacketSize);
-        if (fPacketArray[x].fPacketData != NULL)
-        {
-            if (fPacketArray[x].fIsSpecialBuffer)
-                delete [] (char*)fPacketArray[x].fPacketData;
-            else
-                sBufferPool.Put(fPacketArray[x].fPacketData);
-        }
-    }
+    while (fOldestEntry != NULL)
+        this->RemovePacket(fOldestEntry);
             
     delete [] fPacketArray;
     
@@ -226,48 +226,34 @@ void RTPPacketResender::SetDestination(UDPSocket* inOutputSocket, UInt32 inDestA
     fDestPort = inDestPort;
 }
 
+RTPResenderEntry* RTPPacketResender::GetEntryBySeqNum(UInt16 inSeqNum)
+{
+    RTPResenderEntry* theEntry = &fPacketArray[inSeqNum & fPacketArrayMask];
+    if ((theEntry->fPacketSize == 0) || (theEntry->fSeqNum != inSeqNum))
+        return NULL;
+    return theEntry;
+}
+
 RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize)
 {
     
-    RTPResenderEntry* theEntry = NULL;
+    RTPResenderEntry* theEntry = &fPacketArray[inSeqNum & fPacketArrayMask];
     
-    for (UInt32 packetIndex = 0 ;packetIndex < fPacketsInList; packetIndex++) // see if packet is already in the array
-    {   if (inSeqNum == fPacketArray[packetIndex].fSeqNum)
-        {   return NULL;
-        }
-    }
-
-    if (fPacketsInList == fPacketArraySize) // allocate a new array
-    {
-        fPacketArraySize += kPacketArrayIncreaseInterval;
-        RTPResenderEntry* tempArray = (RTPResenderEntry*) NEW char[sizeof(RTPResenderEntry) * fPacketArraySize];
-        ::memset(tempArray,0,sizeof(RTPResenderEntry) * fPacketArraySize);
-        ::memcpy(tempArray,fPacketArray,sizeof(RTPResenderEntry) * fPacketsInList);
-        delete [] fPacketArray;
-        fPacketArray = tempArray;
-        //qtss_printf("NewArray size=%ld packetsInList=%ld\n",fPacketArraySize, fPacketsInList);
-    }
-
-    if (fPacketsInList <  fPacketArraySize) // have an open spot
-    {   theEntry = &fPacketArray[fPacketsInList];
-        fPacketsInList++;
-        
-        if (fPacketsInList < fPacketArraySize)
-            fLastUsed = fPacketsInList;
-        else
-            fLastUsed = fPacketArraySize;
-    }
-    else 
+    while (theEntry->fPacketSize > 0)
     {
-        // nothing open so re-use 
-        if (fLastUsed < fPacketArraySize - 1)
-            fLastUsed ++;
-        else
-            fLastUsed = 0;
+        if (theEntry->fSeqNum == inSeqNum) // packet is already in the array
+            return NULL;
             
-        //qtss_printf("array is full = %lu reusing index=%lu\n",fPacketsInList,fLastUsed); 
-        theEntry = &fPacketArray[fLastUsed];
-        RemovePacket(fLastUsed, false); // delete packet in place don't fill we will use the spot
+        //
+        // The packets outstanding span more sequence numbers than the array holds.
+        // Make it bigger, or if it is as big as it gets, give up on the old packet.
+        if (fPacketArraySize < kMaxPacketArraySize)
+        {
+            this->ReallocatePacketArray();
+            theEntry = &fPacketArray[inSeqNum & fPacketArrayMask];
+        }
+        else
+            this->RemovePacket(theEntry, true); // delete packet in place, we will use the spot
     }
             
     //
@@ -275,13 +261,12 @@ RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inP
     // we need to specially allocate a special buffer
     if (inPacketSize > kMaxDataBufferSize)
     {
-        //sBufferPool.Put(theEntry->fPacketData);
         theEntry->fIsSpecialBuffer = true;
         theEntry->fPacketData = NEW char[inPacketSize];
     }
-    else// It is not special, it's from the buffer pool
+    else// It is not special, it's from the slab allocator
     {   theEntry->fIsSpecialBuffer = false;
-        theEntry->fPacketData = sBufferPool.Get();
+        theEntry->fPacketData = sAllocator->Get();
     }
 
     
@@ -289,26 +274,74 @@ RTPResenderEntry*   RTPPacketResender::GetEmptyEntry(UInt16 inSeqNum, UInt32 inP
     return theEntry;
 }
 
+void RTPPacketResender::ReallocatePacketArray()
+{
+    UInt32 theNewArraySize = fPacketArraySize * 2;
+    RTPResenderEntry* theNewArray = (RTPResenderEntry*) NEW char[sizeof(RTPResenderEntry) * theNewArraySize];
+    ::memset(theNewArray,0,sizeof(RTPResenderEntry) * theNewArraySize);
+    
+    //
+    // Sequence numbers that were different in the low bits still are, so nothing
+    // collides. Move the entries over in due order, relinking them as we go.
+    RTPResenderEntry* theOldEntry = fOldestEntry;
+    fOldestEntry = NULL;
+    fNewestEntry = NULL;
+    while (theOldEntry != NULL)
+    {
+        RTPResenderEntry* theNewEntry = &theNewArray[theOldEntry->fSeqNum & (theNewArraySize - 1)];
+        Assert(theNewEntry->fPacketSize == 0);
+        *theNewEntry = *theOldEntry;
+        this->AddToDueList(theNewEntry);
+        theOldEntry = theOldEntry->fNextDue;
+    }
+    
+    delete [] fPacketArray;
+    fPacketArray = theNewArray;
+    fPacketArraySize = theNewArraySize;
+    fPacketArrayMask = theNewArraySize - 1;
+    //qtss_printf("NewArray size=%ld packetsInList=%ld\n",fPacketArraySize, fPacketsInList);
+}
+
+void RTPPacketResender::AddToDueList(RTPResenderEntry* inEntry)
+{
+    inEntry->fNextDue = NULL;
+    inEntry->fPrevDue = fNewestEntry;
+    if (fNewestEntry != NULL)
+        fNewestEntry->fNextDue = inEntry;
+    else
+        fOldestEntry = inEntry;
+    fNewestEntry = inEntry;
+}
+
+void RTPPacketResender::RemoveFromDueList(RTPResenderEntry* inEntry)
+{
+    if (inEntry->fPrevDue != NULL)
+        inEntry->fPrevDue->fNextDue = inEntry->fNextDue;
+    else
+        fOldestEntry = inEntry->fNextDue;
+        
+    if (inEntry->fNextDue != NULL)
+        inEntry->fNextDue->fPrevDue = inEntry->fPrevDue;
+    else
+        fNewestEntry = inEntry->fPrevDue;
+        
+    inEntry->fNextDue = NULL;
+    inEntry->fPrevDue = NULL;
+}
 
 void RTPPacketResender::ClearOutstandingPackets()
 {   
-    //OSMutexLocker packetQLocker(&fPacketQMutex);
-    //for (UInt16 packetIndex = 0; packetIndex < fPacketArraySize; packetIndex++) //Testing purposes
-    for (UInt16 packetIndex = 0; packetIndex < fPacketsInList; packetIndex++)
-    {
-        this->RemovePacket(packetIndex,false);// don't move packets delete in place
-        Assert(fPacketArray[packetIndex].fPacketSize==0);
-    }
+    while (fOldestEntry != NULL)
+        this->RemovePacket(fOldestEntry, true);
+        
     if (fBandwidthTracker != NULL)
         fBandwidthTracker->EmptyWindow(fBandwidthTracker->BytesInList()); //clean it out
-    fPacketsInList = 0; // deleting in place doesn't decrement
     
     Assert(fPacketsInList == 0);
 }
 
 void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32 ageLimit )
 {
-    //OSMutexLocker packetQLocker(&fPacketQMutex);
     // the caller needs to adjust the overall age limit by reducing it
     // by the current packet lateness.
     
@@ -337,9 +370,18 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
         theEntry->fNumResends = 0;
         theEntry->fSeqNum = theSeqNum;
         
+        //
+        // Every entry comes due a retransmit timeout after it was last sent,
+        // so the newest one is always the last one due.
+        this->AddToDueList(theEntry);
+        fPacketsInList++;
+        if (fPacketsInList > fMaxPacketsInList)
+            fMaxPacketsInList = fPacketsInList;
+        
         //
         // Track the number of wasted bytes we have
-        atomic_add(&sNumWastedBytes, kMaxDataBufferSize - packetSize);
+        if (!theEntry->fIsSpecialBuffer)
+            AlterRetransmitWastedBytes(kMaxDataBufferSize - packetSize);
         
         //PLDoubleLinkedListNode<RTPResenderEntry> * listNode = NEW PLDoubleLinkedListNode<RTPResenderEntry>( new RTPResenderEntry(inRTPPacket, packetSize, ageLimit, fRTTEstimator.CurRetransmitTimeout() ) );
         //fAckList.AddNodeToTail(listNode);
@@ -355,22 +397,10 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
     fNumSent++;
 }
 
-void RTPPacketResender::AckPacket( UInt16 inSeqNum, SInt64& inCurTimeInMsec )
+SInt32 RTPPacketResender::AckPacket( UInt16 inSeqNum, SInt64& inCurTimeInMsec )
 {
-    //OSMutexLocker packetQLocker(&fPacketQMutex);
-    
-    SInt32 foundIndex = -1;
-    for (UInt32 packetIndex = 0 ;packetIndex < fPacketsInList; packetIndex++)
-    {   if (inSeqNum == fPacketArray[packetIndex].fSeqNum)
-        {   foundIndex = packetIndex;
-            break;
-        }
-    }
-    
-    RTPResenderEntry* theEntry = NULL;
-    if (foundIndex != -1)
-        theEntry = &fPacketArray[foundIndex];
-
+    SInt32 theRTT = -1;
+    RTPResenderEntry* theEntry = this->GetEntryBySeqNum(inSeqNum);
 
     if (theEntry == NULL || theEntry->fPacketSize == 0 )
     {   /*  we got an ack for a packet that has already expired or
@@ -417,7 +447,8 @@ void RTPPacketResender::AckPacket( UInt16 inSeqNum, SInt64& inCurTimeInMsec )
             // only use rtt from packets acked after their initial send, do not use
             // estimates gatherered from re-trasnmitted packets.
             //fRTTEstimator.AddToEstimate( theEntry->fPacketRTTDuration.DurationInMilliseconds() );
-            fBandwidthTracker->AddToRTTEstimate( (SInt32) ( inCurTimeInMsec - theEntry->fAddedTime ) );
+            theRTT = (SInt32) ( inCurTimeInMsec - theEntry->fAddedTime );
+            fBandwidthTracker->AddToRTTEstimate( theRTT );
         
 //          qtss_printf("Got ack for packet %d RTT = %qd\n", inSeqNum, inCurTimeInMsec - theEntry->fAddedTime);
         }
@@ -429,129 +460,106 @@ void RTPPacketResender::AckPacket( UInt16 inSeqNum, SInt64& inCurTimeInMsec )
             , (long)fTrackID, theEntry->fPacketSize, OS::Milliseconds() );
     #endif
         }
-        this->RemovePacket(foundIndex);
+        this->RemovePacket(theEntry);
     }
+    
+    return theRTT;
 }
 
-void RTPPacketResender::RemovePacket(UInt32 packetIndex, Bool16 reuseIndex)
+void RTPPacketResender::RemovePacket(RTPResenderEntry* inEntry, Bool16 inKeepWindowOpen)
 {
-    //OSMutexLocker packetQLocker(&fPacketQMutex);
-
-    Assert(packetIndex < fPacketArraySize);
-    if (packetIndex >= fPacketArraySize)
-        return;
-        
-    if (fPacketsInList == 0)
-        return;
-        
-    RTPResenderEntry* theEntry = &fPacketArray[packetIndex];
-    if (theEntry->fPacketSize == 0)
+    if (inEntry->fPacketSize == 0)
         return;
         
     //
     // Track the number of wasted bytes we have
-    atomic_sub(&sNumWastedBytes, kMaxDataBufferSize - theEntry->fPacketSize);
-    Assert(theEntry->fPacketSize > 0);
+    if (!inEntry->fIsSpecialBuffer)
+        AlterRetransmitWastedBytes(-(SInt32)(kMaxDataBufferSize - inEntry->fPacketSize));
+
+    if (inKeepWindowOpen) // the packet is being thrown away, not acked
+        fBandwidthTracker->EmptyWindow( inEntry->fPacketSize, false ); // keep window available
 
+    if (inEntry->fIsSpecialBuffer)
+    {   delete [] (char*)inEntry->fPacketData;
+    }
+    else if (inEntry->fPacketData != NULL)
+        sAllocator->Put(inEntry->fPacketData);
+        
     //
     // Update our list information
+    this->RemoveFromDueList(inEntry);
+    ::memset(inEntry,0,sizeof(RTPResenderEntry));
     Assert(fPacketsInList > 0);
-    
-    if (theEntry->fIsSpecialBuffer)
-    {   delete [] (char*)theEntry->fPacketData;
-    }
-    else if (theEntry->fPacketData != NULL)
-        sBufferPool.Put(theEntry->fPacketData);
-        
-
-    if (reuseIndex) // we are re-using the space so keep array contiguous
-    {
-        fPacketArray[packetIndex] = fPacketArray[fPacketsInList -1]; 
-        ::memset(&fPacketArray[fPacketsInList -1],0,sizeof(RTPResenderEntry));
-        fPacketsInList--;
-
-    }
-    else    // the array is full
-    {
-        fBandwidthTracker->EmptyWindow( theEntry->fPacketSize, false ); // keep window available
-        ::memset(theEntry,0,sizeof(RTPResenderEntry));
-    }
-    
+    fPacketsInList--;
 }
 
 void RTPPacketResender::ResendDueEntries()
 {
-    if (fPacketsInList <= 0)
-        return;
-        
-    //OSMutexLocker packetQLocker(&fPacketQMutex);
     //
+    // Everything on the due list shares the same retransmit timeout, so it is
+    // in due order; stop at the first entry that isn't due yet.
     SInt32 numResends = 0;
     RTPResenderEntry* theEntry = NULL; 
     SInt64 curTime = OS::Milliseconds();
-    for (SInt32 packetIndex = fPacketsInList -1; packetIndex >= 0; packetIndex--) // walk backwards because remove packet moves array members forward
+    while ((fOldestEntry != NULL) && ((curTime - fOldestEntry->fAddedTime) > fBandwidthTracker->CurRetransmitTimeout()))
     {
-        theEntry = &fPacketArray[packetIndex];
-        
-        if (theEntry->fPacketSize == 0) 
-            continue;
+        theEntry = fOldestEntry;
         
-        if ((curTime - theEntry->fAddedTime) > fBandwidthTracker->CurRetransmitTimeout())
+        // Change:  Only expire packets after they were due to be resent. This gives the client
+        // a chance to ack them and improves congestion avoidance and RTT calculation
+        if (curTime > theEntry->fExpireTime)
         {
-            // Change:  Only expire packets after they were due to be resent. This gives the client
-            // a chance to ack them and improves congestion avoidance and RTT calculation
-            if (curTime > theEntry->fExpireTime)
-            {
-    #if RTP_PACKET_RESENDER_DEBUGGING   
-                unsigned char version;
-                version = *((char*)theEntry->fPacketData);
-                version &= 0x84;    // grab most sig 2 bits
-                version = version >> 6; // shift by 6 bits
-                this->logprintf( "expired:  seq number %li, track id %li (port: %li), vers # %li, pack seq # %li, size: %li, OS::Msecs: %qd\n", \
-                                    (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2)) ), fTrackID,  (long) ntohs(fDestPort), \
-                                    (long)version, (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2))), theEntry->fPacketSize, OS::Milliseconds() );
-    #endif
-                //
-                // This packet is expired
-                fNumExpired++;
-                //qtss_printf("Packet expired: %d\n", ((UInt16*)thePacket)[1]);
-                fBandwidthTracker->EmptyWindow(theEntry->fPacketSize);
-                this->RemovePacket(packetIndex);
+#if RTP_PACKET_RESENDER_DEBUGGING   
+            unsigned char version;
+            version = *((char*)theEntry->fPacketData);
+            version &= 0x84;    // grab most sig 2 bits
+            version = version >> 6; // shift by 6 bits
+            this->logprintf( "expired:  seq number %li, track id %li (port: %li), vers # %li, pack seq # %li, size: %li, OS::Msecs: %qd\n", \
+                                (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2)) ), fTrackID,  (long) ntohs(fDestPort), \
+                                (long)version, (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2))), theEntry->fPacketSize, OS::Milliseconds() );
+#endif
+            //
+            // This packet is expired
+            fNumExpired++;
+            //qtss_printf("Packet expired: %d\n", ((UInt16*)thePacket)[1]);
+            fBandwidthTracker->EmptyWindow(theEntry->fPacketSize);
+            this->RemovePacket(theEntry);
 //              qtss_printf("Expired packet %d\n", theEntry->fSeqNum);
-                continue;
-            }
-            
-            // Resend this packet
-            fSocket->SendTo(fDestAddr, fDestPort, theEntry->fPacketData, theEntry->fPacketSize);
-            //qtss_printf("Packet resent: %d\n", ((UInt16*)theEntry->fPacketData)[1]);
-
-            theEntry->fNumResends++;
-    #if RTP_PACKET_RESENDER_DEBUGGING   
-            this->logprintf( "re-sent: %li RTO %li, track id %li (port %li), size: %li, OS::Ms %qd\n", (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2)) ),  curTime - theEntry->fAddedTime, \
-                    fTrackID, (long) ntohs(fDestPort) \
-                    , theEntry->fPacketSize, OS::Milliseconds());
-    #endif      
-
-            fNumResends++;
-            
-            numResends ++;
-            //qtss_printf("resend loop numResends=%ld packet theEntry->fNumResends=%ld stream fNumResends=\n",numResends,theEntry->fNumResends++, fNumResends);
-                        
-            // ok -- lets try this.. add 1.5x of the INITIAL duration since the last send to the rto estimator
-            // since we won't get an ack on this packet
-            // this should keep us from exponentially increasing due o a one time increase
-            // in the actuall rtt, only AddToEstimate on the first resend ( assume that it's a dupe )
-            // if it's not a dupe, but rather an actual loss, the subseqnuent actuals wil bring down the average quickly
-            
-            if ( theEntry->fNumResends == 1 )
-                fBandwidthTracker->AddToRTTEstimate( (SInt32) ((theEntry->fOrigRetransTimeout  * 3) / 2 ));
-            
-//          qtss_printf("Retransmitted packet %d\n", theEntry->fSeqNum);
-            theEntry->fAddedTime = curTime;
-            fBandwidthTracker->AdjustWindowForRetransmit();
             continue;
         }
         
+        // Resend this packet
+        fSocket->SendTo(fDestAddr, fDestPort, theEntry->fPacketData, theEntry->fPacketSize);
+        //qtss_printf("Packet resent: %d\n", ((UInt16*)theEntry->fPacketData)[1]);
+
+        theEntry->fNumResends++;
+#if RTP_PACKET_RESENDER_DEBUGGING   
+        this->logprintf( "re-sent: %li RTO %li, track id %li (port %li), size: %li, OS::Ms %qd\n", (long)ntohs( *((UInt16*)(((char*)theEntry->fPacketData)+2)) ),  curTime - theEntry->fAddedTime, \
+                fTrackID, (long) ntohs(fDestPort) \
+                , theEntry->fPacketSize, OS::Milliseconds());
+#endif      
+
+        fNumResends++;
+        
+        numResends ++;
+        //qtss_printf("resend loop numResends=%ld packet theEntry->fNumResends=%ld stream fNumResends=\n",numResends,theEntry->fNumResends++, fNumResends);
+                    
+        // ok -- lets try this.. add 1.5x of the INITIAL duration since the last send to the rto estimator
+        // since we won't get an ack on this packet
+        // this should keep us from exponentially increasing due o a one time increase
+        // in the actuall rtt, only AddToEstimate on the first resend ( assume that it's a dupe )
+        // if it's not a dupe, but rather an actual loss, the subseqnuent actuals wil bring down the average quickly
+        
+        if ( theEntry->fNumResends == 1 )
+            fBandwidthTracker->AddToRTTEstimate( (SInt32) ((theEntry->fOrigRetransTimeout  * 3) / 2 ));
+        
+//          qtss_printf("Retransmitted packet %d\n", theEntry->fSeqNum);
+        theEntry->fAddedTime = curTime;
+        fBandwidthTracker->AdjustWindowForRetransmit();
+        
+        //
+        // It is now the last one due
+        this->RemoveFromDueList(theEntry);
+        this->AddToDueList(theEntry);
     }
 }
-void RTPPacketResender::RemovePacket(RTPResenderEntry* inEntry){ Assert(0); }
@@ -31,6 +31,10 @@
     another timer for it's possible re-transmission.
     A duration timer is started to measure the RTT based on the client's ack.
     
+    Outstanding packets live in a ring indexed by sequence number, so an ack
+    finds its packet directly. They are also linked in the order they were last
+    sent, which is the order they come due for a resend.
+    
 */
 
 #ifndef __RTP_PACKET_RESENDER_H__
@@ -42,8 +46,7 @@
 #include "DssStopwatch.h"
 #include "UDPSocket.h"
 #include "OSMemory.h"
-#include "OSBufferPool.h"
-#include "OSMutex.h"
+#include "OSSlabAllocator.h"
 
 #define RTP_PACKET_RESENDER_DEBUGGING 0
 
@@ -61,6 +64,10 @@ class RTPResenderEntry
         SInt64              fOrigRetransTimeout;
         UInt32              fNumResends;
         UInt16              fSeqNum;
+        
+        // Outstanding entries, from the one sent longest ago to the latest
+        RTPResenderEntry*   fNextDue;
+        RTPResenderEntry*   fPrevDue;
 #if RTP_PACKET_RESENDER_DEBUGGING
         UInt32              fPacketArraySizeWhenAdded;
 #endif
@@ -71,6 +78,8 @@ class RTPPacketResender
 {
     public:
         
+        static void         Initialize();
+        
         RTPPacketResender();
         ~RTPPacketResender();
         
@@ -85,8 +94,9 @@ class RTPPacketResender
         void                AddPacket( void * rtpPacket, UInt32 packetSize, SInt32 ageLimitInMsec );
         
         //
-        // Acks a packet. Also not thread safe.
-        void                AckPacket( UInt16 sequenceNumber, SInt64& inCurTimeInMsec );
+        // Acks a packet. Also not thread safe. Returns the round trip time
+        // the ack measured, or -1 if it didn't give a usable one.
+        SInt32              AckPacket( UInt16 sequenceNumber, SInt64& inCurTimeInMsec );
 
         //
         // Resends outstanding packets in the queue. Guess what. Not thread safe.
@@ -104,8 +114,7 @@ class RTPPacketResender
         SInt32              GetNumPacketsInList()   { return fPacketsInList; }
         SInt32              GetNumResends()         { return fNumResends; }
         
-        static UInt32       GetNumRetransmitBuffers() { return sBufferPool.GetTotalNumBuffers(); }
-        static UInt32       GetWastedBufferBytes() { return sNumWastedBytes; }
+        static UInt32       GetNumRetransmitBuffers() { return (sAllocator != NULL) ? sAllocator->GetTotalNumObjects() : 0; }
 
 #if RTP_PACKET_RESENDER_DEBUGGING
         void                SetDebugInfo(UInt32 trackID, UInt16 remoteRTCPPort, UInt32 curPacketDelay);
@@ -144,26 +153,28 @@ class RTPPacketResender
         DssDurationTimer    fInfoDisplayTimer;
 #endif
         
+        // A power of 2 long, so a sequence number masked with fPacketArrayMask
+        // is its packet's index
         RTPResenderEntry*   fPacketArray;
-        UInt16              fStartSeqNum;
         UInt32              fPacketArraySize;
         UInt32              fPacketArrayMask;
-        UInt16              fHighestSeqNum;
-        UInt32              fLastUsed;
-        OSMutex             fPacketQMutex;
+        
+        RTPResenderEntry*   fOldestEntry;   // next to come due
+        RTPResenderEntry*   fNewestEntry;
 
-        RTPResenderEntry*   GetEntryByIndex(UInt16 inIndex);
         RTPResenderEntry*   GetEntryBySeqNum(UInt16 inSeqNum);
 
         RTPResenderEntry*   GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize);
         void ReallocatePacketArray();
-        void RemovePacket(UInt32 packetIndex, Bool16 reuse=true);
-        void RemovePacket(RTPResenderEntry* inEntry);
-
-        static OSBufferPool sBufferPool;
-        static unsigned int sNumWastedBytes;
+        void AddToDueList(RTPResenderEntry* inEntry);
+        void RemoveFromDueList(RTPResenderEntry* inEntry);
         
-        void            UpdateCongestionWindow(SInt32 bytesToOpenBy );
+        // If inKeepWindowOpen, the packet's bytes are taken out of the bandwidth
+        // tracker's window without counting them as acked
+        void RemovePacket(RTPResenderEntry* inEntry, Bool16 inKeepWindowOpen = false);
+
+        // Packet buffers. Each thread gets and puts them from its own cache.
+        static OSSlabAllocator* sAllocator;
 };
 
 #endif //__RTP_PACKET_RESENDER_H__
@@ -41,11 +41,19 @@
 
 #include "OS.h"
 #include "OSMemory.h"
+#include "UDPSocket.h"
 
 #include <errno.h>
 
 #define RTPSESSION_DEBUGGING 0
 
+OSSlabAllocator* RTPSession::sAllocator = NULL;
+
+void RTPSession::Initialize()
+{
+    sAllocator = NEW OSSlabAllocator("RTPSession", sizeof(RTPSession));
+}
+
 RTPSession::RTPSession() :
     RTPSessionInterface(),
     fModule(NULL),
@@ -73,6 +81,9 @@ RTPSession::~RTPSession()
     RTPStream** theStream = NULL;
     UInt32 theLen = 0;
     
+    // Normally already out of the admission queue, unless the kill path wasn't taken
+    QTSServerInterface::GetServer()->RemoveFromAdmissionQueue(this);
+    
     if (QTSServerInterface::GetServer()->GetPrefs()->GetReliableUDPPrintfsEnabled())
     {
         SInt32 theNumLatePacketsDropped = 0;
@@ -166,6 +177,10 @@ QTSS_Error  RTPSession::Activate(const StrPtrLen& inSessionID)
         return err;
     Assert(err == QTSS_NoErr);
     
+    //And into the admission queue, so it can be found quickly if the server
+    //needs to shed its newest sessions
+    theServer->AddToAdmissionQueue(this);
+    
     //
     // Adding this session into the qtssSvrClientSessions attr and incrementing the number of sessions must be atomic
     OSMutexLocker locker(theServer->GetMutex()); 
@@ -299,6 +314,7 @@ QTSS_Error  RTPSession::Play(RTSPRequestInterface* request, QTSS_PlayFlags inFla
 //  qtss_printf("bitrate = %d, window size = %d\n", bitRate, theWindowSize);
     this->GetBandwidthTracker()->SetWindowSize(theWindowSize);
 	this->GetOverbufferWindow()->ResetOverBufferWindow();
+    this->GetPacer()->ResetPacingBucket();
 
     //
     // Go through all the streams, setting their thinning params
@@ -507,6 +523,7 @@ SInt64 RTPSession::Run()
             this->Signal(Task::kKillEvent);// So that we get back to this place in the code
             return kCantGetMutexIdleTime;
         }
+        QTSServerInterface::GetServer()->RemoveFromAdmissionQueue(this);
         
             // The ClientSessionClosing role is allowed to do async stuff
             fModuleState.curTask = this;
@@ -550,9 +567,18 @@ SInt64 RTPSession::Run()
             }
         }
         
+        //Nothing may signal us once we return, so stop accepting RTCP.
+        this->CloseRTCPQueue();
         return -1;//doing this will cause the destructor to get called.
     }
     
+    //Process RTCP the RTCP sockets have queued for us. This is done even while
+    //paused, because receiver reports are what keep a paused session alive.
+    {
+        OSMutexLocker locker(&fSessionMutex);
+        this->ProcessQueuedRTCPPackets();
+    }
+    
     //if the stream is currently paused, just return without doing anything.
     //We'll get woken up again when a play is issued
     if ((fState == qtssPausedState) || (fModule == NULL))
@@ -562,6 +588,11 @@ SInt64 RTPSession::Run()
     //RTSP requests coming in while it's sending packets
     {
         OSMutexLocker locker(&fSessionMutex);
+        
+        //Collect this burst's UDP packets and send them together, and queue
+        //interleaved ones on the RTSP connection the same way
+        UDPSendBatcher theBatcher;
+        RTSPInterleavedWriteBatcher theInterleavedBatcher(fAllTracksInterleaved ? fRTSPSession : NULL);
 
         //just make sure we haven't been scheduled before our scheduled play
         //time. If so, reschedule ourselves for the proper time. (if client
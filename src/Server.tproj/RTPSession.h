@@ -55,6 +55,16 @@ class RTPSession : public RTPSessionInterface
 {
     public:
     
+        // Call this before using this object
+        static void Initialize();
+        
+        // Sessions are allocated out of a slab, see RTPStream.h
+        static void*    operator new(size_t inSize)                     { return OSSlabAllocator::New(sAllocator, inSize); }
+#if MEMORY_DEBUGGING
+        static void*    operator new(size_t inSize, char* /*inFile*/, int /*inLine*/) { return OSSlabAllocator::New(sAllocator, inSize); }
+#endif
+        static void     operator delete(void* inObject, size_t inSize) { OSSlabAllocator::Delete(sAllocator, inObject, inSize); }
+        
         RTPSession();
         virtual ~RTPSession();
         
@@ -113,6 +123,8 @@ class RTPSession : public RTPSessionInterface
 
     private:
     
+        static OSSlabAllocator* sAllocator;
+        
         //where timeouts, deletion conditions get processed
         virtual SInt64  Run();
         
@@ -86,7 +86,10 @@ QTSSAttrInfoDict::AttrInfo  RTPSessionInterface::sAttributes[] =
 	/* 33 */ { "qtssCliSesOverBufferEnabled",       NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite | qtssAttrModePreempSafe },
     /* 34 */ { "qtssCliSesRTCPPacketsRecv",         NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 35 */ { "qtssCliSesRTCPBytesRecv",           NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
-	/* 36 */ { "qtssCliSesStartedThinning",         NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite  | qtssAttrModePreempSafe }
+	/* 36 */ { "qtssCliSesStartedThinning",         NULL, 	qtssAttrDataTypeBool16,		qtssAttrModeRead | qtssAttrModeWrite  | qtssAttrModePreempSafe },
+    /* 37 */ { "qtssCliSesBottleneckBandwidth",     NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 38 */ { "qtssCliSesMinRTTInMsec",            NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 39 */ { "qtssCliSesSmoothedRTTInMsec",       NULL,   qtssAttrDataTypeUInt32,         qtssAttrModeRead | qtssAttrModePreempSafe }
     
 };
 
@@ -135,6 +138,7 @@ RTPSessionInterface::RTPSessionInterface()
     fTracker(QTSServerInterface::GetServer()->GetPrefs()->IsSlowStartEnabled()),
 	fOverbufferWindow(QTSServerInterface::GetServer()->GetPrefs()->GetSendIntervalInMsec(),kUInt32_Max, QTSServerInterface::GetServer()->GetPrefs()->GetMaxSendAheadTimeInSecs(),
 QTSServerInterface::GetServer()->GetPrefs()->GetOverbufferRate()),
+    fPacer(QTSServerInterface::GetServer()->GetPrefs()->GetSendIntervalInMsec()),
     fAuthScheme(QTSServerInterface::GetServer()->GetPrefs()->GetAuthScheme()),
     fAuthQop(RTSPSessionInterface::kNoQop),
     fAuthNonceCount(0),
@@ -152,6 +156,7 @@ QTSServerInterface::GetServer()->GetPrefs()->GetOverbufferRate()),
     
     //mark the session create time
     fSessionCreateTime = OS::Milliseconds();
+    fAdmissionQueueElem.SetSession(this);
 
     // Setup all dictionary attribute values
     
@@ -195,6 +200,9 @@ QTSServerInterface::GetServer()->GetPrefs()->GetOverbufferRate()),
 	
 	this->SetVal(qtssCliSesOverBufferEnabled, this->GetOverbufferWindow()->OverbufferingEnabledPtr(), sizeof(Bool16));
 	this->SetVal(qtssCliSesStartedThinning, &fStartedThinning, sizeof(Bool16));
+    this->SetVal(qtssCliSesBottleneckBandwidth, this->GetPacer()->BottleneckBandwidthPtr(), sizeof(UInt32));
+    this->SetVal(qtssCliSesMinRTTInMsec, this->GetPacer()->MinRTTPtr(), sizeof(UInt32));
+    this->SetVal(qtssCliSesSmoothedRTTInMsec, this->GetPacer()->SmoothedRTTPtr(), sizeof(UInt32));
 	
 }
 
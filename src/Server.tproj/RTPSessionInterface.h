@@ -44,9 +44,11 @@
 #include "Task.h"
 #include "RTPBandwidthTracker.h"
 #include "RTPOverbufferWindow.h"
+#include "RTPPacer.h"
 #include "QTSServerInterface.h"
 #include "OSMutex.h"
 #include "atomic.h"
+#include "RTCPTask.h"
 
 class RTSPRequestInterface;
 
@@ -70,6 +72,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
                 delete [] fSRBuffer.Ptr;
                 delete [] fAuthNonce.Ptr;       
                 delete [] fAuthOpaque.Ptr;      
+                this->CloseRTCPQueue();
             }
 
         virtual void SetValueComplete(UInt32 inAttrIndex, QTSSDictionaryMap* inMap,
@@ -89,6 +92,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         SInt64  GetPlayTime()           { return fPlayTime; }
         SInt64  GetNTPPlayTime()        { return fNTPPlayTime; }
         SInt64  GetSessionCreateTime()  { return fSessionCreateTime; }
+        RTPAdmissionQueueElem*  GetAdmissionQueueElem() { return &fAdmissionQueueElem; }
         //Time (msec) most recent play, adjusted for start time of the movie
         //ex: PlayTime() == 20,000. Client said start 10 sec into the movie,
         //so AdjustedPlayTime() == 10,000
@@ -105,6 +109,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         UInt32  GetUniqueID()           { return fUniqueID; }
         RTPBandwidthTracker* GetBandwidthTracker() { return &fTracker; }
         RTPOverbufferWindow* GetOverbufferWindow() { return &fOverbufferWindow; }
+        RTPPacer*   GetPacer()          { return &fPacer; }
         UInt32  GetFramesSkipped() { return fFramesSkipped; }
         
         //
@@ -190,8 +195,25 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         void            IncrTotalRTCPBytesRecv(UInt16 cnt) { fTotalRTCPBytesRecv += cnt; }
         UInt32          GetTotalRTCPBytesRecv()            { return fTotalRTCPBytesRecv; }
 
+        //
+        // INCOMING RTCP
+        
+        // Called by an RTCPSocket on the EventThread. Queues the packet and signals
+        // this session, which processes it the next time it runs. Returns false,
+        // and leaves the packet with the caller, if the session is going away or
+        // already has too many packets waiting.
+        Bool16          QueueIncomingRTCPPacket(RTCPPacketBuffer* inPacket) { return fRTCPQueue.EnQueue(inPacket, this); }
+
     protected:
     
+        // Hands each queued RTCP packet to its stream. Only the session's own Run
+        // calls this, with the session mutex held.
+        void            ProcessQueuedRTCPPackets()  { fRTCPQueue.ProcessAll(); }
+        
+        // Frees any queued RTCP packets and stops more from being queued. Called
+        // when the session is about to be deleted, after which it must not be signalled.
+        void            CloseRTCPQueue()            { fRTCPQueue.Close(); }
+    
         // These variables are setup by the derived RTPSession object when
         // Play and Pause get called
 
@@ -231,6 +253,9 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         RTSPSessionInterface* fRTSPSession;
     private:
     
+        // RTCP packets waiting for this session's Run
+        RTCPPacketQueue fRTCPQueue;
+    
         //
         // Utility function for calculating current bit rate
         void UpdateBitRateInternal(const SInt64& curTime);
@@ -286,6 +311,9 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         
         // Time when this session got created
         SInt64      fSessionCreateTime;
+        
+        // Links this session into the server's admission queue
+        RTPAdmissionQueueElem   fAdmissionQueueElem;
 
         //Packet priority levels. Each stream has a current level, and
         //the module that owns this session sets what the number of levels is.
@@ -314,6 +342,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         
         RTPBandwidthTracker fTracker;
         RTPOverbufferWindow fOverbufferWindow;
+        RTPPacer            fPacer;
         
         // Built in dictionary attributes
         static QTSSAttrInfoDict::AttrInfo   sAttributes[];
@@ -0,0 +1,145 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPStatsShards.cpp
+
+    Contains:   Implementation of the class
+    
+
+*/
+
+#include "RTPStatsShards.h"
+#include "OSMemory.h"
+#include <string.h>
+#include <stdint.h>
+
+RTPStatsShards::RTPStatsShards()
+:   fShardMemory(NULL),
+    fShards(NULL),
+    fNumShards(0),
+    fSharedRTPBytes(0),
+    fSharedRTPPackets(0),
+    fSharedRTPPacketsLost(0),
+    fSharedRetransmitWastedBytes(0)
+{
+    fShardMemory = NEW char[(kMaxShards * sizeof(Shard)) + kCacheLineSize];
+    ::memset(fShardMemory, 0, (kMaxShards * sizeof(Shard)) + kCacheLineSize);
+    UInt32 theAlignOffset = (UInt32)((kCacheLineSize - ((uintptr_t)fShardMemory & (kCacheLineSize - 1))) & (kCacheLineSize - 1));
+    fShards = (Shard*)(fShardMemory + theAlignOffset);
+#ifdef __Win32__
+    fShardKey = ::TlsAlloc();
+#else
+    (void)::pthread_key_create(&fShardKey, NULL);
+#endif
+}
+
+RTPStatsShards::~RTPStatsShards()
+{
+#ifdef __Win32__
+    (void)::TlsFree(fShardKey);
+#else
+    (void)::pthread_key_delete(fShardKey);
+#endif
+    delete [] fShardMemory;
+}
+
+RTPStatsShards::Shard* RTPStatsShards::GetShard()
+{
+    //0 means this thread hasn't asked yet
+#ifdef __Win32__
+    UInt32 theShardIndex = (UInt32)(uintptr_t)::TlsGetValue(fShardKey);
+#else
+    UInt32 theShardIndex = (UInt32)(uintptr_t)::pthread_getspecific(fShardKey);
+#endif
+    if (theShardIndex == 0)
+    {
+        theShardIndex = atomic_add(&fNumShards, 1);
+        if (theShardIndex > kMaxShards)
+            theShardIndex = kMaxShards + 1;
+#ifdef __Win32__
+        (void)::TlsSetValue(fShardKey, (void*)(uintptr_t)theShardIndex);
+#else
+        (void)::pthread_setspecific(fShardKey, (void*)(uintptr_t)theShardIndex);
+#endif
+    }
+    
+    if (theShardIndex > kMaxShards)
+        return NULL;
+    return &fShards[theShardIndex - 1];
+}
+
+UInt32 RTPStatsShards::GetNumShardsInUse()
+{
+    UInt32 theNumShards = fNumShards;
+    if (theNumShards > kMaxShards)
+        theNumShards = kMaxShards;
+    return theNumShards;
+}
+
+void RTPStatsShards::CollectRTPCounts(UInt32* outBytes, UInt32* outPackets, UInt32* outPacketsLost)
+{
+    // NOTE: The lines below are not thread safe on non-PowerPC platforms. This is
+    // because the shared counters are being manipulated from within an
+    // atomic_add. On PowerPC, assignments are atomic, so the assignment below is ok.
+    // On a non-PowerPC platform, the following would be thread safe:
+    //unsigned int theBytes = atomic_add(&fSharedRTPBytes, 0);
+    unsigned int theBytes = fSharedRTPBytes;
+    (void)atomic_sub(&fSharedRTPBytes, theBytes);
+    unsigned int thePackets = fSharedRTPPackets;
+    (void)atomic_sub(&fSharedRTPPackets, thePackets);
+    unsigned int thePacketsLost = fSharedRTPPacketsLost;
+    (void)atomic_sub(&fSharedRTPPacketsLost, thePacketsLost);
+    
+    // Add in what each thread has counted since last time
+    UInt32 theNumShards = this->GetNumShardsInUse();
+    for (UInt32 theIndex = 0; theIndex < theNumShards; theIndex++)
+    {
+        Shard* theShard = &fShards[theIndex];
+        unsigned int theCount = theShard->fRTPBytes;
+        theBytes += theCount - theShard->fLastRTPBytes;
+        theShard->fLastRTPBytes = theCount;
+        
+        theCount = theShard->fRTPPackets;
+        thePackets += theCount - theShard->fLastRTPPackets;
+        theShard->fLastRTPPackets = theCount;
+        
+        theCount = theShard->fRTPPacketsLost;
+        thePacketsLost += theCount - theShard->fLastRTPPacketsLost;
+        theShard->fLastRTPPacketsLost = theCount;
+    }
+    
+    *outBytes = theBytes;
+    *outPackets = thePackets;
+    *outPacketsLost = thePacketsLost;
+}
+
+UInt32 RTPStatsShards::GetRetransmitWastedBytes()
+{
+    unsigned int theWastedBytes = fSharedRetransmitWastedBytes;
+    UInt32 theNumShards = this->GetNumShardsInUse();
+    for (UInt32 theIndex = 0; theIndex < theNumShards; theIndex++)
+        theWastedBytes += fShards[theIndex].fRetransmitWastedBytes;
+    return theWastedBytes;
+}
@@ -0,0 +1,143 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       RTPStatsShards.h
+
+    Contains:   The server's RTP byte, packet and loss counters, which are bumped for
+                every packet from every task thread.
+                
+                Each thread counts into its own cache-line-sized shard, so the packet
+                path does a plain add without atomics or cache line bouncing. Shard
+                counts are never reset. CollectRTPCounts remembers what it saw last
+                time and returns the difference, which is right even after a count
+                wraps. Threads beyond the number of shards share atomic counters.
+
+*/
+
+#ifndef __RTP_STATS_SHARDS_H__
+#define __RTP_STATS_SHARDS_H__
+
+#include "OSHeaders.h"
+#include "atomic.h"
+
+#ifndef __Win32__
+#include <pthread.h>
+#endif
+
+class RTPStatsShards
+{
+    public:
+    
+        enum
+        {
+            kMaxShards          = 64,   //UInt32
+            kCacheLineSize      = 64    //UInt32
+        };
+    
+        RTPStatsShards();
+        ~RTPStatsShards();
+        
+        //
+        // COUNTING
+        
+        void    AddRTPBytes(UInt32 inBytes)
+            {   Shard* theShard = this->GetShard();
+                if (theShard != NULL) theShard->fRTPBytes += inBytes;
+                else (void)atomic_add(&fSharedRTPBytes, inBytes);
+            }
+        void    AddRTPPackets(UInt32 inPackets)
+            {   Shard* theShard = this->GetShard();
+                if (theShard != NULL) theShard->fRTPPackets += inPackets;
+                else (void)atomic_add(&fSharedRTPPackets, inPackets);
+            }
+        void    AddRTPPacketsLost(UInt32 inPackets)
+            {   Shard* theShard = this->GetShard();
+                if (theShard != NULL) theShard->fRTPPacketsLost += inPackets;
+                else (void)atomic_add(&fSharedRTPPacketsLost, inPackets);
+            }
+        //a current level rather than a total
+        void    AlterRetransmitWastedBytes(SInt32 inDifference)
+            {   Shard* theShard = this->GetShard();
+                if (theShard != NULL) theShard->fRetransmitWastedBytes += inDifference;
+                else (void)atomic_add(&fSharedRetransmitWastedBytes, inDifference);
+            }
+        
+        //
+        // READING
+        
+        //
+        // Returns what has been counted since the last call. Only one thread
+        // at a time may call this.
+        void    CollectRTPCounts(UInt32* outBytes, UInt32* outPackets, UInt32* outPacketsLost);
+        
+        //
+        // Each shard's level may be off on its own (one thread fills a buffer,
+        // another frees it), but they wrap back around to the right sum.
+        UInt32  GetRetransmitWastedBytes();
+        
+        UInt32  GetNumShardsInUse();
+        
+    private:
+    
+        //The counts are unsigned int, like the shared counters, so they all wrap
+        //at 32 bits together (UInt32 is 64 bits on LP64 platforms)
+        struct Shard
+        {
+            volatile unsigned int   fRTPBytes;
+            volatile unsigned int   fRTPPackets;
+            volatile unsigned int   fRTPPacketsLost;
+            volatile unsigned int   fRetransmitWastedBytes; //goes up and down, read directly
+            
+            //only touched by CollectRTPCounts
+            unsigned int            fLastRTPBytes;
+            unsigned int            fLastRTPPackets;
+            unsigned int            fLastRTPPacketsLost;
+            
+            char                    fPad[kCacheLineSize - (7 * sizeof(unsigned int))];
+        };
+        
+        //Returns the calling thread's shard, handing it the next free one the first
+        //time through, or NULL if they are all taken.
+        Shard*          GetShard();
+        
+        char*           fShardMemory;
+        Shard*          fShards;        //cache line aligned, within fShardMemory
+        unsigned int    fNumShards;     //handed out so far, may overshoot kMaxShards
+        
+        //the key holds each thread's shard index + 1
+#ifdef __Win32__
+        DWORD           fShardKey;
+#else
+        pthread_key_t   fShardKey;
+#endif
+
+        //for threads that didn't get a shard
+        unsigned int    fSharedRTPBytes;
+        unsigned int    fSharedRTPPackets;
+        unsigned int    fSharedRTPPacketsLost;
+        unsigned int    fSharedRetransmitWastedBytes;
+};
+
+#endif // __RTP_STATS_SHARDS_H__
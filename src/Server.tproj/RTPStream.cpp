@@ -46,6 +46,7 @@
 #include "RTCPAckPacket.h"
 #include "RTCPSRPacket.h"
 #include "SocketUtils.h"
+#include "OSArrayObjectDeleter.h"
 #include <errno.h>
 
 #if DEBUG
@@ -120,8 +121,13 @@ char *RTPStream::TCP = "TCP";
 
 QTSS_ModuleState RTPStream::sRTCPProcessModuleState = { NULL, 0, NULL, false };
 
+OSSlabAllocator* RTPStream::sAllocator = NULL;
+
 void    RTPStream::Initialize()
 {
+    sAllocator = NEW OSSlabAllocator("RTPStream", sizeof(RTPStream));
+    RTPPacketResender::Initialize();
+    
     for (int x = 0; x < qtssRTPStrNumParams; x++)
         QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTPStreamDictIndex)->
             SetAttribute(x, sAttributes[x].fAttrName, sAttributes[x].fFuncPtr,
@@ -137,6 +143,7 @@ RTPStream::RTPStream(UInt32 inSSRC, RTPSessionInterface* inSession)
     fDisplayCount(0),
     fSawFirstPacket(false),
     fTracker(NULL),
+    fGatherBuffer(NULL),
     fRemoteAddr(0),
     fRemoteRTPPort(0),
     fRemoteRTCPPort(0),
@@ -146,6 +153,11 @@ RTPStream::RTPStream(UInt32 inSSRC, RTPSessionInterface* inSession)
     fLastPacketCount(0),
     fPacketCountInRTCPInterval(0),
     fByteCount(0),
+    fSenderReportIndex(0),
+    fLastReceiverReportTime(0),
+    fLastReceiverReportSeqNum(0),
+    fLastReceiverReportLost(0),
+    fDeliveryRate(0),
     fTrackID(0),
     fSsrc(inSSRC),
     fSsrcStringPtr(fSsrcString, 0),
@@ -220,6 +232,12 @@ RTPStream::RTPStream(UInt32 inSSRC, RTPSessionInterface* inSession)
     qtss_sprintf(fSsrcString, "%lu", fSsrc);
     fSsrcStringPtr.Len = ::strlen(fSsrcString);
     Assert(fSsrcStringPtr.Len < kMaxSsrcSizeInBytes);
+    
+    for (UInt32 x = 0; x < kNumSenderReportTimes; x++)
+    {
+        fSenderReportNTPTimes[x] = 0;
+        fSenderReportSendTimes[x] = 0;
+    }
 
     // SETUP DICTIONARY ATTRIBUTES
     
@@ -280,6 +298,12 @@ RTPStream::~RTPStream()
         QTSServerInterface::GetServer()->GetSocketPool()->ReleaseUDPSocketPair(fSockets);
     }
     
+    delete [] fGatherBuffer;
+    
+    // The session's delivery rate is the sum over its streams, so take this one out
+    if (fDeliveryRate > 0)
+        fSession->GetPacer()->UpdateDeliveryRate(fDeliveryRate, 0, OS::Milliseconds());
+    
 #if RTP_PACKET_RESENDER_DEBUGGING
     //fResender.LogClose(fFlowControlDurationMsec);
     //qtss_printf("Flow control duration msec: %I64d. Max outstanding packets: %d\n", fFlowControlDurationMsec, fResender.GetMaxPacketsInList());
@@ -666,6 +690,15 @@ void    RTPStream::AppendRTPInfo(QTSS_RTSPHeader inHeader, RTSPRequestInterface*
 
 //ReliableRTPWrite must be called from a fSession mutex protected caller
 QTSS_Error  RTPStream::InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
+{
+    struct iovec theVec;
+    theVec.iov_base = (char*)inBuffer;
+    theVec.iov_len = inLen;
+    
+    return this->InterleavedWriteV(&theVec, (inLen > 0) ? 1 : 0, inLen, outLenWritten, channel);
+}
+
+QTSS_Error  RTPStream::InterleavedWriteV(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
 {
     
     if (fSession->GetRTSPSession() == NULL) // RTSPSession required for interleaved write
@@ -675,7 +708,7 @@ QTSS_Error  RTPStream::InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* ou
 
     //char blahblah[2048];
     
-    QTSS_Error err = fSession->GetRTSPSession()->InterleavedWrite( inBuffer, inLen, outLenWritten, channel);
+    QTSS_Error err = fSession->GetRTSPSession()->InterleavedWriteV( inVec, inNumVectors, inLen, outLenWritten, channel);
     //QTSS_Error err = fSession->GetRTSPSession()->InterleavedWrite( blahblah, 2044, outLenWritten, channel);
 #if DEBUG
     //if (outLenWritten != NULL)
@@ -781,7 +814,7 @@ QTSS_Error RTPStream::ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt6
         fBytesSentThisInterval += inLen;
         fResender.AddPacket( inBuffer, inLen, (SInt32) (fDropAllPacketsForThisStreamDelay - curPacketDelay) );
 
-        (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, inBuffer, inLen);
+        fSockets->GetSocketA()->SendToBatched(fRemoteAddr, fRemoteRTPPort, inBuffer, inLen);
     }
 
 
@@ -916,6 +949,35 @@ Bool16 RTPStream::UpdateQualityLevel(const SInt64& inTransmitTime, const SInt64&
     return true; // We should send this packet
 }
 
+Bool16 RTPStream::PacketVectorMatchesLength(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen)
+{
+    UInt32 theTotalLen = 0;
+    for (UInt32 x = 0; x < inNumVectors; x++)
+    {
+        if (inVec[x].iov_len > inLen - theTotalLen)
+            return false;
+        theTotalLen += inVec[x].iov_len;
+    }
+    return (theTotalLen == inLen);
+}
+
+char* RTPStream::GatherPacket(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen)
+{
+    if ( (inLen > kGatherBufferSize) || !PacketVectorMatchesLength(inVec, inNumVectors, inLen) )
+        return NULL;
+        
+    if (fGatherBuffer == NULL)
+        fGatherBuffer = NEW char[kGatherBufferSize];
+        
+    UInt32 theOffset = 0;
+    for (UInt32 x = 0; x < inNumVectors; x++)
+    {
+        ::memcpy(fGatherBuffer + theOffset, inVec[x].iov_base, inVec[x].iov_len);
+        theOffset += inVec[x].iov_len;
+    }
+    return fGatherBuffer;
+}
+
 QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, UInt32 inFlags)
 {
     Assert(fSession != NULL);
@@ -970,7 +1032,7 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
         }
         else if ( inLen > 0 )
         {
-            (void)fSockets->GetSocketB()->SendTo(fRemoteAddr, fRemoteRTCPPort, thePacket->packetData, inLen);
+            fSockets->GetSocketB()->SendToBatched(fRemoteAddr, fRemoteRTCPPort, thePacket->packetData, inLen);
         }
         
         if (err == QTSS_NoErr)
@@ -992,18 +1054,82 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
             fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
             return QTSS_WouldBlock;
         }
+        
+        //
+        // Even if the overbuffer window has room, spread the packets sent ahead
+        // of time out at the pacing rate rather than in one burst. Packets that
+        // are due go out now; the pacing rate comes from what the client got
+        // before, and a reflected stream has no movie bitrate to floor it with,
+        // so pacing them could hold the stream below its own rate for good.
+        // TCP does its own pacing.
+        if ((fTransportType != qtssRTPTransportTypeTCP) && QTSServerInterface::GetServer()->GetPrefs()->IsRTPPacingEnabled() &&
+            !fSession->GetOverbufferWindow()->IsPacketDue(thePacket->packetTransmitTime, theTime))
+        {
+            thePacket->suggestedWakeupTime = fSession->GetPacer()->CheckTransmitTime(theTime, inLen, fSession->GetMovieAvgBitrate());
+            if (thePacket->suggestedWakeupTime > theTime)
+            {
+                fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
+                return QTSS_WouldBlock;
+            }
+        }
 
         //
         // Check to make sure our quality level is correct. This function
         // also tells us whether this packet is just too old to send
         if (this->UpdateQualityLevel(thePacket->packetTransmitTime, theCurrentPacketDelay, theTime, inLen))
         {
-            if ( fTransportType == qtssRTPTransportTypeTCP )    // write out in interleave format on the RTSP TCP channel
-                err = this->InterleavedWrite( thePacket->packetData, inLen, outLenWritten, fRTPChannel );       
+            //
+            // A packet in pieces goes out with sendmsg or writev, straight from
+            // wherever the pieces are. The resender keeps its own copy of each
+            // packet anyway, so reliable UDP gets the packet put back together
+            // in the stream's gather buffer. A packet whose pieces don't add up
+            // to inLen isn't sent at all.
+            iovec* thePacketVector = NULL;
+            UInt32 theNumVectors = 0;
+            if ( (inFlags & qtssWriteFlagsPacketVector) && (thePacket->packetVectorLen > 0) )
+            {
+                thePacketVector = thePacket->packetVector;
+                theNumVectors = thePacket->packetVectorLen;
+                Assert(thePacketVector[0].iov_base == thePacket->packetData);
+            }
+            
+            void* thePacketData = thePacket->packetData;
+            if ( (thePacketVector != NULL) && ( (fTransportType == qtssRTPTransportTypeReliableUDP) ||
+                ( (fTransportType == qtssRTPTransportTypeTCP) && (theNumVectors > RTSPSessionInterface::kMaxInterleavedWriteVectors) ) ) )
+            {
+                thePacketData = this->GatherPacket(thePacketVector, theNumVectors, inLen);
+                thePacketVector = NULL;
+            }
+            else if ( (thePacketVector != NULL) && !PacketVectorMatchesLength(thePacketVector, theNumVectors, inLen) )
+                thePacketData = NULL;
+            
+            if ( thePacketData == NULL )
+            {
+                // The pieces don't add up to the packet
+                fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
+                return QTSS_BadArgument;
+            }
+            
+            if ( (fTransportType == qtssRTPTransportTypeTCP) && (thePacketVector != NULL) )
+                err = this->InterleavedWriteV( thePacketVector, theNumVectors, inLen, outLenWritten, fRTPChannel );
+            else if ( fTransportType == qtssRTPTransportTypeTCP )    // write out in interleave format on the RTSP TCP channel
+                err = this->InterleavedWrite( thePacketData, inLen, outLenWritten, fRTPChannel );       
             else if ( fTransportType == qtssRTPTransportTypeReliableUDP )
-                err = this->ReliableRTPWrite( thePacket->packetData, inLen, theCurrentPacketDelay );
+                err = this->ReliableRTPWrite( thePacketData, inLen, theCurrentPacketDelay );
+            else if ( (inLen > 0) && (thePacketVector != NULL) )
+                fSockets->GetSocketA()->SendToBatchedV(fRemoteAddr, fRemoteRTPPort, thePacketVector, theNumVectors, thePacket->packetData, inLen);
+            else if ( (inLen > 0) && (inFlags & qtssWriteFlagsSharedPacketData) )
+            {
+                //Not a refcounted buffer: the batch only points at packetData, and
+                //sendmmsg reads it when the batch on this thread is flushed. That is
+                //safe only while the caller keeps packetData alive and unchanged
+                //until then. The reflector does, because its packets are only
+                //freed and refilled under the demuxer mutex that the whole
+                //reflect pass, flush included, runs under.
+                fSockets->GetSocketA()->SendToBatched(fRemoteAddr, fRemoteRTPPort, NULL, 0, thePacket->packetData, inLen);
+            }
             else if ( inLen > 0 )
-                (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
+                fSockets->GetSocketA()->SendToBatched(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
             
             if (err == QTSS_NoErr)
                 PrintPacketPrefEnabled( (char*) thePacket->packetData, inLen, (SInt32) RTPStream::rtp);
@@ -1062,6 +1188,8 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
             // update if the socket is flow controlled or some such thing)
             
             fSession->GetOverbufferWindow()->AddPacketToWindow(inLen);
+            if (fTransportType != qtssRTPTransportTypeTCP)
+                fSession->GetPacer()->AddPacketSent(inLen);
             fSession->UpdatePacketsSent(1);
             fSession->UpdateBytesSent(inLen);
             QTSServerInterface::GetServer()->IncrementTotalRTPBytes(inLen);
@@ -1123,8 +1251,8 @@ void RTPStream::SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye)
     RTCPSRPacket* theSR = fSession->GetSRPacket();
     theSR->SetSSRC(fSsrc);
     theSR->SetClientSSRC(fClientSSRC);
-    theSR->SetNTPTimestamp(fSession->GetNTPPlayTime() +
-                            OS::TimeMilli_To_Fixed64Secs(inTime - fSession->GetPlayTime()));
+    SInt64 theNTPTime = fSession->GetNTPPlayTime() + OS::TimeMilli_To_Fixed64Secs(inTime - fSession->GetPlayTime());
+    theSR->SetNTPTimestamp(theNTPTime);
     theSR->SetRTPTimestamp(fLastRTPTimestamp);
     theSR->SetPacketCount(fPacketCount);
     theSR->SetByteCount(payloadByteCount);
@@ -1149,7 +1277,17 @@ void RTPStream::SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye)
     }
     
     if (err == QTSS_NoErr)
+    {
         PrintPacketPrefEnabled((char *) theSR->GetSRPacket(), thePacketLen, (SInt32) RTPStream::rtcpSR); // if we are flow controlled this packet is not sent
+        
+        //
+        // The NTP time is the packet's transmit time, not when the SR actually went
+        // out, so remember the latter to measure round trips from the LSR in the
+        // receiver reports.
+        fSenderReportNTPTimes[fSenderReportIndex] = (UInt32)(theNTPTime >> 16);
+        fSenderReportSendTimes[fSenderReportIndex] = OS::Milliseconds();
+        fSenderReportIndex = (fSenderReportIndex + 1) % kNumSenderReportTimes;
+    }
 }
 
 
@@ -1173,8 +1311,8 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
 
     // Modules are guarenteed atomic access to the session. Also, the RTSP Session accessed
     // below could go away at any time. So we need to lock the RTP session mutex.
-    // *BUT*, when this function is called the caller already has the UDP socket pool &
-    // UDP Demuxer mutexes. Blocking on grabbing this mutex could cause a deadlock.
+    // UDP RTCP gets here from the session's own Run, which already holds it. Interleaved
+    // RTCP comes from the RTSP session's thread, and blocking there could deadlock.
     // So, dump this RTCP packet if we can't get the mutex.
     if (!fSession->GetSessionMutex()->TryLock())
         return;
@@ -1246,6 +1384,8 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
                     fPacketCountInRTCPInterval = fPacketCount - fLastPacketCount;
                     fLastPacketCount = fPacketCount;
                 }
+                
+                this->UpdatePacer(&receiverPacket, curTime);
 
 #ifdef DEBUG_RTCP_PACKETS
                 receiverPacket.Dump();
@@ -1274,7 +1414,7 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
                     if (fTransportType == qtssRTPTransportTypeReliableUDP)
                     {
                         UInt16 theSeqNum = theAckPacket.GetAckSeqNum();
-                        fResender.AckPacket(theSeqNum, curTime);
+                        fSession->GetPacer()->AddRTTSample(fResender.AckPacket(theSeqNum, curTime), curTime);
                         //qtss_printf("Got ack: %d\n",theSeqNum);
                         
                         for (UInt16 maskCount = 0; maskCount < theAckPacket.GetAckMaskSizeInBits(); maskCount++)
@@ -1379,6 +1519,70 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
     fSession->GetSessionMutex()->Unlock();
 }
 
+void RTPStream::UpdatePacer(RTCPReceiverPacket* inReceiverPacket, const SInt64& inCurrentTime)
+{
+    if ((fTransportType == qtssRTPTransportTypeTCP) || (inReceiverPacket->GetReportCount() == 0))
+        return;
+        
+    //
+    // Use the report block about this stream, or the first one if none of them
+    // has our SSRC (the cumulative loss figures above make the same assumption)
+    int theReportNum = 0;
+    for (int x = 0; x < inReceiverPacket->GetReportCount(); x++)
+    {
+        if (inReceiverPacket->GetReportSourceID(x) == fSsrc)
+        {
+            theReportNum = x;
+            break;
+        }
+    }
+    
+    //
+    // Round trip time: now, less when the SR this report echoes went out, less
+    // how long the client held onto it (in 1/65536 secs)
+    UInt32 theLastSRTime = inReceiverPacket->GetLastSenderReportTime(theReportNum);
+    for (UInt32 x = 0; (theLastSRTime != 0) && (x < kNumSenderReportTimes); x++)
+    {
+        if ((fSenderReportNTPTimes[x] == theLastSRTime) && (fSenderReportSendTimes[x] != 0))
+        {
+            SInt64 theHoldTime = ((SInt64)inReceiverPacket->GetLastSenderReportDelay(theReportNum) * 1000) >> 16;
+            SInt64 theRTT = inCurrentTime - fSenderReportSendTimes[x] - theHoldTime;
+            if (theRTT >= 0)
+                fSession->GetPacer()->AddRTTSample((SInt32)theRTT, inCurrentTime);
+            break;
+        }
+    }
+    
+    //
+    // Delivery rate: how many more packets the client has gotten since its last
+    // report, over the time between the reports
+    UInt32 theSeqNum = inReceiverPacket->GetHighestSeqNumReceived(theReportNum);
+    UInt32 theLost = inReceiverPacket->GetTotalLostPackets(theReportNum);
+    SInt32 theNumExpected = (SInt32)(theSeqNum - fLastReceiverReportSeqNum);
+    
+    if (fLastReceiverReportTime != 0)
+    {
+        if (theNumExpected < 0)
+            return; // an old report arriving out of order
+            
+        SInt32 theNumReceived = theNumExpected - (SInt32)(theLost - fLastReceiverReportLost);
+        if ((theNumExpected > 0) && (theNumReceived > 0) && ((UInt32)theNumExpected <= fPacketCount) &&
+            (inCurrentTime > fLastReceiverReportTime))
+        {
+            SInt64 theBitRate = ((SInt64)theNumReceived * (fByteCount / fPacketCount) * 8 * 1000) / (inCurrentTime - fLastReceiverReportTime);
+            if (theBitRate > (SInt64)0xFFFFFFFF)
+                theBitRate = 0xFFFFFFFF;
+                
+            fSession->GetPacer()->UpdateDeliveryRate(fDeliveryRate, (UInt32)theBitRate, inCurrentTime);
+            fDeliveryRate = (UInt32)theBitRate;
+        }
+    }
+    
+    fLastReceiverReportTime = inCurrentTime;
+    fLastReceiverReportSeqNum = theSeqNum;
+    fLastReceiverReportLost = theLost;
+}
+
 char* RTPStream::GetStreamTypeStr()
 {
     char *streamType = NULL;
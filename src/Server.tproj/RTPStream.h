@@ -53,12 +53,24 @@
 #include "RTPPacketResender.h"
 #include "QTSServerInterface.h"
 
-class RTPStream : public QTSSDictionary, public UDPDemuxerTask
+class RTCPReceiverPacket;
+
+class RTPStream : public QTSSDictionary, public RTCPPacketReceiver
 {
     public:
         
         // Initializes dictionary resources
         static void Initialize();
+        
+        //
+        // Streams are created and destroyed with every client session, so
+        // they come out of a per-thread cached slab allocator rather than
+        // the general heap. sAllocator is created by Initialize.
+        static void*    operator new(size_t inSize)                     { return OSSlabAllocator::New(sAllocator, inSize); }
+#if MEMORY_DEBUGGING
+        static void*    operator new(size_t inSize, char* /*inFile*/, int /*inLine*/) { return OSSlabAllocator::New(sAllocator, inSize); }
+#endif
+        static void     operator delete(void* inObject, size_t inSize) { OSSlabAllocator::Delete(sAllocator, inObject, inSize); }
 
         //
         // CONSTRUCTOR / DESTRUCTOR
@@ -110,7 +122,12 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
 
         //When we get a new RTCP packet, we can directly invoke the RTP session and tell it
         //to process the packet right now!
-        void ProcessIncomingRTCPPacket(StrPtrLen* inPacket);
+        virtual void ProcessIncomingRTCPPacket(StrPtrLen* inPacket);
+        
+        //RTCP read from this stream's UDP socket is queued on the session instead,
+        //and the session calls ProcessIncomingRTCPPacket from its own Run.
+        virtual Bool16 QueueIncomingRTCPPacket(RTCPPacketBuffer* inPacket)
+            { return fSession->QueueIncomingRTCPPacket(inPacket); }
 
         // Send a RTCP SR on this stream. Pass in true if this SR should also have a BYE
         void SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye = false);
@@ -135,6 +152,8 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
 		void DisableSSRC() { fEnableSSRC = false; }
 		
     private:
+    
+        static OSSlabAllocator* sAllocator;
         
         enum
         {
@@ -143,6 +162,8 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
             kDefaultPayloadBufSize      = 32,
             kSenderReportIntervalInSecs = 7,
             kNumPrebuiltChNums          = 10,
+            kNumSenderReportTimes       = 4,
+            kGatherBufferSize           = 2048
         };
     
         SInt64 fLastQualityChange;
@@ -162,6 +183,10 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         // manages UDP retransmits
         RTPPacketResender       fResender;
         RTPBandwidthTracker*    fTracker;
+        
+        // Where a packet in pieces is put back together when it can't go out
+        // in pieces. Allocated the first time it's needed.
+        char*                   fGatherBuffer;
 
         
         //who am i sending to?
@@ -177,6 +202,18 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         UInt32      fPacketCountInRTCPInterval;
         UInt32      fByteCount;
         
+        // For measuring the round trip time and delivery rate for the pacer.
+        // The middle 32 bits of the NTP time in each recent SR, and when
+        // it actually went out, so the LSR a receiver report echoes can be
+        // matched up with a send time.
+        UInt32      fSenderReportNTPTimes[kNumSenderReportTimes];
+        SInt64      fSenderReportSendTimes[kNumSenderReportTimes];
+        UInt32      fSenderReportIndex;
+        SInt64      fLastReceiverReportTime;
+        UInt32      fLastReceiverReportSeqNum;
+        UInt32      fLastReceiverReportLost;
+        UInt32      fDeliveryRate;
+        
         // DICTIONARY ATTRIBUTES
         
         //Module assigns a streamID to this object
@@ -285,11 +322,19 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         SInt64  fStreamStartTimeOSms;
         // acutally write the data out that way
         QTSS_Error  InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel );
+        QTSS_Error  InterleavedWriteV(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, UInt32* outLenWritten, unsigned char channel );
 
         // implements the ReliableRTP protocol
         QTSS_Error  ReliableRTPWrite(void* inBuffer, UInt32 inLen, const SInt64& curPacketDelay);
 
+        // copies a packet's pieces into fGatherBuffer. NULL if they don't add up to inLen or don't fit
+        char*       GatherPacket(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen);
+static  Bool16      PacketVectorMatchesLength(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen);
+
         void        SetTCPThinningParams();
+        
+        // feeds the session's pacer from a receiver report block for this stream
+        void        UpdatePacer(RTCPReceiverPacket* inReceiverPacket, const SInt64& inCurrentTime);
         QTSS_Error  TCPWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, UInt32 inFlags);
 
         static QTSSAttrInfoDict::AttrInfo   sAttributes[];
@@ -39,7 +39,7 @@
 #include <errno.h>
 
 QTSS_Error RTSPResponseStream::WriteV(iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength,
-                                            UInt32* outLengthSent, UInt32 inSendType)
+                                            UInt32* outLengthSent, UInt32 inSendType, Bool16 inZeroCopy)
 {
     QTSS_Error theErr = QTSS_NoErr;
     UInt32 theLengthSent = 0;
@@ -87,6 +87,10 @@ QTSS_Error RTSPResponseStream::WriteV(iovec* inVec, UInt32 inNumVectors, UInt32
         }
         // theLengthSent now represents how much data in the ioVec was sent
     }
+    else if ((inNumVectors > 1) && inZeroCopy)
+    {
+        theErr = fSocket->WriteVZeroCopy(&inVec[1], inNumVectors - 1, &theLengthSent);
+    }
     else if (inNumVectors > 1)
     {
         theErr = fSocket->WriteV(&inVec[1], inNumVectors - 1, &theLengthSent);
@@ -70,6 +70,10 @@ class RTSPResponseStream : public ResizeableStringFormatter
         //
         // If some data ends up being buffered, outLengthSent will = inTotalLength,
         // and the return value will be QTSS_NoErr 
+        //
+        // If inZeroCopy is true and nothing is already buffered here, the ioVec
+        // is sent with the socket's WriteVZeroCopy, and the caller has to keep the
+        // data unchanged until the socket says that send is complete.
         
         enum
         {
@@ -78,7 +82,7 @@ class RTSPResponseStream : public ResizeableStringFormatter
             kAlwaysBuffer   = 2
         };
         QTSS_Error WriteV(iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength,
-                                UInt32* outLengthSent, UInt32 inSendType);
+                                UInt32* outLengthSent, UInt32 inSendType, Bool16 inZeroCopy = false);
 
         // Flushes any buffered data to the socket. If all data could be sent,
         // this returns QTSS_NoErr, otherwise, it returns EWOULDBLOCK
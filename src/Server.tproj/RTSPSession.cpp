@@ -118,6 +118,7 @@ static StrPtrLen    sEmptyStr("");
 
 // static class member  initialized in RTSPSession ctor
 OSRefTable* RTSPSession::sHTTPProxyTunnelMap = NULL;
+OSSlabAllocator* RTSPSession::sAllocator = NULL;
 
 char        RTSPSession::sHTTPResponseHeaderBuf[kMaxHTTPResponseLen];
 StrPtrLen   RTSPSession::sHTTPResponseHeaderPtr(sHTTPResponseHeaderBuf, kMaxHTTPResponseLen);
@@ -133,6 +134,7 @@ char*       RTSPSession::sHTTPNoServerResponseFormatStr =  "HTTP/1.0 200 OK\r\n%
 void RTSPSession::Initialize()
 {
     sHTTPProxyTunnelMap = new OSRefTable(OSRefTable::kDefaultTableSize);
+    sAllocator = NEW OSSlabAllocator("RTSPSession", sizeof(RTSPSession));
 
     // Construct premade HTTP response for HTTP proxy tunnel
     qtss_sprintf(sHTTPResponseHeaderBuf, sHTTPResponseFormatStr, "","","", QTSServerInterface::GetServerHeader().Ptr);
@@ -232,6 +234,14 @@ SInt64 RTSPSession::Run()
     if ((events & Task::kTimeoutEvent) || (events & Task::kKillEvent))
         fLiveSession = false;
     
+    //An interleaved send burst ended while the session mutex was busy. Unless
+    //a request is holding it, which sends the queue when it's done, send it now.
+    if ((events & Task::kWriteEvent) && (fRequest == NULL) && this->IsLiveSession())
+    {
+        OSMutexLocker locker(&fSessionMutex);
+        this->FlushInterleavedWrites();
+    }
+    
     while (this->IsLiveSession())
     {
         // RTSP Session state machine. There are several well defined points in an RTSP request
@@ -1353,7 +1363,7 @@ OSRef* RTSPSession::RegisterRTSPSessionIntoHTTPProxyTunnelMap(QTSS_RTSPSessionTy
     // 2) returns another session's fProxyRef if it has the same magic number and is the right sessionType
     // 3) returns NULL if there is a session with the same magic # but it couldn't be resolved.
     
-    OSMutexLocker locker(sHTTPProxyTunnelMap->GetMutex());
+    OSMutexLocker locker(sHTTPProxyTunnelMap->GetMutex(fProxyRef.GetString()));
     OSRef* theRef = sHTTPProxyTunnelMap->RegisterOrResolve(&fProxyRef);
     if (theRef == NULL)
         return &fProxyRef;
@@ -1688,6 +1698,9 @@ void RTSPSession::CleanupRequest()
         fRoleParams.rtspRequestParams.inRTSPHeaders = NULL;
     }
     
+    // Send what any interleaved send burst queued while we held the mutex
+    this->FlushInterleavedWrites();
+    
     fSessionMutex.Unlock();
     fReadMutex.Unlock();
     
@@ -1838,14 +1851,14 @@ UInt32 RTSPSession::GenerateNewSessionID(char* ioBuffer)
     QTSServerInterface* theServer = QTSServerInterface::GetServer();
     
     {
-        OSMutexLocker locker(theServer->GetRTPSessionMap()->GetMutex());
-        OSRefHashTable* theHashTable = theServer->GetRTPSessionMap()->GetHashTable();
-        if (theHashTable->GetNumEntries() > 0)
+        OSRefTable* theMap = theServer->GetRTPSessionMap();
+        OSRefTableLocker locker(theMap);
+        if (theMap->GetNumRefsInTable() > 0)
         {
-            theFirstRandom %= theHashTable->GetNumEntries();
+            theFirstRandom %= theMap->GetNumRefsInTable();
             theFirstRandom >>= 2;
             
-            OSRefHashTableIter theIter(theHashTable);
+            OSRefTableIter theIter(theMap);
             //Iterate through the session map, finding a random session
             for (UInt32 theCount = 0; theCount < theFirstRandom; theIter.Next(), theCount++)
                 Assert(!theIter.IsDone());
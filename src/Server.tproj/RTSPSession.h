@@ -51,12 +51,21 @@ class RTSPSession : public RTSPSessionInterface
         
         // Call this before using this object
         static void Initialize();
+        
+        // One of these is created for every connection, so they come out of a slab
+        static void*    operator new(size_t inSize)                     { return OSSlabAllocator::New(sAllocator, inSize); }
+#if MEMORY_DEBUGGING
+        static void*    operator new(size_t inSize, char* /*inFile*/, int /*inLine*/) { return OSSlabAllocator::New(sAllocator, inSize); }
+#endif
+        static void     operator delete(void* inObject, size_t inSize) { OSSlabAllocator::Delete(sAllocator, inObject, inSize); }
 
         Bool16 IsPlaying() {if (fRTPSession == NULL) return false; if (fRTPSession->GetSessionState() == qtssPlayingState) return true; return false; }
         
         
     private:
 
+        static OSSlabAllocator* sAllocator;
+        
         SInt64 Run();
         
         // Gets & creates RTP session for this request.
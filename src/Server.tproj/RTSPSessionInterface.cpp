@@ -39,6 +39,7 @@
 #include "RTSPProtocol.h"
 
 #include <errno.h>
+#include <sys/socket.h>
 
 
 #if DEBUG
@@ -49,6 +50,8 @@
 
 
 
+TCPCoalesceBufferReaper* TCPCoalesceBufferReaper::sReaper = NULL;
+
 unsigned int            RTSPSessionInterface::sSessionIDCounter = kFirstRTSPSessionID;
 Bool16                  RTSPSessionInterface::sDoBase64Decoding = true;
 UInt32					RTSPSessionInterface::sOptionsRequestBody[kMaxRandomDataSize / sizeof(UInt32)];
@@ -70,7 +73,10 @@ QTSSAttrInfoDict::AttrInfo  RTSPSessionInterface::sAttributes[] =
     /* 11 */{ "qtssRTSPSesLastURLRealm",    NULL,           qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe  },
     
     /* 12 */{ "qtssRTSPSesLocalPort",       SetupParams,    qtssAttrDataTypeUInt16,     qtssAttrModeRead | qtssAttrModePreempSafe | qtssAttrModeCacheable },
-    /* 13 */{ "qtssRTSPSesRemotePort",      SetupParams,    qtssAttrDataTypeUInt16,     qtssAttrModeRead | qtssAttrModePreempSafe | qtssAttrModeCacheable }
+    /* 13 */{ "qtssRTSPSesRemotePort",      SetupParams,    qtssAttrDataTypeUInt16,     qtssAttrModeRead | qtssAttrModePreempSafe | qtssAttrModeCacheable },
+    
+    /* 14 */{ "qtssRTSPSesNumInterleavedPackets", NULL,     qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 15 */{ "qtssRTSPSesNumInterleavedWrites",  NULL,     qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModePreempSafe }
 };
 
 
@@ -86,6 +92,7 @@ void    RTSPSessionInterface::Initialize()
 		RTSPSessionInterface::sOptionsRequestBody[i] = ::rand();
 	((char *)RTSPSessionInterface::sOptionsRequestBody)[0] = 0; //always set first byte so it doesn't hit any client parser bugs for \r or \n.
 	
+    TCPCoalesceBufferReaper::Initialize();
 }
 
 
@@ -98,6 +105,11 @@ RTSPSessionInterface::RTSPSessionInterface()
     fSessionMutex(),
     fTCPCoalesceBuffer(NULL),
     fNumInCoalesceBuffer(0),
+    fCurTCPCoalesceBuffer(0),
+    fInterleavedWriteBurstThread(NULL),
+    fInterleavedWriteBurstOpen(0),
+    fNumInterleavedPackets(0),
+    fNumInterleavedWrites(0),
     fSocket(NULL, Socket::kNonBlockingSocketType),
     fOutputSocketP(&fSocket),
     fInputSocketP(&fSocket),
@@ -117,11 +129,19 @@ RTSPSessionInterface::RTSPSessionInterface()
     fSocket.SetTask(this);
     fStreamRef = this;
 
+    for (UInt32 x = 0; x < kNumTCPCoalesceBuffers; x++)
+    {
+        fTCPCoalesceBuffers[x] = NULL;
+        fTCPCoalesceSendIDs[x] = 0;
+    }
+
     fSessionID = (UInt32)atomic_add(&sSessionIDCounter, 1);
     this->SetVal(qtssRTSPSesID, &fSessionID, sizeof(fSessionID));
     this->SetVal(qtssRTSPSesEventCntxt, &fOutputSocketP, sizeof(fOutputSocketP));
     this->SetVal(qtssRTSPSesType, &fSessionType, sizeof(fSessionType));
     this->SetVal(qtssRTSPSesStreamRef, &fStreamRef, sizeof(fStreamRef));
+    this->SetVal(qtssRTSPSesNumInterleavedPackets, &fNumInterleavedPackets, sizeof(fNumInterleavedPackets));
+    this->SetVal(qtssRTSPSesNumInterleavedWrites, &fNumInterleavedWrites, sizeof(fNumInterleavedWrites));
 
     this->SetEmptyVal(qtssRTSPSesLastUserName, &fUserNameBuf[0], kMaxUserNameLen);
     this->SetEmptyVal(qtssRTSPSesLastUserPassword, &fUserPasswordBuf[0], kMaxUserPasswordLen);
@@ -138,7 +158,10 @@ RTSPSessionInterface::~RTSPSessionInterface()
     if (fInputSocketP != fOutputSocketP) 
         delete fInputSocketP;
     
-    delete [] fTCPCoalesceBuffer;
+    // The kernel may still be sending out of a buffer written zero copy, and
+    // it sends whatever the pages hold by then. The reaper keeps those, and
+    // the connection, until their sends complete.
+    TCPCoalesceBufferReaper::Reap(fOutputSocketP, fTCPCoalesceBuffers, fTCPCoalesceSendIDs);
     
     for (UInt8 x = 0; x < (fCurChannelNum >> 1); x++)
         delete [] fChNumToSessIDMap[x].Ptr;
@@ -215,8 +238,8 @@ UInt8 RTSPSessionInterface::GetTwoChannelNumbers(StrPtrLen* inRTSPSessionID)
 {
     //
     // Allocate a TCP coalesce buffer if still needed
-    if (fTCPCoalesceBuffer != NULL)
-        fTCPCoalesceBuffer = new char[kTCPCoalesceBufferSize];
+    if (fTCPCoalesceBuffer == NULL)
+        fTCPCoalesceBuffer = fTCPCoalesceBuffers[0] = NEW char[kTCPCoalesceBufferSize];
 
     //
     // Allocate 2 channel numbers
@@ -260,6 +283,18 @@ StrPtrLen*  RTSPSessionInterface::GetSessionIDForChannelNum(UInt8 inChannelNum)
 
 QTSS_Error RTSPSessionInterface::InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
 {
+    struct iovec theVec;
+    theVec.iov_base = (char*)inBuffer;
+    theVec.iov_len = inLen;
+    
+    return this->InterleavedWriteV(&theVec, (inLen > 0) ? 1 : 0, inLen, outLenWritten, channel);
+}
+
+QTSS_Error RTSPSessionInterface::InterleavedWriteV(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
+{
+    Assert(inNumVectors <= kMaxInterleavedWriteVectors);
+    if (inNumVectors > kMaxInterleavedWriteVectors)
+        return QTSS_BadArgument;
 
     if ( inLen == 0 && fNumInCoalesceBuffer == 0 )
     {   if (outLenWritten != NULL)
@@ -276,6 +311,127 @@ QTSS_Error RTSPSessionInterface::InterleavedWrite(void* inBuffer, UInt32 inLen,
         return EAGAIN;
     }
 
+    QTSS_Error  err = QTSS_NoErr;
+    UInt32      theFramedLen = inLen + kInteleaveHeaderSize;
+    
+    Bool16      theInBurst = (fInterleavedWriteBurstOpen != 0) && (fInterleavedWriteBurstThread == OSThread::GetCurrent());
+    
+    if ( (inLen == 0) || !theInBurst || (fTCPCoalesceBuffer == NULL) || (theFramedLen > kTCPCoalesceBufferSize) )
+    {
+        // Not part of the open burst, or too big to queue. Write it now,
+        // behind whatever is already queued.
+        err = this->WriteInterleavedQueue( inVec, inNumVectors, inLen, channel, RTSPResponseStream::kAllOrNothing );
+    }
+    else if ( (fNumInCoalesceBuffer == 0) && (fOutputStream.Flush() != QTSS_NoErr) )
+    {
+        // The last burst is still waiting in the output stream for the client
+        // to catch up. Don't queue any more behind it.
+        err = EAGAIN;
+    }
+    else if ( theFramedLen > (UInt32)kTCPCoalesceBufferSize - fNumInCoalesceBuffer )
+    {
+        // No room left. Write the queue and this packet together.
+        err = this->WriteInterleavedQueue( inVec, inNumVectors, inLen, channel, RTSPResponseStream::kAllOrNothing );
+    }
+    else
+    {
+        fTCPCoalesceBuffer[fNumInCoalesceBuffer] = '$';
+        fNumInCoalesceBuffer++;
+        
+        fTCPCoalesceBuffer[fNumInCoalesceBuffer] = channel;
+        fNumInCoalesceBuffer++;
+        
+        SInt16  pcketLen = htons( (UInt16) inLen);
+        ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], &pcketLen, 2 );
+        fNumInCoalesceBuffer += 2;
+        
+        for (UInt32 x = 0; x < inNumVectors; x++)
+        {
+            ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], inVec[x].iov_base, inVec[x].iov_len );
+            fNumInCoalesceBuffer += inVec[x].iov_len;
+        }
+        fNumInterleavedPackets++;
+    
+    #if RTSP_SESSION_INTERFACE_DEBUGGING 
+        qtss_printf("InterleavedWrite: coalesce %li, total bufff %li\n", inLen, fNumInCoalesceBuffer);
+    #endif
+    }
+    
+    if ( err == QTSS_NoErr )
+    {   
+        /*  if no error sure to correct outLenWritten, cuz WriteV above includes the interleave header count
+        
+             GetOutputStream()->WriteV guarantees all or nothing for writes
+             if no error, then all was written.
+        */
+        if ( outLenWritten != NULL )
+            *outLenWritten = inLen;
+    }
+
+    this->GetSessionMutex()->Unlock();
+
+
+    return err;
+    
+}
+
+Bool16 RTSPSessionInterface::BeginInterleavedWrites()
+{
+    // The queue belongs to one burst at a time, so it's claimed with the
+    // session mutex held. A burst that can't have it writes directly.
+    OSThread* theThread = OSThread::GetCurrent();
+    if ( (theThread == NULL) || (this->GetSessionMutex()->TryLock() == false) )
+        return false;
+    
+    Bool16 theBegun = (fInterleavedWriteBurstOpen == 0);
+    if ( theBegun )
+    {
+        fInterleavedWriteBurstThread = theThread;
+        (void)atomic_add(&fInterleavedWriteBurstOpen, 1);
+    }
+    this->GetSessionMutex()->Unlock();
+    return theBegun;
+}
+
+void RTSPSessionInterface::EndInterleavedWrites()
+{
+    // The caller may hold its RTP session's mutex, which an RTSP request
+    // can be waiting for with our mutex held, so we can't wait for it.
+    (void)atomic_sub(&fInterleavedWriteBurstOpen, 1);
+    
+    // Send what the burst queued. Anything the client can't take right now
+    // waits in the output stream, ahead of the next burst or RTSP response.
+    // If the mutex is busy, the RTSP session sends it once the mutex is free.
+    if ( fNumInCoalesceBuffer == 0 )
+        return;
+    
+    if ( this->GetSessionMutex()->TryLock() )
+    {
+        this->FlushInterleavedWrites();
+        this->GetSessionMutex()->Unlock();
+    }
+    else
+        this->Signal(Task::kWriteEvent);
+}
+
+void RTSPSessionInterface::FlushInterleavedWrites()
+{
+    // A new burst keeps queueing behind what's there, and sends it all
+    if ( (fNumInCoalesceBuffer > 0) && (fInterleavedWriteBurstOpen == 0) )
+        (void)this->WriteInterleavedQueue( NULL, 0, 0, 0, RTSPResponseStream::kAlwaysBuffer );
+}
+
+/*********************************
+/
+/   WriteInterleavedQueue
+/
+/   Write out the output queue, followed by the given packet if there is one,
+/   in a single writev. Call with the session mutex held.
+/
+*/
+
+QTSS_Error RTSPSessionInterface::WriteInterleavedQueue(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, unsigned char channel, UInt32 inSendType)
+{
     // DMS - this struct should be packed.
     //rt todo -- is this struct more portable (byte alignment could be a problem)?
     struct  RTPInterleaveHeader
@@ -285,102 +441,94 @@ QTSS_Error RTSPSessionInterface::InterleavedWrite(void* inBuffer, UInt32 inLen,
         UInt16      len;
     };
     
-    struct  iovec               iov[3];
+    struct RTPInterleaveHeader  rih;
+    struct  iovec               iov[kMaxInterleavedWriteVectors + 3];
+    UInt32                      theNumVectors = 1; // skip iov[0], WriteV uses it
+    UInt32                      theTotalLen = 0;
     QTSS_Error                  err = QTSS_NoErr;
     
-    
+    // A big enough queue can go out zero copy if there is another buffer to
+    // fill while the kernel still holds this one. Only the queue can: the
+    // packet's pieces belong to the caller, so that goes in a second write.
+    Bool16 theZeroCopy = ( fNumInCoalesceBuffer >= kTCPZeroCopyMinSize )
+                            && QTSServerInterface::GetServer()->GetPrefs()->GetTCPZeroCopyEnabled()
+                            && ( this->GetFreeTCPCoalesceBuffer() < kNumTCPCoalesceBuffers );
+    if ( theZeroCopy && (inLen > 0) )
+    {
+        err = this->WriteInterleavedQueue( NULL, 0, 0, 0, inSendType );
+        if ( err != QTSS_NoErr )
+            return err;
+        theZeroCopy = false;
+    }
 
-    // flush rules
-    if ( ( inLen > kTCPCoalesceDirectWriteSize || inLen == 0 ) && fNumInCoalesceBuffer > 0 
-        || ( inLen + fNumInCoalesceBuffer + kInteleaveHeaderSize > kTCPCoalesceBufferSize ) && fNumInCoalesceBuffer > 0
-        )
+    if ( fNumInCoalesceBuffer > 0 )
     {
-        UInt32      buffLenWritten;
-        
-        // skip iov[0], WriteV uses it
-        iov[1].iov_base = fTCPCoalesceBuffer;
-        iov[1].iov_len = fNumInCoalesceBuffer;
+        iov[theNumVectors].iov_base = fTCPCoalesceBuffer;
+        iov[theNumVectors].iov_len = fNumInCoalesceBuffer;
+        theTotalLen += fNumInCoalesceBuffer;
+        theNumVectors++;
+    }
+    
+    if ( inLen > 0 )
+    {
+        rih.header = '$';
+        rih.channel = channel;
+        rih.len = htons( (UInt16)inLen);
         
-        err = this->GetOutputStream()->WriteV( iov, 2, fNumInCoalesceBuffer, &buffLenWritten, RTSPResponseStream::kAllOrNothing );
-
-    #if RTSP_SESSION_INTERFACE_DEBUGGING 
-        qtss_printf("InterleavedWrite: flushing %li\n", fNumInCoalesceBuffer );
-    #endif
+        iov[theNumVectors].iov_base = (char*)&rih;
+        iov[theNumVectors].iov_len = sizeof(rih);
+        theNumVectors++;
         
-        if ( err == QTSS_NoErr )
-            fNumInCoalesceBuffer = 0;
+        for (UInt32 x = 0; x < inNumVectors; x++)
+            iov[theNumVectors++] = inVec[x];
+        theTotalLen += inLen + sizeof(rih);
     }
     
+    if ( theTotalLen == 0 )
+        return QTSS_NoErr;
     
-    
+    UInt32 theSendsIssued = fOutputSocketP->GetZeroCopySendsIssued();
+    err = this->GetOutputStream()->WriteV( iov, theNumVectors, theTotalLen, NULL, inSendType, theZeroCopy );
+    fNumInterleavedWrites++;
+
+#if RTSP_SESSION_INTERFACE_DEBUGGING 
+    qtss_printf("InterleavedWrite: wrote %li queued, %li direct\n", fNumInCoalesceBuffer, inLen );
+#endif
+
     if ( err == QTSS_NoErr )
     {
+        if ( inLen > 0 )
+            fNumInterleavedPackets++;
         
-        if ( inLen > kTCPCoalesceDirectWriteSize )  
+        if ( fOutputSocketP->GetZeroCopySendsIssued() != theSendsIssued )
         {
-            struct RTPInterleaveHeader  rih;
-            
-            // write direct to stream
-            rih.header = '$';
-            rih.channel = channel;
-            rih.len = htons( (UInt16)inLen);
-            
-            iov[1].iov_base = (char*)&rih;
-            iov[1].iov_len = sizeof(rih);
-            
-            iov[2].iov_base = (char*)inBuffer;
-            iov[2].iov_len = inLen;
-
-            err = this->GetOutputStream()->WriteV( iov, 3, inLen + sizeof(rih), outLenWritten, RTSPResponseStream::kAllOrNothing );
-
-        #if RTSP_SESSION_INTERFACE_DEBUGGING 
-            qtss_printf("InterleavedWrite: bypass %li\n", inLen );
-        #endif
+            // The kernel is still sending out of this buffer. Fill another one.
+            fTCPCoalesceSendIDs[fCurTCPCoalesceBuffer] = fOutputSocketP->GetZeroCopySendsIssued();
+            fCurTCPCoalesceBuffer = this->GetFreeTCPCoalesceBuffer();
+            Assert(fCurTCPCoalesceBuffer < kNumTCPCoalesceBuffers);
             
+            if ( fTCPCoalesceBuffers[fCurTCPCoalesceBuffer] == NULL )
+                fTCPCoalesceBuffers[fCurTCPCoalesceBuffer] = NEW char[kTCPCoalesceBufferSize];
+            fTCPCoalesceBuffer = fTCPCoalesceBuffers[fCurTCPCoalesceBuffer];
         }
-        else
-        {
-            // coalesce with other small writes
-            
-            fTCPCoalesceBuffer[fNumInCoalesceBuffer] = '$';
-            fNumInCoalesceBuffer++;;
-            
-            fTCPCoalesceBuffer[fNumInCoalesceBuffer] = channel;
-            fNumInCoalesceBuffer++;
-            
-            //*((short*)&fTCPCoalesceBuffer[fNumInCoalesceBuffer]) = htons(inLen);
-            // if we ever turn TCPCoalesce back on, this should be optimized
-            // for processors w/o alignment restrictions as above.
-            
-            SInt16  pcketLen = htons( (UInt16) inLen);
-            ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], &pcketLen, 2 );
-            fNumInCoalesceBuffer += 2;
-            
-            ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], inBuffer, inLen );
-            fNumInCoalesceBuffer += inLen;
-        
-        #if RTSP_SESSION_INTERFACE_DEBUGGING 
-            qtss_printf("InterleavedWrite: coalesce %li, total bufff %li\n", inLen, fNumInCoalesceBuffer);
-        #endif
-        }
+        fNumInCoalesceBuffer = 0;
     }
     
-    if ( err == QTSS_NoErr )
-    {   
-        /*  if no error sure to correct outLenWritten, cuz WriteV above includes the interleave header count
-        
-             GetOutputStream()->WriteV guarantees all or nothing for writes
-             if no error, then all was written.
-        */
-        if ( outLenWritten != NULL )
-            *outLenWritten = inLen;
-    }
-
-    this->GetSessionMutex()->Unlock();
-
-
     return err;
+}
+
+UInt32 RTSPSessionInterface::GetFreeTCPCoalesceBuffer()
+{
+    // Returns kNumTCPCoalesceBuffers if all the others are still in flight
+    UInt32 theSendsCompleted = fOutputSocketP->GetZeroCopySendsCompleted();
     
+    for (UInt32 x = 1; x < kNumTCPCoalesceBuffers; x++)
+    {
+        UInt32 theIndex = (fCurTCPCoalesceBuffer + x) % kNumTCPCoalesceBuffers;
+        if ( fTCPCoalesceSendIDs[theIndex] <= theSendsCompleted )
+            return theIndex;
+    }
+    return kNumTCPCoalesceBuffers;
 }
 
 /*
@@ -501,3 +649,123 @@ void RTSPSessionInterface::SendOptionsRequest()
 	fSentOptionsRequest = true;
 	fRoundTripTimeCalculation = false;
 }
+
+void TCPCoalesceBufferReaper::Initialize()
+{
+    if (sReaper == NULL)
+        sReaper = NEW TCPCoalesceBufferReaper();
+}
+
+void TCPCoalesceBufferReaper::Reap(TCPSocket* inSocket, char** ioBuffers, UInt32* inSendIDs)
+{
+    Assert(sReaper != NULL);
+    
+    // If the connection has failed, the kernel has dropped whatever it was
+    // still sending, so everything can go.
+    UInt32 theSendsCompleted = inSocket->GetZeroCopySendsCompleted();
+    Bool16 isConnected = inSocket->IsConnected();
+    Connection* theConnection = NULL;
+    
+    for (UInt32 x = 0; x < RTSPSessionInterface::kNumTCPCoalesceBuffers; x++)
+    {
+        if (ioBuffers[x] == NULL)
+            continue;
+        
+        if ( !isConnected || (inSendIDs[x] <= theSendsCompleted) )
+            delete [] ioBuffers[x];
+        else
+        {
+            if (theConnection == NULL)
+            {
+                theConnection = NEW Connection();
+                theConnection->fSocket.SnarfSocket(*inSocket);
+            }
+            theConnection->fBuffers[x] = ioBuffers[x];
+            theConnection->fSendIDs[x] = inSendIDs[x];
+        }
+        ioBuffers[x] = NULL;
+    }
+    
+    if (theConnection == NULL)
+        return;
+        
+    // Nothing will be read from or written to the connection again, so let
+    // the client see it close once the queued data is out
+    (void)::shutdown(theConnection->fSocket.GetSocketFD(), SHUT_WR);
+    
+    OSMutexLocker locker(&sReaper->fMutex);
+    sReaper->fConnections.EnQueue(&theConnection->fQueueElem);
+    sReaper->Signal(Task::kUpdateEvent);
+}
+
+SInt64 TCPCoalesceBufferReaper::Run()
+{
+    (void)this->GetEvents();
+    
+    OSMutexLocker locker(&fMutex);
+    for (OSQueueIter theIter(&fConnections); !theIter.IsDone(); )
+    {
+        Connection* theConnection = (Connection*)theIter.GetCurrent()->GetEnclosingObject();
+        theIter.Next();
+        
+        if (theConnection->FreeSentBuffers())
+        {
+            fConnections.Remove(&theConnection->fQueueElem);
+            delete theConnection;
+        }
+    }
+    
+    // Sleep until Reap hands us another connection
+    if (fConnections.GetLength() == 0)
+        return 0;
+    return kReapIntervalInMilSecs;
+}
+
+TCPCoalesceBufferReaper::Connection::Connection()
+:   fQueueElem(),
+    fSocket(NULL, Socket::kNonBlockingSocketType)
+{
+    fQueueElem.SetEnclosingObject(this);
+    for (UInt32 x = 0; x < RTSPSessionInterface::kNumTCPCoalesceBuffers; x++)
+    {
+        fBuffers[x] = NULL;
+        fSendIDs[x] = 0;
+    }
+}
+
+TCPCoalesceBufferReaper::Connection::~Connection()
+{
+    for (UInt32 x = 0; x < RTSPSessionInterface::kNumTCPCoalesceBuffers; x++)
+        delete [] fBuffers[x];
+}
+
+Bool16 TCPCoalesceBufferReaper::Connection::FreeSentBuffers()
+{
+    // A pending error (a reset, say) means the kernel has dropped the sends
+    int theSocketErr = 0;
+#if __Win32__ || __osf__ || __sgi__ || __hpux__	
+    int theLen = sizeof(theSocketErr);
+#else
+    socklen_t theLen = sizeof(theSocketErr);
+#endif
+    if (::getsockopt(fSocket.GetSocketFD(), SOL_SOCKET, SO_ERROR, (char*)&theSocketErr, &theLen) != 0)
+        theSocketErr = OSThread::GetErrno();
+    
+    UInt32 theSendsCompleted = fSocket.GetZeroCopySendsCompleted();
+    Bool16 allFreed = true;
+    
+    for (UInt32 x = 0; x < RTSPSessionInterface::kNumTCPCoalesceBuffers; x++)
+    {
+        if (fBuffers[x] == NULL)
+            continue;
+            
+        if ( (theSocketErr != 0) || (fSendIDs[x] <= theSendsCompleted) )
+        {
+            delete [] fBuffers[x];
+            fBuffers[x] = NULL;
+        }
+        else
+            allFreed = false;
+    }
+    return allFreed;
+}
@@ -111,6 +111,26 @@ public:
 
     // performs RTP over RTSP
     QTSS_Error  InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel);
+    
+    // the same for a packet in up to kMaxInterleavedWriteVectors pieces.
+    // inLen is the length of the whole packet.
+    enum { kMaxInterleavedWriteVectors = 16 };
+    QTSS_Error  InterleavedWriteV(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, UInt32* outLenWritten, unsigned char channel);
+    
+    // RTP sessions bracket each send burst with these. While a burst is open,
+    // the interleaved packets its thread writes are framed into an output
+    // queue instead of being written one at a time, and the queue goes out in
+    // a single writev when it fills up and when the burst ends. Writes from
+    // other threads, such as the reflector's, still go out directly. Only one
+    // burst queues at a time; BeginInterleavedWrites returns false for any
+    // other, and EndInterleavedWrites must only be called if it returned true.
+    // RTSPInterleavedWriteBatcher does this for a scope.
+    Bool16      BeginInterleavedWrites();
+    void        EndInterleavedWrites();
+    
+    // Sends what a finished burst left queued because it couldn't get the
+    // session mutex. Call with the session mutex held.
+    void        FlushInterleavedWrites();
 
 	// OPTIONS request
 	void		SaveOutputStream();
@@ -161,15 +181,32 @@ protected:
     // be prevented from writing while an RTSP request is in progress
     OSMutex             fSessionMutex;
     
-    // for coalescing small interleaved writes into a single TCP frame
+    // Interleaved output queue. Packets written during a send burst are framed
+    // and copied into fTCPCoalesceBuffer, then written together. The other
+    // buffers are only used while the kernel is still sending a full one
+    // zero copy.
     enum
     {
-          kTCPCoalesceBufferSize = 1450 //1450 is the max data space in an TCP segment over ent
-        , kTCPCoalesceDirectWriteSize = 0 // if > this # bytes bypass coalescing and make a direct write
+          kTCPCoalesceBufferSize = 32 * 1024
+        , kNumTCPCoalesceBuffers = 4
+        , kTCPZeroCopyMinSize = 16 * 1024 // smaller writes aren't worth pinning pages for
         , kInteleaveHeaderSize = 4  // '$ '+ 1 byte ch ID + 2 bytes length
     };
     char*       fTCPCoalesceBuffer;
-    SInt32      fNumInCoalesceBuffer;
+    UInt32      fNumInCoalesceBuffer;
+    char*       fTCPCoalesceBuffers[kNumTCPCoalesceBuffers];
+    UInt32      fTCPCoalesceSendIDs[kNumTCPCoalesceBuffers]; // zero copy send each buffer waits on
+    UInt32      fCurTCPCoalesceBuffer;
+    OSThread*   fInterleavedWriteBurstThread;   // set with the session mutex held
+    unsigned int fInterleavedWriteBurstOpen;    // cleared without it when the burst ends
+    
+    UInt32      fNumInterleavedPackets;
+    UInt32      fNumInterleavedWrites;
+    
+    QTSS_Error  WriteInterleavedQueue(const iovec* inVec, UInt32 inNumVectors, UInt32 inLen, unsigned char channel, UInt32 inSendType);
+    UInt32      GetFreeTCPCoalesceBuffer();
+    
+    friend class TCPCoalesceBufferReaper;   // takes the buffers still in flight when we go away
 
 
     //+rt  socket we get from "accept()"
@@ -215,5 +252,70 @@ protected:
     
     static QTSSAttrInfoDict::AttrInfo   sAttributes[];
 };
+
+//Opens an interleaved write burst on an RTSP session for the life of the object,
+//the way UDPSendBatcher does for UDP sends. It holds the session, so the
+//burst can be closed even if the RTP session is torn down in the middle of it.
+//A NULL session is fine.
+class RTSPInterleavedWriteBatcher
+{
+    public:
+        RTSPInterleavedWriteBatcher(RTSPSessionInterface* inSession) : fSession(inSession), fBegun(false)
+            {   if (fSession != NULL) { fSession->IncrementObjectHolderCount(); fBegun = fSession->BeginInterleavedWrites(); } }
+        ~RTSPInterleavedWriteBatcher()
+            {   if (fSession != NULL) { if (fBegun) fSession->EndInterleavedWrites(); fSession->DecrementObjectHolderCount(); } }
+    
+    private:
+        RTSPSessionInterface* fSession;
+        Bool16                fBegun;
+};
+
+//Frees the TCP coalesce buffers of RTSP sessions that went away while the kernel
+//was still sending out of them zero copy. It takes over the session's connection
+//so it can keep reading the completions, frees each buffer once its send has
+//completed (or all of them if the connection fails), and then closes it.
+class TCPCoalesceBufferReaper : public Task
+{
+    public:
+
+        //Initialize must be called before any RTSP session goes away
+        static void     Initialize();
+
+        //Frees the buffers that are done and NULLs them out in ioBuffers. If any are
+        //still in flight, they and inSocket's connection now belong to the reaper.
+        static void     Reap(TCPSocket* inSocket, char** ioBuffers, UInt32* inSendIDs);
+
+        enum
+        {
+            kReapIntervalInMilSecs = 100    //UInt32
+        };
+
+    private:
+
+        TCPCoalesceBufferReaper() : Task() { this->SetTaskName("TCPCoalesceBufferReaper"); }
+        virtual ~TCPCoalesceBufferReaper() {}
+
+        virtual SInt64 Run();
+
+        class Connection
+        {
+            public:
+                Connection();
+                ~Connection();
+
+                //Returns true once every buffer has been freed
+                Bool16      FreeSentBuffers();
+
+                OSQueueElem fQueueElem;
+                TCPSocket   fSocket;
+                char*       fBuffers[RTSPSessionInterface::kNumTCPCoalesceBuffers];
+                UInt32      fSendIDs[RTSPSessionInterface::kNumTCPCoalesceBuffers];
+        };
+
+        OSMutex     fMutex;
+        OSQueue     fConnections;
+
+        static TCPCoalesceBufferReaper* sReaper;
+};
 #endif // __RTSPSESSIONINTERFACE_H__
 
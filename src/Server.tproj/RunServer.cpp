@@ -135,6 +135,18 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
         qtss_printf("Number of task threads: %lu\n",numThreads);
     #endif
     
+        // Socket::Initialize already made the first event thread. Sockets that
+        // register from here on get spread across all of them.
+        UInt32 numEventThreads = sServer->GetPrefs()->GetNumEventThreads();
+        if (numEventThreads == 0)
+            numEventThreads = OS::GetNumProcessors(); // 1 event thread per processor
+        if (numEventThreads > 1)
+            numEventThreads = 1 + Socket::AddEventThreads(numEventThreads - 1);
+
+    #if DEBUG
+        qtss_printf("Number of event threads: %lu\n",numEventThreads);
+    #endif
+    
         // Start up the server's global tasks, and start listening
         TimeoutTask::Initialize();     // The TimeoutTask mechanism is task based,
                                     // we therefore must do this after adding task threads
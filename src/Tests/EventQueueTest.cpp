@@ -0,0 +1,517 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// EventQueueTest:
+//   Checks the one-shot contract of the event queue backend that the
+//   EventThreads rely on, and that cookies and fds come back intact. Then
+//   starts a pool of EventThreads and checks that EventContext::RequestEvent
+//   spreads contexts across them, that every context's events arrive on its
+//   own thread, and that each thread's event counters move.
+//   With -b, also compares the epoll backend against a select() loop at
+//   1k, 10k and 50k idle and active connections.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#if EPOLLEVENTQUEUE
+#include <sys/eventfd.h>
+#endif
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "OSMemory.h"
+#include "ev.h"
+#include "EventContext.h"
+#include "TestUtils.h"
+
+enum { kNumSocketPairs = 64 };
+
+static int sSockets[kNumSocketPairs][2];
+static struct eventreq sRequests[kNumSocketPairs];
+
+static int WaitForEvent(int inQueue, struct eventreq* outReq)
+{
+    //The queue times out every 15 seconds. Give up, rather than hang, if
+    //the event we expect never comes.
+    int theErr = EINTR;
+    for (UInt32 theTry = 0; (theTry < 2) && (theErr == EINTR); theTry++)
+    {
+#if EPOLLEVENTQUEUE
+        theErr = select_queue_waitevent(inQueue, outReq, NULL);
+#else
+        theErr = select_waitevent(outReq, NULL);
+#endif
+    }
+    return theErr;
+}
+
+static void MakeReadable(UInt32 inIndex)
+{
+    (void)::write(sSockets[inIndex][1], "x", 1);
+}
+
+static void Watch(int inQueue, UInt32 inIndex, void* inCookie)
+{
+    ::memset(&sRequests[inIndex], 0, sizeof(struct eventreq));
+    sRequests[inIndex].er_handle = sSockets[inIndex][0];
+    sRequests[inIndex].er_data = inCookie;
+#if EPOLLEVENTQUEUE
+    TEST_CHECK(select_queue_watchevent(inQueue, &sRequests[inIndex], EV_RE) == 0);
+#else
+    TEST_CHECK(select_watchevent(&sRequests[inIndex], EV_RE) == 0);
+#endif
+}
+
+//
+// EventContext sharding. Unique IDs are handed out in order, so consecutive
+// contexts hash to consecutive event threads.
+
+enum { kNumEventThreads = 3, kContextsPerThread = 2, kEventsPerContext = 3 };
+
+class TestContext : public EventContext
+{
+    public:
+    
+        TestContext(int inFileDesc)
+        :   EventContext(inFileDesc, EventThread::GetThread(0)),
+            fNumEvents(0), fThreadIndex(kNumEventThreads), fNumWrongThread(0)
+        {}
+        
+        volatile UInt32 fNumEvents;
+        UInt32          fThreadIndex;
+        UInt32          fNumWrongThread;
+        
+    protected:
+    
+        //Called on the event thread the context hashed to
+        virtual void ProcessEvent(int /*eventBits*/)
+        {
+            char theByte = 0;
+            (void)::read(fFileDesc, &theByte, 1);
+            
+            UInt32 theIndex = 0;
+            while ((theIndex < EventThread::GetNumThreads()) && (EventThread::GetThread(theIndex) != OSThread::GetCurrent()))
+                theIndex++;
+            if (fNumEvents == 0)
+                fThreadIndex = theIndex;
+            else if (theIndex != fThreadIndex)
+                fNumWrongThread++;
+            fNumEvents++;
+        }
+};
+
+static Bool16 WaitForContext(TestContext* inContext, UInt32 inNumEvents)
+{
+    for (UInt32 theWait = 0; theWait < 5000; theWait++)
+    {
+        if (inContext->fNumEvents >= inNumEvents)
+            return true;
+        OSThread::Sleep(1);
+    }
+    return false;
+}
+
+static void CheckEventThreads()
+{
+    UInt32 theNumThreads = 0;
+    while ((theNumThreads < kNumEventThreads) && EventThread::CanAddThread())
+    {
+        EventThread* theThread = NEW EventThread();
+        theThread->Start();
+        theNumThreads++;
+    }
+    TEST_CHECK(theNumThreads == EventThread::GetNumThreads());
+#if EPOLLEVENTQUEUE
+    TEST_CHECK(theNumThreads == kNumEventThreads);
+#endif
+
+    UInt32 theNumContexts = theNumThreads * kContextsPerThread;
+    TestContext* theContexts[kNumEventThreads * kContextsPerThread];
+    int theWriters[kNumEventThreads * kContextsPerThread];
+    for (UInt32 x = 0; x < theNumContexts; x++)
+    {
+        int thePair[2];
+        TEST_CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, thePair) == 0);
+        theContexts[x] = NEW TestContext(thePair[0]);
+        theWriters[x] = thePair[1];
+    }
+    
+    //Start every thread's rates from now
+    for (UInt32 theIndex = 0; theIndex < theNumThreads; theIndex++)
+        EventThread::GetThread(theIndex)->UpdateStats(OS::Milliseconds());
+    SInt64 theStart = OS::Milliseconds();
+    
+    for (UInt32 theEvent = 0; theEvent < kEventsPerContext; theEvent++)
+    {
+        //The first round registers the contexts, later ones re-arm them
+        for (UInt32 x = 0; x < theNumContexts; x++)
+        {
+            theContexts[x]->RequestEvent(EV_RE);
+            (void)::write(theWriters[x], "x", 1);
+        }
+        for (UInt32 x = 0; x < theNumContexts; x++)
+            TEST_CHECK(WaitForContext(theContexts[x], theEvent + 1));
+    }
+    
+    UInt32 theEventsPerThread[kNumEventThreads] = { 0 };
+    for (UInt32 x = 0; x < theNumContexts; x++)
+    {
+        TEST_CHECK(theContexts[x]->fNumEvents == kEventsPerContext);
+        TEST_CHECK(theContexts[x]->fNumWrongThread == 0);
+        TEST_CHECK(theContexts[x]->fThreadIndex < theNumThreads);
+        TEST_CHECK(theContexts[x]->fThreadIndex == (theContexts[0]->fThreadIndex + x) % theNumThreads);
+        if (theContexts[x]->fThreadIndex < theNumThreads)
+            theEventsPerThread[theContexts[x]->fThreadIndex] += theContexts[x]->fNumEvents;
+    }
+    
+    //
+    // The event thread counts an event after handing it to the context, so
+    // give the last ones a moment to land before taking the rates.
+    OSThread::Sleep(100);
+    SInt64 theElapsed = OS::Milliseconds() - theStart;
+    for (UInt32 theIndex = 0; theIndex < theNumThreads; theIndex++)
+    {
+        TEST_CHECK(theEventsPerThread[theIndex] == kContextsPerThread * kEventsPerContext);
+        
+        EventThread* theThread = EventThread::GetThread(theIndex);
+        theThread->UpdateStats(theStart + theElapsed);
+        UInt32 theExpectedRate = (UInt32)(((SInt64)theEventsPerThread[theIndex] * 1000) / (theElapsed + 1));
+        TEST_CHECK(theThread->GetEventsPerSec() > 0);
+        TEST_CHECK(theThread->GetEventsPerSec() >= theExpectedRate);
+    }
+    
+    //Cleanup takes the fd out of its thread's queue and closes it
+    for (UInt32 x = 0; x < theNumContexts; x++)
+    {
+        delete theContexts[x];
+        (void)::close(theWriters[x]);
+    }
+}
+
+#if EPOLLEVENTQUEUE
+//
+// Benchmarks. Each connection is an eventfd: it costs one descriptor, and a
+// write makes it readable the way data arriving on a socket would. An idle
+// pass keeps every connection watched but only wakes kNumBusy of them per
+// round; an active pass wakes all of them every round.
+
+enum { kNumBusy = 32, kEventsPerPass = 200000 };
+
+static int* sBenchFDs = NULL;
+
+static void Wake(UInt32 inIndex)
+{
+    UInt64 theOne = 1;
+    (void)::write(sBenchFDs[inIndex], &theOne, sizeof(theOne));
+}
+
+static void Drain(int inFD)
+{
+    UInt64 theCount = 0;
+    (void)::read(inFD, &theCount, sizeof(theCount));
+}
+
+static UInt32 RoundsFor(UInt32 inNumWoken)
+{
+    UInt32 theRounds = kEventsPerPass / inNumWoken;
+    return (theRounds > 0) ? theRounds : 1;
+}
+
+static void PrintRate(const char* inBackend, UInt32 inNumConnections, const char* inKind, UInt32 inNumEvents, SInt64 inElapsed)
+{
+    ::printf("EventQueueTest: %-6s %6lu %s connections %10llu events/sec\n", inBackend, inNumConnections, inKind,
+                (unsigned long long)(((SInt64)inNumEvents * 1000000) / ((inElapsed > 0) ? inElapsed : 1)));
+}
+
+//
+// The epoll backend, through the same calls Socket::EventThread makes: wait,
+// handle the event, re-arm.
+static void RunEpollPass(int inQueue, UInt32 inNumConnections, Bool16 inActive)
+{
+    UInt32 theNumWoken = inActive ? inNumConnections : kNumBusy;
+    UInt32 theRounds = RoundsFor(theNumWoken);
+    UInt32 theNumEvents = 0;
+    
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 theRound = 0; theRound < theRounds; theRound++)
+    {
+        //Spread the idle pass's busy connections over the whole range
+        for (UInt32 x = 0; x < theNumWoken; x++)
+            Wake(inActive ? x : ((x * inNumConnections) / kNumBusy + theRound) % inNumConnections);
+        
+        for (UInt32 x = 0; x < theNumWoken; x++)
+        {
+            struct eventreq theReq;
+            if (WaitForEvent(inQueue, &theReq) != 0)
+            {
+                TEST_CHECK(false);
+                return;
+            }
+            Drain(theReq.er_handle);
+            TEST_CHECK(select_queue_modwatch(inQueue, &theReq, EV_RE) == 0);
+            theNumEvents++;
+        }
+    }
+    PrintRate("epoll", inNumConnections, inActive ? "active" : "idle", theNumEvents, OS::Microseconds() - theStart);
+}
+
+static void RunEpollBenchmark(UInt32 inNumConnections)
+{
+    int theQueue = select_createqueue();
+    TEST_CHECK(theQueue > 0);
+    if (theQueue <= 0)
+        return;
+        
+    for (UInt32 x = 0; x < inNumConnections; x++)
+    {
+        struct eventreq theReq;
+        ::memset(&theReq, 0, sizeof(theReq));
+        theReq.er_handle = sBenchFDs[x];
+        theReq.er_data = (void*)(uintptr_t)(x + 1);
+        TEST_CHECK(select_queue_watchevent(theQueue, &theReq, EV_RE) == 0);
+    }
+    
+    RunEpollPass(theQueue, inNumConnections, false);
+    RunEpollPass(theQueue, inNumConnections, true);
+    
+    //Removing an fd also closes it
+    for (UInt32 x = 0; x < inNumConnections; x++)
+        (void)select_queue_removeevent(theQueue, sBenchFDs[x]);
+}
+
+//
+// What ev.cpp does on every wakeup: copy the watched set, select() over
+// every fd up to the highest, then walk the returned set from fd 0. One-shot
+// like the backend: an fd leaves the watched set when its event is handed
+// out, and comes back when it is re-armed.
+static void RunSelectPass(UInt32 inNumConnections, Bool16 inActive)
+{
+    UInt32 theNumWoken = inActive ? inNumConnections : kNumBusy;
+    UInt32 theRounds = RoundsFor(theNumWoken);
+    UInt32 theNumEvents = 0;
+    
+    fd_set theWatchedSet;
+    FD_ZERO(&theWatchedSet);
+    int theMaxFD = 0;
+    for (UInt32 x = 0; x < inNumConnections; x++)
+    {
+        FD_SET(sBenchFDs[x], &theWatchedSet);
+        if (sBenchFDs[x] > theMaxFD)
+            theMaxFD = sBenchFDs[x];
+    }
+    
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 theRound = 0; theRound < theRounds; theRound++)
+    {
+        for (UInt32 x = 0; x < theNumWoken; x++)
+            Wake(inActive ? x : ((x * inNumConnections) / kNumBusy + theRound) % inNumConnections);
+            
+        UInt32 theNumHandled = 0;
+        while (theNumHandled < theNumWoken)
+        {
+            fd_set theReturnedSet;
+            ::memcpy(&theReturnedSet, &theWatchedSet, sizeof(fd_set));
+            struct timeval theTimeout = { 15, 0 };
+            int theNumReady = ::select(theMaxFD + 1, &theReturnedSet, NULL, NULL, &theTimeout);
+            if (theNumReady <= 0)
+            {
+                TEST_CHECK(false);
+                return;
+            }
+            
+            for (int theFD = 0; theFD <= theMaxFD; theFD++)
+            {
+                if (!FD_ISSET(theFD, &theReturnedSet))
+                    continue;
+                FD_CLR(theFD, &theWatchedSet);
+                Drain(theFD);
+                FD_SET(theFD, &theWatchedSet);
+                theNumHandled++;
+                theNumEvents++;
+            }
+        }
+    }
+    PrintRate("select", inNumConnections, inActive ? "active" : "idle", theNumEvents, OS::Microseconds() - theStart);
+}
+
+static UInt32 OpenBenchFDs(UInt32 inNumConnections, UInt32 inMaxFDs)
+{
+    if (inNumConnections > inMaxFDs)
+        inNumConnections = inMaxFDs;
+        
+    UInt32 theNumOpen = 0;
+    for ( ; theNumOpen < inNumConnections; theNumOpen++)
+    {
+        sBenchFDs[theNumOpen] = ::eventfd(0, EFD_NONBLOCK);
+        if (sBenchFDs[theNumOpen] < 0)
+            break;
+    }
+    return theNumOpen;
+}
+
+static void RunBenchmark()
+{
+    static const UInt32 kConnectionCounts[] = { 1000, 10000, 50000 };
+    enum { kNumCounts = sizeof(kConnectionCounts) / sizeof(kConnectionCounts[0]), kReservedFDs = 64 };
+    
+    //Every connection is a descriptor, so take as many as we are allowed
+    struct rlimit theLimit;
+    if (::getrlimit(RLIMIT_NOFILE, &theLimit) == 0)
+    {
+        theLimit.rlim_cur = theLimit.rlim_max;
+        (void)::setrlimit(RLIMIT_NOFILE, &theLimit);
+        (void)::getrlimit(RLIMIT_NOFILE, &theLimit);
+    }
+    
+    //Leave some for the test itself and for the epoll queue
+    UInt32 theMaxFDs = kConnectionCounts[kNumCounts - 1];
+    if (theLimit.rlim_cur < theMaxFDs + kReservedFDs)
+        theMaxFDs = (theLimit.rlim_cur > kReservedFDs) ? (UInt32)(theLimit.rlim_cur - kReservedFDs) : 0;
+    
+    sBenchFDs = NEW int[kConnectionCounts[kNumCounts - 1]];
+    for (UInt32 theCount = 0; theCount < kNumCounts; theCount++)
+    {
+        UInt32 theNumConnections = kConnectionCounts[theCount];
+        
+        //
+        // select() can only watch fds below FD_SETSIZE, so it gets as many
+        // connections as fit under that
+        UInt32 theNumOpen = OpenBenchFDs(theNumConnections, theMaxFDs);
+        UInt32 theNumSelectable = 0;
+        while ((theNumSelectable < theNumOpen) && (sBenchFDs[theNumSelectable] < FD_SETSIZE))
+            theNumSelectable++;
+        if (theNumSelectable < theNumConnections)
+            ::printf("EventQueueTest: select %6lu connections capped at %lu by FD_SETSIZE (%d)\n",
+                        theNumConnections, theNumSelectable, FD_SETSIZE);
+        if (theNumSelectable > kNumBusy)
+        {
+            RunSelectPass(theNumSelectable, false);
+            RunSelectPass(theNumSelectable, true);
+        }
+        
+        //
+        // epoll has no ceiling of its own, but every connection still costs a
+        // descriptor, and there are only so many of those.
+        if (theNumOpen < theNumConnections)
+            ::printf("EventQueueTest: epoll  %6lu connections capped at %lu by RLIMIT_NOFILE (%llu)\n",
+                        theNumConnections, theNumOpen, (unsigned long long)theLimit.rlim_cur);
+        if (theNumOpen > kNumBusy)
+            RunEpollBenchmark(theNumOpen);
+        else
+        {
+            for (UInt32 x = 0; x < theNumOpen; x++)
+                (void)::close(sBenchFDs[x]);
+        }
+    }
+    delete [] sBenchFDs;
+    sBenchFDs = NULL;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    select_startevents();
+    
+    for (UInt32 x = 0; x < kNumSocketPairs; x++)
+        TEST_CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, sSockets[x]) == 0);
+        
+    //
+    // Cookies are EventContext unique IDs. Use the full 32 bit range, so a
+    // backend that packs them with the fd can't lose the top bits.
+    for (UInt32 x = 0; x < kNumSocketPairs; x++)
+        Watch(0, x, (void*)(uintptr_t)(0xFFFFFFFF - x));
+        
+    for (UInt32 x = 0; x < kNumSocketPairs; x += 3)
+        MakeReadable(x);
+        
+    for (UInt32 x = 0; x < kNumSocketPairs; x += 3)
+    {
+        struct eventreq theReq;
+        TEST_CHECK(WaitForEvent(0, &theReq) == 0);
+        UInt32 theIndex = 0xFFFFFFFF - (UInt32)(uintptr_t)theReq.er_data;
+        TEST_CHECK(theIndex < kNumSocketPairs);
+        TEST_CHECK((theIndex % 3) == 0);
+        if (theIndex < kNumSocketPairs)
+            TEST_CHECK(theReq.er_handle == sSockets[theIndex][0]);
+        TEST_CHECK(theReq.er_eventbits & EV_RE);
+    }
+    
+    //
+    // Pair 0 still has its byte unread, but it has delivered its event and is
+    // disarmed, so the next event has to come from pair 1.
+    MakeReadable(1);
+    struct eventreq theReq;
+    TEST_CHECK(WaitForEvent(0, &theReq) == 0);
+    TEST_CHECK(theReq.er_handle == sSockets[1][0]);
+    
+    //Re-arming pair 0 delivers its still pending data again
+    TEST_CHECK(select_modwatch(&sRequests[0], EV_RE) == 0);
+    TEST_CHECK(WaitForEvent(0, &theReq) == 0);
+    TEST_CHECK(theReq.er_handle == sSockets[0][0]);
+    TEST_CHECK(theReq.er_data == (void*)(uintptr_t)0xFFFFFFFF);
+    
+#if EPOLLEVENTQUEUE
+    //
+    // Events on one queue are only seen by that queue's waiter
+    int theQueue = select_createqueue();
+    TEST_CHECK(theQueue > 0);
+    Watch(theQueue, kNumSocketPairs - 1, (void*)1);
+    MakeReadable(kNumSocketPairs - 1);
+    MakeReadable(2);
+    (void)select_modwatch(&sRequests[2], EV_RE);
+    
+    TEST_CHECK(WaitForEvent(0, &theReq) == 0);
+    TEST_CHECK(theReq.er_handle == sSockets[2][0]);
+    TEST_CHECK(WaitForEvent(theQueue, &theReq) == 0);
+    TEST_CHECK(theReq.er_handle == sSockets[kNumSocketPairs - 1][0]);
+    TEST_CHECK(theReq.er_data == (void*)1);
+#endif
+
+    for (UInt32 x = 0; x < kNumSocketPairs; x++)
+    {
+        (void)select_removeevent(sSockets[x][0]);
+        (void)::close(sSockets[x][1]);
+    }
+    
+    //
+    // The first event thread takes over queue 0, so this has to come after
+    // the checks above that wait on it directly
+    CheckEventThreads();
+    
+#if EPOLLEVENTQUEUE
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+#endif
+    
+    return TestResult("EventQueueTest");
+}
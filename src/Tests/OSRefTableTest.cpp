@@ -0,0 +1,408 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// OSRefTableTest:
+//   Owner threads register and unregister their own IDs while other threads
+//   resolve and release random IDs and another iterates over the locked-down
+//   table. An UnRegister must wait out every Resolve of its Ref, an ID must
+//   not resolve once it is unregistered, and iterating must see every Ref in
+//   the table, even while its stripes grow. An UnRegister that has to wait
+//   with the table locked must let the other stripes go. With -b, times
+//   Resolve and Release on several threads.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "OSRef.h"
+#include "atomic.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumOwnerThreads = 4,       //UInt32
+    kNumResolverThreads = 3,    //UInt32
+    kNumIDsPerOwner = 2000,     //UInt32
+    kNumRounds = 10,            //UInt32
+    kMinNumResolves = 1000,     //UInt32
+    kNumIDs = kNumOwnerThreads * kNumIDsPerOwner,
+    kIDSize = 24                //UInt32
+};
+
+static OSRefTable*  sTable = NULL;
+static char         sIDs[kNumIDs][kIDSize];
+static OSRef        sRefs[kNumIDs];
+static unsigned int sNumRefsInUse[kNumIDs];
+static volatile Bool16 sDone = false;
+static unsigned int sNumResolves = 0;
+static unsigned int sNumWaitedUnRegisters = 0;
+
+static UInt32 Random(UInt32* ioSeed, UInt32 inRange)
+{
+    *ioSeed = (*ioSeed * 1103515245) + 12345;
+    return (*ioSeed >> 8) % inRange;
+}
+
+static void MakeIDs()
+{
+    //The same length and all digits, like RTP session IDs
+    for (UInt32 x = 0; x < kNumIDs; x++)
+        qtss_sprintf(sIDs[x], "%lu%09lu", 1000000000 + (x * 7919), x);
+}
+
+//
+// Registers its own IDs, then unregisters them, over and over
+class OwnerThread : public OSThread
+{
+    public:
+        OwnerThread(UInt32 inIndex) : fIndex(inIndex) {}
+        
+        virtual void Entry()
+        {
+            //Keep going until the resolvers have had a chance to run, in case
+            //the machine is busy and they haven't been scheduled yet
+            UInt32 theFirst = fIndex * kNumIDsPerOwner;
+            for (UInt32 theRound = 0; (theRound < kNumRounds) || (sNumResolves < kMinNumResolves); theRound++)
+            {
+                for (UInt32 x = theFirst; x < theFirst + kNumIDsPerOwner; x++)
+                {
+                    StrPtrLen theID(sIDs[x]);
+                    sRefs[x].Set(theID, &sRefs[x]);
+                    TEST_CHECK(sTable->Register(&sRefs[x]) == OS_NoErr);
+                    TEST_CHECK(sTable->Register(&sRefs[x]) != OS_NoErr);
+                }
+                for (UInt32 y = theFirst; y < theFirst + kNumIDsPerOwner; y++)
+                {
+                    if (sRefs[y].GetRefCount() > 0)
+                        (void)atomic_add(&sNumWaitedUnRegisters, 1);
+                    sTable->UnRegister(&sRefs[y]);
+                    
+                    //No one may still be using it, and no one can resolve it again
+                    TEST_CHECK(sNumRefsInUse[y] == 0);
+                    StrPtrLen theID(sIDs[y]);
+                    TEST_CHECK(sTable->Resolve(&theID) == NULL);
+                }
+            }
+        }
+        
+    private:
+        UInt32  fIndex;
+};
+
+//
+// Resolves random IDs, and sometimes holds on to them for a while
+class ResolverThread : public OSThread
+{
+    public:
+        ResolverThread(UInt32 inIndex) : fSeed(inIndex + 1) {}
+        
+        virtual void Entry()
+        {
+            while (!sDone)
+            {
+                UInt32 theIndex = Random(&fSeed, kNumIDs);
+                StrPtrLen theID(sIDs[theIndex]);
+                OSRef* theRef = sTable->Resolve(&theID);
+                if (theRef == NULL)
+                    continue;
+                    
+                TEST_CHECK(theRef->GetObject() == &sRefs[theIndex]);
+                (void)atomic_add(&sNumRefsInUse[theIndex], 1);
+                (void)atomic_add(&sNumResolves, 1);
+                if (Random(&fSeed, 8) == 0)
+                    OSThread::ThreadYield();
+                (void)atomic_sub(&sNumRefsInUse[theIndex], 1);
+                sTable->Release(theRef);
+            }
+        }
+        
+    private:
+        UInt32  fSeed;
+};
+
+//
+// Locks down the whole table and counts what is in it
+class IteratorThread : public OSThread
+{
+    public:
+        IteratorThread() : fNumIterations(0) {}
+        
+        virtual void Entry()
+        {
+            while (!sDone)
+            {
+                {
+                    OSRefTableLocker locker(sTable);
+                    UInt32 theNumRefs = 0;
+                    for (OSRefTableIter theIter(sTable); !theIter.IsDone(); theIter.Next())
+                    {
+                        OSRef* theRef = theIter.GetCurrent();
+                        TEST_CHECK(theRef->GetObject() == theRef);
+                        theNumRefs++;
+                    }
+                    TEST_CHECK(theNumRefs == sTable->GetNumRefsInTable());
+                    fNumIterations++;
+                }
+                OSThread::Sleep(1);
+            }
+        }
+        
+        UInt32  fNumIterations;
+};
+
+static void CheckStress()
+{
+    sTable = new OSRefTable(577);
+    
+    ResolverThread* theResolvers[kNumResolverThreads];
+    OwnerThread* theOwners[kNumOwnerThreads];
+    IteratorThread theIterator;
+    for (UInt32 x = 0; x < kNumResolverThreads; x++)
+    {
+        theResolvers[x] = new ResolverThread(x);
+        theResolvers[x]->Start();
+    }
+    theIterator.Start();
+    for (UInt32 y = 0; y < kNumOwnerThreads; y++)
+    {
+        theOwners[y] = new OwnerThread(y);
+        theOwners[y]->Start();
+    }
+    for (UInt32 y = 0; y < kNumOwnerThreads; y++)
+    {
+        theOwners[y]->Join();
+        delete theOwners[y];
+    }
+    sDone = true;
+    for (UInt32 x = 0; x < kNumResolverThreads; x++)
+    {
+        theResolvers[x]->Join();
+        delete theResolvers[x];
+    }
+    theIterator.Join();
+    
+    TEST_CHECK(sTable->GetNumRefsInTable() == 0);
+    TEST_CHECK(sNumResolves > 0);
+    TEST_CHECK(theIterator.fNumIterations > 0);
+    ::printf("OSRefTableTest: %lu resolves, %lu unregisters waited, %lu iterations\n",
+                (UInt32)sNumResolves, (UInt32)sNumWaitedUnRegisters, theIterator.fNumIterations);
+    delete sTable;
+    sTable = NULL;
+}
+
+//
+// With the whole table locked down, Refs that no one is using can still be
+// unregistered and swapped, and the table doesn't grow under the iterator
+static void CheckLockedTable()
+{
+    enum { kNumLockedIDs = 1000 };
+    OSRefTable theTable(31);
+    for (UInt32 x = 0; x < kNumLockedIDs; x++)
+    {
+        StrPtrLen theID(sIDs[x]);
+        sRefs[x].Set(theID, &sRefs[x]);
+        TEST_CHECK(theTable.Register(&sRefs[x]) == OS_NoErr);
+    }
+    
+    OSRefTableLocker locker(&theTable);
+    UInt32 theTableSize = theTable.GetTableSize();
+    UInt32 theNumRefs = 0;
+    for (OSRefTableIter theIter(&theTable); !theIter.IsDone(); theIter.Next())
+    {
+        //Register more while iterating; they may or may not be seen
+        UInt32 theIndex = kNumLockedIDs + theNumRefs;
+        if (theIndex < kNumIDs)
+        {
+            StrPtrLen theID(sIDs[theIndex]);
+            sRefs[theIndex].Set(theID, &sRefs[theIndex]);
+            TEST_CHECK(theTable.Register(&sRefs[theIndex]) == OS_NoErr);
+        }
+        theNumRefs++;
+    }
+    TEST_CHECK(kNumLockedIDs + theNumRefs <= kNumIDs);
+    TEST_CHECK(theNumRefs >= kNumLockedIDs);
+    TEST_CHECK(theTable.GetTableSize() == theTableSize);
+    
+    OSRef theSwappedRef;
+    StrPtrLen theSwappedID(sIDs[0]);
+    theSwappedRef.Set(theSwappedID, &theSwappedRef);
+    theTable.Swap(&theSwappedRef);
+    TEST_CHECK(theTable.Resolve(&theSwappedID) == &theSwappedRef);
+    theTable.Release(&theSwappedRef);
+    theTable.UnRegister(&theSwappedRef);
+    
+    for (UInt32 y = 1; y < kNumLockedIDs + theNumRefs; y++)
+    {
+        TEST_CHECK(theTable.TryUnRegister(&sRefs[y]));
+        StrPtrLen theID(sIDs[y]);
+        TEST_CHECK(theTable.Resolve(&theID) == NULL);
+    }
+    TEST_CHECK(theTable.GetNumRefsInTable() == 0);
+}
+
+//
+// Holds a Ref, and needs a Ref from another stripe before it lets go of it
+class HolderThread : public OSThread
+{
+    public:
+        HolderThread(OSRefTable* inTable, StrPtrLen* inHeldID, StrPtrLen* inOtherID)
+            : fTable(inTable), fHeldID(inHeldID), fOtherID(inOtherID), fHolding(false), fTableLocked(false), fGotOther(false) {}
+        
+        virtual void Entry()
+        {
+            OSRef* theHeldRef = fTable->Resolve(fHeldID);
+            fHolding = true;
+            while (!fTableLocked)
+                OSThread::Sleep(1);
+                
+            //Can't get this until the UnRegister lets the table go
+            OSRef* theOtherRef = fTable->Resolve(fOtherID);
+            fGotOther = (theOtherRef != NULL);
+            fTable->Release(theOtherRef);
+            fTable->Release(theHeldRef);
+        }
+        
+        OSRefTable*         fTable;
+        StrPtrLen*          fHeldID;
+        StrPtrLen*          fOtherID;
+        volatile Bool16     fHolding;
+        volatile Bool16     fTableLocked;
+        volatile Bool16     fGotOther;
+};
+
+//
+// An UnRegister that has to wait with the table locked lets the whole table go
+static void CheckLockedUnRegister()
+{
+    OSRefTable theTable(31);
+    StrPtrLen theHeldID(sIDs[0]);
+    UInt32 theOtherIndex = 1;
+    StrPtrLen theOtherID(sIDs[theOtherIndex]);
+    while (theTable.GetMutex(&theOtherID) == theTable.GetMutex(&theHeldID))
+        theOtherID.Set(sIDs[++theOtherIndex]);
+    sRefs[0].Set(theHeldID, &sRefs[0]);
+    sRefs[theOtherIndex].Set(theOtherID, &sRefs[theOtherIndex]);
+    TEST_CHECK(theTable.Register(&sRefs[0]) == OS_NoErr);
+    TEST_CHECK(theTable.Register(&sRefs[theOtherIndex]) == OS_NoErr);
+    
+    HolderThread theHolder(&theTable, &theHeldID, &theOtherID);
+    theHolder.Start();
+    while (!theHolder.fHolding)
+        OSThread::Sleep(1);
+    
+    {
+        //Locked twice, as a caller that locks it again inside its own lock would
+        OSRefTableLocker locker(&theTable);
+        OSRefTableLocker theNestedLocker(&theTable);
+        theHolder.fTableLocked = true;
+        theTable.UnRegister(&sRefs[0]);
+        
+        //The table is locked down again, and the Ref is gone
+        TEST_CHECK(theHolder.fGotOther);
+        TEST_CHECK(sRefs[0].GetRefCount() == 0);
+        TEST_CHECK(theTable.Resolve(&theHeldID) == NULL);
+        TEST_CHECK(theTable.GetNumRefsInTable() == 1);
+    }
+    theHolder.Join();
+    theTable.UnRegister(&sRefs[theOtherIndex]);
+    TEST_CHECK(theTable.GetNumRefsInTable() == 0);
+}
+
+//
+// Benchmark: Resolve and Release random IDs of a full table
+class BenchmarkThread : public OSThread
+{
+    public:
+        BenchmarkThread(UInt32 inIndex, UInt32 inNumOps) : fSeed(inIndex + 1), fNumOps(inNumOps) {}
+        
+        virtual void Entry()
+        {
+            for (UInt32 x = 0; x < fNumOps; x++)
+            {
+                StrPtrLen theID(sIDs[Random(&fSeed, kNumIDs)]);
+                OSRef* theRef = sTable->Resolve(&theID);
+                sTable->Release(theRef);
+            }
+        }
+        
+    private:
+        UInt32  fSeed;
+        UInt32  fNumOps;
+};
+
+static void RunBenchmark()
+{
+    enum { kNumBenchOps = 1000000 };
+    sTable = new OSRefTable(577);
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumIDs; x++)
+    {
+        StrPtrLen theID(sIDs[x]);
+        sRefs[x].Set(theID, &sRefs[x]);
+        (void)sTable->Register(&sRefs[x]);
+    }
+    ::printf("OSRefTableTest: %lu registers: %lu usec, table size %lu\n", (UInt32)kNumIDs,
+                (UInt32)(OS::Microseconds() - theStart), sTable->GetTableSize());
+    
+    for (UInt32 theNumThreads = 1; theNumThreads <= 4; theNumThreads *= 2)
+    {
+        BenchmarkThread* theThreads[4];
+        theStart = OS::Microseconds();
+        for (UInt32 y = 0; y < theNumThreads; y++)
+        {
+            theThreads[y] = new BenchmarkThread(y, kNumBenchOps);
+            theThreads[y]->Start();
+        }
+        for (UInt32 y = 0; y < theNumThreads; y++)
+        {
+            theThreads[y]->Join();
+            delete theThreads[y];
+        }
+        SInt64 theTime = OS::Microseconds() - theStart;
+        ::printf("OSRefTableTest: %lu threads: %.2fM resolve+release/sec\n", theNumThreads,
+                    ((Float64)kNumBenchOps * theNumThreads) / theTime);
+    }
+    for (UInt32 z = 0; z < kNumIDs; z++)
+        sTable->UnRegister(&sRefs[z]);
+    delete sTable;
+    sTable = NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    MakeIDs();
+    
+    CheckLockedTable();
+    CheckLockedUnRegister();
+    CheckStress();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    return TestResult("OSRefTableTest");
+}
@@ -0,0 +1,316 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// OSSlabAllocatorTest:
+//   Gets and puts objects on one thread, hands them from one thread to
+//   another, and churns them on several threads at once. Every live object
+//   must be aligned and keep its contents, objects that are put back must
+//   be reused rather than new slabs made, and the in-use count must come
+//   back to 0. With -b, compares churn against operator new and delete.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "OSMutex.h"
+#include "OSSlabAllocator.h"
+#include "TestUtils.h"
+
+enum
+{
+    kObjectSize = 2040,         //UInt32. rounded up to 2048
+    kNumChurnThreads = 4,       //UInt32
+    kNumLivePerThread = 64,     //UInt32
+    kNumChurnOps = 200000       //UInt32
+};
+
+static OSSlabAllocator* sAllocator = NULL;
+
+static UInt32 Random(UInt32* ioSeed, UInt32 inRange)
+{
+    *ioSeed = (*ioSeed * 1103515245) + 12345;
+    return (*ioSeed >> 8) % inRange;
+}
+
+//
+// Each live object is filled with a byte pattern made from a tag that its
+// owner remembers, so an object handed out twice, or written by someone
+// else, shows up when the pattern is checked.
+static void FillObject(void* inObject, UInt32 inTag)
+{
+    UInt8* theBytes = (UInt8*)inObject;
+    for (UInt32 x = 0; x < kObjectSize; x++)
+        theBytes[x] = (UInt8)(inTag + (x * 13));
+}
+
+static Bool16 ObjectIsIntact(void* inObject, UInt32 inTag)
+{
+    UInt8* theBytes = (UInt8*)inObject;
+    for (UInt32 x = 0; x < kObjectSize; x++)
+    {
+        if (theBytes[x] != (UInt8)(inTag + (x * 13)))
+            return false;
+    }
+    return true;
+}
+
+static void CheckGetAndPut()
+{
+    enum { kNumObjects = 1000 };
+    static void* sObjects[kNumObjects];
+    
+    TEST_CHECK(sAllocator->GetObjectSize() == 2048);
+    UInt32 theNumInUse = sAllocator->GetNumObjectsInUse();
+    for (UInt32 x = 0; x < kNumObjects; x++)
+    {
+        sObjects[x] = sAllocator->Get();
+        TEST_CHECK(((uintptr_t)sObjects[x] & 15) == 0);
+        FillObject(sObjects[x], x);
+    }
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse + kNumObjects);
+    for (UInt32 y = 0; y < kNumObjects; y++)
+        TEST_CHECK(ObjectIsIntact(sObjects[y], y));
+        
+    //Put back in a different order than they came out
+    for (UInt32 z = 0; z < kNumObjects; z++)
+        sAllocator->Put(sObjects[(z * 7) % kNumObjects]);
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse);
+    
+    //The second time around nothing new is made
+    UInt32 theTotal = sAllocator->GetTotalNumObjects();
+    for (UInt32 x = 0; x < kNumObjects; x++)
+        sObjects[x] = sAllocator->Get();
+    TEST_CHECK(sAllocator->GetTotalNumObjects() == theTotal);
+    for (UInt32 y = 0; y < kNumObjects; y++)
+        sAllocator->Put(sObjects[y]);
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse);
+}
+
+static void CheckNewAndDelete()
+{
+    //Only the allocator's own size comes from it; anything else from the heap
+    UInt32 theNumInUse = sAllocator->GetNumObjectsInUse();
+    void* theObject = OSSlabAllocator::New(sAllocator, kObjectSize);
+    void* theBiggerObject = OSSlabAllocator::New(sAllocator, kObjectSize + 16);
+    void* theUnallocatedObject = OSSlabAllocator::New(NULL, kObjectSize);
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse + 1);
+    
+    FillObject(theObject, 1);
+    FillObject(theBiggerObject, 2);
+    FillObject(theUnallocatedObject, 3);
+    TEST_CHECK(ObjectIsIntact(theObject, 1) && ObjectIsIntact(theBiggerObject, 2) && ObjectIsIntact(theUnallocatedObject, 3));
+    
+    OSSlabAllocator::Delete(sAllocator, theObject, kObjectSize);
+    OSSlabAllocator::Delete(sAllocator, theBiggerObject, kObjectSize + 16);
+    OSSlabAllocator::Delete(NULL, theUnallocatedObject, kObjectSize);
+    OSSlabAllocator::Delete(sAllocator, NULL, kObjectSize);
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse);
+}
+
+//
+// One thread gets objects and another puts them back, the way an RTSP
+// session can be set up on one task thread and torn down on another
+enum { kNumHandOffs = 100000, kHandOffRingSize = 256 };
+
+static OSMutex  sHandOffMutex;
+static void*    sHandOffRing[kHandOffRingSize];
+static UInt32   sNumHandedOff = 0;
+static UInt32   sNumTakenBack = 0;
+
+class HandOffThread : public OSThread
+{
+    public:
+        HandOffThread(Bool16 inGets) : fGets(inGets) {}
+        
+        virtual void Entry()
+        {
+            UInt32 theNumDone = 0;
+            while (theNumDone < kNumHandOffs)
+            {
+                OSMutexLocker locker(&sHandOffMutex);
+                if (fGets && (sNumHandedOff - sNumTakenBack < kHandOffRingSize))
+                {
+                    void* theObject = sAllocator->Get();
+                    FillObject(theObject, sNumHandedOff);
+                    sHandOffRing[sNumHandedOff % kHandOffRingSize] = theObject;
+                    sNumHandedOff++;
+                    theNumDone++;
+                }
+                else if (!fGets && (sNumTakenBack < sNumHandedOff))
+                {
+                    void* theObject = sHandOffRing[sNumTakenBack % kHandOffRingSize];
+                    TEST_CHECK(ObjectIsIntact(theObject, sNumTakenBack));
+                    sAllocator->Put(theObject);
+                    sNumTakenBack++;
+                    theNumDone++;
+                }
+                else
+                {
+                    locker.Unlock();
+                    OSThread::ThreadYield();
+                }
+            }
+        }
+        
+    private:
+        Bool16  fGets;
+};
+
+static void CheckHandOff()
+{
+    UInt32 theNumInUse = sAllocator->GetNumObjectsInUse();
+    UInt32 theTotal = sAllocator->GetTotalNumObjects();
+    HandOffThread theGetter(true);
+    HandOffThread thePutter(false);
+    theGetter.Start();
+    thePutter.Start();
+    theGetter.Join();
+    thePutter.Join();
+    
+    //The putter gives back what it frees rather than hoarding it, so the
+    //getter keeps reusing the same objects
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse);
+    TEST_CHECK(sAllocator->GetTotalNumObjects() <= theTotal + kHandOffRingSize + 256);
+}
+
+//
+// Several threads each get and put objects at random
+class ChurnThread : public OSThread
+{
+    public:
+        ChurnThread(UInt32 inIndex, Bool16 inUseSlab, UInt32 inNumOps)
+            : fIndex(inIndex), fUseSlab(inUseSlab), fNumOps(inNumOps), fCheck(true), fTime(0) {}
+        
+        virtual void Entry()
+        {
+            void* theObjects[kNumLivePerThread];
+            UInt32 theTags[kNumLivePerThread];
+            ::memset(theObjects, 0, sizeof(theObjects));
+            UInt32 theSeed = fIndex + 1;
+            
+            SInt64 theStart = OS::Microseconds();
+            for (UInt32 x = 0; x < fNumOps; x++)
+            {
+                UInt32 theSlot = Random(&theSeed, kNumLivePerThread);
+                if (theObjects[theSlot] != NULL)
+                {
+                    if (fCheck)
+                        TEST_CHECK(ObjectIsIntact(theObjects[theSlot], theTags[theSlot]));
+                    if (fUseSlab)
+                        sAllocator->Put(theObjects[theSlot]);
+                    else
+                        ::operator delete(theObjects[theSlot]);
+                    theObjects[theSlot] = NULL;
+                }
+                else
+                {
+                    theObjects[theSlot] = fUseSlab ? sAllocator->Get() : ::operator new(kObjectSize);
+                    theTags[theSlot] = (fIndex << 24) + x;
+                    if (fCheck)
+                        FillObject(theObjects[theSlot], theTags[theSlot]);
+                    else
+                        *(UInt32*)theObjects[theSlot] = theTags[theSlot];
+                }
+            }
+            fTime = OS::Microseconds() - theStart;
+            
+            for (UInt32 y = 0; y < kNumLivePerThread; y++)
+            {
+                if ((theObjects[y] != NULL) && fUseSlab)
+                    sAllocator->Put(theObjects[y]);
+                else if (theObjects[y] != NULL)
+                    ::operator delete(theObjects[y]);
+            }
+        }
+        
+        UInt32  fIndex;
+        Bool16  fUseSlab;
+        UInt32  fNumOps;
+        Bool16  fCheck;
+        SInt64  fTime;
+};
+
+static SInt64 RunChurn(UInt32 inNumThreads, Bool16 inUseSlab, UInt32 inNumOps, Bool16 inCheck)
+{
+    ChurnThread* theThreads[kNumChurnThreads];
+    for (UInt32 x = 0; x < inNumThreads; x++)
+    {
+        theThreads[x] = new ChurnThread(x, inUseSlab, inNumOps);
+        theThreads[x]->fCheck = inCheck;
+        theThreads[x]->Start();
+    }
+    SInt64 theTime = 0;
+    for (UInt32 y = 0; y < inNumThreads; y++)
+    {
+        theThreads[y]->Join();
+        if (theThreads[y]->fTime > theTime)
+            theTime = theThreads[y]->fTime;
+        delete theThreads[y];
+    }
+    return theTime;
+}
+
+static void CheckChurn()
+{
+    UInt32 theNumInUse = sAllocator->GetNumObjectsInUse();
+    (void)RunChurn(kNumChurnThreads, true, kNumChurnOps, true);
+    TEST_CHECK(sAllocator->GetNumObjectsInUse() == theNumInUse);
+    
+    //Each thread holds at most kNumLivePerThread, and caches at most a few batches more
+    TEST_CHECK(sAllocator->GetTotalNumObjects() <= kNumChurnThreads * (kNumLivePerThread + 128) + 2048);
+}
+
+//
+// Benchmark: the churn above without the content checks
+static void RunBenchmark()
+{
+    enum { kNumBenchOps = 4000000 };
+    for (UInt32 theNumThreads = 1; theNumThreads <= kNumChurnThreads; theNumThreads *= 2)
+    {
+        SInt64 theHeapTime = RunChurn(theNumThreads, false, kNumBenchOps, false);
+        SInt64 theSlabTime = RunChurn(theNumThreads, true, kNumBenchOps, false);
+        ::printf("OSSlabAllocatorTest: %lu threads: operator new %.1fM ops/sec, slab %.1fM ops/sec\n", theNumThreads,
+                    ((Float64)kNumBenchOps * theNumThreads) / theHeapTime, ((Float64)kNumBenchOps * theNumThreads) / theSlabTime);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    sAllocator = new OSSlabAllocator("OSSlabAllocatorTest", kObjectSize);
+    
+    CheckGetAndPut();
+    CheckNewAndDelete();
+    CheckHandOff();
+    CheckChurn();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    return TestResult("OSSlabAllocatorTest");
+}
@@ -0,0 +1,485 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTAccessFileTest:
+//   Checks the pre-tokenized qtaccess rules against hand-worked answers for
+//   users, groups, actions and realm names, then runs the access file cache
+//   and AccessChecker's users and groups files over an in-memory file system
+//   served through the QTSS callbacks, so modification dates and clock can
+//   be moved at will. With -b, times checks on parsed rules against parsing
+//   the file every time, and profile lookups among many users.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "QTSS.h"
+#include "QTSS_Private.h"
+#include "QTAccessFile.h"
+#include "AccessChecker.h"
+#include "TestUtils.h"
+
+//
+// The in-memory file system. A file with NULL text doesn't exist.
+enum { kMaxTestFiles = 8 };
+
+struct TestFile
+{
+    const char*     fPath;
+    char*           fText;
+    QTSS_TimeVal    fModDate;
+};
+
+struct TestFileObject
+{
+    TestFile*       fFile;
+    UInt64          fLength;
+    QTSS_TimeVal    fModDate;
+    UInt32          fPosition;
+};
+
+static TestFile     sFiles[kMaxTestFiles];
+static UInt32       sNumFiles = 0;
+static SInt64       sNow = 1;
+static UInt32       sNumOpens = 0;
+static UInt32       sNumReads = 0;
+
+static TestFile* FindFile(const char* inPath)
+{
+    for (UInt32 x = 0; x < sNumFiles; x++)
+    {
+        if (::strcmp(sFiles[x].fPath, inPath) == 0)
+            return &sFiles[x];
+    }
+    return NULL;
+}
+
+static void WriteFile(const char* inPath, const char* inText, QTSS_TimeVal inModDate)
+{
+    TestFile* theFile = FindFile(inPath);
+    if (theFile == NULL)
+    {
+        Assert(sNumFiles < kMaxTestFiles);
+        theFile = &sFiles[sNumFiles++];
+        theFile->fPath = inPath;
+        theFile->fText = NULL;
+    }
+    delete [] theFile->fText;
+    theFile->fText = NULL;
+    if (inText != NULL)
+    {
+        theFile->fText = new char[::strlen(inText) + 1];
+        ::strcpy(theFile->fText, inText);
+    }
+    theFile->fModDate = inModDate;
+}
+
+static QTSS_Error TestMilliseconds(SInt64* outMilliseconds)
+{
+    *outMilliseconds = sNow;
+    return QTSS_NoErr;
+}
+
+static QTSS_Error TestOpenFileObject(char* inPath, QTSS_OpenFileFlags /*inFlags*/, QTSS_Object* outFileObject)
+{
+    TestFile* theFile = FindFile(inPath);
+    if ((theFile == NULL) || (theFile->fText == NULL))
+        return QTSS_FileNotFound;
+        
+    sNumOpens++;
+    TestFileObject* theObject = new TestFileObject;
+    theObject->fFile = theFile;
+    theObject->fLength = ::strlen(theFile->fText);
+    theObject->fModDate = theFile->fModDate;
+    theObject->fPosition = 0;
+    *outFileObject = (QTSS_Object)theObject;
+    return QTSS_NoErr;
+}
+
+static QTSS_Error TestGetValuePtr(QTSS_Object inObject, QTSS_AttributeID inID, UInt32 /*inIndex*/, void** outBuffer, UInt32* outLen)
+{
+    TestFileObject* theObject = (TestFileObject*)inObject;
+    if (inID == qtssFlObjModDate)
+    {
+        *outBuffer = &theObject->fModDate;
+        *outLen = sizeof(theObject->fModDate);
+    }
+    else if (inID == qtssFlObjLength)
+    {
+        *outBuffer = &theObject->fLength;
+        *outLen = sizeof(theObject->fLength);
+    }
+    else
+        return QTSS_BadArgument;
+    return QTSS_NoErr;
+}
+
+static QTSS_Error TestRead(QTSS_StreamRef inRef, void* ioBuffer, UInt32 inBufLen, UInt32* outLengthRead)
+{
+    TestFileObject* theObject = (TestFileObject*)inRef;
+    UInt32 theLength = (UInt32)theObject->fLength - theObject->fPosition;
+    if (theLength > inBufLen)
+        theLength = inBufLen;
+    ::memcpy(ioBuffer, theObject->fFile->fText + theObject->fPosition, theLength);
+    theObject->fPosition += theLength;
+    *outLengthRead = theLength;
+    sNumReads++;
+    return QTSS_NoErr;
+}
+
+static QTSS_Error TestCloseFileObject(QTSS_Object inObject)
+{
+    delete (TestFileObject*)inObject;
+    return QTSS_NoErr;
+}
+
+static QTSS_Error TestDispatch(QTSS_Role /*inRole*/, QTSS_RoleParamPtr /*inParams*/)
+{
+    return QTSS_NoErr;
+}
+
+static QTSS_Callbacks sCallbacks;
+
+static void SetupCallbacks()
+{
+    ::memset(&sCallbacks, 0, sizeof(sCallbacks));
+    sCallbacks.addr[kMillisecondsCallback] = (QTSS_CallbackProcPtr)&TestMilliseconds;
+    sCallbacks.addr[kOpenFileObjectCallback] = (QTSS_CallbackProcPtr)&TestOpenFileObject;
+    sCallbacks.addr[kGetAttributePtrByIDCallback] = (QTSS_CallbackProcPtr)&TestGetValuePtr;
+    sCallbacks.addr[kReadCallback] = (QTSS_CallbackProcPtr)&TestRead;
+    sCallbacks.addr[kCloseFileObjectCallback] = (QTSS_CallbackProcPtr)&TestCloseFileObject;
+    
+    QTSS_PrivateArgs theArgs;
+    ::memset(&theArgs, 0, sizeof(theArgs));
+    theArgs.inCallbacks = &sCallbacks;
+    (void)_stublibrary_main(&theArgs, &TestDispatch);
+}
+
+//
+// Rules
+static const char* sLimitFile =
+    "<Limit WRITE>\n"
+    "require user writer\n"
+    "AuthUserFile /write/users\n"
+    "</Limit>\n"
+    "require group admin staff\n"
+    "AuthScheme digest\n"
+    "AuthGroupFile \"/read/groups\"\n"
+    "AuthUserFile /old/users\n"
+    "AuthUserFile /read/users\n";
+
+static Bool16 Allowed(const char* inFile, const char* inUser, UInt32 inNumGroups, QTSS_ActionFlags inFlags)
+{
+    char* theGroups[] = { (char*)"guests", (char*)"staff" };
+    StrPtrLen theFile((char*)inFile);
+    QTAccessFileRules theRules(&theFile);
+    return theRules.AccessAllowed((char*)inUser, theGroups, inNumGroups, inFlags, NULL);
+}
+
+static void CheckRealm(const char* inFile, UInt32 inBufferLen, const char* inExpected)
+{
+    char theBuffer[64] = "unchanged";
+    StrPtrLen theRealm(theBuffer, inBufferLen);
+    StrPtrLen theFile((char*)inFile);
+    QTAccessFileRules theRules(&theFile);
+    (void)theRules.AccessAllowed((char*)"nobody", NULL, 0, qtssActionFlagsRead, &theRealm);
+    TEST_CHECK(::strcmp(theBuffer, inExpected) == 0);
+}
+
+static void CheckFind(QTSS_ActionFlags inAction, QTSS_AuthScheme inScheme, const char* inUsersFile, const char* inGroupsFile)
+{
+    StrPtrLen theFile((char*)sLimitFile);
+    QTAccessFileRules theRules(&theFile);
+    char* theUsersFile = NULL;
+    char* theGroupsFile = NULL;
+    TEST_CHECK(theRules.FindUsersAndGroupsFilesAndAuthScheme(inAction, &theUsersFile, &theGroupsFile) == inScheme);
+    TEST_CHECK((theUsersFile == NULL) == (inUsersFile == NULL));
+    TEST_CHECK((theUsersFile == NULL) || (::strcmp(theUsersFile, inUsersFile) == 0));
+    TEST_CHECK((theGroupsFile == NULL) == (inGroupsFile == NULL));
+    TEST_CHECK((theGroupsFile == NULL) || (::strcmp(theGroupsFile, inGroupsFile) == 0));
+    delete [] theUsersFile;
+    delete [] theGroupsFile;
+}
+
+static void TestRules()
+{
+    const char* theUserFile = "AuthName \"My Realm\"\nrequire user alice bob\n";
+    TEST_CHECK(Allowed(theUserFile, "alice", 0, qtssActionFlagsRead));
+    TEST_CHECK(Allowed(theUserFile, "bob", 0, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theUserFile, "carol", 2, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theUserFile, "ali", 0, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theUserFile, NULL, 0, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theUserFile, "alice", 0, qtssActionFlagsWrite));   //outside a Limit, only reads
+    CheckRealm(theUserFile, 64, "My Realm");
+    CheckRealm(theUserFile, 4, "My ");
+    CheckRealm("require any-user\n", 64, "");
+    CheckRealm("AuthName one\nAuthName two\n", 64, "two");
+    
+    TEST_CHECK(Allowed(sLimitFile, "writer", 0, qtssActionFlagsWrite));
+    TEST_CHECK(!Allowed(sLimitFile, "writer", 0, qtssActionFlagsRead));
+    TEST_CHECK(Allowed(sLimitFile, "reader", 2, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(sLimitFile, "reader", 1, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(sLimitFile, "reader", 2, qtssActionFlagsWrite));
+    TEST_CHECK(!Allowed(sLimitFile, NULL, 2, qtssActionFlagsRead));
+    CheckFind(qtssActionFlagsRead, qtssAuthDigest, "/read/users", "/read/groups");
+    CheckFind(qtssActionFlagsWrite, qtssAuthNone, "/write/users", NULL);
+    
+    const char* theAnyUserFile = "<Limit READ WRITE>\nrequire any-user\n</Limit>\n";
+    TEST_CHECK(Allowed(theAnyUserFile, NULL, 0, qtssActionFlagsRead));
+    TEST_CHECK(Allowed(theAnyUserFile, NULL, 0, qtssActionFlagsWrite));
+    
+    const char* theValidUserFile = "# comment\n\n   require valid-user\n";
+    TEST_CHECK(Allowed(theValidUserFile, "anyone", 0, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theValidUserFile, "", 0, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theValidUserFile, NULL, 0, qtssActionFlagsRead));
+    
+    const char* theEmptyNamesFile = "<Limit READ>\nrequire user\nrequire group\nAuthScheme foo\n";
+    TEST_CHECK(!Allowed(theEmptyNamesFile, "alice", 2, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed("", "alice", 2, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed("# only a comment\n", "alice", 2, qtssActionFlagsRead));
+    
+    const char* theCRLFFile = "require user  carol\t dave \r\nAuthName \"r2\"\r\nrequire group staff\r\n";
+    TEST_CHECK(Allowed(theCRLFFile, "dave", 0, qtssActionFlagsRead));
+    TEST_CHECK(Allowed(theCRLFFile, "zed", 2, qtssActionFlagsRead));
+    TEST_CHECK(!Allowed(theCRLFFile, "zed", 1, qtssActionFlagsRead));
+    CheckRealm(theCRLFFile, 64, "r2");
+}
+
+//
+// Access file cache
+static Bool16 CachedAllowed(const char* inUser, char** outAccessFilePath)
+{
+    QTAccessFileRules* theRules = QTAccessFile::GetAccessFileRules("/movies", "/movies/a/b/x.mov", outAccessFilePath);
+    Bool16 theAllowed = (theRules != NULL) && theRules->AccessAllowed((char*)inUser, NULL, 0, qtssActionFlagsRead, NULL);
+    QTAccessFile::ReleaseAccessFileRules(theRules);
+    return theAllowed;
+}
+
+static void TestAccessFileCache()
+{
+    WriteFile("/movies/a/qtaccess", "require user alice\n", 1000);
+    
+    //Found in the parent directory, and read only once while the entry is fresh
+    char* theAccessFilePath = NULL;
+    TEST_CHECK(CachedAllowed("alice", &theAccessFilePath));
+    TEST_CHECK((theAccessFilePath != NULL) && (::strcmp(theAccessFilePath, "/movies/a/qtaccess") == 0));
+    delete [] theAccessFilePath;
+    UInt32 theNumOpens = sNumOpens;
+    for (UInt32 x = 0; x < 1000; x++)
+        TEST_CHECK(CachedAllowed("alice", NULL));
+    TEST_CHECK(sNumOpens == theNumOpens);
+    
+    //A changed file is only noticed once the check interval has passed. Rules
+    //a request is still holding stay usable after they are replaced.
+    QTAccessFileRules* theOldRules = QTAccessFile::GetAccessFileRules("/movies", "/movies/a/b/x.mov", NULL);
+    WriteFile("/movies/a/qtaccess", "require user bob\n", 2000);
+    TEST_CHECK(!CachedAllowed("bob", NULL));
+    sNow += 1000;
+    TEST_CHECK(CachedAllowed("bob", NULL));
+    TEST_CHECK(!CachedAllowed("alice", NULL));
+    TEST_CHECK(theOldRules->AccessAllowed((char*)"alice", NULL, 0, qtssActionFlagsRead, NULL));
+    QTAccessFile::ReleaseAccessFileRules(theOldRules);
+    
+    //An unchanged file is stat'ed again, but not read or parsed again
+    sNow += 1000;
+    theNumOpens = sNumOpens;
+    UInt32 theNumReads = sNumReads;
+    TEST_CHECK(CachedAllowed("bob", NULL));
+    TEST_CHECK(sNumOpens > theNumOpens);
+    TEST_CHECK(sNumReads == theNumReads);
+    
+    //A file added nearer the movie takes over
+    WriteFile("/movies/a/b/qtaccess", "require user carol\n", 3000);
+    sNow += 1000;
+    TEST_CHECK(CachedAllowed("carol", &theAccessFilePath));
+    TEST_CHECK((theAccessFilePath != NULL) && (::strcmp(theAccessFilePath, "/movies/a/b/qtaccess") == 0));
+    delete [] theAccessFilePath;
+    
+    //And with both gone, there are no rules
+    WriteFile("/movies/a/b/qtaccess", NULL, 0);
+    WriteFile("/movies/a/qtaccess", NULL, 0);
+    sNow += 1000;
+    TEST_CHECK(QTAccessFile::GetAccessFileRules("/movies", "/movies/a/b/x.mov", NULL) == NULL);
+    
+    //The static lookup by path goes through the same cache
+    WriteFile("/movies/a/qtaccess", "AuthUserFile /u\nAuthScheme basic\n", 4000);
+    sNow += 1000;
+    char* theUsersFile = NULL;
+    char* theGroupsFile = NULL;
+    TEST_CHECK(QTAccessFile::FindUsersAndGroupsFilesAndAuthScheme((char*)"/movies/a/qtaccess", qtssActionFlagsRead, &theUsersFile, &theGroupsFile) == qtssAuthBasic);
+    TEST_CHECK((theUsersFile != NULL) && (::strcmp(theUsersFile, "/u") == 0));
+    TEST_CHECK(theGroupsFile == NULL);
+    delete [] theUsersFile;
+    
+    //Renaming the access file flushes the cache
+    WriteFile("/movies/a/.access", "require user dave\n", 5000);
+    QTAccessFile::SetAccessFileName(".access");
+    TEST_CHECK(CachedAllowed("dave", NULL));
+    QTAccessFile::SetAccessFileName("qtaccess");
+}
+
+//
+// Users and groups
+enum { kNumUsers = 5000 };
+
+static char* MakeUsersFile(UInt32 inNumUsers)
+{
+    char* theText = new char[(inNumUsers * 32) + 64];
+    char* theEnd = theText + qtss_sprintf(theText, "realm Streaming Server\n");
+    for (UInt32 x = 0; x < inNumUsers; x++)
+        theEnd += qtss_sprintf(theEnd, "user%lu:crypt%lu:digest%lu\n", x, x, x);
+    theEnd += qtss_sprintf(theEnd, "user7:duplicate:duplicate\n");
+    return theText;
+}
+
+static void TestAccessChecker()
+{
+    char* theUsers = MakeUsersFile(kNumUsers);
+    WriteFile("/etc/users", theUsers, 1000);
+    WriteFile("/etc/groups", "admin: user1 user7 nobody user4999\nstaff: user7 \n", 1000);
+    
+    AccessChecker theChecker;
+    theChecker.UpdateFilePaths("/etc/users", "/etc/groups");
+    TEST_CHECK(theChecker.UpdateUserProfiles() == AccessChecker::kNoErr);
+    TEST_CHECK(theChecker.GetAuthRealm()->Equal("Streaming Server"));
+    
+    //The first of two entries for a name wins, as with the old linear search
+    StrPtrLen theName((char*)"user7");
+    AccessChecker::UserProfile* theProfile = theChecker.RetrieveUserProfile(&theName);
+    TEST_CHECK((theProfile != NULL) && theProfile->cryptPassword.Equal("crypt7"));
+    TEST_CHECK((theProfile != NULL) && (theProfile->numGroups == 2));
+    TEST_CHECK((theProfile != NULL) && (theProfile->numGroups == 2) && (::strcmp(theProfile->groups[0], "admin") == 0) && (::strcmp(theProfile->groups[1], "staff") == 0));
+    
+    theName.Set((char*)"user4999");
+    theProfile = theChecker.RetrieveUserProfile(&theName);
+    TEST_CHECK((theProfile != NULL) && theProfile->digestPassword.Equal("digest4999") && (theProfile->numGroups == 1));
+    theName.Set((char*)"user0");
+    theProfile = theChecker.RetrieveUserProfile(&theName);
+    TEST_CHECK((theProfile != NULL) && (theProfile->numGroups == 0));
+    theName.Set((char*)"nobody");
+    TEST_CHECK(theChecker.RetrieveUserProfile(&theName) == NULL);
+    theName.Set((char*)"user");
+    TEST_CHECK(theChecker.RetrieveUserProfile(&theName) == NULL);
+    
+    //The files are only looked at again once the check interval has passed
+    UInt32 theNumOpens = sNumOpens;
+    for (UInt32 x = 0; x < 100; x++)
+        (void)theChecker.UpdateUserProfiles();
+    TEST_CHECK(sNumOpens == theNumOpens);
+    
+    WriteFile("/etc/groups", "staff: user3\n", 2000);
+    sNow += 1000;
+    TEST_CHECK(theChecker.UpdateUserProfiles() == AccessChecker::kNoErr);
+    TEST_CHECK(sNumOpens > theNumOpens);
+    theName.Set((char*)"user7");
+    theProfile = theChecker.RetrieveUserProfile(&theName);
+    TEST_CHECK((theProfile != NULL) && (theProfile->numGroups == 0));
+    theName.Set((char*)"user3");
+    theProfile = theChecker.RetrieveUserProfile(&theName);
+    TEST_CHECK((theProfile != NULL) && (theProfile->numGroups == 1));
+    
+    //Without a users file there are no profiles
+    WriteFile("/etc/users", NULL, 0);
+    sNow += 1000;
+    TEST_CHECK(theChecker.UpdateUserProfiles() & AccessChecker::kUsersFileNotFoundErr);
+    TEST_CHECK(theChecker.RetrieveUserProfile(&theName) == NULL);
+    
+    delete [] theUsers;
+}
+
+//
+// Benchmarks
+enum { kNumBenchChecks = 100000 };
+
+static void BenchmarkRules()
+{
+    //A typical file: a realm, a few users and a group, with the user last
+    StrPtrLen theFile((char*)"# Streaming access\nAuthName \"Streaming Server\"\nAuthScheme digest\n"
+                            "require user alice bob carol dave erin frank\nrequire group staff\nrequire user mallory\n");
+    char theRealmBuffer[64];
+    StrPtrLen theRealm(theRealmBuffer, sizeof(theRealmBuffer));
+    UInt32 theNumAllowed = 0;
+    
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchChecks; x++)
+        theNumAllowed += QTAccessFile::AccessAllowed((char*)"mallory", NULL, 0, &theFile, qtssActionFlagsRead, &theRealm);
+    SInt64 theParseTime = OS::Microseconds() - theStart;
+    
+    QTAccessFileRules theRules(&theFile);
+    theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchChecks; x++)
+        theNumAllowed += theRules.AccessAllowed((char*)"mallory", NULL, 0, qtssActionFlagsRead, &theRealm);
+    SInt64 theRulesTime = OS::Microseconds() - theStart;
+    
+    TEST_CHECK(theNumAllowed == 2 * kNumBenchChecks);
+    ::printf("QTAccessFileTest: %.1f ns per check, parsing the file every time\n", (theParseTime * 1000.0) / kNumBenchChecks);
+    ::printf("QTAccessFileTest: %.1f ns per check on parsed rules\n", (theRulesTime * 1000.0) / kNumBenchChecks);
+}
+
+static void BenchmarkProfiles()
+{
+    char* theUsers = MakeUsersFile(kNumUsers);
+    WriteFile("/etc/users", theUsers, 10000);
+    WriteFile("/etc/groups", "staff: user3\n", 10000);
+    sNow += 1000;
+    AccessChecker theChecker;
+    theChecker.UpdateFilePaths("/etc/users", "/etc/groups");
+    (void)theChecker.UpdateUserProfiles();
+    
+    char theNameBuffer[32];
+    UInt32 theNumFound = 0;
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchChecks; x++)
+    {
+        StrPtrLen theName(theNameBuffer, qtss_sprintf(theNameBuffer, "user%lu", (x * 7919) % kNumUsers));
+        theNumFound += (theChecker.RetrieveUserProfile(&theName) != NULL);
+    }
+    SInt64 theTime = OS::Microseconds() - theStart;
+    
+    TEST_CHECK(theNumFound == kNumBenchChecks);
+    ::printf("QTAccessFileTest: %.1f ns per profile lookup among %lu users\n", (theTime * 1000.0) / kNumBenchChecks, (UInt32)kNumUsers);
+    delete [] theUsers;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    SetupCallbacks();
+    QTAccessFile::Initialize();
+    
+    TestRules();
+    TestAccessFileCache();
+    TestAccessChecker();
+    
+    if (TestWantsBenchmarks(argc, argv))
+    {
+        BenchmarkRules();
+        BenchmarkProfiles();
+    }
+    
+    return TestResult("QTAccessFileTest");
+}
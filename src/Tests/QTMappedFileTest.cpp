@@ -0,0 +1,320 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTMappedFileTest:
+//   Maps small files through the shared mapped file cache: one mapping per
+//   file however many hold it, unused mappings kept until the limit is hit
+//   and then unmapped least recently used first, a fresh mapping for a file
+//   replaced while the old one is still held, and no mapping at all when
+//   the held ones leave no room. A movie that doesn't fit must still open
+//   and read the same through its file.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+//QTFileLib's external library, which this links, is built without the API callbacks,
+//and QTFile's members must match it
+#undef DSS_USE_API_CALLBACKS
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "QTFile.h"
+#include "QTFile_FileControlBlock.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumFiles = 3,
+    kCacheBytes = 1024 * 1024,      //UInt64
+    kSmallCacheBytes = 100 * 1024,  //UInt64. holds A and B, or A and C, but not all three
+    kMovieCacheBytes = 4 * 1024 * 1024, //UInt64
+    kReadLength = 4096              //UInt32
+};
+
+enum { kFileA = 0, kFileB = 1, kFileC = 2 };
+
+static const UInt64 sFileLengths[kNumFiles] = { 40 * 1024, 56 * 1024, 40 * 1024 };
+static char sPaths[kNumFiles][64];
+static char sEmptyPath[64];
+
+static const char* sMovie = "../sample_100kbit.mov";
+
+static char FileByte(UInt32 inVersion, UInt64 inPosition)
+{
+    return (char)((inVersion * 31) + (inPosition % 251));
+}
+
+//
+// Writes the file somewhere else and moves it into place, the way a new
+// version of a movie gets published, so the path gets a new file.
+static void WriteFile(const char* inPath, UInt64 inLength, UInt32 inVersion)
+{
+    char theTempPath[80];
+    qtss_sprintf(theTempPath, "%s.new", inPath);
+    FILE* theFile = ::fopen(theTempPath, "wb");
+    TEST_CHECK(theFile != NULL);
+    if (theFile == NULL)
+        return;
+    for (UInt64 x = 0; x < inLength; x++)
+        (void)::fputc(FileByte(inVersion, x), theFile);
+    ::fclose(theFile);
+    TEST_CHECK(::rename(theTempPath, inPath) == 0);
+}
+
+static Bool16 HasContents(QTFile_MappedFile* inFile, UInt64 inLength, UInt32 inVersion)
+{
+    if ((inFile == NULL) || (inFile->GetLength() != inLength))
+        return false;
+    
+    const char* theData = inFile->GetData(0, (UInt32)inLength);
+    if (theData == NULL)
+        return false;
+    for (UInt64 x = 0; x < inLength; x++)
+    {
+        if (theData[x] != FileByte(inVersion, x))
+            return false;
+    }
+    
+    char theBuffer[kReadLength];
+    if (!inFile->Read(inLength - kReadLength, theBuffer, kReadLength))
+        return false;
+    return ::memcmp(theBuffer, theData + inLength - kReadLength, kReadLength) == 0;
+}
+
+static Bool16 CacheHolds(UInt32 inNumFiles, UInt64 inNumMappedBytes)
+{
+    UInt32 theNumFiles = 0;
+    UInt64 theNumMappedBytes = 0;
+    QTFile_MappedFile::GetCacheStats(&theNumFiles, &theNumMappedBytes);
+    return (theNumFiles == inNumFiles) && (theNumMappedBytes == inNumMappedBytes);
+}
+
+static void SetUp(UInt64 inMaxMappedBytes)
+{
+    for (UInt32 x = 0; x < kNumFiles; x++)
+        WriteFile(sPaths[x], sFileLengths[x], x);
+    QTFile_MappedFile::SetCacheParams(true, inMaxMappedBytes);
+}
+
+static void TearDown()
+{
+    //Dropping the limit unmaps everything no one holds
+    QTFile_MappedFile::SetCacheParams(true, 0);
+    TEST_CHECK(CacheHolds(0, 0));
+}
+
+static void CheckSharing()
+{
+    SetUp(kCacheBytes);
+    const UInt64 theLength = sFileLengths[kFileA];
+    
+    //Nothing is mapped while the cache is off
+    QTFile_MappedFile::SetCacheParams(false, kCacheBytes);
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileA]) == NULL);
+    QTFile_MappedFile::SetCacheParams(true, kCacheBytes);
+    
+    //or for files that aren't there or are empty
+    TEST_CHECK(QTFile_MappedFile::Acquire("/tmp/QTMappedFileTest.missing") == NULL);
+    TEST_CHECK(QTFile_MappedFile::Acquire(sEmptyPath) == NULL);
+    TEST_CHECK(CacheHolds(0, 0));
+    
+    QTFile_MappedFile* theFirst = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    QTFile_MappedFile* theSecond = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    TEST_CHECK(theFirst != NULL);
+    TEST_CHECK(theFirst == theSecond);
+    TEST_CHECK(HasContents(theFirst, theLength, kFileA));
+    TEST_CHECK(CacheHolds(1, theLength));
+    
+    //Nothing past the end
+    char theBuffer[kReadLength];
+    if (theFirst != NULL)
+    {
+        TEST_CHECK(!theFirst->Read(theLength - 10, theBuffer, 11));
+        TEST_CHECK(!theFirst->Read(theLength + 1, theBuffer, 0));
+        TEST_CHECK(theFirst->GetData(theLength - 10, 11) == NULL);
+        TEST_CHECK(theFirst->GetData(theLength - 10, 10) != NULL);
+    }
+    
+    //Once no one holds it, it stays mapped for the next one to ask
+    QTFile_MappedFile::Release(theFirst);
+    QTFile_MappedFile::Release(theSecond);
+    TEST_CHECK(CacheHolds(1, theLength));
+    QTFile_MappedFile* theThird = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    TEST_CHECK(theThird == theFirst);
+    TEST_CHECK(HasContents(theThird, theLength, kFileA));
+    QTFile_MappedFile::Release(theThird);
+    
+    TearDown();
+}
+
+static void CheckLRUEviction()
+{
+    SetUp(kSmallCacheBytes);
+    
+    QTFile_MappedFile* theFileA = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    QTFile_MappedFile::Release(theFileA);
+    QTFile_MappedFile::Release(QTFile_MappedFile::Acquire(sPaths[kFileB]));
+    TEST_CHECK(CacheHolds(2, sFileLengths[kFileA] + sFileLengths[kFileB]));
+    
+    //
+    // A was mapped first but used last, so C takes B's room. Taking A's
+    // would leave B and C mapped instead, which is more bytes.
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileA]) == theFileA);
+    QTFile_MappedFile::Release(theFileA);
+    QTFile_MappedFile* theFileC = QTFile_MappedFile::Acquire(sPaths[kFileC]);
+    TEST_CHECK(HasContents(theFileC, sFileLengths[kFileC], kFileC));
+    TEST_CHECK(CacheHolds(2, sFileLengths[kFileA] + sFileLengths[kFileC]));
+    QTFile_MappedFile::Release(theFileC);
+    
+    //A is still the same mapping
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileA]) == theFileA);
+    TEST_CHECK(HasContents(theFileA, sFileLengths[kFileA], kFileA));
+    QTFile_MappedFile::Release(theFileA);
+    
+    TearDown();
+}
+
+static void CheckReplacedFile()
+{
+    SetUp(kCacheBytes);
+    const UInt64 theLength = sFileLengths[kFileA];
+    
+    QTFile_MappedFile* theOldFile = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    TEST_CHECK(HasContents(theOldFile, theLength, kFileA));
+    
+    //
+    // A new version of the same length. Whoever asks now gets it, while
+    // the holder of the old one still reads the old one.
+    WriteFile(sPaths[kFileA], theLength, kNumFiles);
+    QTFile_MappedFile* theNewFile = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    TEST_CHECK(theNewFile != NULL);
+    TEST_CHECK(theNewFile != theOldFile);
+    TEST_CHECK(HasContents(theNewFile, theLength, kNumFiles));
+    TEST_CHECK(HasContents(theOldFile, theLength, kFileA));
+    TEST_CHECK(CacheHolds(2, 2 * theLength));
+    
+    //
+    // The old one is unmapped the next time the path is looked up after its
+    // last holder lets go
+    QTFile_MappedFile::Release(theOldFile);
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileA]) == theNewFile);
+    TEST_CHECK(CacheHolds(1, theLength));
+    QTFile_MappedFile::Release(theNewFile);
+    QTFile_MappedFile::Release(theNewFile);
+    
+    TearDown();
+}
+
+static void CheckOverBudget()
+{
+    SetUp(kSmallCacheBytes);
+    
+    //
+    // With A and B held there is no room for C, and nothing that can be
+    // unmapped to make some. A is still shared.
+    QTFile_MappedFile* theFileA = QTFile_MappedFile::Acquire(sPaths[kFileA]);
+    QTFile_MappedFile* theFileB = QTFile_MappedFile::Acquire(sPaths[kFileB]);
+    TEST_CHECK((theFileA != NULL) && (theFileB != NULL));
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileC]) == NULL);
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileA]) == theFileA);
+    QTFile_MappedFile::Release(theFileA);
+    TEST_CHECK(CacheHolds(2, sFileLengths[kFileA] + sFileLengths[kFileB]));
+    
+    QTFile_MappedFile::Release(theFileB);
+    QTFile_MappedFile* theFileC = QTFile_MappedFile::Acquire(sPaths[kFileC]);
+    TEST_CHECK(HasContents(theFileC, sFileLengths[kFileC], kFileC));
+    TEST_CHECK(CacheHolds(2, sFileLengths[kFileA] + sFileLengths[kFileC]));
+    
+    //
+    // Lowering the limit leaves held mappings alone, and they go as soon as
+    // they are let go
+    QTFile_MappedFile::SetCacheParams(true, 0);
+    TEST_CHECK(CacheHolds(2, sFileLengths[kFileA] + sFileLengths[kFileC]));
+    TEST_CHECK(QTFile_MappedFile::Acquire(sPaths[kFileB]) == NULL);
+    TEST_CHECK(HasContents(theFileA, sFileLengths[kFileA], kFileA));
+    QTFile_MappedFile::Release(theFileA);
+    QTFile_MappedFile::Release(theFileC);
+    TEST_CHECK(CacheHolds(0, 0));
+}
+
+//
+// A movie too big for the cache reads from its file instead, and gets the
+// same bytes as one that is mapped
+static void CheckMovieFallback()
+{
+    QTFile_MappedFile::SetCacheParams(true, kSmallCacheBytes);
+    QTFile* theUnmapped = new QTFile();
+    TEST_CHECK(theUnmapped->Open(sMovie) == QTFile::errNoError);
+    TEST_CHECK(!theUnmapped->IsMapped());
+    TEST_CHECK(CacheHolds(0, 0));
+    
+    QTFile_MappedFile::SetCacheParams(true, kMovieCacheBytes);
+    QTFile* theMapped = new QTFile();
+    TEST_CHECK(theMapped->Open(sMovie) == QTFile::errNoError);
+    TEST_CHECK(theMapped->IsMapped());
+    TEST_CHECK(theMapped->GetDurationInSeconds() == theUnmapped->GetDurationInSeconds());
+    
+    const UInt64 theOffsets[] = { 0, 123457, 1000000 };
+    for (UInt32 x = 0; x < sizeof(theOffsets) / sizeof(theOffsets[0]); x++)
+    {
+        char theUnmappedData[kReadLength];
+        char theMappedData[kReadLength];
+        const char* theReference = NULL;
+        TEST_CHECK(theUnmapped->Read(theOffsets[x], theUnmappedData, kReadLength));
+        TEST_CHECK(theMapped->Read(theOffsets[x], theMappedData, kReadLength));
+        TEST_CHECK(::memcmp(theUnmappedData, theMappedData, kReadLength) == 0);
+        TEST_CHECK(!theUnmapped->Reference(theOffsets[x], kReadLength, &theReference));
+        TEST_CHECK(theMapped->Reference(theOffsets[x], kReadLength, &theReference));
+        TEST_CHECK((theReference != NULL) && (::memcmp(theReference, theMappedData, kReadLength) == 0));
+    }
+    
+    delete theUnmapped;
+    delete theMapped;
+    TearDown();
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    
+    for (UInt32 x = 0; x < kNumFiles; x++)
+        qtss_sprintf(sPaths[x], "/tmp/QTMappedFileTest.%d.%c", (int)::getpid(), 'a' + x);
+    qtss_sprintf(sEmptyPath, "/tmp/QTMappedFileTest.%d.empty", (int)::getpid());
+    WriteFile(sEmptyPath, 0, 0);
+    
+    CheckSharing();
+    CheckLRUEviction();
+    CheckReplacedFile();
+    CheckOverBudget();
+    CheckMovieFallback();
+    
+    for (UInt32 y = 0; y < kNumFiles; y++)
+        (void)::unlink(sPaths[y]);
+    (void)::unlink(sEmptyPath);
+    return TestResult("QTMappedFileTest");
+}
@@ -0,0 +1,366 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPCacheFileTest:
+//   Writes small RTP cache files and reads them back through QTRTPCacheFile:
+//   every packet of a good file, and files with a wrong header, tables that
+//   run off the end, or packets that do. Every truncation of a good file
+//   must either fail to open or only hand out packets that are all there.
+//   With -b, times packet lookups.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "QTRTPCacheFile.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumTracks = 2,
+    kMaxSamples = 4,
+    kMaxPackets = 8,
+    kMaxFileSize = 4096,
+    kMovieModDate = 1234567890
+};
+
+static const char* sCachePath = "/tmp/QTRTPCacheFileTest.rtpcache";
+
+//
+// Two hint tracks; the first has a sample with no packets. Packets are
+// numbered across the file: packet 1 is a repeat, 2 is B-frame data, and 4
+// couldn't be built.
+static const UInt32 sTrackIDs[kNumTracks] = { 3, 5 };
+static const UInt32 sNumSamples[kNumTracks] = { 4, 1 };
+static const UInt32 sPacketsPerSample[kNumTracks][kMaxSamples] = { { 2, 0, 3, 1 }, { 1 } };
+
+static char     sFile[kMaxFileSize];
+static UInt32   sFileLength = 0;
+static UInt32   sTrackHeaderOffsets[kNumTracks];
+static UInt32   sSampleTableOffsets[kNumTracks];
+static UInt32   sPacketTableOffsets[kNumTracks];
+static UInt32   sPacketDataOffsets[kMaxPackets];
+static UInt32   sNumPackets = 0;
+
+static UInt16 PacketLength(UInt32 inPacket)     { return (UInt16)(12 + (7 * inPacket)); }
+static Float64 PacketTime(UInt32 inPacket)      { return 0.25 * inPacket; }
+static char PacketByte(UInt32 inPacket)         { return (char)(0x40 + inPacket); }
+
+static UInt16 PacketFlags(UInt32 inPacket)
+{
+    if (inPacket == 1)
+        return QTRTPCacheTrack::kRepeatPacket;
+    if (inPacket == 2)
+        return QTRTPCacheTrack::kBFramePacket;
+    if (inPacket == 4)
+        return QTRTPCacheTrack::kUncachedPacket;
+    return 0;
+}
+
+static void WriteUInt16(UInt32 inOffset, UInt16 inValue)
+{
+    inValue = htons(inValue);
+    ::memcpy(&sFile[inOffset], &inValue, sizeof(inValue));
+}
+
+static void WriteUInt32(UInt32 inOffset, UInt32 inValue)
+{
+    UInt32 theValue = htonl(inValue);
+    ::memcpy(&sFile[inOffset], &theValue, 4);
+}
+
+static void WriteUInt64(UInt32 inOffset, UInt64 inValue)
+{
+    SInt64 theValue = OS::HostToNetworkSInt64((SInt64)inValue);
+    ::memcpy(&sFile[inOffset], &theValue, sizeof(theValue));
+}
+
+static void WriteFloat64(UInt32 inOffset, Float64 inValue)
+{
+    UInt64 theBits;
+    ::memcpy(&theBits, &inValue, sizeof(theBits));
+    WriteUInt64(inOffset, theBits);
+}
+
+//
+// Lays out the file as QTRTPCacheGen does: header, track headers, each
+// track's sample and packet tables, then the packet data.
+static void BuildFile()
+{
+    ::memset(sFile, 0, sizeof(sFile));
+    UInt32 theOffset = QTRTPCacheFile::kFileHeaderSize + (kNumTracks * QTRTPCacheFile::kTrackHeaderSize);
+    UInt32 theNumTablePackets[kNumTracks];
+    for (UInt32 theTrack = 0; theTrack < kNumTracks; theTrack++)
+    {
+        theNumTablePackets[theTrack] = 0;
+        for (UInt32 theSample = 0; theSample < sNumSamples[theTrack]; theSample++)
+            theNumTablePackets[theTrack] += sPacketsPerSample[theTrack][theSample];
+            
+        sTrackHeaderOffsets[theTrack] = QTRTPCacheFile::kFileHeaderSize + (theTrack * QTRTPCacheFile::kTrackHeaderSize);
+        sSampleTableOffsets[theTrack] = theOffset;
+        theOffset += sNumSamples[theTrack] * QTRTPCacheFile::kSampleEntrySize;
+        sPacketTableOffsets[theTrack] = theOffset;
+        theOffset += theNumTablePackets[theTrack] * QTRTPCacheFile::kPacketEntrySize;
+    }
+    
+    WriteUInt32(0, QTRTPCacheFile::kFileType);
+    WriteUInt32(4, QTRTPCacheFile::kFileVersion);
+    WriteUInt64(8, kMovieModDate);
+    WriteUInt32(16, kNumTracks);
+    
+    sNumPackets = 0;
+    for (UInt32 theTrack = 0; theTrack < kNumTracks; theTrack++)
+    {
+        UInt32 theHeader = sTrackHeaderOffsets[theTrack];
+        WriteUInt32(theHeader, sTrackIDs[theTrack]);
+        WriteUInt32(theHeader + 4, sNumSamples[theTrack]);
+        WriteUInt32(theHeader + 8, theNumTablePackets[theTrack]);
+        WriteUInt64(theHeader + 16, sSampleTableOffsets[theTrack]);
+        WriteUInt64(theHeader + 24, sPacketTableOffsets[theTrack]);
+        
+        UInt32 theTrackPacket = 0;
+        for (UInt32 theSample = 0; theSample < sNumSamples[theTrack]; theSample++)
+        {
+            UInt32 theSampleEntry = sSampleTableOffsets[theTrack] + (theSample * QTRTPCacheFile::kSampleEntrySize);
+            WriteUInt32(theSampleEntry, theTrackPacket);
+            WriteUInt32(theSampleEntry + 4, sPacketsPerSample[theTrack][theSample]);
+            
+            for (UInt32 x = 0; x < sPacketsPerSample[theTrack][theSample]; x++, theTrackPacket++, sNumPackets++)
+            {
+                UInt32 thePacketEntry = sPacketTableOffsets[theTrack] + (theTrackPacket * QTRTPCacheFile::kPacketEntrySize);
+                sPacketDataOffsets[sNumPackets] = theOffset;
+                WriteFloat64(thePacketEntry, PacketTime(sNumPackets));
+                WriteUInt64(thePacketEntry + 8, theOffset);
+                WriteUInt16(thePacketEntry + 16, PacketLength(sNumPackets));
+                WriteUInt16(thePacketEntry + 18, PacketFlags(sNumPackets));
+                ::memset(&sFile[theOffset], PacketByte(sNumPackets), PacketLength(sNumPackets));
+                theOffset += PacketLength(sNumPackets);
+            }
+        }
+    }
+    sFileLength = theOffset;
+}
+
+static void SaveFile(UInt32 inLength)
+{
+    int theFD = ::open(sCachePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(theFD != -1);
+    TEST_CHECK(::write(theFD, sFile, inLength) == (ssize_t)inLength);
+    (void)::close(theFD);
+}
+
+//
+// Looks up every packet of every track, and one past either end of each
+// sample and track. Packets whose data isn't all in the first inLength
+// bytes must not be handed out.
+static void CheckPackets(QTRTPCacheFile* inFile, UInt32 inLength)
+{
+    TEST_CHECK(inFile->FindTrack(4) == NULL);
+    
+    UInt32 thePacket = 0;
+    for (UInt32 theTrack = 0; theTrack < kNumTracks; theTrack++)
+    {
+        QTRTPCacheTrack* theCacheTrack = inFile->FindTrack(sTrackIDs[theTrack]);
+        TEST_CHECK(theCacheTrack != NULL);
+        if (theCacheTrack == NULL)
+            return;
+            
+        UInt16 theNumPackets = 0;
+        const char* theData = NULL;
+        UInt32 theLength = 0;
+        Float64 theTime = 0;
+        UInt16 theFlags = 0;
+        TEST_CHECK(!theCacheTrack->GetNumPackets(0, &theNumPackets));
+        TEST_CHECK(!theCacheTrack->GetNumPackets(sNumSamples[theTrack] + 1, &theNumPackets));
+        TEST_CHECK(!theCacheTrack->GetPacket(0, 1, &theData, &theLength, &theTime, &theFlags));
+        TEST_CHECK(!theCacheTrack->GetPacket(sNumSamples[theTrack] + 1, 1, &theData, &theLength, &theTime, &theFlags));
+        
+        for (UInt32 theSample = 1; theSample <= sNumSamples[theTrack]; theSample++)
+        {
+            UInt32 theExpectedNumPackets = sPacketsPerSample[theTrack][theSample - 1];
+            TEST_CHECK(theCacheTrack->GetNumPackets(theSample, &theNumPackets));
+            TEST_CHECK(theNumPackets == theExpectedNumPackets);
+            TEST_CHECK(!theCacheTrack->GetPacket(theSample, 0, &theData, &theLength, &theTime, &theFlags));
+            TEST_CHECK(!theCacheTrack->GetPacket(theSample, (UInt16)(theExpectedNumPackets + 1), &theData, &theLength, &theTime, &theFlags));
+            
+            for (UInt32 x = 1; x <= theExpectedNumPackets; x++, thePacket++)
+            {
+                Bool16 theExpectedResult = ((PacketFlags(thePacket) & QTRTPCacheTrack::kUncachedPacket) == 0)
+                                            && (sPacketDataOffsets[thePacket] + PacketLength(thePacket) <= inLength);
+                Bool16 theResult = theCacheTrack->GetPacket(theSample, (UInt16)x, &theData, &theLength, &theTime, &theFlags);
+                TEST_CHECK(theResult == theExpectedResult);
+                if (!theResult)
+                    continue;
+                    
+                TEST_CHECK(theLength == PacketLength(thePacket));
+                TEST_CHECK(theTime == PacketTime(thePacket));
+                TEST_CHECK(theFlags == PacketFlags(thePacket));
+                TEST_CHECK((theData[0] == PacketByte(thePacket)) && (theData[theLength - 1] == PacketByte(thePacket)));
+            }
+        }
+    }
+    TEST_CHECK(thePacket == sNumPackets);
+}
+
+static void TestGoodFile()
+{
+    char* theCachePath = QTRTPCacheFile::GetCacheFilePath("/movies/sample.mov");
+    TEST_CHECK(::strcmp(theCachePath, "/movies/sample.mov.rtpcache") == 0);
+    delete [] theCachePath;
+    
+    BuildFile();
+    SaveFile(sFileLength);
+    QTRTPCacheFile* theFile = QTRTPCacheFile::Open(sCachePath, kMovieModDate);
+    TEST_CHECK(theFile != NULL);
+    if (theFile != NULL)
+        CheckPackets(theFile, sFileLength);
+    delete theFile;
+    
+    //A cache of an older copy of the movie
+    TEST_CHECK(QTRTPCacheFile::Open(sCachePath, kMovieModDate + 1) == NULL);
+    TEST_CHECK(QTRTPCacheFile::Open("/tmp/QTRTPCacheFileTest.missing", kMovieModDate) == NULL);
+}
+
+//
+// Damaged headers and tables must keep the file from opening.
+static void CheckDamagedHeader(UInt32 inOffset, UInt32 inValue)
+{
+    BuildFile();
+    WriteUInt32(inOffset, inValue);
+    SaveFile(sFileLength);
+    QTRTPCacheFile* theFile = QTRTPCacheFile::Open(sCachePath, kMovieModDate);
+    TEST_CHECK(theFile == NULL);
+    delete theFile;
+}
+
+//
+// Damaged sample and packet entries must keep the lookup from succeeding.
+static void CheckDamagedEntry(UInt32 inOffset, UInt32 inValue, UInt32 inSample, UInt16 inPacket)
+{
+    BuildFile();
+    WriteUInt32(inOffset, inValue);
+    SaveFile(sFileLength);
+    QTRTPCacheFile* theFile = QTRTPCacheFile::Open(sCachePath, kMovieModDate);
+    TEST_CHECK(theFile != NULL);
+    if (theFile == NULL)
+        return;
+        
+    QTRTPCacheTrack* theCacheTrack = theFile->FindTrack(sTrackIDs[0]);
+    UInt16 theNumPackets = 0;
+    const char* theData = NULL;
+    UInt32 theLength = 0;
+    Float64 theTime = 0;
+    UInt16 theFlags = 0;
+    if (inPacket == 0)
+        TEST_CHECK(!theCacheTrack->GetNumPackets(inSample, &theNumPackets));
+    else
+        TEST_CHECK(!theCacheTrack->GetPacket(inSample, inPacket, &theData, &theLength, &theTime, &theFlags));
+    delete theFile;
+}
+
+static void TestDamagedFiles()
+{
+    CheckDamagedHeader(0, FOUR_CHARS_TO_INT('m', 'o', 'o', 'v'));
+    CheckDamagedHeader(4, QTRTPCacheFile::kFileVersion + 1);
+    CheckDamagedHeader(16, 0x10000000);
+    CheckDamagedHeader(sTrackHeaderOffsets[0] + 4, 0x10000000);     //samples
+    CheckDamagedHeader(sTrackHeaderOffsets[1] + 8, 0x10000000);     //packets
+    CheckDamagedHeader(sTrackHeaderOffsets[0] + 20, sFileLength);   //sample table offset, low word
+    CheckDamagedHeader(sTrackHeaderOffsets[1] + 24, 1);             //packet table offset, high word
+    
+    UInt32 theFirstPacketEntry = sPacketTableOffsets[0];
+    CheckDamagedEntry(sSampleTableOffsets[0] + 4, 0x10000, 1, 0);                          //packet count
+    CheckDamagedEntry(sSampleTableOffsets[0], 0xFFFFFFFF, 1, 2);                            //first packet wraps
+    CheckDamagedEntry(sSampleTableOffsets[0] + 16, 4, 3, 3);                                //runs past the table
+    CheckDamagedEntry(theFirstPacketEntry + 12, sFileLength - PacketLength(0) + 1, 1, 1);   //data offset, low word
+    CheckDamagedEntry(theFirstPacketEntry + 8, 1, 1, 1);                                    //data offset, high word
+    CheckDamagedEntry(theFirstPacketEntry + 16, 11 << 16, 1, 1);                            //no room for an RTP header
+    
+    //Nothing is left of the file but its header
+    BuildFile();
+    SaveFile(QTRTPCacheFile::kFileHeaderSize - 1);
+    TEST_CHECK(QTRTPCacheFile::Open(sCachePath, kMovieModDate) == NULL);
+}
+
+static void TestTruncatedFiles()
+{
+    BuildFile();
+    UInt32 theTablesEnd = sPacketDataOffsets[0];
+    for (UInt32 theLength = 0; theLength < sFileLength; theLength++)
+    {
+        SaveFile(theLength);
+        QTRTPCacheFile* theFile = QTRTPCacheFile::Open(sCachePath, kMovieModDate);
+        TEST_CHECK((theFile != NULL) == (theLength >= theTablesEnd));
+        if (theFile != NULL)
+            CheckPackets(theFile, theLength);
+        delete theFile;
+    }
+}
+
+//
+// Benchmark: random packet lookups, as QTRTPFile makes them while sending
+enum { kNumBenchLookups = 2000000 };
+
+static void RunBenchmark()
+{
+    BuildFile();
+    SaveFile(sFileLength);
+    QTRTPCacheFile* theFile = QTRTPCacheFile::Open(sCachePath, kMovieModDate);
+    QTRTPCacheTrack* theCacheTrack = theFile->FindTrack(sTrackIDs[0]);
+    UInt32 theSum = 0;
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchLookups; x++)
+    {
+        const char* theData = NULL;
+        UInt32 theLength = 0;
+        Float64 theTime = 0;
+        UInt16 theFlags = 0;
+        UInt32 theSample = (x % sNumSamples[0]) + 1;
+        if (theCacheTrack->GetPacket(theSample, 1, &theData, &theLength, &theTime, &theFlags))
+            theSum += theLength;
+    }
+    SInt64 theTime = OS::Microseconds() - theStart;
+    TEST_CHECK(theSum > 0);
+    ::printf("QTRTPCacheFileTest: %.1f ns per packet lookup\n", (theTime * 1000.0) / kNumBenchLookups);
+    delete theFile;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    
+    TestGoodFile();
+    TestDamagedFiles();
+    TestTruncatedFiles();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    (void)::unlink(sCachePath);
+    return TestResult("QTRTPCacheFileTest");
+}
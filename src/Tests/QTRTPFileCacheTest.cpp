@@ -0,0 +1,320 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// QTRTPFileCacheTest:
+//   Opens the sample movies through QTRTPFile's parsed movie cache: sharing
+//   while open, keeping unused movies under the limit, re-parsing a movie
+//   whose file changed, and not caching failures. Then several threads open
+//   the movies at once, and every one must describe the same tracks as a
+//   movie parsed on its own. With -b, times opening a movie with and
+//   without the cache.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "QTFile.h"
+#include "QTRTPFile.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumMovies = 7,
+    kNumOpenThreads = 4,        //UInt32
+    kNumOpensPerThread = 500,   //UInt32
+    kCacheBytes = 32 * 1024 * 1024
+};
+
+static const char* sMovies[kNumMovies] =
+{
+    "../sample_100kbit.mov",
+    "../sample_300kbit.mov",
+    "../sample_100kbit.mp4",
+    "../sample_300kbit.mp4",
+    "../sample_50kbit.3gp",
+    "../sample_h264_100kbit.mp4",
+    "../sample_h264_300kbit.mp4"
+};
+
+static UInt32 sSignatures[kNumMovies];
+
+//
+// Opens the movie with all of its hint tracks, as a session's DESCRIBE and
+// SETUPs do, and returns a hash of its SDP, duration and RTP byte count.
+// 0 if it couldn't be opened. Packets aren't compared: building them from
+// the hint tracks needs a 32-bit UInt32, which LP64 builds don't have.
+static UInt32 OpenMovie(const char* inPath)
+{
+    QTRTPFile theFile;
+    if (theFile.Initialize(inPath) != QTRTPFile::errNoError)
+        return 0;
+        
+    UInt32 theHash = 2166136261U;
+    int theSDPLength = 0;
+    char* theSDP = theFile.GetSDPFile(&theSDPLength);
+    for (int x = 0; x < theSDPLength; x++)
+        theHash = (theHash ^ (UInt8)theSDP[x]) * 16777619;
+    theHash = (theHash ^ (UInt32)(theFile.GetMovieDuration() * 1000)) * 16777619;
+    
+    QTTrack* theTrack = NULL;
+    while (theFile.GetQTFile()->NextTrack(&theTrack, theTrack))
+    {
+        if (!theFile.GetQTFile()->IsHintTrack(theTrack))
+            continue;
+        if (theFile.AddTrack(theTrack->GetTrackID(), false) != QTRTPFile::errNoError)
+            return 0;
+    }
+    if (theFile.Seek(0.0) != QTRTPFile::errNoError)
+        return 0;
+    theHash = (theHash ^ (UInt32)theFile.GetAddedTracksRTPBytes()) * 16777619;
+    return theHash;
+}
+
+static void GetStats(UInt32* outHits, UInt32* outMisses, UInt32* outEvictions)
+{
+    QTRTPFile::GetFileCacheStats(outHits, outMisses, outEvictions);
+}
+
+static Bool16 CopyFile(const char* inFromPath, const char* inToPath)
+{
+    FILE* theFrom = ::fopen(inFromPath, "rb");
+    FILE* theTo = ::fopen(inToPath, "wb");
+    if ((theFrom == NULL) || (theTo == NULL))
+    {
+        if (theFrom != NULL)
+            ::fclose(theFrom);
+        if (theTo != NULL)
+            ::fclose(theTo);
+        return false;
+    }
+    char theBuffer[8192];
+    size_t theLength = 0;
+    while ((theLength = ::fread(theBuffer, 1, sizeof(theBuffer), theFrom)) > 0)
+        (void)::fwrite(theBuffer, 1, theLength, theTo);
+    ::fclose(theFrom);
+    ::fclose(theTo);
+    return true;
+}
+
+static void SetModTime(const char* inPath, time_t inTime)
+{
+    struct utimbuf theTimes;
+    theTimes.actime = inTime;
+    theTimes.modtime = inTime;
+    (void)::utime(inPath, &theTimes);
+}
+
+static void TestCache()
+{
+    UInt32 theHits = 0, theMisses = 0, theEvictions = 0;
+    UInt32 theLastHits = 0, theLastMisses = 0, theLastEvictions = 0;
+    
+    //Without a limit, a movie is only shared while it is open
+    QTRTPFile::SetFileCacheParams(0);
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    {
+        QTRTPFile theFirst, theSecond;
+        TEST_CHECK(theFirst.Initialize(sMovies[0]) == QTRTPFile::errNoError);
+        TEST_CHECK(theSecond.Initialize(sMovies[0]) == QTRTPFile::errNoError);
+        TEST_CHECK(theFirst.GetQTFile() == theSecond.GetQTFile());
+    }
+    TEST_CHECK(OpenMovie(sMovies[0]) == sSignatures[0]);
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theHits - theLastHits == 1);
+    TEST_CHECK(theMisses - theLastMisses == 2);
+    TEST_CHECK(theEvictions - theLastEvictions == 2);
+    
+    //With one, it stays parsed after its last close
+    QTRTPFile::SetFileCacheParams(kCacheBytes);
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    for (UInt32 x = 0; x < 10; x++)
+        TEST_CHECK(OpenMovie(sMovies[1]) == sSignatures[1]);
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theHits - theLastHits == 9);
+    TEST_CHECK(theMisses - theLastMisses == 1);
+    TEST_CHECK(theEvictions == theLastEvictions);
+    
+    //Lowering the limit releases movies no one is using
+    QTRTPFile::SetFileCacheParams(0);
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theEvictions - theLastEvictions == 1);
+    QTRTPFile::SetFileCacheParams(kCacheBytes);
+    
+    //A movie that failed to open isn't cached
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    {
+        QTRTPFile theFile;
+        TEST_CHECK(theFile.Initialize("../no_such_movie.mov") == QTRTPFile::errFileNotFound);
+    }
+    {
+        QTRTPFile theFile;
+        TEST_CHECK(theFile.Initialize("../no_such_movie.mov") == QTRTPFile::errFileNotFound);
+    }
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theHits == theLastHits);
+    TEST_CHECK(theMisses - theLastMisses == 2);
+    
+    //A file that changes while no one has it open is parsed again. One that
+    //changes while open is shared as is until its last close.
+    char theCopyPath[64];
+    qtss_sprintf(theCopyPath, "/tmp/QTRTPFileCacheTest.%d.mov", (int)::getpid());
+    TEST_CHECK(CopyFile(sMovies[0], theCopyPath));
+    time_t theModTime = ::time(NULL) - 1000;
+    SetModTime(theCopyPath, theModTime);
+    TEST_CHECK(OpenMovie(theCopyPath) == sSignatures[0]);
+    
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    SetModTime(theCopyPath, theModTime + 10);
+    TEST_CHECK(OpenMovie(theCopyPath) == sSignatures[0]);
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theMisses - theLastMisses == 1);
+    TEST_CHECK(theEvictions - theLastEvictions == 1);
+    
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    {
+        QTRTPFile theFile;
+        TEST_CHECK(theFile.Initialize(theCopyPath) == QTRTPFile::errNoError);
+        SetModTime(theCopyPath, theModTime + 20);
+        TEST_CHECK(OpenMovie(theCopyPath) == sSignatures[0]);
+    }
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theHits - theLastHits == 2);
+    TEST_CHECK(theMisses == theLastMisses);
+    
+    //A removed file has nothing left to share once closed
+    (void)::unlink(theCopyPath);
+    {
+        QTRTPFile theFile;
+        TEST_CHECK(theFile.Initialize(theCopyPath) == QTRTPFile::errFileNotFound);
+    }
+}
+
+//
+// Each thread opens random sample movies, and checks that they look the
+// same as a movie parsed on its own.
+class OpenThread : public OSThread
+{
+    public:
+    
+        OpenThread(UInt32 inIndex) : fRandomSeed(inIndex + 1) {}
+        
+        virtual void Entry()
+        {
+            for (UInt32 x = 0; x < kNumOpensPerThread; x++)
+            {
+                fRandomSeed = (fRandomSeed * 1103515245) + 12345;
+                UInt32 theMovie = (fRandomSeed >> 8) % kNumMovies;
+                TEST_CHECK(OpenMovie(sMovies[theMovie]) == sSignatures[theMovie]);
+            }
+        }
+        
+        UInt32  fRandomSeed;
+};
+
+static void TestThreadedOpens()
+{
+    //Start from an empty cache, so each movie must be parsed exactly once
+    //however many threads ask for it at the same time
+    QTRTPFile::SetFileCacheParams(0);
+    QTRTPFile::SetFileCacheParams(kCacheBytes);
+    
+    UInt32 theLastHits = 0, theLastMisses = 0, theLastEvictions = 0;
+    GetStats(&theLastHits, &theLastMisses, &theLastEvictions);
+    
+    OpenThread* theThreads[kNumOpenThreads];
+    for (UInt32 x = 0; x < kNumOpenThreads; x++)
+    {
+        theThreads[x] = new OpenThread(x);
+        theThreads[x]->Start();
+    }
+    for (UInt32 y = 0; y < kNumOpenThreads; y++)
+    {
+        theThreads[y]->Join();
+        delete theThreads[y];
+    }
+    
+    UInt32 theHits = 0, theMisses = 0, theEvictions = 0;
+    GetStats(&theHits, &theMisses, &theEvictions);
+    TEST_CHECK(theMisses - theLastMisses == kNumMovies);
+    TEST_CHECK((theHits - theLastHits) + (theMisses - theLastMisses) == kNumOpenThreads * kNumOpensPerThread);
+    TEST_CHECK(theEvictions == theLastEvictions);
+}
+
+//
+// Benchmark: opening a movie and its hint tracks, as a session's SETUP does
+enum { kNumBenchOpens = 1000 };
+
+static SInt64 TimeOpens()
+{
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchOpens; x++)
+    {
+        QTRTPFile theFile;
+        (void)theFile.Initialize(sMovies[x % kNumMovies]);
+        QTTrack* theTrack = NULL;
+        while (theFile.GetQTFile()->NextTrack(&theTrack, theTrack))
+        {
+            if (theFile.GetQTFile()->IsHintTrack(theTrack))
+                (void)theFile.AddTrack(theTrack->GetTrackID(), false);
+        }
+    }
+    return OS::Microseconds() - theStart;
+}
+
+static void RunBenchmark()
+{
+    QTRTPFile::SetFileCacheParams(0);
+    SInt64 theUncachedTime = TimeOpens();
+    QTRTPFile::SetFileCacheParams(kCacheBytes);
+    SInt64 theCachedTime = TimeOpens();
+    ::printf("QTRTPFileCacheTest: %.1f us per open, parsing the movie every time\n", (Float64)theUncachedTime / kNumBenchOpens);
+    ::printf("QTRTPFileCacheTest: %.1f us per open, from the cache\n", (Float64)theCachedTime / kNumBenchOpens);
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    QTRTPFile::Initialize();
+    
+    //What each movie sends when it is parsed on its own
+    QTRTPFile::SetFileCacheParams(0);
+    for (UInt32 x = 0; x < kNumMovies; x++)
+    {
+        sSignatures[x] = OpenMovie(sMovies[x]);
+        TEST_CHECK(sSignatures[x] != 0);
+    }
+    
+    TestCache();
+    TestThreadedOpens();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+    
+    return TestResult("QTRTPFileCacheTest");
+}
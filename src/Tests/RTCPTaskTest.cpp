@@ -0,0 +1,348 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// RTCPTaskTest:
+//   Sends RTCP from many clients to an RTCPSocket, each client from its own
+//   loopback address, and has the socket read them the way the EventThread
+//   does. Every packet from a registered client must reach that client's
+//   stream, in order, on the thread its session runs on, and packets from
+//   anyone else must be dropped. A session's queue must stop taking packets
+//   when it is full or closed. With -b, prints RTCP packets per second from
+//   50k simulated clients, from the socket read to the session processing.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "Socket.h"
+#include "ev.h"
+#include "atomic.h"
+#include "RTCPTask.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumTaskThreads = 4,            //UInt32
+    kFirstClientAddr = 0x7F010001,  //UInt32. 127.1.0.1, clients count up from here
+    kClientPort = 6971,             //UInt16
+    kPacketSize = 52,               //UInt32. a receiver report with one block
+    kNumClients = 8,                //UInt32
+    kNumRegisteredClients = 6,      //UInt32
+    kPacketsPerClient = 4,          //UInt32
+    kNumBenchClients = 50000,       //UInt32
+    kBenchBurst = 128,              //UInt32. what one read event finds waiting
+    kBenchPasses = 2                //UInt32
+};
+
+static unsigned int sNumProcessed = 0;
+
+class TestSession;
+
+//
+// Stands in for an RTPStream. Checks that its packets come from its own
+// client, in order, and on its session's thread.
+class TestStream : public RTCPPacketReceiver
+{
+    public:
+
+        TestStream() : fSession(NULL), fClient(0), fNextSeqNum(0), fNumOutOfOrder(0), fNumOffThread(0) {}
+        virtual ~TestStream() {}
+
+        virtual Bool16  QueueIncomingRTCPPacket(RTCPPacketBuffer* inPacket);
+        virtual void    ProcessIncomingRTCPPacket(StrPtrLen* inPacket);
+
+        TestSession*    fSession;
+        UInt32          fClient;
+        UInt32          fNextSeqNum;
+        UInt32          fNumOutOfOrder;
+        UInt32          fNumOffThread;
+};
+
+//
+// Stands in for an RTPSession: empties its RTCP queue when it runs
+class TestSession : public Task
+{
+    public:
+
+        TestSession() : fHold(false), fRunThread(NULL) { this->SetTaskName((char*)"TestSession"); }
+
+        virtual SInt64 Run()
+        {
+            (void)this->GetEvents();
+            if (!fHold)
+            {
+                fRunThread = OSThread::GetCurrent();
+                fQueue.ProcessAll();
+                fRunThread = NULL;
+            }
+            return 0;
+        }
+
+        RTCPPacketQueue     fQueue;
+        volatile Bool16     fHold;
+        OSThread* volatile  fRunThread;
+};
+
+Bool16 TestStream::QueueIncomingRTCPPacket(RTCPPacketBuffer* inPacket)
+{
+    return fSession->fQueue.EnQueue(inPacket, fSession);
+}
+
+void TestStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
+{
+    UInt32 theClient = 0;
+    UInt32 theSeqNum = 0;
+    if (inPacket->Len == kPacketSize)
+    {
+        ::memcpy(&theClient, inPacket->Ptr, sizeof(theClient));
+        ::memcpy(&theSeqNum, inPacket->Ptr + sizeof(theClient), sizeof(theSeqNum));
+    }
+    if ((theClient != fClient) || (theSeqNum != fNextSeqNum))
+        fNumOutOfOrder++;
+    if ((fSession->fRunThread == NULL) || (fSession->fRunThread != OSThread::GetCurrent()))
+        fNumOffThread++;
+    fNextSeqNum = theSeqNum + 1;
+    (void)atomic_add(&sNumProcessed, 1);
+}
+
+//
+// Gives ProcessEvent, which the EventThread calls, to the test
+class TestRTCPSocket : public RTCPSocket
+{
+    public:
+        void ReadPackets() { this->ProcessEvent(EV_RE); }
+};
+
+//
+// Task threads may still be returning from a session's Run after its last
+// packet is processed, so sessions live until the threads are gone.
+static TestRTCPSocket*  sSocket = NULL;
+static TestSession      sSessions[kNumRegisteredClients];
+static TestStream       sStreams[kNumRegisteredClients];
+static TestSession      sHeldSession;
+static TestSession*     sBenchSessions = NULL;
+static TestStream*      sBenchStreams = NULL;
+
+//
+// Clients send from their own address, so each needs a socket only while it
+// sends. That keeps 50k of them under the descriptor limit.
+static Bool16 SendFromClient(UInt32 inClient, UInt32 inSeqNum)
+{
+    int theFD = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (theFD < 0)
+        return false;
+
+    struct sockaddr_in theAddr;
+    ::memset(&theAddr, 0, sizeof(theAddr));
+    theAddr.sin_family = AF_INET;
+    theAddr.sin_addr.s_addr = htonl(kFirstClientAddr + inClient);
+    theAddr.sin_port = htons(kClientPort);
+    Bool16 isSent = (::bind(theFD, (struct sockaddr*)&theAddr, sizeof(theAddr)) == 0);
+
+    char thePacket[kPacketSize];
+    ::memset(thePacket, 0, kPacketSize);
+    ::memcpy(thePacket, &inClient, sizeof(inClient));
+    ::memcpy(thePacket + sizeof(inClient), &inSeqNum, sizeof(inSeqNum));
+
+    theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    theAddr.sin_port = htons(sSocket->GetLocalPort());
+    if (isSent)
+        isSent = (::sendto(theFD, thePacket, kPacketSize, 0, (struct sockaddr*)&theAddr, sizeof(theAddr)) == kPacketSize);
+    (void)::close(theFD);
+    return isSent;
+}
+
+static void RegisterStreams(TestStream* inStreams, UInt32 inNumStreams)
+{
+    for (UInt32 x = 0; x < inNumStreams; x++)
+        TEST_CHECK(sSocket->GetDemuxer()->RegisterTask(kFirstClientAddr + inStreams[x].fClient, kClientPort, &inStreams[x]) == OS_NoErr);
+}
+
+static void UnregisterStreams(TestStream* inStreams, UInt32 inNumStreams)
+{
+    for (UInt32 x = 0; x < inNumStreams; x++)
+        TEST_CHECK(sSocket->GetDemuxer()->UnregisterTask(kFirstClientAddr + inStreams[x].fClient, kClientPort, &inStreams[x]) == OS_NoErr);
+}
+
+static Bool16 WaitForProcessed(UInt32 inNumPackets)
+{
+    for (SInt64 theDeadline = OS::Milliseconds() + 2000; OS::Milliseconds() < theDeadline; )
+    {
+        if (sNumProcessed >= inNumPackets)
+            return true;
+        OSThread::ThreadYield();
+    }
+    return false;
+}
+
+static void CheckDemux()
+{
+    for (UInt32 x = 0; x < kNumRegisteredClients; x++)
+    {
+        sStreams[x].fSession = &sSessions[x];
+        sStreams[x].fClient = x;
+    }
+    RegisterStreams(sStreams, kNumRegisteredClients);
+
+    //Interleaved, so a read batch holds packets for every stream
+    sNumProcessed = 0;
+    for (UInt32 theSeqNum = 0; theSeqNum < kPacketsPerClient; theSeqNum++)
+    {
+        for (UInt32 theClient = 0; theClient < kNumClients; theClient++)
+            TEST_CHECK(SendFromClient(theClient, theSeqNum));
+    }
+    sSocket->ReadPackets();
+    TEST_CHECK(WaitForProcessed(kNumRegisteredClients * kPacketsPerClient));
+
+    //Anything from an unregistered client would have shown up by now
+    OSThread::Sleep(50);
+    TEST_CHECK(sNumProcessed == kNumRegisteredClients * kPacketsPerClient);
+    for (UInt32 y = 0; y < kNumRegisteredClients; y++)
+    {
+        TEST_CHECK(sStreams[y].fNextSeqNum == kPacketsPerClient);
+        TEST_CHECK(sStreams[y].fNumOutOfOrder == 0);
+        TEST_CHECK(sStreams[y].fNumOffThread == 0);
+    }
+
+    UnregisterStreams(sStreams, kNumRegisteredClients);
+    for (UInt32 z = 0; z < kNumRegisteredClients; z++)
+        sSessions[z].fQueue.Close();
+}
+
+static void CheckQueueLimits()
+{
+    //A held session keeps everything it is given queued
+    sHeldSession.fHold = true;
+    TestStream theStream;
+    theStream.fSession = &sHeldSession;
+
+    enum { kMaxQueued = 64, kNumTries = kMaxQueued + 8 };
+    RTCPPacketBuffer* theBuffers[kNumTries];
+    RTCPPacketBuffer::Get(theBuffers, kNumTries);
+
+    UInt32 theNumQueued = 0;
+    for (UInt32 x = 0; x < kNumTries; x++)
+    {
+        theBuffers[x]->fStream = &theStream;
+        theBuffers[x]->fLen = kPacketSize;
+        if (theStream.QueueIncomingRTCPPacket(theBuffers[x]))
+            theNumQueued++;
+        else
+            RTCPPacketBuffer::Release(theBuffers[x]);
+    }
+    TEST_CHECK(theNumQueued == kMaxQueued);
+
+    //Closing frees what is queued and refuses anything more
+    sHeldSession.fQueue.Close();
+    RTCPPacketBuffer* theLateBuffer = NULL;
+    RTCPPacketBuffer::Get(&theLateBuffer, 1);
+    theLateBuffer->fStream = &theStream;
+    TEST_CHECK(!theStream.QueueIncomingRTCPPacket(theLateBuffer));
+    RTCPPacketBuffer::Release(theLateBuffer);
+    TEST_CHECK(theStream.fNextSeqNum == 0);
+}
+
+static void RunBenchmark()
+{
+    sBenchSessions = new TestSession[kNumBenchClients];
+    sBenchStreams = new TestStream[kNumBenchClients];
+    for (UInt32 x = 0; x < kNumBenchClients; x++)
+    {
+        sBenchStreams[x].fSession = &sBenchSessions[x];
+        sBenchStreams[x].fClient = x;
+    }
+    RegisterStreams(sBenchStreams, kNumBenchClients);
+
+    //
+    // Only reading the socket and getting the packets through the session
+    // queues is timed. Sending them from a fresh socket each is not.
+    sNumProcessed = 0;
+    UInt32 theNumSent = 0;
+    SInt64 theReadTime = 0;
+    SInt64 theElapsed = 0;
+    for (UInt32 thePass = 0; thePass < kBenchPasses; thePass++)
+    {
+        for (UInt32 theClient = 0; theClient < kNumBenchClients; theClient += kBenchBurst)
+        {
+            for (UInt32 x = theClient; (x < theClient + kBenchBurst) && (x < kNumBenchClients); x++)
+            {
+                if (SendFromClient(x, thePass))
+                    theNumSent++;
+            }
+
+            SInt64 theStart = OS::Microseconds();
+            sSocket->ReadPackets();
+            theReadTime += OS::Microseconds() - theStart;
+            (void)WaitForProcessed(theNumSent);
+            theElapsed += OS::Microseconds() - theStart;
+        }
+    }
+
+    UInt32 theNumOutOfOrder = 0;
+    for (UInt32 y = 0; y < kNumBenchClients; y++)
+        theNumOutOfOrder += sBenchStreams[y].fNumOutOfOrder;
+    TEST_CHECK(theNumOutOfOrder == 0);
+
+    ::printf("RTCPTaskTest: %lu clients, %lu of %lu packets processed, %llu packets/sec read, %llu packets/sec read and processed by %lu session threads\n",
+                (UInt32)kNumBenchClients, (UInt32)sNumProcessed, theNumSent,
+                (unsigned long long)(((SInt64)sNumProcessed * 1000000) / ((theReadTime > 0) ? theReadTime : 1)),
+                (unsigned long long)(((SInt64)sNumProcessed * 1000000) / ((theElapsed > 0) ? theElapsed : 1)),
+                (UInt32)kNumTaskThreads);
+
+    UnregisterStreams(sBenchStreams, kNumBenchClients);
+    for (UInt32 z = 0; z < kNumBenchClients; z++)
+        sBenchSessions[z].fQueue.Close();
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    Socket::Initialize();
+    select_startevents();
+    (void)TaskThreadPool::AddThreads(kNumTaskThreads);
+
+    sSocket = new TestRTCPSocket();
+    TEST_CHECK(sSocket->Open() == OS_NoErr);
+    TEST_CHECK(sSocket->Bind(INADDR_LOOPBACK, 0) == OS_NoErr);
+    sSocket->SetSocketRcvBufSize(4 * 1024 * 1024);
+
+    CheckDemux();
+    CheckQueueLimits();
+
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+
+    TaskThreadPool::RemoveThreads();
+    delete [] sBenchStreams;
+    delete [] sBenchSessions;
+    return TestResult("RTCPTaskTest");
+}
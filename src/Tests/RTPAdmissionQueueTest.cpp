@@ -0,0 +1,207 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// RTPAdmissionQueueTest:
+//   Adds sessions to an admission queue in the order they were created and
+//   sheds them the way the stats task does when the server is over its
+//   bandwidth limit. Sessions must be killed newest first, at most the number
+//   asked for per update, and never once they have played for the safe play
+//   duration. A shed session, a session killed some other way, and a session
+//   deleted without being killed must all leave the queue, the way RTPSession
+//   leaves it on its kill path and in its destructor.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "Task.h"
+#include "atomic.h"
+#include "RTPAdmissionQueue.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumSessions = 10,          //UInt32
+    kCreateInterval = 1000,     //SInt64. msec between sessions
+    kSafePlayDuration = 5000,   //SInt64. msec
+    kKillWaitInMsec = 5000      //SInt64
+};
+
+static RTPAdmissionQueue*   sQueue = NULL;
+static unsigned int         sNumKilled = 0;
+static unsigned int         sNumDeleted = 0;
+static UInt32               sKillOrder[kNumSessions];
+
+//
+// Takes itself out of the queue when it is killed, and again as it is
+// deleted, like an RTPSession
+class TestSession : public Task
+{
+    public:
+    
+        TestSession(UInt32 inIndex) : fIndex(inIndex)
+        {
+            fAdmissionQueueElem.SetSession(this);
+        }
+        
+        virtual ~TestSession()
+        {
+            sQueue->Remove(&fAdmissionQueueElem);
+            (void)atomic_add(&sNumDeleted, 1);
+        }
+        
+        virtual SInt64 Run()
+        {
+            EventFlags theEvents = this->GetEvents();
+            if ((theEvents & Task::kKillEvent) == 0)
+                return 0;
+                
+            sQueue->Remove(&fAdmissionQueueElem);
+            sKillOrder[atomic_add(&sNumKilled, 1) - 1] = fIndex;
+            return -1;
+        }
+        
+        UInt32                  fIndex;
+        RTPAdmissionQueueElem   fAdmissionQueueElem;
+};
+
+static TestSession*     sSessions[kNumSessions];
+
+//
+// Session x is created at (x + 1) seconds, so the last one is the newest
+static void AddSessions()
+{
+    sNumKilled = 0;
+    sNumDeleted = 0;
+    for (UInt32 x = 0; x < kNumSessions; x++)
+    {
+        sSessions[x] = new TestSession(x);
+        sQueue->Add(&sSessions[x]->fAdmissionQueueElem, (x + 1) * kCreateInterval);
+        TEST_CHECK(sSessions[x]->fAdmissionQueueElem.IsInQueue());
+    }
+    TEST_CHECK(sQueue->GetLength() == kNumSessions);
+}
+
+static void WaitForDeletes(UInt32 inNumDeleted)
+{
+    SInt64 theGiveUpTime = OS::Milliseconds() + kKillWaitInMsec;
+    while ((sNumDeleted < inNumDeleted) && (OS::Milliseconds() < theGiveUpTime))
+        OSThread::Sleep(1);
+    TEST_CHECK(sNumDeleted == inNumDeleted);
+}
+
+static void CheckShedding()
+{
+    AddSessions();
+    
+    //Half a second after the newest session was created, the three newest
+    //have played for less than the safe play duration
+    SInt64 theCurTime = (kNumSessions * kCreateInterval) + 500;
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, 3) == 3);
+    TEST_CHECK(sQueue->GetLength() == kNumSessions - 3);
+    WaitForDeletes(3);
+    TEST_CHECK((sKillOrder[0] == 9) && (sKillOrder[1] == 8) && (sKillOrder[2] == 7));
+    
+    //No more than asked for, however many are young enough
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, 0) == 0);
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, 1) == 1);
+    WaitForDeletes(4);
+    TEST_CHECK(sKillOrder[3] == 6);
+    
+    //Session 4 has played for 5.5 secs, so it and everything older stay, even
+    //when more are asked for
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, kNumSessions) == 1);
+    WaitForDeletes(5);
+    TEST_CHECK(sKillOrder[4] == 5);
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, kNumSessions) == 0);
+    TEST_CHECK(sQueue->GetLength() == 5);
+    for (UInt32 x = 0; x < 5; x++)
+        TEST_CHECK(sSessions[x]->fAdmissionQueueElem.IsInQueue());
+    
+    //A session that has played for exactly the safe play duration is safe
+    TEST_CHECK(sQueue->ShedNewest((5 * kCreateInterval) + kSafePlayDuration, kSafePlayDuration, kNumSessions) == 0);
+    TEST_CHECK(sQueue->ShedNewest((5 * kCreateInterval) + kSafePlayDuration - 1, kSafePlayDuration, kNumSessions) == 1);
+    WaitForDeletes(6);
+    TEST_CHECK(sKillOrder[5] == 4);
+    
+    //The rest are killed some other way, such as a timeout, or deleted
+    //without being killed, and leave the queue either way
+    sSessions[1]->Signal(Task::kKillEvent);
+    WaitForDeletes(7);
+    TEST_CHECK(sKillOrder[6] == 1);
+    TEST_CHECK(sQueue->GetLength() == 3);
+    for (UInt32 y = 0; y < 4; y++)
+    {
+        if (y != 1)
+            delete sSessions[y];
+    }
+    TEST_CHECK(sNumDeleted == kNumSessions);
+    TEST_CHECK(sQueue->GetLength() == 0);
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, kNumSessions) == 0);
+}
+
+//
+// A session taken out by its own kill path before a shed gets to it is
+// skipped, and what was left out of the queue can go back in
+static void CheckRemoveBeforeShed()
+{
+    AddSessions();
+    sQueue->Remove(&sSessions[9]->fAdmissionQueueElem);
+    sQueue->Remove(&sSessions[9]->fAdmissionQueueElem);
+    TEST_CHECK(!sSessions[9]->fAdmissionQueueElem.IsInQueue());
+    TEST_CHECK(sQueue->GetLength() == kNumSessions - 1);
+    
+    SInt64 theCurTime = (kNumSessions * kCreateInterval) + 500;
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, 1) == 1);
+    WaitForDeletes(1);
+    TEST_CHECK(sKillOrder[0] == 8);
+    
+    sQueue->Add(&sSessions[9]->fAdmissionQueueElem, kNumSessions * kCreateInterval);
+    TEST_CHECK(sQueue->ShedNewest(theCurTime, kSafePlayDuration, 1) == 1);
+    WaitForDeletes(2);
+    TEST_CHECK(sKillOrder[1] == 9);
+    
+    for (UInt32 x = 0; x < kNumSessions - 2; x++)
+        delete sSessions[x];
+    TEST_CHECK(sQueue->GetLength() == 0);
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    
+    //One task thread runs the kills in the order they were signalled
+    (void)TaskThreadPool::AddThreads(1);
+    sQueue = new RTPAdmissionQueue();
+    
+    CheckShedding();
+    CheckRemoveBeforeShed();
+    
+    TaskThreadPool::RemoveThreads();
+    delete sQueue;
+    return TestResult("RTPAdmissionQueueTest");
+}
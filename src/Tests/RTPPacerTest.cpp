@@ -0,0 +1,204 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// RTPPacerTest:
+//   Checks the pacer's token bucket against its rate, the floor it keeps
+//   under the media's bitrate, and which packets the overbuffer window
+//   calls due. Then plays a reflected stream whose bitrate rises past what
+//   the pacer has seen the client get, with no movie bitrate to floor the
+//   pacing rate, the way RTPStream::Write sends it. Due packets must never
+//   be held back. With -b, prints how late they get when every packet is
+//   paced instead.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "RTPPacer.h"
+#include "RTPOverbufferWindow.h"
+#include "TestUtils.h"
+
+enum
+{
+    kSendInterval = 50,         //UInt32. msec
+    kPacketSize = 1250,         //SInt32
+    kReportInterval = 5000      //SInt64. msec between receiver reports
+};
+
+static void CheckTokenBucket()
+{
+    RTPPacer thePacer(kSendInterval);
+    
+    //Nothing is paced until the first estimate
+    TEST_CHECK(!thePacer.HasEstimate());
+    TEST_CHECK(thePacer.CheckTransmitTime(1000, kPacketSize, 0) == -1);
+    
+    //Startup paces at 2/ln2 of the bottleneck bandwidth
+    thePacer.UpdateDeliveryRate(0, 1000000, 1000);
+    TEST_CHECK(thePacer.HasEstimate() && thePacer.IsStartingUp());
+    TEST_CHECK(thePacer.GetBottleneckBandwidth() == 1000000);
+    
+    //Send as fast as the bucket allows for a second; each wait must be in
+    //the future, and the total must come to the rate plus one bucket
+    thePacer.ResetPacingBucket();
+    SInt64 theBytesSent = 0;
+    for (SInt64 theTime = 2000; theTime < 3000; )
+    {
+        SInt64 theWakeupTime = thePacer.CheckTransmitTime(theTime, kPacketSize, 0);
+        if (theWakeupTime == -1)
+        {
+            thePacer.AddPacketSent(kPacketSize);
+            theBytesSent += kPacketSize;
+            continue;
+        }
+        TEST_CHECK(theWakeupTime > theTime);
+        theTime = theWakeupTime;
+    }
+    UInt32 theRate = thePacer.GetPacingRate();
+    TEST_CHECK(theRate == 2885000);
+    SInt64 theBucketBytes = ((SInt64)theRate * 10 / 8000) + (2 * 1500);
+    TEST_CHECK(theBytesSent * 8 >= (SInt64)theRate - (kPacketSize * 8));
+    TEST_CHECK(theBytesSent * 8 <= (SInt64)theRate + (theBucketBytes * 8) + (kPacketSize * 8));
+    
+    //Never below 5/4 of the media's bitrate, and never 0 without one
+    thePacer.UpdateDeliveryRate(1000000, 1, 4000);
+    for (UInt32 x = 0; x < 8; x++)
+        thePacer.UpdateDeliveryRate(1, 1, 40000 + (x * kReportInterval));
+    TEST_CHECK(thePacer.GetBottleneckBandwidth() == 1);
+    (void)thePacer.CheckTransmitTime(80000, kPacketSize, 1000000);
+    TEST_CHECK(thePacer.GetPacingRate() >= 1250000);
+    SInt64 theWakeupTime = thePacer.CheckTransmitTime(80001, kPacketSize, 0);
+    TEST_CHECK(thePacer.GetPacingRate() > 0);
+    TEST_CHECK((theWakeupTime == -1) || (theWakeupTime > 80001));
+}
+
+static void CheckDuePackets()
+{
+    RTPOverbufferWindow theWindow(kSendInterval, 0, 25, 2.0);
+    
+    //Due within this send interval, whether or not it is late
+    TEST_CHECK(theWindow.IsPacketDue(1000, 10000));
+    TEST_CHECK(theWindow.IsPacketDue(10000 + kSendInterval, 10000));
+    TEST_CHECK(!theWindow.IsPacketDue(10000 + kSendInterval + 1, 10000));
+    
+    //Due packets go out even with no room in the window; others wait
+    theWindow.SetWindowSize(0);
+    TEST_CHECK(theWindow.CheckTransmitTime(10000, 10000, kPacketSize) == -1);
+    TEST_CHECK(theWindow.CheckTransmitTime(20000, 10000, kPacketSize) > 10000);
+}
+
+//
+// A broadcast that ran at 100 kbps long enough for the pacer to leave
+// startup, then goes up to 500 kbps. Each packet's transmit time is when it
+// arrived, as for every reflected packet. The client gets everything sent,
+// and reports it every few seconds. Returns how late the latest packet went
+// out, in msec.
+static SInt64 RunReflectedStream(Bool16 inPaceDuePackets, UInt32* outNumSent)
+{
+    enum { kStartTime = 1000, kEndTime = 61000, kPacketSpacing = 20, kMaxPackets = 4096 };
+    static SInt64 sTransmitTimes[kMaxPackets];
+    
+    RTPOverbufferWindow theWindow(kSendInterval, 0, 25, 2.0);
+    RTPPacer thePacer(kSendInterval);
+    UInt32 theDeliveryRate = 0;
+    for (UInt32 x = 0; x < 4; x++)
+    {
+        thePacer.UpdateDeliveryRate(theDeliveryRate, 100000, (x + 1) * kReportInterval - 20000);
+        theDeliveryRate = 100000;
+    }
+    TEST_CHECK(!thePacer.IsStartingUp());
+    thePacer.ResetPacingBucket();
+    
+    UInt32 theNumArrived = 0;
+    UInt32 theNumSent = 0;
+    SInt64 theMaxLateness = 0;
+    SInt64 theBytesSinceReport = 0;
+    for (SInt64 theTime = kStartTime; theTime < kEndTime; theTime++)
+    {
+        if ((theTime % kPacketSpacing) == 0)
+            sTransmitTimes[theNumArrived++] = theTime;
+        
+        //As RTPStream::Write: the overbuffer window first, then the pacer
+        while (theNumSent < theNumArrived)
+        {
+            SInt64 theTransmitTime = sTransmitTimes[theNumSent];
+            if (theWindow.CheckTransmitTime(theTransmitTime, theTime, kPacketSize) > theTime)
+                break;
+            if ((inPaceDuePackets || !theWindow.IsPacketDue(theTransmitTime, theTime)) &&
+                (thePacer.CheckTransmitTime(theTime, kPacketSize, 0) > theTime))
+                break;
+                
+            theWindow.AddPacketToWindow(kPacketSize);
+            thePacer.AddPacketSent(kPacketSize);
+            theBytesSinceReport += kPacketSize;
+            if (theTime - theTransmitTime > theMaxLateness)
+                theMaxLateness = theTime - theTransmitTime;
+            theNumSent++;
+        }
+        
+        if (((theTime - kStartTime) % kReportInterval) == kReportInterval - 1)
+        {
+            UInt32 theNewRate = (UInt32)((theBytesSinceReport * 8 * 1000) / kReportInterval);
+            thePacer.UpdateDeliveryRate(theDeliveryRate, theNewRate, theTime);
+            thePacer.AddRTTSample(40, theTime);
+            theDeliveryRate = theNewRate;
+            theBytesSinceReport = 0;
+        }
+    }
+    
+    //Whatever is still queued is as late as it has been waiting
+    if ((theNumSent < theNumArrived) && (kEndTime - sTransmitTimes[theNumSent] > theMaxLateness))
+        theMaxLateness = kEndTime - sTransmitTimes[theNumSent];
+    *outNumSent = theNumSent;
+    return theMaxLateness;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    
+    CheckTokenBucket();
+    CheckDuePackets();
+    
+    UInt32 theNumSent = 0;
+    SInt64 theLateness = RunReflectedStream(false, &theNumSent);
+    TEST_CHECK(theLateness == 0);
+    TEST_CHECK(theNumSent == 3000);
+    
+    //Make sure the stream really did outrun the pacer's estimate
+    UInt32 theNumPacedSent = 0;
+    SInt64 thePacedLateness = RunReflectedStream(true, &theNumPacedSent);
+    TEST_CHECK(thePacedLateness > 1000);
+    
+    if (TestWantsBenchmarks(argc, argv))
+    {
+        ::printf("RTPPacerTest: reflected 100->500 kbps, due packets not paced: %lu of 3000 sent, at most %lld msec late\n",
+                    theNumSent, (long long)theLateness);
+        ::printf("RTPPacerTest: reflected 100->500 kbps, every packet paced: %lu of 3000 sent, at most %lld msec late\n",
+                    theNumPacedSent, (long long)thePacedLateness);
+    }
+    
+    return TestResult("RTPPacerTest");
+}
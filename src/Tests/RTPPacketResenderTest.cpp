@@ -0,0 +1,330 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// RTPPacketResenderTest:
+//   Adds packets to a resender sending over loopback, and checks that acks
+//   find them, that due packets are resent oldest first and then wait a
+//   whole retransmit timeout again, and that packets past their age limit
+//   are dropped once they come due instead of being resent. The ring holding
+//   the packets must keep all of them as it grows, with their sequence
+//   numbers wrapping, and at its largest size give up the oldest packet's
+//   spot to a new packet that lands on it.
+
+#include <stdlib.h>
+#include <fcntl.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "UDPSocket.h"
+#include "RTPPacketResender.h"
+#include "QTSServerInterface.h"
+#include "TestUtils.h"
+
+enum
+{
+    kPacketSize = 64,               //UInt32
+    kClientWindow = 1024 * 1024,    //SInt32
+    kNoAgeLimit = 60 * 1000,        //SInt32. msec
+    kFirstRTO = 600,                //SInt32. msec, the tracker's minimum
+    kResentRTO = 900,               //SInt32. msec, after a first resend counts 1.5x the first RTO
+    kMaxPacketArraySize = 8192,     //UInt32. as in RTPPacketResender.cpp
+    kMaxReceived = 256              //UInt32
+};
+
+//The resender counts wasted buffer bytes in the server when there is one
+QTSServerInterface* QTSServerInterface::sServer = NULL;
+
+static UDPSocket* sSender = NULL;
+static UDPSocket* sReceiver = NULL;
+
+static UInt16   sReceivedSeqNums[kMaxReceived];
+
+static UDPSocket* MakeSocket()
+{
+    UDPSocket* theSocket = new UDPSocket(NULL, 0);
+    TEST_CHECK(theSocket->Open() == OS_NoErr);
+    TEST_CHECK(theSocket->Bind(INADDR_LOOPBACK, 0) == OS_NoErr);
+    theSocket->SetSocketRcvBufSize(1024 * 1024);
+    (void)::fcntl(theSocket->GetSocketFD(), F_SETFL, O_NONBLOCK);
+    return theSocket;
+}
+
+static void AddPacket(RTPPacketResender* inResender, UInt16 inSeqNum, SInt32 inAgeLimit)
+{
+    //AddPacket reads the sequence number as a UInt16, so keep it aligned
+    UInt16 thePacket[kPacketSize / sizeof(UInt16)];
+    ::memset(thePacket, 0, sizeof(thePacket));
+    thePacket[0] = htons(0x8060);
+    thePacket[1] = htons(inSeqNum);
+    inResender->AddPacket(thePacket, kPacketSize, inAgeLimit);
+}
+
+static SInt32 AckPacket(RTPPacketResender* inResender, UInt16 inSeqNum)
+{
+    SInt64 theCurTime = OS::Milliseconds();
+    return inResender->AckPacket(inSeqNum, theCurTime);
+}
+
+//Returns how many packets were resent, and their sequence numbers in sReceivedSeqNums
+static UInt32 ReceiveAll()
+{
+    UInt32 theNumReceived = 0;
+    UInt32 theAddr = 0;
+    UInt16 thePort = 0;
+    char thePacket[kPacketSize + 1];
+    UInt32 theLen = 0;
+    while (theNumReceived < kMaxReceived)
+    {
+        if (sReceiver->RecvFrom(&theAddr, &thePort, thePacket, sizeof(thePacket), &theLen) != OS_NoErr)
+            break;
+        TEST_CHECK(theLen == kPacketSize);
+        UInt16 theSeqNum = 0;
+        ::memcpy(&theSeqNum, &thePacket[2], sizeof(theSeqNum));
+        sReceivedSeqNums[theNumReceived++] = ntohs(theSeqNum);
+    }
+    return theNumReceived;
+}
+
+static void SleepUntil(SInt64 inTime)
+{
+    SInt64 theCurTime = OS::Milliseconds();
+    if (inTime > theCurTime)
+        OSThread::Sleep((UInt32)(inTime - theCurTime));
+}
+
+static void SetUp(RTPPacketResender* inResender, RTPBandwidthTracker* inTracker)
+{
+    inTracker->SetWindowSize(kClientWindow);
+    inResender->SetBandwidthTracker(inTracker);
+    inResender->SetDestination(sSender, INADDR_LOOPBACK, sReceiver->GetLocalPort());
+}
+
+static void CheckAcks()
+{
+    RTPBandwidthTracker theTracker(false);
+    RTPPacketResender theResender;
+    SetUp(&theResender, &theTracker);
+    
+    for (UInt16 theSeqNum = 100; theSeqNum < 110; theSeqNum++)
+        AddPacket(&theResender, theSeqNum, kNoAgeLimit);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 10);
+    TEST_CHECK(theTracker.BytesInList() == 10 * kPacketSize);
+    
+    //A repeated packet is only kept once
+    AddPacket(&theResender, 105, kNoAgeLimit);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 10);
+    
+    //A packet that was never resent gives a round trip time
+    TEST_CHECK(AckPacket(&theResender, 105) >= 0);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 9);
+    TEST_CHECK(theTracker.BytesInList() == 9 * kPacketSize);
+    
+    //Acks for packets that are gone, or never were, change nothing. 164
+    //lands in 100's spot in the ring.
+    TEST_CHECK(AckPacket(&theResender, 105) == -1);
+    TEST_CHECK(AckPacket(&theResender, 164) == -1);
+    TEST_CHECK(AckPacket(&theResender, 5000) == -1);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 9);
+    
+    TEST_CHECK(AckPacket(&theResender, 100) >= 0);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 8);
+    TEST_CHECK(theResender.GetNumResends() == 0);
+    TEST_CHECK(ReceiveAll() == 0);
+    
+    theResender.ClearOutstandingPackets();
+    TEST_CHECK(theResender.GetNumPacketsInList() == 0);
+}
+
+static void CheckResendOrder()
+{
+    RTPBandwidthTracker theTracker(false);
+    RTPPacketResender theResender;
+    SetUp(&theResender, &theTracker);
+    
+    //
+    // 65535 and 0 go out first, 1 a while later. Sequence numbers wrap in between.
+    SInt64 theStartTime = OS::Milliseconds();
+    AddPacket(&theResender, 65535, kNoAgeLimit);
+    AddPacket(&theResender, 0, kNoAgeLimit);
+    SleepUntil(theStartTime + 300);
+    AddPacket(&theResender, 1, kNoAgeLimit);
+    
+    //
+    // Nothing is due before a retransmit timeout
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 0);
+    
+    //
+    // 65535 is due. Resending it raises the timeout, so 0 isn't due any more.
+    SleepUntil(theStartTime + kFirstRTO + 100);
+    theResender.ResendDueEntries();
+    TEST_CHECK(theTracker.CurRetransmitTimeout() == kResentRTO);
+    TEST_CHECK(ReceiveAll() == 1);
+    TEST_CHECK(sReceivedSeqNums[0] == 65535);
+    
+    //
+    // When everything is due, 65535 comes last, having been sent last
+    SleepUntil(theStartTime + kFirstRTO + 100 + kResentRTO + 150);
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 3);
+    TEST_CHECK(sReceivedSeqNums[0] == 0);
+    TEST_CHECK(sReceivedSeqNums[1] == 1);
+    TEST_CHECK(sReceivedSeqNums[2] == 65535);
+    TEST_CHECK(theResender.GetNumResends() == 4);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 3);
+    
+    //Resent packets don't give a round trip time, but the ack takes them out
+    TEST_CHECK(AckPacket(&theResender, 1) == -1);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 2);
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 0);
+}
+
+static void CheckExpiry()
+{
+    RTPBandwidthTracker theTracker(false);
+    RTPPacketResender theResender;
+    SetUp(&theResender, &theTracker);
+    
+    //A packet already past its age limit isn't kept
+    AddPacket(&theResender, 19, 0);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 0);
+    
+    SInt64 theStartTime = OS::Milliseconds();
+    AddPacket(&theResender, 20, 100);
+    AddPacket(&theResender, 21, kNoAgeLimit);
+    
+    //
+    // 20 is past its age limit, but stays until it comes due so a late ack
+    // can still find it
+    SleepUntil(theStartTime + 300);
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 0);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 2);
+    
+    //
+    // Once due, it is dropped rather than resent
+    SleepUntil(theStartTime + kFirstRTO + 100);
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 1);
+    TEST_CHECK(sReceivedSeqNums[0] == 21);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 1);
+    TEST_CHECK(theResender.GetNumResends() == 1);
+    TEST_CHECK(AckPacket(&theResender, 20) == -1);
+    TEST_CHECK(theResender.GetNumPacketsInList() == 1);
+}
+
+static void CheckGrowth()
+{
+    RTPBandwidthTracker theTracker(false);
+    RTPPacketResender theResender;
+    SetUp(&theResender, &theTracker);
+    
+    //
+    // 200 packets don't fit the ring it starts with, so it grows while they
+    // are added, sequence numbers wrapping after the first 96
+    const UInt32 theNumPackets = 200;
+    const UInt16 theFirstSeqNum = 65440;
+    SInt64 theStartTime = OS::Milliseconds();
+    for (UInt32 x = 0; x < theNumPackets; x++)
+        AddPacket(&theResender, (UInt16)(theFirstSeqNum + x), kNoAgeLimit);
+    TEST_CHECK(theResender.GetNumPacketsInList() == (SInt32)theNumPackets);
+    TEST_CHECK(theResender.GetMaxPacketsInList() == (SInt32)theNumPackets);
+    
+    //
+    // The due order survives the moves: the first one comes due first...
+    SleepUntil(theStartTime + kFirstRTO + 100);
+    theResender.ResendDueEntries();
+    TEST_CHECK(ReceiveAll() == 1);
+    TEST_CHECK(sReceivedSeqNums[0] == theFirstSeqNum);
+    
+    //
+    // ...and the rest after it, in the order they were added
+    SleepUntil(theStartTime + kResentRTO + 250);
+    theResender.ResendDueEntries();
+    UInt32 theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == theNumPackets - 1);
+    for (UInt32 y = 0; y < theNumReceived; y++)
+        TEST_CHECK(sReceivedSeqNums[y] == (UInt16)(theFirstSeqNum + 1 + y));
+    
+    //Every one can still be found by its sequence number
+    for (UInt32 z = 0; z < theNumPackets; z++)
+        (void)AckPacket(&theResender, (UInt16)(theFirstSeqNum + z));
+    TEST_CHECK(theResender.GetNumPacketsInList() == 0);
+}
+
+static void CheckEviction()
+{
+    RTPBandwidthTracker theTracker(false);
+    RTPPacketResender theResender;
+    SetUp(&theResender, &theTracker);
+    
+    //
+    // Fill the largest ring, wrapping sequence numbers on the way
+    const UInt16 theFirstSeqNum = 60000;
+    for (UInt32 x = 0; x < kMaxPacketArraySize; x++)
+        AddPacket(&theResender, (UInt16)(theFirstSeqNum + x), kNoAgeLimit);
+    TEST_CHECK(theResender.GetNumPacketsInList() == kMaxPacketArraySize);
+    
+    //
+    // The next one lands on the first one's spot, and takes it
+    const UInt16 theNextSeqNum = (UInt16)(theFirstSeqNum + kMaxPacketArraySize);
+    AddPacket(&theResender, theNextSeqNum, kNoAgeLimit);
+    TEST_CHECK(theResender.GetNumPacketsInList() == kMaxPacketArraySize);
+    TEST_CHECK(theResender.GetMaxPacketsInList() == kMaxPacketArraySize);
+    TEST_CHECK(AckPacket(&theResender, theFirstSeqNum) == -1);
+    TEST_CHECK(theResender.GetNumPacketsInList() == kMaxPacketArraySize);
+    TEST_CHECK(AckPacket(&theResender, theNextSeqNum) >= 0);
+    TEST_CHECK(AckPacket(&theResender, (UInt16)(theFirstSeqNum + 1)) >= 0);
+    TEST_CHECK(theResender.GetNumPacketsInList() == kMaxPacketArraySize - 2);
+    
+    //
+    // The evicted packet left the due list intact, so clearing it gets them all
+    theResender.ClearOutstandingPackets();
+    TEST_CHECK(theResender.GetNumPacketsInList() == 0);
+    TEST_CHECK(ReceiveAll() == 0);
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    Socket::Initialize();
+    RTPPacketResender::Initialize();
+    
+    sSender = MakeSocket();
+    sReceiver = MakeSocket();
+    
+    CheckAcks();
+    CheckResendOrder();
+    CheckExpiry();
+    CheckGrowth();
+    CheckEviction();
+    
+    delete sSender;
+    delete sReceiver;
+    return TestResult("RTPPacketResenderTest");
+}
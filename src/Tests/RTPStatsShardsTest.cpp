@@ -0,0 +1,251 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// RTPStatsShardsTest:
+//   Counts RTP bytes, packets and loss on more threads than there are
+//   shards while another thread collects, the way RTPStatsUpdaterTask does.
+//   Everything counted must be collected exactly once, including after a
+//   shard's count wraps, and the retransmit wastage level must add up
+//   across threads. With -b, compares counting against a shared atomic_add.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "atomic.h"
+#include "RTPStatsShards.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumCountingThreads = RTPStatsShards::kMaxShards + 16,    //UInt32
+    kNumCountsPerThread = 20000                                 //UInt32
+};
+
+static void CheckOneThread()
+{
+    RTPStatsShards theShards;
+    UInt32 theBytes = 1, thePackets = 1, thePacketsLost = 1;
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK((theBytes == 0) && (thePackets == 0) && (thePacketsLost == 0));
+    TEST_CHECK(theShards.GetNumShardsInUse() == 0);
+    
+    theShards.AddRTPBytes(1000);
+    theShards.AddRTPBytes(500);
+    theShards.AddRTPPackets(1);
+    theShards.AddRTPPackets(1);
+    theShards.AddRTPPacketsLost(3);
+    TEST_CHECK(theShards.GetNumShardsInUse() == 1);
+    
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK((theBytes == 1500) && (thePackets == 2) && (thePacketsLost == 3));
+    
+    //Nothing new since the last time
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK((theBytes == 0) && (thePackets == 0) && (thePacketsLost == 0));
+    
+    //Counts are never reset, so a count that wraps past 2^32 still comes out right
+    theShards.AddRTPBytes(0xFFFFF000);
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK(theBytes == 0xFFFFF000);
+    theShards.AddRTPBytes(0x2000);
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK(theBytes == 0x2000);
+    
+    theShards.AlterRetransmitWastedBytes(4096);
+    theShards.AlterRetransmitWastedBytes(-1024);
+    TEST_CHECK(theShards.GetRetransmitWastedBytes() == 3072);
+}
+
+static void CheckSeparateTables()
+{
+    //A thread has a shard in each table it counts into, and they don't mix
+    RTPStatsShards theFirst;
+    RTPStatsShards theSecond;
+    theFirst.AddRTPBytes(100);
+    theSecond.AddRTPBytes(7);
+    theFirst.AddRTPBytes(100);
+    
+    UInt32 theBytes = 0, thePackets = 0, thePacketsLost = 0;
+    theFirst.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK(theBytes == 200);
+    theSecond.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    TEST_CHECK(theBytes == 7);
+}
+
+//
+// Each thread counts its share, and holds some retransmit wastage
+class CountingThread : public OSThread
+{
+    public:
+        CountingThread(RTPStatsShards* inShards, UInt32 inIndex)
+            : fShards(inShards), fIndex(inIndex) {}
+        
+        virtual void Entry()
+        {
+            for (UInt32 x = 0; x < kNumCountsPerThread; x++)
+            {
+                fShards->AddRTPBytes(fIndex + 1);
+                fShards->AddRTPPackets(1);
+                if ((x % 100) == 0)
+                    fShards->AddRTPPacketsLost(1);
+            }
+            fShards->AlterRetransmitWastedBytes((fIndex + 1) * 100);
+        }
+        
+    private:
+        RTPStatsShards* fShards;
+        UInt32          fIndex;
+};
+
+static void CheckManyThreads()
+{
+    RTPStatsShards theShards;
+    CountingThread* theThreads[kNumCountingThreads];
+    for (UInt32 x = 0; x < kNumCountingThreads; x++)
+    {
+        theThreads[x] = new CountingThread(&theShards, x);
+        theThreads[x]->Start();
+    }
+    
+    //Collect while they count, then once more after they are done
+    UInt64 theTotalBytes = 0, theTotalPackets = 0, theTotalPacketsLost = 0;
+    UInt32 theBytes = 0, thePackets = 0, thePacketsLost = 0;
+    for (UInt32 y = 0; y < 50; y++)
+    {
+        theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+        theTotalBytes += theBytes;
+        theTotalPackets += thePackets;
+        theTotalPacketsLost += thePacketsLost;
+        OSThread::ThreadYield();
+    }
+    for (UInt32 z = 0; z < kNumCountingThreads; z++)
+    {
+        theThreads[z]->Join();
+        delete theThreads[z];
+    }
+    theShards.CollectRTPCounts(&theBytes, &thePackets, &thePacketsLost);
+    theTotalBytes += theBytes;
+    theTotalPackets += thePackets;
+    theTotalPacketsLost += thePacketsLost;
+    
+    //The threads past the last shard count through the shared counters
+    TEST_CHECK(theShards.GetNumShardsInUse() == RTPStatsShards::kMaxShards);
+    
+    UInt64 theExpectedBytes = (UInt64)kNumCountsPerThread * ((kNumCountingThreads * (kNumCountingThreads + 1)) / 2);
+    TEST_CHECK(theTotalBytes == theExpectedBytes);
+    TEST_CHECK(theTotalPackets == (UInt64)kNumCountsPerThread * kNumCountingThreads);
+    TEST_CHECK(theTotalPacketsLost == (UInt64)(kNumCountsPerThread / 100) * kNumCountingThreads);
+    
+    //Each thread's wastage sits in its own shard, and this thread frees all of it
+    UInt32 theWastedBytes = 100 * ((kNumCountingThreads * (kNumCountingThreads + 1)) / 2);
+    TEST_CHECK(theShards.GetRetransmitWastedBytes() == theWastedBytes);
+    theShards.AlterRetransmitWastedBytes(-(SInt32)theWastedBytes);
+    TEST_CHECK(theShards.GetRetransmitWastedBytes() == 0);
+}
+
+//
+// Benchmark: every thread counting a packet into its shard, against
+// every thread doing atomic_adds on the same counters, from 1 thread up to
+// one for each shard
+enum { kNumBenchThreads = RTPStatsShards::kMaxShards, kNumBenchCounts = 500000 };
+
+static unsigned int sSharedBytes = 0;
+static unsigned int sSharedPackets = 0;
+
+class BenchThread : public OSThread
+{
+    public:
+        BenchThread(RTPStatsShards* inShards) : fShards(inShards), fTime(0) {}
+        
+        virtual void Entry()
+        {
+            SInt64 theStart = OS::Microseconds();
+            for (UInt32 x = 0; x < kNumBenchCounts; x++)
+            {
+                if (fShards != NULL)
+                {
+                    fShards->AddRTPBytes(1400);
+                    fShards->AddRTPPackets(1);
+                }
+                else
+                {
+                    (void)atomic_add(&sSharedBytes, 1400);
+                    (void)atomic_add(&sSharedPackets, 1);
+                }
+            }
+            fTime = OS::Microseconds() - theStart;
+        }
+        
+        RTPStatsShards* fShards;
+        SInt64          fTime;
+};
+
+static SInt64 RunBenchThreads(UInt32 inNumThreads, RTPStatsShards* inShards)
+{
+    BenchThread* theThreads[kNumBenchThreads];
+    for (UInt32 x = 0; x < inNumThreads; x++)
+    {
+        theThreads[x] = new BenchThread(inShards);
+        theThreads[x]->Start();
+    }
+    SInt64 theTime = 1;
+    for (UInt32 y = 0; y < inNumThreads; y++)
+    {
+        theThreads[y]->Join();
+        if (theThreads[y]->fTime > theTime)
+            theTime = theThreads[y]->fTime;
+        delete theThreads[y];
+    }
+    return theTime;
+}
+
+static void RunBenchmark()
+{
+    for (UInt32 theNumThreads = 1; theNumThreads <= kNumBenchThreads; theNumThreads *= 2)
+    {
+        RTPStatsShards theShards;
+        SInt64 theAtomicTime = RunBenchThreads(theNumThreads, NULL);
+        SInt64 theShardTime = RunBenchThreads(theNumThreads, &theShards);
+        ::printf("RTPStatsShardsTest: %lu threads: atomic_add %.1fM packets/sec, shards %.1fM packets/sec\n", theNumThreads,
+                    ((Float64)kNumBenchCounts * theNumThreads) / theAtomicTime, ((Float64)kNumBenchCounts * theNumThreads) / theShardTime);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    
+    CheckOneThread();
+    CheckSeparateTables();
+    CheckManyThreads();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    return TestResult("RTPStatsShardsTest");
+}
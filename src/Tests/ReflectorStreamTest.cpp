@@ -0,0 +1,420 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// ReflectorStreamTest:
+//   Adds and removes outputs on two threads while a third reflects packets
+//   to them, the way RTSP threads and a ReflectorSocket share a stream.
+//   Once RemoveOutput returns, the sender must never write to that output
+//   again, including while the bucket array is being grown underneath a
+//   walk, and an output that stays must get every packet, in order, from
+//   the first one it was given. The same goes for streams split over the
+//   fan-out threads, where no output may be written by two slices at once. Also feeds the key frame parser H.264 and MPEG-4 payloads, with
+//   CSRCs, header extensions and padding, including padding that claims more
+//   than the packet has. With -b, prints how long adds and removes take
+//   under walks.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "ReflectorStream.h"
+#include "atomic.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumChurnThreads = 2,           //UInt32
+    kNumOutputsPerThread = 600,     //UInt32. enough for the bucket array to grow several times
+    kNumRounds = 5,                 //UInt32. each round grows a new stream's array from scratch
+    kNumFanOutRounds = 3,           //UInt32. more rounds, split over the fan-out threads
+    kNumFanOutThreads = 3,          //UInt32
+    kFanOutMinOutputs = 32,         //UInt32. low enough that most walks are split
+    kNumCyclesPerRound = 2000,      //UInt32. adds plus removes, over all the churn threads
+    kPacketLifeInMsec = 1000,       //SInt64. how long a packet stays queued
+    kWriteSpins = 200,              //UInt32
+    kChurnSleepInUSec = 50          //UInt32
+};
+
+static OSThread*            sWalkThread = NULL;
+
+class TestOutput : public ReflectorOutput
+{
+    public:
+    
+        TestOutput() : fRemoved(true), fNumWrites(0), fNumWritesAfterRemove(0), fNumGaps(0), fLongestRun(0),
+                        fNumOverlappingWrites(0), fNumFanOutWrites(0), fWriting(0), fRunLength(0), fFirstSeqNum(0), fLastSeqNum(0), fLastPacketID(0)
+            { this->InititializeBookmarks(1); }
+        virtual ~TestOutput() {}
+        
+        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* /*inStreamCookie*/, UInt32 /*inFlags*/, SInt64 /*packetLatenessInMSec*/,
+                                        SInt64* /*timeToSendThisPacketAgain*/, UInt64* packetIDPtr, SInt64* /*arrivalTimeMSec*/)
+        {
+            //Take about as long as a real send, so a remove has time to overlap
+            //the write. fRemoved is only set once RemoveOutput has returned, so
+            //seeing it at any point in here is a write to a removed output.
+            //Only one thread may be writing to an output at a time.
+            if (atomic_add(&fWriting, 1) != 1)
+                fNumOverlappingWrites++;
+            for (volatile UInt32 theSpin = 0; theSpin < kWriteSpins; theSpin++)
+                { }
+            if (fRemoved)
+                fNumWritesAfterRemove++;
+            if (OSThread::GetCurrent() != sWalkThread)
+                fNumFanOutWrites++;
+            (void)atomic_sub(&fWriting, 1);
+                
+            //A buffered walk starts each output again at its bookmark, the last
+            //packet it was given. Like RTPSessionOutput, skip what was already sent.
+            if (packetIDPtr != NULL)
+            {
+                if ((fRunLength > 0) && (*packetIDPtr <= fLastPacketID))
+                    return QTSS_NoErr;
+                fLastPacketID = *packetIDPtr;
+            }
+            
+            //From its first packet on, an output must get every packet in order
+            UInt16 theSeqNum = 0;
+            ::memcpy(&theSeqNum, inPacket->Ptr + 2, sizeof(theSeqNum));
+            theSeqNum = ntohs(theSeqNum);
+            if (fRunLength == 0)
+                fFirstSeqNum = theSeqNum;
+            else if (theSeqNum != (UInt16)(fLastSeqNum + 1))
+                fNumGaps++;
+            fLastSeqNum = theSeqNum;
+            fRunLength++;
+            if (fRunLength > fLongestRun)
+                fLongestRun = fRunLength;
+            fNumWrites++;
+            return QTSS_NoErr;
+        }
+        virtual void        TearDown()  {}
+        virtual Bool16      IsUDP()     { return true; }
+        virtual Bool16      IsPlaying() { return true; }
+        
+        //Each time it's added, an output starts a new run of packets
+        void    Reset() { ::memset(fBookmarkedPacketsElemsArray, 0, sizeof(OSQueueElem*) * fNumBookmarks); fAvailPosition = 0; fNewOutput = true; fRunLength = 0; }
+        
+        volatile Bool16 fRemoved;
+        UInt32          fNumWrites;
+        UInt32          fNumWritesAfterRemove;
+        UInt32          fNumGaps;
+        UInt32          fLongestRun;
+        UInt32          fNumOverlappingWrites;
+        UInt32          fNumFanOutWrites;
+        unsigned int    fWriting;
+        
+        UInt32          fRunLength;
+        UInt16          fFirstSeqNum;
+        UInt16          fLastSeqNum;
+        UInt64          fLastPacketID;
+};
+
+static ReflectorSocket*     sSocket = NULL;
+static ReflectorStream*     sStream = NULL;
+static TestOutput           sOutputs[kNumChurnThreads][kNumOutputsPerThread];
+static UInt32               sNumWalks = 0;
+static SInt64               sAddTime = 0;
+static SInt64               sRemoveTime = 0;
+
+//
+// Feeds the stream one packet per pass and reflects it, as ReflectorSocket::Run
+// does, with the demuxer mutex held. Packets arrive nearly as old as the
+// buffer, so they are trimmed soon and the queue stays short.
+class WalkThread : public OSThread
+{
+    public:
+    
+        virtual void Entry()
+        {
+            char thePacketData[64];
+            ::memset(thePacketData, 0, sizeof(thePacketData));
+            thePacketData[0] = (char)0x80;
+            OSQueue theFreeQueue;
+            
+            for (UInt16 theSeqNum = 0; !this->IsStopRequested(); theSeqNum++)
+            {
+                //A ReflectorSocket waits for its next packet between passes. Give the
+                //churn threads the same chance to get at the bucket lock.
+                OSThread::ThreadYield();
+                
+                OSMutexLocker locker(sSocket->GetDemuxer()->GetMutex());
+                ReflectorPacket* thePacket = NULL;
+                if (theFreeQueue.GetLength() > 0)
+                    thePacket = (ReflectorPacket*)theFreeQueue.DeQueue()->GetEnclosingObject();
+                else
+                    thePacket = sSocket->GetPacket();
+                    
+                thePacketData[2] = (char)(theSeqNum >> 8);
+                thePacketData[3] = (char)theSeqNum;
+                thePacket->SetPacketData(thePacketData, sizeof(thePacketData));
+                (void)sSocket->ProcessPacket(OS::Milliseconds() - ReflectorStream::sOverBufferInMsec + kPacketLifeInMsec, thePacket, 0, 0);
+                
+                SInt64 theWakeupTime = 0;
+                sStream->GetRTPSender()->ReflectPackets(&theWakeupTime, &theFreeQueue);
+                sNumWalks++;
+            }
+            
+            //Everything left was queued before the last pass trimmed it
+            while (theFreeQueue.GetLength() > 0)
+                delete (ReflectorPacket*)theFreeQueue.DeQueue()->GetEnclosingObject();
+        }
+};
+
+class ChurnThread : public OSThread
+{
+    public:
+    
+        ChurnThread(UInt32 inIndex, UInt32 inRound) : fIndex(inIndex), fRandomSeed((inRound * kNumChurnThreads) + inIndex + 1) {}
+        
+        virtual void Entry()
+        {
+            for (UInt32 theCycle = 0; theCycle < kNumCyclesPerRound / kNumChurnThreads; theCycle++)
+            {
+                TestOutput* theOutput = &sOutputs[fIndex][this->Random(kNumOutputsPerThread)];
+                SInt64 theStart = OS::Microseconds();
+                if (theOutput->fRemoved)
+                {
+                    theOutput->Reset();
+                    theOutput->fRemoved = false;
+                    TEST_CHECK(sStream->AddOutput(theOutput, -1) >= 0);
+                    fAddTime += OS::Microseconds() - theStart;
+                }
+                else
+                {
+                    sStream->RemoveOutput(theOutput);
+                    
+                    //From here on the output is as good as deleted
+                    theOutput->fRemoved = true;
+                    fRemoveTime += OS::Microseconds() - theStart;
+                }
+                
+                //Waking up from a short sleep tends to preempt the walk part way
+                //through, even on one processor, which is when the walk and a
+                //change to the outputs overlap.
+                ::usleep(kChurnSleepInUSec);
+            }
+        }
+        
+        UInt32  Random(UInt32 inRange)
+        {
+            fRandomSeed = (fRandomSeed * 1103515245) + 12345;
+            return (fRandomSeed >> 8) % inRange;
+        }
+        
+        UInt32  fIndex;
+        UInt32  fRandomSeed;
+        SInt64  fAddTime;
+        SInt64  fRemoveTime;
+};
+
+static void RunRound(UInt32 inRound, Bool16 inEnableBuffer)
+{
+    SourceInfo::StreamInfo theInfo;
+    theInfo.fPayloadType = qtssUnknownPayloadType;
+    sStream = new ReflectorStream(&theInfo);
+    
+    //Relays walk the outputs in ReflectRelayPackets, everything else in ReflectToBucket
+    sStream->SetEnableBuffer(inEnableBuffer);
+    sSocket->AddSender(sStream->GetRTPSender());
+    
+    WalkThread theWalker;
+    sWalkThread = &theWalker;
+    theWalker.Start();
+    
+    ChurnThread* theChurners[kNumChurnThreads];
+    for (UInt32 x = 0; x < kNumChurnThreads; x++)
+    {
+        theChurners[x] = new ChurnThread(x, inRound);
+        theChurners[x]->fAddTime = 0;
+        theChurners[x]->fRemoveTime = 0;
+        theChurners[x]->Start();
+    }
+    for (UInt32 y = 0; y < kNumChurnThreads; y++)
+    {
+        theChurners[y]->Join();
+        sAddTime += theChurners[y]->fAddTime;
+        sRemoveTime += theChurners[y]->fRemoveTime;
+        delete theChurners[y];
+    }
+    
+    theWalker.StopAndWaitForThread();
+    
+    for (UInt32 x = 0; x < kNumChurnThreads; x++)
+    {
+        for (UInt32 y = 0; y < kNumOutputsPerThread; y++)
+        {
+            if (!sOutputs[x][y].fRemoved)
+            {
+                sStream->RemoveOutput(&sOutputs[x][y]);
+                sOutputs[x][y].fRemoved = true;
+            }
+        }
+    }
+    sSocket->RemoveSender(sStream->GetRTPSender());
+    delete sStream;
+    sStream = NULL;
+}
+
+//
+// The packets are written out in hex, so they read like a capture
+struct KeyFrameCase
+{
+    UInt32      fFormat;
+    Bool16      fStartsAccessUnit;
+    const char* fHexPacket;
+    Bool16      fIsKeyFrame;
+};
+
+static const KeyFrameCase sKeyFrameCases[] =
+{
+    //H.264: single NAL units
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "65aa", true },    //IDR slice
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "41aa", false },   //non-IDR slice
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "67aa", true },    //SPS
+    //H.264: STAP-A, with and without an SPS among the aggregated units
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "180002090000026742", true },
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "18000209000002419a", false },
+    //H.264: FU-A, only the start of an IDR slice counts
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "7c85aa", true },
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "7c05aa", false },
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001" "7c41aa", false },
+    //A CSRC and a header extension before the payload
+    { ReflectorSender::kH264KeyFrames, false, "816000010000000000000001" "00000002" "65aa", true },
+    { ReflectorSender::kH264KeyFrames, false, "906000010000000000000001" "0000000100000000" "65aa", true },
+    //Headers that run past the end of the packet
+    { ReflectorSender::kH264KeyFrames, false, "8060000100000000000001", false },
+    { ReflectorSender::kH264KeyFrames, false, "806000010000000000000001", false },
+    { ReflectorSender::kH264KeyFrames, false, "906000010000000000000001" "00000005" "65aa", false },
+    { ReflectorSender::kH264KeyFrames, false, "8f6000010000000000000001" "65aa", false },
+    //Padding: the IDR slice is only in the padding, so the STAP-A has none
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "650002", true },
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "18000241aa" "0002650005", false },
+    //Padding lengths of 0, of the whole payload, and of more than the packet
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "65aa00", false },
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "65aa03", false },
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "65aaff", false },
+    { ReflectorSender::kH264KeyFrames, false, "a06000010000000000000001" "18000265ff", false },
+    //MPEG-4: the VOP's coding type, or a VOS header before it
+    { ReflectorSender::kMPEG4KeyFrames, true, "806000010000000000000001" "000001b62233", true },
+    { ReflectorSender::kMPEG4KeyFrames, true, "806000010000000000000001" "000001b66233", false },
+    { ReflectorSender::kMPEG4KeyFrames, true, "806000010000000000000001" "000001b0f5000001b6", true },
+    { ReflectorSender::kMPEG4KeyFrames, false, "806000010000000000000001" "000001b62233", false },
+    { ReflectorSender::kMPEG4KeyFrames, true, "a06000010000000000000001" "000001b62233" "0000000000000008", true },
+    { ReflectorSender::kMPEG4KeyFrames, true, "a06000010000000000000001" "000001" "b6223304", false }
+};
+
+static void CheckKeyFrames()
+{
+    SourceInfo::StreamInfo theInfo;
+    theInfo.fPayloadType = qtssUnknownPayloadType;
+    ReflectorStream* theStream = new ReflectorStream(&theInfo);
+    ReflectorSender* theSender = theStream->GetRTPSender();
+    
+    for (UInt32 x = 0; x < sizeof(sKeyFrameCases) / sizeof(KeyFrameCase); x++)
+    {
+        //Copied to a buffer of its own length, so a read past the end shows up under a memory checker
+        const char* theHex = sKeyFrameCases[x].fHexPacket;
+        UInt32 theLen = ::strlen(theHex) / 2;
+        UInt8* thePacket = new UInt8[theLen];
+        for (UInt32 y = 0; y < theLen; y++)
+        {
+            unsigned int theByte = 0;
+            (void)::sscanf(&theHex[y * 2], "%2x", &theByte);
+            thePacket[y] = (UInt8)theByte;
+        }
+        
+        StrPtrLen thePacketPtr((char*)thePacket, theLen);
+        theSender->fKeyFrameFormat = sKeyFrameCases[x].fFormat;
+        Bool16 theIsKeyFrame = theSender->IsKeyFrameData(&thePacketPtr, sKeyFrameCases[x].fStartsAccessUnit);
+        if (theIsKeyFrame != sKeyFrameCases[x].fIsKeyFrame)
+            ::printf("ReflectorStreamTest: key frame case %lu (%s) got %d\n", x, theHex, theIsKeyFrame);
+        TEST_CHECK(theIsKeyFrame == sKeyFrameCases[x].fIsKeyFrame);
+        delete [] thePacket;
+    }
+    
+    theSender->fKeyFrameFormat = ReflectorSender::kNoKeyFrames;
+    delete theStream;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    Socket::Initialize();
+    
+    sSocket = new ReflectorSocket();
+    sSocket->SetSSRCFilter(false, 0);
+    
+    CheckKeyFrames();
+    
+    for (UInt32 theRound = 0; theRound < kNumRounds; theRound++)
+        RunRound(theRound, (theRound % 2) == 0);
+        
+    //Split the walks over the fan-out threads. Only buffered streams are split.
+    ReflectorFanOutThread::Initialize(kNumFanOutThreads, kFanOutMinOutputs);
+    for (UInt32 theFanOutRound = 0; theFanOutRound < kNumFanOutRounds; theFanOutRound++)
+        RunRound(kNumRounds + theFanOutRound, true);
+    
+    UInt32 theNumWrites = 0;
+    UInt32 theNumFanOutWrites = 0;
+    UInt32 theLongestRun = 0;
+    for (UInt32 x = 0; x < kNumChurnThreads; x++)
+    {
+        for (UInt32 y = 0; y < kNumOutputsPerThread; y++)
+        {
+            TEST_CHECK(sOutputs[x][y].fNumWritesAfterRemove == 0);
+            TEST_CHECK(sOutputs[x][y].fNumGaps == 0);
+            TEST_CHECK(sOutputs[x][y].fNumOverlappingWrites == 0);
+            
+            //The last run ends where it started, plus the number of packets in it
+            TestOutput* theOutput = &sOutputs[x][y];
+            if (theOutput->fRunLength > 0)
+                TEST_CHECK((UInt16)(theOutput->fLastSeqNum - theOutput->fFirstSeqNum + 1) == (UInt16)theOutput->fRunLength);
+            theNumWrites += sOutputs[x][y].fNumWrites;
+            theNumFanOutWrites += sOutputs[x][y].fNumFanOutWrites;
+            if (sOutputs[x][y].fLongestRun > theLongestRun)
+                theLongestRun = sOutputs[x][y].fLongestRun;
+        }
+    }
+    
+    //Make sure the walks really did reach the outputs
+    TEST_CHECK(sNumWalks > 0);
+    TEST_CHECK(theNumWrites > 0);
+    TEST_CHECK(theLongestRun > 1);
+    TEST_CHECK(theNumFanOutWrites > 0);
+    
+    if (TestWantsBenchmarks(argc, argv))
+    {
+        UInt32 theNumCycles = (kNumRounds + kNumFanOutRounds) * kNumCyclesPerRound;
+        ::printf("ReflectorStreamTest: %lu add/remove cycles, %lu walks, %lu packets written, %lu writes on fan-out threads\n",
+                    theNumCycles, sNumWalks, theNumWrites, theNumFanOutWrites);
+        ::printf("ReflectorStreamTest: %llu ns per add or remove, on average, during walks\n",
+                    (unsigned long long)(((sAddTime + sRemoveTime) * 1000) / theNumCycles));
+    }
+    
+    return TestResult("ReflectorStreamTest");
+}
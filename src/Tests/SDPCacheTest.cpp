@@ -0,0 +1,336 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// SDPCacheTest:
+//   Adds and looks up DESCRIBE SDPs the way QTSSFileModule does. A lookup
+//   must return the SDP cached for its key and the place of the o= line's
+//   session ID, an SDP made from an older version of the movie must be
+//   dropped, and the least recently used SDP must be evicted once the cache
+//   is full, including while several threads use it. The o= line of an SDP
+//   sent from the cache must carry the new session ID in place of the old
+//   one. With -b, times lookups on several threads.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "OSMemory.h"
+#include "OSArrayObjectDeleter.h"
+#include "SDPCache.h"
+#include "TestUtils.h"
+
+static char sModDateStr[DateBuffer::kDateBufferLen + 1] = "Fri, 16 Oct 2026 23:39:27 GMT";
+
+//
+// An SDP the way DoDescribe writes it, with the key in the s= line so a
+// lookup can tell whose SDP it got back
+static char* MakeSDP(const char* inKey, UInt32* outLen)
+{
+    char theSDP[512];
+    qtss_sprintf(theSDP, "v=0\r\no=StreamingServer 3390134400 1160000000000 IN IP4 10.0.0.1\r\ns=%s\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\na=control:*\r\n", inKey);
+    *outLen = ::strlen(theSDP);
+    char* theCopy = NEW char[*outLen];
+    ::memcpy(theCopy, theSDP, *outLen);
+    return theCopy;
+}
+
+static void AddSDP(SDPCache* inCache, const char* inKey, SInt64 inModDate)
+{
+    UInt32 theLen = 0;
+    char* theSDP = MakeSDP(inKey, &theLen);
+    inCache->Add(inKey, inModDate, sModDateStr, theSDP, theLen);
+}
+
+//
+// Returns whether inKey's SDP is cached for this mod date, and checks that it's the right one
+static Bool16 HasSDP(SDPCache* inCache, const char* inKey, SInt64 inModDate)
+{
+    UInt32 theLen = 0, theSessionIDOffset = 0, theSessionIDLen = 0;
+    char theModDateStr[DateBuffer::kDateBufferLen];
+    char* theSDP = inCache->Get(inKey, inModDate, &theLen, &theSessionIDOffset, &theSessionIDLen, theModDateStr);
+    if (theSDP == NULL)
+        return false;
+        
+    UInt32 theExpectedLen = 0;
+    char* theExpectedSDP = MakeSDP(inKey, &theExpectedLen);
+    TEST_CHECK((theLen == theExpectedLen) && (::memcmp(theSDP, theExpectedSDP, theLen) == 0));
+    TEST_CHECK((theSessionIDLen == 10) && (::memcmp(theSDP + theSessionIDOffset, "3390134400", 10) == 0));
+    TEST_CHECK(::memcmp(theModDateStr, sModDateStr, DateBuffer::kDateBufferLen) == 0);
+    delete [] theSDP;
+    delete [] theExpectedSDP;
+    return true;
+}
+
+static void CheckGetAndAdd()
+{
+    SDPCache theCache;
+    TEST_CHECK(!HasSDP(&theCache, "/movies/a.mov", 100));
+    AddSDP(&theCache, "/movies/a.mov", 100);
+    AddSDP(&theCache, "/movies/b.mov", 100);
+    TEST_CHECK(theCache.GetNumEntries() == 2);
+    TEST_CHECK(HasSDP(&theCache, "/movies/a.mov", 100));
+    TEST_CHECK(HasSDP(&theCache, "/movies/b.mov", 100));
+    TEST_CHECK(!HasSDP(&theCache, "/movies/c.mov", 100));
+    TEST_CHECK((theCache.GetNumHits() == 2) && (theCache.GetNumMisses() == 2));
+    
+    //Adding the same key again replaces the old SDP
+    AddSDP(&theCache, "/movies/a.mov", 100);
+    TEST_CHECK(theCache.GetNumEntries() == 2);
+    TEST_CHECK(HasSDP(&theCache, "/movies/a.mov", 100));
+    
+    //Once the movie changes, its SDP is gone
+    TEST_CHECK(!HasSDP(&theCache, "/movies/a.mov", 200));
+    TEST_CHECK(theCache.GetNumEntries() == 1);
+    TEST_CHECK(!HasSDP(&theCache, "/movies/a.mov", 100));
+    
+    theCache.Flush();
+    TEST_CHECK(theCache.GetNumEntries() == 0);
+    TEST_CHECK(!HasSDP(&theCache, "/movies/b.mov", 100));
+}
+
+static void CheckNoOwnerLine()
+{
+    //An SDP without the o= line the module writes is sent as it is
+    SDPCache theCache;
+    char* theSDP = NEW char[16];
+    ::memcpy(theSDP, "v=0\r\ns=x\r\n", 10);
+    theCache.Add("/movies/x.mov", 1, sModDateStr, theSDP, 10);
+    
+    UInt32 theLen = 0, theSessionIDOffset = 1, theSessionIDLen = 1;
+    char theModDateStr[DateBuffer::kDateBufferLen];
+    char* theCopy = theCache.Get("/movies/x.mov", 1, &theLen, &theSessionIDOffset, &theSessionIDLen, theModDateStr);
+    TEST_CHECK(theCopy != NULL);
+    TEST_CHECK((theLen == 10) && (theSessionIDOffset == 0) && (theSessionIDLen == 0));
+    delete [] theCopy;
+}
+
+//
+// Returns the SDP ReplaceSessionID points the vectors at
+static UInt32 GatherSDP(iovec* inVecs, char* outSDP)
+{
+    UInt32 theLen = 0;
+    for (UInt32 x = 0; x < 3; x++)
+    {
+        ::memcpy(outSDP + theLen, inVecs[x].iov_base, inVecs[x].iov_len);
+        theLen += inVecs[x].iov_len;
+    }
+    outSDP[theLen] = '\0';
+    return theLen;
+}
+
+static void CheckSessionID()
+{
+    SDPCache theCache;
+    AddSDP(&theCache, "/movies/a.mov", 100);
+    UInt32 theLen = 0, theSessionIDOffset = 0, theSessionIDLen = 0;
+    char theModDateStr[DateBuffer::kDateBufferLen];
+    OSCharArrayDeleter theSDP(theCache.Get("/movies/a.mov", 100, &theLen, &theSessionIDOffset, &theSessionIDLen, theModDateStr));
+    TEST_CHECK(theSDP.GetObject() != NULL);
+    
+    //The session ID is an NTP time, the way SendCachedDescribe makes it
+    char theSessionID[SDPCache::kSessionIDBufferLen];
+    iovec theVecs[3];
+    char theSentSDP[512];
+    SInt64 theNTPTime = (SInt64)1791000000 + 2208988800LU;
+    UInt32 theSendLen = SDPCache::ReplaceSessionID(theSDP.GetObject(), theLen, theSessionIDOffset, theSessionIDLen,
+                                                    theNTPTime, theSessionID, theVecs);
+    TEST_CHECK(::strcmp(theSessionID, "3999988800") == 0);
+    TEST_CHECK(GatherSDP(theVecs, theSentSDP) == theSendLen);
+    TEST_CHECK(theSendLen == theLen);
+    char* theOwnerLine = ::strstr(theSentSDP, "o=");
+    char* theOwnerLineEnd = ::strstr(theSentSDP, "\r\ns=");
+    TEST_CHECK((theOwnerLine != NULL) && (theOwnerLineEnd != NULL));
+    if ((theOwnerLine != NULL) && (theOwnerLineEnd != NULL))
+    {
+        static const char* sExpectedOwnerLine = "o=StreamingServer 3999988800 1160000000000 IN IP4 10.0.0.1";
+        TEST_CHECK((UInt32)(theOwnerLineEnd - theOwnerLine) == ::strlen(sExpectedOwnerLine));
+        TEST_CHECK(::strncmp(theOwnerLine, sExpectedOwnerLine, ::strlen(sExpectedOwnerLine)) == 0);
+    }
+    
+    //The rest of the SDP is untouched
+    UInt32 theExpectedLen = 0;
+    OSCharArrayDeleter theExpectedSDP(MakeSDP("/movies/a.mov", &theExpectedLen));
+    TEST_CHECK(::memcmp(theSentSDP, theExpectedSDP.GetObject(), theSessionIDOffset) == 0);
+    TEST_CHECK(::memcmp(theSentSDP + theSessionIDOffset + 10, theExpectedSDP.GetObject() + theSessionIDOffset + 10,
+                        theExpectedLen - (theSessionIDOffset + 10)) == 0);
+    
+    //Session IDs of any length fit, unpadded
+    theSendLen = SDPCache::ReplaceSessionID(theSDP.GetObject(), theLen, theSessionIDOffset, theSessionIDLen,
+                                                kSInt64_Max, theSessionID, theVecs);
+    TEST_CHECK(::strcmp(theSessionID, "9223372036854775807") == 0);
+    TEST_CHECK(theSendLen == theLen + 9);
+    TEST_CHECK(GatherSDP(theVecs, theSentSDP) == theSendLen);
+    TEST_CHECK(::strstr(theSentSDP, "o=StreamingServer 9223372036854775807 1160000000000 IN IP4 10.0.0.1\r\n") != NULL);
+    theSendLen = SDPCache::ReplaceSessionID(theSDP.GetObject(), theLen, theSessionIDOffset, theSessionIDLen,
+                                                7, theSessionID, theVecs);
+    TEST_CHECK((::strcmp(theSessionID, "7") == 0) && (theSendLen == theLen - 9));
+    
+    //Without an o= line the SDP goes out as it is
+    char theBareSDP[] = "v=0\r\ns=x\r\n";
+    theSendLen = SDPCache::ReplaceSessionID(theBareSDP, 10, 0, 0, theNTPTime, theSessionID, theVecs);
+    TEST_CHECK((theSendLen == 10) && (theVecs[1].iov_len == 0));
+    TEST_CHECK((GatherSDP(theVecs, theSentSDP) == 10) && (::strcmp(theSentSDP, theBareSDP) == 0));
+}
+
+static void CheckEviction()
+{
+    SDPCache theCache(3);
+    AddSDP(&theCache, "a", 1);
+    AddSDP(&theCache, "b", 1);
+    AddSDP(&theCache, "c", 1);
+    
+    //Looking up a makes b the least recently used
+    TEST_CHECK(HasSDP(&theCache, "a", 1));
+    AddSDP(&theCache, "d", 1);
+    TEST_CHECK(theCache.GetNumEntries() == 3);
+    TEST_CHECK(!HasSDP(&theCache, "b", 1));
+    TEST_CHECK(HasSDP(&theCache, "a", 1) && HasSDP(&theCache, "c", 1) && HasSDP(&theCache, "d", 1));
+    
+    //Far more keys than buckets or entries
+    SDPCache theBigCache;
+    enum { kNumKeys = SDPCache::kDefaultMaxEntries + 1000 };
+    char theKey[32];
+    for (UInt32 x = 0; x < kNumKeys; x++)
+    {
+        qtss_sprintf(theKey, "/movies/%lu.mov", x);
+        AddSDP(&theBigCache, theKey, 1);
+    }
+    TEST_CHECK(theBigCache.GetNumEntries() == SDPCache::kDefaultMaxEntries);
+    for (UInt32 y = 0; y < kNumKeys; y++)
+    {
+        qtss_sprintf(theKey, "/movies/%lu.mov", y);
+        TEST_CHECK(HasSDP(&theBigCache, theKey, 1) == (y >= kNumKeys - SDPCache::kDefaultMaxEntries));
+    }
+}
+
+//
+// Several threads look up and add SDPs for more movies than fit, the
+// way task threads handle DESCRIBEs
+enum { kNumCacheThreads = 4, kNumThreadMovies = 64, kNumThreadOps = 50000 };
+
+static UInt32 Random(UInt32* ioSeed, UInt32 inRange)
+{
+    *ioSeed = (*ioSeed * 1103515245) + 12345;
+    return (*ioSeed >> 8) % inRange;
+}
+
+class DescribeThread : public OSThread
+{
+    public:
+        DescribeThread(SDPCache* inCache, UInt32 inIndex, UInt32 inNumOps, Bool16 inCheck)
+            : fCache(inCache), fSeed(inIndex + 1), fNumOps(inNumOps), fCheck(inCheck), fTime(0) {}
+        
+        virtual void Entry()
+        {
+            char theKey[32];
+            char theModDateStr[DateBuffer::kDateBufferLen];
+            SInt64 theStart = OS::Microseconds();
+            for (UInt32 x = 0; x < fNumOps; x++)
+            {
+                qtss_sprintf(theKey, "/movies/%lu.mov", Random(&fSeed, kNumThreadMovies));
+                if (fCheck)
+                {
+                    if (!HasSDP(fCache, theKey, 1))
+                        AddSDP(fCache, theKey, 1);
+                    continue;
+                }
+                
+                UInt32 theLen = 0, theSessionIDOffset = 0, theSessionIDLen = 0;
+                char* theSDP = fCache->Get(theKey, 1, &theLen, &theSessionIDOffset, &theSessionIDLen, theModDateStr);
+                if (theSDP == NULL)
+                    AddSDP(fCache, theKey, 1);
+                delete [] theSDP;
+            }
+            fTime = OS::Microseconds() - theStart;
+        }
+        
+        SDPCache*   fCache;
+        UInt32      fSeed;
+        UInt32      fNumOps;
+        Bool16      fCheck;
+        SInt64      fTime;
+};
+
+static SInt64 RunDescribeThreads(SDPCache* inCache, UInt32 inNumThreads, UInt32 inNumOps, Bool16 inCheck)
+{
+    DescribeThread* theThreads[kNumCacheThreads];
+    for (UInt32 x = 0; x < inNumThreads; x++)
+    {
+        theThreads[x] = new DescribeThread(inCache, x, inNumOps, inCheck);
+        theThreads[x]->Start();
+    }
+    SInt64 theTime = 1;
+    for (UInt32 y = 0; y < inNumThreads; y++)
+    {
+        theThreads[y]->Join();
+        if (theThreads[y]->fTime > theTime)
+            theTime = theThreads[y]->fTime;
+        delete theThreads[y];
+    }
+    return theTime;
+}
+
+static void CheckThreads()
+{
+    //Room for half the movies, so there is plenty of eviction
+    SDPCache theCache(kNumThreadMovies / 2);
+    (void)RunDescribeThreads(&theCache, kNumCacheThreads, kNumThreadOps, true);
+    TEST_CHECK(theCache.GetNumEntries() <= kNumThreadMovies / 2);
+    TEST_CHECK(theCache.GetNumHits() + theCache.GetNumMisses() == kNumCacheThreads * kNumThreadOps);
+    TEST_CHECK(theCache.GetNumHits() > 0);
+}
+
+//
+// Benchmark: DESCRIBEs of a working set that fits in the cache
+static void RunBenchmark()
+{
+    enum { kNumBenchOps = 500000 };
+    for (UInt32 theNumThreads = 1; theNumThreads <= kNumCacheThreads; theNumThreads *= 2)
+    {
+        SDPCache theCache;
+        SInt64 theTime = RunDescribeThreads(&theCache, theNumThreads, kNumBenchOps, false);
+        ::printf("SDPCacheTest: %lu threads: %.2fM lookups/sec, %lu%% hits\n", theNumThreads,
+                    ((Float64)kNumBenchOps * theNumThreads) / theTime,
+                    (theCache.GetNumHits() * 100) / (theCache.GetNumHits() + theCache.GetNumMisses()));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    
+    CheckGetAndAdd();
+    CheckNoOwnerLine();
+    CheckSessionID();
+    CheckEviction();
+    CheckThreads();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    return TestResult("SDPCacheTest");
+}
@@ -0,0 +1,317 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// SampleTableTest:
+//   Looks up every track of the sample movies through the time-to-sample,
+//   sample-to-chunk and sync sample tables, in order and at random, with
+//   fresh and reused control blocks. Every lookup must agree with what the
+//   track's samples give when read one at a time, whatever the control
+//   block last saw. With -b, times seeks against playing straight through.
+
+#include <stdlib.h>
+
+//The QTFile on the stack must match the non-callback QTFileLib build linked in
+#undef DSS_USE_API_CALLBACKS
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "QTFile.h"
+#include "QTTrack.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumMovies = 7,
+    kNumRandomLookups = 20000   //UInt32
+};
+
+static const char* sMovies[kNumMovies] =
+{
+    "../sample_100kbit.mov",
+    "../sample_300kbit.mov",
+    "../sample_100kbit.mp4",
+    "../sample_300kbit.mp4",
+    "../sample_50kbit.3gp",
+    "../sample_h264_100kbit.mp4",
+    "../sample_h264_300kbit.mp4"
+};
+
+static UInt32 sRandomSeed = 1;
+static UInt32 Random(UInt32 inRange)
+{
+    sRandomSeed = (sRandomSeed * 1103515245) + 12345;
+    return (sRandomSeed >> 8) % inRange;
+}
+
+//
+// One track's samples, each looked up on its own with a fresh control block.
+// Sample numbers start at 1. The time-to-sample table answers for one sample
+// past the end, and the sync flags are kept for two, which is as far as the
+// random lookups go.
+struct TrackSamples
+{
+    UInt32      fNumSamples;
+    UInt32*     fMediaTimes;
+    UInt32*     fChunkNumbers;
+    UInt32*     fSamplesPerChunk;
+    UInt32*     fDescriptions;
+    UInt32*     fOffsetsInChunk;
+    Bool16*     fIsSync;
+};
+
+static void ReadSamples(QTTrack* inTrack, TrackSamples* outSamples)
+{
+    //The time-to-sample table also answers for the sample just past the end
+    UInt32 theNumSamples = 0;
+    for (UInt32 theMediaTime = 0; ; theNumSamples++)
+    {
+        QTAtom_stts_SampleTableControlBlock theSTCB;
+        if (!inTrack->GetSampleMediaTime(theNumSamples + 2, &theMediaTime, &theSTCB))
+            break;
+    }
+    outSamples->fNumSamples = theNumSamples;
+    outSamples->fMediaTimes = new UInt32[theNumSamples + 2];
+    outSamples->fChunkNumbers = new UInt32[theNumSamples + 2];
+    outSamples->fSamplesPerChunk = new UInt32[theNumSamples + 2];
+    outSamples->fDescriptions = new UInt32[theNumSamples + 2];
+    outSamples->fOffsetsInChunk = new UInt32[theNumSamples + 2];
+    outSamples->fIsSync = new Bool16[theNumSamples + 3];
+    
+    for (UInt32 theSample = 1; theSample <= theNumSamples + 2; theSample++)
+    {
+        outSamples->fIsSync[theSample] = inTrack->IsSyncSample(theSample, 0);
+        if (theSample > theNumSamples + 1)
+            continue;
+            
+        QTAtom_stts_SampleTableControlBlock theSTCB;
+        TEST_CHECK(inTrack->GetSampleMediaTime(theSample, &outSamples->fMediaTimes[theSample], &theSTCB));
+        if (theSample > 1)
+            TEST_CHECK(outSamples->fMediaTimes[theSample] >= outSamples->fMediaTimes[theSample - 1]);
+            
+        if (theSample > theNumSamples)
+            continue;
+            
+        QTAtom_stsc_SampleTableControlBlock theChunkSTCB;
+        TEST_CHECK(inTrack->SampleToChunkInfo(theSample, &outSamples->fSamplesPerChunk[theSample], &outSamples->fChunkNumbers[theSample],
+                                            &outSamples->fDescriptions[theSample], &outSamples->fOffsetsInChunk[theSample], &theChunkSTCB));
+                                            
+        //Samples fill each chunk in turn
+        TEST_CHECK(outSamples->fOffsetsInChunk[theSample] < outSamples->fSamplesPerChunk[theSample]);
+        if (theSample == 1)
+            TEST_CHECK(outSamples->fOffsetsInChunk[theSample] == 0);
+        else if (outSamples->fChunkNumbers[theSample] == outSamples->fChunkNumbers[theSample - 1])
+            TEST_CHECK(outSamples->fOffsetsInChunk[theSample] == outSamples->fOffsetsInChunk[theSample - 1] + 1);
+        else
+        {
+            TEST_CHECK(outSamples->fChunkNumbers[theSample] == outSamples->fChunkNumbers[theSample - 1] + 1);
+            TEST_CHECK(outSamples->fOffsetsInChunk[theSample] == 0);
+        }
+    }
+}
+
+static void DeleteSamples(TrackSamples* inSamples)
+{
+    delete [] inSamples->fMediaTimes;
+    delete [] inSamples->fChunkNumbers;
+    delete [] inSamples->fSamplesPerChunk;
+    delete [] inSamples->fDescriptions;
+    delete [] inSamples->fOffsetsInChunk;
+    delete [] inSamples->fIsSync;
+}
+
+//
+// The expected answers, from the samples read one at a time. The last sample
+// that starts at or before the time, up to the one just past the end; audio
+// tracks have too many samples for a linear scan.
+static Bool16 FindSampleAtTime(TrackSamples* inSamples, UInt32 inMediaTime, UInt32* outSample)
+{
+    if (inMediaTime > inSamples->fMediaTimes[inSamples->fNumSamples + 1])
+        return false;
+    UInt32 theLow = 1;
+    UInt32 theHigh = inSamples->fNumSamples + 1;
+    while (theLow < theHigh)
+    {
+        UInt32 theMiddle = theLow + ((theHigh - theLow + 1) / 2);
+        if (inSamples->fMediaTimes[theMiddle] <= inMediaTime)
+            theLow = theMiddle;
+        else
+            theHigh = theMiddle - 1;
+    }
+    *outSample = theLow;
+    return true;
+}
+
+static UInt32 FindPreviousSync(TrackSamples* inSamples, UInt32 inSample)
+{
+    for (UInt32 theSample = inSample; theSample > 0; theSample--)
+    {
+        if (inSamples->fIsSync[theSample])
+            return theSample;
+    }
+    return inSample;
+}
+
+static UInt32 FindNextSync(TrackSamples* inSamples, UInt32 inSample)
+{
+    for (UInt32 theSample = inSample + 1; theSample <= inSamples->fNumSamples + 2; theSample++)
+    {
+        if (inSamples->fIsSync[theSample])
+            return theSample;
+    }
+    return inSample + 1;
+}
+
+static void CheckLookups(QTTrack* inTrack, TrackSamples* inSamples, Bool16 inRandom)
+{
+    UInt32 theNumSamples = inSamples->fNumSamples;
+    UInt32 theEndTime = inSamples->fMediaTimes[theNumSamples + 1];
+    QTAtom_stts_SampleTableControlBlock theSTCB;
+    QTAtom_stsc_SampleTableControlBlock theChunkSTCB;
+    UInt32 theNumLookups = inRandom ? kNumRandomLookups : theNumSamples;
+    
+    for (UInt32 x = 0; x < theNumLookups; x++)
+    {
+        //Mostly inside the track, sometimes just past either end
+        UInt32 theSample = inRandom ? Random(theNumSamples + 3) : x + 1;
+        UInt32 theMediaTime = inRandom ? Random(theEndTime + 50) : inSamples->fMediaTimes[x + 1] + Random(2);
+        
+        UInt32 theFoundTime = 0;
+        if ((theSample >= 1) && (theSample <= theNumSamples + 1))
+        {
+            TEST_CHECK(inTrack->GetSampleMediaTime(theSample, &theFoundTime, &theSTCB));
+            TEST_CHECK(theFoundTime == inSamples->fMediaTimes[theSample]);
+        }
+        else if (theSample > theNumSamples + 1)
+            TEST_CHECK(!inTrack->GetSampleMediaTime(theSample, &theFoundTime, &theSTCB));
+            
+        UInt32 theExpectedSample = 0;
+        UInt32 theFoundSample = 0;
+        Bool16 theExpectedResult = FindSampleAtTime(inSamples, theMediaTime, &theExpectedSample);
+        Bool16 theResult = inTrack->GetSampleNumberFromMediaTime(theMediaTime, &theFoundSample, (x & 1) ? &theSTCB : NULL);
+        TEST_CHECK(theResult == theExpectedResult);
+        TEST_CHECK(!theResult || (theFoundSample == theExpectedSample));
+        
+        if ((theSample >= 1) && (theSample <= theNumSamples))
+        {
+            UInt32 theSamplesPerChunk = 0, theChunk = 0, theDescription = 0, theOffset = 0;
+            TEST_CHECK(inTrack->SampleToChunkInfo(theSample, &theSamplesPerChunk, &theChunk, &theDescription, &theOffset, (x % 3) ? &theChunkSTCB : NULL));
+            TEST_CHECK(theChunk == inSamples->fChunkNumbers[theSample]);
+            TEST_CHECK(theSamplesPerChunk == inSamples->fSamplesPerChunk[theSample]);
+            TEST_CHECK(theDescription == inSamples->fDescriptions[theSample]);
+            TEST_CHECK(theOffset == inSamples->fOffsetsInChunk[theSample]);
+        }
+        
+        UInt32 theSyncSample = 0;
+        inTrack->GetPreviousSyncSample(theSample, &theSyncSample);
+        TEST_CHECK(theSyncSample == FindPreviousSync(inSamples, theSample));
+        inTrack->GetNextSyncSample(theSample, &theSyncSample);
+        TEST_CHECK(theSyncSample == FindNextSync(inSamples, theSample));
+    }
+}
+
+static void TestMovie(const char* inPath)
+{
+    QTFile theFile;
+    TEST_CHECK(theFile.Open(inPath) == QTFile::errNoError);
+    
+    QTTrack* theTrack = NULL;
+    UInt32 theNumTracks = 0;
+    while (theFile.NextTrack(&theTrack, theTrack))
+    {
+        TEST_CHECK(theTrack->Initialize() == QTTrack::errNoError);
+        TrackSamples theSamples;
+        ReadSamples(theTrack, &theSamples);
+        TEST_CHECK(theSamples.fNumSamples > 0);
+        TEST_CHECK(theSamples.fIsSync[1]);
+        
+        CheckLookups(theTrack, &theSamples, false);
+        CheckLookups(theTrack, &theSamples, true);
+        DeleteSamples(&theSamples);
+        theNumTracks++;
+    }
+    TEST_CHECK(theNumTracks > 0);
+}
+
+//
+// Benchmark: for each track of a movie, seeks to random times, each with a
+// fresh control block as a new client gets, against the same lookups made
+// in order through one control block, as a playing client makes them
+enum { kNumBenchLookups = 200000 };
+
+static SInt64 TimeLookups(QTTrack* inTrack, UInt32 inEndTime, Bool16 inRandom)
+{
+    QTAtom_stts_SampleTableControlBlock thePlayingSTCB;
+    QTAtom_stsc_SampleTableControlBlock thePlayingChunkSTCB;
+    UInt32 theSum = 0;
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < kNumBenchLookups; x++)
+    {
+        QTAtom_stts_SampleTableControlBlock theSeekSTCB;
+        QTAtom_stsc_SampleTableControlBlock theSeekChunkSTCB;
+        UInt32 theMediaTime = inRandom ? Random(inEndTime) : (UInt32)(((UInt64)inEndTime * x) / kNumBenchLookups);
+        UInt32 theSample = 0, theSyncSample = 0, theChunk = 0;
+        (void)inTrack->GetSampleNumberFromMediaTime(theMediaTime, &theSample, inRandom ? &theSeekSTCB : &thePlayingSTCB);
+        inTrack->GetPreviousSyncSample(theSample, &theSyncSample);
+        (void)inTrack->SampleToChunkInfo(theSyncSample, NULL, &theChunk, NULL, NULL, inRandom ? &theSeekChunkSTCB : &thePlayingChunkSTCB);
+        theSum += theChunk;
+    }
+    SInt64 theTime = OS::Microseconds() - theStart;
+    TEST_CHECK(theSum > 0);
+    return theTime;
+}
+
+static void RunBenchmark()
+{
+    QTFile theFile;
+    (void)theFile.Open(sMovies[1]);
+    QTTrack* theTrack = NULL;
+    while (theFile.NextTrack(&theTrack, theTrack))
+    {
+        (void)theTrack->Initialize();
+        TrackSamples theSamples;
+        ReadSamples(theTrack, &theSamples);
+        UInt32 theEndTime = theSamples.fMediaTimes[theSamples.fNumSamples + 1];
+        SInt64 theSeekTime = TimeLookups(theTrack, theEndTime, true);
+        SInt64 thePlayTime = TimeLookups(theTrack, theEndTime, false);
+        ::printf("SampleTableTest: track %lu, %lu samples: %.1f ns per seek, %.1f ns per lookup playing\n", theTrack->GetTrackID(),
+                    theSamples.fNumSamples, (theSeekTime * 1000.0) / kNumBenchLookups, (thePlayTime * 1000.0) / kNumBenchLookups);
+        DeleteSamples(&theSamples);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    
+    for (UInt32 x = 0; x < kNumMovies; x++)
+        TestMovie(sMovies[x]);
+        
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    return TestResult("SampleTableTest");
+}
@@ -0,0 +1,390 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// TCPSocketTest:
+//   Writes interleaved RTP over loopback TCP the way an RTSP session's
+//   output queue does: a burst of framed packets copied into one of a few
+//   queue buffers, and written with WriteV or WriteVZeroCopy. A buffer sent
+//   zero copy is only filled again once the socket reports its send done.
+//   The reader checks that every packet arrives once, intact and in order,
+//   and every zero copy send must be reported done in the end. With -b,
+//   compares packets per second written one writev per packet against
+//   coalesced bursts.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "TCPSocket.h"
+#include "TestUtils.h"
+
+enum
+{
+    kPacketSize = 1200,         //UInt32
+    kFramedPacketSize = kPacketSize + 4,
+    kPacketsPerBurst = 24,      //UInt32
+    kQueueSize = 32 * 1024,
+    kNumQueues = 4              //UInt32
+};
+
+//
+// The writing end of a loopback connection
+class TestTCPSocket : public TCPSocket
+{
+    public:
+        TestTCPSocket() : TCPSocket(NULL, Socket::kNonBlockingSocketType) {}
+        void    Accept(int inListener)
+        {
+            struct sockaddr_in theAddr;
+            socklen_t theLen = sizeof(theAddr);
+            int theFD = ::accept(inListener, (struct sockaddr*)&theAddr, &theLen);
+            TEST_CHECK(theFD != -1);
+            (void)::fcntl(theFD, F_SETFL, O_NONBLOCK);
+            this->Set(theFD, &theAddr);
+        }
+};
+
+//
+// One connection, with the reader's parse state and the writer's queues
+struct TestConnection
+{
+    TestTCPSocket   fWriter;
+    int             fReader;
+    
+    char            fReadBuffer[kFramedPacketSize];
+    UInt32          fNumInReadBuffer;
+    UInt32          fNumPacketsRead;
+    UInt32          fNumBadPackets;
+    
+    char*           fQueues[kNumQueues];
+    UInt32          fQueueSendIDs[kNumQueues];
+    UInt32          fCurQueue;
+    UInt32          fNumPacketsWritten;
+};
+
+static int          sListener = -1;
+static UInt16       sListenPort = 0;
+
+static void MakeListener()
+{
+    sListener = ::socket(PF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in theAddr;
+    ::memset(&theAddr, 0, sizeof(theAddr));
+    theAddr.sin_family = AF_INET;
+    theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_CHECK(::bind(sListener, (struct sockaddr*)&theAddr, sizeof(theAddr)) == 0);
+    TEST_CHECK(::listen(sListener, 1024) == 0);
+    socklen_t theLen = sizeof(theAddr);
+    TEST_CHECK(::getsockname(sListener, (struct sockaddr*)&theAddr, &theLen) == 0);
+    sListenPort = ntohs(theAddr.sin_port);
+}
+
+static TestConnection* MakeConnection()
+{
+    TestConnection* theConnection = new TestConnection;
+    theConnection->fReader = ::socket(PF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in theAddr;
+    ::memset(&theAddr, 0, sizeof(theAddr));
+    theAddr.sin_family = AF_INET;
+    theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    theAddr.sin_port = htons(sListenPort);
+    TEST_CHECK(::connect(theConnection->fReader, (struct sockaddr*)&theAddr, sizeof(theAddr)) == 0);
+    (void)::fcntl(theConnection->fReader, F_SETFL, O_NONBLOCK);
+    theConnection->fWriter.Accept(sListener);
+    
+    theConnection->fNumInReadBuffer = 0;
+    theConnection->fNumPacketsRead = 0;
+    theConnection->fNumBadPackets = 0;
+    for (UInt32 x = 0; x < kNumQueues; x++)
+    {
+        theConnection->fQueues[x] = new char[kQueueSize];
+        theConnection->fQueueSendIDs[x] = 0;
+    }
+    theConnection->fCurQueue = 0;
+    theConnection->fNumPacketsWritten = 0;
+    return theConnection;
+}
+
+static void DeleteConnection(TestConnection* inConnection)
+{
+    (void)::close(inConnection->fReader);
+    for (UInt32 x = 0; x < kNumQueues; x++)
+        delete [] inConnection->fQueues[x];
+    delete inConnection;
+}
+
+static void FillPacket(char* outPacket, UInt32 inSeqNum)
+{
+    for (UInt32 x = 0; x < kPacketSize; x++)
+        outPacket[x] = (char)(inSeqNum * 7 + x);
+    ::memcpy(outPacket, &inSeqNum, sizeof(inSeqNum));
+}
+
+static void FrameHeader(char* outHeader, UInt32 inSeqNum)
+{
+    outHeader[0] = '$';
+    outHeader[1] = (char)(inSeqNum & 1);
+    outHeader[2] = (char)(kPacketSize >> 8);
+    outHeader[3] = (char)(kPacketSize & 0xFF);
+}
+
+//
+// Reads whatever has arrived, and checks each packet as it completes
+static void ReadPackets(TestConnection* inConnection, Bool16 inCheck)
+{
+    char theBuffer[16 * 1024];
+    SInt32 theLen = 0;
+    while ((theLen = ::read(inConnection->fReader, theBuffer, sizeof(theBuffer))) > 0)
+    {
+        if (!inCheck)
+        {
+            inConnection->fNumPacketsRead += ((UInt32)theLen + inConnection->fNumInReadBuffer) / kFramedPacketSize;
+            inConnection->fNumInReadBuffer = ((UInt32)theLen + inConnection->fNumInReadBuffer) % kFramedPacketSize;
+            continue;
+        }
+        
+        for (SInt32 x = 0; x < theLen; )
+        {
+            UInt32 theCopyLen = kFramedPacketSize - inConnection->fNumInReadBuffer;
+            if (theCopyLen > (UInt32)(theLen - x))
+                theCopyLen = (UInt32)(theLen - x);
+            ::memcpy(&inConnection->fReadBuffer[inConnection->fNumInReadBuffer], &theBuffer[x], theCopyLen);
+            inConnection->fNumInReadBuffer += theCopyLen;
+            x += theCopyLen;
+            if (inConnection->fNumInReadBuffer < kFramedPacketSize)
+                break;
+                
+            char theExpected[kFramedPacketSize];
+            FrameHeader(theExpected, inConnection->fNumPacketsRead);
+            FillPacket(&theExpected[4], inConnection->fNumPacketsRead);
+            if (::memcmp(inConnection->fReadBuffer, theExpected, kFramedPacketSize) != 0)
+                inConnection->fNumBadPackets++;
+            inConnection->fNumPacketsRead++;
+            inConnection->fNumInReadBuffer = 0;
+        }
+    }
+}
+
+//
+// Writes all of inLen, reading the other end whenever the socket is full
+static void WriteAll(TestConnection* inConnection, struct iovec* inVec, UInt32 inNumVectors, UInt32 inLen,
+                        Bool16 inZeroCopy, Bool16 inCheck, UInt32* ioNumWrites)
+{
+    struct iovec theVec[2];
+    Assert(inNumVectors <= 2);
+    ::memcpy(theVec, inVec, inNumVectors * sizeof(struct iovec));
+    struct iovec* theNextVec = theVec;
+    
+    while (inLen > 0)
+    {
+        UInt32 theLenSent = 0;
+        OS_Error theErr = inZeroCopy ? inConnection->fWriter.WriteVZeroCopy(theNextVec, inNumVectors, &theLenSent)
+                                     : inConnection->fWriter.WriteV(theNextVec, inNumVectors, &theLenSent);
+        (*ioNumWrites)++;
+        if (theErr == EAGAIN)
+        {
+            ReadPackets(inConnection, inCheck);
+            continue;
+        }
+        TEST_CHECK(theErr == OS_NoErr);
+        if (theErr != OS_NoErr)
+            return;
+            
+        //Skip what went out
+        inLen -= theLenSent;
+        while ((inNumVectors > 0) && (theLenSent >= theNextVec->iov_len))
+        {
+            theLenSent -= theNextVec->iov_len;
+            theNextVec++;
+            inNumVectors--;
+        }
+        if (inNumVectors > 0)
+        {
+            theNextVec->iov_base = (char*)theNextVec->iov_base + theLenSent;
+            theNextVec->iov_len -= theLenSent;
+        }
+    }
+}
+
+//
+// Returns the next queue buffer the kernel is done with, waiting for one if
+// they are all still being sent, as RTSPSessionInterface's queue does
+static UInt32 GetFreeQueue(TestConnection* inConnection, Bool16 inCheck)
+{
+    for (UInt32 theTry = 0; theTry < 1000; theTry++)
+    {
+        UInt32 theSendsCompleted = inConnection->fWriter.GetZeroCopySendsCompleted();
+        for (UInt32 x = 1; x < kNumQueues; x++)
+        {
+            UInt32 theIndex = (inConnection->fCurQueue + x) % kNumQueues;
+            if (inConnection->fQueueSendIDs[theIndex] <= theSendsCompleted)
+                return theIndex;
+        }
+        ReadPackets(inConnection, inCheck);
+        OSThread::Sleep(1);
+    }
+    TEST_CHECK(false);
+    return (inConnection->fCurQueue + 1) % kNumQueues;
+}
+
+static void WriteBurst(TestConnection* inConnection, Bool16 inCoalesce, Bool16 inZeroCopy, Bool16 inCheck, UInt32* ioNumWrites)
+{
+    if (!inCoalesce)
+    {
+        //One writev per packet, the header and the packet in two pieces
+        for (UInt32 x = 0; x < kPacketsPerBurst; x++)
+        {
+            char theHeader[4];
+            char thePacket[kPacketSize];
+            FrameHeader(theHeader, inConnection->fNumPacketsWritten);
+            FillPacket(thePacket, inConnection->fNumPacketsWritten);
+            struct iovec theVec[2];
+            theVec[0].iov_base = theHeader;
+            theVec[0].iov_len = sizeof(theHeader);
+            theVec[1].iov_base = thePacket;
+            theVec[1].iov_len = kPacketSize;
+            WriteAll(inConnection, theVec, 2, kFramedPacketSize, false, inCheck, ioNumWrites);
+            inConnection->fNumPacketsWritten++;
+        }
+        return;
+    }
+    
+    char* theQueue = inConnection->fQueues[inConnection->fCurQueue];
+    for (UInt32 x = 0; x < kPacketsPerBurst; x++)
+    {
+        FrameHeader(&theQueue[x * kFramedPacketSize], inConnection->fNumPacketsWritten);
+        FillPacket(&theQueue[(x * kFramedPacketSize) + 4], inConnection->fNumPacketsWritten);
+        inConnection->fNumPacketsWritten++;
+    }
+    
+    struct iovec theVec;
+    theVec.iov_base = theQueue;
+    theVec.iov_len = kPacketsPerBurst * kFramedPacketSize;
+    UInt32 theSendsIssued = inConnection->fWriter.GetZeroCopySendsIssued();
+    WriteAll(inConnection, &theVec, 1, kPacketsPerBurst * kFramedPacketSize, inZeroCopy, inCheck, ioNumWrites);
+    if (inConnection->fWriter.GetZeroCopySendsIssued() != theSendsIssued)
+    {
+        //The kernel may still be sending out of this queue. Fill another one.
+        inConnection->fQueueSendIDs[inConnection->fCurQueue] = inConnection->fWriter.GetZeroCopySendsIssued();
+        inConnection->fCurQueue = GetFreeQueue(inConnection, inCheck);
+    }
+}
+
+static void CheckBursts(Bool16 inCoalesce, Bool16 inZeroCopy)
+{
+    enum { kNumConnections = 4, kNumBursts = 200 };
+    TestConnection* theConnections[kNumConnections];
+    for (UInt32 x = 0; x < kNumConnections; x++)
+        theConnections[x] = MakeConnection();
+        
+    UInt32 theNumWrites = 0;
+    for (UInt32 theBurst = 0; theBurst < kNumBursts; theBurst++)
+    {
+        for (UInt32 x = 0; x < kNumConnections; x++)
+            WriteBurst(theConnections[x], inCoalesce, inZeroCopy, true, &theNumWrites);
+    }
+    
+    for (UInt32 x = 0; x < kNumConnections; x++)
+    {
+        TestConnection* theConnection = theConnections[x];
+        for (UInt32 theTry = 0; (theTry < 1000) && (theConnection->fNumPacketsRead < theConnection->fNumPacketsWritten); theTry++)
+        {
+            ReadPackets(theConnection, true);
+            OSThread::Sleep(1);
+        }
+        TEST_CHECK(theConnection->fNumPacketsRead == kNumBursts * kPacketsPerBurst);
+        TEST_CHECK(theConnection->fNumBadPackets == 0);
+        
+        //Every zero copy send is reported done once the data is gone
+        TestTCPSocket* theWriter = &theConnection->fWriter;
+        for (UInt32 theTry = 0; (theTry < 1000) && (theWriter->GetZeroCopySendsCompleted() != theWriter->GetZeroCopySendsIssued()); theTry++)
+            OSThread::Sleep(1);
+        TEST_CHECK(theWriter->GetZeroCopySendsCompleted() == theWriter->GetZeroCopySendsIssued());
+        if (!inZeroCopy)
+            TEST_CHECK(theWriter->GetZeroCopySendsIssued() == 0);
+            
+        DeleteConnection(theConnection);
+    }
+}
+
+//
+// Benchmark: many connections each writing bursts in turn, the way RTP
+// sessions do, with the reading ends emptied as we go
+static void RunBenchmark()
+{
+    enum { kNumConnections = 200, kBenchMsec = 1000 };
+    static const char* sModeNames[] = { "writev per packet", "coalesced", "coalesced, zero copy" };
+    for (UInt32 theMode = 0; theMode < 3; theMode++)
+    {
+        TestConnection* theConnections[kNumConnections];
+        for (UInt32 x = 0; x < kNumConnections; x++)
+            theConnections[x] = MakeConnection();
+        
+        UInt32 theNumWrites = 0;
+        UInt32 theNumPackets = 0;
+        SInt64 theStart = OS::Milliseconds();
+        while (OS::Milliseconds() - theStart < kBenchMsec)
+        {
+            for (UInt32 x = 0; x < kNumConnections; x++)
+            {
+                WriteBurst(theConnections[x], theMode > 0, theMode == 2, false, &theNumWrites);
+                ReadPackets(theConnections[x], false);
+                theNumPackets += kPacketsPerBurst;
+            }
+        }
+        SInt64 theTime = OS::Milliseconds() - theStart;
+        
+        ::printf("TCPSocketTest: %-22s %lu packets/sec (including receive), %.3f writes per packet\n", sModeNames[theMode],
+                    (UInt32)(((SInt64)theNumPackets * 1000) / theTime), (Float32)theNumWrites / theNumPackets);
+        for (UInt32 x = 0; x < kNumConnections; x++)
+            DeleteConnection(theConnections[x]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    MakeListener();
+    
+    CheckBursts(false, false);
+    CheckBursts(true, false);
+    
+    //Where the kernel can't send zero copy, this is the same as the last one
+    CheckBursts(true, true);
+    
+    if (TestWantsBenchmarks(argc, argv))
+        RunBenchmark();
+        
+    (void)::close(sListener);
+    return TestResult("TCPSocketTest");
+}
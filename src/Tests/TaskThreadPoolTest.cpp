@@ -0,0 +1,223 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// TaskThreadPoolTest:
+//   Hogs one task thread with a long Run() and signals a batch of quick
+//   tasks round-robin behind it. The idle threads must steal the ones queued
+//   on the busy thread, so they all run long before the slow one returns.
+//   Tasks that asked for the same thread must never be stolen, and no task
+//   may ever run on two threads at once. With -b, prints how long the quick
+//   tasks took and the dispatch latency the pool reports.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "Task.h"
+#include "atomic.h"
+#include "TestUtils.h"
+
+enum
+{
+    kNumTaskThreads = 4,        //UInt32
+    kNumQuickTasks = 100,       //UInt32
+    kNumPinnedTasks = 16,       //UInt32
+    kNumPinnedRounds = 50,      //UInt32
+    kSlowRunMSecs = 1000        //UInt32
+};
+
+//
+// Sleeps in Run, the way a task blocked on a file read or a lock does
+class SlowTask : public Task
+{
+    public:
+        SlowTask() : fNumRuns(0), fRunStartTime(0), fRunEndTime(0) { this->SetTaskName((char*)"SlowTask"); }
+        
+        virtual SInt64 Run()
+        {
+            (void)this->GetEvents();
+            fRunStartTime = OS::Milliseconds();
+            OSThread::Sleep(kSlowRunMSecs);
+            fRunEndTime = OS::Milliseconds();
+            fNumRuns++;
+            return 0;
+        }
+        
+        volatile UInt32 fNumRuns;
+        volatile SInt64 fRunStartTime;
+        volatile SInt64 fRunEndTime;
+};
+
+//
+// Remembers where and when it ran, and whether it ever found itself
+// already running. A pinned one asks for the same thread every time.
+class QuickTask : public Task
+{
+    public:
+        QuickTask(Bool16 inPinned)
+            : fPinned(inPinned), fPinnedThread(NULL), fInRun(0), fNumRuns(0),
+              fNumOverlaps(0), fNumMoves(0), fRunTime(0) { this->SetTaskName((char*)"QuickTask"); }
+        
+        virtual SInt64 Run()
+        {
+            (void)this->GetEvents();
+            if (atomic_add(&fInRun, 1) != 1)
+                fNumOverlaps++;
+                
+            if (fPinned)
+            {
+                if (fPinnedThread == NULL)
+                    fPinnedThread = OSThread::GetCurrent();
+                else if (fPinnedThread != OSThread::GetCurrent())
+                    fNumMoves++;
+                this->ForceSameThread();
+            }
+            
+            //Give a second signal, or a thief, time to find this task mid-run
+            for (volatile UInt32 theSpin = 0; theSpin < 20000; theSpin++)
+                { }
+            fRunTime = OS::Milliseconds();
+            fNumRuns++;
+            (void)atomic_sub(&fInRun, 1);
+            return 0;
+        }
+        
+        Bool16          fPinned;
+        OSThread*       fPinnedThread;
+        unsigned int    fInRun;
+        volatile UInt32 fNumRuns;
+        UInt32          fNumOverlaps;
+        UInt32          fNumMoves;
+        volatile SInt64 fRunTime;
+};
+
+static Bool16 WaitForRuns(QuickTask** inTasks, UInt32 inNumTasks, UInt32 inNumRuns)
+{
+    for (SInt64 theDeadline = OS::Milliseconds() + (4 * kSlowRunMSecs); OS::Milliseconds() < theDeadline; )
+    {
+        UInt32 x = 0;
+        while ((x < inNumTasks) && (inTasks[x]->fNumRuns >= inNumRuns))
+            x++;
+        if (x == inNumTasks)
+            return true;
+        OSThread::Sleep(1);
+    }
+    return false;
+}
+
+static SInt64 sQuickTasksTime = 0;
+
+static void CheckStealing()
+{
+    SlowTask* theSlowTask = new SlowTask();
+    QuickTask* theQuickTasks[kNumQuickTasks];
+    for (UInt32 x = 0; x < kNumQuickTasks; x++)
+        theQuickTasks[x] = new QuickTask(false);
+    
+    //Signalled round-robin, so about one in four of the quick tasks is
+    //queued on the thread that is stuck in the slow one
+    theSlowTask->Signal(Task::kStartEvent);
+    while (theSlowTask->fRunStartTime == 0)
+        OSThread::Sleep(1);
+        
+    SInt64 theStartTime = OS::Milliseconds();
+    for (UInt32 x = 0; x < kNumQuickTasks; x++)
+        theQuickTasks[x]->Signal(Task::kStartEvent);
+    TEST_CHECK(WaitForRuns(theQuickTasks, kNumQuickTasks, 1));
+    
+    SInt64 theLastRunTime = 0;
+    for (UInt32 y = 0; y < kNumQuickTasks; y++)
+    {
+        TEST_CHECK(theQuickTasks[y]->fNumRuns == 1);
+        if (theQuickTasks[y]->fRunTime > theLastRunTime)
+            theLastRunTime = theQuickTasks[y]->fRunTime;
+    }
+    sQuickTasksTime = theLastRunTime - theStartTime;
+    TEST_CHECK(theLastRunTime < theSlowTask->fRunStartTime + (kSlowRunMSecs / 2));
+    
+    while (theSlowTask->fNumRuns == 0)
+        OSThread::Sleep(1);
+    
+    //A task is gone from the queue it was stolen from, so it runs only once
+    OSThread::Sleep(50);
+    for (UInt32 z = 0; z < kNumQuickTasks; z++)
+        TEST_CHECK(theQuickTasks[z]->fNumRuns == 1);
+}
+
+static void CheckPinnedTasks()
+{
+    enum { kNumSlowTasks = kNumTaskThreads - 1 };
+    SlowTask* theSlowTasks[kNumSlowTasks];
+    for (UInt32 x = 0; x < kNumSlowTasks; x++)
+        theSlowTasks[x] = new SlowTask();
+    QuickTask* thePinnedTasks[kNumPinnedTasks];
+    for (UInt32 y = 0; y < kNumPinnedTasks; y++)
+        thePinnedTasks[y] = new QuickTask(true);
+    
+    //Pinned tasks end up queued behind slow ones while other threads have
+    //nothing to do, and signals can come in while they run
+    for (UInt32 theRound = 0; theRound < kNumPinnedRounds; theRound++)
+    {
+        if ((theRound % 10) == 0)
+        {
+            for (UInt32 x = 0; x < kNumSlowTasks; x++)
+                theSlowTasks[x]->Signal(Task::kStartEvent);
+        }
+        for (UInt32 y = 0; y < kNumPinnedTasks; y++)
+            thePinnedTasks[y]->Signal(Task::kStartEvent);
+        OSThread::Sleep(theRound % 3);
+    }
+    TEST_CHECK(WaitForRuns(thePinnedTasks, kNumPinnedTasks, 1));
+    OSThread::Sleep(kSlowRunMSecs + 100);
+    
+    for (UInt32 z = 0; z < kNumPinnedTasks; z++)
+    {
+        TEST_CHECK(thePinnedTasks[z]->fNumMoves == 0);
+        TEST_CHECK(thePinnedTasks[z]->fNumOverlaps == 0);
+        TEST_CHECK(thePinnedTasks[z]->fNumRuns <= kNumPinnedRounds);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    (void)TaskThreadPool::AddThreads(kNumTaskThreads);
+    
+    CheckStealing();
+    UInt32 theDispatchLatency = TaskThreadPool::GetDispatchLatencyP99InUSecs();
+    TEST_CHECK(theDispatchLatency > 0);
+    TEST_CHECK((theDispatchLatency & (theDispatchLatency - 1)) == 0);
+    
+    CheckPinnedTasks();
+    
+    if (TestWantsBenchmarks(argc, argv))
+        ::printf("TaskThreadPoolTest: %lu quick tasks behind a %lu msec Run() on %lu threads all ran in %lu msec, dispatch p99 %lu usec\n",
+                    (UInt32)kNumQuickTasks, (UInt32)kSlowRunMSecs, (UInt32)kNumTaskThreads, (UInt32)sQuickTasksTime, theDispatchLatency);
+    
+    TaskThreadPool::RemoveThreads();
+    return TestResult("TaskThreadPoolTest");
+}
@@ -0,0 +1,66 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+/*
+    File:       TestUtils.h
+
+    Contains:   Checks shared by the test programs in this directory.
+                
+                Each test is a program that returns 0 when every check passed.
+                A test run with -b also runs its benchmarks and prints them.
+    
+    
+*/
+
+#ifndef __TESTUTILS_H__
+#define __TESTUTILS_H__
+
+#include <stdio.h>
+#include <string.h>
+#include "OSHeaders.h"
+
+static UInt32 sNumFailedChecks = 0;
+
+#define TEST_CHECK(condition)                                                       \
+    do                                                                              \
+    {                                                                               \
+        if (!(condition))                                                           \
+        {                                                                           \
+            ::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            sNumFailedChecks++;                                                     \
+        }                                                                           \
+    } while (0)
+
+inline Bool16 TestWantsBenchmarks(int argc, char* argv[])
+{
+    return (argc > 1) && (::strcmp(argv[1], "-b") == 0);
+}
+
+inline int TestResult(const char* inTestName)
+{
+    ::printf("%s: %s\n", inTestName, (sNumFailedChecks == 0) ? "passed" : "FAILED");
+    return (sNumFailedChecks == 0) ? 0 : 1;
+}
+
+#endif //__TESTUTILS_H__
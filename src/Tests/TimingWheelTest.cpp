@@ -0,0 +1,237 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// TimingWheelTest:
+//   Runs OSTimingWheel against a plain list of deadlines, with timers spread
+//   over every level and the clock moving in small steps and big jumps.
+//   With -b, also times re-arming timers on expiry against OSHeap.
+
+#include <stdlib.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSHeap.h"
+#include "OSTimingWheel.h"
+#include "TestUtils.h"
+
+enum { kNumTimers = 20000 };
+
+static OSTimingWheelElem    sTimers[kNumTimers];
+static Bool16               sScheduled[kNumTimers];
+
+static UInt32 sRandomSeed = 1;
+static UInt32 Random(UInt32 inRange)
+{
+    sRandomSeed = (sRandomSeed * 1103515245) + 12345;
+    return (sRandomSeed >> 8) % inRange;
+}
+
+static SInt64 RandomDelay()
+{
+    //Mostly short timeouts, like the server's, but some for every level
+    switch (Random(4))
+    {
+        case 0:     return Random(256);
+        case 1:     return Random(256 * 64);
+        case 2:     return Random(256 * 64 * 64);
+        default:    return Random(256 * 64 * 64 * 64);
+    }
+}
+
+static void Schedule(OSTimingWheel* inWheel, UInt32 inIndex, SInt64 inTime)
+{
+    sTimers[inIndex].SetValue(inTime);
+    inWheel->Insert(&sTimers[inIndex]);
+    sScheduled[inIndex] = true;
+}
+
+static void CheckWheel(OSTimingWheel* inWheel, SInt64 inNow)
+{
+    //Everything due has been extracted, and the wheel's next expiration
+    //is never later than the earliest deadline it holds
+    SInt64 theEarliest = -1;
+    UInt32 theNumScheduled = 0;
+    for (UInt32 x = 0; x < kNumTimers; x++)
+    {
+        if (!sScheduled[x])
+            continue;
+        theNumScheduled++;
+        TEST_CHECK(sTimers[x].GetValue() > inNow);
+        if ((theEarliest == -1) || (sTimers[x].GetValue() < theEarliest))
+            theEarliest = sTimers[x].GetValue();
+    }
+    TEST_CHECK(inWheel->GetNumElements() == theNumScheduled);
+    
+    SInt64 theNext = inWheel->GetNextExpiration();
+    if (theEarliest == -1)
+        TEST_CHECK(theNext == -1);
+    else
+    {
+        //It is exact up to the next turn of level 0
+        TEST_CHECK((theNext != -1) && (theNext <= theEarliest));
+        if (theEarliest < ((inNow + 1 + 255) & ~(SInt64)255))
+            TEST_CHECK(theNext == theEarliest);
+    }
+}
+
+static void TestAgainstDeadlineList()
+{
+    SInt64 theNow = 1000000;
+    OSTimingWheel theWheel(theNow);
+    
+    for (UInt32 x = 0; x < kNumTimers; x++)
+        Schedule(&theWheel, x, theNow + RandomDelay());
+    CheckWheel(&theWheel, theNow - 1);
+    
+    for (UInt32 theStep = 0; theStep < 3000; theStep++)
+    {
+        if (Random(50) == 0)
+            theNow += Random(256 * 64 * 64);   //a stall, so several levels cascade at once
+        else
+            theNow += Random(300);
+            
+        for (OSTimingWheelElem* theElem = theWheel.ExtractExpired(theNow); theElem != NULL; theElem = theWheel.ExtractExpired(theNow))
+        {
+            UInt32 theIndex = (UInt32)(theElem - sTimers);
+            TEST_CHECK(theIndex < kNumTimers);
+            TEST_CHECK(sScheduled[theIndex]);
+            TEST_CHECK(theElem->GetValue() <= theNow);
+            TEST_CHECK(!theElem->IsMemberOfAnyWheel());
+            sScheduled[theIndex] = false;
+        }
+        
+        //Cancel some, re-arm some, including a few already in the past
+        for (UInt32 theChange = 0; theChange < 20; theChange++)
+        {
+            UInt32 theIndex = Random(kNumTimers);
+            if (sScheduled[theIndex] && Random(2))
+            {
+                TEST_CHECK(theWheel.Remove(&sTimers[theIndex]) == &sTimers[theIndex]);
+                TEST_CHECK(theWheel.Remove(&sTimers[theIndex]) == NULL);
+                sScheduled[theIndex] = false;
+            }
+            else if (!sScheduled[theIndex])
+            {
+                SInt64 theTime = (Random(10) == 0) ? theNow - Random(100) : theNow + 1 + RandomDelay();
+                Schedule(&theWheel, theIndex, theTime);
+                if (theTime <= theNow)
+                {
+                    TEST_CHECK(theWheel.ExtractExpired(theNow) == &sTimers[theIndex]);
+                    sScheduled[theIndex] = false;
+                }
+            }
+        }
+        
+        if ((theStep % 100) == 0)
+            CheckWheel(&theWheel, theNow);
+    }
+    
+    CheckWheel(&theWheel, theNow);
+    for (UInt32 x = 0; x < kNumTimers; x++)
+    {
+        if (sScheduled[x])
+            (void)theWheel.Remove(&sTimers[x]);
+        sScheduled[x] = false;
+    }
+    TEST_CHECK(theWheel.GetNumElements() == 0);
+}
+
+//
+// Benchmark: kNumBenchTimers timers, each re-armed 1-50 ms out every time it
+// expires, with the clock moving a millisecond at a time
+enum { kNumBenchTimers = 100000, kNumBenchMilSecs = 2000 };
+
+static void BenchmarkWheel()
+{
+    OSTimingWheelElem* theTimers = new OSTimingWheelElem[kNumBenchTimers];
+    SInt64 theNow = 0;
+    OSTimingWheel theWheel(theNow);
+    for (UInt32 x = 0; x < kNumBenchTimers; x++)
+    {
+        theTimers[x].SetValue(1 + Random(50));
+        theWheel.Insert(&theTimers[x]);
+    }
+    
+    UInt64 theNumExpired = 0;
+    SInt64 theStart = OS::Microseconds();
+    for (theNow = 1; theNow <= kNumBenchMilSecs; theNow++)
+    {
+        for (OSTimingWheelElem* theElem = theWheel.ExtractExpired(theNow); theElem != NULL; theElem = theWheel.ExtractExpired(theNow))
+        {
+            theElem->SetValue(theNow + 1 + Random(50));
+            theWheel.Insert(theElem);
+            theNumExpired++;
+        }
+    }
+    SInt64 theTime = OS::Microseconds() - theStart;
+    ::printf("OSTimingWheel: %.1f ns per expire+reschedule (%llu expirations)\n", (theTime * 1000.0) / theNumExpired, (unsigned long long)theNumExpired);
+    for (UInt32 x = 0; x < kNumBenchTimers; x++)
+        (void)theWheel.Remove(&theTimers[x]);
+    delete [] theTimers;
+}
+
+static void BenchmarkHeap()
+{
+    OSHeapElem* theTimers = new OSHeapElem[kNumBenchTimers];
+    OSHeap theHeap;
+    for (UInt32 x = 0; x < kNumBenchTimers; x++)
+    {
+        theTimers[x].SetValue(1 + Random(50));
+        theHeap.Insert(&theTimers[x]);
+    }
+    
+    UInt64 theNumExpired = 0;
+    SInt64 theStart = OS::Microseconds();
+    for (SInt64 theNow = 1; theNow <= kNumBenchMilSecs; theNow++)
+    {
+        while ((theHeap.PeekMin() != NULL) && (theHeap.PeekMin()->GetValue() <= theNow))
+        {
+            OSHeapElem* theElem = theHeap.ExtractMin();
+            theElem->SetValue(theNow + 1 + Random(50));
+            theHeap.Insert(theElem);
+            theNumExpired++;
+        }
+    }
+    SInt64 theTime = OS::Microseconds() - theStart;
+    ::printf("OSHeap:        %.1f ns per expire+reschedule (%llu expirations)\n", (theTime * 1000.0) / theNumExpired, (unsigned long long)theNumExpired);
+    for (UInt32 x = 0; x < kNumBenchTimers; x++)
+        (void)theHeap.Remove(&theTimers[x]);
+    delete [] theTimers;
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    
+    TestAgainstDeadlineList();
+    
+    if (TestWantsBenchmarks(argc, argv))
+    {
+        BenchmarkWheel();
+        BenchmarkHeap();
+    }
+    
+    return TestResult("TimingWheelTest");
+}
@@ -0,0 +1,600 @@
+/*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * Copyright (c) 1999-2003 Apple Computer, Inc.  All Rights Reserved.
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ *
+ */
+//
+// UDPSocketTest:
+//   Sends over loopback through the UDP send batch, and checks that every
+//   packet arrives once, intact and in order, and that nothing goes out
+//   before the batch is flushed. Sends header overlays on referenced
+//   payloads, and packets in pieces, the same way. Reads datagrams back with RecvFromMany, and
+//   checks what it reports about each datagram, and hands them out through a
+//   demuxer by sender, the way an RTCP socket finds each packet's stream.
+//   With -b, compares packets per second sent and received one system call
+//   at a time against batches.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "SafeStdLib.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "UDPSocket.h"
+#include "TestUtils.h"
+
+enum
+{
+    kPacketSize = 1200,         //UInt32
+    kMaxReceived = 256          //UInt32
+};
+
+static UDPSocket* sSender = NULL;
+static UDPSocket* sSender2 = NULL;
+static UDPSocket* sReceiver = NULL;
+
+static char     sReceived[kMaxReceived][kPacketSize + 1];
+static UInt32   sReceivedLen[kMaxReceived];
+static UInt16   sReceivedFromPort[kMaxReceived];
+
+static UDPSocket* MakeSocket()
+{
+    UDPSocket* theSocket = new UDPSocket(NULL, 0);
+    TEST_CHECK(theSocket->Open() == OS_NoErr);
+    TEST_CHECK(theSocket->Bind(INADDR_LOOPBACK, 0) == OS_NoErr);
+    theSocket->SetSocketRcvBufSize(4 * 1024 * 1024);
+    theSocket->SetSocketBufSize(4 * 1024 * 1024);
+    (void)::fcntl(theSocket->GetSocketFD(), F_SETFL, O_NONBLOCK);
+    return theSocket;
+}
+
+static void FillPacket(char* outPacket, UInt32 inSeqNum, UInt32 inLength)
+{
+    for (UInt32 x = 0; x < inLength; x++)
+        outPacket[x] = (char)(inSeqNum * 7 + x);
+    ::memcpy(outPacket, &inSeqNum, sizeof(inSeqNum));
+}
+
+static Bool16 PacketIsIntact(char* inPacket, UInt32 inSeqNum, UInt32 inLength)
+{
+    char theExpected[kPacketSize];
+    FillPacket(theExpected, inSeqNum, inLength);
+    return ::memcmp(inPacket, theExpected, inLength) == 0;
+}
+
+static UInt32 ReceiveAll()
+{
+    UInt32 theNumReceived = 0;
+    UInt32 theAddr = 0;
+    while (theNumReceived < kMaxReceived)
+    {
+        if (sReceiver->RecvFrom(&theAddr, &sReceivedFromPort[theNumReceived], sReceived[theNumReceived],
+                                kPacketSize + 1, &sReceivedLen[theNumReceived]) != OS_NoErr)
+            break;
+        theNumReceived++;
+    }
+    return theNumReceived;
+}
+
+//
+// Sends inNumPackets packets, sequence numbers from 0, inside one batch. A short
+// packet in the middle checks that a run of equal sized packets is cut there.
+static void CheckBatchedSends(UInt32 inNumPackets, UInt32 inShortPacket)
+{
+    char thePacket[kPacketSize];
+    UDPSocket::BeginSendBatch();
+    for (UInt32 x = 0; x < inNumPackets; x++)
+    {
+        UInt32 theLength = (x == inShortPacket) ? kPacketSize / 3 : kPacketSize;
+        FillPacket(thePacket, x, theLength);
+        sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, theLength);
+        
+        //The batch owns a copy, so the caller may reuse its buffer right away
+        ::memset(thePacket, 0xEE, sizeof(thePacket));
+    }
+    UDPSocket::EndSendBatch();
+    
+    UInt32 theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == inNumPackets);
+    for (UInt32 y = 0; y < theNumReceived; y++)
+    {
+        UInt32 theLength = (y == inShortPacket) ? kPacketSize / 3 : kPacketSize;
+        TEST_CHECK(sReceivedLen[y] == theLength);
+        TEST_CHECK(PacketIsIntact(sReceived[y], y, theLength));
+    }
+}
+
+static void CheckBatchFlushing()
+{
+    char thePacket[kPacketSize];
+    FillPacket(thePacket, 0, kPacketSize);
+    
+    //
+    // Nothing goes out until the outermost EndSendBatch
+    UDPSocket::BeginSendBatch();
+    UDPSocket::BeginSendBatch();
+    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    UDPSocket::EndSendBatch();
+    TEST_CHECK(ReceiveAll() == 0);
+    UDPSocket::EndSendBatch();
+    TEST_CHECK(ReceiveAll() == 1);
+    
+    //
+    // A send on another socket flushes what was queued on the first one, so
+    // packets still leave each socket in order.
+    UDPSocket::BeginSendBatch();
+    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    sSender2->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    UInt32 theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == 1);
+    TEST_CHECK((theNumReceived == 0) || (sReceivedFromPort[0] == sSender->GetLocalPort()));
+    UDPSocket::EndSendBatch();
+    theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == 1);
+    TEST_CHECK((theNumReceived == 0) || (sReceivedFromPort[0] == sSender2->GetLocalPort()));
+    
+    //
+    // A full batch goes out without waiting for EndSendBatch
+    UDPSocket::SetSendBatchParams(8, false);
+    UDPSocket::BeginSendBatch();
+    for (UInt32 x = 0; x < 9; x++)
+        sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    TEST_CHECK(ReceiveAll() == 8);
+    UDPSocket::EndSendBatch();
+    TEST_CHECK(ReceiveAll() == 1);
+    
+    //
+    // With batching off, SendToBatched sends at once
+    UDPSocket::SetSendBatchParams(1, false);
+    UDPSocket::BeginSendBatch();
+    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    TEST_CHECK(ReceiveAll() == 1);
+    UDPSocket::EndSendBatch();
+    
+    //Outside of a batch, SendToBatched sends at once too
+    UDPSocket::SetSendBatchParams(64, false);
+    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+    TEST_CHECK(ReceiveAll() == 1);
+}
+
+//
+// Each packet is a header that is copied into the batch, and a payload the
+// batch only points at. The payload must stay valid until the flush; the
+// header buffer is reused right away.
+static void CheckOverlaySends(UInt32 inNumPackets)
+{
+    enum { kHeaderSize = 12 };
+    static char sPayloads[kMaxReceived][kPacketSize];
+    char theHeader[kHeaderSize];
+    
+    UDPSocket::BeginSendBatch();
+    for (UInt32 x = 0; x < inNumPackets; x++)
+    {
+        char thePacket[kPacketSize];
+        FillPacket(thePacket, x, kPacketSize);
+        ::memcpy(theHeader, thePacket, kHeaderSize);
+        ::memcpy(sPayloads[x], thePacket + kHeaderSize, kPacketSize - kHeaderSize);
+        
+        //Every third packet has no overlay, like reflected RTP
+        if ((x % 3) == 2)
+            sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), NULL, 0, thePacket, kPacketSize);
+        else
+            sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), theHeader, kHeaderSize,
+                                    sPayloads[x], kPacketSize - kHeaderSize);
+        ::memset(theHeader, 0xEE, kHeaderSize);
+        
+        //Referenced from the stack for no-overlay packets, so flush those now
+        if ((x % 3) == 2)
+        {
+            UDPSocket::EndSendBatch();
+            UDPSocket::BeginSendBatch();
+        }
+    }
+    UDPSocket::EndSendBatch();
+    
+    UInt32 theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == inNumPackets);
+    for (UInt32 y = 0; y < theNumReceived; y++)
+    {
+        TEST_CHECK(sReceivedLen[y] == kPacketSize);
+        TEST_CHECK(PacketIsIntact(sReceived[y], y, kPacketSize));
+    }
+}
+
+//
+// Each packet is sent twice, flat and then in five pieces that alternate
+// between a buffer the caller reuses, which the batch must copy, and memory
+// that stays put, as a movie's media data does. Both copies must arrive
+// the same.
+static void CheckVectorSends(UInt32 inNumPackets)
+{
+    enum { kHeaderSize = 12, kNumPieces = 5 };
+    static char sMediaData[kMaxReceived / 2][kPacketSize];
+    static const UInt32 sPieceLengths[kNumPieces] = { kHeaderSize, 500, 20, 600, 68 };
+    char theBuffer[kPacketSize];
+    
+    UDPSocket::BeginSendBatch();
+    for (UInt32 x = 0; x < inNumPackets; x++)
+    {
+        char thePacket[kPacketSize];
+        FillPacket(thePacket, x, kPacketSize);
+        sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+        
+        struct iovec theVector[kNumPieces];
+        UInt32 theBufferLength = 0;
+        UInt32 theMediaLength = 0;
+        UInt32 thePacketOffset = 0;
+        for (UInt32 thePiece = 0; thePiece < kNumPieces; thePiece++)
+        {
+            char* thePieceData = NULL;
+            if ((thePiece & 1) == 0)
+            {
+                thePieceData = &theBuffer[theBufferLength];
+                theBufferLength += sPieceLengths[thePiece];
+            }
+            else
+            {
+                thePieceData = &sMediaData[x][theMediaLength];
+                theMediaLength += sPieceLengths[thePiece];
+            }
+            ::memcpy(thePieceData, &thePacket[thePacketOffset], sPieceLengths[thePiece]);
+            theVector[thePiece].iov_base = thePieceData;
+            theVector[thePiece].iov_len = sPieceLengths[thePiece];
+            thePacketOffset += sPieceLengths[thePiece];
+        }
+        Assert(thePacketOffset == kPacketSize);
+        sSender->SendToBatchedV(INADDR_LOOPBACK, sReceiver->GetLocalPort(), theVector, kNumPieces, theBuffer, theBufferLength);
+        ::memset(theBuffer, 0xEE, sizeof(theBuffer));
+    }
+    UDPSocket::EndSendBatch();
+    
+    UInt32 theNumReceived = ReceiveAll();
+    TEST_CHECK(theNumReceived == inNumPackets * 2);
+    for (UInt32 y = 0; y + 1 < theNumReceived; y += 2)
+    {
+        TEST_CHECK((sReceivedLen[y] == kPacketSize) && (sReceivedLen[y + 1] == kPacketSize));
+        TEST_CHECK(PacketIsIntact(sReceived[y], y / 2, kPacketSize));
+        TEST_CHECK(::memcmp(sReceived[y], sReceived[y + 1], kPacketSize) == 0);
+    }
+}
+
+static void CheckReceiveBatches()
+{
+    enum { kNumPackets = 40, kNumBuffers = 16 };
+    UDPSocket* theReceiver = MakeSocket();
+    TEST_CHECK(theReceiver->EnableReceiveTimestamps() == OS_NoErr);
+    TEST_CHECK(theReceiver->EnableDropCounting() == OS_NoErr);
+    
+    char thePacket[kPacketSize];
+    void* theBuffers[kNumBuffers];
+    for (UInt32 x = 0; x < kNumBuffers; x++)
+        theBuffers[x] = sReceived[x];
+    UDPRecvInfo theInfo[kNumBuffers];
+    UInt32 theNumReceived = 0;
+    
+    TEST_CHECK(theReceiver->RecvFromMany(theBuffers, kPacketSize, kNumBuffers, theInfo, &theNumReceived) == EAGAIN);
+    TEST_CHECK(theNumReceived == 0);
+    
+    //
+    // Datagrams come back in order across calls, each with its own length,
+    // sender and arrival time.
+    SInt64 theSendTime = OS::Milliseconds();
+    for (UInt32 x = 0; x < kNumPackets; x++)
+    {
+        FillPacket(thePacket, x, kPacketSize - x);
+        (void)sSender->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, kPacketSize - x);
+    }
+    UInt32 theNextSeqNum = 0;
+    while (theReceiver->RecvFromMany(theBuffers, kPacketSize, kNumBuffers, theInfo, &theNumReceived) == OS_NoErr)
+    {
+        TEST_CHECK((theNumReceived > 0) && (theNumReceived <= kNumBuffers));
+        for (UInt32 y = 0; y < theNumReceived; y++, theNextSeqNum++)
+        {
+            TEST_CHECK(theInfo[y].fRecvLen == kPacketSize - theNextSeqNum);
+            TEST_CHECK(PacketIsIntact((char*)theBuffers[y], theNextSeqNum, kPacketSize - theNextSeqNum));
+            TEST_CHECK(theInfo[y].fRemoteAddr == INADDR_LOOPBACK);
+            TEST_CHECK(theInfo[y].fRemotePort == sSender->GetLocalPort());
+            TEST_CHECK(!theInfo[y].fTruncated);
+#if UDPRECVBATCHING
+            //Kernel timestamps are in OS::Milliseconds() terms, give or take the clock's rounding
+            TEST_CHECK(theInfo[y].fArrivalTimeInMilSecs >= theSendTime - 2);
+            TEST_CHECK(theInfo[y].fArrivalTimeInMilSecs <= OS::Milliseconds() + 2);
+#endif
+        }
+    }
+    TEST_CHECK(theNextSeqNum == kNumPackets);
+    TEST_CHECK(theReceiver->GetNumKernelDrops() == 0);
+    
+    //A datagram bigger than the buffer is cut short and flagged
+    FillPacket(thePacket, 0, kPacketSize);
+    (void)sSender->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, kPacketSize);
+    TEST_CHECK(theReceiver->RecvFromMany(theBuffers, kPacketSize / 2, kNumBuffers, theInfo, &theNumReceived) == OS_NoErr);
+    TEST_CHECK(theNumReceived == 1);
+#if UDPRECVBATCHING
+    TEST_CHECK(theInfo[0].fTruncated);
+#endif
+    
+#if UDPRECVBATCHING
+    //
+    // Overflow a small receive buffer. The drop count rides on datagrams queued
+    // after the drops, so drain the buffer and send one more to read it.
+    theReceiver->SetSocketRcvBufSize(4096);
+    for (UInt32 x = 0; x < kNumPackets; x++)
+        (void)sSender->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, kPacketSize);
+    while (theReceiver->RecvFromMany(theBuffers, kPacketSize, kNumBuffers, theInfo, &theNumReceived) == OS_NoErr)
+        { }
+    (void)sSender->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, kPacketSize);
+    TEST_CHECK(theReceiver->RecvFromMany(theBuffers, kPacketSize, kNumBuffers, theInfo, &theNumReceived) == OS_NoErr);
+    TEST_CHECK(theReceiver->GetNumKernelDrops() > 0);
+    TEST_CHECK(theReceiver->GetNumKernelDrops() < kNumPackets);
+#endif
+    
+    delete theReceiver;
+}
+
+//
+// Many clients' RTCP arrives on one socket, interleaved. Each batch is looked
+// up in the socket's demuxer, which must give every datagram to the task
+// registered for its sender, and nothing for senders without one.
+class CountingDemuxerTask : public UDPDemuxerTask
+{
+    public:
+        CountingDemuxerTask() : fNumReceived(0), fNextSeqNum(0) {}
+        UInt32  fNumReceived;
+        UInt32  fNextSeqNum;
+};
+
+static void CheckDemuxedReceives()
+{
+    enum { kNumSenders = 8, kNumRegistered = 6, kNumRounds = 60, kBatchSize = 32 };
+    UDPSocket* theReceiver = new UDPSocket(NULL, UDPSocket::kWantsDemuxer);
+    TEST_CHECK(theReceiver->Open() == OS_NoErr);
+    TEST_CHECK(theReceiver->Bind(INADDR_LOOPBACK, 0) == OS_NoErr);
+    theReceiver->SetSocketRcvBufSize(4 * 1024 * 1024);
+    (void)::fcntl(theReceiver->GetSocketFD(), F_SETFL, O_NONBLOCK);
+    UDPDemuxer* theDemuxer = theReceiver->GetDemuxer();
+    TEST_CHECK(theDemuxer != NULL);
+    
+    UDPSocket* theSenders[kNumSenders];
+    CountingDemuxerTask theTasks[kNumSenders];
+    for (UInt32 x = 0; x < kNumSenders; x++)
+    {
+        theSenders[x] = MakeSocket();
+        if (x < kNumRegistered)
+            TEST_CHECK(theDemuxer->RegisterTask(INADDR_LOOPBACK, theSenders[x]->GetLocalPort(), &theTasks[x]) == OS_NoErr);
+    }
+    TEST_CHECK(theDemuxer->RegisterTask(INADDR_LOOPBACK, theSenders[0]->GetLocalPort(), &theTasks[1]) == EPERM);
+    
+    //A short receiver report's worth from each sender in turn; the sequence
+    //number rides in the first bytes
+    char thePacket[kPacketSize];
+    for (UInt32 theRound = 0; theRound < kNumRounds; theRound++)
+    {
+        for (UInt32 x = 0; x < kNumSenders; x++)
+        {
+            FillPacket(thePacket, theRound, 84);
+            (void)theSenders[x]->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, 84);
+        }
+    }
+    
+    void* theBuffers[kBatchSize];
+    for (UInt32 y = 0; y < kBatchSize; y++)
+        theBuffers[y] = sReceived[y];
+    UDPRecvInfo theInfo[kBatchSize];
+    UInt32 theNumReceived = 0;
+    UInt32 theNumUnknown = 0;
+    while (theReceiver->RecvFromMany(theBuffers, kPacketSize, kBatchSize, theInfo, &theNumReceived) == OS_NoErr)
+    {
+        OSMutexLocker locker(theDemuxer->GetMutex());
+        for (UInt32 z = 0; z < theNumReceived; z++)
+        {
+            CountingDemuxerTask* theTask = (CountingDemuxerTask*)theDemuxer->GetTask(theInfo[z].fRemoteAddr, theInfo[z].fRemotePort);
+            if (theTask == NULL)
+            {
+                theNumUnknown++;
+                continue;
+            }
+            TEST_CHECK(theInfo[z].fRemotePort == theSenders[theTask - theTasks]->GetLocalPort());
+            TEST_CHECK(PacketIsIntact((char*)theBuffers[z], theTask->fNextSeqNum, 84));
+            theTask->fNextSeqNum++;
+            theTask->fNumReceived++;
+        }
+    }
+    for (UInt32 x = 0; x < kNumRegistered; x++)
+        TEST_CHECK(theTasks[x].fNumReceived == kNumRounds);
+    TEST_CHECK(theNumUnknown == (kNumSenders - kNumRegistered) * kNumRounds);
+    
+    //Once a task is unregistered, its sender's packets have nowhere to go
+    TEST_CHECK(theDemuxer->UnregisterTask(INADDR_LOOPBACK, theSenders[0]->GetLocalPort(), &theTasks[0]) == OS_NoErr);
+    TEST_CHECK(theDemuxer->UnregisterTask(INADDR_LOOPBACK, theSenders[0]->GetLocalPort(), &theTasks[0]) == EPERM);
+    (void)theSenders[0]->SendTo(INADDR_LOOPBACK, theReceiver->GetLocalPort(), thePacket, 84);
+    TEST_CHECK(theReceiver->RecvFromMany(theBuffers, kPacketSize, kBatchSize, theInfo, &theNumReceived) == OS_NoErr);
+    TEST_CHECK((theNumReceived == 1) && (theDemuxer->GetTask(theInfo[0].fRemoteAddr, theInfo[0].fRemotePort) == NULL));
+    
+    for (UInt32 x = 1; x < kNumRegistered; x++)
+        (void)theDemuxer->UnregisterTask(INADDR_LOOPBACK, theSenders[x]->GetLocalPort(), &theTasks[x]);
+    for (UInt32 x = 0; x < kNumSenders; x++)
+        delete theSenders[x];
+    delete theReceiver;
+}
+
+static void RunReceiveBenchmark()
+{
+    enum { kNumPackets = 200000, kBurst = 32 };
+    char thePacket[kPacketSize];
+    FillPacket(thePacket, 0, kPacketSize);
+    void* theBuffers[kBurst];
+    for (UInt32 x = 0; x < kBurst; x++)
+        theBuffers[x] = sReceived[x];
+    UDPRecvInfo theInfo[kBurst];
+    UInt32 theNumReceived = 0;
+    
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        SInt64 theRecvTime = 0;
+        UInt32 theTotalReceived = 0;
+        for (UInt32 x = 0; x < kNumPackets; x += kBurst)
+        {
+            UDPSocket::BeginSendBatch();
+            for (UInt32 y = 0; y < kBurst; y++)
+                sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+            UDPSocket::EndSendBatch();
+            
+            SInt64 theStart = OS::Microseconds();
+            if (theMode == 0)
+            {
+                while (sReceiver->RecvFrom(&theInfo[0].fRemoteAddr, &theInfo[0].fRemotePort, theBuffers[0],
+                                            kPacketSize, &theInfo[0].fRecvLen) == OS_NoErr)
+                    theTotalReceived++;
+            }
+            else
+            {
+                while (sReceiver->RecvFromMany(theBuffers, kPacketSize, kBurst, theInfo, &theNumReceived) == OS_NoErr)
+                    theTotalReceived += theNumReceived;
+            }
+            theRecvTime += OS::Microseconds() - theStart;
+        }
+        ::printf("UDPSocketTest: %-13s %llu packets/sec received\n", (theMode == 0) ? "recvfrom" : "recvmmsg",
+                    (unsigned long long)(((SInt64)theTotalReceived * 1000000) / ((theRecvTime > 0) ? theRecvTime : 1)));
+    }
+}
+
+static void RunBenchmark()
+{
+    enum { kNumPackets = 200000, kBurst = 32 };
+    char thePacket[kPacketSize];
+    FillPacket(thePacket, 0, kPacketSize);
+    char theDrain[kPacketSize];
+    UInt32 theAddr = 0;
+    UInt16 thePort = 0;
+    UInt32 theLen = 0;
+    
+    for (UInt32 theMode = 0; theMode < 3; theMode++)
+    {
+        UDPSocket::SetSendBatchParams((theMode == 0) ? 1 : 64, theMode == 2);
+        SInt64 theStart = OS::Microseconds();
+        for (UInt32 x = 0; x < kNumPackets; x += kBurst)
+        {
+            UDPSocket::BeginSendBatch();
+            for (UInt32 y = 0; y < kBurst; y++)
+                sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePacket, kPacketSize);
+            UDPSocket::EndSendBatch();
+            
+            //Keep the receive buffer from filling, so every mode does the same work
+            while (sReceiver->RecvFrom(&theAddr, &thePort, theDrain, kPacketSize, &theLen) == OS_NoErr)
+                { }
+        }
+        SInt64 theElapsed = OS::Microseconds() - theStart;
+        const char* theModeName[] = { "sendto", "sendmmsg", "sendmmsg+GSO" };
+        ::printf("UDPSocketTest: %-13s %llu packets/sec (including receive)\n", theModeName[theMode],
+                    (unsigned long long)(((SInt64)kNumPackets * 1000000) / ((theElapsed > 0) ? theElapsed : 1)));
+    }
+}
+
+//
+// One payload fanned out to many outputs, as a ReflectorSender does, either
+// copied into the batch for each output or referenced by all of them.
+static void RunFanOutBenchmark()
+{
+    enum { kNumPackets = 200000, kNumOutputs = 64 };
+    char thePayload[kPacketSize];
+    FillPacket(thePayload, 0, kPacketSize);
+    char theDrain[kPacketSize];
+    UInt32 theAddr = 0;
+    UInt16 thePort = 0;
+    UInt32 theLen = 0;
+    
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        SInt64 theSendTime = 0;
+        for (UInt32 x = 0; x < kNumPackets; x += kNumOutputs)
+        {
+            SInt64 theStart = OS::Microseconds();
+            UDPSocket::BeginSendBatch();
+            for (UInt32 y = 0; y < kNumOutputs; y++)
+            {
+                if (theMode == 0)
+                    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), thePayload, kPacketSize);
+                else
+                    sSender->SendToBatched(INADDR_LOOPBACK, sReceiver->GetLocalPort(), NULL, 0, thePayload, kPacketSize);
+            }
+            UDPSocket::EndSendBatch();
+            theSendTime += OS::Microseconds() - theStart;
+            
+            while (sReceiver->RecvFrom(&theAddr, &thePort, theDrain, kPacketSize, &theLen) == OS_NoErr)
+                { }
+        }
+        ::printf("UDPSocketTest: fan-out %-10s %llu ns per packet sent, %lu payload bytes copied per %d outputs\n",
+                    (theMode == 0) ? "copied" : "referenced",
+                    (unsigned long long)((theSendTime * 1000) / kNumPackets),
+                    (theMode == 0) ? (UInt32)kPacketSize * kNumOutputs : 0, kNumOutputs);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    OS::Initialize();
+    OSThread::Initialize();
+    Socket::Initialize();
+    
+    sSender = MakeSocket();
+    sSender2 = MakeSocket();
+    sReceiver = MakeSocket();
+    
+    UDPSocket::SetSendBatchParams(64, false);
+    CheckBatchedSends(50, 20);
+    CheckBatchFlushing();
+    
+    //
+    // With GSO, equal sized packets to one address go out as one send and are
+    // split up again by the kernel. Where GSO isn't supported, the batch falls
+    // back to one packet per send, and the result must be the same.
+    UDPSocket::SetSendBatchParams(64, true);
+    CheckBatchedSends(40, 39);
+    CheckBatchedSends(64, 10);
+    CheckOverlaySends(50);
+    CheckVectorSends(50);
+    UDPSocket::SetSendBatchParams(64, false);
+    CheckOverlaySends(50);
+    CheckVectorSends(50);
+    UDPSocket::SetSendBatchParams(1, false);
+    CheckVectorSends(50);
+    UDPSocket::SetSendBatchParams(64, false);
+    
+    CheckReceiveBatches();
+    CheckDemuxedReceives();
+    
+    if (TestWantsBenchmarks(argc, argv))
+    {
+        RunBenchmark();
+        UDPSocket::SetSendBatchParams(64, false);
+        RunReceiveBenchmark();
+        RunFanOutBenchmark();
+    }
+        
+    delete sSender;
+    delete sSender2;
+    delete sReceiver;
+    return TestResult("UDPSocketTest");
+}